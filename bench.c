@@ -0,0 +1,1115 @@
+/* bench.c
+ * Memory-layout benchmarks for libdict
+ * Copyright (C) 2001-2011 Farooq Mela */
+
+#define _DEFAULT_SOURCE		/* For syscall(). */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#ifdef __linux__
+# include <sys/syscall.h>
+# include <linux/perf_event.h>
+#endif
+
+#include "dict.h"
+#include "dict_inline.h"
+
+const char appname[] = "bench";
+
+#ifdef __GNUC__
+# define NORETURN	__attribute__((__noreturn__))
+#else
+# define NORETURN
+#endif
+
+void quit(const char *, ...) NORETURN;
+
+typedef struct {
+    double	nsec;		/* Per operation. */
+    long long	tlb_misses;	/* Per operation times 1000, or -1. */
+} sample;
+
+static int counter_open(void);
+static long long counter_read(int fd);
+static double now(void);
+static uint64_t rng(uint64_t *state);
+static void report(const char *what, const sample *before,
+		   const sample *after);
+
+static sample search_run(dict *dct, size_t count, uint64_t *state);
+
+static void bench_arena(size_t count);
+static void bench_relayout(size_t count);
+static void bench_inline(size_t count);
+static void bench_remove(size_t count);
+static void bench_relaxed(size_t count);
+static void bench_join(size_t count);
+static void bench_learned(size_t count);
+static void bench_kary(size_t count);
+static void bench_frozen(size_t count);
+static void bench_shm(size_t count);
+static void bench_sample(size_t count);
+static void bench_cursor(size_t count);
+static void bench_export(size_t count);
+
+int
+main(int argc, char **argv)
+{
+    if (argc < 2 || argc > 3) {
+	fprintf(stderr, "usage: %s [bench] [count]\n", appname);
+	fprintf(stderr, "bench: specifies the benchmark:\n");
+	fprintf(stderr, "   arena: red-black tree on malloc() vs. huge page"
+		" arena\n");
+	fprintf(stderr, "   relayout: height-balanced and red-black trees before"
+		" vs. after relayout\n");
+	fprintf(stderr, "   inline: dict_search() vs. dict_inline.h search and"
+		" iteration\n");
+	fprintf(stderr, "   remove: one dict_remove() per key vs."
+		" dict_remove_if() and dict_remove_many()\n");
+	fprintf(stderr, "   relaxed: red-black tree insertion bursts with"
+		" eager vs. deferred rebalancing\n");
+	fprintf(stderr, "   join: intersection by iteration and dict_search()"
+		" vs. dict_join\n");
+	fprintf(stderr, "   learned: height-balanced tree vs. learned index"
+		" searches\n");
+	fprintf(stderr, "   kary: binary search of a sorted array vs. red-black"
+		" tree and k-ary index searches, on one core and on all\n");
+	fprintf(stderr, "   frozen: hashtable vs. frozen hashtable searches, and"
+		" building vs. loading one\n");
+	fprintf(stderr, "   shm: hashtable and red-black tree searches in"
+		" private vs. shared memory\n");
+	fprintf(stderr, "   sample: red-black tree searches without vs. with"
+		" latency sampling\n");
+	fprintf(stderr, "   cursor: paginated red-black tree scans by seeking"
+		" vs. with a cursor\n");
+	fprintf(stderr, "   export: red-black tree copied into arrays by"
+		" iterator vs. dict_export(), on one core and on all\n");
+	exit(EXIT_FAILURE);
+    }
+
+    size_t count = 4000000;
+    if (argc == 3 && (count = strtoul(argv[2], NULL, 10)) == 0)
+	quit("count must be positive");
+
+    if (strcmp(argv[1], "arena") == 0)
+	bench_arena(count);
+    else if (strcmp(argv[1], "relayout") == 0)
+	bench_relayout(count);
+    else if (strcmp(argv[1], "inline") == 0)
+	bench_inline(count);
+    else if (strcmp(argv[1], "remove") == 0)
+	bench_remove(count);
+    else if (strcmp(argv[1], "relaxed") == 0)
+	bench_relaxed(count);
+    else if (strcmp(argv[1], "join") == 0)
+	bench_join(count);
+    else if (strcmp(argv[1], "learned") == 0)
+	bench_learned(count);
+    else if (strcmp(argv[1], "kary") == 0)
+	bench_kary(count);
+    else if (strcmp(argv[1], "frozen") == 0)
+	bench_frozen(count);
+    else if (strcmp(argv[1], "shm") == 0)
+	bench_shm(count);
+    else if (strcmp(argv[1], "sample") == 0)
+	bench_sample(count);
+    else if (strcmp(argv[1], "cursor") == 0)
+	bench_cursor(count);
+    else if (strcmp(argv[1], "export") == 0)
+	bench_export(count);
+    else
+	quit("unknown benchmark '%s'", argv[1]);
+
+    return EXIT_SUCCESS;
+}
+
+/* Builds a tree of COUNT integer keys inserted in random order, then times
+ * COUNT random searches on it. */
+static sample
+arena_run(size_t count)
+{
+    dict *dct = rb_dict_new(dict_ptr_cmp, NULL);
+    uint64_t state = 1;
+    for (size_t i = 0; i < count; i++) {
+	void *key = (void *)(uintptr_t)(rng(&state) % count + 1);
+	*dict_insert(dct, key, NULL) = key;
+    }
+    sample s = search_run(dct, count, &state);
+    dict_free(dct);
+    return s;
+}
+
+static void
+bench_arena(size_t count)
+{
+    printf("%zu keys, %zu searches\n", count, count);
+
+    sample before = arena_run(count);
+
+    dict_malloc_func = dict_arena_malloc;
+    dict_free_func = dict_arena_free;
+    sample after = arena_run(count);
+    dict_malloc_func = malloc;
+    dict_free_func = free;
+
+    dict_arena_stats stats;
+    dict_arena_get_stats(&stats);
+    printf("arena: %zu regions, %zu advised for huge pages, %zu fallbacks\n",
+	   stats.regions, stats.huge_regions, stats.fallbacks);
+    report("search", &before, &after);
+}
+
+/* Builds a tree of COUNT integer keys, then scatters its nodes by removing
+ * and reinserting COUNT random keys. */
+static void
+relayout_run(const char *name, dict *dct, size_t count,
+	     bool (*relayout)(void *, dict_layout))
+{
+    uint64_t state = 1;
+    for (size_t i = 0; i < count; i++) {
+	void *key = (void *)(uintptr_t)(rng(&state) % count + 1);
+	*dict_insert(dct, key, NULL) = key;
+    }
+    for (size_t i = 0; i < count; i++) {
+	void *key = (void *)(uintptr_t)(rng(&state) % count + 1);
+	dict_remove(dct, key);
+	key = (void *)(uintptr_t)(rng(&state) % count + 1);
+	*dict_insert(dct, key, NULL) = key;
+    }
+
+    printf("%s: %zu keys, %zu searches\n", name, dict_count(dct), count);
+    sample before = search_run(dct, count, &state);
+    double start = now();
+    if (!relayout(dict_private(dct), DICT_LAYOUT_BFS))
+	quit("out of memory");
+    printf("bfs relayout: %.1f ms\n", (now() - start) * 1e3);
+    sample bfs = search_run(dct, count, &state);
+    start = now();
+    if (!relayout(dict_private(dct), DICT_LAYOUT_VEB))
+	quit("out of memory");
+    printf("veb relayout: %.1f ms\n", (now() - start) * 1e3);
+    sample veb = search_run(dct, count, &state);
+    report("bfs", &before, &bfs);
+    report("veb", &before, &veb);
+    dict_free(dct);
+}
+
+static void
+bench_relayout(size_t count)
+{
+    relayout_run("hb_tree", hb_dict_new(dict_ptr_cmp, NULL), count,
+		 (bool (*)(void *, dict_layout))hb_tree_relayout);
+    relayout_run("rb_tree", rb_dict_new(dict_ptr_cmp, NULL), count,
+		 (bool (*)(void *, dict_layout))rb_tree_relayout);
+}
+
+/* Times COUNT searches for random keys in [1, COUNT] through SEARCH, which
+ * is expanded in the loop so that an inline function gets inlined. */
+#define INLINE_SEARCH_RUN(s, search, container, count, state) \
+    do { \
+	size_t found = 0; \
+	double run_start = now(); \
+	for (size_t i = 0; i < (count); i++) { \
+	    void *key = (void *)(uintptr_t)(rng(state) % (count) + 1); \
+	    found += search((container), key) != NULL; \
+	} \
+	(s).nsec = (now() - run_start) * 1e9 / (count); \
+	(s).tlb_misses = -1; \
+	if (found == 0) \
+	    quit("no keys found"); \
+    } while (0)
+
+static unsigned
+ptr_hash(const void *key)
+{
+    return (unsigned)(uintptr_t)key * 2654435761U;
+}
+
+static dict *
+inline_fill(dict *dct, size_t count, uint64_t *state)
+{
+    for (size_t i = 0; i < count; i++) {
+	void *key = (void *)(uintptr_t)(rng(state) % count + 1);
+	*dict_insert(dct, key, NULL) = key;
+    }
+    return dct;
+}
+
+static void
+bench_inline(size_t count)
+{
+    uint64_t state = 1;
+    sample before, after;
+
+    dict *dct = inline_fill(rb_dict_new(dict_ptr_cmp, NULL), count, &state);
+    rb_tree *tree = dict_private(dct);
+    printf("rb_tree: %zu keys, %zu searches\n", dict_count(dct), count);
+    INLINE_SEARCH_RUN(before, dict_search, dct, count, &state);
+    INLINE_SEARCH_RUN(after, rb_tree_search_inline, tree, count, &state);
+    report("search", &before, &after);
+
+    uintptr_t sum = 0;
+    dict_itor *ditor = dict_itor_new(dct);
+    double start = now();
+    for (dict_itor_first(ditor); dict_itor_valid(ditor); dict_itor_next(ditor))
+	sum += (uintptr_t)dict_itor_key(ditor);
+    before.nsec = (now() - start) * 1e9 / dict_count(dct);
+    dict_itor_free(ditor);
+    rb_itor *itor = rb_itor_new(tree);
+    start = now();
+    for (bool ok = rb_itor_first(itor); ok; ok = rb_itor_next_inline(itor))
+	sum -= (uintptr_t)rb_itor_key_inline(itor);
+    after.nsec = (now() - start) * 1e9 / dict_count(dct);
+    rb_itor_free(itor);
+    if (sum != 0)
+	quit("iterations disagree");
+    report("iterate", &before, &after);
+    dict_free(dct);
+
+    dct = inline_fill(hashtable_dict_new(dict_ptr_cmp, ptr_hash, NULL,
+					 (unsigned)count),
+		      count, &state);
+    printf("hashtable: %zu keys, %zu searches\n", dict_count(dct), count);
+    INLINE_SEARCH_RUN(before, dict_search, dct, count, &state);
+    INLINE_SEARCH_RUN(after, hashtable_search_inline, dict_private(dct),
+		      count, &state);
+    report("search", &before, &after);
+    dict_free(dct);
+}
+
+static bool
+remove_divisible(const void *key, void *datum, void *ctx)
+{
+    (void)datum;
+    return (uintptr_t)key % *(uintptr_t *)ctx == 0;
+}
+
+/* Builds a red-black tree of the integer keys [1, COUNT]. */
+static dict *
+remove_fill(size_t count)
+{
+    dict *dct = rb_dict_new(dict_ptr_cmp, NULL);
+    for (size_t i = 0; i < count; i++) {
+	void *key = (void *)(uintptr_t)(i + 1);
+	*dict_insert(dct, key, NULL) = key;
+    }
+    return dct;
+}
+
+/* Times removing the keys divisible by DIVISOR: collecting them and removing
+ * them one at a time vs. dict_remove_if(), then removing them in random order
+ * one at a time vs. dict_remove_many(). */
+static void
+remove_run(size_t count, uintptr_t divisor)
+{
+    const void **keys = malloc(count * sizeof(*keys));
+    const void **sorted = malloc(count * sizeof(*sorted));
+    if (!keys || !sorted)
+	quit("out of memory");
+    size_t nkeys = 0;
+    for (uintptr_t key = divisor; key <= count; key += divisor)
+	keys[nkeys++] = (const void *)key;
+    uint64_t state = 1;
+    for (size_t i = nkeys; i > 1; i--) {
+	size_t j = rng(&state) % i;
+	const void *t = keys[i - 1]; keys[i - 1] = keys[j]; keys[j] = t;
+    }
+    printf("1/%zu of %zu keys\n", (size_t)divisor, count);
+
+    /* All four trees are built before any is freed, so that each has its nodes
+     * laid out alike. */
+    dict *dct[4];
+    for (int i = 0; i < 4; i++)
+	dct[i] = remove_fill(count);
+
+    double start = now();
+    dict_itor *itor = dict_itor_new(dct[0]);
+    size_t n = 0;
+    for (dict_itor_first(itor); dict_itor_valid(itor); dict_itor_next(itor))
+	if (remove_divisible(dict_itor_key(itor), NULL, &divisor))
+	    sorted[n++] = dict_itor_key(itor);
+    dict_itor_free(itor);
+    for (size_t i = 0; i < n; i++)
+	dict_remove(dct[0], sorted[i]);
+    sample before = { (now() - start) * 1e9 / nkeys, -1 };
+
+    start = now();
+    if (dict_remove_if(dct[1], remove_divisible, &divisor) != nkeys)
+	quit("dict_remove_if() missed keys");
+    sample after = { (now() - start) * 1e9 / nkeys, -1 };
+    report("rm_if", &before, &after);
+
+    start = now();
+    for (size_t i = 0; i < nkeys; i++)
+	dict_remove(dct[2], keys[i]);
+    before.nsec = (now() - start) * 1e9 / nkeys;
+
+    start = now();
+    if (dict_remove_many(dct[3], keys, nkeys) != nkeys)
+	quit("dict_remove_many() missed keys");
+    after.nsec = (now() - start) * 1e9 / nkeys;
+    report("rm_many", &before, &after);
+
+    for (int i = 0; i < 4; i++)
+	dict_free(dct[i]);
+    free(sorted);
+    free(keys);
+}
+
+static void
+bench_remove(size_t count)
+{
+    remove_run(count, 2);
+    remove_run(count, 16);
+    remove_run(count, 1024);
+}
+
+/* Inserts a burst of COUNT / 2 random keys in [1, COUNT] into DCT's tree,
+ * returning the time per insertion. */
+static double
+relaxed_burst(dict *dct, size_t count)
+{
+    uint64_t state = 2;
+    rb_tree *tree = dict_private(dct);
+    double start = now();
+    for (size_t i = 0; i < count / 2; i++) {
+	void *key = (void *)(uintptr_t)(rng(&state) % count + 1);
+	*rb_tree_insert(tree, key, NULL) = key;
+    }
+    return (now() - start) * 1e9 / (count / 2);
+}
+
+/* Times a burst of insertions into a red-black tree of COUNT / 2 random keys
+ * with eager vs. deferred rebalancing, then searches in the eager tree vs. the
+ * relaxed one before its rebalancing is done. */
+static void
+bench_relaxed(size_t count)
+{
+    printf("%zu keys, then a burst of %zu insertions\n", count / 2, count / 2);
+
+    dict *dct[2];
+    for (int i = 0; i < 2; i++) {
+	uint64_t state = 1;
+	dct[i] = rb_dict_new(dict_ptr_cmp, NULL);
+	for (size_t j = 0; j < count / 2; j++) {
+	    void *key = (void *)(uintptr_t)(rng(&state) % count + 1);
+	    *dict_insert(dct[i], key, NULL) = key;
+	}
+    }
+    if (!rb_tree_set_relaxed(dict_private(dct[1]), true))
+	quit("out of memory");
+
+    sample before = { relaxed_burst(dct[0], count), -1 };
+    sample after = { relaxed_burst(dct[1], count), -1 };
+    report("insert", &before, &after);
+
+    uint64_t state = 3;
+    before = search_run(dct[0], count, &state);
+    state = 3;
+    after = search_run(dct[1], count, &state);
+    report("search", &before, &after);
+
+    double start = now();
+    rb_tree_rebalance_step(dict_private(dct[1]), SIZE_MAX);
+    double fixup = (now() - start) * 1e9 / (count / 2);
+    printf("deferred rebalancing: %.1f ns per insertion, height %zu vs. %zu\n",
+	   fixup, rb_tree_height(dict_private(dct[0])),
+	   rb_tree_height(dict_private(dct[1])));
+
+    for (int i = 0; i < 2; i++)
+	dict_free(dct[i]);
+}
+
+/* Times intersecting a red-black tree of the even keys in [1, COUNT] with a
+ * skiplist of one in STRIDE keys of [1, COUNT] chosen at random: walking the
+ * skiplist and searching the tree for each key vs. a join of the two. */
+static void
+join_run(size_t count, uintptr_t stride)
+{
+    printf("1/2 of %zu keys joined with 1/%zu\n", count, (size_t)stride);
+    dict *dct[2] = {
+	rb_dict_new(dict_ptr_cmp, NULL),
+	skiplist_dict_new(dict_ptr_cmp, NULL, 20),
+    };
+    for (uintptr_t key = 2; key <= count; key += 2)
+	*dict_insert(dct[0], (void *)key, NULL) = (void *)key;
+    uint64_t state = 1;
+    size_t nkeys = 0;
+    for (uintptr_t key = 1; key <= count; key++)
+	if (rng(&state) % stride == 0) {
+	    *dict_insert(dct[1], (void *)key, NULL) = (void *)key;
+	    nkeys++;
+	}
+
+    size_t found[2] = { 0, 0 };
+    double start = now();
+    dict_itor *itor = dict_itor_new(dct[1]);
+    for (dict_itor_first(itor); dict_itor_valid(itor); dict_itor_next(itor))
+	found[0] += dict_search(dct[0], dict_itor_key(itor)) != NULL;
+    dict_itor_free(itor);
+    sample before = { (now() - start) * 1e9 / nkeys, -1 };
+
+    start = now();
+    dict_join *join = dict_join_new(dct, 2, dict_ptr_cmp);
+    if (!join)
+	quit("out of memory");
+    while (dict_join_next(join))
+	found[1]++;
+    dict_join_free(join);
+    sample after = { (now() - start) * 1e9 / nkeys, -1 };
+    if (found[0] != found[1])
+	quit("join found %zu keys, not %zu", found[1], found[0]);
+    report("join", &before, &after);
+
+    for (int i = 0; i < 2; i++)
+	dict_free(dct[i]);
+}
+
+static void
+bench_join(size_t count)
+{
+    join_run(count, 3);
+    join_run(count, 64);
+    join_run(count, 4096);
+}
+
+/* Times COUNT searches of DCT for random keys among the NKEYS in KEYS. */
+static sample
+learned_run(dict *dct, void **keys, size_t nkeys, size_t count)
+{
+    uint64_t state = 4;
+    int fd = counter_open();
+    long long misses = counter_read(fd);
+    size_t found = 0;
+    double start = now();
+    for (size_t i = 0; i < count; i++)
+	found += dict_search(dct, keys[rng(&state) % nkeys]) != NULL;
+    sample s = { (now() - start) * 1e9 / count, -1 };
+    if (fd != -1) {
+	s.tlb_misses = (counter_read(fd) - misses) * 1000 / (long long)count;
+	close(fd);
+    }
+    if (found != count)
+	quit("%zu keys not found", count - found);
+    return s;
+}
+
+/* Times searches of a height-balanced tree of COUNT keys, relaid out in van
+ * Emde Boas order, vs. learned indexes over the same keys with a few error
+ * bounds. The gaps between keys vary from one run of keys to the next. */
+static void
+bench_learned(size_t count)
+{
+    void **keys = malloc(count * sizeof(*keys));
+    if (!keys)
+	quit("out of memory");
+    uint64_t state = 1;
+    uintptr_t key = 0;
+    size_t gap = 1;
+    for (size_t i = 0; i < count; i++) {
+	if (i % 4096 == 0)
+	    gap = 1 + rng(&state) % 1000;
+	key += 1 + rng(&state) % gap;
+	keys[i] = (void *)key;
+    }
+    printf("%zu keys, %zu searches\n", count, count);
+
+    const size_t epsilons[] = { 16, 64, 256 };
+    enum { NLEARNED = sizeof(epsilons) / sizeof(epsilons[0]) };
+    dict *tree = hb_dict_new(dict_ptr_cmp, NULL);
+    for (size_t i = 0; i < count; i++)
+	*dict_insert(tree, keys[i], NULL) = keys[i];
+    if (!hb_tree_relayout(dict_private(tree), DICT_LAYOUT_VEB))
+	quit("out of memory");
+    dict *learned[NLEARNED];
+    for (size_t e = 0; e < NLEARNED; e++) {
+	double start = now();
+	if (!(learned[e] = pgm_dict_new(keys, keys, count, epsilons[e], NULL)))
+	    quit("out of memory");
+	pgm_index *index = dict_private(learned[e]);
+	printf("epsilon %zu: %zu segments, %zu levels, built in %.1f ms\n",
+	       epsilons[e], pgm_index_segments(index), pgm_index_height(index),
+	       (now() - start) * 1e3);
+    }
+
+    sample before = learned_run(tree, keys, count, count);
+    for (size_t e = 0; e < NLEARNED; e++) {
+	sample after = learned_run(learned[e], keys, count, count);
+	char what[16];
+	snprintf(what, sizeof(what), "eps %zu", epsilons[e]);
+	report(what, &before, &after);
+    }
+
+    for (size_t e = 0; e < NLEARNED; e++)
+	dict_free(learned[e]);
+    dict_free(tree);
+    free(keys);
+}
+
+enum { KARY_BSEARCH, KARY_RB, KARY_SCALAR, KARY_SIMD, KARY_KINDS };
+
+typedef struct {
+    const uintptr_t *sorted;
+    size_t	    nkeys;
+    rb_tree	    *tree;
+    kary_index	    *index;
+} kary_targets;
+
+/* Looks up the COUNT keys in PROBES in the structure of the given KIND,
+ * returning the number found. */
+static size_t
+kary_search(int kind, const kary_targets *t, void **probes, size_t count)
+{
+    size_t found = 0;
+    switch (kind) {
+    case KARY_BSEARCH:
+	for (size_t i = 0; i < count; i++) {
+	    const uintptr_t key = (uintptr_t)probes[i];
+	    size_t lo = 0, hi = t->nkeys;
+	    while (lo < hi) {
+		const size_t mid = lo + (hi - lo) / 2;
+		if (t->sorted[mid] < key)
+		    lo = mid + 1;
+		else
+		    hi = mid;
+	    }
+	    found += lo < t->nkeys && t->sorted[lo] == key;
+	}
+	break;
+    case KARY_RB:
+	for (size_t i = 0; i < count; i++)
+	    found += rb_tree_search(t->tree, probes[i]) != NULL;
+	break;
+    default:
+	for (size_t i = 0; i < count; i++)
+	    found += kary_index_lower_bound(t->index, probes[i]) < t->nkeys;
+	break;
+    }
+    return found;
+}
+
+/* Times the searches of the given KIND in NPROCS processes at once, each
+ * searching for every key in PROBES, and returns the time per search in each
+ * process. */
+static sample
+kary_run(int kind, const kary_targets *t, void **probes, size_t count,
+	 long nprocs)
+{
+    if (kind == KARY_SCALAR || kind == KARY_SIMD)
+	kary_index_use_simd(t->index, kind == KARY_SIMD);
+    double start = now();
+    if (nprocs == 1) {
+	if (kary_search(kind, t, probes, count) != count)
+	    quit("keys not found");
+    } else {
+	for (long p = 0; p < nprocs; p++) {
+	    const pid_t pid = fork();
+	    if (pid == -1)
+		quit("fork failed");
+	    if (pid == 0)
+		_exit(kary_search(kind, t, probes, count) == count ? 0 : 1);
+	}
+	for (long p = 0; p < nprocs; p++) {
+	    int status;
+	    if (wait(&status) == -1 || !WIFEXITED(status) ||
+		WEXITSTATUS(status) != 0)
+		quit("searching process failed");
+	}
+    }
+    sample s = { (now() - start) * 1e9 / count, -1 };
+    return s;
+}
+
+static void
+kary_compare(const kary_targets *t, void **probes, size_t count, long nprocs)
+{
+    static const char *const names[KARY_KINDS] = {
+	"bsearch", "rb", "kary", "kary_simd"
+    };
+    sample s[KARY_KINDS];
+    for (int kind = 0; kind < KARY_KINDS; kind++)
+	s[kind] = kary_run(kind, t, probes, count, nprocs);
+    for (int kind = 1; kind < KARY_KINDS; kind++)
+	report(names[kind], &s[KARY_BSEARCH], &s[kind]);
+}
+
+/* Times COUNT searches of COUNT keys, spaced by up to GAP, in a sorted array,
+ * a red-black tree and a k-ary index, in one process and then in one process
+ * per core. Timings are relative to the sorted array. */
+static void
+kary_keys_run(size_t count, uintptr_t gap)
+{
+    uintptr_t *sorted = malloc(count * sizeof(*sorted));
+    void **probes = malloc(count * sizeof(*probes));
+    if (!sorted || !probes)
+	quit("out of memory");
+    uint64_t state = 1;
+    uintptr_t key = 0;
+    for (size_t i = 0; i < count; i++)
+	sorted[i] = key += 1 + rng(&state) % gap;
+    for (size_t i = 0; i < count; i++)
+	probes[i] = (void *)sorted[rng(&state) % count];
+
+    kary_targets t = { sorted, count, NULL, NULL };
+    dict *dct = rb_dict_new(dict_ptr_cmp, NULL);
+    for (size_t i = 0; i < count; i++)
+	*dict_insert(dct, (void *)sorted[i], NULL) = (void *)sorted[i];
+    t.tree = dict_private(dct);
+    if (!(t.index = kary_index_from_dict(dct, NULL)))
+	quit("out of memory");
+    const bool simd = kary_index_use_simd(t.index, true);
+    printf("%zu keys up to %#zx, %zu searches; %zu levels, %s\n", count,
+	   (size_t)key, count, kary_index_height(t.index),
+	   simd ? "vector comparisons" : "no vector instructions");
+
+    kary_compare(&t, probes, count, 1);
+    long nprocs = sysconf(_SC_NPROCESSORS_ONLN);
+    if (nprocs > 1) {
+	printf("%ld processes at once\n", nprocs);
+	kary_compare(&t, probes, count, nprocs);
+    }
+
+    kary_index_free(t.index);
+    dict_free(dct);
+    free(probes);
+    free(sorted);
+}
+
+static void
+bench_kary(size_t count)
+{
+    kary_keys_run(count, 1000);
+    kary_keys_run(count, (uintptr_t)1 << 20);
+}
+
+#define FROZEN_PATH	"bench.frozen"
+#define FROZEN_KEY_SIZE	16
+
+/* Times searches of a hashtable of COUNT integer keys vs. the same table
+ * frozen, then building a table of COUNT string keys vs. loading it frozen
+ * from a file. */
+static void
+bench_frozen(size_t count)
+{
+    void **keys = malloc(count * sizeof(*keys));
+    if (!keys)
+	quit("out of memory");
+    uint64_t state = 1;
+    for (size_t i = 0; i < count; i++)
+	keys[i] = (void *)(uintptr_t)(rng(&state) | 1);
+    dict *dct = hashtable_dict_new(dict_ptr_cmp, ptr_hash, NULL,
+				   (unsigned)count);
+    for (size_t i = 0; i < count; i++)
+	*dict_insert(dct, keys[i], NULL) = keys[i];
+    printf("%zu keys, %zu searches\n", dict_count(dct), count);
+    sample before = learned_run(dct, keys, count, count);
+    double start = now();
+    dict *frozen = hashtable_freeze_dict(dict_private(dct));
+    if (!frozen)
+	quit("out of memory");
+    printf("frozen in %.1f ms\n", (now() - start) * 1e3);
+    sample after = learned_run(frozen, keys, count, count);
+    report("search", &before, &after);
+    dict_free(frozen);
+    dict_free(dct);
+    free(keys);
+
+    char (*names)[FROZEN_KEY_SIZE] = malloc(count * sizeof(*names));
+    if (!names)
+	quit("out of memory");
+    for (size_t i = 0; i < count; i++)
+	snprintf(names[i], sizeof(names[i]), "%015u", (unsigned)i);
+    start = now();
+    hashtable *table = hashtable_new(dict_str_cmp, dict_str_hash, NULL,
+				     (unsigned)count);
+    for (size_t i = 0; i < count; i++)
+	*hashtable_insert(table, names[i], NULL) = (void *)i;
+    before = (sample){ (now() - start) * 1e9 / count, -1 };
+    hashtable_frozen *saved = hashtable_freeze(table);
+    if (!saved || !hashtable_frozen_save(saved, FROZEN_PATH, FROZEN_KEY_SIZE))
+	quit("cannot save %s", FROZEN_PATH);
+    hashtable_frozen_free(saved);
+    hashtable_free(table);
+    start = now();
+    hashtable_frozen *loaded = hashtable_frozen_load(FROZEN_PATH, dict_str_cmp,
+						     dict_str_hash);
+    if (!loaded)
+	quit("cannot load %s", FROZEN_PATH);
+    after = (sample){ (now() - start) * 1e9 / count, -1 };
+    remove(FROZEN_PATH);
+    if (hashtable_frozen_search(loaded, names[count - 1]) !=
+	(void *)(count - 1))
+	quit("loaded table lost a key");
+    report("load", &before, &after);
+    hashtable_frozen_free(loaded);
+    free(names);
+}
+
+#define SHM_NAME	"/libdict-bench"
+
+static unsigned
+ulong_hash(const void *key)
+{
+    return ptr_hash((void *)(uintptr_t)*(const unsigned long *)key);
+}
+
+/* Times COUNT searches of DCT for random keys among the NKEYS in KEYS. */
+static sample
+shm_run(dict *dct, const unsigned long *keys, size_t nkeys, size_t count)
+{
+    uint64_t state = 5;
+    size_t found = 0;
+    double start = now();
+    for (size_t i = 0; i < count; i++)
+	found += dict_search(dct, &keys[rng(&state) % nkeys]) != NULL;
+    sample s = { (now() - start) * 1e9 / count, -1 };
+    if (found != count)
+	quit("%zu keys not found", count - found);
+    return s;
+}
+
+/* Times searches of a hashtable and a red-black tree of COUNT keys in the
+ * memory of this process vs. in a shared memory object, where each search
+ * also takes a process-shared lock. */
+static void
+bench_shm(size_t count)
+{
+    unsigned long *keys = malloc(count * sizeof(*keys));
+    if (!keys)
+	quit("out of memory");
+    uint64_t state = 1;
+    for (size_t i = 0; i < count; i++)
+	keys[i] = (unsigned long)(rng(&state) | 1);
+    printf("%zu keys, %zu searches\n", count, count);
+
+    const shm_map_layout layouts[2] = { SHM_MAP_HASHTABLE, SHM_MAP_RB_TREE };
+    const char *names[2] = { "hashtable", "rb_tree" };
+    for (int l = 0; l < 2; l++) {
+	dict *private = l == 0 ?
+	    hashtable_dict_new(dict_ulong_cmp, ulong_hash, NULL,
+			       (unsigned)count) :
+	    rb_dict_new(dict_ulong_cmp, NULL);
+	shm_map_unlink(SHM_NAME);
+	dict *shared = shm_dict_create(SHM_NAME, layouts[l],
+				       4096 + count * 8 + count * 64,
+				       sizeof(unsigned long), (unsigned)count,
+				       dict_ulong_cmp, ulong_hash);
+	if (!shared)
+	    quit("cannot create %s", SHM_NAME);
+	for (size_t i = 0; i < count; i++) {
+	    *dict_insert(private, &keys[i], NULL) = &keys[i];
+	    if (!shm_map_put(dict_private(shared), &keys[i], (void *)1))
+		quit("%s is full", SHM_NAME);
+	}
+	sample before = shm_run(private, keys, count, count);
+	sample after = shm_run(shared, keys, count, count);
+	report(names[l], &before, &after);
+	dict_free(shared);
+	shm_map_unlink(SHM_NAME);
+	dict_free(private);
+    }
+    free(keys);
+}
+
+typedef struct {
+    size_t	samples;
+    uint64_t	nsec;
+} sample_total;
+
+static void
+sample_add(dict_op op, const dict *dct, const void *key, uint64_t nsec,
+	   void *ctx)
+{
+    sample_total *total = ctx;
+    (void)op, (void)dct, (void)key;
+    total->samples++;
+    total->nsec += nsec;
+}
+
+/* Times searches of a red-black tree of COUNT keys with sampling off vs.
+ * timing one search in 1024, and every search. */
+static void
+bench_sample(size_t count)
+{
+    dict *dct = rb_dict_new(dict_ptr_cmp, NULL);
+    uint64_t state = 1;
+    for (size_t i = 0; i < count; i++) {
+	void *key = (void *)(uintptr_t)(rng(&state) % count + 1);
+	*dict_insert(dct, key, NULL) = key;
+    }
+    printf("%zu keys, %zu searches\n", dict_count(dct), count);
+
+    const unsigned every[2] = { 1024, 1 };
+    const char *names[2] = { "1/1024", "1/1" };
+    for (int e = 0; e < 2; e++) {
+	state = 2;
+	sample before = search_run(dct, count, &state);
+	sample_total total = { 0, 0 };
+	dict_set_sampler(every[e], sample_add, &total);
+	state = 2;
+	sample after = search_run(dct, count, &state);
+	dict_set_sampler(0, NULL, NULL);
+	report(names[e], &before, &after);
+	printf("%zu samples, %.1f ns mean\n", total.samples,
+	       total.samples ? (double)total.nsec / total.samples : 0.0);
+    }
+    dict_free(dct);
+}
+
+#define CURSOR_PAGE 10
+
+/* Scans the keys [1, COUNT] of DCT in pages of CURSOR_PAGE keys, and returns
+ * the time per key. Without CURSOR, each page seeks a new iterator past the
+ * last key of the one before; with it, CHURN removes and reinserts a key
+ * between pages. */
+static sample
+page_run(dict *dct, size_t count, bool cursor, bool churn)
+{
+    size_t seen = 0;
+    double start = now();
+    if (!cursor) {
+	dict_itor *itor = dict_itor_new(dct);
+	uintptr_t next = 1;
+	size_t n = CURSOR_PAGE;
+	while (n == CURSOR_PAGE && dict_itor_first(itor) &&
+	       dict_itor_seek(itor, (void *)next)) {
+	    n = 0;
+	    do {
+		next = (uintptr_t)dict_itor_key(itor) + 1;
+		seen++;
+	    } while (++n < CURSOR_PAGE && dict_itor_next(itor));
+	}
+	dict_itor_free(itor);
+    } else {
+	dict_cursor *cur = dict_cursor_new(dct, dict_ptr_cmp);
+	for (size_t n = 0; dict_cursor_next(cur); seen++) {
+	    if (++n == CURSOR_PAGE) {
+		n = 0;
+		if (churn) {
+		    dict_remove(dct, (void *)1);
+		    *dict_insert(dct, (void *)1, NULL) = (void *)1;
+		}
+	    }
+	}
+	dict_cursor_free(cur);
+    }
+    sample s = { (now() - start) * 1e9 / count, -1 };
+    if (seen != count)
+	quit("%zu keys scanned, %zu expected", seen, count);
+    return s;
+}
+
+/* Times scans of a red-black tree of COUNT keys, inserted in random order, a
+ * page at a time: seeking to the start of each page vs. a cursor that steps
+ * on, and a cursor that must seek because the tree changed. */
+static void
+bench_cursor(size_t count)
+{
+    void **keys = malloc(count * sizeof(*keys));
+    if (!keys)
+	quit("out of memory");
+    uint64_t state = 1;
+    for (size_t i = 0; i < count; i++) {
+	size_t j = rng(&state) % (i + 1);
+	keys[i] = keys[j];
+	keys[j] = (void *)(uintptr_t)(i + 1);
+    }
+    dict *dct = rb_dict_new(dict_ptr_cmp, NULL);
+    for (size_t i = 0; i < count; i++)
+	*dict_insert(dct, keys[i], NULL) = keys[i];
+    free(keys);
+    printf("%zu keys, pages of %d\n", count, CURSOR_PAGE);
+
+    sample before = page_run(dct, count, false, false);
+    sample after = page_run(dct, count, true, false);
+    report("cursor", &before, &after);
+    after = page_run(dct, count, true, true);
+    report("churn", &before, &after);
+    dict_free(dct);
+}
+
+#define EXPORT_CHUNK 1024
+
+/* Copies the COUNT keys and data of DCT into KEYS and DATA, and returns the
+ * time per key. With THREADS of 0 an iterator copies them; otherwise
+ * dict_export() copies chunks of EXPORT_CHUNK keys if THREADS is 1, or
+ * dict_export_all() copies them all on THREADS threads. */
+static sample
+export_run(dict *dct, size_t count, void **keys, void **data,
+	   unsigned threads)
+{
+    size_t n = 0;
+    double start = now();
+    if (threads == 0) {
+	dict_itor *itor = dict_itor_new(dct);
+	for (dict_itor_first(itor); dict_itor_valid(itor);
+	     dict_itor_next(itor), n++) {
+	    keys[n] = dict_itor_key(itor);
+	    data[n] = *dict_itor_data(itor);
+	}
+	dict_itor_free(itor);
+    } else if (threads == 1) {
+	dict_export_pos pos = DICT_EXPORT_START;
+	size_t chunk;
+	while ((chunk = dict_export(dct, keys + n, data + n, EXPORT_CHUNK,
+				    &pos)) == EXPORT_CHUNK)
+	    n += chunk;
+	n += chunk;
+	dict_export_end(&pos);
+    } else {
+	n = dict_export_all(dct, keys, data, threads);
+    }
+    sample s = { (now() - start) * 1e9 / count, -1 };
+    if (n != count)
+	quit("%zu keys copied, %zu expected", n, count);
+    for (size_t i = 1; i < count; i++)
+	if (keys[i - 1] >= keys[i] || data[i] != keys[i])
+	    quit("keys copied out of order");
+    return s;
+}
+
+/* Times copying a red-black tree of COUNT keys, inserted in random order,
+ * into arrays: with an iterator vs. dict_export() on one thread, and vs.
+ * dict_export_all() on every processor. */
+static void
+bench_export(size_t count)
+{
+    void **keys = malloc(count * sizeof(*keys));
+    void **data = malloc(count * sizeof(*data));
+    if (!keys || !data)
+	quit("out of memory");
+    uint64_t state = 1;
+    for (size_t i = 0; i < count; i++) {
+	size_t j = rng(&state) % (i + 1);
+	keys[i] = keys[j];
+	keys[j] = (void *)(uintptr_t)(i + 1);
+    }
+    dict *dct = rb_dict_new(dict_ptr_cmp, NULL);
+    for (size_t i = 0; i < count; i++)
+	*dict_insert(dct, keys[i], NULL) = keys[i];
+    printf("%zu keys, chunks of %d\n", count, EXPORT_CHUNK);
+
+    sample before = export_run(dct, count, keys, data, 0);
+    sample after = export_run(dct, count, keys, data, 1);
+    report("export", &before, &after);
+    long nprocs = sysconf(_SC_NPROCESSORS_ONLN);
+    if (nprocs > 1) {
+	printf("%ld threads at once\n", nprocs);
+	after = export_run(dct, count, keys, data, (unsigned)nprocs);
+	report("all", &before, &after);
+    }
+    dict_free(dct);
+    free(keys);
+    free(data);
+}
+
+/* Times COUNT searches for random keys in [1, COUNT]. */
+static sample
+search_run(dict *dct, size_t count, uint64_t *state)
+{
+    int fd = counter_open();
+    long long misses = counter_read(fd);
+    size_t found = 0;
+    double start = now();
+    for (size_t i = 0; i < count; i++) {
+	void *key = (void *)(uintptr_t)(rng(state) % count + 1);
+	found += dict_search(dct, key) != NULL;
+    }
+    sample s = { (now() - start) * 1e9 / count, -1 };
+    if (fd != -1) {
+	s.tlb_misses = (counter_read(fd) - misses) * 1000 / (long long)count;
+	close(fd);
+    }
+    if (found == 0)
+	quit("no keys found");
+    return s;
+}
+
+static void
+report(const char *what, const sample *before, const sample *after)
+{
+    printf("%-8s %12s %12s %9s\n", what, "before", "after", "delta");
+    printf("%-8s %12.1f %12.1f %+8.1f%%\n", "ns/op",
+	   before->nsec, after->nsec,
+	   (after->nsec - before->nsec) * 100 / before->nsec);
+    if (before->tlb_misses < 0 || after->tlb_misses < 0) {
+	printf("%-8s %12s %12s\n", "dTLB/kop", "n/a", "n/a");
+	return;
+    }
+    printf("%-8s %12lld %12lld", "dTLB/kop",
+	   before->tlb_misses, after->tlb_misses);
+    if (before->tlb_misses)
+	printf(" %+8.1f%%",
+	       (double)(after->tlb_misses - before->tlb_misses) * 100 /
+	       (double)before->tlb_misses);
+    printf("\n");
+}
+
+/* Opens a counter of this thread's dTLB load misses, or returns -1. */
+static int
+counter_open(void)
+{
+#ifdef __linux__
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CACHE_DTLB |
+	(PERF_COUNT_HW_CACHE_OP_READ << 8) |
+	(PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+    return -1;
+#endif
+}
+
+static long long
+counter_read(int fd)
+{
+    long long value = 0;
+    if (fd != -1 && read(fd, &value, sizeof(value)) != sizeof(value))
+	value = 0;
+    return value;
+}
+
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/* xorshift64*, so that runs are repeatable across platforms. */
+static uint64_t
+rng(uint64_t *state)
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545F4914F6CDD1DULL;
+}
+
+void
+quit(const char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    fprintf(stderr, "%s: ", appname);
+    vfprintf(stderr, fmt, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+
+    exit(EXIT_FAILURE);
+}
@@ -49,6 +49,9 @@ main(int argc, char **argv)
     dict *dct = NULL;
     ++argv;
     switch (argv[0][0]) {
+	case 'g':
+	    dct = sg_dict_new((dict_compare_func)strcmp, key_val_free);
+	    break;
 	case 'h':
 	    dct = hb_dict_new((dict_compare_func)strcmp, key_val_free);
 	    break;
@@ -64,6 +67,9 @@ main(int argc, char **argv)
 	case 's':
 	    dct = sp_dict_new((dict_compare_func)strcmp, key_val_free);
 	    break;
+	case 'v':
+	    dct = wavl_dict_new((dict_compare_func)strcmp, key_val_free);
+	    break;
 	case 'w':
 	    dct = wb_dict_new((dict_compare_func)strcmp, key_val_free);
 	    break;
@@ -72,8 +78,12 @@ main(int argc, char **argv)
 				     dict_str_hash,
 				     key_val_free, HSIZE);
 	    break;
+	case 'L':
+	    dct = lsmtree_dict_new((dict_compare_func)strcmp, dict_str_hash,
+				   key_val_free, 4);
+	    break;
 	default:
-	    quit("type must be one of h, p, r, t, s, w, or H");
+	    quit("type must be one of g, h, p, r, t, s, v, w, H, or L");
     }
 
     if (!dct)
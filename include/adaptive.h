@@ -0,0 +1,100 @@
+/*
+ * libdict -- adaptive map definitions.
+ *
+ * Copyright (c) 2001-2011, Farooq Mela
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *    This product includes software developed by Farooq Mela.
+ * 4. Neither the name Farooq Mela nor the names of contributors may be used to
+ *    endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY FAROOQ MELA ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL FAROOQ MELA BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _ADAPTIVE_H_
+#define _ADAPTIVE_H_
+
+#include "dict.h"
+
+BEGIN_DECL
+
+/* An adaptive map keeps its entries in a splay tree, a red-black tree or a
+ * hashtable, starting with the red-black tree. It samples its own workload:
+ * the mix of insertions, searches and removals, how often it is iterated or
+ * traversed, and how often recently used keys recur (through |hash_func|).
+ * Periodically it asks a cost model whether another representation would do
+ * markedly better, and if the answer is the same twice running, moves its
+ * entries there in O(n). It uses the hashtable only while no ordered
+ * operation has been seen for a while; iterating or traversing a map that is
+ * a hashtable first turns it back into a tree, so both are in key order.
+ * The map does not reorganize itself while any of its iterators exist, but
+ * any insertion or removal invalidates them. */
+typedef struct adaptive adaptive;
+
+typedef enum {
+    ADAPTIVE_SP_TREE,
+    ADAPTIVE_RB_TREE,
+    ADAPTIVE_HASHTABLE
+} adaptive_kind;
+
+adaptive*	adaptive_new(dict_compare_func cmp_func,
+			     dict_hash_func hash_func,
+			     dict_delete_func del_func);
+dict*		adaptive_dict_new(dict_compare_func cmp_func,
+				  dict_hash_func hash_func,
+				  dict_delete_func del_func);
+size_t		adaptive_free(adaptive* map);
+adaptive*	adaptive_clone(adaptive* map,
+			       dict_key_datum_clone_func clone_func);
+
+void**		adaptive_insert(adaptive* map, void* key, bool* inserted);
+void*		adaptive_search(adaptive* map, const void* key);
+bool		adaptive_remove(adaptive* map, const void* key);
+size_t		adaptive_clear(adaptive* map);
+size_t		adaptive_traverse(adaptive* map, dict_visit_func visit);
+size_t		adaptive_count(const adaptive* map);
+/* Returns the current representation, and how many times it has changed. */
+adaptive_kind	adaptive_backend(const adaptive* map);
+size_t		adaptive_migrations(const adaptive* map);
+bool		adaptive_verify(const adaptive* map);
+
+typedef struct adaptive_itor adaptive_itor;
+
+adaptive_itor*	adaptive_itor_new(adaptive* map);
+dict_itor*	adaptive_dict_itor_new(adaptive* map);
+void		adaptive_itor_free(adaptive_itor* itor);
+
+bool		adaptive_itor_valid(const adaptive_itor* itor);
+void		adaptive_itor_invalidate(adaptive_itor* itor);
+bool		adaptive_itor_next(adaptive_itor* itor);
+bool		adaptive_itor_prev(adaptive_itor* itor);
+bool		adaptive_itor_nextn(adaptive_itor* itor, size_t count);
+bool		adaptive_itor_prevn(adaptive_itor* itor, size_t count);
+bool		adaptive_itor_first(adaptive_itor* itor);
+bool		adaptive_itor_last(adaptive_itor* itor);
+const void*	adaptive_itor_key(const adaptive_itor* itor);
+void**		adaptive_itor_data(adaptive_itor* itor);
+bool		adaptive_itor_seek(adaptive_itor* itor, const void* key);
+
+END_DECL
+
+#endif /* !_ADAPTIVE_H_ */
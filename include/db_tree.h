@@ -0,0 +1,99 @@
+/*
+ * libdict -- disk-backed B+ tree interface.
+ *
+ * Copyright (c) 2001-2011, Farooq Mela
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *    This product includes software developed by Farooq Mela.
+ * 4. Neither the name Farooq Mela nor the names of contributors may be used to
+ *    endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY FAROOQ MELA ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL FAROOQ MELA BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _DB_TREE_H_
+#define _DB_TREE_H_
+
+#include "dict.h"
+
+BEGIN_DECL
+
+/* A B+ tree stored in pages of a file, which are read and written through a
+ * fixed-size LRU buffer pool of |pool_pages| pages.
+ *
+ * Keys are byte strings of |key_size| bytes, which are copied into the tree;
+ * the comparison function is called with pointers to such copies. Datums are
+ * stored as they are, as pointer-sized values, so they should be integers or
+ * file offsets rather than pointers to memory. Pointers to keys and datums
+ * returned by the tree point into the buffer pool, and remain valid only until
+ * the next call on the tree.
+ *
+ * Changes reach the file when their pages are evicted, or when the tree is
+ * synced or freed; freeing the tree leaves its contents in the file. If an I/O
+ * error occurs while the tree is being modified, the file may be left
+ * inconsistent. */
+typedef struct db_tree db_tree;
+
+db_tree*	db_tree_new(const char* path, size_t key_size,
+			    dict_compare_func cmp_func,
+			    dict_delete_func del_func, size_t pool_pages);
+dict*		db_dict_new(const char* path, size_t key_size,
+			    dict_compare_func cmp_func,
+			    dict_delete_func del_func, size_t pool_pages);
+size_t		db_tree_free(db_tree* tree);
+db_tree*	db_tree_clone(db_tree* tree,
+			      dict_key_datum_clone_func clone_func);
+
+void**		db_tree_insert(db_tree* tree, void* key, bool* inserted);
+void*		db_tree_search(db_tree* tree, const void* key);
+bool		db_tree_remove(db_tree* tree, const void* key);
+size_t		db_tree_clear(db_tree* tree);
+size_t		db_tree_traverse(db_tree* tree, dict_visit_func visit);
+size_t		db_tree_count(const db_tree* tree);
+size_t		db_tree_height(const db_tree* tree);
+bool		db_tree_sync(db_tree* tree);
+void		db_tree_io_counts(const db_tree* tree, size_t* reads,
+				  size_t* writes);
+bool		db_tree_verify(const db_tree* tree);
+
+typedef struct db_itor db_itor;
+
+db_itor*	db_itor_new(db_tree* tree);
+dict_itor*	db_dict_itor_new(db_tree* tree);
+void		db_itor_free(db_itor* tree);
+
+bool		db_itor_valid(const db_itor* itor);
+void		db_itor_invalidate(db_itor* itor);
+bool		db_itor_next(db_itor* itor);
+bool		db_itor_prev(db_itor* itor);
+bool		db_itor_nextn(db_itor* itor, size_t count);
+bool		db_itor_prevn(db_itor* itor, size_t count);
+bool		db_itor_first(db_itor* itor);
+bool		db_itor_last(db_itor* itor);
+bool		db_itor_search(db_itor* itor, const void* key);
+bool		db_itor_seek(db_itor* itor, const void* key);
+const void*	db_itor_key(const db_itor* itor);
+void**		db_itor_data(db_itor* itor);
+
+END_DECL
+
+#endif /* !_DB_TREE_H_ */
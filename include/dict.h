@@ -62,6 +62,9 @@ typedef int	    (*dict_compare_func)(const void*, const void*);
 typedef void	    (*dict_delete_func)(void*, void*);
 /* A pointer to a function used for iterating over dictionary contents. */
 typedef bool	    (*dict_visit_func)(const void*, void*);
+/* A pointer to a function that decides whether to remove a key-value pair,
+ * given the context pointer passed to dict_remove_if(). */
+typedef bool	    (*dict_predicate_func)(const void*, void*, void*);
 /* A pointer to a function that returns the hash value of a key. */
 typedef unsigned    (*dict_hash_func)(const void*);
 /* A pointer to a function that returns the priority of a key. */
@@ -69,15 +72,63 @@ typedef unsigned    (*dict_prio_func)(const void*);
 /* A pointer to a function that clones a key or datum value, given the key-datum
  * pair. */
 typedef void	    (*dict_key_datum_clone_func)(void** key, void** datum);
+/* A pointer to a function that computes into |agg| the aggregate of a subtree
+ * whose root holds |key| and |datum|, given the aggregates of its left and
+ * right subtrees (NULL for an empty subtree). It must combine its inputs in
+ * that order with an associative operation, e.g. a sum, minimum or maximum.
+ * Trees that maintain aggregates (hb, rb and wb) pick up a datum stored
+ * through the pointer returned by insert, but may call the function with a
+ * NULL datum before then; after changing a datum any other way, call the
+ * tree's update_aggregate function with its key. Verifying a tree compares
+ * the bytes the function writes with those stored, so it should assign the
+ * members of a padded aggregate rather than copy a whole struct into |agg|. */
+typedef void	    (*dict_aggregate_func)(void* agg, const void* key,
+					   const void* datum,
+					   const void* left, const void* right);
+/* The orders in which a tree's nodes can be relaid out in memory (hb and rb
+ * trees): level by level, or in van Emde Boas order, which stores the top half
+ * of the tree and then each subtree below it, recursively. */
+typedef enum {
+    DICT_LAYOUT_BFS,
+    DICT_LAYOUT_VEB
+} dict_layout;
 /* A pointer to a function that clones a dictionary. */
 typedef void*	    (*dict_clone_func)(void*,
 				       dict_key_datum_clone_func clone_func);
 
+/* Sets (the binary search trees other than the interval tree, hashtables and
+ * skiplists made by their _new_set constructors) store keys without datums,
+ * saving a pointer per entry. A key's datum reads as DICT_SET_MEMBER, so
+ * search returns it for the keys in the set; insert and iterators return a
+ * pointer to a slot that holds it, and anything stored there is discarded.
+ * The delete function is passed a NULL datum. */
+extern char	    dict_set_member;
+#define DICT_SET_MEMBER	    ((void*)&dict_set_member)
+
 
 /* A pointer to a function that libdict will use to allocate memory. */
-void*		    (*dict_malloc_func)(size_t);
+extern void*	    (*dict_malloc_func)(size_t);
 /* A pointer to a function that libdict will use to deallocate memory. */
-void		    (*dict_free_func)(void*);
+extern void	    (*dict_free_func)(void*);
+
+/* An allocator for large containers, to be used as dict_malloc_func and
+ * dict_free_func. Small blocks are carved out of 2MB-aligned regions that the
+ * kernel is advised to back with transparent huge pages, so that nodes share
+ * far fewer TLB entries than with malloc(); freed blocks are reused. Larger
+ * blocks, and blocks that cannot be had from a region, come from malloc(),
+ * and dict_arena_free() passes blocks it did not allocate on to free().
+ * Regions are never returned to the system. Not thread-safe. */
+void*		    dict_arena_malloc(size_t size);
+void		    dict_arena_free(void* ptr);
+
+typedef struct {
+    size_t	    regions;	    /* Regions mapped. */
+    size_t	    huge_regions;   /* Regions advised to use huge pages. */
+    size_t	    blocks;	    /* Blocks in use. */
+    size_t	    fallbacks;	    /* Allocations passed on to malloc(). */
+} dict_arena_stats;
+
+void		    dict_arena_get_stats(dict_arena_stats* stats);
 
 /* Forward declarations for transparent type dict_itor. */
 typedef struct dict_itor dict_itor;
@@ -91,6 +142,25 @@ typedef size_t      (*dict_clear_func)(void* obj);
 typedef size_t      (*dict_traverse_func)(void* obj, dict_visit_func visit);
 typedef size_t      (*dict_count_func)(const void* obj);
 typedef bool	    (*dict_verify_func)(const void* obj);
+typedef size_t	    (*dict_remove_many_func)(void* obj, const void** keys,
+					     size_t count);
+typedef size_t	    (*dict_remove_if_func)(void* obj, dict_predicate_func pred,
+					   void* ctx);
+typedef size_t	    (*dict_mod_count_func)(const void* obj);
+
+/* Where an export resumes. Start from DICT_EXPORT_START. */
+typedef struct {
+    void*	    node;	/* The next node, or NULL. */
+    size_t	    index;	/* The number of pairs exported. */
+    dict_itor*	    itor;	/* For containers without an export. */
+} dict_export_pos;
+
+#define DICT_EXPORT_START   { NULL, 0, NULL }
+
+typedef size_t	    (*dict_export_func)(void* obj, void** keys, void** data,
+					size_t max, dict_export_pos* pos);
+typedef size_t	    (*dict_export_all_func)(void* obj, void** keys,
+					    void** data, unsigned threads);
 
 typedef struct {
     dict_inew_func      inew;
@@ -103,6 +173,11 @@ typedef struct {
     dict_count_func     count;
     dict_verify_func	verify;
     dict_clone_func	clone;
+    dict_remove_many_func remove_many;
+    dict_remove_if_func	remove_if;
+    dict_mod_count_func	mod_count;
+    dict_export_func	export;
+    dict_export_all_func export_all;
 } dict_vtable;
 
 typedef void	    (*dict_ifree_func)(void* itor);
@@ -118,6 +193,7 @@ typedef void*	    (*dict_key_func)(void* itor);
 typedef void**	    (*dict_data_func)(void* itor);
 typedef bool	    (*dict_iremove_func)(void* itor);
 typedef int	    (*dict_icompare_func)(void* itor1, void* itor2);
+typedef bool	    (*dict_iseek_func)(void* itor, const void* key);
 
 typedef struct {
     dict_ifree_func	    ifree;
@@ -133,6 +209,7 @@ typedef struct {
     dict_data_func	    data;
     dict_iremove_func       remove;
     dict_icompare_func      compare;
+    dict_iseek_func	    seek;
 } itor_vtable;
 
 typedef struct {
@@ -140,10 +217,45 @@ typedef struct {
     dict_vtable*    _vtable;
 } dict;
 
+/* The operations that samplers and operation traces record. */
+typedef enum {
+    DICT_OP_INSERT,
+    DICT_OP_SEARCH,
+    DICT_OP_REMOVE,
+    DICT_OP_CLEAR		/* Traces only. */
+} dict_op;
+
+/* A pointer to a function that is given the time taken by a sampled
+ * operation on |dct| with |key|, in nanoseconds, and the context pointer
+ * passed to dict_set_sampler(). */
+typedef void	    (*dict_sample_func)(dict_op op, const dict* dct,
+					const void* key, uint64_t nsec,
+					void* ctx);
+
+/* Time one in every |every| calls to dict_insert(), dict_search() and
+ * dict_remove() made by each thread, across all dictionaries, and pass each
+ * time to |func|, which may be called from several threads at once; an
+ * |every| of 0 or a NULL |func| turns sampling off. Calls that are not timed
+ * cost one more test of dict_sample_every. dict_set_sampler() itself is not
+ * thread-safe: no other thread may be calling these functions meanwhile. */
+void		    dict_set_sampler(unsigned every, dict_sample_func func,
+				     void* ctx);
+
+extern unsigned	    dict_sample_every;
+void**		    dict_sampled_insert(dict* dct, void* key, bool* inserted);
+void*		    dict_sampled_search(dict* dct, const void* key);
+bool		    dict_sampled_remove(dict* dct, const void* key);
+
 #define dict_private(dct)       ((dct)->_object)
-#define dict_insert(dct,k,d)	((dct)->_vtable->insert((dct)->_object,(k),(d)))
-#define dict_search(dct,k)      ((dct)->_vtable->search((dct)->_object, (k)))
-#define dict_remove(dct,k)      ((dct)->_vtable->remove((dct)->_object, (k)))
+#define dict_insert(dct,k,d) \
+    (dict_sample_every ? dict_sampled_insert((dct), (k), (d)) : \
+     (dct)->_vtable->insert((dct)->_object, (k), (d)))
+#define dict_search(dct,k) \
+    (dict_sample_every ? dict_sampled_search((dct), (k)) : \
+     (dct)->_vtable->search((dct)->_object, (k)))
+#define dict_remove(dct,k) \
+    (dict_sample_every ? dict_sampled_remove((dct), (k)) : \
+     (dct)->_vtable->remove((dct)->_object, (k)))
 #define dict_traverse(dct,f)    ((dct)->_vtable->traverse((dct)->_object, (f)))
 #define dict_count(dct)		((dct)->_vtable->count((dct)->_object))
 #define dict_verify(dct)	((dct)->_vtable->verify((dct)->_object))
@@ -151,6 +263,27 @@ typedef struct {
 #define dict_itor_new(dct)      (dct)->_vtable->inew((dct)->_object)
 size_t dict_free(dict* dct);
 dict* dict_clone(dict* dct, dict_key_datum_clone_func clone_func);
+/* Remove the |count| keys in |keys|, which may be reordered, and return the
+ * number that were found. Ordered containers sort the keys and merge them
+ * with their contents when there are many. */
+size_t dict_remove_many(dict* dct, const void** keys, size_t count);
+/* Remove each key-value pair for which |pred|, called with |ctx|, returns
+ * true, and return the number removed. |pred| is called once on each pair, in
+ * order for ordered containers, except that it may be called again on pairs
+ * it kept if memory runs short. It must not modify the dictionary. */
+size_t dict_remove_if(dict* dct, dict_predicate_func pred, void* ctx);
+/* Copy up to |max| keys and their datums, in order for ordered containers,
+ * into |keys| and |data|, either of which may be NULL, and return the number
+ * copied, which is less than |max| only at the end. Each call resumes where
+ * the last one with |pos| stopped; the dictionary must not be modified in
+ * between. A walk stopped before the end must be ended with
+ * dict_export_end(). */
+size_t dict_export(dict* dct, void** keys, void** data, size_t max,
+		   dict_export_pos* pos);
+void dict_export_end(dict_export_pos* pos);
+/* Copy every key and datum as dict_export() would, and return the count. Trees
+ * split the work among up to |threads| threads when they are large. */
+size_t dict_export_all(dict* dct, void** keys, void** data, unsigned threads);
 
 struct dict_itor {
     void*	    _itor;
@@ -170,8 +303,53 @@ struct dict_itor {
 #define dict_itor_key(i)	((i)->_vtable->key((i)->_itor))
 #define dict_itor_data(i)       ((i)->_vtable->data((i)->_itor))
 #define dict_itor_remove(i)	((i)->_vtable->remove((i)->_itor))
+/* Move forward to the first key not less than |k|, searching outward from the
+ * current position, and return whether there is one. */
+#define dict_itor_seek(i,k)	((i)->_vtable->seek((i)->_itor, (k)))
 void dict_itor_free(dict_itor* itor);
 
+/* A join yields the keys present in every one of |count| dictionaries ordered
+ * by |cmp_func|, in order, without building intermediate results. Each input
+ * is moved forward with dict_itor_seek() where it is supported, so that the
+ * cost grows with the logarithm of the runs of keys skipped; the inputs must
+ * not be modified while they are joined. */
+typedef struct dict_join dict_join;
+
+dict_join*  dict_join_new(dict** dicts, size_t count,
+			  dict_compare_func cmp_func);
+void	    dict_join_free(dict_join* join);
+/* Move to the first, or else the next, common key, returning false if there
+ * is none. */
+bool	    dict_join_next(dict_join* join);
+const void* dict_join_key(const dict_join* join);
+/* Return the address of the datum for the current key in input |index|. */
+void**	    dict_join_data(dict_join* join, size_t index);
+
+/* A cursor walks a dictionary ordered by |cmp_func| in order, and may be left
+ * while the dictionary is modified. It remembers its key and the container's
+ * modification count: if nothing was added or removed since it last moved,
+ * it steps on from where it is; otherwise it seeks back to its key, so that it
+ * resumes after it whether or not that key is still there. Containers that do
+ * not count modifications are seeked every time, and the cursor keeps no
+ * iterator of theirs between moves, so it leaves a shm_map unlocked. The key
+ * the cursor is on is compared with after the dictionary changes, so it must
+ * not be freed while the cursor is on it, even if it is removed. */
+typedef struct dict_cursor dict_cursor;
+
+dict_cursor* dict_cursor_new(dict* dct, dict_compare_func cmp_func);
+void	    dict_cursor_free(dict_cursor* cursor);
+/* Move to the first key, or else the key after the current one, returning
+ * false if there is none. A cursor that has run off the end finds keys added
+ * after its last key since. */
+bool	    dict_cursor_next(dict_cursor* cursor);
+/* Move to the first key not less than |key|, returning false if there is
+ * none; the cursor then keeps |key| as it would a key it is on. */
+bool	    dict_cursor_seek(dict_cursor* cursor, const void* key);
+const void* dict_cursor_key(const dict_cursor* cursor);
+/* Return the address of the current key's datum, or NULL if the key has been
+ * removed. */
+void**	    dict_cursor_data(dict_cursor* cursor);
+
 int dict_int_cmp(const void* k1, const void* k2);
 int dict_uint_cmp(const void* k1, const void* k2);
 int dict_long_cmp(const void* k1, const void* k2);
@@ -182,13 +360,25 @@ unsigned dict_str_hash(const void* str);
 
 END_DECL
 
+#include "adaptive.h"
+#include "db_tree.h"
 #include "hashtable.h"
 #include "hb_tree.h"
+#include "iv_tree.h"
+#include "kary_index.h"
+#include "lsmtree.h"
+#include "op_trace.h"
+#include "pgm_index.h"
 #include "pr_tree.h"
 #include "rb_tree.h"
+#include "sg_tree.h"
+#include "shm_map.h"
 #include "skiplist.h"
+#include "smallmap.h"
 #include "sp_tree.h"
 #include "tr_tree.h"
+#include "wal.h"
+#include "wavl_tree.h"
 #include "wb_tree.h"
 
 #endif /* !_DICT_H_ */
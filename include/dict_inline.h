@@ -0,0 +1,358 @@
+/*
+ * libdict -- inline definitions for the hot operations.
+ *
+ * Copyright (c) 2001-2011, Farooq Mela
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *    This product includes software developed by Farooq Mela.
+ * 4. Neither the name Farooq Mela nor the names of contributors may be used to
+ *    endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY FAROOQ MELA ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL FAROOQ MELA BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _DICT_INLINE_H_
+#define _DICT_INLINE_H_
+
+#include "dict.h"
+
+BEGIN_DECL
+
+/* Calls through a dict go through its vtable, and the container functions
+ * live in their own translation units, so neither can be inlined into a
+ * caller's loop. This header is an optional alternative for code that knows
+ * the concrete container type: search and the iterator's next, key and data
+ * are defined here as static inline functions over mirrors of the containers'
+ * private layouts, and insert, whose rebalancing stays out of line, is a
+ * direct call. The layouts are checked against these mirrors when the library
+ * is compiled.
+ *
+ * The splay tree's search restructures the tree, and the scapegoat tree's
+ * nodes have no parent link, so those two only get direct calls. */
+
+/* The node, tree and iterator prefixes shared by the hb, pr, rb, sp, tr, wavl
+ * and wb trees. A red-black node keeps its color in the low bit of rlink. A
+ * node's datum comes after any fields of its tree's own, at |datum_offset|. */
+typedef struct dict_inline_node dict_inline_node;
+struct dict_inline_node {
+    void*		key;
+    dict_inline_node*	parent;
+    dict_inline_node*	llink;
+    dict_inline_node*	rlink;
+};
+
+typedef struct {
+    dict_inline_node*	root;
+    size_t		count;
+    dict_compare_func	cmp_func;
+    bool		keys_only;
+    void*		set_datum;
+    size_t		datum_offset;
+} dict_inline_tree;
+
+#define DICT_INLINE_DATUM(tree, node) \
+    ((void**)(void*)((char*)(node) + (tree)->datum_offset))
+
+typedef struct {
+    dict_inline_tree*	tree;
+    dict_inline_node*	node;
+} dict_inline_itor;
+
+#define DICT_INLINE_RLINK(node) \
+    ((dict_inline_node*)((intptr_t)(node)->rlink & ~(intptr_t)1))
+
+/* The red-black trees' sentinel. */
+extern struct rb_node	rb_null;
+#define DICT_INLINE_RB_NULL ((dict_inline_node*)(void*)&rb_null)
+
+typedef struct dict_inline_hash_node dict_inline_hash_node;
+struct dict_inline_hash_node {
+    void*		key;
+    dict_inline_hash_node* next;
+    dict_inline_hash_node* prev;
+    unsigned		hash;
+    void*		datum;	    /* Not allocated in a set. */
+};
+
+typedef struct {
+    dict_inline_hash_node** table;
+    unsigned		size;
+    dict_compare_func	cmp_func;
+    dict_hash_func	hash_func;
+    bool		keys_only;
+    void*		set_datum;
+} dict_inline_hashtable;
+
+typedef struct {
+    dict_inline_hashtable* table;
+    dict_inline_hash_node* node;
+    unsigned		slot;
+} dict_inline_hashtable_itor;
+
+static inline void*
+dict_inline_tree_search(const void* Tree, const void* key,
+			const dict_inline_node* null)
+{
+    const dict_inline_tree* tree = (const dict_inline_tree*)Tree;
+    const dict_inline_node* node = tree->root;
+    while (node != null) {
+	int cmp = tree->cmp_func(key, node->key);
+	if (cmp < 0)
+	    node = node->llink;
+	else if (cmp)
+	    node = DICT_INLINE_RLINK(node);
+	else
+	    return tree->keys_only ? DICT_SET_MEMBER :
+				     *DICT_INLINE_DATUM(tree, node);
+    }
+    return NULL;
+}
+
+/* Advances a valid iterator to the in-order successor of its node. */
+static inline bool
+dict_inline_itor_step(void* Itor, const dict_inline_node* null)
+{
+    dict_inline_itor* itor = (dict_inline_itor*)Itor;
+    dict_inline_node* node = itor->node;
+    dict_inline_node* next = DICT_INLINE_RLINK(node);
+    if (next != null) {
+	while (next->llink != null)
+	    next = next->llink;
+    } else {
+	next = node->parent;
+	while (next != null && DICT_INLINE_RLINK(next) == node) {
+	    node = next;
+	    next = next->parent;
+	}
+    }
+    itor->node = next;
+    return next != null;
+}
+
+static inline const void*
+dict_inline_itor_key(const void* Itor, const dict_inline_node* null)
+{
+    const dict_inline_itor* itor = (const dict_inline_itor*)Itor;
+    return itor->node != null ? itor->node->key : NULL;
+}
+
+static inline void**
+dict_inline_itor_data(void* Itor, const dict_inline_node* null)
+{
+    dict_inline_itor* itor = (dict_inline_itor*)Itor;
+    if (itor->node == null)
+	return NULL;
+    if (itor->tree->keys_only) {
+	itor->tree->set_datum = DICT_SET_MEMBER;
+	return &itor->tree->set_datum;
+    }
+    return DICT_INLINE_DATUM(itor->tree, itor->node);
+}
+
+/* Defines the inline operations of a tree whose missing links are |null|. An
+ * invalid iterator is handed to the out-of-line next, which decides whether
+ * it restarts at the first node. */
+#define DICT_INLINE_TREE(prefix, itor_prefix, null) \
+    static inline void* \
+    prefix##_search_inline(prefix* tree, const void* key) \
+    { \
+	return dict_inline_tree_search(tree, key, null); \
+    } \
+    static inline bool \
+    itor_prefix##_next_inline(itor_prefix* itor) \
+    { \
+	if (((dict_inline_itor*)(void*)itor)->node == null) \
+	    return itor_prefix##_next(itor); \
+	return dict_inline_itor_step(itor, null); \
+    } \
+    static inline const void* \
+    itor_prefix##_key_inline(const itor_prefix* itor) \
+    { \
+	return dict_inline_itor_key(itor, null); \
+    } \
+    static inline void** \
+    itor_prefix##_data_inline(itor_prefix* itor) \
+    { \
+	return dict_inline_itor_data(itor, null); \
+    }
+
+DICT_INLINE_TREE(hb_tree, hb_itor, NULL)
+DICT_INLINE_TREE(pr_tree, pr_itor, NULL)
+DICT_INLINE_TREE(rb_tree, rb_itor, DICT_INLINE_RB_NULL)
+DICT_INLINE_TREE(tr_tree, tr_itor, NULL)
+DICT_INLINE_TREE(wavl_tree, wavl_itor, NULL)
+DICT_INLINE_TREE(wb_tree, wb_itor, NULL)
+
+/* The splay tree's search is a direct call; its iterator is inlined. */
+static inline void*
+sp_tree_search_inline(sp_tree* tree, const void* key)
+{
+    return sp_tree_search(tree, key);
+}
+
+static inline bool
+sp_itor_next_inline(sp_itor* itor)
+{
+    if (((dict_inline_itor*)(void*)itor)->node == NULL)
+	return sp_itor_next(itor);
+    return dict_inline_itor_step(itor, NULL);
+}
+
+static inline const void*
+sp_itor_key_inline(const sp_itor* itor)
+{
+    return dict_inline_itor_key(itor, NULL);
+}
+
+static inline void**
+sp_itor_data_inline(sp_itor* itor)
+{
+    return dict_inline_itor_data(itor, NULL);
+}
+
+static inline void*
+hashtable_search_inline(hashtable* Table, const void* key)
+{
+    const dict_inline_hashtable* table = (const dict_inline_hashtable*)Table;
+    const unsigned hash = table->hash_func(key);
+    const dict_inline_hash_node* node = table->table[hash % table->size];
+    while (node && hash >= node->hash) {
+	if (hash == node->hash && table->cmp_func(key, node->key) == 0)
+	    return table->keys_only ? DICT_SET_MEMBER : node->datum;
+	node = node->next;
+    }
+    return NULL;
+}
+
+static inline bool
+hashtable_itor_next_inline(hashtable_itor* Itor)
+{
+    dict_inline_hashtable_itor* itor = (dict_inline_hashtable_itor*)Itor;
+    if (!itor->node)
+	return hashtable_itor_next(Itor);
+    if ((itor->node = itor->node->next) != NULL)
+	return true;
+    for (unsigned slot = itor->slot + 1; slot < itor->table->size; slot++) {
+	if (itor->table->table[slot]) {
+	    itor->node = itor->table->table[slot];
+	    itor->slot = slot;
+	    return true;
+	}
+    }
+    itor->slot = 0;
+    return false;
+}
+
+static inline const void*
+hashtable_itor_key_inline(const hashtable_itor* Itor)
+{
+    const dict_inline_hashtable_itor* itor =
+	(const dict_inline_hashtable_itor*)Itor;
+    return itor->node ? itor->node->key : NULL;
+}
+
+static inline void**
+hashtable_itor_data_inline(hashtable_itor* Itor)
+{
+    dict_inline_hashtable_itor* itor = (dict_inline_hashtable_itor*)Itor;
+    if (!itor->node)
+	return NULL;
+    if (itor->table->keys_only) {
+	itor->table->set_datum = DICT_SET_MEMBER;
+	return &itor->table->set_datum;
+    }
+    return &itor->node->datum;
+}
+
+/* Type-generic front end: dict_search_typed(tree, key) and so on select the
+ * inline function, or the direct call, for the container's type. */
+#if !defined(__cplusplus) && \
+    ((defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L) || \
+     defined(__clang__) || \
+     (defined(__GNUC__) && (__GNUC__ > 4 || \
+			    (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+
+#define dict_search_typed(c,k) _Generic((c), \
+    hashtable*:		hashtable_search_inline, \
+    hb_tree*:		hb_tree_search_inline, \
+    pr_tree*:		pr_tree_search_inline, \
+    rb_tree*:		rb_tree_search_inline, \
+    sg_tree*:		sg_tree_search, \
+    skiplist*:		skiplist_search, \
+    sp_tree*:		sp_tree_search_inline, \
+    tr_tree*:		tr_tree_search_inline, \
+    wavl_tree*:		wavl_tree_search_inline, \
+    wb_tree*:		wb_tree_search_inline)((c), (k))
+
+#define dict_insert_typed(c,k,i) _Generic((c), \
+    hashtable*:		hashtable_insert, \
+    hb_tree*:		hb_tree_insert, \
+    pr_tree*:		pr_tree_insert, \
+    rb_tree*:		rb_tree_insert, \
+    sg_tree*:		sg_tree_insert, \
+    skiplist*:		skiplist_insert, \
+    sp_tree*:		sp_tree_insert, \
+    tr_tree*:		tr_tree_insert, \
+    wavl_tree*:		wavl_tree_insert, \
+    wb_tree*:		wb_tree_insert)((c), (k), (i))
+
+#define dict_itor_next_typed(i) _Generic((i), \
+    hashtable_itor*:	hashtable_itor_next_inline, \
+    hb_itor*:		hb_itor_next_inline, \
+    pr_itor*:		pr_itor_next_inline, \
+    rb_itor*:		rb_itor_next_inline, \
+    sg_itor*:		sg_itor_next, \
+    skiplist_itor*:	skiplist_itor_next, \
+    sp_itor*:		sp_itor_next_inline, \
+    tr_itor*:		tr_itor_next_inline, \
+    wavl_itor*:		wavl_itor_next_inline, \
+    wb_itor*:		wb_itor_next_inline)(i)
+
+#define dict_itor_key_typed(i) _Generic((i), \
+    hashtable_itor*:	hashtable_itor_key_inline, \
+    hb_itor*:		hb_itor_key_inline, \
+    pr_itor*:		pr_itor_key_inline, \
+    rb_itor*:		rb_itor_key_inline, \
+    sg_itor*:		sg_itor_key, \
+    skiplist_itor*:	skiplist_itor_key, \
+    sp_itor*:		sp_itor_key_inline, \
+    tr_itor*:		tr_itor_key_inline, \
+    wavl_itor*:		wavl_itor_key_inline, \
+    wb_itor*:		wb_itor_key_inline)(i)
+
+#define dict_itor_data_typed(i) _Generic((i), \
+    hashtable_itor*:	hashtable_itor_data_inline, \
+    hb_itor*:		hb_itor_data_inline, \
+    pr_itor*:		pr_itor_data_inline, \
+    rb_itor*:		rb_itor_data_inline, \
+    sg_itor*:		sg_itor_data, \
+    skiplist_itor*:	skiplist_itor_data, \
+    sp_itor*:		sp_itor_data_inline, \
+    tr_itor*:		tr_itor_data_inline, \
+    wavl_itor*:		wavl_itor_data_inline, \
+    wb_itor*:		wb_itor_data_inline)(i)
+
+#endif
+
+END_DECL
+
+#endif /* !_DICT_INLINE_H_ */
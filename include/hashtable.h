@@ -45,6 +45,14 @@ hashtable*	hashtable_new(dict_compare_func cmp_func,
 dict*		hashtable_dict_new(dict_compare_func cmp_func,
 				   dict_hash_func hash_func,
 				   dict_delete_func del_func, unsigned size);
+/* A set of keys, whose nodes are a pointer smaller; see DICT_SET_MEMBER. */
+hashtable*	hashtable_new_set(dict_compare_func cmp_func,
+				  dict_hash_func hash_func,
+				  dict_delete_func del_func, unsigned size);
+dict*		hashtable_dict_new_set(dict_compare_func cmp_func,
+				       dict_hash_func hash_func,
+				       dict_delete_func del_func,
+				       unsigned size);
 size_t		hashtable_free(hashtable* table);
 hashtable*	hashtable_clone(hashtable* table,
 				dict_key_datum_clone_func clone_func);
@@ -52,8 +60,12 @@ hashtable*	hashtable_clone(hashtable* table,
 void**		hashtable_insert(hashtable* table, void* key, bool* inserted);
 void*		hashtable_search(hashtable* table, const void* key);
 bool		hashtable_remove(hashtable* table, const void* key);
+size_t		hashtable_remove_if(hashtable* table, dict_predicate_func pred,
+				    void* ctx);
 size_t		hashtable_clear(hashtable* table);
 size_t		hashtable_traverse(hashtable* table, dict_visit_func visit);
+size_t		hashtable_export(hashtable* table, void** keys, void** data,
+				 size_t max, dict_export_pos* pos);
 size_t		hashtable_count(const hashtable* table);
 size_t		hashtable_size(const hashtable* table);
 size_t		hashtable_slots_used(const hashtable* table);
@@ -79,6 +91,80 @@ const void*	hashtable_itor_key(const hashtable_itor* itor);
 void**		hashtable_itor_data(hashtable_itor* itor);
 bool		hashtable_itor_remove(hashtable_itor* itor);
 
+/* A frozen hashtable holds a fixed set of entries in one array, placed by a
+ * minimal perfect hash of their hash values, so that a lookup reads one entry
+ * and compares one key. Only keys whose hash values collide with another's
+ * (which the perfect hash cannot tell apart) cost more: they are kept at the
+ * end of the array, sorted by hash value, and found by a binary search.
+ *
+ * Freezing moves the entries of |table| into the frozen table, which takes
+ * over calling its delete function; |table| is left empty. As with the static
+ * indexes, insertion into a frozen table only succeeds for keys already
+ * present, returning the location of their datum, removal always fails, and
+ * clearing deletes every entry. Iteration visits the entries in no particular
+ * order. Freezing fails if memory runs out, leaving |table| unchanged. */
+typedef struct hashtable_frozen hashtable_frozen;
+
+hashtable_frozen* hashtable_freeze(hashtable* table);
+dict*		hashtable_freeze_dict(hashtable* table);
+size_t		hashtable_frozen_free(hashtable_frozen* frozen);
+hashtable_frozen* hashtable_frozen_clone(hashtable_frozen* frozen,
+					 dict_key_datum_clone_func clone_func);
+
+void**		hashtable_frozen_insert(hashtable_frozen* frozen, void* key,
+					bool* inserted);
+void*		hashtable_frozen_search(hashtable_frozen* frozen,
+					const void* key);
+bool		hashtable_frozen_remove(hashtable_frozen* frozen,
+					const void* key);
+size_t		hashtable_frozen_clear(hashtable_frozen* frozen);
+size_t		hashtable_frozen_traverse(hashtable_frozen* frozen,
+					  dict_visit_func visit);
+size_t		hashtable_frozen_export(hashtable_frozen* frozen, void** keys,
+					void** data, size_t max,
+					dict_export_pos* pos);
+size_t		hashtable_frozen_count(const hashtable_frozen* frozen);
+bool		hashtable_frozen_verify(const hashtable_frozen* frozen);
+
+/* Writes a frozen table to the file at |path|, for keys that are byte
+ * strings of |key_size| bytes. Datums are written as they are, as
+ * pointer-sized values, so they should be integers or file offsets rather than
+ * pointers to memory. The file can only be loaded on machines with the same
+ * byte order and pointer size. */
+bool		hashtable_frozen_save(const hashtable_frozen* frozen,
+				      const char* path, size_t key_size);
+/* Maps the file at |path| into memory as a frozen table, without reading or
+ * rebuilding it. Keys are pointers to their bytes in the mapping, and
+ * |hash_func| must hash them as the functions of the saved table did. Datums
+ * can be changed in memory, which does not change the file. */
+hashtable_frozen* hashtable_frozen_load(const char* path,
+					dict_compare_func cmp_func,
+					dict_hash_func hash_func);
+dict*		hashtable_frozen_dict_load(const char* path,
+					   dict_compare_func cmp_func,
+					   dict_hash_func hash_func);
+
+typedef struct hashtable_frozen_itor hashtable_frozen_itor;
+
+hashtable_frozen_itor* hashtable_frozen_itor_new(hashtable_frozen* frozen);
+dict_itor*	hashtable_frozen_dict_itor_new(hashtable_frozen* frozen);
+void		hashtable_frozen_itor_free(hashtable_frozen_itor* itor);
+
+bool		hashtable_frozen_itor_valid(const hashtable_frozen_itor* itor);
+void		hashtable_frozen_itor_invalidate(hashtable_frozen_itor* itor);
+bool		hashtable_frozen_itor_next(hashtable_frozen_itor* itor);
+bool		hashtable_frozen_itor_prev(hashtable_frozen_itor* itor);
+bool		hashtable_frozen_itor_nextn(hashtable_frozen_itor* itor,
+					    size_t count);
+bool		hashtable_frozen_itor_prevn(hashtable_frozen_itor* itor,
+					    size_t count);
+bool		hashtable_frozen_itor_first(hashtable_frozen_itor* itor);
+bool		hashtable_frozen_itor_last(hashtable_frozen_itor* itor);
+bool		hashtable_frozen_itor_search(hashtable_frozen_itor* itor,
+					     const void* key);
+const void*	hashtable_frozen_itor_key(const hashtable_frozen_itor* itor);
+void**		hashtable_frozen_itor_data(hashtable_frozen_itor* itor);
+
 END_DECL
 
 #endif /* !_HASHTABLE_H_ */
@@ -43,6 +43,11 @@ hb_tree*	hb_tree_new(dict_compare_func cmp_func,
 			    dict_delete_func del_func);
 dict*		hb_dict_new(dict_compare_func cmp_func,
 			    dict_delete_func del_func);
+/* A set of keys, whose nodes are a pointer smaller; see DICT_SET_MEMBER. */
+hb_tree*	hb_tree_new_set(dict_compare_func cmp_func,
+				dict_delete_func del_func);
+dict*		hb_dict_new_set(dict_compare_func cmp_func,
+				dict_delete_func del_func);
 size_t		hb_tree_free(hb_tree* tree);
 hb_tree*	hb_tree_clone(hb_tree* tree,
 			      dict_key_datum_clone_func clone_func);
@@ -50,8 +55,16 @@ hb_tree*	hb_tree_clone(hb_tree* tree,
 void**		hb_tree_insert(hb_tree* tree, void* key, bool* inserted);
 void*		hb_tree_search(hb_tree* tree, const void* key);
 bool		hb_tree_remove(hb_tree* tree, const void* key);
+size_t		hb_tree_remove_many(hb_tree* tree, const void** keys,
+				    size_t count);
+size_t		hb_tree_remove_if(hb_tree* tree, dict_predicate_func pred,
+				  void* ctx);
 size_t		hb_tree_clear(hb_tree* tree);
 size_t		hb_tree_traverse(hb_tree* tree, dict_visit_func visit);
+size_t		hb_tree_export(hb_tree* tree, void** keys, void** data,
+			       size_t max, dict_export_pos* pos);
+size_t		hb_tree_export_all(hb_tree* tree, void** keys, void** data,
+				   unsigned threads);
 size_t		hb_tree_count(const hb_tree* tree);
 size_t		hb_tree_height(const hb_tree* tree);
 size_t		hb_tree_mheight(const hb_tree* tree);
@@ -59,6 +72,18 @@ size_t		hb_tree_pathlen(const hb_tree* tree);
 const void*	hb_tree_min(const hb_tree* tree);
 const void*	hb_tree_max(const hb_tree* tree);
 bool		hb_tree_verify(const hb_tree* tree);
+bool		hb_tree_set_aggregate(hb_tree* tree,
+				      dict_aggregate_func agg_func,
+				      size_t agg_size);
+bool		hb_tree_update_aggregate(hb_tree* tree, const void* key);
+bool		hb_tree_range_aggregate(hb_tree* tree, const void* lo,
+					const void* hi, void* result);
+/* Copy the nodes into one contiguous allocation in |order|; iterators are
+ * invalidated. Returns false, leaving the tree as it was, if out of memory. */
+bool		hb_tree_relayout(hb_tree* tree, dict_layout order);
+/* Do about |budget| nodes' worth of a breadth-first relayout, which may be
+ * interleaved with other operations. Returns true once it is complete. */
+bool		hb_tree_relayout_step(hb_tree* tree, size_t budget);
 
 typedef struct hb_itor hb_itor;
 
@@ -0,0 +1,90 @@
+/*
+ * libdict -- interval tree interface.
+ *
+ * Copyright (c) 2001-2011, Farooq Mela
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *    This product includes software developed by Farooq Mela.
+ * 4. Neither the name Farooq Mela nor the names of contributors may be used to
+ *    endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY FAROOQ MELA ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL FAROOQ MELA BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _IV_TREE_H_
+#define _IV_TREE_H_
+
+#include "dict.h"
+
+BEGIN_DECL
+
+/* A closed interval [lo, hi]. Keys of an interval tree must point to objects
+ * that begin with an iv_interval; the tree orders them by |lo|, then by |hi|,
+ * comparing endpoints with its comparison function. */
+typedef struct {
+    void*	    lo;
+    void*	    hi;
+} iv_interval;
+
+typedef struct iv_tree iv_tree;
+
+iv_tree*	iv_tree_new(dict_compare_func cmp_func,
+			    dict_delete_func del_func);
+dict*		iv_dict_new(dict_compare_func cmp_func,
+			    dict_delete_func del_func);
+size_t		iv_tree_free(iv_tree* tree);
+iv_tree*	iv_tree_clone(iv_tree* tree,
+			      dict_key_datum_clone_func clone_func);
+
+void**		iv_tree_insert(iv_tree* tree, void* key, bool* inserted);
+void*		iv_tree_search(iv_tree* tree, const void* key);
+bool		iv_tree_remove(iv_tree* tree, const void* key);
+size_t		iv_tree_remove_if(iv_tree* tree, dict_predicate_func pred,
+				  void* ctx);
+size_t		iv_tree_clear(iv_tree* tree);
+size_t		iv_tree_traverse(iv_tree* tree, dict_visit_func visit);
+size_t		iv_tree_export(iv_tree* tree, void** keys, void** data,
+			       size_t max, dict_export_pos* pos);
+size_t		iv_tree_export_all(iv_tree* tree, void** keys, void** data,
+				   unsigned threads);
+size_t		iv_tree_count(const iv_tree* tree);
+size_t		iv_tree_height(const iv_tree* tree);
+size_t		iv_tree_mheight(const iv_tree* tree);
+size_t		iv_tree_pathlen(const iv_tree* tree);
+const void*	iv_tree_min(const iv_tree* tree);
+const void*	iv_tree_max(const iv_tree* tree);
+bool		iv_tree_verify(const iv_tree* tree);
+
+/* Call |visit| with each interval overlapping [lo, hi] and its datum, in
+ * order, until it returns false. Returns the number of calls. */
+size_t		iv_tree_overlaps(iv_tree* tree, const void* lo, const void* hi,
+				 dict_visit_func visit);
+/* Call |visit| with each interval containing |point| and its datum, in order,
+ * until it returns false. Returns the number of calls. */
+size_t		iv_tree_stab(iv_tree* tree, const void* point,
+			     dict_visit_func visit);
+
+dict_itor*	iv_dict_itor_new(iv_tree* tree);
+
+END_DECL
+
+#endif /* !_IV_TREE_H_ */
@@ -0,0 +1,108 @@
+/*
+ * libdict -- static k-ary search tree definitions.
+ *
+ * Copyright (c) 2001-2011, Farooq Mela
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *    This product includes software developed by Farooq Mela.
+ * 4. Neither the name Farooq Mela nor the names of contributors may be used to
+ *    endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY FAROOQ MELA ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL FAROOQ MELA BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _KARY_INDEX_H_
+#define _KARY_INDEX_H_
+
+#include "dict.h"
+
+BEGIN_DECL
+
+/* A read-only search tree over a fixed set of integer keys, stored as
+ * pointer-sized values (e.g. (void*)(uintptr_t)42) and ordered as by
+ * dict_ptr_cmp. Each node is one 64-byte cache line of separator keys, 8 keys
+ * of 64 bits or, when every key fits, 16 of 32 bits, so that a node has 9 or
+ * 17 children and a lookup touches one line per level. The keys in a node are
+ * compared with the key sought all at once, with AVX2 or SSE instructions
+ * where the processor has them (chosen at run time), or else one by one.
+ *
+ * The index is built from |count| keys in increasing order, with their data
+ * (or none, if |data| is NULL), or from the contents of an ordered dictionary
+ * whose keys are such integers; construction fails if the keys do not
+ * increase. As with pgm_index, insertion only succeeds for keys already
+ * present, returning the location of their datum, removal always fails, and
+ * clearing deletes every entry, calling |del_func| if it is given. */
+typedef struct kary_index kary_index;
+
+kary_index*	kary_index_new(void* const* keys, void* const* data,
+			       size_t count, dict_delete_func del_func);
+kary_index*	kary_index_from_dict(dict* dct, dict_delete_func del_func);
+dict*		kary_dict_new(void* const* keys, void* const* data,
+			      size_t count, dict_delete_func del_func);
+dict*		kary_dict_from_dict(dict* dct, dict_delete_func del_func);
+size_t		kary_index_free(kary_index* index);
+/* |clone_func| must leave the value of each key unchanged. */
+kary_index*	kary_index_clone(kary_index* index,
+				 dict_key_datum_clone_func clone_func);
+
+void**		kary_index_insert(kary_index* index, void* key, bool* inserted);
+void*		kary_index_search(kary_index* index, const void* key);
+bool		kary_index_remove(kary_index* index, const void* key);
+size_t		kary_index_clear(kary_index* index);
+size_t		kary_index_traverse(kary_index* index, dict_visit_func visit);
+size_t		kary_index_export(kary_index* index, void** keys, void** data,
+				  size_t max, dict_export_pos* pos);
+size_t		kary_index_count(const kary_index* index);
+size_t		kary_index_height(const kary_index* index);
+/* Returns the position in key order of the first key not less than |key|,
+ * or the number of keys if there is none. */
+size_t		kary_index_lower_bound(const kary_index* index,
+				       const void* key);
+/* Selects comparisons with vector instructions, if the processor has them,
+ * or one key at a time, and returns whether vector instructions are used. */
+bool		kary_index_use_simd(kary_index* index, bool enable);
+bool		kary_index_verify(const kary_index* index);
+
+typedef struct kary_itor kary_itor;
+
+kary_itor*	kary_itor_new(kary_index* index);
+dict_itor*	kary_dict_itor_new(kary_index* index);
+void		kary_itor_free(kary_itor* itor);
+
+bool		kary_itor_valid(const kary_itor* itor);
+void		kary_itor_invalidate(kary_itor* itor);
+bool		kary_itor_next(kary_itor* itor);
+bool		kary_itor_prev(kary_itor* itor);
+bool		kary_itor_nextn(kary_itor* itor, size_t count);
+bool		kary_itor_prevn(kary_itor* itor, size_t count);
+bool		kary_itor_first(kary_itor* itor);
+bool		kary_itor_last(kary_itor* itor);
+bool		kary_itor_search(kary_itor* itor, const void* key);
+/* Move to the first key not less than |key|, from anywhere. */
+bool		kary_itor_lower_bound(kary_itor* itor, const void* key);
+bool		kary_itor_seek(kary_itor* itor, const void* key);
+const void*	kary_itor_key(const kary_itor* itor);
+void**		kary_itor_data(kary_itor* itor);
+
+END_DECL
+
+#endif /* !_KARY_INDEX_H_ */
@@ -0,0 +1,94 @@
+/*
+ * libdict -- log-structured merge tree interface.
+ *
+ * Copyright (c) 2001-2011, Farooq Mela
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *    This product includes software developed by Farooq Mela.
+ * 4. Neither the name Farooq Mela nor the names of contributors may be used to
+ *    endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY FAROOQ MELA ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL FAROOQ MELA BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _LSMTREE_H_
+#define _LSMTREE_H_
+
+#include "dict.h"
+
+BEGIN_DECL
+
+/* A log-structured merge tree keeps recent insertions in a skiplist memtable.
+ * Once the memtable holds |mem_limit| keys, it is frozen into an immutable
+ * sorted run; runs of similar size are then merged together, so that there
+ * are only logarithmically many of them. Merging is spread over the insertions
+ * and removals that follow, a few entries each, so none of them takes more
+ * than about a freeze's worth of time. Each run carries a Bloom filter
+ * (built with |hash_func|, if given) and its key range, which lookups consult
+ * before searching the run. Keys are unique across the memtable and the runs.
+ * Any insertion or removal invalidates existing iterators. */
+typedef struct lsmtree lsmtree;
+
+lsmtree*	lsmtree_new(dict_compare_func cmp_func,
+			    dict_hash_func hash_func,
+			    dict_delete_func del_func, size_t mem_limit);
+dict*		lsmtree_dict_new(dict_compare_func cmp_func,
+				 dict_hash_func hash_func,
+				 dict_delete_func del_func, size_t mem_limit);
+size_t		lsmtree_free(lsmtree* tree);
+lsmtree*	lsmtree_clone(lsmtree* tree,
+			      dict_key_datum_clone_func clone_func);
+
+void**		lsmtree_insert(lsmtree* tree, void* key, bool* inserted);
+void*		lsmtree_search(lsmtree* tree, const void* key);
+bool		lsmtree_remove(lsmtree* tree, const void* key);
+size_t		lsmtree_clear(lsmtree* tree);
+size_t		lsmtree_traverse(lsmtree* tree, dict_visit_func visit);
+size_t		lsmtree_count(const lsmtree* tree);
+size_t		lsmtree_run_count(const lsmtree* tree);
+bool		lsmtree_flush(lsmtree* tree);
+/* Do about |budget| entries' worth of the pending merge, as each insertion and
+ * removal does. Returns true once no merge is pending. */
+bool		lsmtree_merge_step(lsmtree* tree, size_t budget);
+bool		lsmtree_verify(const lsmtree* tree);
+
+typedef struct lsmtree_itor lsmtree_itor;
+
+lsmtree_itor*	lsmtree_itor_new(lsmtree* tree);
+dict_itor*	lsmtree_dict_itor_new(lsmtree* tree);
+void		lsmtree_itor_free(lsmtree_itor* itor);
+
+bool		lsmtree_itor_valid(const lsmtree_itor* itor);
+void		lsmtree_itor_invalidate(lsmtree_itor* itor);
+bool		lsmtree_itor_next(lsmtree_itor* itor);
+bool		lsmtree_itor_prev(lsmtree_itor* itor);
+bool		lsmtree_itor_nextn(lsmtree_itor* itor, size_t count);
+bool		lsmtree_itor_prevn(lsmtree_itor* itor, size_t count);
+bool		lsmtree_itor_first(lsmtree_itor* itor);
+bool		lsmtree_itor_last(lsmtree_itor* itor);
+bool		lsmtree_itor_seek(lsmtree_itor* itor, const void* key);
+const void*	lsmtree_itor_key(const lsmtree_itor* itor);
+void**		lsmtree_itor_data(lsmtree_itor* itor);
+
+END_DECL
+
+#endif /* !_LSMTREE_H_ */
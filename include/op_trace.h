@@ -0,0 +1,109 @@
+/*
+ * libdict -- operation trace interface.
+ *
+ * Copyright (c) 2001-2011, Farooq Mela
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *    This product includes software developed by Farooq Mela.
+ * 4. Neither the name Farooq Mela nor the names of contributors may be used to
+ *    endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY FAROOQ MELA ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL FAROOQ MELA BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _OP_TRACE_H_
+#define _OP_TRACE_H_
+
+#include "dict.h"
+
+BEGIN_DECL
+
+/* An operation trace records the insertions, searches, removals and clears
+ * made on any dictionary to a compact binary file, for replaying against
+ * other containers offline (see replay.c). Each record holds the operation,
+ * its result, the time it started, and the key: its serialized bytes, if an
+ * encoder is given, or else its pointer value as an ID, which suits integer
+ * keys stored in pointers. Records are buffered and written out when the
+ * buffer fills, on flush, and on free; they are not synced to disk.
+ *
+ * Traversals, iterators and bulk removals are not recorded. A search is
+ * recorded as found if it returned a non-NULL datum. */
+
+/* A pointer to a function that writes the serialized form of |key| into
+ * |buf|, which has room for |size| bytes, and returns its length. If the
+ * length exceeds |size|, it is called again with a large enough buffer. */
+typedef size_t	    (*op_trace_encode_func)(const void* key, void* buf,
+					    size_t size);
+
+typedef struct op_trace op_trace;
+
+/* Creates, or truncates, the trace file at |path| for |dct|. Freeing the
+ * trace flushes it, and frees the dictionary. */
+op_trace*	op_trace_new(dict* dct, const char* path,
+			     op_trace_encode_func key_encode);
+dict*		op_trace_dict_new(dict* dct, const char* path,
+				  op_trace_encode_func key_encode);
+size_t		op_trace_free(op_trace* trace);
+op_trace*	op_trace_clone(op_trace* trace,
+			       dict_key_datum_clone_func clone_func);
+
+void**		op_trace_insert(op_trace* trace, void* key, bool* inserted);
+void*		op_trace_search(op_trace* trace, const void* key);
+bool		op_trace_remove(op_trace* trace, const void* key);
+size_t		op_trace_clear(op_trace* trace);
+size_t		op_trace_traverse(op_trace* trace, dict_visit_func visit);
+size_t		op_trace_count(const op_trace* trace);
+bool		op_trace_verify(const op_trace* trace);
+dict_itor*	op_trace_itor_new(op_trace* trace);
+
+/* Writes out the buffered records, returning false if one could not be
+ * written; records are dropped from then on. */
+bool		op_trace_flush(op_trace* trace);
+/* Returns the number of operations recorded. */
+size_t		op_trace_records(const op_trace* trace);
+
+typedef struct {
+    dict_op		op;
+    int			result;	    /* 1 if the key was inserted, found or
+				     * removed, 0 if not, -1 on failure. */
+    uint64_t		nsec;	    /* Since the trace was created. */
+    const void*		key;	    /* Serialized key, or NULL for an ID. */
+    size_t		key_size;
+    uint64_t		key_id;
+} op_trace_record;
+
+typedef struct op_trace_reader op_trace_reader;
+
+/* Opens the trace file at |path| for reading, or returns NULL if it cannot
+ * be read or is not a trace. */
+op_trace_reader*    op_trace_reader_open(const char* path);
+void		    op_trace_reader_close(op_trace_reader* reader);
+/* Returns whether the keys in the trace were serialized, rather than IDs. */
+bool		    op_trace_reader_keys(const op_trace_reader* reader);
+/* Reads the next record into |record|, whose key stays valid until the next
+ * call. Returns false at the end of the trace, or at a record cut short. */
+bool		    op_trace_reader_next(op_trace_reader* reader,
+					 op_trace_record* record);
+
+END_DECL
+
+#endif /* !_OP_TRACE_H_ */
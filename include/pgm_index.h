@@ -0,0 +1,107 @@
+/*
+ * libdict -- learned index definitions.
+ *
+ * Copyright (c) 2001-2011, Farooq Mela
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *    This product includes software developed by Farooq Mela.
+ * 4. Neither the name Farooq Mela nor the names of contributors may be used to
+ *    endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY FAROOQ MELA ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL FAROOQ MELA BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _PGM_INDEX_H_
+#define _PGM_INDEX_H_
+
+#include "dict.h"
+
+BEGIN_DECL
+
+/* A read-only index over a fixed set of integer keys, stored as pointer-sized
+ * values (e.g. (void*)(uintptr_t)42) and ordered as by dict_ptr_cmp. The keys
+ * are kept in a sorted array, and a key's position in it is predicted by a
+ * piecewise linear model that is itself indexed by smaller such models, level
+ * by level. Each prediction is within a bound of the true position that is at
+ * most about |epsilon|, so a lookup evaluates one line per level and finishes
+ * with a binary search over about 2 * |epsilon| keys. Smaller values of
+ * |epsilon| make for more segments and shorter final searches.
+ *
+ * The index is built from |count| keys in increasing order, with their data
+ * (or none, if |data| is NULL), or from the contents of an ordered dictionary
+ * whose keys are such integers; construction fails if the keys do not
+ * increase. Insertion only succeeds for keys already present, returning the
+ * location of their datum, and removal always fails; clearing the index
+ * deletes every entry and leaves it empty. |del_func|, if given, is called on
+ * the entries when the index is cleared or freed. */
+typedef struct pgm_index pgm_index;
+
+pgm_index*	pgm_index_new(void* const* keys, void* const* data,
+			      size_t count, size_t epsilon,
+			      dict_delete_func del_func);
+pgm_index*	pgm_index_from_dict(dict* dct, size_t epsilon,
+				    dict_delete_func del_func);
+dict*		pgm_dict_new(void* const* keys, void* const* data,
+			     size_t count, size_t epsilon,
+			     dict_delete_func del_func);
+dict*		pgm_dict_from_dict(dict* dct, size_t epsilon,
+				   dict_delete_func del_func);
+size_t		pgm_index_free(pgm_index* index);
+/* |clone_func| must leave the value of each key unchanged. */
+pgm_index*	pgm_index_clone(pgm_index* index,
+				dict_key_datum_clone_func clone_func);
+
+void**		pgm_index_insert(pgm_index* index, void* key, bool* inserted);
+void*		pgm_index_search(pgm_index* index, const void* key);
+bool		pgm_index_remove(pgm_index* index, const void* key);
+size_t		pgm_index_clear(pgm_index* index);
+size_t		pgm_index_traverse(pgm_index* index, dict_visit_func visit);
+size_t		pgm_index_export(pgm_index* index, void** keys, void** data,
+				 size_t max, dict_export_pos* pos);
+size_t		pgm_index_count(const pgm_index* index);
+/* The number of levels of models, and of segments on the bottom level. */
+size_t		pgm_index_height(const pgm_index* index);
+size_t		pgm_index_segments(const pgm_index* index);
+bool		pgm_index_verify(const pgm_index* index);
+
+typedef struct pgm_itor pgm_itor;
+
+pgm_itor*	pgm_itor_new(pgm_index* index);
+dict_itor*	pgm_dict_itor_new(pgm_index* index);
+void		pgm_itor_free(pgm_itor* itor);
+
+bool		pgm_itor_valid(const pgm_itor* itor);
+void		pgm_itor_invalidate(pgm_itor* itor);
+bool		pgm_itor_next(pgm_itor* itor);
+bool		pgm_itor_prev(pgm_itor* itor);
+bool		pgm_itor_nextn(pgm_itor* itor, size_t count);
+bool		pgm_itor_prevn(pgm_itor* itor, size_t count);
+bool		pgm_itor_first(pgm_itor* itor);
+bool		pgm_itor_last(pgm_itor* itor);
+bool		pgm_itor_search(pgm_itor* itor, const void* key);
+bool		pgm_itor_seek(pgm_itor* itor, const void* key);
+const void*	pgm_itor_key(const pgm_itor* itor);
+void**		pgm_itor_data(pgm_itor* itor);
+
+END_DECL
+
+#endif /* !_PGM_INDEX_H_ */
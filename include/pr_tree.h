@@ -43,6 +43,11 @@ pr_tree*	pr_tree_new(dict_compare_func cmp_func,
 			    dict_delete_func del_func);
 dict*		pr_dict_new(dict_compare_func cmp_func,
 			    dict_delete_func del_func);
+/* A set of keys, whose nodes are a pointer smaller; see DICT_SET_MEMBER. */
+pr_tree*	pr_tree_new_set(dict_compare_func cmp_func,
+				dict_delete_func del_func);
+dict*		pr_dict_new_set(dict_compare_func cmp_func,
+				dict_delete_func del_func);
 size_t		pr_tree_free(pr_tree* tree);
 pr_tree*	pr_tree_clone(pr_tree* tree,
 			      dict_key_datum_clone_func clone_func);
@@ -50,8 +55,16 @@ pr_tree*	pr_tree_clone(pr_tree* tree,
 void**		pr_tree_insert(pr_tree* tree, void* key, bool* inserted);
 void*		pr_tree_search(pr_tree* tree, const void* key);
 bool		pr_tree_remove(pr_tree* tree, const void* key);
+size_t		pr_tree_remove_many(pr_tree* tree, const void** keys,
+				    size_t count);
+size_t		pr_tree_remove_if(pr_tree* tree, dict_predicate_func pred,
+				  void* ctx);
 size_t		pr_tree_clear(pr_tree* tree);
 size_t		pr_tree_traverse(pr_tree* tree, dict_visit_func visit);
+size_t		pr_tree_export(pr_tree* tree, void** keys, void** data,
+			       size_t max, dict_export_pos* pos);
+size_t		pr_tree_export_all(pr_tree* tree, void** keys, void** data,
+				   unsigned threads);
 size_t		pr_tree_count(const pr_tree* tree);
 size_t		pr_tree_height(const pr_tree* tree);
 size_t		pr_tree_mheight(const pr_tree* tree);
@@ -43,6 +43,11 @@ rb_tree*	rb_tree_new(dict_compare_func cmp_func,
 			    dict_delete_func del_func);
 dict*		rb_dict_new(dict_compare_func cmp_func,
 			    dict_delete_func del_func);
+/* A set of keys, whose nodes are a pointer smaller; see DICT_SET_MEMBER. */
+rb_tree*	rb_tree_new_set(dict_compare_func cmp_func,
+				dict_delete_func del_func);
+dict*		rb_dict_new_set(dict_compare_func cmp_func,
+				dict_delete_func del_func);
 size_t		rb_tree_free(rb_tree* tree);
 rb_tree*	rb_tree_clone(rb_tree* tree,
 			      dict_key_datum_clone_func clone_func);
@@ -50,8 +55,16 @@ rb_tree*	rb_tree_clone(rb_tree* tree,
 void**		rb_tree_insert(rb_tree* tree, void* key, bool* inserted);
 void*		rb_tree_search(rb_tree* tree, const void* key);
 bool		rb_tree_remove(rb_tree* tree, const void* key);
+size_t		rb_tree_remove_many(rb_tree* tree, const void** keys,
+				    size_t count);
+size_t		rb_tree_remove_if(rb_tree* tree, dict_predicate_func pred,
+				  void* ctx);
 size_t		rb_tree_clear(rb_tree* tree);
 size_t		rb_tree_traverse(rb_tree* tree, dict_visit_func visit);
+size_t		rb_tree_export(rb_tree* tree, void** keys, void** data,
+			       size_t max, dict_export_pos* pos);
+size_t		rb_tree_export_all(rb_tree* tree, void** keys, void** data,
+				   unsigned threads);
 size_t		rb_tree_count(const rb_tree* tree);
 size_t		rb_tree_height(const rb_tree* tree);
 size_t		rb_tree_mheight(const rb_tree* tree);
@@ -59,6 +72,26 @@ size_t		rb_tree_pathlen(const rb_tree* tree);
 const void*	rb_tree_min(const rb_tree* tree);
 const void*	rb_tree_max(const rb_tree* tree);
 bool		rb_tree_verify(const rb_tree* tree);
+bool		rb_tree_set_aggregate(rb_tree* tree,
+				      dict_aggregate_func agg_func,
+				      size_t agg_size);
+bool		rb_tree_update_aggregate(rb_tree* tree, const void* key);
+bool		rb_tree_range_aggregate(rb_tree* tree, const void* lo,
+					const void* hi, void* result);
+/* Copy the nodes into one contiguous allocation in |order|; iterators are
+ * invalidated. Returns false, leaving the tree as it was, if out of memory. */
+bool		rb_tree_relayout(rb_tree* tree, dict_layout order);
+/* Do about |budget| nodes' worth of a breadth-first relayout, which may be
+ * interleaved with other operations. Returns true once it is complete. */
+bool		rb_tree_relayout_step(rb_tree* tree, size_t budget);
+/* In relaxed mode insertions defer their rebalancing, leaving red-red
+ * violations behind; removals do it only when the tree's black height needs
+ * fixing, after finishing the deferred work. Turning it off finishes it too.
+ * Returns false if out of memory. */
+bool		rb_tree_set_relaxed(rb_tree* tree, bool relaxed);
+/* Do up to |budget| steps of deferred rebalancing, each taking constant time.
+ * Returns true once none is left. */
+bool		rb_tree_rebalance_step(rb_tree* tree, size_t budget);
 
 typedef struct rb_itor rb_itor;
 
@@ -75,6 +108,7 @@ bool		rb_itor_prevn(rb_itor* itor, size_t count);
 bool		rb_itor_first(rb_itor* itor);
 bool		rb_itor_last(rb_itor* itor);
 bool		rb_itor_search(rb_itor* itor, const void* key);
+bool		rb_itor_seek(rb_itor* itor, const void* key);
 const void*	rb_itor_key(const rb_itor* itor);
 void**		rb_itor_data(rb_itor* itor);
 bool		rb_itor_remove(rb_itor* itor);
@@ -0,0 +1,95 @@
+/*
+ * libdict -- scapegoat tree interface.
+ *
+ * Copyright (c) 2001-2011, Farooq Mela
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *    This product includes software developed by Farooq Mela.
+ * 4. Neither the name Farooq Mela nor the names of contributors may be used to
+ *    endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY FAROOQ MELA ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL FAROOQ MELA BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef _SG_TREE_H_
+#define _SG_TREE_H_
+
+#include "dict.h"
+
+BEGIN_DECL
+
+typedef struct sg_tree sg_tree;
+
+sg_tree*	sg_tree_new(dict_compare_func cmp_func,
+			    dict_delete_func del_func);
+dict*		sg_dict_new(dict_compare_func cmp_func,
+			    dict_delete_func del_func);
+/* A set of keys, whose nodes are a pointer smaller; see DICT_SET_MEMBER. */
+sg_tree*	sg_tree_new_set(dict_compare_func cmp_func,
+				dict_delete_func del_func);
+dict*		sg_dict_new_set(dict_compare_func cmp_func,
+				dict_delete_func del_func);
+size_t		sg_tree_free(sg_tree* tree);
+sg_tree*	sg_tree_clone(sg_tree* tree,
+			      dict_key_datum_clone_func clone_func);
+
+void**		sg_tree_insert(sg_tree* tree, void* key, bool* inserted);
+void*		sg_tree_search(sg_tree* tree, const void* key);
+bool		sg_tree_remove(sg_tree* tree, const void* key);
+size_t		sg_tree_remove_many(sg_tree* tree, const void** keys,
+				    size_t count);
+size_t		sg_tree_remove_if(sg_tree* tree, dict_predicate_func pred,
+				  void* ctx);
+size_t		sg_tree_clear(sg_tree* tree);
+size_t		sg_tree_traverse(sg_tree* tree, dict_visit_func visit);
+size_t		sg_tree_export(sg_tree* tree, void** keys, void** data,
+			       size_t max, dict_export_pos* pos);
+size_t		sg_tree_count(const sg_tree* tree);
+size_t		sg_tree_height(const sg_tree* tree);
+size_t		sg_tree_mheight(const sg_tree* tree);
+size_t		sg_tree_pathlen(const sg_tree* tree);
+const void*	sg_tree_min(const sg_tree* tree);
+const void*	sg_tree_max(const sg_tree* tree);
+bool		sg_tree_verify(const sg_tree* tree);
+
+typedef struct sg_itor sg_itor;
+
+sg_itor*	sg_itor_new(sg_tree* tree);
+dict_itor*	sg_dict_itor_new(sg_tree* tree);
+void		sg_itor_free(sg_itor* tree);
+
+bool		sg_itor_valid(const sg_itor* itor);
+void		sg_itor_invalidate(sg_itor* itor);
+bool		sg_itor_next(sg_itor* itor);
+bool		sg_itor_prev(sg_itor* itor);
+bool		sg_itor_nextn(sg_itor* itor, size_t count);
+bool		sg_itor_prevn(sg_itor* itor, size_t count);
+bool		sg_itor_first(sg_itor* itor);
+bool		sg_itor_last(sg_itor* itor);
+bool		sg_itor_search(sg_itor* itor, const void* key);
+bool		sg_itor_seek(sg_itor* itor, const void* key);
+const void*	sg_itor_key(const sg_itor* itor);
+void**		sg_itor_data(sg_itor* itor);
+bool		sg_itor_remove(sg_itor* itor);
+
+END_DECL
+
+#endif /* !_SG_TREE_H_ */
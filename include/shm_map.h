@@ -0,0 +1,131 @@
+/*
+ * libdict -- dictionaries in POSIX shared memory interface.
+ *
+ * Copyright (c) 2001-2011, Farooq Mela
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *    This product includes software developed by Farooq Mela.
+ * 4. Neither the name Farooq Mela nor the names of contributors may be used to
+ *    endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY FAROOQ MELA ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL FAROOQ MELA BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _SHM_MAP_H_
+#define _SHM_MAP_H_
+
+#include "dict.h"
+
+BEGIN_DECL
+
+/* A shared map is a hashtable or red-black tree kept in a POSIX shared
+ * memory object, which any number of processes can open by name and search or
+ * modify. Nodes are allocated from the object, which has a fixed size, and
+ * link to one another by their offsets in it, so each process can map it at a
+ * different address. A process-shared readers-writer lock in the object lets
+ * searches proceed in parallel without any IPC beyond the lock itself, and
+ * serializes changes; each function takes and releases it, so every call is
+ * atomic with respect to every other process.
+ *
+ * As with db_tree, keys are byte strings of |key_size| bytes, which are copied
+ * into the map, and the comparison and hash functions are called with
+ * pointers to such copies. Datums are stored as they are, as pointer-sized
+ * values, so they should be integers or offsets rather than pointers to the
+ * memory of one process. Pointers to keys and datums returned by the map
+ * point into the object, and should only be used while no other process may
+ * be removing them. Storing a datum through the pointer returned by
+ * shm_map_insert() happens outside the lock, though it is a single aligned
+ * store; shm_map_put() inserts a key together with its datum.
+ *
+ * Freeing a map unmaps it from the process, leaving its contents to the other
+ * processes; shm_map_unlink() removes its name, and the object goes away once
+ * no process has it mapped. Insertion fails once the object is full. A
+ * process that dies while changing the map leaves its lock held. */
+typedef enum {
+    SHM_MAP_HASHTABLE,
+    SHM_MAP_RB_TREE
+} shm_map_layout;
+
+typedef struct shm_map shm_map;
+
+/* Creates the shared memory object |name|, of |size| bytes, which must not
+ * already exist. A hashtable has a fixed number of |buckets|; |hash_func| is
+ * not used by a red-black tree, and may be NULL. */
+shm_map*	shm_map_create(const char* name, shm_map_layout layout,
+			       size_t size, size_t key_size, unsigned buckets,
+			       dict_compare_func cmp_func,
+			       dict_hash_func hash_func);
+dict*		shm_dict_create(const char* name, shm_map_layout layout,
+				size_t size, size_t key_size, unsigned buckets,
+				dict_compare_func cmp_func,
+				dict_hash_func hash_func);
+/* Opens a map created by another process, or by this one. The functions must
+ * compare and hash keys as those of its creator do. */
+shm_map*	shm_map_open(const char* name, dict_compare_func cmp_func,
+			     dict_hash_func hash_func);
+dict*		shm_dict_open(const char* name, dict_compare_func cmp_func,
+			      dict_hash_func hash_func);
+bool		shm_map_unlink(const char* name);
+size_t		shm_map_free(shm_map* map);
+shm_map*	shm_map_clone(shm_map* map,
+			      dict_key_datum_clone_func clone_func);
+
+void**		shm_map_insert(shm_map* map, void* key, bool* inserted);
+/* Sets the datum of |key| to |datum|, inserting |key| if it is absent, and
+ * returns false only if the object is full. */
+bool		shm_map_put(shm_map* map, const void* key, void* datum);
+void*		shm_map_search(shm_map* map, const void* key);
+bool		shm_map_remove(shm_map* map, const void* key);
+size_t		shm_map_clear(shm_map* map);
+/* Visits the entries while holding the lock for reading, so |visit| must not
+ * change the map. */
+size_t		shm_map_traverse(shm_map* map, dict_visit_func visit);
+size_t		shm_map_count(const shm_map* map);
+/* Returns how many more keys the object has room for. */
+size_t		shm_map_room(const shm_map* map);
+bool		shm_map_verify(const shm_map* map);
+
+/* An iterator holds the lock for reading from its creation until it is
+ * freed, so the process holding it must not change the map meanwhile. A
+ * hashtable is iterated in no particular order. */
+typedef struct shm_map_itor shm_map_itor;
+
+shm_map_itor*	shm_map_itor_new(shm_map* map);
+dict_itor*	shm_map_dict_itor_new(shm_map* map);
+void		shm_map_itor_free(shm_map_itor* itor);
+
+bool		shm_map_itor_valid(const shm_map_itor* itor);
+void		shm_map_itor_invalidate(shm_map_itor* itor);
+bool		shm_map_itor_next(shm_map_itor* itor);
+bool		shm_map_itor_prev(shm_map_itor* itor);
+bool		shm_map_itor_nextn(shm_map_itor* itor, size_t count);
+bool		shm_map_itor_prevn(shm_map_itor* itor, size_t count);
+bool		shm_map_itor_first(shm_map_itor* itor);
+bool		shm_map_itor_last(shm_map_itor* itor);
+bool		shm_map_itor_search(shm_map_itor* itor, const void* key);
+bool		shm_map_itor_seek(shm_map_itor* itor, const void* key);
+const void*	shm_map_itor_key(const shm_map_itor* itor);
+void**		shm_map_itor_data(shm_map_itor* itor);
+
+END_DECL
+
+#endif /* !_SHM_MAP_H_ */
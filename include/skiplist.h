@@ -45,6 +45,13 @@ skiplist*	skiplist_new(dict_compare_func cmp_func,
 dict*		skiplist_dict_new(dict_compare_func cmp_func,
 				  dict_delete_func del_func,
 				  unsigned max_link);
+/* A set of keys, whose nodes are a pointer smaller; see DICT_SET_MEMBER. */
+skiplist*	skiplist_new_set(dict_compare_func cmp_func,
+				 dict_delete_func del_func,
+				 unsigned max_link);
+dict*		skiplist_dict_new_set(dict_compare_func cmp_func,
+				      dict_delete_func del_func,
+				      unsigned max_link);
 size_t		skiplist_free(skiplist* list);
 skiplist*	skiplist_clone(skiplist* list,
 			       dict_key_datum_clone_func clone_func);
@@ -54,8 +61,15 @@ void*		skiplist_search(skiplist* list, const void* key);
 bool		skiplist_remove(skiplist* list, const void* key);
 size_t		skiplist_clear(skiplist* list);
 size_t		skiplist_traverse(skiplist* list, dict_visit_func visit);
+size_t		skiplist_export(skiplist* list, void** keys, void** data,
+				size_t max, dict_export_pos* pos);
 size_t		skiplist_count(const skiplist* list);
 bool		skiplist_verify(const skiplist* list);
+/* A versioned list keeps superseded values while open snapshots may see them.
+ * Every insertion and removal commits under the next sequence number. Returns
+ * false if the list is not empty or has open snapshots. */
+bool		skiplist_set_versioned(skiplist* list, bool versioned);
+uint64_t	skiplist_sequence(const skiplist* list);
 
 typedef struct skiplist_itor skiplist_itor;
 
@@ -72,10 +86,25 @@ bool		skiplist_itor_prevn(skiplist_itor* itor, size_t count);
 bool		skiplist_itor_first(skiplist_itor* itor);
 bool		skiplist_itor_last(skiplist_itor* itor);
 bool		skiplist_itor_search(skiplist_itor* itor, const void* key);
+bool		skiplist_itor_seek(skiplist_itor* itor, const void* key);
 const void*	skiplist_itor_key(const skiplist_itor* itor);
 void**		skiplist_itor_data(skiplist_itor* itor);
 bool		skiplist_itor_remove(skiplist_itor* itor);
 
+/* A snapshot reads a versioned list as of the sequence number at which it was
+ * opened, while the list goes on being modified. Snapshots must be closed
+ * before the list is freed; values replaced or removed in the meantime are
+ * deleted once no snapshot can see them. */
+typedef struct skiplist_snapshot skiplist_snapshot;
+
+skiplist_snapshot* skiplist_snapshot_open(skiplist* list);
+void		skiplist_snapshot_close(skiplist_snapshot* snapshot);
+uint64_t	skiplist_snapshot_sequence(const skiplist_snapshot* snapshot);
+void*		skiplist_snapshot_search(const skiplist_snapshot* snapshot,
+					 const void* key);
+skiplist_itor*	skiplist_snapshot_itor_new(skiplist_snapshot* snapshot);
+dict_itor*	skiplist_snapshot_dict_itor_new(skiplist_snapshot* snapshot);
+
 END_DECL
 
 #endif /* !_SKIPLIST_H_ */
@@ -0,0 +1,94 @@
+/*
+ * libdict -- small map definitions.
+ *
+ * Copyright (c) 2001-2011, Farooq Mela
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *    This product includes software developed by Farooq Mela.
+ * 4. Neither the name Farooq Mela nor the names of contributors may be used to
+ *    endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY FAROOQ MELA ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL FAROOQ MELA BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _SMALLMAP_H_
+#define _SMALLMAP_H_
+
+#include "dict.h"
+
+BEGIN_DECL
+
+/* A small map keeps up to |capacity| entries sorted in an array allocated
+ * along with the map, so that a tiny dictionary costs one allocation and no
+ * nodes. Inserting one entry more converts it into the dictionary returned by
+ * |backend_new|, e.g. rb_dict_new, which then holds every entry; clearing the
+ * map returns it to the array. |backend_new| is passed a NULL delete function,
+ * since the map deletes keys and data itself. Any insertion or removal
+ * invalidates existing iterators. */
+typedef struct smallmap smallmap;
+
+typedef dict*	(*smallmap_backend_func)(dict_compare_func cmp_func,
+					 dict_delete_func del_func);
+
+smallmap*	smallmap_new(dict_compare_func cmp_func,
+			     dict_delete_func del_func,
+			     smallmap_backend_func backend_new,
+			     size_t capacity);
+dict*		smallmap_dict_new(dict_compare_func cmp_func,
+				  dict_delete_func del_func,
+				  smallmap_backend_func backend_new,
+				  size_t capacity);
+size_t		smallmap_free(smallmap* map);
+smallmap*	smallmap_clone(smallmap* map,
+			       dict_key_datum_clone_func clone_func);
+
+void**		smallmap_insert(smallmap* map, void* key, bool* inserted);
+void*		smallmap_search(smallmap* map, const void* key);
+bool		smallmap_remove(smallmap* map, const void* key);
+size_t		smallmap_clear(smallmap* map);
+size_t		smallmap_traverse(smallmap* map, dict_visit_func visit);
+size_t		smallmap_count(const smallmap* map);
+/* Returns the dictionary the map has converted into, or NULL. */
+dict*		smallmap_backend(smallmap* map);
+bool		smallmap_verify(const smallmap* map);
+
+typedef struct smallmap_itor smallmap_itor;
+
+smallmap_itor*	smallmap_itor_new(smallmap* map);
+dict_itor*	smallmap_dict_itor_new(smallmap* map);
+void		smallmap_itor_free(smallmap_itor* itor);
+
+bool		smallmap_itor_valid(const smallmap_itor* itor);
+void		smallmap_itor_invalidate(smallmap_itor* itor);
+bool		smallmap_itor_next(smallmap_itor* itor);
+bool		smallmap_itor_prev(smallmap_itor* itor);
+bool		smallmap_itor_nextn(smallmap_itor* itor, size_t count);
+bool		smallmap_itor_prevn(smallmap_itor* itor, size_t count);
+bool		smallmap_itor_first(smallmap_itor* itor);
+bool		smallmap_itor_last(smallmap_itor* itor);
+const void*	smallmap_itor_key(const smallmap_itor* itor);
+void**		smallmap_itor_data(smallmap_itor* itor);
+bool		smallmap_itor_seek(smallmap_itor* itor, const void* key);
+
+END_DECL
+
+#endif /* !_SMALLMAP_H_ */
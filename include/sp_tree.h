@@ -43,6 +43,11 @@ sp_tree*	sp_tree_new(dict_compare_func cmp_func,
 			    dict_delete_func del_func);
 dict*		sp_dict_new(dict_compare_func cmp_func,
 			    dict_delete_func del_func);
+/* A set of keys, whose nodes are a pointer smaller; see DICT_SET_MEMBER. */
+sp_tree*	sp_tree_new_set(dict_compare_func cmp_func,
+				dict_delete_func del_func);
+dict*		sp_dict_new_set(dict_compare_func cmp_func,
+				dict_delete_func del_func);
 size_t		sp_tree_free(sp_tree* tree);
 sp_tree*	sp_tree_clone(sp_tree* tree,
 			      dict_key_datum_clone_func clone_func);
@@ -50,8 +55,16 @@ sp_tree*	sp_tree_clone(sp_tree* tree,
 void**		sp_tree_insert(sp_tree* tree, void* key, bool* inserted);
 void*		sp_tree_search(sp_tree* tree, const void* key);
 bool		sp_tree_remove(sp_tree* tree, const void* key);
+size_t		sp_tree_remove_many(sp_tree* tree, const void** keys,
+				    size_t count);
+size_t		sp_tree_remove_if(sp_tree* tree, dict_predicate_func pred,
+				  void* ctx);
 size_t		sp_tree_clear(sp_tree* tree);
 size_t		sp_tree_traverse(sp_tree* tree, dict_visit_func visit);
+size_t		sp_tree_export(sp_tree* tree, void** keys, void** data,
+			       size_t max, dict_export_pos* pos);
+size_t		sp_tree_export_all(sp_tree* tree, void** keys, void** data,
+				   unsigned threads);
 size_t		sp_tree_count(const sp_tree* tree);
 size_t		sp_tree_height(const sp_tree* tree);
 size_t		sp_tree_mheight(const sp_tree* tree);
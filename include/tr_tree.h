@@ -45,6 +45,13 @@ tr_tree*	tr_tree_new(dict_compare_func compare_func,
 dict*		tr_dict_new(dict_compare_func compare_func,
 			    dict_prio_func prio_func,
 			    dict_delete_func del_func);
+/* A set of keys, whose nodes are a pointer smaller; see DICT_SET_MEMBER. */
+tr_tree*	tr_tree_new_set(dict_compare_func compare_func,
+				dict_prio_func prio_func,
+				dict_delete_func del_func);
+dict*		tr_dict_new_set(dict_compare_func compare_func,
+				dict_prio_func prio_func,
+				dict_delete_func del_func);
 size_t		tr_tree_free(tr_tree* tree);
 tr_tree*	tr_tree_clone(tr_tree* tree,
 			      dict_key_datum_clone_func clone_func);
@@ -52,8 +59,16 @@ tr_tree*	tr_tree_clone(tr_tree* tree,
 void**		tr_tree_insert(tr_tree* tree, void* key, bool* inserted);
 void*		tr_tree_search(tr_tree* tree, const void* key);
 bool		tr_tree_remove(tr_tree* tree, const void* key);
+size_t		tr_tree_remove_many(tr_tree* tree, const void** keys,
+				    size_t count);
+size_t		tr_tree_remove_if(tr_tree* tree, dict_predicate_func pred,
+				  void* ctx);
 size_t		tr_tree_clear(tr_tree* tree);
 size_t		tr_tree_traverse(tr_tree* tree, dict_visit_func visit);
+size_t		tr_tree_export(tr_tree* tree, void** keys, void** data,
+			       size_t max, dict_export_pos* pos);
+size_t		tr_tree_export_all(tr_tree* tree, void** keys, void** data,
+				   unsigned threads);
 size_t		tr_tree_count(const tr_tree* tree);
 size_t		tr_tree_height(const tr_tree* tree);
 size_t		tr_tree_mheight(const tr_tree* tree);
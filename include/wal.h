@@ -0,0 +1,100 @@
+/*
+ * libdict -- write-ahead log interface.
+ *
+ * Copyright (c) 2001-2011, Farooq Mela
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *    This product includes software developed by Farooq Mela.
+ * 4. Neither the name Farooq Mela nor the names of contributors may be used to
+ *    endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY FAROOQ MELA ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL FAROOQ MELA BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _WAL_H_
+#define _WAL_H_
+
+#include "dict.h"
+
+BEGIN_DECL
+
+/* A write-ahead log makes any dictionary durable. Insertions and removals
+ * are passed on to the dictionary and appended as records to a buffer, which
+ * is written to the log file when full and synced to disk on commit. Opening
+ * a log replays its records into the (empty) dictionary; a record torn by a
+ * crash ends the replay and is cut off. A checkpoint writes the contents of
+ * the dictionary to a new log, which replaces the old one.
+ *
+ * An insertion is logged with the datum stored through the pointer it
+ * returns, as of the next call on the log; datums changed in any other way,
+ * and changes made through iterators or directly on the dictionary, are not
+ * logged. A removal that cannot be logged or committed returns false, even
+ * though the key has been removed from the dictionary. */
+
+/* A pointer to a function that writes the serialized form of a key or datum
+ * into |buf|, which has room for |size| bytes, and returns its length. If the
+ * length exceeds |size|, it is called again with a large enough buffer. */
+typedef size_t	    (*wal_encode_func)(const void* obj, void* buf, size_t size);
+/* A pointer to a function that returns the key or datum serialized into the
+ * |size| bytes at |buf|. */
+typedef void*	    (*wal_decode_func)(const void* buf, size_t size);
+
+typedef struct {
+    wal_encode_func	key_encode;
+    wal_decode_func	key_decode;
+    wal_encode_func	datum_encode;
+    wal_decode_func	datum_decode;
+} wal_codec;
+
+typedef struct wal_log wal_log;
+
+/* Opens the log at |path| for |dct|, creating it if needed, and replays it.
+ * The log commits on its own after every |group| records, or only when asked
+ * to if |group| is 0. While replaying, keys decoded for removals, and keys
+ * decoded for insertions of keys already present along with the datums they
+ * replace, are passed to |del_func|. Freeing the log commits it, and frees
+ * the dictionary. */
+wal_log*	wal_log_new(dict* dct, const char* path, const wal_codec* codec,
+			    dict_delete_func del_func, size_t group);
+dict*		wal_dict_new(dict* dct, const char* path,
+			     const wal_codec* codec,
+			     dict_delete_func del_func, size_t group);
+size_t		wal_log_free(wal_log* log);
+wal_log*	wal_log_clone(wal_log* log,
+			      dict_key_datum_clone_func clone_func);
+
+void**		wal_log_insert(wal_log* log, void* key, bool* inserted);
+void*		wal_log_search(wal_log* log, const void* key);
+bool		wal_log_remove(wal_log* log, const void* key);
+size_t		wal_log_clear(wal_log* log);
+size_t		wal_log_traverse(wal_log* log, dict_visit_func visit);
+size_t		wal_log_count(const wal_log* log);
+bool		wal_log_verify(const wal_log* log);
+dict_itor*	wal_log_itor_new(wal_log* log);
+
+bool		wal_log_commit(wal_log* log);
+bool		wal_log_checkpoint(wal_log* log);
+size_t		wal_log_size(const wal_log* log);
+
+END_DECL
+
+#endif /* !_WAL_H_ */
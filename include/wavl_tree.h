@@ -0,0 +1,97 @@
+/*
+ * libdict -- weak AVL (rank-balanced) tree interface.
+ *
+ * Copyright (c) 2001-2011, Farooq Mela
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *    This product includes software developed by Farooq Mela.
+ * 4. Neither the name Farooq Mela nor the names of contributors may be used to
+ *    endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY FAROOQ MELA ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL FAROOQ MELA BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _WAVL_TREE_H_
+#define _WAVL_TREE_H_
+
+#include "dict.h"
+
+BEGIN_DECL
+
+typedef struct wavl_tree wavl_tree;
+
+wavl_tree*	wavl_tree_new(dict_compare_func cmp_func,
+			      dict_delete_func del_func);
+dict*		wavl_dict_new(dict_compare_func cmp_func,
+			      dict_delete_func del_func);
+/* A set of keys, whose nodes are a pointer smaller; see DICT_SET_MEMBER. */
+wavl_tree*	wavl_tree_new_set(dict_compare_func cmp_func,
+				  dict_delete_func del_func);
+dict*		wavl_dict_new_set(dict_compare_func cmp_func,
+				  dict_delete_func del_func);
+size_t		wavl_tree_free(wavl_tree* tree);
+wavl_tree*	wavl_tree_clone(wavl_tree* tree,
+				dict_key_datum_clone_func clone_func);
+
+void**		wavl_tree_insert(wavl_tree* tree, void* key, bool* inserted);
+void*		wavl_tree_search(wavl_tree* tree, const void* key);
+bool		wavl_tree_remove(wavl_tree* tree, const void* key);
+size_t		wavl_tree_remove_many(wavl_tree* tree, const void** keys,
+				      size_t count);
+size_t		wavl_tree_remove_if(wavl_tree* tree, dict_predicate_func pred,
+				    void* ctx);
+size_t		wavl_tree_clear(wavl_tree* tree);
+size_t		wavl_tree_traverse(wavl_tree* tree, dict_visit_func visit);
+size_t		wavl_tree_export(wavl_tree* tree, void** keys, void** data,
+				 size_t max, dict_export_pos* pos);
+size_t		wavl_tree_export_all(wavl_tree* tree, void** keys, void** data,
+				     unsigned threads);
+size_t		wavl_tree_count(const wavl_tree* tree);
+size_t		wavl_tree_height(const wavl_tree* tree);
+size_t		wavl_tree_mheight(const wavl_tree* tree);
+size_t		wavl_tree_pathlen(const wavl_tree* tree);
+const void*	wavl_tree_min(const wavl_tree* tree);
+const void*	wavl_tree_max(const wavl_tree* tree);
+bool		wavl_tree_verify(const wavl_tree* tree);
+
+typedef struct wavl_itor wavl_itor;
+
+wavl_itor*	wavl_itor_new(wavl_tree* tree);
+dict_itor*	wavl_dict_itor_new(wavl_tree* tree);
+void		wavl_itor_free(wavl_itor* tree);
+
+bool		wavl_itor_valid(const wavl_itor* itor);
+void		wavl_itor_invalidate(wavl_itor* itor);
+bool		wavl_itor_next(wavl_itor* itor);
+bool		wavl_itor_prev(wavl_itor* itor);
+bool		wavl_itor_nextn(wavl_itor* itor, size_t count);
+bool		wavl_itor_prevn(wavl_itor* itor, size_t count);
+bool		wavl_itor_first(wavl_itor* itor);
+bool		wavl_itor_last(wavl_itor* itor);
+bool		wavl_itor_search(wavl_itor* itor, const void* key);
+const void*	wavl_itor_key(const wavl_itor* itor);
+void**		wavl_itor_data(wavl_itor* itor);
+bool		wavl_itor_remove(wavl_itor* itor);
+
+END_DECL
+
+#endif /* !_WAVL_TREE_H_ */
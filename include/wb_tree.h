@@ -43,6 +43,11 @@ wb_tree*	wb_tree_new(dict_compare_func cmp_func,
 			    dict_delete_func del_func);
 dict*		wb_dict_new(dict_compare_func cmp_func,
 			    dict_delete_func del_func);
+/* A set of keys, whose nodes are a pointer smaller; see DICT_SET_MEMBER. */
+wb_tree*	wb_tree_new_set(dict_compare_func cmp_func,
+				dict_delete_func del_func);
+dict*		wb_dict_new_set(dict_compare_func cmp_func,
+				dict_delete_func del_func);
 size_t		wb_tree_free(wb_tree* tree);
 wb_tree*	wb_tree_clone(wb_tree* tree,
 			      dict_key_datum_clone_func clone_func);
@@ -50,8 +55,16 @@ wb_tree*	wb_tree_clone(wb_tree* tree,
 void**		wb_tree_insert(wb_tree* tree, void* key, bool* inserted);
 void*		wb_tree_search(wb_tree* tree, const void* key);
 bool		wb_tree_remove(wb_tree* tree, const void* key);
+size_t		wb_tree_remove_many(wb_tree* tree, const void** keys,
+				    size_t count);
+size_t		wb_tree_remove_if(wb_tree* tree, dict_predicate_func pred,
+				  void* ctx);
 size_t		wb_tree_clear(wb_tree* tree);
 size_t		wb_tree_traverse(wb_tree* tree, dict_visit_func visit);
+size_t		wb_tree_export(wb_tree* tree, void** keys, void** data,
+			       size_t max, dict_export_pos* pos);
+size_t		wb_tree_export_all(wb_tree* tree, void** keys, void** data,
+				   unsigned threads);
 size_t		wb_tree_count(const wb_tree* tree);
 size_t		wb_tree_height(const wb_tree* tree);
 size_t		wb_tree_mheight(const wb_tree* tree);
@@ -59,6 +72,12 @@ size_t		wb_tree_pathlen(const wb_tree* tree);
 const void*	wb_tree_min(const wb_tree* tree);
 const void*	wb_tree_max(const wb_tree* tree);
 bool		wb_tree_verify(const wb_tree* tree);
+bool		wb_tree_set_aggregate(wb_tree* tree,
+				      dict_aggregate_func agg_func,
+				      size_t agg_size);
+bool		wb_tree_update_aggregate(wb_tree* tree, const void* key);
+bool		wb_tree_range_aggregate(wb_tree* tree, const void* lo,
+					const void* hi, void* result);
 
 typedef struct wb_itor wb_itor;
 
@@ -0,0 +1,391 @@
+/* replay.c
+ * Replays an operation trace against each container type
+ * Copyright (C) 2001-2011 Farooq Mela */
+
+#define _POSIX_C_SOURCE 200809L	/* For clock_gettime(). */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+
+#include "dict.h"
+
+const char appname[] = "replay";
+
+#ifdef __GNUC__
+# define NORETURN	__attribute__((__noreturn__))
+#else
+# define NORETURN
+#endif
+
+void quit(const char *, ...) NORETURN;
+
+/* A serialized key from the trace, stored once however often it occurs. */
+typedef struct {
+    size_t	    size;
+    unsigned char   bytes[];
+} blob;
+
+typedef struct {
+    dict_op	    op;
+    int		    result;
+    void	    *key;
+    uint64_t	    nsec;
+} op;
+
+typedef struct {
+    const char	    *name;
+    dict	    *(*create)(dict_compare_func cmp_func,
+			       dict_hash_func hash_func, size_t keys);
+} container;
+
+static dict *hb_create(dict_compare_func, dict_hash_func, size_t);
+static dict *pr_create(dict_compare_func, dict_hash_func, size_t);
+static dict *rb_create(dict_compare_func, dict_hash_func, size_t);
+static dict *sg_create(dict_compare_func, dict_hash_func, size_t);
+static dict *sp_create(dict_compare_func, dict_hash_func, size_t);
+static dict *tr_create(dict_compare_func, dict_hash_func, size_t);
+static dict *wavl_create(dict_compare_func, dict_hash_func, size_t);
+static dict *wb_create(dict_compare_func, dict_hash_func, size_t);
+static dict *skiplist_create(dict_compare_func, dict_hash_func, size_t);
+static dict *hashtable_create(dict_compare_func, dict_hash_func, size_t);
+
+static const container containers[] = {
+    { "hb",	    hb_create },
+    { "pr",	    pr_create },
+    { "rb",	    rb_create },
+    { "sg",	    sg_create },
+    { "sp",	    sp_create },
+    { "tr",	    tr_create },
+    { "wavl",	    wavl_create },
+    { "wb",	    wb_create },
+    { "skiplist",   skiplist_create },
+    { "hashtable",  hashtable_create },
+};
+#define NCONTAINERS (sizeof(containers) / sizeof(containers[0]))
+
+static op *load(const char *path, size_t *nops, size_t *nkeys, bool *blobs,
+		hashtable **interned);
+static void replay(const container *c, const op *ops, size_t nops,
+		   size_t nkeys, bool blobs, bool paced);
+static uint64_t now(void);
+static int blob_cmp(const void *k1, const void *k2);
+static void blob_free(void *key, void *datum);
+static unsigned blob_hash(const void *k);
+static unsigned id_hash(const void *k);
+
+int
+main(int argc, char **argv)
+{
+    bool paced = false;
+    int arg = 1;
+    if (arg < argc && strcmp(argv[arg], "-p") == 0) {
+	paced = true;
+	arg++;
+    }
+    if (arg >= argc) {
+	fprintf(stderr, "usage: %s [-p] [trace] [container...]\n", appname);
+	fprintf(stderr, "trace: a file written by op_trace_new()\n");
+	fprintf(stderr, "-p: issue each operation no sooner than it was"
+		" recorded, instead of back to back\n");
+	fprintf(stderr, "container: one or more of");
+	for (size_t i = 0; i < NCONTAINERS; i++)
+	    fprintf(stderr, " %s", containers[i].name);
+	fprintf(stderr, " (default: all)\n");
+	exit(EXIT_FAILURE);
+    }
+
+    size_t nops, nkeys;
+    bool blobs;
+    hashtable *interned;
+    op *ops = load(argv[arg++], &nops, &nkeys, &blobs, &interned);
+    printf("%zu operations on %zu keys (%s)\n", nops, nkeys,
+	   blobs ? "serialized" : "IDs");
+
+    /* The least time between two clock readings is included in every
+     * latency below. */
+    uint64_t overhead = UINT64_MAX;
+    for (int i = 0; i < 1000; i++) {
+	uint64_t start = now(), end = now();
+	if (end - start < overhead)
+	    overhead = end - start;
+    }
+    printf("timer overhead %" PRIu64 " ns (included)\n", overhead);
+    printf("%-10s %10s %8s %8s %8s %8s %10s %10s\n", "container", "total ms",
+	   "mean", "p50", "p99", "p99.9", "max", "mismatch");
+
+    if (arg == argc) {
+	for (size_t i = 0; i < NCONTAINERS; i++)
+	    replay(&containers[i], ops, nops, nkeys, blobs, paced);
+    }
+    for (; arg < argc; arg++) {
+	size_t i = 0;
+	while (i < NCONTAINERS && strcmp(argv[arg], containers[i].name) != 0)
+	    i++;
+	if (i == NCONTAINERS)
+	    quit("unknown container '%s'", argv[arg]);
+	replay(&containers[i], ops, nops, nkeys, blobs, paced);
+    }
+
+    hashtable_free(interned);
+    free(ops);
+    return EXIT_SUCCESS;
+}
+
+/* Reads the trace at PATH into an array of operations, with each distinct
+ * serialized key interned as a blob in INTERNED. */
+static op *
+load(const char *path, size_t *nops, size_t *nkeys, bool *blobs,
+     hashtable **interned)
+{
+    op_trace_reader *reader = op_trace_reader_open(path);
+    if (!reader)
+	quit("cannot read trace '%s'", path);
+    *blobs = op_trace_reader_keys(reader);
+
+    size_t cap = 1024;
+    op *ops = malloc(cap * sizeof(*ops));
+    hashtable *ids = hashtable_new(dict_ptr_cmp, id_hash, NULL, 65521);
+    *interned = hashtable_new(blob_cmp, blob_hash, blob_free, 65521);
+    if (!ops || !ids || !*interned)
+	quit("out of memory");
+
+    op_trace_record record;
+    size_t n = 0;
+    while (op_trace_reader_next(reader, &record)) {
+	if (n == cap && !(ops = realloc(ops, (cap *= 2) * sizeof(*ops))))
+	    quit("out of memory");
+	ops[n].op = record.op;
+	ops[n].result = record.result;
+	ops[n].nsec = record.nsec;
+	ops[n].key = NULL;
+	if (record.op == DICT_OP_CLEAR) {
+	    /* No key. */
+	} else if (*blobs) {
+	    blob *key = malloc(sizeof(*key) + record.key_size);
+	    if (!key)
+		quit("out of memory");
+	    key->size = record.key_size;
+	    memcpy(key->bytes, record.key, record.key_size);
+	    bool inserted = false;
+	    void **datum = hashtable_insert(*interned, key, &inserted);
+	    if (!datum)
+		quit("out of memory");
+	    if (inserted)
+		*datum = key;
+	    else
+		free(key);
+	    ops[n].key = *datum;
+	} else {
+	    ops[n].key = (void *)(uintptr_t)record.key_id;
+	    if (!hashtable_insert(ids, ops[n].key, NULL))
+		quit("out of memory");
+	}
+	n++;
+    }
+    op_trace_reader_close(reader);
+    *nops = n;
+    *nkeys = *blobs ? hashtable_count(*interned) : hashtable_count(ids);
+    hashtable_free(ids);
+    return ops;
+}
+
+static int
+latency_cmp(const void *a, const void *b)
+{
+    const uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/* Replays the NOPS operations against a new container of type C, timing each
+ * one, and prints the distribution of latencies. With PACED, each operation
+ * is held back until as long after the first as it was in the trace. */
+static void
+replay(const container *c, const op *ops, size_t nops, size_t nkeys,
+       bool blobs, bool paced)
+{
+    dict *dct = c->create(blobs ? blob_cmp : dict_ptr_cmp,
+			  blobs ? blob_hash : id_hash, nkeys);
+    uint64_t *latency = malloc((nops ? nops : 1) * sizeof(*latency));
+    if (!dct || !latency)
+	quit("out of memory");
+
+    size_t mismatches = 0;
+    const uint64_t origin = now(), first = nops ? ops[0].nsec : 0;
+    uint64_t total = 0;
+    for (size_t i = 0; i < nops; i++) {
+	const op *o = &ops[i];
+	if (paced)
+	    while (now() - origin < o->nsec - first)
+		/* void */;
+	int result;
+	const uint64_t start = now();
+	switch (o->op) {
+	case DICT_OP_INSERT: {
+	    bool inserted = false;
+	    void **datum = dict_insert(dct, o->key, &inserted);
+	    if (datum)
+		*datum = o->key;
+	    result = datum ? inserted : -1;
+	    break;
+	}
+	case DICT_OP_SEARCH:
+	    result = dict_search(dct, o->key) != NULL;
+	    break;
+	case DICT_OP_REMOVE:
+	    result = dict_remove(dct, o->key);
+	    break;
+	default:
+	    dict_clear(dct);
+	    result = 1;
+	    break;
+	}
+	latency[i] = now() - start;
+	total += latency[i];
+	mismatches += result != o->result;
+    }
+    dict_free(dct);
+
+    qsort(latency, nops, sizeof(*latency), latency_cmp);
+#define PERCENTILE(p) (nops ? latency[(size_t)((nops - 1) * (p))] : 0)
+    printf("%-10s %10.1f %8.1f %8" PRIu64 " %8" PRIu64 " %8" PRIu64
+	   " %10" PRIu64 " %10zu\n", c->name, total / 1e6,
+	   nops ? (double)total / nops : 0.0, PERCENTILE(0.5),
+	   PERCENTILE(0.99), PERCENTILE(0.999), PERCENTILE(1.0), mismatches);
+#undef PERCENTILE
+    free(latency);
+}
+
+static dict *
+hb_create(dict_compare_func cmp_func, dict_hash_func hash_func, size_t keys)
+{
+    (void)hash_func, (void)keys;
+    return hb_dict_new(cmp_func, NULL);
+}
+
+static dict *
+pr_create(dict_compare_func cmp_func, dict_hash_func hash_func, size_t keys)
+{
+    (void)hash_func, (void)keys;
+    return pr_dict_new(cmp_func, NULL);
+}
+
+static dict *
+rb_create(dict_compare_func cmp_func, dict_hash_func hash_func, size_t keys)
+{
+    (void)hash_func, (void)keys;
+    return rb_dict_new(cmp_func, NULL);
+}
+
+static dict *
+sg_create(dict_compare_func cmp_func, dict_hash_func hash_func, size_t keys)
+{
+    (void)hash_func, (void)keys;
+    return sg_dict_new(cmp_func, NULL);
+}
+
+static dict *
+sp_create(dict_compare_func cmp_func, dict_hash_func hash_func, size_t keys)
+{
+    (void)hash_func, (void)keys;
+    return sp_dict_new(cmp_func, NULL);
+}
+
+static dict *
+tr_create(dict_compare_func cmp_func, dict_hash_func hash_func, size_t keys)
+{
+    (void)hash_func, (void)keys;
+    return tr_dict_new(cmp_func, NULL, NULL);
+}
+
+static dict *
+wavl_create(dict_compare_func cmp_func, dict_hash_func hash_func, size_t keys)
+{
+    (void)hash_func, (void)keys;
+    return wavl_dict_new(cmp_func, NULL);
+}
+
+static dict *
+wb_create(dict_compare_func cmp_func, dict_hash_func hash_func, size_t keys)
+{
+    (void)hash_func, (void)keys;
+    return wb_dict_new(cmp_func, NULL);
+}
+
+static dict *
+skiplist_create(dict_compare_func cmp_func, dict_hash_func hash_func,
+		size_t keys)
+{
+    (void)hash_func, (void)keys;
+    return skiplist_dict_new(cmp_func, NULL, 12);
+}
+
+/* Sized for every key in the trace at once. */
+static dict *
+hashtable_create(dict_compare_func cmp_func, dict_hash_func hash_func,
+		 size_t keys)
+{
+    return hashtable_dict_new(cmp_func, hash_func, NULL,
+			      keys ? (unsigned)keys : 1);
+}
+
+static int
+blob_cmp(const void *k1, const void *k2)
+{
+    const blob *a = k1, *b = k2;
+    const int cmp = memcmp(a->bytes, b->bytes,
+			   a->size < b->size ? a->size : b->size);
+    return cmp ? cmp : (a->size > b->size) - (a->size < b->size);
+}
+
+static void
+blob_free(void *key, void *datum)
+{
+    (void)datum;
+    free(key);
+}
+
+static unsigned
+blob_hash(const void *k)
+{
+    /* FNV 1-a, as dict_str_hash(). */
+    const blob *b = k;
+    unsigned hash = 2166136261U;
+    for (size_t i = 0; i < b->size; i++)
+	hash = (hash ^ b->bytes[i]) * 16777619U;
+    return hash;
+}
+
+static unsigned
+id_hash(const void *k)
+{
+    const uint64_t id = (uint64_t)(uintptr_t)k * 0x9E3779B97F4A7C15ULL;
+    return (unsigned)(id >> 32);
+}
+
+static uint64_t
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+void
+quit(const char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    fprintf(stderr, "%s: ", appname);
+    vfprintf(stderr, fmt, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+
+    exit(EXIT_FAILURE);
+}
@@ -0,0 +1,652 @@
+/*
+ * libdict -- adaptive map implementation.
+ *
+ * Copyright (c) 2001-2011, Farooq Mela
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *    This product includes software developed by Farooq Mela.
+ * 4. Neither the name of the Farooq Mela nor the
+ *    names of contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY FAROOQ MELA ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL FAROOQ MELA BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * The backend is always created without a delete function, so that moving
+ * its entries to another backend and freeing it leaves them intact; the map
+ * deletes keys and data itself, finding the stored key of an entry to be
+ * removed through an iterator of the backend.
+ *
+ * Every operation counts towards an epoch of at least EPOCH_MIN operations,
+ * and at least as many as there are entries, so that the O(n) cost of a
+ * migration is amortized over the operations that justified it. One access in
+ * SAMPLE_MASK + 1 has the hash of its key compared against those of the last
+ * RECENT_KEYS sampled accesses; the fraction of repeats, less what a uniform
+ * workload would produce, estimates the skew that a splay tree benefits
+ * from. At the end of an epoch, the cost of its operations is estimated for
+ * each backend, in units of key comparisons, and the map switches to the
+ * cheapest one only after it has been at least a quarter cheaper than the
+ * current one for SWITCH_EPOCHS epochs running.
+ */
+
+#include "adaptive.h"
+
+#include "dict_private.h"
+
+#define EPOCH_MIN	    1024
+#define SAMPLE_MASK	    15
+#define RECENT_KEYS	    8
+#define SWITCH_EPOCHS	    2
+#define QUIET_EPOCHS	    4	    /* Epochs without ordered operations
+				     * before a hashtable is considered. */
+#define HASH_MIN_SIZE	    31
+
+struct adaptive {
+    dict_compare_func	    cmp_func;
+    dict_hash_func	    hash_func;
+    dict_delete_func	    del_func;
+    adaptive_kind	    kind;
+    dict*		    backend;
+    dict_itor*		    finder;	/* Finds stored keys for deletion. */
+    size_t		    iterators;	/* Iterators in existence. */
+    size_t		    migrations;
+    size_t		    mod_base;	/* Added to the backend's count. */
+    /* Workload of the current epoch. */
+    size_t		    ops;
+    size_t		    searches;
+    size_t		    updates;	/* Insertions and removals. */
+    size_t		    ordered;	/* Iterators created and traversals. */
+    size_t		    samples;
+    size_t		    repeats;
+    unsigned		    recent[RECENT_KEYS];
+    unsigned		    quiet_epochs;
+    adaptive_kind	    candidate;
+    unsigned		    candidate_epochs;
+};
+
+struct adaptive_itor {
+    adaptive*		    map;
+    dict_itor*		    backend;
+};
+
+static size_t adaptive_mod_count(const adaptive* map);
+
+static dict_vtable adaptive_vtable = {
+    (dict_inew_func)	    adaptive_dict_itor_new,
+    (dict_dfree_func)	    adaptive_free,
+    (dict_insert_func)	    adaptive_insert,
+    (dict_search_func)	    adaptive_search,
+    (dict_remove_func)	    adaptive_remove,
+    (dict_clear_func)	    adaptive_clear,
+    (dict_traverse_func)    adaptive_traverse,
+    (dict_count_func)	    adaptive_count,
+    (dict_verify_func)	    adaptive_verify,
+    (dict_clone_func)	    adaptive_clone,
+    (dict_remove_many_func) NULL,/* adaptive_remove_many not implemented yet */
+    (dict_remove_if_func)   NULL,/* adaptive_remove_if not implemented yet */
+    (dict_mod_count_func)   adaptive_mod_count,
+    (dict_export_func)	    NULL,/* adaptive_export not implemented yet */
+    (dict_export_all_func)  NULL,/* adaptive_export_all not implemented yet */
+};
+
+static itor_vtable adaptive_itor_vtable = {
+    (dict_ifree_func)	    adaptive_itor_free,
+    (dict_valid_func)	    adaptive_itor_valid,
+    (dict_invalidate_func)  adaptive_itor_invalidate,
+    (dict_next_func)	    adaptive_itor_next,
+    (dict_prev_func)	    adaptive_itor_prev,
+    (dict_nextn_func)	    adaptive_itor_nextn,
+    (dict_prevn_func)	    adaptive_itor_prevn,
+    (dict_first_func)	    adaptive_itor_first,
+    (dict_last_func)	    adaptive_itor_last,
+    (dict_key_func)	    adaptive_itor_key,
+    (dict_data_func)	    adaptive_itor_data,
+    (dict_iremove_func)	    NULL,/* adaptive_itor_remove not implemented */
+    (dict_icompare_func)    NULL,/* adaptive_itor_compare not implemented */
+    (dict_iseek_func)	    adaptive_itor_seek
+};
+
+static dict*
+backend_new(const adaptive* map, adaptive_kind kind, size_t count)
+{
+    switch (kind) {
+    case ADAPTIVE_SP_TREE:
+	return sp_dict_new(map->cmp_func, NULL);
+    case ADAPTIVE_RB_TREE:
+	return rb_dict_new(map->cmp_func, NULL);
+    case ADAPTIVE_HASHTABLE:
+	return hashtable_dict_new(map->cmp_func, map->hash_func, NULL,
+				  (unsigned)MAX(count * 2 + 1, HASH_MIN_SIZE));
+    }
+    return NULL;
+}
+
+adaptive*
+adaptive_new(dict_compare_func cmp_func, dict_hash_func hash_func,
+	     dict_delete_func del_func)
+{
+    ASSERT(hash_func != NULL);
+
+    adaptive* map = MALLOC(sizeof(*map));
+    if (map) {
+	map->cmp_func = cmp_func ? cmp_func : dict_ptr_cmp;
+	map->hash_func = hash_func;
+	map->del_func = del_func;
+	map->kind = ADAPTIVE_RB_TREE;
+	if (!(map->backend = backend_new(map, map->kind, 0))) {
+	    FREE(map);
+	    return NULL;
+	}
+	map->finder = NULL;
+	map->iterators = 0;
+	map->migrations = 0;
+	map->mod_base = 0;
+	map->ops = map->searches = map->updates = map->ordered = 0;
+	map->samples = map->repeats = 0;
+	for (unsigned i = 0; i < RECENT_KEYS; i++)
+	    map->recent[i] = 0;
+	map->quiet_epochs = 0;
+	map->candidate = map->kind;
+	map->candidate_epochs = 0;
+    }
+    return map;
+}
+
+dict*
+adaptive_dict_new(dict_compare_func cmp_func, dict_hash_func hash_func,
+		  dict_delete_func del_func)
+{
+    dict* dct = MALLOC(sizeof(*dct));
+    if (dct) {
+	if (!(dct->_object = adaptive_new(cmp_func, hash_func, del_func))) {
+	    FREE(dct);
+	    return NULL;
+	}
+	dct->_vtable = &adaptive_vtable;
+    }
+    return dct;
+}
+
+size_t
+adaptive_free(adaptive* map)
+{
+    ASSERT(map != NULL);
+
+    size_t count = adaptive_clear(map);
+    if (map->finder)
+	dict_itor_free(map->finder);
+    dict_free(map->backend);
+    FREE(map);
+    return count;
+}
+
+adaptive*
+adaptive_clone(adaptive* map, dict_key_datum_clone_func clone_func)
+{
+    ASSERT(map != NULL);
+
+    adaptive* clone = adaptive_new(map->cmp_func, map->hash_func,
+				   map->del_func);
+    if (clone) {
+	dict* backend = dict_clone(map->backend, clone_func);
+	if (!backend) {
+	    adaptive_free(clone);
+	    return NULL;
+	}
+	dict_free(clone->backend);
+	clone->backend = backend;
+	clone->kind = clone->candidate = map->kind;
+    }
+    return clone;
+}
+
+/* Moves every entry to a new backend of |kind|; on failure, nothing changes. */
+static bool
+migrate(adaptive* map, adaptive_kind kind)
+{
+    dict* backend = backend_new(map, kind, dict_count(map->backend));
+    if (!backend)
+	return false;
+    dict_itor* itor = dict_itor_new(map->backend);
+    if (!itor) {
+	dict_free(backend);
+	return false;
+    }
+    for (dict_itor_first(itor); dict_itor_valid(itor); dict_itor_next(itor)) {
+	void** datum_location = dict_insert(backend, (void*)dict_itor_key(itor),
+					    NULL);
+	if (!datum_location) {
+	    dict_itor_free(itor);
+	    dict_free(backend);
+	    return false;
+	}
+	*datum_location = *dict_itor_data(itor);
+    }
+    dict_itor_free(itor);
+
+    if (map->finder) {
+	dict_itor_free(map->finder);
+	map->finder = NULL;
+    }
+    /* The count of the new backend starts over, so the base makes up the
+     * difference, plus one for the migration itself. */
+    const size_t mod_count = adaptive_mod_count(map);
+    dict_free(map->backend);
+    map->backend = backend;
+    map->kind = kind;
+    map->migrations++;
+    map->mod_base = mod_count + 1 - dict_mod_count(backend);
+    return true;
+}
+
+static unsigned
+log2_ceil(size_t n)
+{
+    unsigned bits = 0;
+    while (n) {
+	n >>= 1;
+	bits++;
+    }
+    return bits;
+}
+
+/* Estimated cost, in key comparisons, of the epoch's operations on |kind|. */
+static double
+epoch_cost(const adaptive* map, adaptive_kind kind, double skew)
+{
+    const double depth = log2_ceil(dict_count(map->backend) + 1);
+    const double searches = (double)map->searches;
+    const double updates = (double)map->updates;
+
+    switch (kind) {
+    case ADAPTIVE_SP_TREE:
+	/* Splaying does about twice the work of a search along the path, but
+	 * a recurring key is found near the root. */
+	return (searches + updates) * (skew * 2 + (1 - skew) * depth * 2);
+    case ADAPTIVE_RB_TREE:
+	return searches * depth + updates * (depth + 2);
+    case ADAPTIVE_HASHTABLE:
+	return (searches + updates) * 3;
+    }
+    return 0;
+}
+
+static void
+epoch_end(adaptive* map)
+{
+    const size_t count = dict_count(map->backend);
+    double skew = 0;
+    if (map->samples) {
+	skew = (double)map->repeats / (double)map->samples;
+	if (count)
+	    skew -= (double)RECENT_KEYS / (double)count;
+	skew = MAX(skew, 0.0);
+    }
+    if (map->ordered)
+	map->quiet_epochs = 0;
+    else if (map->quiet_epochs < QUIET_EPOCHS)
+	map->quiet_epochs++;
+
+    adaptive_kind best = map->kind;
+    double best_cost = epoch_cost(map, map->kind, skew);
+    const double current_cost = best_cost;
+    for (unsigned k = ADAPTIVE_SP_TREE; k <= ADAPTIVE_HASHTABLE; k++) {
+	if (k == ADAPTIVE_HASHTABLE && map->quiet_epochs < QUIET_EPOCHS)
+	    continue;
+	const double cost = epoch_cost(map, (adaptive_kind)k, skew);
+	if (cost < best_cost) {
+	    best = (adaptive_kind)k;
+	    best_cost = cost;
+	}
+    }
+    if (best != map->kind && best_cost < current_cost * 0.75) {
+	if (best == map->candidate) {
+	    map->candidate_epochs++;
+	} else {
+	    map->candidate = best;
+	    map->candidate_epochs = 1;
+	}
+	if (map->candidate_epochs >= SWITCH_EPOCHS && map->iterators == 0 &&
+	    migrate(map, best))
+	    map->candidate_epochs = 0;
+    } else {
+	map->candidate = map->kind;
+	map->candidate_epochs = 0;
+    }
+
+    if (map->kind == ADAPTIVE_HASHTABLE && map->iterators == 0) {
+	hashtable* table = dict_private(map->backend);
+	if (count > hashtable_size(table) * 2)
+	    hashtable_resize(table, (unsigned)(count * 2 + 1));
+    }
+
+    map->ops = map->searches = map->updates = map->ordered = 0;
+    map->samples = map->repeats = 0;
+}
+
+/* Accounts for an access to |key|, ending the epoch first if it is over. */
+static void
+note_access(adaptive* map, const void* key)
+{
+    if (map->ops >= EPOCH_MIN && map->ops >= dict_count(map->backend))
+	epoch_end(map);
+    if ((++map->ops & SAMPLE_MASK) == 0) {
+	const unsigned hash = map->hash_func(key);
+	for (unsigned i = 0; i < RECENT_KEYS; i++) {
+	    if (map->recent[i] == hash) {
+		map->repeats++;
+		break;
+	    }
+	}
+	map->recent[map->samples++ % RECENT_KEYS] = hash;
+    }
+}
+
+/* Accounts for an ordered operation, which a hashtable cannot serve. */
+static void
+ordered_access(adaptive* map)
+{
+    map->ops++;
+    map->ordered++;
+    map->quiet_epochs = 0;
+    if (map->kind == ADAPTIVE_HASHTABLE && map->iterators == 0)
+	migrate(map, ADAPTIVE_RB_TREE);
+}
+
+void**
+adaptive_insert(adaptive* map, void* key, bool* inserted)
+{
+    ASSERT(map != NULL);
+
+    note_access(map, key);
+    map->updates++;
+    bool added = false;
+    void** datum = dict_insert(map->backend, key, &added);
+    if (added)
+	map->mod_base++;
+    if (inserted)
+	*inserted = added;
+    return datum;
+}
+
+void*
+adaptive_search(adaptive* map, const void* key)
+{
+    ASSERT(map != NULL);
+
+    note_access(map, key);
+    map->searches++;
+    return dict_search(map->backend, key);
+}
+
+static bool
+finder_search(adaptive* map, const void* key)
+{
+    if (!map->finder && !(map->finder = dict_itor_new(map->backend)))
+	return false;
+    void* itor = dict_itor_private(map->finder);
+    switch (map->kind) {
+    case ADAPTIVE_SP_TREE:
+	return sp_itor_search(itor, key);
+    case ADAPTIVE_RB_TREE:
+	return rb_itor_search(itor, key);
+    case ADAPTIVE_HASHTABLE:
+	return hashtable_itor_search(itor, key);
+    }
+    return false;
+}
+
+bool
+adaptive_remove(adaptive* map, const void* key)
+{
+    ASSERT(map != NULL);
+
+    note_access(map, key);
+    map->updates++;
+    if (!map->del_func) {
+	if (!dict_remove(map->backend, key))
+	    return false;
+	map->mod_base++;
+	return true;
+    }
+    if (!finder_search(map, key))
+	return false;
+    void* stored_key = (void*)dict_itor_key(map->finder);
+    void* datum = *dict_itor_data(map->finder);
+    dict_itor_invalidate(map->finder);
+    if (!dict_remove(map->backend, stored_key))
+	return false;
+    map->mod_base++;
+    map->del_func(stored_key, datum);
+    return true;
+}
+
+size_t
+adaptive_clear(adaptive* map)
+{
+    ASSERT(map != NULL);
+
+    if (map->del_func) {
+	dict_itor* itor = dict_itor_new(map->backend);
+	if (itor) {
+	    for (dict_itor_first(itor); dict_itor_valid(itor);
+		 dict_itor_next(itor))
+		map->del_func((void*)dict_itor_key(itor), *dict_itor_data(itor));
+	    dict_itor_free(itor);
+	}
+    }
+    map->mod_base++;
+    return dict_clear(map->backend);
+}
+
+size_t
+adaptive_traverse(adaptive* map, dict_visit_func visit)
+{
+    ASSERT(map != NULL);
+    ASSERT(visit != NULL);
+
+    ordered_access(map);
+    return dict_traverse(map->backend, visit);
+}
+
+size_t
+adaptive_count(const adaptive* map)
+{
+    ASSERT(map != NULL);
+
+    return dict_count(map->backend);
+}
+
+/* A hashtable backend does not count its changes, so those made through the
+ * map are counted in the base. */
+static size_t
+adaptive_mod_count(const adaptive* map)
+{
+    ASSERT(map != NULL);
+
+    return map->mod_base + dict_mod_count(map->backend);
+}
+
+adaptive_kind
+adaptive_backend(const adaptive* map)
+{
+    ASSERT(map != NULL);
+
+    return map->kind;
+}
+
+size_t
+adaptive_migrations(const adaptive* map)
+{
+    ASSERT(map != NULL);
+
+    return map->migrations;
+}
+
+bool
+adaptive_verify(const adaptive* map)
+{
+    ASSERT(map != NULL);
+
+    VERIFY(map->backend != NULL);
+    VERIFY(map->kind != ADAPTIVE_HASHTABLE || map->hash_func != NULL);
+    return dict_verify(map->backend);
+}
+
+adaptive_itor*
+adaptive_itor_new(adaptive* map)
+{
+    ASSERT(map != NULL);
+
+    ordered_access(map);
+    adaptive_itor* itor = MALLOC(sizeof(*itor));
+    if (itor) {
+	if (!(itor->backend = dict_itor_new(map->backend))) {
+	    FREE(itor);
+	    return NULL;
+	}
+	itor->map = map;
+	map->iterators++;
+    }
+    return itor;
+}
+
+dict_itor*
+adaptive_dict_itor_new(adaptive* map)
+{
+    ASSERT(map != NULL);
+
+    dict_itor* itor = MALLOC(sizeof(*itor));
+    if (itor) {
+	if (!(itor->_itor = adaptive_itor_new(map))) {
+	    FREE(itor);
+	    return NULL;
+	}
+	itor->_vtable = &adaptive_itor_vtable;
+    }
+    return itor;
+}
+
+void
+adaptive_itor_free(adaptive_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    itor->map->iterators--;
+    dict_itor_free(itor->backend);
+    FREE(itor);
+}
+
+bool
+adaptive_itor_valid(const adaptive_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    return dict_itor_valid(itor->backend);
+}
+
+void
+adaptive_itor_invalidate(adaptive_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    dict_itor_invalidate(itor->backend);
+}
+
+bool
+adaptive_itor_next(adaptive_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    return dict_itor_next(itor->backend);
+}
+
+bool
+adaptive_itor_prev(adaptive_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    return dict_itor_prev(itor->backend);
+}
+
+bool
+adaptive_itor_nextn(adaptive_itor* itor, size_t count)
+{
+    ASSERT(itor != NULL);
+
+    return dict_itor_nextn(itor->backend, count);
+}
+
+bool
+adaptive_itor_prevn(adaptive_itor* itor, size_t count)
+{
+    ASSERT(itor != NULL);
+
+    return dict_itor_prevn(itor->backend, count);
+}
+
+bool
+adaptive_itor_first(adaptive_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    return dict_itor_first(itor->backend);
+}
+
+bool
+adaptive_itor_last(adaptive_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    return dict_itor_last(itor->backend);
+}
+
+const void*
+adaptive_itor_key(const adaptive_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    return dict_itor_key(itor->backend);
+}
+
+void**
+adaptive_itor_data(adaptive_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    return dict_itor_data(itor->backend);
+}
+
+bool
+adaptive_itor_seek(adaptive_itor* itor, const void* key)
+{
+    ASSERT(itor != NULL);
+
+    if (itor->backend->_vtable->seek)
+	return dict_itor_seek(itor->backend, key);
+    if (!dict_itor_valid(itor->backend))
+	return false;
+    while (itor->map->cmp_func(dict_itor_key(itor->backend), key) < 0)
+	if (!dict_itor_next(itor->backend))
+	    return false;
+    return true;
+}
@@ -0,0 +1,1425 @@
+/*
+ * libdict -- disk-backed B+ tree implementation.
+ * cf. [Bayer and McCreight 1972], [Comer 1979]
+ *
+ * Copyright (c) 2001-2011, Farooq Mela
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *    This product includes software developed by Farooq Mela.
+ * 4. Neither the name of the Farooq Mela nor the
+ *    names of contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY FAROOQ MELA ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL FAROOQ MELA BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * The file is an array of fixed-size pages. Page 0 holds the header; every
+ * other page is a leaf, an internal node, or on the free list. Leaves hold
+ * sorted key-datum entries and are linked to their siblings for iteration;
+ * internal nodes hold n sorted keys and n+1 child page numbers, with keys in
+ * child i less than key i, and keys in child i+1 not less than it. Every node
+ * but the root is at least half full.
+ *
+ * Pages are read into and written from a pool of frames with pread() and
+ * pwrite(). The pool is an LRU list hashed by page number; an operation pins
+ * the few frames it works on, so that they cannot be evicted under it. A
+ * lookup touches one page per level, and so costs at most one read per level
+ * (plus a write, if the page it evicts is dirty).
+ */
+
+#define _POSIX_C_SOURCE 200809L	    /* For pread(), pwrite(), fdatasync(). */
+
+#include "db_tree.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "dict_private.h"
+
+#define DB_PAGE_SIZE	    4096
+#define DB_MAX_HEIGHT	    48
+#define DB_MIN_POOL	    8
+#define DB_MAGIC	    0x4274636964626c69ULL	/* "libdictB" */
+#define DB_VERSION	    1
+#define NO_PAGE		    0	    /* Page 0 is the header. */
+
+typedef struct {
+    uint64_t		    magic;
+    uint32_t		    version;
+    uint32_t		    page_size;
+    uint64_t		    key_size;
+    uint64_t		    root;
+    uint64_t		    height;
+    uint64_t		    count;
+    uint64_t		    npages;
+    uint64_t		    free_head;
+} db_header;
+
+typedef struct {
+    uint16_t		    leaf;
+    uint16_t		    unused;
+    uint32_t		    n;		/* Number of keys. */
+    uint64_t		    prev, next;	/* Sibling leaves. */
+} db_page;
+
+typedef struct db_frame db_frame;
+
+struct db_frame {
+    uint64_t		    pgno;
+    unsigned		    pins;
+    bool		    dirty;
+    db_frame*		    lru_prev;
+    db_frame*		    lru_next;
+    db_frame*		    hash_next;
+    unsigned char*	    data;
+};
+
+struct db_tree {
+    int			    fd;
+    db_header		    hdr;
+    bool		    hdr_dirty;
+    size_t		    key_size;
+    size_t		    key_slot;	/* key_size, rounded up to 8. */
+    size_t		    stride;	/* key_slot plus a datum or child. */
+    unsigned		    leaf_max;
+    unsigned		    node_max;
+    dict_compare_func	    cmp_func;
+    dict_delete_func	    del_func;
+    db_frame*		    frames;
+    size_t		    nframes;
+    unsigned char*	    pool;
+    db_frame**		    buckets;
+    size_t		    bucket_mask;
+    db_frame*		    lru_head;	/* Most recently used. */
+    db_frame*		    lru_tail;
+    unsigned char*	    scratch;	/* Contents of two nodes. */
+    unsigned char*	    keybuf;
+    size_t		    reads;
+    size_t		    writes;
+    size_t		    mod_count;	/* Keys added or removed. */
+};
+
+struct db_itor {
+    db_tree*		    tree;
+    uint64_t		    pgno;
+    unsigned		    index;
+};
+
+typedef struct {
+    uint64_t		    pgno;
+    unsigned		    index;	/* Child taken. */
+} db_step;
+
+static size_t	    db_tree_mod_count(const db_tree* tree);
+
+static dict_vtable db_tree_vtable = {
+    (dict_inew_func)	    db_dict_itor_new,
+    (dict_dfree_func)	    db_tree_free,
+    (dict_insert_func)	    db_tree_insert,
+    (dict_search_func)	    db_tree_search,
+    (dict_remove_func)	    db_tree_remove,
+    (dict_clear_func)	    db_tree_clear,
+    (dict_traverse_func)    db_tree_traverse,
+    (dict_count_func)	    db_tree_count,
+    (dict_verify_func)	    db_tree_verify,
+    (dict_clone_func)	    db_tree_clone,
+    (dict_remove_many_func) NULL,/* db_tree_remove_many not implemented yet */
+    (dict_remove_if_func)   NULL,/* db_tree_remove_if not implemented yet */
+    (dict_mod_count_func)   db_tree_mod_count,
+    (dict_export_func)	    NULL,/* db_tree_export not implemented yet */
+    (dict_export_all_func)  NULL,/* db_tree_export_all not implemented yet */
+};
+
+static itor_vtable db_tree_itor_vtable = {
+    (dict_ifree_func)	    db_itor_free,
+    (dict_valid_func)	    db_itor_valid,
+    (dict_invalidate_func)  db_itor_invalidate,
+    (dict_next_func)	    db_itor_next,
+    (dict_prev_func)	    db_itor_prev,
+    (dict_nextn_func)	    db_itor_nextn,
+    (dict_prevn_func)	    db_itor_prevn,
+    (dict_first_func)	    db_itor_first,
+    (dict_last_func)	    db_itor_last,
+    (dict_key_func)	    db_itor_key,
+    (dict_data_func)	    db_itor_data,
+    (dict_iremove_func)	    NULL,/* db_itor_remove not implemented */
+    (dict_icompare_func)    NULL,/* db_itor_compare not implemented */
+    (dict_iseek_func)	    db_itor_seek
+};
+
+#define PAGE(f)		    ((db_page*)(f)->data)
+#define HDR_SIZE	    sizeof(db_page)
+
+/* Leaf entry i: the datum, then the key. */
+static inline unsigned char*
+leaf_entry(const db_tree* tree, unsigned char* data, size_t i)
+{
+    return data + HDR_SIZE + i * tree->stride;
+}
+#define ENTRY_DATUM(e)	    ((void**)(e))
+#define ENTRY_KEY(e)	    ((e) + sizeof(uint64_t))
+
+/* Internal node: child 0, then pairs of key i and child i+1. */
+static inline unsigned char*
+node_key(const db_tree* tree, unsigned char* data, size_t i)
+{
+    return data + HDR_SIZE + sizeof(uint64_t) + i * tree->stride;
+}
+
+static inline uint64_t*
+node_child(const db_tree* tree, unsigned char* data, size_t i)
+{
+    if (i == 0)
+	return (uint64_t*)(data + HDR_SIZE);
+    return (uint64_t*)(node_key(tree, data, i - 1) + tree->key_slot);
+}
+
+static bool
+page_io(db_tree* tree, uint64_t pgno, void* buf, size_t size, bool write)
+{
+    unsigned char* p = buf;
+    off_t offset = (off_t)(pgno * DB_PAGE_SIZE);
+    while (size) {
+	ssize_t n = write ? pwrite(tree->fd, p, size, offset)
+			  : pread(tree->fd, p, size, offset);
+	if (n < 0 && errno == EINTR)
+	    continue;
+	if (n <= 0)
+	    return false;
+	p += n;
+	offset += n;
+	size -= (size_t)n;
+    }
+    if (write)
+	tree->writes++;
+    else
+	tree->reads++;
+    return true;
+}
+
+static bool
+header_write(db_tree* tree)
+{
+    if (!page_io(tree, 0, &tree->hdr, sizeof(tree->hdr), true))
+	return false;
+    tree->hdr_dirty = false;
+    return true;
+}
+
+static inline size_t
+frame_bucket(const db_tree* tree, uint64_t pgno)
+{
+    return (size_t)((pgno * 0x9E3779B97F4A7C15ULL) >> 32) & tree->bucket_mask;
+}
+
+static db_frame*
+frame_lookup(const db_tree* tree, uint64_t pgno)
+{
+    db_frame* f = tree->buckets[frame_bucket(tree, pgno)];
+    while (f && f->pgno != pgno)
+	f = f->hash_next;
+    return f;
+}
+
+static void
+frame_unhash(db_tree* tree, db_frame* f)
+{
+    db_frame** p = &tree->buckets[frame_bucket(tree, f->pgno)];
+    while (*p != f)
+	p = &(*p)->hash_next;
+    *p = f->hash_next;
+    f->pgno = NO_PAGE;
+}
+
+static void
+frame_hash(db_tree* tree, db_frame* f, uint64_t pgno)
+{
+    db_frame** p = &tree->buckets[frame_bucket(tree, pgno)];
+    f->pgno = pgno;
+    f->hash_next = *p;
+    *p = f;
+}
+
+static void
+frame_touch(db_tree* tree, db_frame* f)
+{
+    if (tree->lru_head == f)
+	return;
+    /* Unlink; f is not the head, so it has a predecessor. */
+    f->lru_prev->lru_next = f->lru_next;
+    if (f->lru_next)
+	f->lru_next->lru_prev = f->lru_prev;
+    else
+	tree->lru_tail = f->lru_prev;
+    f->lru_prev = NULL;
+    f->lru_next = tree->lru_head;
+    tree->lru_head->lru_prev = f;
+    tree->lru_head = f;
+}
+
+static bool
+frame_flush(db_tree* tree, db_frame* f)
+{
+    if (f->dirty) {
+	if (!page_io(tree, f->pgno, f->data, DB_PAGE_SIZE, true))
+	    return false;
+	f->dirty = false;
+    }
+    return true;
+}
+
+/* Returns the frame holding page |pgno|, pinned. The page is read from the
+ * file unless |read| is false, in which case it is zeroed. */
+static db_frame*
+page_get(db_tree* tree, uint64_t pgno, bool read)
+{
+    ASSERT(pgno != NO_PAGE);
+
+    db_frame* f = frame_lookup(tree, pgno);
+    if (!f) {
+	f = tree->lru_tail;
+	while (f && f->pins)
+	    f = f->lru_prev;
+	if (!f || !frame_flush(tree, f))
+	    return NULL;
+	if (f->pgno != NO_PAGE)
+	    frame_unhash(tree, f);
+	if (read) {
+	    if (!page_io(tree, pgno, f->data, DB_PAGE_SIZE, false))
+		return NULL;
+	} else {
+	    memset(f->data, 0, DB_PAGE_SIZE);
+	}
+	frame_hash(tree, f, pgno);
+    }
+    frame_touch(tree, f);
+    f->pins++;
+    return f;
+}
+
+static inline void
+page_put(db_frame* f)
+{
+    ASSERT(f->pins > 0);
+    f->pins--;
+}
+
+static db_frame*
+page_alloc(db_tree* tree, bool leaf)
+{
+    db_frame* f;
+    if (tree->hdr.free_head != NO_PAGE) {
+	if (!(f = page_get(tree, tree->hdr.free_head, true)))
+	    return NULL;
+	memcpy(&tree->hdr.free_head, f->data, sizeof(uint64_t));
+	memset(f->data, 0, DB_PAGE_SIZE);
+    } else {
+	if (!(f = page_get(tree, tree->hdr.npages, false)))
+	    return NULL;
+	tree->hdr.npages++;
+    }
+    tree->hdr_dirty = true;
+    PAGE(f)->leaf = leaf;
+    f->dirty = true;
+    return f;
+}
+
+static void
+page_free(db_tree* tree, db_frame* f)
+{
+    memset(f->data, 0, DB_PAGE_SIZE);
+    memcpy(f->data, &tree->hdr.free_head, sizeof(uint64_t));
+    tree->hdr.free_head = f->pgno;
+    tree->hdr_dirty = true;
+    f->dirty = true;
+}
+
+db_tree*
+db_tree_new(const char* path, size_t key_size, dict_compare_func cmp_func,
+	    dict_delete_func del_func, size_t pool_pages)
+{
+    ASSERT(path != NULL);
+    ASSERT(key_size > 0);
+    ASSERT(cmp_func != NULL);
+
+    const size_t key_slot = (key_size + 7) & ~(size_t)7;
+    const size_t stride = key_slot + sizeof(uint64_t);
+    if ((DB_PAGE_SIZE - HDR_SIZE - sizeof(uint64_t)) / stride < 4)
+	return NULL;
+    if (pool_pages < DB_MIN_POOL)
+	pool_pages = DB_MIN_POOL;
+
+    db_tree* tree = MALLOC(sizeof(*tree));
+    if (!tree)
+	return NULL;
+    memset(tree, 0, sizeof(*tree));
+    tree->key_size = key_size;
+    tree->key_slot = key_slot;
+    tree->stride = stride;
+    tree->leaf_max = (unsigned)((DB_PAGE_SIZE - HDR_SIZE) / stride);
+    tree->node_max = (unsigned)((DB_PAGE_SIZE - HDR_SIZE - sizeof(uint64_t)) /
+				stride);
+    tree->cmp_func = cmp_func;
+    tree->del_func = del_func;
+    tree->nframes = pool_pages;
+    size_t nbuckets = 1;
+    while (nbuckets < pool_pages * 2)
+	nbuckets <<= 1;
+    tree->bucket_mask = nbuckets - 1;
+    tree->frames = MALLOC(pool_pages * sizeof(db_frame));
+    tree->pool = MALLOC(pool_pages * DB_PAGE_SIZE);
+    tree->buckets = MALLOC(nbuckets * sizeof(db_frame*));
+    tree->scratch = MALLOC(2 * DB_PAGE_SIZE + stride);
+    tree->keybuf = MALLOC(key_slot);
+    tree->fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (!tree->frames || !tree->pool || !tree->buckets || !tree->scratch ||
+	!tree->keybuf || tree->fd < 0)
+	goto fail;
+
+    memset(tree->buckets, 0, nbuckets * sizeof(db_frame*));
+    for (size_t i = 0; i < pool_pages; i++) {
+	db_frame* f = &tree->frames[i];
+	f->pgno = NO_PAGE;
+	f->pins = 0;
+	f->dirty = false;
+	f->lru_prev = i ? &tree->frames[i - 1] : NULL;
+	f->lru_next = i + 1 < pool_pages ? &tree->frames[i + 1] : NULL;
+	f->hash_next = NULL;
+	f->data = tree->pool + i * DB_PAGE_SIZE;
+    }
+    tree->lru_head = &tree->frames[0];
+    tree->lru_tail = &tree->frames[pool_pages - 1];
+
+    struct stat st;
+    if (fstat(tree->fd, &st) != 0)
+	goto fail;
+    if (st.st_size == 0) {
+	tree->hdr.magic = DB_MAGIC;
+	tree->hdr.version = DB_VERSION;
+	tree->hdr.page_size = DB_PAGE_SIZE;
+	tree->hdr.key_size = key_size;
+	tree->hdr.npages = 1;
+	memset(tree->scratch, 0, DB_PAGE_SIZE);
+	memcpy(tree->scratch, &tree->hdr, sizeof(tree->hdr));
+	if (!page_io(tree, 0, tree->scratch, DB_PAGE_SIZE, true))
+	    goto fail;
+    } else if (!page_io(tree, 0, &tree->hdr, sizeof(tree->hdr), false) ||
+	       tree->hdr.magic != DB_MAGIC ||
+	       tree->hdr.version != DB_VERSION ||
+	       tree->hdr.page_size != DB_PAGE_SIZE ||
+	       tree->hdr.key_size != key_size) {
+	goto fail;
+    }
+    return tree;
+
+fail:
+    if (tree->fd >= 0)
+	close(tree->fd);
+    FREE(tree->keybuf);
+    FREE(tree->scratch);
+    FREE(tree->buckets);
+    FREE(tree->pool);
+    FREE(tree->frames);
+    FREE(tree);
+    return NULL;
+}
+
+dict*
+db_dict_new(const char* path, size_t key_size, dict_compare_func cmp_func,
+	    dict_delete_func del_func, size_t pool_pages)
+{
+    dict* dct = MALLOC(sizeof(*dct));
+    if (dct) {
+	if (!(dct->_object = db_tree_new(path, key_size, cmp_func, del_func,
+					 pool_pages))) {
+	    FREE(dct);
+	    return NULL;
+	}
+	dct->_vtable = &db_tree_vtable;
+    }
+    return dct;
+}
+
+size_t
+db_tree_free(db_tree* tree)
+{
+    ASSERT(tree != NULL);
+
+    const size_t count = tree->hdr.count;
+    db_tree_sync(tree);
+    close(tree->fd);
+    FREE(tree->keybuf);
+    FREE(tree->scratch);
+    FREE(tree->buckets);
+    FREE(tree->pool);
+    FREE(tree->frames);
+    FREE(tree);
+    return count;
+}
+
+db_tree*
+db_tree_clone(db_tree* tree, dict_key_datum_clone_func clone_func)
+{
+    ASSERT(tree != NULL);
+
+    /* A clone would need a file of its own. */
+    (void)clone_func;
+    return NULL;
+}
+
+bool
+db_tree_sync(db_tree* tree)
+{
+    ASSERT(tree != NULL);
+
+    for (size_t i = 0; i < tree->nframes; i++)
+	if (!frame_flush(tree, &tree->frames[i]))
+	    return false;
+    if (tree->hdr_dirty && !header_write(tree))
+	return false;
+    return fdatasync(tree->fd) == 0;
+}
+
+/* Returns the index of the first key in leaf |data| not less than |key|. */
+static unsigned
+leaf_search(const db_tree* tree, unsigned char* data, const void* key,
+	    bool* found)
+{
+    unsigned lo = 0, hi = ((db_page*)data)->n;
+    int cmp = 1;
+    while (lo < hi) {
+	const unsigned mid = (lo + hi) >> 1;
+	cmp = tree->cmp_func(key, ENTRY_KEY(leaf_entry(tree, data, mid)));
+	if (cmp > 0) {
+	    lo = mid + 1;
+	} else {
+	    hi = mid;
+	    if (cmp == 0)
+		break;
+	}
+    }
+    *found = (cmp == 0);
+    return cmp == 0 ? hi : lo;
+}
+
+/* Returns the index of the child of node |data| that would hold |key|. */
+static unsigned
+node_search(const db_tree* tree, unsigned char* data, const void* key)
+{
+    unsigned lo = 0, hi = ((db_page*)data)->n;
+    while (lo < hi) {
+	const unsigned mid = (lo + hi) >> 1;
+	if (tree->cmp_func(key, node_key(tree, data, mid)) < 0)
+	    hi = mid;
+	else
+	    lo = mid + 1;
+    }
+    return lo;
+}
+
+/* Descends to the leaf that would hold |key|, which is returned pinned. The
+ * internal nodes passed and the children taken are recorded in |path|. */
+static db_frame*
+descend(db_tree* tree, const void* key, db_step* path)
+{
+    uint64_t pgno = tree->hdr.root;
+    for (unsigned depth = 0;; depth++) {
+	db_frame* f = page_get(tree, pgno, true);
+	if (!f || PAGE(f)->leaf)
+	    return f;
+	ASSERT(depth + 1 < tree->hdr.height);
+	const unsigned i = node_search(tree, f->data, key);
+	if (path) {
+	    path[depth].pgno = pgno;
+	    path[depth].index = i;
+	}
+	pgno = *node_child(tree, f->data, i);
+	page_put(f);
+    }
+}
+
+void*
+db_tree_search(db_tree* tree, const void* key)
+{
+    ASSERT(tree != NULL);
+
+    size_t depth = TRACE_DEPTH(search, tree->hdr.height);
+
+    if (tree->hdr.root == NO_PAGE) {
+	TRACE_OP(search, "db", tree, key, depth, 0);
+	return NULL;
+    }
+    db_frame* f = descend(tree, key, NULL);
+    if (!f) {
+	TRACE_OP(search, "db", tree, key, depth, 0);
+	return NULL;
+    }
+    bool found;
+    const unsigned i = leaf_search(tree, f->data, key, &found);
+    page_put(f);
+    TRACE_OP(search, "db", tree, key, depth, found);
+    return found ? *ENTRY_DATUM(leaf_entry(tree, f->data, i)) : NULL;
+}
+
+static inline void
+entry_init(const db_tree* tree, unsigned char* e, const void* key)
+{
+    memset(e, 0, tree->stride);
+    memcpy(ENTRY_KEY(e), key, tree->key_size);
+}
+
+static inline void
+pair_init(const db_tree* tree, unsigned char* p, const void* key,
+	  uint64_t child)
+{
+    memset(p, 0, tree->key_slot);
+    memcpy(p, key, tree->key_size);
+    memcpy(p + tree->key_slot, &child, sizeof(child));
+}
+
+/* Inserts |key| and |child| at pair |index| of the internal node at the
+ * bottom of |path|, splitting nodes on the way up as needed. */
+static bool
+node_insert(db_tree* tree, db_step* path, unsigned depth, const void* key,
+	    uint64_t child)
+{
+    const size_t stride = tree->stride;
+    while (depth > 0) {
+	const db_step* step = &path[--depth];
+	db_frame* f = page_get(tree, step->pgno, true);
+	if (!f)
+	    return false;
+	db_page* pg = PAGE(f);
+	const unsigned i = step->index;
+	if (pg->n < tree->node_max) {
+	    unsigned char* p = node_key(tree, f->data, i);
+	    memmove(p + stride, p, (pg->n - i) * stride);
+	    pair_init(tree, p, key, child);
+	    pg->n++;
+	    f->dirty = true;
+	    page_put(f);
+	    return true;
+	}
+
+	/* Lay the node out in scratch with the new pair, then split it. */
+	db_frame* right = page_alloc(tree, false);
+	if (!right) {
+	    page_put(f);
+	    return false;
+	}
+	unsigned char* s = tree->scratch;
+	memcpy(s, f->data + HDR_SIZE, sizeof(uint64_t) + i * stride);
+	unsigned char* p = s + sizeof(uint64_t) + i * stride;
+	pair_init(tree, p, key, child);
+	memcpy(p + stride, node_key(tree, f->data, i), (pg->n - i) * stride);
+	const unsigned n = pg->n + 1, nl = n / 2;
+	memset(f->data + HDR_SIZE, 0, DB_PAGE_SIZE - HDR_SIZE);
+	memcpy(f->data + HDR_SIZE, s, sizeof(uint64_t) + nl * stride);
+	pg->n = nl;
+	unsigned char* up = s + sizeof(uint64_t) + nl * stride;
+	memcpy(right->data + HDR_SIZE, up + tree->key_slot, sizeof(uint64_t));
+	memcpy(node_key(tree, right->data, 0), up + stride,
+	       (n - nl - 1) * stride);
+	PAGE(right)->n = n - nl - 1;
+	memcpy(tree->keybuf, up, tree->key_size);
+	key = tree->keybuf;
+	child = right->pgno;
+	f->dirty = true;
+	page_put(f);
+	page_put(right);
+    }
+
+    /* The root was split. */
+    db_frame* root = page_alloc(tree, false);
+    if (!root)
+	return false;
+    memcpy(node_child(tree, root->data, 0), &tree->hdr.root, sizeof(uint64_t));
+    pair_init(tree, node_key(tree, root->data, 0), key, child);
+    PAGE(root)->n = 1;
+    tree->hdr.root = root->pgno;
+    tree->hdr.height++;
+    page_put(root);
+    return true;
+}
+
+/* Splits the full leaf |leaf| to insert |key| at index |i|. */
+static void**
+leaf_split(db_tree* tree, db_frame* leaf, unsigned i, const void* key,
+	   db_step* path)
+{
+    db_frame* right = page_alloc(tree, true);
+    if (!right) {
+	page_put(leaf);
+	return NULL;
+    }
+    db_page* lp = PAGE(leaf);
+    db_page* rp = PAGE(right);
+    if (lp->next != NO_PAGE) {
+	db_frame* next = page_get(tree, lp->next, true);
+	if (!next) {
+	    page_put(leaf);
+	    page_put(right);
+	    return NULL;
+	}
+	PAGE(next)->prev = right->pgno;
+	next->dirty = true;
+	page_put(next);
+    }
+    rp->next = lp->next;
+    rp->prev = leaf->pgno;
+    lp->next = right->pgno;
+
+    const size_t stride = tree->stride;
+    unsigned char* s = tree->scratch;
+    memcpy(s, leaf_entry(tree, leaf->data, 0), i * stride);
+    entry_init(tree, s + i * stride, key);
+    memcpy(s + (i + 1) * stride, leaf_entry(tree, leaf->data, i),
+	   (lp->n - i) * stride);
+    const unsigned n = lp->n + 1, nl = n / 2;
+    memset(leaf_entry(tree, leaf->data, 0), 0, DB_PAGE_SIZE - HDR_SIZE);
+    memcpy(leaf_entry(tree, leaf->data, 0), s, nl * stride);
+    lp->n = nl;
+    memcpy(leaf_entry(tree, right->data, 0), s + nl * stride,
+	   (n - nl) * stride);
+    rp->n = n - nl;
+    leaf->dirty = true;
+
+    const uint64_t target = i < nl ? leaf->pgno : right->pgno;
+    const unsigned index = i < nl ? i : i - nl;
+    const uint64_t rpgno = right->pgno;
+    memcpy(tree->keybuf, ENTRY_KEY(leaf_entry(tree, right->data, 0)),
+	   tree->key_size);
+    page_put(leaf);
+    page_put(right);
+    if (!node_insert(tree, path, (unsigned)tree->hdr.height - 1, tree->keybuf,
+		     rpgno))
+	return NULL;
+
+    /* The leaf may have been written out meanwhile; the caller will store
+     * the datum. */
+    db_frame* f = page_get(tree, target, true);
+    if (!f)
+	return NULL;
+    f->dirty = true;
+    page_put(f);
+    return ENTRY_DATUM(leaf_entry(tree, f->data, index));
+}
+
+void**
+db_tree_insert(db_tree* tree, void* key, bool* inserted)
+{
+    ASSERT(tree != NULL);
+
+    size_t depth = TRACE_DEPTH(insert, tree->hdr.height);
+
+    if (tree->hdr.root == NO_PAGE) {
+	db_frame* f = page_alloc(tree, true);
+	if (!f) {
+	    TRACE_OP(insert, "db", tree, key, depth, -1);
+	    return NULL;
+	}
+	tree->hdr.root = f->pgno;
+	tree->hdr.height = 1;
+	page_put(f);
+    }
+
+    db_step path[DB_MAX_HEIGHT];
+    db_frame* leaf = descend(tree, key, path);
+    if (!leaf) {
+	TRACE_OP(insert, "db", tree, key, depth, -1);
+	return NULL;
+    }
+    bool found;
+    const unsigned i = leaf_search(tree, leaf->data, key, &found);
+    if (found) {
+	/* The caller may store a new datum. */
+	leaf->dirty = true;
+	page_put(leaf);
+	if (inserted)
+	    *inserted = false;
+	TRACE_OP(insert, "db", tree, key, depth, 0);
+	return ENTRY_DATUM(leaf_entry(tree, leaf->data, i));
+    }
+
+    void** datum;
+    db_page* pg = PAGE(leaf);
+    if (pg->n < tree->leaf_max) {
+	unsigned char* e = leaf_entry(tree, leaf->data, i);
+	memmove(e + tree->stride, e, (pg->n - i) * tree->stride);
+	entry_init(tree, e, key);
+	pg->n++;
+	leaf->dirty = true;
+	page_put(leaf);
+	datum = ENTRY_DATUM(e);
+    } else if (tree->hdr.height >= DB_MAX_HEIGHT) {
+	page_put(leaf);
+	TRACE_OP(insert, "db", tree, key, depth, -1);
+	return NULL;
+    } else {
+	datum = leaf_split(tree, leaf, i, key, path);
+    }
+    if (datum) {
+	tree->hdr.count++;
+	tree->hdr_dirty = true;
+	tree->mod_count++;
+	if (inserted)
+	    *inserted = true;
+    }
+    TRACE_OP(insert, "db", tree, key, depth, datum ? 1 : -1);
+    return datum;
+}
+
+/* Rebalances the adjacent siblings |left| and |right|, children |s| and s+1 of
+ * |parent|: merges them if they fit in one node, and otherwise splits their
+ * entries evenly. Returns true if they were merged. */
+static bool
+siblings_join(db_tree* tree, db_frame* parent, unsigned s, db_frame* left,
+	      db_frame* right)
+{
+    const size_t stride = tree->stride;
+    db_page* lp = PAGE(left);
+    db_page* rp = PAGE(right);
+    unsigned char* s_key = node_key(tree, parent->data, s);
+    unsigned char* buf = tree->scratch;
+    unsigned n, nl;
+    bool merge;
+
+    left->dirty = right->dirty = parent->dirty = true;
+    if (lp->leaf) {
+	n = lp->n + rp->n;
+	merge = n <= tree->leaf_max;
+	memcpy(buf, leaf_entry(tree, left->data, 0), lp->n * stride);
+	memcpy(buf + lp->n * stride, leaf_entry(tree, right->data, 0),
+	       rp->n * stride);
+	nl = merge ? n : n / 2;
+	memset(leaf_entry(tree, left->data, 0), 0, DB_PAGE_SIZE - HDR_SIZE);
+	memcpy(leaf_entry(tree, left->data, 0), buf, nl * stride);
+	lp->n = nl;
+	if (merge) {
+	    if (rp->next != NO_PAGE) {
+		db_frame* next = page_get(tree, rp->next, true);
+		if (next) {
+		    PAGE(next)->prev = left->pgno;
+		    next->dirty = true;
+		    page_put(next);
+		}
+	    }
+	    lp->next = rp->next;
+	} else {
+	    memset(leaf_entry(tree, right->data, 0), 0,
+		   DB_PAGE_SIZE - HDR_SIZE);
+	    memcpy(leaf_entry(tree, right->data, 0), buf + nl * stride,
+		   (n - nl) * stride);
+	    rp->n = n - nl;
+	    memcpy(s_key, ENTRY_KEY(leaf_entry(tree, right->data, 0)),
+		   tree->key_size);
+	}
+    } else {
+	/* Lay out left, the separator with right's child 0, then right. */
+	n = lp->n + 1 + rp->n;
+	merge = n <= tree->node_max;
+	size_t size = sizeof(uint64_t) + lp->n * stride;
+	memcpy(buf, left->data + HDR_SIZE, size);
+	memcpy(buf + size, s_key, tree->key_slot);
+	memcpy(buf + size + tree->key_slot, right->data + HDR_SIZE,
+	       sizeof(uint64_t));
+	memcpy(buf + size + stride, node_key(tree, right->data, 0),
+	       rp->n * stride);
+	nl = merge ? n : n / 2;
+	memset(left->data + HDR_SIZE, 0, DB_PAGE_SIZE - HDR_SIZE);
+	memcpy(left->data + HDR_SIZE, buf, sizeof(uint64_t) + nl * stride);
+	lp->n = nl;
+	if (!merge) {
+	    unsigned char* up = buf + sizeof(uint64_t) + nl * stride;
+	    memcpy(s_key, up, tree->key_slot);
+	    memset(right->data + HDR_SIZE, 0, DB_PAGE_SIZE - HDR_SIZE);
+	    memcpy(right->data + HDR_SIZE, up + tree->key_slot,
+		   sizeof(uint64_t));
+	    memcpy(node_key(tree, right->data, 0), up + stride,
+		   (n - nl - 1) * stride);
+	    rp->n = n - nl - 1;
+	}
+    }
+    if (merge) {
+	page_free(tree, right);
+	db_page* pp = PAGE(parent);
+	memmove(s_key, s_key + stride, (pp->n - s - 1) * stride);
+	memset(node_key(tree, parent->data, pp->n - 1), 0, stride);
+	pp->n--;
+    }
+    return merge;
+}
+
+/* Restores the minimum fill of node |f| at |depth| in |path|, and of its
+ * ancestors in turn. Unpins |f|. */
+static void
+rebalance(db_tree* tree, db_step* path, unsigned depth, db_frame* f)
+{
+    for (;;) {
+	db_page* pg = PAGE(f);
+	if (depth == 0) {
+	    if (pg->n == 0) {
+		if (pg->leaf) {
+		    tree->hdr.root = NO_PAGE;
+		    tree->hdr.height = 0;
+		} else {
+		    memcpy(&tree->hdr.root, node_child(tree, f->data, 0),
+			   sizeof(uint64_t));
+		    tree->hdr.height--;
+		}
+		page_free(tree, f);
+	    }
+	    page_put(f);
+	    return;
+	}
+	const unsigned min = (pg->leaf ? tree->leaf_max : tree->node_max) / 2;
+	if (pg->n >= min)
+	    break;
+
+	const db_step* step = &path[depth - 1];
+	db_frame* parent = page_get(tree, step->pgno, true);
+	if (!parent)
+	    break;
+	const unsigned c = step->index;
+	const unsigned s = c > 0 ? c - 1 : c;
+	db_frame* sibling = page_get(tree,
+				     *node_child(tree, parent->data,
+						 c > 0 ? c - 1 : c + 1),
+				     true);
+	if (!sibling) {
+	    page_put(parent);
+	    break;
+	}
+	const bool merged = c > 0 ?
+	    siblings_join(tree, parent, s, sibling, f) :
+	    siblings_join(tree, parent, s, f, sibling);
+	page_put(sibling);
+	page_put(f);
+	if (!merged) {
+	    page_put(parent);
+	    return;
+	}
+	f = parent;
+	depth--;
+    }
+    page_put(f);
+}
+
+bool
+db_tree_remove(db_tree* tree, const void* key)
+{
+    ASSERT(tree != NULL);
+
+    size_t depth = TRACE_DEPTH(remove, tree->hdr.height);
+
+    if (tree->hdr.root == NO_PAGE) {
+	TRACE_OP(remove, "db", tree, key, depth, 0);
+	return false;
+    }
+    db_step path[DB_MAX_HEIGHT];
+    db_frame* leaf = descend(tree, key, path);
+    if (!leaf) {
+	TRACE_OP(remove, "db", tree, key, depth, 0);
+	return false;
+    }
+    bool found;
+    const unsigned i = leaf_search(tree, leaf->data, key, &found);
+    if (!found) {
+	page_put(leaf);
+	TRACE_OP(remove, "db", tree, key, depth, 0);
+	return false;
+    }
+    db_page* pg = PAGE(leaf);
+    unsigned char* e = leaf_entry(tree, leaf->data, i);
+    if (tree->del_func)
+	tree->del_func(ENTRY_KEY(e), *ENTRY_DATUM(e));
+    memmove(e, e + tree->stride, (pg->n - i - 1) * tree->stride);
+    memset(leaf_entry(tree, leaf->data, pg->n - 1), 0, tree->stride);
+    pg->n--;
+    leaf->dirty = true;
+    tree->hdr.count--;
+    tree->hdr_dirty = true;
+    tree->mod_count++;
+    rebalance(tree, path, (unsigned)tree->hdr.height - 1, leaf);
+    TRACE_OP(remove, "db", tree, key, depth, 1);
+    return true;
+}
+
+static db_frame*
+leaf_edge(db_tree* tree, bool last)
+{
+    uint64_t pgno = tree->hdr.root;
+    if (pgno == NO_PAGE)
+	return NULL;
+    for (;;) {
+	db_frame* f = page_get(tree, pgno, true);
+	if (!f || PAGE(f)->leaf)
+	    return f;
+	pgno = *node_child(tree, f->data, last ? PAGE(f)->n : 0);
+	page_put(f);
+    }
+}
+
+/* Visits every entry in order; with a NULL |visit|, passes each entry to the
+ * delete function instead. */
+static size_t
+leaf_walk(db_tree* tree, dict_visit_func visit)
+{
+    size_t count = 0;
+    db_frame* f = leaf_edge(tree, false);
+    while (f) {
+	for (unsigned i = 0; i < PAGE(f)->n; i++) {
+	    unsigned char* e = leaf_entry(tree, f->data, i);
+	    ++count;
+	    if (!visit) {
+		tree->del_func(ENTRY_KEY(e), *ENTRY_DATUM(e));
+	    } else if (!visit(ENTRY_KEY(e), *ENTRY_DATUM(e))) {
+		page_put(f);
+		return count;
+	    }
+	}
+	const uint64_t next = PAGE(f)->next;
+	page_put(f);
+	f = next != NO_PAGE ? page_get(tree, next, true) : NULL;
+    }
+    return count;
+}
+
+size_t
+db_tree_clear(db_tree* tree)
+{
+    ASSERT(tree != NULL);
+
+    const size_t count = tree->hdr.count;
+    if (tree->del_func)
+	leaf_walk(tree, NULL);
+    for (size_t i = 0; i < tree->nframes; i++) {
+	db_frame* f = &tree->frames[i];
+	if (f->pgno != NO_PAGE)
+	    frame_unhash(tree, f);
+	f->dirty = false;
+    }
+    tree->hdr.root = NO_PAGE;
+    tree->hdr.height = 0;
+    tree->hdr.count = 0;
+    tree->hdr.npages = 1;
+    tree->hdr.free_head = NO_PAGE;
+    tree->hdr_dirty = true;
+    tree->mod_count++;
+    if (ftruncate(tree->fd, DB_PAGE_SIZE) == 0)
+	header_write(tree);
+    return count;
+}
+
+size_t
+db_tree_traverse(db_tree* tree, dict_visit_func visit)
+{
+    ASSERT(tree != NULL);
+    ASSERT(visit != NULL);
+
+    return leaf_walk(tree, visit);
+}
+
+size_t
+db_tree_count(const db_tree* tree)
+{
+    ASSERT(tree != NULL);
+
+    return tree->hdr.count;
+}
+
+static size_t
+db_tree_mod_count(const db_tree* tree)
+{
+    ASSERT(tree != NULL);
+
+    return tree->mod_count;
+}
+
+size_t
+db_tree_height(const db_tree* tree)
+{
+    ASSERT(tree != NULL);
+
+    return tree->hdr.height;
+}
+
+void
+db_tree_io_counts(const db_tree* tree, size_t* reads, size_t* writes)
+{
+    ASSERT(tree != NULL);
+
+    if (reads)
+	*reads = tree->reads;
+    if (writes)
+	*writes = tree->writes;
+}
+
+typedef struct {
+    size_t		    count;
+    uint64_t		    prev_leaf;
+    bool		    have_last;
+    unsigned char*	    last_key;
+    const unsigned char*    lower;	/* Pending separator. */
+} db_verify;
+
+static bool verify_node(db_tree* tree, uint64_t pgno, unsigned depth,
+			db_verify* v);
+
+static bool
+verify_page(db_tree* tree, uint64_t pgno, unsigned char* data,
+	    unsigned depth, db_verify* v)
+{
+    const db_page* pg = (db_page*)data;
+    VERIFY(pg->leaf == (depth + 1 == tree->hdr.height));
+    VERIFY(pg->n >= 1);
+    if (depth > 0)
+	VERIFY(pg->n >= (pg->leaf ? tree->leaf_max : tree->node_max) / 2);
+    if (pg->leaf) {
+	VERIFY(pg->n <= tree->leaf_max);
+	VERIFY(pg->prev == v->prev_leaf);
+	for (unsigned i = 0; i < pg->n; i++) {
+	    const unsigned char* key = ENTRY_KEY(leaf_entry(tree, data, i));
+	    if (v->have_last)
+		VERIFY(tree->cmp_func(v->last_key, key) < 0);
+	    if (v->lower) {
+		VERIFY(tree->cmp_func(v->lower, key) <= 0);
+		v->lower = NULL;
+	    }
+	    memcpy(v->last_key, key, tree->key_size);
+	    v->have_last = true;
+	}
+	v->prev_leaf = pgno;
+	v->count += pg->n;
+	return true;
+    }
+    VERIFY(pg->n <= tree->node_max);
+    for (unsigned i = 0; i <= pg->n; i++) {
+	if (!verify_node(tree, *node_child(tree, data, i), depth + 1, v))
+	    return false;
+	if (i < pg->n) {
+	    const unsigned char* key = node_key(tree, data, i);
+	    VERIFY(tree->cmp_func(v->last_key, key) < 0);
+	    v->lower = key;
+	}
+    }
+    return true;
+}
+
+static bool
+verify_node(db_tree* tree, uint64_t pgno, unsigned depth, db_verify* v)
+{
+    VERIFY(depth < tree->hdr.height);
+    VERIFY(pgno != NO_PAGE && pgno < tree->hdr.npages);
+    unsigned char* data = MALLOC(DB_PAGE_SIZE);
+    if (!data)
+	return true;	/* Nothing can be checked without memory. */
+    db_frame* f = page_get(tree, pgno, true);
+    if (!f) {
+	FREE(data);
+	VERIFY(f != NULL);
+    }
+    memcpy(data, f->data, DB_PAGE_SIZE);
+    page_put(f);
+    const bool ok = verify_page(tree, pgno, data, depth, v);
+    FREE(data);
+    return ok;
+}
+
+bool
+db_tree_verify(const db_tree* tree)
+{
+    ASSERT(tree != NULL);
+
+    for (size_t i = 0; i < tree->nframes; i++) {
+	const db_frame* f = &tree->frames[i];
+	VERIFY(f->pins == 0);
+	if (f->pgno != NO_PAGE)
+	    VERIFY(frame_lookup(tree, f->pgno) == f);
+    }
+    if (tree->hdr.root == NO_PAGE) {
+	VERIFY(tree->hdr.height == 0);
+	VERIFY(tree->hdr.count == 0);
+	return true;
+    }
+    VERIFY(tree->hdr.height > 0 && tree->hdr.height <= DB_MAX_HEIGHT);
+
+    db_verify v = { 0, NO_PAGE, false, NULL, NULL };
+    if (!(v.last_key = MALLOC(tree->key_slot)))
+	return true;
+    const bool ok = verify_node((db_tree*)tree, tree->hdr.root, 0, &v);
+    FREE(v.last_key);
+    VERIFY(ok);
+    VERIFY(v.count == tree->hdr.count);
+    db_frame* f = page_get((db_tree*)tree, v.prev_leaf, true);
+    if (f) {
+	page_put(f);
+	VERIFY(PAGE(f)->next == NO_PAGE);
+    }
+    return true;
+}
+
+db_itor*
+db_itor_new(db_tree* tree)
+{
+    ASSERT(tree != NULL);
+
+    db_itor* itor = MALLOC(sizeof(*itor));
+    if (itor) {
+	itor->tree = tree;
+	itor->pgno = NO_PAGE;
+	itor->index = 0;
+    }
+    return itor;
+}
+
+dict_itor*
+db_dict_itor_new(db_tree* tree)
+{
+    ASSERT(tree != NULL);
+
+    dict_itor* itor = MALLOC(sizeof(*itor));
+    if (itor) {
+	if (!(itor->_itor = db_itor_new(tree))) {
+	    FREE(itor);
+	    return NULL;
+	}
+	itor->_vtable = &db_tree_itor_vtable;
+    }
+    return itor;
+}
+
+void
+db_itor_free(db_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    FREE(itor);
+}
+
+bool
+db_itor_valid(const db_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    return itor->pgno != NO_PAGE;
+}
+
+void
+db_itor_invalidate(db_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    itor->pgno = NO_PAGE;
+}
+
+bool
+db_itor_next(db_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    if (itor->pgno == NO_PAGE)
+	return db_itor_first(itor);
+    db_frame* f = page_get(itor->tree, itor->pgno, true);
+    if (!f) {
+	itor->pgno = NO_PAGE;
+	return false;
+    }
+    page_put(f);
+    if (++itor->index < PAGE(f)->n)
+	return true;
+    itor->pgno = PAGE(f)->next;
+    itor->index = 0;
+    return itor->pgno != NO_PAGE;
+}
+
+bool
+db_itor_prev(db_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    if (itor->pgno == NO_PAGE)
+	return db_itor_last(itor);
+    if (itor->index > 0) {
+	itor->index--;
+	return true;
+    }
+    db_frame* f = page_get(itor->tree, itor->pgno, true);
+    if (!f) {
+	itor->pgno = NO_PAGE;
+	return false;
+    }
+    page_put(f);
+    if ((itor->pgno = PAGE(f)->prev) == NO_PAGE)
+	return false;
+    if (!(f = page_get(itor->tree, itor->pgno, true))) {
+	itor->pgno = NO_PAGE;
+	return false;
+    }
+    page_put(f);
+    itor->index = PAGE(f)->n - 1;
+    return true;
+}
+
+bool
+db_itor_nextn(db_itor* itor, size_t count)
+{
+    ASSERT(itor != NULL);
+
+    while (count--)
+	if (!db_itor_next(itor))
+	    return false;
+    return itor->pgno != NO_PAGE;
+}
+
+bool
+db_itor_prevn(db_itor* itor, size_t count)
+{
+    ASSERT(itor != NULL);
+
+    while (count--)
+	if (!db_itor_prev(itor))
+	    return false;
+    return itor->pgno != NO_PAGE;
+}
+
+bool
+db_itor_first(db_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    db_frame* f = leaf_edge(itor->tree, false);
+    if (!f) {
+	itor->pgno = NO_PAGE;
+	return false;
+    }
+    page_put(f);
+    itor->pgno = f->pgno;
+    itor->index = 0;
+    return true;
+}
+
+bool
+db_itor_last(db_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    db_frame* f = leaf_edge(itor->tree, true);
+    if (!f) {
+	itor->pgno = NO_PAGE;
+	return false;
+    }
+    page_put(f);
+    itor->pgno = f->pgno;
+    itor->index = PAGE(f)->n - 1;
+    return true;
+}
+
+bool
+db_itor_search(db_itor* itor, const void* key)
+{
+    ASSERT(itor != NULL);
+
+    db_tree* tree = itor->tree;
+    itor->pgno = NO_PAGE;
+    if (tree->hdr.root == NO_PAGE)
+	return false;
+    db_frame* f = descend(tree, key, NULL);
+    if (!f)
+	return false;
+    page_put(f);
+    bool found;
+    const unsigned i = leaf_search(tree, f->data, key, &found);
+    if (found) {
+	itor->pgno = f->pgno;
+	itor->index = i;
+    }
+    return found;
+}
+
+bool
+db_itor_seek(db_itor* itor, const void* key)
+{
+    ASSERT(itor != NULL);
+
+    if (itor->pgno == NO_PAGE)
+	return false;
+    db_tree* tree = itor->tree;
+    const void* current = db_itor_key(itor);
+    if (!current) {
+	itor->pgno = NO_PAGE;
+	return false;
+    }
+    if (tree->cmp_func(current, key) >= 0)
+	return true;
+    /* Descend from the root, as a search does, rather than step through the
+     * leaves in between. */
+    db_frame* f = descend(tree, key, NULL);
+    if (!f) {
+	itor->pgno = NO_PAGE;
+	return false;
+    }
+    page_put(f);
+    bool found;
+    const unsigned i = leaf_search(tree, f->data, key, &found);
+    if (i < PAGE(f)->n) {
+	itor->pgno = f->pgno;
+	itor->index = i;
+	return true;
+    }
+    /* Every key in the leaf is less than |key|; the next leaf's first is
+     * not. */
+    itor->pgno = PAGE(f)->next;
+    itor->index = 0;
+    return itor->pgno != NO_PAGE;
+}
+
+const void*
+db_itor_key(const db_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    if (itor->pgno == NO_PAGE)
+	return NULL;
+    db_frame* f = page_get(itor->tree, itor->pgno, true);
+    if (!f)
+	return NULL;
+    page_put(f);
+    return ENTRY_KEY(leaf_entry(itor->tree, f->data, itor->index));
+}
+
+void**
+db_itor_data(db_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    if (itor->pgno == NO_PAGE)
+	return NULL;
+    db_frame* f = page_get(itor->tree, itor->pgno, true);
+    if (!f)
+	return NULL;
+    page_put(f);
+    f->dirty = true;
+    return ENTRY_DATUM(leaf_entry(itor->tree, f->data, itor->index));
+}
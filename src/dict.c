@@ -30,6 +30,10 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#define _POSIX_C_SOURCE 200809L /* For clock_gettime(). */
+
+#include <string.h>
+#include <time.h>
 #include "dict_private.h"
 
 #define XSTRINGIFY(x)	STRINGIFY(x)
@@ -42,6 +46,97 @@ const char* const kDictVersionString = XSTRINGIFY(DICT_VERSION_MAJOR) "."
 void* (*dict_malloc_func)(size_t) = malloc;
 void (*dict_free_func)(void*) = free;
 
+/* Only its address matters. */
+char dict_set_member;
+
+#if defined(DICT_USDT)
+/* Raised by tracing tools while they are attached to a probe. */
+# define SEMAPHORE(probe) \
+    volatile unsigned short libdict_##probe##_semaphore \
+	__attribute__((section(".probes")))
+SEMAPHORE(insert);
+SEMAPHORE(search);
+SEMAPHORE(remove);
+SEMAPHORE(rotate);
+SEMAPHORE(rebuild);
+SEMAPHORE(resize);
+# undef SEMAPHORE
+#endif
+
+unsigned dict_sample_every = 0;
+/* Each thread counts its own calls, so that they need no synchronization. */
+static THREAD_LOCAL unsigned sample_countdown = 0;
+static dict_sample_func sample_func = NULL;
+static void* sample_ctx = NULL;
+
+void
+dict_set_sampler(unsigned every, dict_sample_func func, void* ctx)
+{
+    sample_func = func;
+    sample_ctx = ctx;
+    sample_countdown = every;
+    dict_sample_every = func ? every : 0;
+}
+
+static uint64_t
+sample_clock(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+/* Return whether to time this operation, counting down from
+ * dict_sample_every. A thread's first call, or its first since the interval
+ * was shortened, starts its countdown afresh. */
+static bool
+sample_due(void)
+{
+    const unsigned every = dict_sample_every;
+    if (sample_countdown == 0 || sample_countdown > every)
+	sample_countdown = every;
+    return --sample_countdown == 0;
+}
+
+void**
+dict_sampled_insert(dict* dct, void* key, bool* inserted)
+{
+    ASSERT(dct != NULL);
+
+    if (!sample_due())
+	return dct->_vtable->insert(dct->_object, key, inserted);
+    uint64_t start = sample_clock();
+    void** datum = dct->_vtable->insert(dct->_object, key, inserted);
+    sample_func(DICT_OP_INSERT, dct, key, sample_clock() - start, sample_ctx);
+    return datum;
+}
+
+void*
+dict_sampled_search(dict* dct, const void* key)
+{
+    ASSERT(dct != NULL);
+
+    if (!sample_due())
+	return dct->_vtable->search(dct->_object, key);
+    uint64_t start = sample_clock();
+    void* datum = dct->_vtable->search(dct->_object, key);
+    sample_func(DICT_OP_SEARCH, dct, key, sample_clock() - start, sample_ctx);
+    return datum;
+}
+
+bool
+dict_sampled_remove(dict* dct, const void* key)
+{
+    ASSERT(dct != NULL);
+
+    if (!sample_due())
+	return dct->_vtable->remove(dct->_object, key);
+    uint64_t start = sample_clock();
+    bool removed = dct->_vtable->remove(dct->_object, key);
+    sample_func(DICT_OP_REMOVE, dct, key, sample_clock() - start, sample_ctx);
+    return removed;
+}
+
 int
 dict_int_cmp(const void* k1, const void* k2)
 {
@@ -131,6 +226,140 @@ dict_clone(dict* dct, dict_key_datum_clone_func clone_func)
     return clone;
 }
 
+size_t
+dict_remove_many(dict* dct, const void** keys, size_t count)
+{
+    ASSERT(dct != NULL);
+    ASSERT(keys != NULL || count == 0);
+
+    if (dct->_vtable->remove_many)
+	return dct->_vtable->remove_many(dct->_object, keys, count);
+    size_t removed = 0;
+    for (size_t i = 0; i < count; i++)
+	removed += dict_remove(dct, keys[i]);
+    return removed;
+}
+
+bool
+dict_keys_grow(const void*** keys, size_t* size, const void** local)
+{
+    if (*size > SIZE_MAX / 2 / sizeof(**keys))
+	return false;
+    const void** grown = MALLOC(2 * *size * sizeof(**keys));
+    if (!grown)
+	return false;
+    memcpy(grown, *keys, *size * sizeof(**keys));
+    if (*keys != local)
+	FREE(*keys);
+    *keys = grown;
+    *size *= 2;
+    return true;
+}
+
+size_t
+dict_mod_count(const dict* dct)
+{
+    ASSERT(dct != NULL);
+
+    return dct->_vtable->mod_count ? dct->_vtable->mod_count(dct->_object) : 0;
+}
+
+size_t
+dict_remove_if(dict* dct, dict_predicate_func pred, void* ctx)
+{
+    ASSERT(dct != NULL);
+    ASSERT(pred != NULL);
+
+    if (dct->_vtable->remove_if)
+	return dct->_vtable->remove_if(dct->_object, pred, ctx);
+
+    /* Collect the keys to remove in one pass, then remove them. If the buffer
+     * cannot grow, the keys collected so far are removed and the pass is
+     * started over. */
+    const void* local[DICT_LOCAL_KEYS];
+    const void** keys = local;
+    size_t size = DICT_LOCAL_KEYS;
+    size_t removed = 0;
+    bool done = false;
+    while (!done) {
+	dict_itor* itor = dict_itor_new(dct);
+	if (!itor)
+	    break;
+	size_t nkeys = 0;
+	done = true;
+	for (dict_itor_first(itor); dict_itor_valid(itor);
+	     dict_itor_next(itor)) {
+	    if (nkeys == size && !dict_keys_grow(&keys, &size, local)) {
+		done = false;
+		break;
+	    }
+	    const void* key = dict_itor_key(itor);
+	    if (pred(key, *dict_itor_data(itor), ctx))
+		keys[nkeys++] = key;
+	}
+	dict_itor_free(itor);
+	for (size_t i = 0; i < nkeys; i++)
+	    removed += dict_remove(dct, keys[i]);
+    }
+    if (keys != local)
+	FREE(keys);
+    return removed;
+}
+
+size_t
+dict_export(dict* dct, void** keys, void** data, size_t max,
+	    dict_export_pos* pos)
+{
+    ASSERT(dct != NULL);
+    ASSERT(pos != NULL);
+
+    if (dct->_vtable->export)
+	return dct->_vtable->export(dct->_object, keys, data, max, pos);
+
+    /* Copy through an iterator, which is kept in |pos| until the end. */
+    if (!pos->itor) {
+	if (pos->index || !(pos->itor = dict_itor_new(dct)))
+	    return 0;
+	dict_itor_first(pos->itor);
+    }
+    dict_itor* itor = pos->itor;
+    size_t n = 0;
+    for (; n < max && dict_itor_valid(itor); n++, dict_itor_next(itor)) {
+	if (keys)
+	    keys[n] = dict_itor_key(itor);
+	if (data)
+	    data[n] = *dict_itor_data(itor);
+    }
+    pos->index += n;
+    if (n < max)
+	dict_export_end(pos);
+    return n;
+}
+
+void
+dict_export_end(dict_export_pos* pos)
+{
+    ASSERT(pos != NULL);
+
+    if (pos->itor) {
+	dict_itor_free(pos->itor);
+	pos->itor = NULL;
+    }
+}
+
+size_t
+dict_export_all(dict* dct, void** keys, void** data, unsigned threads)
+{
+    ASSERT(dct != NULL);
+
+    if (dct->_vtable->export_all)
+	return dct->_vtable->export_all(dct->_object, keys, data, threads);
+    dict_export_pos pos = DICT_EXPORT_START;
+    const size_t count = dict_export(dct, keys, data, dict_count(dct), &pos);
+    dict_export_end(&pos);
+    return count;
+}
+
 void
 dict_itor_free(dict_itor* itor)
 {
@@ -0,0 +1,195 @@
+/*
+ * libdict -- huge page arena allocator.
+ *
+ * Copyright (c) 2001-2011, Farooq Mela
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *    This product includes software developed by Farooq Mela.
+ * 4. Neither the name of the Farooq Mela nor the
+ *    names of contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY FAROOQ MELA ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL FAROOQ MELA BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Each region serves blocks of a single size class, which are handed out
+ * from the front of the region and, once freed, reused through a per-class
+ * free list. A hash set of region numbers maps a block back to its class, and
+ * tells blocks of the arena from blocks of malloc().
+ */
+
+#define _DEFAULT_SOURCE		    /* For madvise() and MAP_ANONYMOUS. */
+
+#include <sys/mman.h>
+#include "dict_private.h"
+
+#ifndef MAP_ANONYMOUS
+# define MAP_ANONYMOUS	MAP_ANON
+#endif
+
+#define REGION_SHIFT	21
+#define REGION_SIZE	((size_t)1 << REGION_SHIFT)
+#define CLASS_SHIFT	4
+#define MAX_BLOCK	512
+#define NCLASSES	(MAX_BLOCK >> CLASS_SHIFT)
+
+typedef struct arena_block arena_block;
+
+struct arena_block {
+    arena_block*	    next;
+};
+
+typedef struct {
+    arena_block*	    free;
+    char*		    next;	/* Next block never handed out. */
+    char*		    end;
+} arena_class;
+
+typedef struct {
+    uintptr_t		    region;	/* Region number plus one; 0 if empty. */
+    unsigned		    cls;
+} arena_slot;
+
+static arena_class	    classes[NCLASSES];
+static arena_slot*	    slots;
+static size_t		    slot_mask;
+static dict_arena_stats	    stats;
+
+static arena_slot*
+slot_find(uintptr_t region)
+{
+    if (!slots)
+	return NULL;
+    size_t i = (size_t)(region * 0x9E3779B97F4A7C15ULL >> 20) & slot_mask;
+    while (slots[i].region) {
+	if (slots[i].region == region)
+	    return &slots[i];
+	i = (i + 1) & slot_mask;
+    }
+    return NULL;
+}
+
+static bool
+slot_add(uintptr_t region, unsigned cls)
+{
+    if (!slots || (stats.regions + 1) * 2 > slot_mask + 1) {
+	const size_t old_size = slots ? slot_mask + 1 : 0;
+	const size_t size = old_size ? old_size * 2 : 64;
+	arena_slot* old = slots;
+	if (!(slots = calloc(size, sizeof(*slots)))) {
+	    slots = old;
+	    return false;
+	}
+	slot_mask = size - 1;
+	for (size_t i = 0; i < old_size; i++)
+	    if (old[i].region)
+		slot_add(old[i].region, old[i].cls);
+	free(old);
+    }
+    size_t i = (size_t)(region * 0x9E3779B97F4A7C15ULL >> 20) & slot_mask;
+    while (slots[i].region)
+	i = (i + 1) & slot_mask;
+    slots[i].region = region;
+    slots[i].cls = cls;
+    return true;
+}
+
+/* Maps a 2MB-aligned region, by mapping twice as much and trimming. */
+static char*
+region_new(unsigned cls)
+{
+    char* p = mmap(NULL, REGION_SIZE * 2, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+	return NULL;
+    const size_t head = (REGION_SIZE - ((uintptr_t)p & (REGION_SIZE - 1))) &
+	(REGION_SIZE - 1);
+    if (head)
+	munmap(p, head);
+    munmap(p + head + REGION_SIZE, REGION_SIZE - head);
+    p += head;
+    if (!slot_add(((uintptr_t)p >> REGION_SHIFT) + 1, cls)) {
+	munmap(p, REGION_SIZE);
+	return NULL;
+    }
+    stats.regions++;
+#ifdef MADV_HUGEPAGE
+    if (madvise(p, REGION_SIZE, MADV_HUGEPAGE) == 0)
+	stats.huge_regions++;
+#endif
+    return p;
+}
+
+void*
+dict_arena_malloc(size_t size)
+{
+    if (size > MAX_BLOCK) {
+	stats.fallbacks++;
+	return malloc(size);
+    }
+    const unsigned cls = size ? (unsigned)((size - 1) >> CLASS_SHIFT) : 0;
+    const size_t block_size = (size_t)(cls + 1) << CLASS_SHIFT;
+    arena_class* c = &classes[cls];
+    void* p;
+    if (c->free) {
+	p = c->free;
+	c->free = c->free->next;
+    } else {
+	if (!c->next || (size_t)(c->end - c->next) < block_size) {
+	    char* region = region_new(cls);
+	    if (!region) {
+		stats.fallbacks++;
+		return malloc(size);
+	    }
+	    c->next = region;
+	    c->end = region + REGION_SIZE;
+	}
+	p = c->next;
+	c->next += block_size;
+    }
+    stats.blocks++;
+    return p;
+}
+
+void
+dict_arena_free(void* ptr)
+{
+    if (!ptr)
+	return;
+    const arena_slot* slot = slot_find(((uintptr_t)ptr >> REGION_SHIFT) + 1);
+    if (!slot) {
+	free(ptr);
+	return;
+    }
+    arena_block* block = ptr;
+    block->next = classes[slot->cls].free;
+    classes[slot->cls].free = block;
+    stats.blocks--;
+}
+
+void
+dict_arena_get_stats(dict_arena_stats* out)
+{
+    ASSERT(out != NULL);
+
+    *out = stats;
+}
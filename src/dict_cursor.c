@@ -0,0 +1,216 @@
+/*
+ * libdict -- cursors that survive modification.
+ *
+ * Copyright (c) 2001-2011, Farooq Mela
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *    This product includes software developed by Farooq Mela.
+ * 4. Neither the name of the Farooq Mela nor the
+ *    names of contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY FAROOQ MELA ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL FAROOQ MELA BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * The cursor's iterator is only trusted while the container's modification
+ * count is what it was when the iterator last moved; otherwise it may be on a
+ * node that has since been freed, or belong to a backend that has been
+ * replaced. A new iterator is then moved to the first key and seeked forward
+ * to the cursor's key, which costs about as much as a search. The iterator of
+ * a container that does not count modifications is freed after every move,
+ * since it could not be trusted again and may hold a lock, as a shm_map's
+ * does; a cursor on one finds no more keys if a new one cannot be allocated.
+ */
+
+#include "dict.h"
+
+#include "dict_private.h"
+
+struct dict_cursor {
+    dict*		dct;
+    dict_compare_func	cmp_func;
+    dict_itor*		itor;
+    const void*		key;
+    bool		has_key;    /* Whether the cursor is on or past |key|. */
+    bool		valid;	    /* Whether the cursor is on |key|. */
+    bool		inclusive;  /* Whether |key| itself is still ahead. */
+    size_t		mod_count;  /* The container's, when |itor| moved. */
+};
+
+dict_cursor*
+dict_cursor_new(dict* dct, dict_compare_func cmp_func)
+{
+    ASSERT(dct != NULL);
+    ASSERT(cmp_func != NULL);
+
+    dict_cursor* cursor = MALLOC(sizeof(*cursor));
+    if (!cursor)
+	return NULL;
+    cursor->dct = dct;
+    cursor->cmp_func = cmp_func;
+    cursor->itor = NULL;
+    cursor->key = NULL;
+    cursor->has_key = false;
+    cursor->valid = false;
+    cursor->inclusive = false;
+    cursor->mod_count = 0;
+    return cursor;
+}
+
+void
+dict_cursor_free(dict_cursor* cursor)
+{
+    ASSERT(cursor != NULL);
+
+    if (cursor->itor)
+	dict_itor_free(cursor->itor);
+    FREE(cursor);
+}
+
+/* Return whether the iterator is still where the cursor left it. */
+static bool
+cursor_current(const dict_cursor* cursor)
+{
+    const dict* dct = cursor->dct;
+    return cursor->itor && dct->_vtable->mod_count &&
+	dct->_vtable->mod_count(dct->_object) == cursor->mod_count;
+}
+
+/* Move a new iterator to the first key. The old one is freed first, so that
+ * a container whose iterators hold a lock is never locked twice. */
+static bool
+cursor_first(dict_cursor* cursor)
+{
+    if (cursor->itor)
+	dict_itor_free(cursor->itor);
+    if (!(cursor->itor = dict_itor_new(cursor->dct)))
+	return false;
+    return dict_itor_first(cursor->itor);
+}
+
+/* Free the iterator of a container that does not count modifications, which
+ * will be replaced on the next move anyway. */
+static void
+cursor_release(dict_cursor* cursor)
+{
+    if (cursor->itor && !cursor->dct->_vtable->mod_count) {
+	dict_itor_free(cursor->itor);
+	cursor->itor = NULL;
+    }
+}
+
+/* Move the iterator to the first key not less than |key|, stepping through
+ * the keys of containers that cannot seek. */
+static bool
+cursor_seek(dict_cursor* cursor, const void* key)
+{
+    if (!cursor_first(cursor))
+	return false;
+    dict_itor* itor = cursor->itor;
+    if (itor->_vtable->seek)
+	return dict_itor_seek(itor, key);
+    while (cursor->cmp_func(dict_itor_key(itor), key) < 0)
+	if (!dict_itor_next(itor))
+	    return false;
+    return true;
+}
+
+/* Make the iterator's position, on a key if |valid|, the cursor's. */
+static bool
+cursor_moved(dict_cursor* cursor, bool valid)
+{
+    const dict* dct = cursor->dct;
+    if (dct->_vtable->mod_count)
+	cursor->mod_count = dct->_vtable->mod_count(dct->_object);
+    if ((cursor->valid = valid)) {
+	cursor->key = dict_itor_key(cursor->itor);
+	cursor->has_key = true;
+	cursor->inclusive = false;
+    }
+    return valid;
+}
+
+bool
+dict_cursor_next(dict_cursor* cursor)
+{
+    ASSERT(cursor != NULL);
+
+    bool found;
+    if (!cursor->has_key)
+	found = cursor_first(cursor);
+    else if (cursor_current(cursor))
+	found = cursor->valid && dict_itor_next(cursor->itor);
+    else
+	found = cursor_seek(cursor, cursor->key) &&
+	    (cursor->inclusive ||
+	     cursor->cmp_func(dict_itor_key(cursor->itor), cursor->key) > 0 ||
+	     dict_itor_next(cursor->itor));
+    cursor_moved(cursor, found);
+    cursor_release(cursor);
+    return found;
+}
+
+bool
+dict_cursor_seek(dict_cursor* cursor, const void* key)
+{
+    ASSERT(cursor != NULL);
+
+    const bool found = cursor_seek(cursor, key);
+    if (!found) {
+	cursor->key = key;
+	cursor->has_key = true;
+	cursor->inclusive = true;
+    }
+    cursor_moved(cursor, found);
+    cursor_release(cursor);
+    return found;
+}
+
+const void*
+dict_cursor_key(const dict_cursor* cursor)
+{
+    ASSERT(cursor != NULL);
+
+    return cursor->valid ? cursor->key : NULL;
+}
+
+void**
+dict_cursor_data(dict_cursor* cursor)
+{
+    ASSERT(cursor != NULL);
+
+    if (!cursor->valid)
+	return NULL;
+    if (!cursor_current(cursor)) {
+	/* If the key is gone, the cursor stays on it, and the next move seeks
+	 * again. */
+	if (!cursor_seek(cursor, cursor->key) ||
+	    cursor->cmp_func(dict_itor_key(cursor->itor), cursor->key) != 0) {
+	    cursor_release(cursor);
+	    return NULL;
+	}
+	cursor_moved(cursor, true);
+    }
+    void** datum = dict_itor_data(cursor->itor);
+    cursor_release(cursor);
+    return datum;
+}
@@ -0,0 +1,178 @@
+/*
+ * libdict -- leapfrog join of ordered dictionaries.
+ *
+ * Copyright (c) 2001-2011, Farooq Mela
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *    This product includes software developed by Farooq Mela.
+ * 4. Neither the name of the Farooq Mela nor the
+ *    names of contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY FAROOQ MELA ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL FAROOQ MELA BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * The join keeps an iterator on each input, and the inputs in a cycle ordered
+ * by their iterators' keys: the one at |least| has the least key, and the one
+ * before it in the cycle the greatest. Each step seeks the least forward to
+ * the greatest key, which makes it the greatest, until all the keys are equal.
+ * An input is only ever moved forward from where it is, so that with
+ * dict_itor_seek() it skips runs of keys missing from the others in time
+ * logarithmic in their length.
+ */
+
+#include "dict.h"
+
+#include "dict_private.h"
+
+struct dict_join {
+    dict_compare_func	cmp_func;
+    size_t		count;
+    size_t		least;	    /* Position in |cycle| of the least key. */
+    bool		started;
+    bool		valid;
+    dict_itor**		itors;	    /* In the order of the inputs. */
+    size_t*		cycle;	    /* Indices into |itors|. */
+};
+
+dict_join*
+dict_join_new(dict** dicts, size_t count, dict_compare_func cmp_func)
+{
+    ASSERT(dicts != NULL);
+    ASSERT(count > 0);
+    ASSERT(cmp_func != NULL);
+
+    dict_join* join = MALLOC(sizeof(*join));
+    if (!join)
+	return NULL;
+    join->cmp_func = cmp_func;
+    join->count = 0;
+    join->least = 0;
+    join->started = false;
+    join->valid = false;
+    join->itors = MALLOC(count * sizeof(*join->itors));
+    join->cycle = MALLOC(count * sizeof(*join->cycle));
+    if (!join->itors || !join->cycle) {
+	dict_join_free(join);
+	return NULL;
+    }
+    for (; join->count < count; join->count++) {
+	if (!(join->itors[join->count] = dict_itor_new(dicts[join->count]))) {
+	    dict_join_free(join);
+	    return NULL;
+	}
+	join->cycle[join->count] = join->count;
+    }
+    return join;
+}
+
+void
+dict_join_free(dict_join* join)
+{
+    ASSERT(join != NULL);
+
+    for (size_t i = 0; i < join->count; i++)
+	dict_itor_free(join->itors[i]);
+    FREE(join->itors);
+    FREE(join->cycle);
+    FREE(join);
+}
+
+/* Move |itor| forward to the first key not less than |key|, stepping through
+ * the keys of containers that cannot seek. */
+static bool
+join_seek(const dict_join* join, dict_itor* itor, const void* key)
+{
+    if (itor->_vtable->seek)
+	return dict_itor_seek(itor, key);
+    while (join->cmp_func(dict_itor_key(itor), key) < 0)
+	if (!dict_itor_next(itor))
+	    return false;
+    return true;
+}
+
+static bool
+join_search(dict_join* join)
+{
+    const size_t n = join->count;
+    const void* greatest =
+	dict_itor_key(join->itors[join->cycle[(join->least + n - 1) % n]]);
+    for (;;) {
+	dict_itor* itor = join->itors[join->cycle[join->least]];
+	if (join->cmp_func(dict_itor_key(itor), greatest) == 0)
+	    return join->valid = true;
+	if (!join_seek(join, itor, greatest))
+	    return join->valid = false;
+	greatest = dict_itor_key(itor);
+	join->least = (join->least + 1) % n;
+    }
+}
+
+bool
+dict_join_next(dict_join* join)
+{
+    ASSERT(join != NULL);
+
+    if (!join->started) {
+	join->started = true;
+	for (size_t i = 0; i < join->count; i++)
+	    if (!dict_itor_first(join->itors[i]))
+		return join->valid = false;
+	/* Order the cycle by first key; there are few inputs. */
+	for (size_t i = 1; i < join->count; i++) {
+	    const size_t index = join->cycle[i];
+	    const void* key = dict_itor_key(join->itors[index]);
+	    size_t j = i;
+	    for (; j > 0 && join->cmp_func(
+			dict_itor_key(join->itors[join->cycle[j - 1]]), key) > 0;
+		 j--)
+		join->cycle[j] = join->cycle[j - 1];
+	    join->cycle[j] = index;
+	}
+	join->least = 0;
+	return join_search(join);
+    }
+    if (!join->valid)
+	return false;
+    /* Every key is equal, so any input can become the one with the greatest. */
+    if (!dict_itor_next(join->itors[join->cycle[join->least]]))
+	return join->valid = false;
+    join->least = (join->least + 1) % join->count;
+    return join_search(join);
+}
+
+const void*
+dict_join_key(const dict_join* join)
+{
+    ASSERT(join != NULL);
+
+    return join->valid ? dict_itor_key(join->itors[0]) : NULL;
+}
+
+void**
+dict_join_data(dict_join* join, size_t index)
+{
+    ASSERT(join != NULL);
+    ASSERT(index < join->count);
+
+    return join->valid ? dict_itor_data(join->itors[index]) : NULL;
+}
@@ -13,6 +13,14 @@
 
 #include "dict.h"
 
+/* Operations within the library are not sampled. */
+#undef dict_insert
+#undef dict_search
+#undef dict_remove
+#define dict_insert(dct,k,d)	((dct)->_vtable->insert((dct)->_object,(k),(d)))
+#define dict_search(dct,k)      ((dct)->_vtable->search((dct)->_object, (k)))
+#define dict_remove(dct,k)      ((dct)->_vtable->remove((dct)->_object, (k)))
+
 /* A feature (or bug) of this macro is that the expression is always evaluated,
  * regardless of whether NDEBUG is defined or not. This is intentional and
  * sometimes useful. */
@@ -50,6 +58,10 @@
 	} \
     } while (0)
 
+/* Fails to compile, naming |name|, unless |expr| is a true constant. */
+#define STATIC_ASSERT(name, expr) \
+    typedef char static_assert_##name[(expr) ? 1 : -1]
+
 #define MALLOC(n)	(*dict_malloc_func)(n)
 #define FREE(p)		(*dict_free_func)(p)
 
@@ -58,6 +70,90 @@
 #define MAX(a,b)	((a) > (b) ? (a) : (b))
 #define SWAP(a,b,v)	do { v = (a); (a) = (b); (b) = v; } while (0)
 
+/* Containers that can be sets have a |keys_only| flag and a |set_datum| slot,
+ * and nodes whose last field is the datum, which a set does not allocate. A
+ * set's datums read as DICT_SET_MEMBER, |set_datum| is handed out wherever a
+ * pointer to a datum is returned, and the delete function is passed NULL. */
+#define SET_NODE_SIZE(obj, size) \
+    ((obj)->keys_only ? (size) - sizeof(void*) : (size))
+#define NODE_DATUM(obj, node) \
+    ((obj)->keys_only ? DICT_SET_MEMBER : (node)->datum)
+#define NODE_DEL_DATUM(obj, node) \
+    ((obj)->keys_only ? NULL : (node)->datum)
+#define NODE_DATUM_SLOT(obj, node) \
+    ((obj)->keys_only ? \
+     ((obj)->set_datum = DICT_SET_MEMBER, &(obj)->set_datum) : \
+     &(node)->datum)
+
+/* Bulk removals collect the keys to remove in a buffer that starts out as a
+ * local array of DICT_LOCAL_KEYS keys. Doubles the size of |*keys|, returning
+ * false if it cannot. */
+#define DICT_LOCAL_KEYS	32
+bool		dict_keys_grow(const void*** keys, size_t* size,
+			       const void** local);
+
+/* Returns the modification count of |dct|, or 0 if it does not keep one. A
+ * wrapper adds that of the dictionary it wraps to a count of the changes made
+ * through it, so that its own count changes whenever either does. */
+size_t		dict_mod_count(const dict* dct);
+
+/* Static probes for tracing tools such as bpftrace, perf and SystemTap, under
+ * the provider "libdict". They are built in where <sys/sdt.h> is found, unless
+ * DICT_NO_USDT is defined, and cost a nop each until a tool attaches:
+ *
+ *   insert, search, remove (container, object, key, depth, result)
+ *	|container| names the type ("rb", "hashtable", ...) and |depth| is the
+ *	number of nodes or entries the key was compared with before the
+ *	operation, or 0 where that is not tracked; |result| is 1 if
+ *	the key was inserted, found or removed, 0 if not, and -1 if an insert
+ *	ran out of memory.
+ *   rotate (object, node, direction)
+ *	|node| of a tree was rotated left (0) or right (1).
+ *   rebuild (object, size)
+ *	a subtree of |size| nodes of a tree was rebuilt balanced, in one pass
+ *	rather than by rotations.
+ *   resize (object, old size, new size)
+ *	a hashtable was resized.
+ *
+ * A tool raises a probe's semaphore while it is attached, so the depth, which
+ * takes a second walk, is only computed by TRACE_DEPTH() then; it must be
+ * passed to TRACE_OP() as a variable or a constant. */
+#if !defined(DICT_NO_USDT) && defined(__has_include)
+# if __has_include(<sys/sdt.h>)
+#  define DICT_USDT 1
+# endif
+#endif
+
+#if defined(DICT_USDT)
+# define _SDT_HAS_SEMAPHORES 1
+# include <sys/sdt.h>
+extern volatile unsigned short libdict_insert_semaphore;
+extern volatile unsigned short libdict_search_semaphore;
+extern volatile unsigned short libdict_remove_semaphore;
+extern volatile unsigned short libdict_rotate_semaphore;
+extern volatile unsigned short libdict_rebuild_semaphore;
+extern volatile unsigned short libdict_resize_semaphore;
+# define TRACE_ENABLED(probe)	(libdict_##probe##_semaphore != 0)
+# define TRACE_DEPTH(probe, expr) \
+    (TRACE_ENABLED(probe) ? (size_t)(expr) : 0)
+# define TRACE_OP(probe, name, obj, key, depth, result) \
+    DTRACE_PROBE5(libdict, probe, name, obj, key, (size_t)(depth), \
+		  (int)(result))
+# define TRACE_ROTATE(obj, node, dir) \
+    DTRACE_PROBE3(libdict, rotate, obj, node, dir)
+# define TRACE_REBUILD(obj, size) \
+    DTRACE_PROBE2(libdict, rebuild, obj, (size_t)(size))
+# define TRACE_RESIZE(obj, from, to) \
+    DTRACE_PROBE3(libdict, resize, obj, (size_t)(from), (size_t)(to))
+#else
+# define TRACE_ENABLED(probe)	0
+# define TRACE_DEPTH(probe, expr) (0 ? (size_t)(expr) : (size_t)0)
+# define TRACE_OP(probe, name, obj, key, depth, result) ((void)(depth))
+# define TRACE_ROTATE(obj, node, dir) ((void)0)
+# define TRACE_REBUILD(obj, size) ((void)0)
+# define TRACE_RESIZE(obj, from, to) ((void)0)
+#endif
+
 #if defined(__GNUC__)
 # define GCC_INLINE	__inline__
 # define GCC_CONST	__attribute__((__const__))
@@ -66,4 +162,14 @@
 # define GCC_CONST
 #endif
 
+/* Storage of which each thread has its own copy, where the compiler has it;
+ * elsewhere, storage shared by all threads. */
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+# define THREAD_LOCAL	_Thread_local
+#elif defined(__GNUC__)
+# define THREAD_LOCAL	__thread
+#else
+# define THREAD_LOCAL
+#endif
+
 #endif /* !_DICT_PRIVATE_H_ */
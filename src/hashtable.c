@@ -31,20 +31,29 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#define _POSIX_C_SOURCE 200809L	    /* For mmap() and friends. */
+
 #include "hashtable.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h> /* For qsort() */
 #include <string.h> /* For memset() */
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "dict_private.h"
+#include "dict_inline.h"
 
 typedef struct hash_node hash_node;
 
 struct hash_node {
     void*		    key;
-    void*		    datum;
     hash_node*		    next;
     /* Only because iterators are bidirectional: */
     hash_node*		    prev;
     unsigned		    hash;	/* Untruncated hash value. */
+    void*		    datum;	/* Not allocated in a set. */
 };
 
 struct hashtable {
@@ -52,6 +61,8 @@ struct hashtable {
     unsigned		    size;
     dict_compare_func	    cmp_func;
     dict_hash_func	    hash_func;
+    bool		    keys_only;
+    void*		    set_datum;
     dict_delete_func	    del_func;
     size_t		    count;
 };
@@ -62,6 +73,40 @@ struct hashtable_itor {
     unsigned		    slot;
 };
 
+/* The layouts that dict_inline.h relies on. */
+#define SAME_OFFSET(a, b, field) (offsetof(a, field) == offsetof(b, field))
+STATIC_ASSERT(inline_node_key,
+	      SAME_OFFSET(hash_node, dict_inline_hash_node, key));
+STATIC_ASSERT(inline_node_datum,
+	      SAME_OFFSET(hash_node, dict_inline_hash_node, datum));
+STATIC_ASSERT(inline_node_next,
+	      SAME_OFFSET(hash_node, dict_inline_hash_node, next));
+STATIC_ASSERT(inline_node_hash,
+	      SAME_OFFSET(hash_node, dict_inline_hash_node, hash));
+STATIC_ASSERT(inline_table, SAME_OFFSET(hashtable, dict_inline_hashtable,
+					table));
+STATIC_ASSERT(inline_size, SAME_OFFSET(hashtable, dict_inline_hashtable,
+				       size));
+STATIC_ASSERT(inline_cmp_func, SAME_OFFSET(hashtable, dict_inline_hashtable,
+					   cmp_func));
+STATIC_ASSERT(inline_hash_func, SAME_OFFSET(hashtable, dict_inline_hashtable,
+					    hash_func));
+STATIC_ASSERT(inline_keys_only, SAME_OFFSET(hashtable, dict_inline_hashtable,
+					    keys_only));
+STATIC_ASSERT(inline_set_datum, SAME_OFFSET(hashtable, dict_inline_hashtable,
+					    set_datum));
+STATIC_ASSERT(inline_itor_table,
+	      SAME_OFFSET(hashtable_itor, dict_inline_hashtable_itor, table));
+STATIC_ASSERT(inline_itor_node,
+	      SAME_OFFSET(hashtable_itor, dict_inline_hashtable_itor, node));
+STATIC_ASSERT(inline_itor_slot,
+	      SAME_OFFSET(hashtable_itor, dict_inline_hashtable_itor, slot));
+#undef SAME_OFFSET
+
+/* A set's nodes end before the datum. */
+STATIC_ASSERT(set_node_size,
+	      offsetof(hash_node, datum) + sizeof(void*) == sizeof(hash_node));
+
 static dict_vtable hashtable_vtable = {
     (dict_inew_func)	    hashtable_dict_itor_new,
     (dict_dfree_func)	    hashtable_free,
@@ -73,6 +118,11 @@ static dict_vtable hashtable_vtable = {
     (dict_count_func)	    hashtable_count,
     (dict_verify_func)	    hashtable_verify,
     (dict_clone_func)	    hashtable_clone,
+    (dict_remove_many_func) NULL,/* hashtable_remove_many not implemented yet */
+    (dict_remove_if_func)   hashtable_remove_if,
+    (dict_mod_count_func)   NULL,/* Entries are unordered. */
+    (dict_export_func)	    hashtable_export,
+    (dict_export_all_func)  NULL,/* hashtable_export_all not implemented yet */
 };
 
 static itor_vtable hashtable_itor_vtable = {
@@ -88,7 +138,8 @@ static itor_vtable hashtable_itor_vtable = {
     (dict_key_func)	    hashtable_itor_key,
     (dict_data_func)	    hashtable_itor_data,
     (dict_iremove_func)	    NULL,/* hashtable_itor_remove not implemented yet */
-    (dict_icompare_func)    NULL/* hashtable_itor_compare not implemented yet */
+    (dict_icompare_func)    NULL,/* hashtable_itor_compare not implemented yet */
+    (dict_iseek_func)	    NULL /* hashtable_itor_seek not implemented yet */
 };
 
 hashtable*
@@ -109,6 +160,8 @@ hashtable_new(dict_compare_func cmp_func, dict_hash_func hash_func,
 	table->size = size;
 	table->cmp_func = cmp_func ? cmp_func : dict_ptr_cmp;
 	table->hash_func = hash_func;
+	table->keys_only = false;
+	table->set_datum = NULL;
 	table->del_func = del_func;
 	table->count = 0;
     }
@@ -123,20 +176,24 @@ hashtable_clone(hashtable* table, dict_key_datum_clone_func clone_func)
     hashtable* clone = hashtable_new(table->cmp_func, table->hash_func,
 				     table->del_func, table->size);
     if (clone) {
+	clone->keys_only = table->keys_only;
 	clone->count = table->count;
 	for (unsigned slot = 0; slot < table->size; ++slot) {
 	    hash_node* prev = NULL;
 	    hash_node* node = table->table[slot];
 	    for (; node; node = node->next) {
-		hash_node* add = MALLOC(sizeof(*add));
+		hash_node* add = MALLOC(SET_NODE_SIZE(table, sizeof(*add)));
 		if (!add) {
 		    hashtable_free(clone);
 		    return NULL;
 		}
 		add->key = node->key;
-		add->datum = node->datum;
+		void* datum = DICT_SET_MEMBER;
+		if (!table->keys_only)
+		    add->datum = node->datum;
 		if (clone_func)
-		    clone_func(&add->key, &add->datum);
+		    clone_func(&add->key,
+			       table->keys_only ? &datum : &add->datum);
 		add->next = NULL;
 		add->prev = prev;
 		if (prev)
@@ -171,6 +228,32 @@ hashtable_dict_new(dict_compare_func cmp_func, dict_hash_func hash_func,
     return dct;
 }
 
+hashtable*
+hashtable_new_set(dict_compare_func cmp_func, dict_hash_func hash_func,
+		  dict_delete_func del_func, unsigned size)
+{
+    hashtable* table = hashtable_new(cmp_func, hash_func, del_func, size);
+    if (table)
+	table->keys_only = true;
+    return table;
+}
+
+dict*
+hashtable_dict_new_set(dict_compare_func cmp_func, dict_hash_func hash_func,
+		       dict_delete_func del_func, unsigned size)
+{
+    dict* dct = MALLOC(sizeof(*dct));
+    if (dct) {
+	dct->_object = hashtable_new_set(cmp_func, hash_func, del_func, size);
+	if (!dct->_object) {
+	    FREE(dct);
+	    return NULL;
+	}
+	dct->_vtable = &hashtable_vtable;
+    }
+    return dct;
+}
+
 size_t
 hashtable_free(hashtable* table)
 {
@@ -182,11 +265,29 @@ hashtable_free(hashtable* table)
     return count;
 }
 
+/* Return the number of nodes in the chain for |key| that are visited to find
+ * it, or to find that it is not in the table. */
+static size_t
+chain_depth(const hashtable* table, const void* key)
+{
+    const unsigned hash = table->hash_func(key);
+    size_t depth = 0;
+    for (const hash_node* node = table->table[hash % table->size];
+	 node && hash >= node->hash; node = node->next) {
+	++depth;
+	if (hash == node->hash && table->cmp_func(key, node->key) == 0)
+	    break;
+    }
+    return depth;
+}
+
 void**
 hashtable_insert(hashtable* table, void* key, bool* inserted)
 {
     ASSERT(table != NULL);
 
+    size_t depth = TRACE_DEPTH(insert, chain_depth(table, key));
+
     const unsigned hash = table->hash_func(key);
     const unsigned mhash = hash % table->size;
     hash_node* node = table->table[mhash];
@@ -195,21 +296,24 @@ hashtable_insert(hashtable* table, void* key, bool* inserted)
 	if (hash == node->hash && table->cmp_func(key, node->key) == 0) {
 	    if (inserted)
 		*inserted = false;
-	    return &node->datum;
+	    TRACE_OP(insert, "hashtable", table, key, depth, 0);
+	    return NODE_DATUM_SLOT(table, node);
 	}
 	prev = node;
 	node = node->next;
     }
 
-    hash_node* add = MALLOC(sizeof(*add));
+    hash_node* add = MALLOC(SET_NODE_SIZE(table, sizeof(*add)));
     if (!add) {
+	TRACE_OP(insert, "hashtable", table, key, depth, -1);
 	return NULL;
     }
     if (inserted)
 	*inserted = true;
 
     add->key = key;
-    add->datum = NULL;
+    if (!table->keys_only)
+	add->datum = NULL;
     add->hash = hash;
     add->prev = prev;
     if (prev)
@@ -221,7 +325,8 @@ hashtable_insert(hashtable* table, void* key, bool* inserted)
 	node->prev = add;
 
     table->count++;
-    return &add->datum;
+    TRACE_OP(insert, "hashtable", table, key, depth, 1);
+    return NODE_DATUM_SLOT(table, add);
 }
 
 void*
@@ -229,13 +334,18 @@ hashtable_search(hashtable* table, const void* key)
 {
     ASSERT(table != NULL);
 
+    size_t depth = TRACE_DEPTH(search, chain_depth(table, key));
+
     const unsigned hash = table->hash_func(key);
     hash_node* node = table->table[hash % table->size];
     while (node && hash >= node->hash) {
-	if (hash == node->hash && table->cmp_func(key, node->key) == 0)
-	    return node->datum;
+	if (hash == node->hash && table->cmp_func(key, node->key) == 0) {
+	    TRACE_OP(search, "hashtable", table, key, depth, 1);
+	    return NODE_DATUM(table, node);
+	}
 	node = node->next;
     }
+    TRACE_OP(search, "hashtable", table, key, depth, 0);
     return NULL;
 }
 
@@ -244,6 +354,8 @@ hashtable_remove(hashtable* table, const void* key)
 {
     ASSERT(table != NULL);
 
+    size_t depth = TRACE_DEPTH(remove, chain_depth(table, key));
+
     const unsigned hash = table->hash_func(key);
     const unsigned mhash = hash % table->size;
 
@@ -260,18 +372,53 @@ hashtable_remove(hashtable* table, const void* key)
 		node->next->prev = prev;
 
 	    if (table->del_func)
-		table->del_func(node->key, node->datum);
+		table->del_func(node->key, NODE_DEL_DATUM(table, node));
 
 	    FREE(node);
 	    table->count--;
+	    TRACE_OP(remove, "hashtable", table, key, depth, 1);
 	    return true;
 	}
 	prev = node;
 	node = node->next;
     }
+    TRACE_OP(remove, "hashtable", table, key, depth, 0);
     return false;
 }
 
+size_t
+hashtable_remove_if(hashtable* table, dict_predicate_func pred, void* ctx)
+{
+    ASSERT(table != NULL);
+    ASSERT(pred != NULL);
+
+    size_t removed = 0;
+    for (unsigned slot = 0; slot < table->size; slot++) {
+	hash_node* prev = NULL;
+	hash_node* node = table->table[slot];
+	while (node) {
+	    hash_node* next = node->next;
+	    if (pred(node->key, NODE_DATUM(table, node), ctx)) {
+		if (prev)
+		    prev->next = next;
+		else
+		    table->table[slot] = next;
+		if (next)
+		    next->prev = prev;
+		if (table->del_func)
+		    table->del_func(node->key, NODE_DEL_DATUM(table, node));
+		FREE(node);
+		removed++;
+	    } else {
+		prev = node;
+	    }
+	    node = next;
+	}
+    }
+    table->count -= removed;
+    return removed;
+}
+
 size_t
 hashtable_clear(hashtable* table)
 {
@@ -282,7 +429,7 @@ hashtable_clear(hashtable* table)
 	while (node != NULL) {
 	    hash_node* next = node->next;
 	    if (table->del_func)
-		table->del_func(node->key, node->datum);
+		table->del_func(node->key, NODE_DEL_DATUM(table, node));
 	    FREE(node);
 	    node = next;
 	}
@@ -304,12 +451,48 @@ hashtable_traverse(hashtable* table, dict_visit_func visit)
     for (unsigned i = 0; i < table->size; i++)
 	for (hash_node* node = table->table[i]; node; node = node->next) {
 	    ++count;
-	    if (!visit(node->key, node->datum))
+	    if (!visit(node->key, NODE_DATUM(table, node)))
 		return count;
 	}
     return count;
 }
 
+size_t
+hashtable_export(hashtable* table, void** keys, void** data, size_t max,
+		 dict_export_pos* pos)
+{
+    ASSERT(table != NULL);
+    ASSERT(pos != NULL);
+
+    /* The slot to resume in is that of the next node. */
+    hash_node* node = pos->node;
+    unsigned slot = 0;
+    if (node)
+	slot = node->hash % table->size;
+    else if (pos->index)
+	return 0;
+    size_t n = 0;
+    for (; slot < table->size; slot++, node = NULL) {
+	if (!node)
+	    node = table->table[slot];
+	for (; node; node = node->next) {
+	    if (n == max) {
+		pos->index += n;
+		pos->node = node;
+		return n;
+	    }
+	    if (keys)
+		keys[n] = node->key;
+	    if (data)
+		data[n] = NODE_DATUM(table, node);
+	    n++;
+	}
+    }
+    pos->index += n;
+    pos->node = NULL;
+    return n;
+}
+
 size_t
 hashtable_count(const hashtable* table)
 {
@@ -377,6 +560,7 @@ hashtable_resize(hashtable* table, unsigned new_size)
 	}
     }
 
+    TRACE_RESIZE(table, table->size, new_size);
     FREE(table->table);
     table->table = ntable;
     table->size = new_size;
@@ -583,6 +767,7 @@ hashtable_itor_search(hashtable_itor* itor, const void* key)
 	    itor->slot = mhash;
 	    return true;
 	}
+	node = node->next;
     }
     itor->node = NULL;
     itor->slot = 0;
@@ -602,5 +787,891 @@ hashtable_itor_data(hashtable_itor* itor)
 {
     ASSERT(itor != NULL);
 
-    return itor->node ? &itor->node->datum : NULL;
+    return itor->node ? NODE_DATUM_SLOT(itor->table, itor->node) : NULL;
+}
+
+/*
+ * A frozen table places the first entry with each distinct hash value by a
+ * minimal perfect hash in the manner of PTHash: the hash values are spread
+ * over buckets of a few each, and each bucket gets a pilot, found by trial,
+ * that sends its hash values to free slots when mixed with them. The largest
+ * buckets are placed first, while most slots are free. A lookup mixes the
+ * hash value of the key, reads the pilot of its bucket, and so finds the one
+ * slot where the key can be. So that few pilots need many trials, the pilots
+ * choose among a few percent more positions than there are slots; the entries
+ * placed past the last slot are moved into the slots left empty, through a
+ * table consulted only for those positions. Entries with a hash value already
+ * placed follow the slots, sorted by hash value.
+ *
+ * Each entry holds the hash value and datum, followed by a pointer to the key
+ * or, in a table loaded from a file, the bytes of the key. The file is laid
+ * out as the table is in memory: a header, the pilots, the remapped
+ * positions, then the entries.
+ */
+
+#define FROZEN_MAGIC	    0x7a6f726674636964ULL	/* "dictfroz" */
+#define FROZEN_VERSION	    1
+#define FROZEN_BUCKET_SIZE  4	    /* Hash values per bucket, on average. */
+#define FROZEN_SPARE	    32	    /* One spare position per this many. */
+#define FROZEN_ALIGN	    64	    /* Of the entries in a file. */
+#define FROZEN_SEED	    0x9e3779b97f4a7c15ULL
+
+typedef struct {
+    unsigned		    hash;
+    unsigned		    dups;	/* Entries with this hash follow the
+					 * slots. */
+    void*		    datum;
+    /* The key, or a pointer to it, follows. */
+} frozen_entry;
+
+typedef struct {
+    uint64_t		    magic;
+    uint32_t		    version;
+    uint32_t		    ptr_size;
+    uint64_t		    key_size;
+    uint64_t		    count;
+    uint64_t		    slots;
+    uint64_t		    buckets;
+    uint64_t		    range;
+    uint64_t		    seed;
+} frozen_header;
+
+struct hashtable_frozen {
+    unsigned char*	    entries;
+    size_t		    stride;	/* Bytes per entry. */
+    size_t		    count;
+    size_t		    slots;	/* Entries placed by the perfect hash. */
+    size_t		    range;	/* Positions the pilots choose among. */
+    uint32_t*		    pilots;
+    uint64_t*		    remap;	/* Slots of the positions past them. */
+    size_t		    buckets;
+    uint64_t		    seed;
+    size_t		    key_size;	/* Of keys stored in the entries, or 0. */
+    dict_compare_func	    cmp_func;
+    dict_hash_func	    hash_func;
+    dict_delete_func	    del_func;
+    bool		    keys_only;	/* Frozen from a set. */
+    void*		    map;	/* The file mapping, if loaded. */
+    size_t		    map_size;
+};
+
+struct hashtable_frozen_itor {
+    hashtable_frozen*	    frozen;
+    size_t		    pos;
+};
+
+#define POS_NONE	    ((size_t)-1)
+#define ENTRY(f, i) \
+    ((frozen_entry*)((f)->entries + (size_t)(i) * (f)->stride))
+
+static dict_vtable hashtable_frozen_vtable = {
+    (dict_inew_func)	    hashtable_frozen_dict_itor_new,
+    (dict_dfree_func)	    hashtable_frozen_free,
+    (dict_insert_func)	    hashtable_frozen_insert,
+    (dict_search_func)	    hashtable_frozen_search,
+    (dict_remove_func)	    hashtable_frozen_remove,
+    (dict_clear_func)	    hashtable_frozen_clear,
+    (dict_traverse_func)    hashtable_frozen_traverse,
+    (dict_count_func)	    hashtable_frozen_count,
+    (dict_verify_func)	    hashtable_frozen_verify,
+    (dict_clone_func)	    hashtable_frozen_clone,
+    (dict_remove_many_func) NULL,/* Nothing can be removed. */
+    (dict_remove_if_func)   NULL,/* Nothing can be removed. */
+    (dict_mod_count_func)   NULL,/* Entries are unordered. */
+    (dict_export_func)	    hashtable_frozen_export,
+    (dict_export_all_func)  NULL,/* Copying an array needs no threads. */
+};
+
+static itor_vtable hashtable_frozen_itor_vtable = {
+    (dict_ifree_func)	    hashtable_frozen_itor_free,
+    (dict_valid_func)	    hashtable_frozen_itor_valid,
+    (dict_invalidate_func)  hashtable_frozen_itor_invalidate,
+    (dict_next_func)	    hashtable_frozen_itor_next,
+    (dict_prev_func)	    hashtable_frozen_itor_prev,
+    (dict_nextn_func)	    hashtable_frozen_itor_nextn,
+    (dict_prevn_func)	    hashtable_frozen_itor_prevn,
+    (dict_first_func)	    hashtable_frozen_itor_first,
+    (dict_last_func)	    hashtable_frozen_itor_last,
+    (dict_key_func)	    hashtable_frozen_itor_key,
+    (dict_data_func)	    hashtable_frozen_itor_data,
+    (dict_iremove_func)	    NULL,/* Nothing can be removed. */
+    (dict_icompare_func)    NULL,/* Entries are unordered. */
+    (dict_iseek_func)	    NULL /* Entries are unordered. */
+};
+
+static GCC_INLINE uint64_t
+mix64(uint64_t x)
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+/* Maps the top or bottom 32 bits of |x| onto [0, n) without a division. */
+#define RANGE_HI(x, n)	    ((size_t)(((x) >> 32) * (uint64_t)(n) >> 32))
+#define RANGE_LO(x, n)	    ((size_t)(((x) & 0xffffffffU) * (uint64_t)(n) >> 32))
+
+/* Returns the position, in [0, range), that a pilot sends a hash value to,
+ * given both mixed by mix64(). Mixing them again keeps any two hash values
+ * of a bucket apart under some pilot, however close they are. */
+static GCC_INLINE size_t
+frozen_position(const hashtable_frozen* frozen, uint64_t mixed,
+		uint64_t pilot_mixed)
+{
+    return RANGE_LO(mix64(mixed ^ pilot_mixed), frozen->range);
+}
+
+static GCC_INLINE size_t
+frozen_slot(const hashtable_frozen* frozen, uint64_t mixed)
+{
+    const uint32_t pilot = frozen->pilots[RANGE_HI(mixed, frozen->buckets)];
+    const size_t pos = frozen_position(frozen, mixed, mix64(pilot));
+    return pos < frozen->slots ? pos : frozen->remap[pos - frozen->slots];
+}
+
+static GCC_INLINE const void*
+entry_key(const hashtable_frozen* frozen, const frozen_entry* entry)
+{
+    return frozen->key_size ? (const void*)(entry + 1)
+			    : *(void* const*)(entry + 1);
+}
+
+/* Returns the entry holding |key|, which hashes to |hash|, or NULL. */
+static frozen_entry*
+frozen_find(const hashtable_frozen* frozen, const void* key, unsigned hash)
+{
+    if (frozen->slots == 0)
+	return NULL;
+    frozen_entry* entry =
+	ENTRY(frozen, frozen_slot(frozen, mix64(hash + frozen->seed)));
+    if (entry->hash != hash)
+	return NULL;
+    if (frozen->cmp_func(key, entry_key(frozen, entry)) == 0)
+	return entry;
+    if (!entry->dups)
+	return NULL;
+    /* Find the first entry after the slots with the hash value. */
+    size_t lo = frozen->slots, hi = frozen->count;
+    while (lo < hi) {
+	const size_t mid = lo + (hi - lo) / 2;
+	if (ENTRY(frozen, mid)->hash < hash)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+    for (; lo < frozen->count && (entry = ENTRY(frozen, lo))->hash == hash;
+	 lo++)
+	if (frozen->cmp_func(key, entry_key(frozen, entry)) == 0)
+	    return entry;
+    return NULL;
+}
+
+typedef struct {
+    uint64_t		    mixed;
+    hash_node*		    node;
+} frozen_item;
+
+static int
+node_hash_cmp(const void* a, const void* b)
+{
+    const unsigned x = (*(hash_node* const*)a)->hash;
+    const unsigned y = (*(hash_node* const*)b)->hash;
+    return (x > y) - (x < y);
+}
+
+/* Finds pilots placing the |nslots| items, which have distinct hash values,
+ * into distinct slots, and stores each item's slot in place of its mixed hash
+ * value. Fails only if memory runs out, or if no pilot works for some bucket
+ * (which does not happen with any reasonable hash function). */
+static bool
+frozen_place(hashtable_frozen* frozen, frozen_item* items, size_t nslots)
+{
+    size_t* starts = MALLOC((frozen->buckets + 1) * sizeof(*starts));
+    size_t* order = MALLOC(frozen->buckets * sizeof(*order));
+    frozen_item* sorted = MALLOC(nslots * sizeof(*sorted));
+    bool* taken = MALLOC(frozen->range * sizeof(*taken));
+    bool ok = starts && order && sorted && taken;
+    if (ok) {
+	/* Group the items by bucket. */
+	memset(starts, 0, (frozen->buckets + 1) * sizeof(*starts));
+	for (size_t i = 0; i < nslots; i++)
+	    starts[RANGE_HI(items[i].mixed, frozen->buckets) + 1]++;
+	size_t largest = 0;
+	for (size_t b = 0; b < frozen->buckets; b++) {
+	    if (largest < starts[b + 1])
+		largest = starts[b + 1];
+	    starts[b + 1] += starts[b];
+	}
+	for (size_t i = 0; i < nslots; i++) {
+	    const size_t b = RANGE_HI(items[i].mixed, frozen->buckets);
+	    sorted[starts[b]++] = items[i];
+	}
+	for (size_t b = frozen->buckets; b > 0; b--)
+	    starts[b] = starts[b - 1];
+	starts[0] = 0;
+	/* Order the buckets from largest to smallest. */
+	size_t n = 0;
+	for (size_t size = largest; size > 0; size--)
+	    for (size_t b = 0; b < frozen->buckets; b++)
+		if (starts[b + 1] - starts[b] == size)
+		    order[n++] = b;
+	memset(taken, 0, frozen->range * sizeof(*taken));
+	memset(frozen->pilots, 0, frozen->buckets * sizeof(*frozen->pilots));
+	for (size_t k = 0; ok && k < n; k++) {
+	    const size_t b = order[k];
+	    frozen_item* first = &sorted[starts[b]];
+	    const size_t size = starts[b + 1] - starts[b];
+	    uint32_t pilot = 0;
+	    for (;; pilot++) {
+		const uint64_t pilot_mixed = mix64(pilot);
+		size_t i = 0;
+		for (; i < size; i++) {
+		    const size_t pos = frozen_position(frozen, first[i].mixed,
+						       pilot_mixed);
+		    if (taken[pos])
+			break;
+		    taken[pos] = true;
+		}
+		if (i == size)
+		    break;
+		while (i-- > 0)
+		    taken[frozen_position(frozen, first[i].mixed,
+					  pilot_mixed)] = false;
+		if (pilot == UINT32_MAX) {
+		    ok = false;
+		    break;
+		}
+	    }
+	    frozen->pilots[b] = pilot;
+	}
+	/* Send the positions past the slots to the slots left empty. */
+	size_t hole = 0;
+	for (size_t pos = nslots; ok && pos < frozen->range; pos++) {
+	    frozen->remap[pos - nslots] = 0;
+	    if (taken[pos]) {
+		while (taken[hole])
+		    hole++;
+		frozen->remap[pos - nslots] = hole++;
+	    }
+	}
+	for (size_t i = 0; ok && i < nslots; i++) {
+	    items[i].node = sorted[i].node;
+	    items[i].mixed = frozen_slot(frozen, sorted[i].mixed);
+	}
+    }
+    FREE(starts);
+    FREE(order);
+    FREE(sorted);
+    FREE(taken);
+    return ok;
+}
+
+static void
+frozen_release(hashtable_frozen* frozen)
+{
+    if (frozen->map) {
+	munmap(frozen->map, frozen->map_size);
+    } else {
+	FREE(frozen->entries);
+	FREE(frozen->pilots);
+	FREE(frozen->remap);
+    }
+    FREE(frozen);
+}
+
+hashtable_frozen*
+hashtable_freeze(hashtable* table)
+{
+    ASSERT(table != NULL);
+
+    hashtable_frozen* frozen = MALLOC(sizeof(*frozen));
+    if (!frozen)
+	return NULL;
+    frozen->count = table->count;
+    frozen->stride = sizeof(frozen_entry) + sizeof(void*);
+    frozen->seed = FROZEN_SEED;
+    frozen->key_size = 0;
+    frozen->cmp_func = table->cmp_func;
+    frozen->hash_func = table->hash_func;
+    frozen->del_func = table->del_func;
+    frozen->keys_only = table->keys_only;
+    frozen->map = NULL;
+    frozen->map_size = 0;
+
+    /* Equal hash values are adjacent in the sorted chains. The first node
+     * with each value gets a slot; the others are set aside. */
+    frozen_item* items = MALLOC((table->count + 1) * sizeof(*items));
+    hash_node** extra = MALLOC((table->count + 1) * sizeof(*extra));
+    size_t nslots = 0, nextra = 0;
+    if (items && extra) {
+	for (unsigned slot = 0; slot < table->size; slot++) {
+	    for (hash_node* node = table->table[slot]; node; node = node->next) {
+		if (node->prev && node->prev->hash == node->hash) {
+		    extra[nextra++] = node;
+		} else {
+		    items[nslots].mixed = mix64(node->hash + frozen->seed);
+		    items[nslots++].node = node;
+		}
+	    }
+	}
+    }
+    frozen->slots = nslots;
+    frozen->range = nslots + nslots / FROZEN_SPARE + 1;
+    frozen->buckets = nslots / FROZEN_BUCKET_SIZE + 1;
+    frozen->pilots = MALLOC(frozen->buckets * sizeof(*frozen->pilots));
+    frozen->remap = MALLOC((frozen->range - nslots) * sizeof(*frozen->remap));
+    frozen->entries = MALLOC((frozen->count + 1) * frozen->stride);
+    if (!items || !extra || !frozen->pilots || !frozen->remap ||
+	!frozen->entries ||
+	!frozen_place(frozen, items, nslots)) {
+	FREE(items);
+	FREE(extra);
+	frozen_release(frozen);
+	return NULL;
+    }
+
+    for (size_t i = 0; i < nslots; i++) {
+	frozen_entry* entry = ENTRY(frozen, items[i].mixed);
+	entry->hash = items[i].node->hash;
+	entry->dups = items[i].node->next &&
+		      items[i].node->next->hash == entry->hash;
+	entry->datum = NODE_DATUM(table, items[i].node);
+	*(void**)(entry + 1) = items[i].node->key;
+    }
+    qsort(extra, nextra, sizeof(*extra), node_hash_cmp);
+    for (size_t i = 0; i < nextra; i++) {
+	frozen_entry* entry = ENTRY(frozen, nslots + i);
+	entry->hash = extra[i]->hash;
+	entry->dups = 0;
+	entry->datum = NODE_DATUM(table, extra[i]);
+	*(void**)(entry + 1) = extra[i]->key;
+    }
+    FREE(items);
+    FREE(extra);
+
+    /* The entries have moved; free the nodes without deleting them. */
+    const dict_delete_func del_func = table->del_func;
+    table->del_func = NULL;
+    hashtable_clear(table);
+    table->del_func = del_func;
+    return frozen;
+}
+
+static dict*
+frozen_dict_wrap(hashtable_frozen* frozen)
+{
+    if (!frozen)
+	return NULL;
+    dict* dct = MALLOC(sizeof(*dct));
+    if (!dct) {
+	hashtable_frozen_free(frozen);
+	return NULL;
+    }
+    dct->_object = frozen;
+    dct->_vtable = &hashtable_frozen_vtable;
+    return dct;
+}
+
+dict*
+hashtable_freeze_dict(hashtable* table)
+{
+    ASSERT(table != NULL);
+
+    dict* dct = MALLOC(sizeof(*dct));
+    if (!dct)
+	return NULL;
+    if (!(dct->_object = hashtable_freeze(table))) {
+	FREE(dct);
+	return NULL;
+    }
+    dct->_vtable = &hashtable_frozen_vtable;
+    return dct;
+}
+
+size_t
+hashtable_frozen_free(hashtable_frozen* frozen)
+{
+    ASSERT(frozen != NULL);
+
+    const size_t count = hashtable_frozen_clear(frozen);
+    frozen_release(frozen);
+    return count;
+}
+
+hashtable_frozen*
+hashtable_frozen_clone(hashtable_frozen* frozen,
+		       dict_key_datum_clone_func clone_func)
+{
+    ASSERT(frozen != NULL);
+
+    hashtable_frozen* clone = MALLOC(sizeof(*clone));
+    if (!clone)
+	return NULL;
+    *clone = *frozen;
+    clone->map = NULL;
+    clone->map_size = 0;
+    const size_t spare = frozen->range - frozen->slots;
+    clone->pilots = MALLOC(frozen->buckets * sizeof(*clone->pilots));
+    clone->remap = MALLOC((spare + 1) * sizeof(*clone->remap));
+    clone->entries = MALLOC((frozen->count + 1) * frozen->stride);
+    if (!clone->pilots || !clone->remap || !clone->entries) {
+	frozen_release(clone);
+	return NULL;
+    }
+    memcpy(clone->pilots, frozen->pilots,
+	   frozen->buckets * sizeof(*clone->pilots));
+    memcpy(clone->remap, frozen->remap, spare * sizeof(*clone->remap));
+    memcpy(clone->entries, frozen->entries, frozen->count * frozen->stride);
+    if (clone_func) {
+	for (size_t i = 0; i < clone->count; i++) {
+	    frozen_entry* entry = ENTRY(clone, i);
+	    if (clone->key_size) {
+		/* The key is in the entry, and stays there. */
+		void* key = entry + 1;
+		clone_func(&key, &entry->datum);
+		ASSERT(key == entry + 1);
+	    } else {
+		clone_func((void**)(entry + 1), &entry->datum);
+	    }
+	}
+    }
+    return clone;
+}
+
+void**
+hashtable_frozen_insert(hashtable_frozen* frozen, void* key, bool* inserted)
+{
+    ASSERT(frozen != NULL);
+
+    frozen_entry* entry = frozen_find(frozen, key, frozen->hash_func(key));
+    if (!entry)
+	return NULL;
+    if (inserted)
+	*inserted = false;
+    return &entry->datum;
+}
+
+void*
+hashtable_frozen_search(hashtable_frozen* frozen, const void* key)
+{
+    ASSERT(frozen != NULL);
+
+    frozen_entry* entry = frozen_find(frozen, key, frozen->hash_func(key));
+    TRACE_OP(search, "frozen", frozen, key, 0, entry != NULL);
+    return entry ? entry->datum : NULL;
+}
+
+bool
+hashtable_frozen_remove(hashtable_frozen* frozen, const void* key)
+{
+    ASSERT(frozen != NULL);
+
+    (void)key;
+    return false;
+}
+
+size_t
+hashtable_frozen_clear(hashtable_frozen* frozen)
+{
+    ASSERT(frozen != NULL);
+
+    const size_t count = frozen->count;
+    if (frozen->del_func) {
+	for (size_t i = 0; i < count; i++) {
+	    frozen_entry* entry = ENTRY(frozen, i);
+	    frozen->del_func((void*)entry_key(frozen, entry),
+			     frozen->keys_only ? NULL : entry->datum);
+	}
+    }
+    frozen->count = 0;
+    frozen->slots = 0;
+    return count;
+}
+
+size_t
+hashtable_frozen_traverse(hashtable_frozen* frozen, dict_visit_func visit)
+{
+    ASSERT(frozen != NULL);
+    ASSERT(visit != NULL);
+
+    size_t count = 0;
+    while (count < frozen->count) {
+	const frozen_entry* entry = ENTRY(frozen, count++);
+	if (!visit(entry_key(frozen, entry), entry->datum))
+	    break;
+    }
+    return count;
+}
+
+size_t
+hashtable_frozen_export(hashtable_frozen* frozen, void** keys, void** data,
+			size_t max, dict_export_pos* pos)
+{
+    ASSERT(frozen != NULL);
+    ASSERT(pos != NULL);
+
+    size_t n = 0;
+    for (; n < max && pos->index < frozen->count; n++, pos->index++) {
+	const frozen_entry* entry = ENTRY(frozen, pos->index);
+	if (keys)
+	    keys[n] = (void*)entry_key(frozen, entry);
+	if (data)
+	    data[n] = entry->datum;
+    }
+    return n;
+}
+
+size_t
+hashtable_frozen_count(const hashtable_frozen* frozen)
+{
+    ASSERT(frozen != NULL);
+
+    return frozen->count;
+}
+
+bool
+hashtable_frozen_verify(const hashtable_frozen* frozen)
+{
+    ASSERT(frozen != NULL);
+
+    VERIFY(frozen->slots <= frozen->count);
+    VERIFY(frozen->slots <= frozen->range);
+    VERIFY(frozen->slots == 0 || frozen->buckets > 0);
+    for (size_t pos = frozen->slots; frozen->slots && pos < frozen->range;
+	 pos++)
+	VERIFY(frozen->remap[pos - frozen->slots] < frozen->slots);
+    for (size_t i = 0; i < frozen->count; i++) {
+	const frozen_entry* entry = ENTRY(frozen, i);
+	const void* key = entry_key(frozen, entry);
+	VERIFY(frozen->hash_func(key) == entry->hash);
+	VERIFY(frozen_find(frozen, key, entry->hash) == entry);
+	if (i < frozen->slots) {
+	    VERIFY(frozen_slot(frozen, mix64(entry->hash + frozen->seed)) == i);
+	} else {
+	    if (i > frozen->slots)
+		VERIFY(ENTRY(frozen, i - 1)->hash <= entry->hash);
+	    VERIFY(!entry->dups);
+	}
+    }
+    return true;
+}
+
+static bool
+write_full(int fd, const void* buf, size_t size)
+{
+    const unsigned char* p = buf;
+    while (size) {
+	ssize_t n = write(fd, p, size);
+	if (n < 0 && errno == EINTR)
+	    continue;
+	if (n <= 0)
+	    return false;
+	p += n;
+	size -= (size_t)n;
+    }
+    return true;
+}
+
+/* The offsets of the remapped positions and of the entries in a file. */
+static size_t
+frozen_remap_offset(size_t buckets)
+{
+    const size_t size = sizeof(frozen_header) + buckets * sizeof(uint32_t);
+    return (size + sizeof(uint64_t) - 1) / sizeof(uint64_t) * sizeof(uint64_t);
+}
+
+static size_t
+frozen_entries_offset(size_t buckets, size_t spare)
+{
+    const size_t size = frozen_remap_offset(buckets) +
+	spare * sizeof(uint64_t);
+    return (size + FROZEN_ALIGN - 1) / FROZEN_ALIGN * FROZEN_ALIGN;
+}
+
+bool
+hashtable_frozen_save(const hashtable_frozen* frozen, const char* path,
+		      size_t key_size)
+{
+    ASSERT(frozen != NULL);
+    ASSERT(path != NULL);
+    ASSERT(key_size > 0);
+
+    if (frozen->key_size && frozen->key_size != key_size) {
+	errno = EINVAL;
+	return false;
+    }
+    const size_t stride = sizeof(frozen_entry) +
+	(key_size + sizeof(void*) - 1) / sizeof(void*) * sizeof(void*);
+    const size_t spare = frozen->range - frozen->slots;
+    const size_t offset = frozen_entries_offset(frozen->buckets, spare);
+    /* Everything before the entries, then the entries in batches. */
+    const size_t batch = 256;
+    unsigned char* buf = MALLOC(MAX(offset, batch * stride));
+    if (!buf)
+	return false;
+    const int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+	FREE(buf);
+	return false;
+    }
+    memset(buf, 0, offset);
+    frozen_header header = {
+	FROZEN_MAGIC, FROZEN_VERSION, sizeof(void*), key_size, frozen->count,
+	frozen->slots, frozen->buckets, frozen->range, frozen->seed
+    };
+    memcpy(buf, &header, sizeof(header));
+    memcpy(buf + sizeof(header), frozen->pilots,
+	   frozen->buckets * sizeof(uint32_t));
+    memcpy(buf + frozen_remap_offset(frozen->buckets), frozen->remap,
+	   spare * sizeof(uint64_t));
+    bool ok = write_full(fd, buf, offset);
+    for (size_t i = 0; ok && i < frozen->count; i += batch) {
+	const size_t n = MIN(batch, frozen->count - i);
+	memset(buf, 0, n * stride);
+	for (size_t j = 0; j < n; j++) {
+	    const frozen_entry* entry = ENTRY(frozen, i + j);
+	    memcpy(buf + j * stride, entry, sizeof(*entry));
+	    memcpy(buf + j * stride + sizeof(*entry),
+		   entry_key(frozen, entry), key_size);
+	}
+	ok = write_full(fd, buf, n * stride);
+    }
+    FREE(buf);
+    if (close(fd) != 0)
+	ok = false;
+    return ok;
+}
+
+hashtable_frozen*
+hashtable_frozen_load(const char* path, dict_compare_func cmp_func,
+		      dict_hash_func hash_func)
+{
+    ASSERT(path != NULL);
+    ASSERT(cmp_func != NULL);
+    ASSERT(hash_func != NULL);
+
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0)
+	return NULL;
+    struct stat st;
+    frozen_header header;
+    if (fstat(fd, &st) != 0) {
+	close(fd);
+	return NULL;
+    }
+    if ((size_t)st.st_size < sizeof(header)) {
+	close(fd);
+	errno = EINVAL;
+	return NULL;
+    }
+    void* map = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE,
+		     MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+	return NULL;
+    const size_t size = (size_t)st.st_size;
+    memcpy(&header, map, sizeof(header));
+    const size_t stride = sizeof(frozen_entry) +
+	(header.key_size + sizeof(void*) - 1) / sizeof(void*) * sizeof(void*);
+    const size_t spare = header.range - header.slots;
+    bool valid = header.magic == FROZEN_MAGIC &&
+	header.version == FROZEN_VERSION && header.ptr_size == sizeof(void*) &&
+	header.key_size > 0 && header.key_size <= size &&
+	header.slots <= header.count && header.slots <= header.range &&
+	(header.slots == 0 || header.buckets > 0) &&
+	header.buckets <= size / sizeof(uint32_t) &&
+	spare <= size / sizeof(uint64_t) &&
+	header.count <= size / stride &&
+	frozen_entries_offset(header.buckets, spare) +
+	    header.count * stride <= size;
+    uint64_t* remap = NULL;
+    if (valid) {
+	/* Everything else a lookup reads is within the mapping. */
+	remap = (uint64_t*)((unsigned char*)map +
+			    frozen_remap_offset(header.buckets));
+	for (size_t i = 0; valid && header.slots && i < spare; i++)
+	    valid = remap[i] < header.slots;
+    }
+    hashtable_frozen* frozen = valid ? MALLOC(sizeof(*frozen)) : NULL;
+    if (!frozen) {
+	munmap(map, size);
+	errno = valid ? ENOMEM : EINVAL;
+	return NULL;
+    }
+    frozen->entries = (unsigned char*)map +
+	frozen_entries_offset(header.buckets, spare);
+    frozen->stride = stride;
+    frozen->count = header.count;
+    frozen->slots = header.slots;
+    frozen->range = header.range;
+    frozen->pilots = (uint32_t*)((unsigned char*)map + sizeof(header));
+    frozen->remap = remap;
+    frozen->buckets = header.buckets;
+    frozen->seed = header.seed;
+    frozen->key_size = header.key_size;
+    frozen->cmp_func = cmp_func;
+    frozen->hash_func = hash_func;
+    frozen->del_func = NULL;
+    frozen->keys_only = false;
+    frozen->map = map;
+    frozen->map_size = size;
+    return frozen;
+}
+
+dict*
+hashtable_frozen_dict_load(const char* path, dict_compare_func cmp_func,
+			   dict_hash_func hash_func)
+{
+    return frozen_dict_wrap(hashtable_frozen_load(path, cmp_func, hash_func));
+}
+
+hashtable_frozen_itor*
+hashtable_frozen_itor_new(hashtable_frozen* frozen)
+{
+    ASSERT(frozen != NULL);
+
+    hashtable_frozen_itor* itor = MALLOC(sizeof(*itor));
+    if (itor) {
+	itor->frozen = frozen;
+	itor->pos = POS_NONE;
+    }
+    return itor;
+}
+
+dict_itor*
+hashtable_frozen_dict_itor_new(hashtable_frozen* frozen)
+{
+    ASSERT(frozen != NULL);
+
+    dict_itor* itor = MALLOC(sizeof(*itor));
+    if (itor) {
+	if (!(itor->_itor = hashtable_frozen_itor_new(frozen))) {
+	    FREE(itor);
+	    return NULL;
+	}
+	itor->_vtable = &hashtable_frozen_itor_vtable;
+    }
+    return itor;
+}
+
+void
+hashtable_frozen_itor_free(hashtable_frozen_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    FREE(itor);
+}
+
+bool
+hashtable_frozen_itor_valid(const hashtable_frozen_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    return itor->pos != POS_NONE;
+}
+
+void
+hashtable_frozen_itor_invalidate(hashtable_frozen_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    itor->pos = POS_NONE;
+}
+
+bool
+hashtable_frozen_itor_next(hashtable_frozen_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    return hashtable_frozen_itor_nextn(itor, 1);
+}
+
+bool
+hashtable_frozen_itor_prev(hashtable_frozen_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    return hashtable_frozen_itor_prevn(itor, 1);
+}
+
+bool
+hashtable_frozen_itor_nextn(hashtable_frozen_itor* itor, size_t count)
+{
+    ASSERT(itor != NULL);
+
+    if (itor->pos != POS_NONE) {
+	if (count < itor->frozen->count - itor->pos)
+	    itor->pos += count;
+	else
+	    itor->pos = POS_NONE;
+    }
+    return itor->pos != POS_NONE;
+}
+
+bool
+hashtable_frozen_itor_prevn(hashtable_frozen_itor* itor, size_t count)
+{
+    ASSERT(itor != NULL);
+
+    if (itor->pos != POS_NONE) {
+	if (count <= itor->pos)
+	    itor->pos -= count;
+	else
+	    itor->pos = POS_NONE;
+    }
+    return itor->pos != POS_NONE;
+}
+
+bool
+hashtable_frozen_itor_first(hashtable_frozen_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    itor->pos = itor->frozen->count ? 0 : POS_NONE;
+    return itor->pos != POS_NONE;
+}
+
+bool
+hashtable_frozen_itor_last(hashtable_frozen_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    itor->pos = itor->frozen->count ? itor->frozen->count - 1 : POS_NONE;
+    return itor->pos != POS_NONE;
+}
+
+bool
+hashtable_frozen_itor_search(hashtable_frozen_itor* itor, const void* key)
+{
+    ASSERT(itor != NULL);
+
+    const hashtable_frozen* frozen = itor->frozen;
+    const frozen_entry* entry = frozen_find(frozen, key,
+					    frozen->hash_func(key));
+    itor->pos = entry ? (size_t)((const unsigned char*)entry -
+				 frozen->entries) / frozen->stride
+		      : POS_NONE;
+    return itor->pos != POS_NONE;
+}
+
+const void*
+hashtable_frozen_itor_key(const hashtable_frozen_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    if (itor->pos == POS_NONE)
+	return NULL;
+    return entry_key(itor->frozen, ENTRY(itor->frozen, itor->pos));
+}
+
+void**
+hashtable_frozen_itor_data(hashtable_frozen_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    return itor->pos != POS_NONE ? &ENTRY(itor->frozen, itor->pos)->datum
+				 : NULL;
 }
@@ -32,6 +32,7 @@
 
 #include "hb_tree.h"
 
+#include <string.h>
 #include "dict_private.h"
 #include "tree_common.h"
 
@@ -40,27 +41,39 @@ typedef struct hb_node hb_node;
 struct hb_node {
     TREE_NODE_FIELDS(hb_node);
     signed char		    bal;    /* TODO: store in unused low bits. */
+    void*		    datum;	/* Not allocated in a set. */
 };
 
 struct hb_tree {
     TREE_FIELDS(hb_node);
+    TREE_AGGREGATE_FIELDS(hb_node);
+    tree_layout*	    layout;
 };
 
 struct hb_itor {
     TREE_ITERATOR_FIELDS(hb_tree, hb_node);
 };
 
+/* A set's nodes end before the datum. */
+STATIC_ASSERT(set_node_size,
+	      offsetof(hb_node, datum) + sizeof(void*) == sizeof(hb_node));
+
 static dict_vtable hb_tree_vtable = {
     (dict_inew_func)	    hb_dict_itor_new,
-    (dict_dfree_func)	    tree_free,
+    (dict_dfree_func)	    hb_tree_free,
     (dict_insert_func)	    hb_tree_insert,
-    (dict_search_func)	    tree_search,
+    (dict_search_func)	    hb_tree_search,
     (dict_remove_func)	    hb_tree_remove,
-    (dict_clear_func)	    tree_clear,
+    (dict_clear_func)	    hb_tree_clear,
     (dict_traverse_func)    tree_traverse,
     (dict_count_func)	    tree_count,
     (dict_verify_func)	    hb_tree_verify,
     (dict_clone_func)	    hb_tree_clone,
+    (dict_remove_many_func) hb_tree_remove_many,
+    (dict_remove_if_func)   hb_tree_remove_if,
+    (dict_mod_count_func)   tree_mod_count,
+    (dict_export_func)	    hb_tree_export,
+    (dict_export_all_func)  hb_tree_export_all,
 };
 
 static itor_vtable hb_tree_itor_vtable = {
@@ -76,7 +89,8 @@ static itor_vtable hb_tree_itor_vtable = {
     (dict_key_func)	    tree_iterator_key,
     (dict_data_func)	    tree_iterator_data,
     (dict_iremove_func)	    NULL,/* hb_itor_remove not implemented yet */
-    (dict_icompare_func)    NULL /* hb_itor_compare not implemented yet */
+    (dict_icompare_func)    NULL,/* hb_itor_compare not implemented yet */
+    (dict_iseek_func)	    tree_iterator_seek
 };
 
 static bool	rot_left(hb_tree* tree, hb_node* node);
@@ -84,7 +98,7 @@ static bool	rot_right(hb_tree* tree, hb_node* node);
 static size_t	node_height(const hb_node* node);
 static size_t	node_mheight(const hb_node* node);
 static size_t	node_pathlen(const hb_node* node, size_t level);
-static hb_node*	node_new(void* key);
+static hb_node*	node_new(hb_tree* tree, void* key);
 
 hb_tree*
 hb_tree_new(dict_compare_func cmp_func, dict_delete_func del_func)
@@ -94,8 +108,18 @@ hb_tree_new(dict_compare_func cmp_func, dict_delete_func del_func)
 	tree->root = NULL;
 	tree->count = 0;
 	tree->cmp_func = cmp_func ? cmp_func : dict_ptr_cmp;
+	tree->keys_only = false;
+	tree->set_datum = NULL;
+	tree->datum_offset = offsetof(hb_node, datum);
 	tree->del_func = del_func;
 	tree->rotation_count = 0;
+	tree->mod_count = 0;
+	tree->agg_func = NULL;
+	tree->agg_update = NULL;
+	tree->agg_offset = 0;
+	tree->agg_size = 0;
+	tree->agg_stale = NULL;
+	tree->layout = NULL;
     }
     return tree;
 }
@@ -114,16 +138,40 @@ hb_dict_new(dict_compare_func cmp_func, dict_delete_func del_func)
     return dct;
 }
 
+hb_tree*
+hb_tree_new_set(dict_compare_func cmp_func, dict_delete_func del_func)
+{
+    hb_tree* tree = hb_tree_new(cmp_func, del_func);
+    if (tree)
+	tree->keys_only = true;
+    return tree;
+}
+
+dict*
+hb_dict_new_set(dict_compare_func cmp_func, dict_delete_func del_func)
+{
+    dict* dct = MALLOC(sizeof(*dct));
+    if (dct) {
+	if (!(dct->_object = hb_tree_new_set(cmp_func, del_func))) {
+	    FREE(dct);
+	    return NULL;
+	}
+	dct->_vtable = &hb_tree_vtable;
+    }
+    return dct;
+}
+
 size_t
 hb_tree_free(hb_tree* tree)
 {
-    const size_t count = 0;
-    
+    size_t count = 0;
+
     ASSERT(tree != NULL);
 
     if (tree->root)
 	count = hb_tree_clear(tree);
 
+    tree_layout_free(tree->layout);
     FREE(tree);
     return count;
 }
@@ -133,7 +181,67 @@ hb_tree_clone(hb_tree* tree, dict_key_datum_clone_func clone_func)
 {
     ASSERT(tree != NULL);
 
-    return tree_clone(tree, sizeof(hb_tree), sizeof(hb_node), clone_func);
+    tree_aggregate_flush(tree, NULL);
+    hb_tree* clone = tree_clone(tree, sizeof(hb_tree),
+				tree_node_alloc_size(tree, sizeof(hb_node)),
+				clone_func);
+    if (clone) {
+	clone->layout = NULL;
+	if (clone_func)
+	    tree_aggregate_rebuild(clone, NULL);
+    }
+    return clone;
+}
+
+/* Set the balance information of a node of a rebuilt tree. */
+static void
+node_rebuild(void* Tree, void* Node, size_t depth, size_t lheight,
+	     size_t rheight)
+{
+    hb_tree* tree = Tree;
+    hb_node* node = Node;
+    (void)depth;
+
+    node->bal = (signed char)((int)rheight - (int)lheight);
+    if (tree->agg_func)
+	tree_node_aggregate(tree, NULL, node);
+}
+
+size_t
+hb_tree_remove_many(hb_tree* tree, const void** keys, size_t count)
+{
+    ASSERT(tree != NULL);
+
+    tree_aggregate_flush(tree, NULL);
+    return tree_remove_many(tree, NULL, tree->layout, keys, count,
+			    (dict_remove_func)hb_tree_remove, node_rebuild);
+}
+
+size_t
+hb_tree_remove_if(hb_tree* tree, dict_predicate_func pred, void* ctx)
+{
+    ASSERT(tree != NULL);
+
+    tree_aggregate_flush(tree, NULL);
+    return tree_remove_if(tree, NULL, tree->layout, pred, ctx,
+			  (dict_remove_func)hb_tree_remove, node_rebuild);
+}
+
+size_t
+hb_tree_export(hb_tree* tree, void** keys, void** data, size_t max,
+	       dict_export_pos* pos)
+{
+    ASSERT(tree != NULL);
+
+    return tree_export(tree, NULL, keys, data, max, pos);
+}
+
+size_t
+hb_tree_export_all(hb_tree* tree, void** keys, void** data, unsigned threads)
+{
+    ASSERT(tree != NULL);
+
+    return tree_export_all(tree, NULL, keys, data, threads);
 }
 
 size_t
@@ -154,11 +262,12 @@ hb_tree_clear(hb_tree* tree)
 	}
 
 	if (tree->del_func)
-	    tree->del_func(node->key, node->datum);
+	    tree->del_func(node->key, NODE_DEL_DATUM(tree, node));
 
 	hb_node* parent = node->parent;
-	FREE(node);
+	tree_layout_free_node(tree->layout, node);
 	tree->count--;
+	tree->mod_count++;
 
 	if (parent) {
 	    if (parent->llink == node)
@@ -170,6 +279,7 @@ hb_tree_clear(hb_tree* tree)
     }
 
     tree->root = NULL;
+    tree->agg_stale = NULL;
     ASSERT(tree->count == 0);
 
     return count;
@@ -178,7 +288,10 @@ hb_tree_clear(hb_tree* tree)
 void*
 hb_tree_search(hb_tree* tree, const void* key)
 {
-    return tree_search(tree, key);
+    size_t depth = TRACE_DEPTH(search, tree_search_depth(tree, key));
+    void* datum = tree_search(tree, key);
+    TRACE_OP(search, "hb", tree, key, depth, datum != NULL);
+    return datum;
 }
 
 void**
@@ -186,6 +299,9 @@ hb_tree_insert(hb_tree* tree, void* key, bool* inserted)
 {
     ASSERT(tree != NULL);
 
+    size_t depth = TRACE_DEPTH(insert, tree_search_depth(tree, key));
+
+    tree_aggregate_flush(tree, NULL);
     int cmp = 0;
     hb_node* node = tree->root;
     hb_node* parent = NULL;
@@ -199,14 +315,18 @@ hb_tree_insert(hb_tree* tree, void* key, bool* inserted)
 	else {
 	    if (inserted)
 		*inserted = false;
-	    return &node->datum;
+	    if (tree->agg_func)
+		tree->agg_stale = node;
+	    TRACE_OP(insert, "hb", tree, key, depth, 0);
+	    return NODE_DATUM_SLOT(tree, node);
 	}
 	if (parent->bal)
 	    q = parent;
     }
 
-    hb_node *add = node = node_new(key);
+    hb_node *add = node = node_new(tree, key);
     if (!node) {
+	TRACE_OP(insert, "hb", tree, key, depth, -1);
 	return NULL;
     }
     if (inserted)
@@ -250,7 +370,11 @@ hb_tree_insert(hb_tree* tree, void* key, bool* inserted)
 	tree->rotation_count += rotations;
     }
     ++tree->count;
-    return &add->datum;
+    tree->mod_count++;
+    if (tree->agg_func)
+	tree->agg_stale = add;
+    TRACE_OP(insert, "hb", tree, key, depth, 1);
+    return NODE_DATUM_SLOT(tree, add);
 }
 
 bool
@@ -258,6 +382,9 @@ hb_tree_remove(hb_tree* tree, const void* key)
 {
     ASSERT(tree != NULL);
 
+    size_t depth = TRACE_DEPTH(remove, tree_search_depth(tree, key));
+
+    tree_aggregate_flush(tree, NULL);
     hb_node* node = tree->root;
     hb_node* parent = NULL;
     while (node) {
@@ -269,8 +396,10 @@ hb_tree_remove(hb_tree* tree, const void* key)
 	else
 	    break;
     }
-    if (!node)
+    if (!node) {
+	TRACE_OP(remove, "hb", tree, key, depth, 0);
 	return false;
+    }
 
     if (node->llink && node->rlink) {
 	hb_node* out;
@@ -285,20 +414,23 @@ hb_tree_remove(hb_tree* tree, const void* key)
 	}
 	void* tmp;
 	SWAP(node->key, out->key, tmp);
-	SWAP(node->datum, out->datum, tmp);
+	if (!tree->keys_only)
+	    SWAP(node->datum, out->datum, tmp);
 	node = out;
 	parent = out->parent;
     }
 
     hb_node* child = node->llink ? node->llink : node->rlink;
     if (tree->del_func)
-	tree->del_func(node->key, node->datum);
-    FREE(node);
+	tree->del_func(node->key, NODE_DEL_DATUM(tree, node));
+    tree_layout_free_node(tree->layout, node);
     if (child)
 	child->parent = parent;
     if (!parent) {
 	tree->root = child;
 	tree->count--;
+	tree->mod_count++;
+	TRACE_OP(remove, "hb", tree, key, depth, 1);
 	return true;
     }
 
@@ -307,6 +439,7 @@ hb_tree_remove(hb_tree* tree, const void* key)
 	parent->llink = child;
     else
 	parent->rlink = child;
+    tree_node_aggregate_path(tree, NULL, parent);
 
     unsigned rotations = 0;
     for (;;) {
@@ -363,6 +496,8 @@ higher:
     }
     tree->rotation_count += rotations;
     tree->count--;
+    tree->mod_count++;
+    TRACE_OP(remove, "hb", tree, key, depth, 1);
     return true;
 }
 
@@ -433,16 +568,20 @@ hb_tree_pathlen(const hb_tree* tree)
 }
 
 static hb_node*
-node_new(void* key)
+node_new(hb_tree* tree, void* key)
 {
-    hb_node* node = MALLOC(sizeof(*node));
+    hb_node* node = MALLOC(tree_node_alloc_size(tree, sizeof(*node)));
     if (node) {
+	if (tree->agg_func)
+	    memset((char*)node + tree->agg_offset, 0, tree->agg_size);
 	node->key = key;
-	node->datum = NULL;
+	if (!tree->keys_only)
+	    node->datum = NULL;
 	node->parent = NULL;
 	node->llink = NULL;
 	node->rlink = NULL;
 	node->bal = 0;
+	tree_node_aggregate(tree, NULL, node);
     }
     return node;
 }
@@ -500,6 +639,8 @@ rot_left(hb_tree* tree, hb_node* node)
 
     hb_node* rlink = node->rlink;
     tree_node_rot_left(tree, node);
+    tree_node_aggregate(tree, NULL, node);
+    tree_node_aggregate(tree, NULL, rlink);
 
     bool hc = (rlink->bal != 0);
     node->bal  -= 1 + MAX(rlink->bal, 0);
@@ -527,6 +668,8 @@ rot_right(hb_tree* tree, hb_node* node)
 
     hb_node* llink = node->llink;
     tree_node_rot_right(tree, node);
+    tree_node_aggregate(tree, NULL, node);
+    tree_node_aggregate(tree, NULL, llink);
 
     bool hc = (llink->bal != 0);
     node->bal  += 1 - MIN(llink->bal, 0);
@@ -573,7 +716,56 @@ hb_tree_verify(const hb_tree* tree)
     } else {
 	VERIFY(tree->count == 0);
     }
-    return node_verify(tree, NULL, tree->root, NULL);
+    return node_verify(tree, NULL, tree->root, NULL) &&
+	   tree_aggregate_verify(tree, NULL);
+}
+
+bool
+hb_tree_set_aggregate(hb_tree* tree, dict_aggregate_func agg_func,
+		      size_t agg_size)
+{
+    ASSERT(tree != NULL);
+
+    return tree_set_aggregate(tree, sizeof(hb_node), agg_func, agg_size);
+}
+
+bool
+hb_tree_update_aggregate(hb_tree* tree, const void* key)
+{
+    ASSERT(tree != NULL);
+
+    return tree_aggregate_update(tree, NULL, key);
+}
+
+bool
+hb_tree_range_aggregate(hb_tree* tree, const void* lo, const void* hi,
+			void* result)
+{
+    ASSERT(tree != NULL);
+
+    return tree_range_aggregate(tree, NULL, lo, hi, result);
+}
+
+bool
+hb_tree_relayout(hb_tree* tree, dict_layout order)
+{
+    ASSERT(tree != NULL);
+
+    tree_aggregate_flush(tree, NULL);
+    return tree_relayout(tree, &tree->layout,
+			 tree_node_alloc_size(tree, sizeof(hb_node)), NULL,
+			 order);
+}
+
+bool
+hb_tree_relayout_step(hb_tree* tree, size_t budget)
+{
+    ASSERT(tree != NULL);
+
+    tree_aggregate_flush(tree, NULL);
+    return tree_relayout_step(tree, &tree->layout,
+			      tree_node_alloc_size(tree, sizeof(hb_node)),
+			      NULL, budget);
 }
 
 hb_itor*
@@ -727,5 +919,5 @@ hb_itor_data(hb_itor* itor)
 {
     ASSERT(itor != NULL);
 
-    return itor->node ? &itor->node->datum : NULL;
+    return itor->node ? NODE_DATUM_SLOT(itor->tree, itor->node) : NULL;
 }
@@ -0,0 +1,431 @@
+/*
+ * libdict -- interval tree implementation.
+ * cf. [Cormen, Leiserson, and Rivest 1990]
+ *
+ * Copyright (c) 2001-2011, Farooq Mela
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *    This product includes software developed by Farooq Mela.
+ * 4. Neither the name of the Farooq Mela nor the
+ *    names of contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY FAROOQ MELA ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL FAROOQ MELA BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * An interval tree is a red-black tree of intervals ordered by their lower
+ * endpoints, in which every node also records the greatest upper endpoint in
+ * its subtree. A subtree whose greatest upper endpoint lies before a query
+ * interval cannot contain an interval overlapping it, and neither can the
+ * right subtree of an interval that starts after the query interval ends, so
+ * reporting the k overlapping intervals takes O(lg N + k lg(N/k)) time.
+ *
+ * The balancing code is that of rb_tree; the greatest upper endpoint is kept
+ * in the space rb_tree sets aside for subtree aggregates.
+ */
+
+#include "iv_tree.h"
+
+#include "dict_private.h"
+#include "rb_tree_private.h"
+
+struct iv_tree {
+    rb_tree		    rb;
+};
+
+#define INTERVAL(key)	    ((const iv_interval*)(key))
+#define MAX_HI(tree,node)   (*(void**)AGG(tree, node))
+
+static dict_vtable iv_tree_vtable = {
+    (dict_inew_func)	    iv_dict_itor_new,
+    (dict_dfree_func)	    iv_tree_free,
+    (dict_insert_func)	    iv_tree_insert,
+    (dict_search_func)	    iv_tree_search,
+    (dict_remove_func)	    iv_tree_remove,
+    (dict_clear_func)	    iv_tree_clear,
+    (dict_traverse_func)    iv_tree_traverse,
+    (dict_count_func)	    iv_tree_count,
+    (dict_verify_func)	    iv_tree_verify,
+    (dict_clone_func)	    iv_tree_clone,
+    (dict_remove_many_func) NULL,/* iv_tree_remove_many not implemented yet */
+    (dict_remove_if_func)   iv_tree_remove_if,
+    (dict_mod_count_func)   tree_mod_count,
+    (dict_export_func)	    iv_tree_export,
+    (dict_export_all_func)  iv_tree_export_all,
+};
+
+static void
+max_update(rb_tree* tree, rb_node* node)
+{
+    void* max = INTERVAL(node->key)->hi;
+    if (node->llink != RB_NULL &&
+	tree->cmp_func(MAX_HI(tree, node->llink), max) > 0)
+	max = MAX_HI(tree, node->llink);
+    if (RLINK(node) != RB_NULL &&
+	tree->cmp_func(MAX_HI(tree, RLINK(node)), max) > 0)
+	max = MAX_HI(tree, RLINK(node));
+    MAX_HI(tree, node) = max;
+}
+
+static int
+interval_cmp(const rb_tree* tree, const void* a, const void* b)
+{
+    int cmp = tree->cmp_func(INTERVAL(a)->lo, INTERVAL(b)->lo);
+    return cmp ? cmp : tree->cmp_func(INTERVAL(a)->hi, INTERVAL(b)->hi);
+}
+
+iv_tree*
+iv_tree_new(dict_compare_func cmp_func, dict_delete_func del_func)
+{
+    iv_tree* tree = MALLOC(sizeof(*tree));
+    if (tree) {
+	tree->rb.root = RB_NULL;
+	tree->rb.count = 0;
+	tree->rb.cmp_func = cmp_func ? cmp_func : dict_ptr_cmp;
+	tree->rb.keys_only = false;
+	tree->rb.set_datum = NULL;
+	tree->rb.datum_offset = offsetof(rb_node, datum);
+	tree->rb.del_func = del_func;
+	tree->rb.rotation_count = 0;
+	tree->rb.mod_count = 0;
+	tree->rb.agg_func = NULL;
+	tree->rb.agg_update = (tree_update_func)max_update;
+	tree->rb.agg_offset = TREE_AGGREGATE_OFFSET(sizeof(rb_node));
+	tree->rb.agg_size = sizeof(void*);
+	tree->rb.agg_stale = NULL;
+	tree->rb.layout = NULL;
+	tree->rb.pending = NULL;
+    }
+    return tree;
+}
+
+dict*
+iv_dict_new(dict_compare_func cmp_func, dict_delete_func del_func)
+{
+    dict* dct = MALLOC(sizeof(*dct));
+    if (dct) {
+	if (!(dct->_object = iv_tree_new(cmp_func, del_func))) {
+	    FREE(dct);
+	    return NULL;
+	}
+	dct->_vtable = &iv_tree_vtable;
+    }
+    return dct;
+}
+
+size_t
+iv_tree_free(iv_tree* tree)
+{
+    ASSERT(tree != NULL);
+
+    return rb_tree_free(&tree->rb);
+}
+
+iv_tree*
+iv_tree_clone(iv_tree* tree, dict_key_datum_clone_func clone_func)
+{
+    ASSERT(tree != NULL);
+
+    return (iv_tree*)rb_tree_clone(&tree->rb, clone_func);
+}
+
+/* Return the number of nodes |key| is compared with to find it, or to find
+ * that it is not in the tree. */
+static size_t
+node_depth(iv_tree* tree, const void* key)
+{
+    size_t depth = 0;
+    for (rb_node* node = tree->rb.root; node != RB_NULL; ) {
+	++depth;
+	int cmp = interval_cmp(&tree->rb, key, node->key);
+	if (cmp < 0)
+	    node = node->llink;
+	else if (cmp)
+	    node = RLINK(node);
+	else
+	    break;
+    }
+    return depth;
+}
+
+void**
+iv_tree_insert(iv_tree* tree, void* key, bool* inserted)
+{
+    ASSERT(tree != NULL);
+    ASSERT(tree->rb.cmp_func(INTERVAL(key)->lo, INTERVAL(key)->hi) <= 0);
+
+    size_t depth = TRACE_DEPTH(insert, node_depth(tree, key));
+
+    tree_aggregate_flush(&tree->rb, RB_NULL);
+    int cmp = 0;
+    rb_node* node = tree->rb.root;
+    rb_node* parent = RB_NULL;
+    while (node != RB_NULL) {
+	cmp = interval_cmp(&tree->rb, key, node->key);
+	if (cmp < 0)
+	    parent = node, node = node->llink;
+	else if (cmp)
+	    parent = node, node = RLINK(node);
+	else {
+	    if (inserted)
+		*inserted = false;
+	    TRACE_OP(insert, "iv", tree, key, depth, 0);
+	    return &node->datum;
+	}
+    }
+
+    if (!(node = rb_tree_insert_node(&tree->rb, parent, cmp, key))) {
+	TRACE_OP(insert, "iv", tree, key, depth, -1);
+	return NULL;
+    }
+    if (inserted)
+	*inserted = true;
+    TRACE_OP(insert, "iv", tree, key, depth, 1);
+    return &node->datum;
+}
+
+static rb_node*
+node_search(iv_tree* tree, const void* key)
+{
+    rb_node* node = tree->rb.root;
+    while (node != RB_NULL) {
+	int cmp = interval_cmp(&tree->rb, key, node->key);
+	if (cmp < 0)
+	    node = node->llink;
+	else if (cmp)
+	    node = RLINK(node);
+	else
+	    break;
+    }
+    return node;
+}
+
+void*
+iv_tree_search(iv_tree* tree, const void* key)
+{
+    ASSERT(tree != NULL);
+
+    size_t depth = TRACE_DEPTH(search, node_depth(tree, key));
+    rb_node* node = node_search(tree, key);
+    TRACE_OP(search, "iv", tree, key, depth, node != RB_NULL);
+    return node != RB_NULL ? node->datum : NULL;
+}
+
+bool
+iv_tree_remove(iv_tree* tree, const void* key)
+{
+    ASSERT(tree != NULL);
+
+    size_t depth = TRACE_DEPTH(remove, node_depth(tree, key));
+
+    tree_aggregate_flush(&tree->rb, RB_NULL);
+    rb_node* node = node_search(tree, key);
+    if (node == RB_NULL) {
+	TRACE_OP(remove, "iv", tree, key, depth, 0);
+	return false;
+    }
+    rb_tree_remove_node(&tree->rb, node);
+    TRACE_OP(remove, "iv", tree, key, depth, 1);
+    return true;
+}
+
+size_t
+iv_tree_remove_if(iv_tree* tree, dict_predicate_func pred, void* ctx)
+{
+    ASSERT(tree != NULL);
+
+    tree_aggregate_flush(&tree->rb, RB_NULL);
+    return tree_remove_if(&tree->rb, RB_NULL, tree->rb.layout, pred, ctx,
+			  (dict_remove_func)iv_tree_remove,
+			  rb_tree_rebuild_node);
+}
+
+size_t
+iv_tree_clear(iv_tree* tree)
+{
+    ASSERT(tree != NULL);
+
+    return rb_tree_clear(&tree->rb);
+}
+
+size_t
+iv_tree_traverse(iv_tree* tree, dict_visit_func visit)
+{
+    ASSERT(tree != NULL);
+
+    return rb_tree_traverse(&tree->rb, visit);
+}
+
+size_t
+iv_tree_export(iv_tree* tree, void** keys, void** data, size_t max,
+	       dict_export_pos* pos)
+{
+    ASSERT(tree != NULL);
+
+    return tree_export(&tree->rb, RB_NULL, keys, data, max, pos);
+}
+
+size_t
+iv_tree_export_all(iv_tree* tree, void** keys, void** data, unsigned threads)
+{
+    ASSERT(tree != NULL);
+
+    return tree_export_all(&tree->rb, RB_NULL, keys, data, threads);
+}
+
+size_t
+iv_tree_count(const iv_tree* tree)
+{
+    ASSERT(tree != NULL);
+
+    return rb_tree_count(&tree->rb);
+}
+
+size_t
+iv_tree_height(const iv_tree* tree)
+{
+    ASSERT(tree != NULL);
+
+    return rb_tree_height(&tree->rb);
+}
+
+size_t
+iv_tree_mheight(const iv_tree* tree)
+{
+    ASSERT(tree != NULL);
+
+    return rb_tree_mheight(&tree->rb);
+}
+
+size_t
+iv_tree_pathlen(const iv_tree* tree)
+{
+    ASSERT(tree != NULL);
+
+    return rb_tree_pathlen(&tree->rb);
+}
+
+const void*
+iv_tree_min(const iv_tree* tree)
+{
+    ASSERT(tree != NULL);
+
+    return rb_tree_min(&tree->rb);
+}
+
+const void*
+iv_tree_max(const iv_tree* tree)
+{
+    ASSERT(tree != NULL);
+
+    return rb_tree_max(&tree->rb);
+}
+
+static bool
+node_overlaps(rb_tree* tree, rb_node* node, const void* lo, const void* hi,
+	      dict_visit_func visit, size_t* count)
+{
+    /* No interval in this subtree ends at or after |lo|. */
+    if (node == RB_NULL || tree->cmp_func(MAX_HI(tree, node), lo) < 0)
+	return true;
+    if (!node_overlaps(tree, node->llink, lo, hi, visit, count))
+	return false;
+    /* Neither this interval nor any to its right starts by |hi|. */
+    if (tree->cmp_func(INTERVAL(node->key)->lo, hi) > 0)
+	return true;
+    if (tree->cmp_func(INTERVAL(node->key)->hi, lo) >= 0) {
+	++*count;
+	if (!visit(node->key, node->datum))
+	    return false;
+    }
+    return node_overlaps(tree, RLINK(node), lo, hi, visit, count);
+}
+
+size_t
+iv_tree_overlaps(iv_tree* tree, const void* lo, const void* hi,
+		 dict_visit_func visit)
+{
+    ASSERT(tree != NULL);
+    ASSERT(visit != NULL);
+
+    tree_aggregate_flush(&tree->rb, RB_NULL);
+    size_t count = 0;
+    node_overlaps(&tree->rb, tree->rb.root, lo, hi, visit, &count);
+    return count;
+}
+
+size_t
+iv_tree_stab(iv_tree* tree, const void* point, dict_visit_func visit)
+{
+    ASSERT(tree != NULL);
+
+    return iv_tree_overlaps(tree, point, point, visit);
+}
+
+static bool
+node_verify(const rb_tree* tree, rb_node* node)
+{
+    if (node == RB_NULL)
+	return true;
+
+    VERIFY(tree->cmp_func(INTERVAL(node->key)->lo,
+			  INTERVAL(node->key)->hi) <= 0);
+    if (node->llink != RB_NULL) {
+	VERIFY(interval_cmp(tree, node->llink->key, node->key) < 0);
+    }
+    if (RLINK(node) != RB_NULL) {
+	VERIFY(interval_cmp(tree, node->key, RLINK(node)->key) < 0);
+    }
+    if (!node_verify(tree, node->llink) || !node_verify(tree, RLINK(node)))
+	return false;
+
+    /* Verify that the greatest upper endpoint in the subtree is recorded. */
+    void* max = INTERVAL(node->key)->hi;
+    if (node->llink != RB_NULL &&
+	tree->cmp_func(MAX_HI(tree, node->llink), max) > 0)
+	max = MAX_HI(tree, node->llink);
+    if (RLINK(node) != RB_NULL &&
+	tree->cmp_func(MAX_HI(tree, RLINK(node)), max) > 0)
+	max = MAX_HI(tree, RLINK(node));
+    VERIFY(tree->cmp_func(MAX_HI(tree, node), max) == 0);
+    return true;
+}
+
+bool
+iv_tree_verify(const iv_tree* tree)
+{
+    ASSERT(tree != NULL);
+
+    if (!rb_tree_verify(&tree->rb))
+	return false;
+    /* The last insert leaves its path stale until the next operation. */
+    tree_aggregate_flush((rb_tree*)&tree->rb, RB_NULL);
+    return node_verify(&tree->rb, tree->rb.root);
+}
+
+dict_itor*
+iv_dict_itor_new(iv_tree* tree)
+{
+    ASSERT(tree != NULL);
+
+    return rb_dict_itor_new(&tree->rb);
+}
@@ -0,0 +1,818 @@
+/*
+ * libdict -- static k-ary search tree implementation.
+ *
+ * Copyright (c) 2001-2011, Farooq Mela
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *    This product includes software developed by Farooq Mela.
+ * 4. Neither the name of the Farooq Mela nor the
+ *    names of contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY FAROOQ MELA ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL FAROOQ MELA BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * The keys are stored in the leaves, which are the last level of nodes, in
+ * order and padded out to a whole node with the greatest key value. Every
+ * other node holds |lanes| separators for its |lanes| + 1 children: the
+ * greatest key under each child but the last. The number of separators less
+ * than the key sought is then the child to descend into, and at a leaf, the
+ * position of the first key not less than it. Levels are stored root first,
+ * each left to right, so that node j of a level has children j * (lanes + 1)
+ * onwards on the next.
+ *
+ * Keys are stored with their top bit flipped, which maps their unsigned order
+ * onto signed order, since vector instructions only compare signed integers.
+ * Counting the separators less than the key is then a vector comparison, a
+ * mask of its results and a count of the bits set in the mask.
+ */
+
+#include "kary_index.h"
+
+#include <string.h>	    /* For memcpy() */
+#include "dict_private.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+# define KARY_X86
+# include <immintrin.h>
+# define TARGET(isa)	    __attribute__((__target__(isa)))
+#endif
+
+#define KARY_NODE_SIZE	    64	    /* A cache line. */
+#define KARY_MAX_HEIGHT	    32
+
+#define FLIP32(k)	    ((int32_t)((uint32_t)(k) ^ 0x80000000U))
+#define FLIP64(k)	    ((int64_t)((uint64_t)(k) ^ 0x8000000000000000ULL))
+
+struct kary_index {
+    unsigned char*	    nodes;	/* Aligned to a cache line. */
+    void*		    block;	/* The allocation holding the nodes. */
+    void**		    data;
+    size_t		    count;
+    unsigned		    width;	/* Bytes per key: 4 or 8. */
+    unsigned		    lanes;	/* Keys per node. */
+    unsigned		    height;	/* Levels above the leaves. */
+    size_t		    levels[KARY_MAX_HEIGHT + 1];    /* First nodes. */
+    dict_delete_func	    del_func;
+    size_t		    (*lower_bound)(const kary_index*, uintptr_t);
+};
+
+#define POS_NONE	    ((size_t)-1)
+
+struct kary_itor {
+    kary_index*		    index;
+    size_t		    pos;
+};
+
+static dict_vtable kary_index_vtable = {
+    (dict_inew_func)	    kary_dict_itor_new,
+    (dict_dfree_func)	    kary_index_free,
+    (dict_insert_func)	    kary_index_insert,
+    (dict_search_func)	    kary_index_search,
+    (dict_remove_func)	    kary_index_remove,
+    (dict_clear_func)	    kary_index_clear,
+    (dict_traverse_func)    kary_index_traverse,
+    (dict_count_func)	    kary_index_count,
+    (dict_verify_func)	    kary_index_verify,
+    (dict_clone_func)	    kary_index_clone,
+    (dict_remove_many_func) NULL,/* Nothing can be removed. */
+    (dict_remove_if_func)   NULL,/* Nothing can be removed. */
+    (dict_mod_count_func)   kary_index_count,/* Only a clear changes it. */
+    (dict_export_func)	    kary_index_export,
+    (dict_export_all_func)  NULL,/* kary_index_export_all not implemented yet */
+};
+
+static itor_vtable kary_itor_vtable = {
+    (dict_ifree_func)	    kary_itor_free,
+    (dict_valid_func)	    kary_itor_valid,
+    (dict_invalidate_func)  kary_itor_invalidate,
+    (dict_next_func)	    kary_itor_next,
+    (dict_prev_func)	    kary_itor_prev,
+    (dict_nextn_func)	    kary_itor_nextn,
+    (dict_prevn_func)	    kary_itor_prevn,
+    (dict_first_func)	    kary_itor_first,
+    (dict_last_func)	    kary_itor_last,
+    (dict_key_func)	    kary_itor_key,
+    (dict_data_func)	    kary_itor_data,
+    (dict_iremove_func)	    NULL,/* Nothing can be removed. */
+    (dict_icompare_func)    NULL,/* kary_itor_compare not implemented */
+    (dict_iseek_func)	    kary_itor_seek
+};
+
+/* Each of these returns the number of the separators in a node less than
+ * |x|, both flipped. */
+static GCC_INLINE unsigned
+rank32_scalar(const int32_t* sep, int32_t x)
+{
+    unsigned rank = 0;
+    for (unsigned i = 0; i < KARY_NODE_SIZE / 4; i++)
+	rank += sep[i] < x;
+    return rank;
+}
+
+static GCC_INLINE unsigned
+rank64_scalar(const int64_t* sep, int64_t x)
+{
+    unsigned rank = 0;
+    for (unsigned i = 0; i < KARY_NODE_SIZE / 8; i++)
+	rank += sep[i] < x;
+    return rank;
+}
+
+#ifdef KARY_X86
+static GCC_INLINE TARGET("sse2") unsigned
+rank32_sse2(const int32_t* sep, int32_t x)
+{
+    const __m128i v = _mm_set1_epi32(x);
+    unsigned mask = 0;
+    for (unsigned i = 0; i < 4; i++) {
+	const __m128i s = _mm_load_si128((const __m128i*)sep + i);
+	mask |= (unsigned)_mm_movemask_ps(
+		    _mm_castsi128_ps(_mm_cmpgt_epi32(v, s))) << (4 * i);
+    }
+    return (unsigned)__builtin_popcount(mask);
+}
+
+static GCC_INLINE TARGET("avx2") unsigned
+rank32_avx2(const int32_t* sep, int32_t x)
+{
+    const __m256i v = _mm256_set1_epi32(x);
+    const __m256i lo = _mm256_load_si256((const __m256i*)sep);
+    const __m256i hi = _mm256_load_si256((const __m256i*)sep + 1);
+    const unsigned mask =
+	(unsigned)_mm256_movemask_ps(
+	    _mm256_castsi256_ps(_mm256_cmpgt_epi32(v, lo))) |
+	(unsigned)_mm256_movemask_ps(
+	    _mm256_castsi256_ps(_mm256_cmpgt_epi32(v, hi))) << 8;
+    return (unsigned)__builtin_popcount(mask);
+}
+
+static GCC_INLINE TARGET("sse4.2") unsigned
+rank64_sse42(const int64_t* sep, int64_t x)
+{
+    const __m128i v = _mm_set1_epi64x(x);
+    unsigned mask = 0;
+    for (unsigned i = 0; i < 4; i++) {
+	const __m128i s = _mm_load_si128((const __m128i*)sep + i);
+	mask |= (unsigned)_mm_movemask_pd(
+		    _mm_castsi128_pd(_mm_cmpgt_epi64(v, s))) << (2 * i);
+    }
+    return (unsigned)__builtin_popcount(mask);
+}
+
+static GCC_INLINE TARGET("avx2") unsigned
+rank64_avx2(const int64_t* sep, int64_t x)
+{
+    const __m256i v = _mm256_set1_epi64x(x);
+    const __m256i lo = _mm256_load_si256((const __m256i*)sep);
+    const __m256i hi = _mm256_load_si256((const __m256i*)sep + 1);
+    const unsigned mask =
+	(unsigned)_mm256_movemask_pd(
+	    _mm256_castsi256_pd(_mm256_cmpgt_epi64(v, lo))) |
+	(unsigned)_mm256_movemask_pd(
+	    _mm256_castsi256_pd(_mm256_cmpgt_epi64(v, hi))) << 4;
+    return (unsigned)__builtin_popcount(mask);
+}
+#endif
+
+/* Defines a descent from the root to the position of the first key not less
+ * than |key|, which must not be greater than the last key, counting
+ * separators with |rank|. Each is compiled for the instructions it uses, as
+ * given by |target|. */
+#define DEFINE_LOWER_BOUND(name, target, type, flip, rank) \
+    static target size_t \
+    name(const kary_index* index, uintptr_t key) \
+    { \
+	enum { LANES = KARY_NODE_SIZE / sizeof(type) }; \
+	const type x = flip(key); \
+	size_t node = 0; \
+	for (unsigned l = 0; l <= index->height; l++) { \
+	    const type* sep = (const type*) \
+		(index->nodes + (index->levels[l] + node) * KARY_NODE_SIZE); \
+	    const unsigned r = rank(sep, x); \
+	    node = l < index->height ? node * (LANES + 1) + r \
+				     : node * LANES + r; \
+	} \
+	return node; \
+    }
+
+DEFINE_LOWER_BOUND(lower_bound32_scalar, , int32_t, FLIP32, rank32_scalar)
+DEFINE_LOWER_BOUND(lower_bound64_scalar, , int64_t, FLIP64, rank64_scalar)
+#ifdef KARY_X86
+DEFINE_LOWER_BOUND(lower_bound32_sse2, TARGET("sse2"), int32_t, FLIP32,
+		   rank32_sse2)
+DEFINE_LOWER_BOUND(lower_bound32_avx2, TARGET("avx2"), int32_t, FLIP32,
+		   rank32_avx2)
+DEFINE_LOWER_BOUND(lower_bound64_sse42, TARGET("sse4.2"), int64_t, FLIP64,
+		   rank64_sse42)
+DEFINE_LOWER_BOUND(lower_bound64_avx2, TARGET("avx2"), int64_t, FLIP64,
+		   rank64_avx2)
+#endif
+
+static uintptr_t
+key_at(const kary_index* index, size_t pos)
+{
+    const unsigned char* leaves =
+	index->nodes + index->levels[index->height] * KARY_NODE_SIZE;
+    if (index->width == 4)
+	return (uint32_t)FLIP32(((const int32_t*)leaves)[pos]);
+    return (uintptr_t)(uint64_t)FLIP64(((const int64_t*)leaves)[pos]);
+}
+
+static void
+key_store(const kary_index* index, unsigned char* node, unsigned i,
+	  uintptr_t key)
+{
+    if (index->width == 4)
+	((int32_t*)node)[i] = FLIP32(key);
+    else
+	((int64_t*)node)[i] = FLIP64(key);
+}
+
+/* Lays out the nodes over the |count| keys in |keys|, which increase. */
+static bool
+nodes_build(kary_index* index, const uintptr_t* keys)
+{
+    const size_t count = index->count;
+    index->width = count && (uint64_t)keys[count - 1] > UINT32_MAX ? 8 : 4;
+    index->lanes = KARY_NODE_SIZE / index->width;
+    index->height = 0;
+    if (count == 0) {
+	index->levels[0] = 0;
+	return true;
+    }
+
+    /* Count the nodes on each level from the leaves up, and the keys under
+     * each node on it; then number the levels from the root. */
+    const size_t fanout = index->lanes + 1;
+    size_t sizes[KARY_MAX_HEIGHT + 1], spans[KARY_MAX_HEIGHT + 1];
+    sizes[0] = (count + index->lanes - 1) / index->lanes;
+    spans[0] = index->lanes;
+    unsigned height = 0;
+    while (sizes[height] > 1) {
+	ASSERT(height < KARY_MAX_HEIGHT);
+	sizes[height + 1] = (sizes[height] + fanout - 1) / fanout;
+	spans[height + 1] = spans[height] * fanout;
+	height++;
+    }
+    index->height = height;
+    size_t total = 0;
+    for (unsigned l = 0; l <= height; l++) {
+	index->levels[l] = total;
+	total += sizes[height - l];
+    }
+
+    if (!(index->block = MALLOC(total * KARY_NODE_SIZE + KARY_NODE_SIZE - 1)))
+	return false;
+    index->nodes = (unsigned char*)
+	(((uintptr_t)index->block + KARY_NODE_SIZE - 1) &
+	 ~(uintptr_t)(KARY_NODE_SIZE - 1));
+
+    for (unsigned l = 0; l <= height; l++) {
+	const unsigned depth = height - l;	/* Counted from the leaves. */
+	for (size_t j = 0; j < sizes[depth]; j++) {
+	    unsigned char* node =
+		index->nodes + (index->levels[l] + j) * KARY_NODE_SIZE;
+	    for (unsigned i = 0; i < index->lanes; i++) {
+		size_t pos;
+		if (depth == 0) {
+		    pos = j * index->lanes + i;
+		} else {
+		    /* The last key under child i. */
+		    const size_t child = j * fanout + i;
+		    pos = child < sizes[depth - 1]
+			? MIN((child + 1) * spans[depth - 1], count) - 1
+			: count;
+		}
+		key_store(index, node, i, pos < count ? keys[pos] : UINTPTR_MAX);
+	    }
+	}
+    }
+    return true;
+}
+
+static void
+lower_bound_select(kary_index* index, bool simd)
+{
+    index->lower_bound = index->width == 4 ? lower_bound32_scalar
+					   : lower_bound64_scalar;
+#ifdef KARY_X86
+    if (!simd)
+	return;
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+	index->lower_bound = index->width == 4 ? lower_bound32_avx2
+					       : lower_bound64_avx2;
+    else if (index->width == 4 && __builtin_cpu_supports("sse2"))
+	index->lower_bound = lower_bound32_sse2;
+    else if (index->width == 8 && __builtin_cpu_supports("sse4.2"))
+	index->lower_bound = lower_bound64_sse42;
+#else
+    (void)simd;
+#endif
+}
+
+static kary_index*
+index_alloc(size_t count, dict_delete_func del_func)
+{
+    kary_index* index = MALLOC(sizeof(*index));
+    if (!index)
+	return NULL;
+    if (!(index->data = count ? MALLOC(count * sizeof(*index->data)) : NULL)
+	&& count) {
+	FREE(index);
+	return NULL;
+    }
+    index->nodes = NULL;
+    index->block = NULL;
+    index->count = count;
+    index->del_func = del_func;
+    return index;
+}
+
+static void
+index_release(kary_index* index)
+{
+    FREE(index->block);
+    FREE(index->data);
+    FREE(index);
+}
+
+/* Builds the nodes over |keys|, failing if they do not increase. */
+static kary_index*
+index_finish(kary_index* index, const uintptr_t* keys)
+{
+    for (size_t i = 1; i < index->count; i++) {
+	if (keys[i - 1] >= keys[i]) {
+	    index_release(index);
+	    return NULL;
+	}
+    }
+    if (!nodes_build(index, keys)) {
+	index_release(index);
+	return NULL;
+    }
+    lower_bound_select(index, true);
+    return index;
+}
+
+kary_index*
+kary_index_new(void* const* keys, void* const* data, size_t count,
+	       dict_delete_func del_func)
+{
+    ASSERT(keys != NULL || count == 0);
+
+    kary_index* index = index_alloc(count, del_func);
+    if (!index)
+	return NULL;
+    for (size_t i = 0; i < count; i++)
+	index->data[i] = data ? data[i] : NULL;
+    /* Pointers and pointer-sized integers share a representation. */
+    return index_finish(index, (const uintptr_t*)keys);
+}
+
+kary_index*
+kary_index_from_dict(dict* dct, dict_delete_func del_func)
+{
+    ASSERT(dct != NULL);
+
+    const size_t count = dict_count(dct);
+    kary_index* index = index_alloc(count, del_func);
+    if (!index)
+	return NULL;
+    uintptr_t* keys = count ? MALLOC(count * sizeof(*keys)) : NULL;
+    dict_itor* itor = dict_itor_new(dct);
+    if ((count && !keys) || !itor) {
+	if (itor)
+	    dict_itor_free(itor);
+	FREE(keys);
+	index_release(index);
+	return NULL;
+    }
+    size_t i = 0;
+    for (dict_itor_first(itor); dict_itor_valid(itor) && i < count;
+	 dict_itor_next(itor), i++) {
+	keys[i] = (uintptr_t)dict_itor_key(itor);
+	index->data[i] = *dict_itor_data(itor);
+    }
+    dict_itor_free(itor);
+    ASSERT(i == count);
+    index = index_finish(index, keys);
+    FREE(keys);
+    return index;
+}
+
+static dict*
+dict_wrap(kary_index* index)
+{
+    if (!index)
+	return NULL;
+    dict* dct = MALLOC(sizeof(*dct));
+    if (!dct) {
+	index_release(index);
+	return NULL;
+    }
+    dct->_object = index;
+    dct->_vtable = &kary_index_vtable;
+    return dct;
+}
+
+dict*
+kary_dict_new(void* const* keys, void* const* data, size_t count,
+	      dict_delete_func del_func)
+{
+    return dict_wrap(kary_index_new(keys, data, count, del_func));
+}
+
+dict*
+kary_dict_from_dict(dict* dct, dict_delete_func del_func)
+{
+    return dict_wrap(kary_index_from_dict(dct, del_func));
+}
+
+size_t
+kary_index_free(kary_index* index)
+{
+    ASSERT(index != NULL);
+
+    const size_t count = kary_index_clear(index);
+    index_release(index);
+    return count;
+}
+
+kary_index*
+kary_index_clone(kary_index* index, dict_key_datum_clone_func clone_func)
+{
+    ASSERT(index != NULL);
+
+    kary_index* clone = index_alloc(0, index->del_func);
+    if (!clone)
+	return NULL;
+    *clone = *index;
+    clone->data = NULL;
+    clone->block = NULL;
+    if (index->count) {
+	const size_t size = (index->levels[index->height] +
+			     (index->count + index->lanes - 1) / index->lanes) *
+			    KARY_NODE_SIZE;
+	clone->data = MALLOC(index->count * sizeof(*index->data));
+	clone->block = MALLOC(size + KARY_NODE_SIZE - 1);
+	if (!clone->data || !clone->block) {
+	    index_release(clone);
+	    return NULL;
+	}
+	clone->nodes = (unsigned char*)
+	    (((uintptr_t)clone->block + KARY_NODE_SIZE - 1) &
+	     ~(uintptr_t)(KARY_NODE_SIZE - 1));
+	memcpy(clone->nodes, index->nodes, size);
+	memcpy(clone->data, index->data, index->count * sizeof(*index->data));
+    }
+    if (clone_func) {
+	for (size_t i = 0; i < clone->count; i++) {
+	    void* key = (void*)key_at(clone, i);
+	    clone_func(&key, &clone->data[i]);
+	    ASSERT((uintptr_t)key == key_at(clone, i));
+	}
+    }
+    return clone;
+}
+
+size_t
+kary_index_lower_bound(const kary_index* index, const void* key)
+{
+    ASSERT(index != NULL);
+
+    if (index->count == 0 || (uintptr_t)key > key_at(index, index->count - 1))
+	return index->count;
+    return index->lower_bound(index, (uintptr_t)key);
+}
+
+/* Returns the position of |key|, or POS_NONE if it is absent. */
+static size_t
+index_find(const kary_index* index, const void* key)
+{
+    const size_t pos = kary_index_lower_bound(index, key);
+    if (pos == index->count || key_at(index, pos) != (uintptr_t)key)
+	return POS_NONE;
+    return pos;
+}
+
+void**
+kary_index_insert(kary_index* index, void* key, bool* inserted)
+{
+    ASSERT(index != NULL);
+
+    const size_t pos = index_find(index, key);
+    if (pos == POS_NONE)
+	return NULL;
+    if (inserted)
+	*inserted = false;
+    return &index->data[pos];
+}
+
+void*
+kary_index_search(kary_index* index, const void* key)
+{
+    ASSERT(index != NULL);
+
+    const size_t pos = index_find(index, key);
+    TRACE_OP(search, "kary", index, key, 0, pos != POS_NONE);
+    return pos != POS_NONE ? index->data[pos] : NULL;
+}
+
+bool
+kary_index_remove(kary_index* index, const void* key)
+{
+    ASSERT(index != NULL);
+
+    (void)key;
+    return false;
+}
+
+size_t
+kary_index_clear(kary_index* index)
+{
+    ASSERT(index != NULL);
+
+    const size_t count = index->count;
+    if (index->del_func)
+	for (size_t i = 0; i < count; i++)
+	    index->del_func((void*)key_at(index, i), index->data[i]);
+    FREE(index->block);
+    index->block = NULL;
+    index->nodes = NULL;
+    index->count = 0;
+    index->height = 0;
+    index->levels[0] = 0;
+    return count;
+}
+
+size_t
+kary_index_traverse(kary_index* index, dict_visit_func visit)
+{
+    ASSERT(index != NULL);
+    ASSERT(visit != NULL);
+
+    size_t count = 0;
+    while (count < index->count) {
+	const size_t i = count++;
+	if (!visit((const void*)key_at(index, i), index->data[i]))
+	    break;
+    }
+    return count;
+}
+
+size_t
+kary_index_export(kary_index* index, void** keys, void** data, size_t max,
+		  dict_export_pos* pos)
+{
+    ASSERT(index != NULL);
+    ASSERT(pos != NULL);
+
+    size_t n = 0;
+    for (; n < max && pos->index < index->count; n++, pos->index++) {
+	if (keys)
+	    keys[n] = (void*)key_at(index, pos->index);
+	if (data)
+	    data[n] = index->data[pos->index];
+    }
+    return n;
+}
+
+size_t
+kary_index_count(const kary_index* index)
+{
+    ASSERT(index != NULL);
+
+    return index->count;
+}
+
+size_t
+kary_index_height(const kary_index* index)
+{
+    ASSERT(index != NULL);
+
+    return index->count ? index->height + 1 : 0;
+}
+
+bool
+kary_index_use_simd(kary_index* index, bool enable)
+{
+    ASSERT(index != NULL);
+
+    lower_bound_select(index, enable);
+    return index->lower_bound != lower_bound32_scalar &&
+	   index->lower_bound != lower_bound64_scalar;
+}
+
+bool
+kary_index_verify(const kary_index* index)
+{
+    ASSERT(index != NULL);
+
+    if (index->count == 0)
+	return true;
+    VERIFY(index->width * index->lanes == KARY_NODE_SIZE);
+    VERIFY(((uintptr_t)index->nodes & (KARY_NODE_SIZE - 1)) == 0);
+    VERIFY(index->levels[0] == 0);
+    for (size_t i = 1; i < index->count; i++)
+	VERIFY(key_at(index, i - 1) < key_at(index, i));
+    /* Every key is found where it is, the same way with or without vector
+     * instructions. */
+    kary_index scalar = *index;
+    lower_bound_select(&scalar, false);
+    for (size_t i = 0; i < index->count; i++) {
+	const uintptr_t key = key_at(index, i);
+	VERIFY(index->lower_bound(index, key) == i);
+	VERIFY(scalar.lower_bound(&scalar, key) == i);
+	if (i > 0 && key_at(index, i - 1) + 1 < key) {
+	    VERIFY(index->lower_bound(index, key - 1) == i);
+	    VERIFY(scalar.lower_bound(&scalar, key - 1) == i);
+	}
+    }
+    return true;
+}
+
+kary_itor*
+kary_itor_new(kary_index* index)
+{
+    ASSERT(index != NULL);
+
+    kary_itor* itor = MALLOC(sizeof(*itor));
+    if (itor) {
+	itor->index = index;
+	itor->pos = POS_NONE;
+    }
+    return itor;
+}
+
+dict_itor*
+kary_dict_itor_new(kary_index* index)
+{
+    ASSERT(index != NULL);
+
+    dict_itor* itor = MALLOC(sizeof(*itor));
+    if (itor) {
+	if (!(itor->_itor = kary_itor_new(index))) {
+	    FREE(itor);
+	    return NULL;
+	}
+	itor->_vtable = &kary_itor_vtable;
+    }
+    return itor;
+}
+
+void
+kary_itor_free(kary_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    FREE(itor);
+}
+
+bool
+kary_itor_valid(const kary_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    return itor->pos != POS_NONE;
+}
+
+void
+kary_itor_invalidate(kary_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    itor->pos = POS_NONE;
+}
+
+bool
+kary_itor_next(kary_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    return kary_itor_nextn(itor, 1);
+}
+
+bool
+kary_itor_prev(kary_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    return kary_itor_prevn(itor, 1);
+}
+
+bool
+kary_itor_nextn(kary_itor* itor, size_t count)
+{
+    ASSERT(itor != NULL);
+
+    if (itor->pos != POS_NONE) {
+	if (count < itor->index->count - itor->pos)
+	    itor->pos += count;
+	else
+	    itor->pos = POS_NONE;
+    }
+    return itor->pos != POS_NONE;
+}
+
+bool
+kary_itor_prevn(kary_itor* itor, size_t count)
+{
+    ASSERT(itor != NULL);
+
+    if (itor->pos != POS_NONE) {
+	if (count <= itor->pos)
+	    itor->pos -= count;
+	else
+	    itor->pos = POS_NONE;
+    }
+    return itor->pos != POS_NONE;
+}
+
+bool
+kary_itor_first(kary_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    itor->pos = itor->index->count ? 0 : POS_NONE;
+    return itor->pos != POS_NONE;
+}
+
+bool
+kary_itor_last(kary_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    itor->pos = itor->index->count ? itor->index->count - 1 : POS_NONE;
+    return itor->pos != POS_NONE;
+}
+
+bool
+kary_itor_search(kary_itor* itor, const void* key)
+{
+    ASSERT(itor != NULL);
+
+    itor->pos = index_find(itor->index, key);
+    return itor->pos != POS_NONE;
+}
+
+bool
+kary_itor_lower_bound(kary_itor* itor, const void* key)
+{
+    ASSERT(itor != NULL);
+
+    const size_t pos = kary_index_lower_bound(itor->index, key);
+    itor->pos = pos < itor->index->count ? pos : POS_NONE;
+    return itor->pos != POS_NONE;
+}
+
+bool
+kary_itor_seek(kary_itor* itor, const void* key)
+{
+    ASSERT(itor != NULL);
+
+    if (itor->pos == POS_NONE)
+	return false;
+    /* A descent from the root touches one cache line per level, which costs
+     * no more than searching outward from the current key. */
+    if (key_at(itor->index, itor->pos) >= (uintptr_t)key)
+	return true;
+    return kary_itor_lower_bound(itor, key);
+}
+
+const void*
+kary_itor_key(const kary_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    return itor->pos != POS_NONE ? (const void*)key_at(itor->index, itor->pos)
+				 : NULL;
+}
+
+void**
+kary_itor_data(kary_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    return itor->pos != POS_NONE ? &itor->index->data[itor->pos] : NULL;
+}
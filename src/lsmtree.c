@@ -0,0 +1,1178 @@
+/*
+ * libdict -- log-structured merge tree implementation.
+ * cf. [O'Neil et al. 1996], [Bloom 1970]
+ *
+ * Copyright (c) 2001-2011, Farooq Mela
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *    This product includes software developed by Farooq Mela.
+ * 4. Neither the name of the Farooq Mela nor the
+ *    names of contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY FAROOQ MELA ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL FAROOQ MELA BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Insertions go into a skiplist memtable. When it holds mem_limit keys, the
+ * next insertion freezes it into a run: a sorted array of key-datum pairs,
+ * with a bitmap of removed entries and a Bloom filter. Runs are kept oldest
+ * (and largest) first; after each freeze, the newest runs are merged in a
+ * k-way merge for as long as the run before them is no more than twice
+ * their combined size, so the sizes grow geometrically and there are O(log n)
+ * runs.
+ *
+ * Merges are incremental, so that no single operation pays for merging the
+ * whole tree. A merge first places an empty output run before the runs it
+ * merges; each insertion and removal then moves a few of their entries into
+ * it, front first, marking them removed where they were. Every entry is thus
+ * in exactly one run throughout, and lookups and iterators need not know
+ * about the merge. Only one merge is pending at a time, and it is paced to
+ * finish before the runs frozen meanwhile number MERGE_RUNS.
+ *
+ * Since a key lives either in the memtable or in exactly one run, insertion
+ * checks the runs before the memtable, and removal from a run just marks the
+ * entry removed; a run that is more than half removed is rewritten, by a merge
+ * of it alone. The key of a removed entry may no longer be valid, so searches
+ * never compare against it. Iterators merge the memtable and the runs on the
+ * fly.
+ */
+
+#include "lsmtree.h"
+
+#include <string.h>	    /* For memcpy() and memset() */
+#include "dict_private.h"
+
+#define MAX_RUNS	    48
+#define MERGE_RUNS	    16	    /* Runs at which merges speed up. */
+#define MEM_MAX_LINK	    16	    /* Skiplist links of the memtable. */
+#define FILTER_BITS	    10	    /* Bloom filter bits per key. */
+#define FILTER_PROBES	    7
+#define MERGE_STEP	    16	    /* Least entries merged per operation. */
+#define MERGE_CLEAR_WORDS   16	    /* Words cleared per entry's worth. */
+
+typedef struct {
+    void*		    key;
+    void*		    datum;
+} lsm_entry;
+
+typedef struct {
+    size_t		    size;	/* Number of entries allocated. */
+    size_t		    count;	/* Number of entries, including removed. */
+    size_t		    live;	/* Number of entries not removed. */
+    size_t		    lo, hi;	/* First and last entry not removed. */
+    uint32_t*		    dead;	/* Bitmap of removed entries. */
+    uint32_t*		    filter;	/* Bloom filter, or NULL. */
+    uint32_t		    filter_mask;
+    lsm_entry		    entries[];
+} lsm_run;
+
+struct lsmtree {
+    skiplist*		    mem;
+    skiplist_itor*	    mem_itor;
+    size_t		    mem_limit;
+    lsm_run*		    runs[MAX_RUNS];
+    unsigned		    nruns;
+    dict_compare_func	    cmp_func;
+    dict_hash_func	    hash_func;
+    dict_delete_func	    del_func;
+    size_t		    count;
+    size_t		    mod_count;	/* Changes, including freezes. */
+    lsm_run*		    merge_out;	/* Run being merged into, or NULL. */
+    lsm_run*		    merge_in[MAX_RUNS];
+    unsigned		    merge_nin;
+    size_t		    merge_cleared; /* Words of |merge_out| cleared. */
+};
+
+#define SRC_NONE	    (-2)
+#define SRC_MEM		    (-1)
+
+struct lsmtree_itor {
+    lsmtree*		    tree;
+    skiplist_itor*	    mem;
+    ptrdiff_t		    pos[MAX_RUNS];
+    int			    cur;	/* Source of the current entry. */
+    bool		    forward;
+};
+
+static size_t	    lsmtree_mod_count(const lsmtree* tree);
+
+static dict_vtable lsmtree_vtable = {
+    (dict_inew_func)	    lsmtree_dict_itor_new,
+    (dict_dfree_func)	    lsmtree_free,
+    (dict_insert_func)	    lsmtree_insert,
+    (dict_search_func)	    lsmtree_search,
+    (dict_remove_func)	    lsmtree_remove,
+    (dict_clear_func)	    lsmtree_clear,
+    (dict_traverse_func)    lsmtree_traverse,
+    (dict_count_func)	    lsmtree_count,
+    (dict_verify_func)	    lsmtree_verify,
+    (dict_clone_func)	    lsmtree_clone,
+    (dict_remove_many_func) NULL,/* lsmtree_remove_many not implemented yet */
+    (dict_remove_if_func)   NULL,/* lsmtree_remove_if not implemented yet */
+    (dict_mod_count_func)   lsmtree_mod_count,
+    (dict_export_func)	    NULL,/* lsmtree_export not implemented yet */
+    (dict_export_all_func)  NULL,/* lsmtree_export_all not implemented yet */
+};
+
+static itor_vtable lsmtree_itor_vtable = {
+    (dict_ifree_func)	    lsmtree_itor_free,
+    (dict_valid_func)	    lsmtree_itor_valid,
+    (dict_invalidate_func)  lsmtree_itor_invalidate,
+    (dict_next_func)	    lsmtree_itor_next,
+    (dict_prev_func)	    lsmtree_itor_prev,
+    (dict_nextn_func)	    lsmtree_itor_nextn,
+    (dict_prevn_func)	    lsmtree_itor_prevn,
+    (dict_first_func)	    lsmtree_itor_first,
+    (dict_last_func)	    lsmtree_itor_last,
+    (dict_key_func)	    lsmtree_itor_key,
+    (dict_data_func)	    lsmtree_itor_data,
+    (dict_iremove_func)	    NULL,/* lsmtree_itor_remove not implemented */
+    (dict_icompare_func)    NULL,/* lsmtree_itor_compare not implemented */
+    (dict_iseek_func)	    lsmtree_itor_seek
+};
+
+#define IS_DEAD(run,i)	    (((run)->dead[(i) >> 5] >> ((i) & 31)) & 1)
+#define SET_DEAD(run,i)	    ((run)->dead[(i) >> 5] |= 1U << ((i) & 31))
+
+lsmtree*
+lsmtree_new(dict_compare_func cmp_func, dict_hash_func hash_func,
+	    dict_delete_func del_func, size_t mem_limit)
+{
+    ASSERT(mem_limit > 0);
+
+    lsmtree* tree = MALLOC(sizeof(*tree));
+    if (tree) {
+	if (!(tree->mem = skiplist_new(cmp_func, NULL, MEM_MAX_LINK))) {
+	    FREE(tree);
+	    return NULL;
+	}
+	if (!(tree->mem_itor = skiplist_itor_new(tree->mem))) {
+	    skiplist_free(tree->mem);
+	    FREE(tree);
+	    return NULL;
+	}
+	tree->mem_limit = mem_limit;
+	tree->nruns = 0;
+	tree->cmp_func = cmp_func ? cmp_func : dict_ptr_cmp;
+	tree->hash_func = hash_func;
+	tree->del_func = del_func;
+	tree->count = 0;
+	tree->mod_count = 0;
+	tree->merge_out = NULL;
+	tree->merge_nin = 0;
+	tree->merge_cleared = 0;
+    }
+    return tree;
+}
+
+dict*
+lsmtree_dict_new(dict_compare_func cmp_func, dict_hash_func hash_func,
+		 dict_delete_func del_func, size_t mem_limit)
+{
+    dict* dct = MALLOC(sizeof(*dct));
+    if (dct) {
+	if (!(dct->_object = lsmtree_new(cmp_func, hash_func, del_func,
+					 mem_limit))) {
+	    FREE(dct);
+	    return NULL;
+	}
+	dct->_vtable = &lsmtree_vtable;
+    }
+    return dct;
+}
+
+size_t
+lsmtree_free(lsmtree* tree)
+{
+    ASSERT(tree != NULL);
+
+    size_t count = lsmtree_clear(tree);
+    skiplist_itor_free(tree->mem_itor);
+    skiplist_free(tree->mem);
+    FREE(tree);
+    return count;
+}
+
+static inline uint32_t
+filter_hash(const lsmtree* tree, const void* key)
+{
+    uint32_t hash = tree->hash_func(key) * 0x9E3779B1U;
+    return hash ^ (hash >> 16);
+}
+
+static void
+filter_add(lsm_run* run, uint32_t hash)
+{
+    const uint32_t delta = (hash >> 17) | (hash << 15) | 1;
+    for (unsigned k = 0; k < FILTER_PROBES; k++, hash += delta) {
+	const uint32_t bit = hash & run->filter_mask;
+	run->filter[bit >> 5] |= 1U << (bit & 31);
+    }
+}
+
+static bool
+filter_test(const lsm_run* run, uint32_t hash)
+{
+    const uint32_t delta = (hash >> 17) | (hash << 15) | 1;
+    for (unsigned k = 0; k < FILTER_PROBES; k++, hash += delta) {
+	const uint32_t bit = hash & run->filter_mask;
+	if (!((run->filter[bit >> 5] >> (bit & 31)) & 1))
+	    return false;
+    }
+    return true;
+}
+
+/* Allocates a run with room for |size| > 0 entries, holding none. Its removal
+ * bitmap and filter are left uncleared. */
+static lsm_run*
+run_alloc(const lsmtree* tree, size_t size)
+{
+    ASSERT(size > 0);
+
+    const size_t dead_words = (size + 31) >> 5;
+    size_t filter_bits = 0;
+    if (tree->hash_func) {
+	filter_bits = 64;
+	while (filter_bits < size * FILTER_BITS)
+	    filter_bits <<= 1;
+    }
+    const size_t filter_words = filter_bits >> 5;
+    lsm_run* run = MALLOC(sizeof(*run) + size * sizeof(lsm_entry) +
+			  (dead_words + filter_words) * sizeof(uint32_t));
+    if (run) {
+	run->size = size;
+	run->count = run->live = 0;
+	run->lo = 0;
+	run->hi = (size_t)-1;
+	run->dead = (uint32_t*)(run->entries + size);
+	run->filter = filter_words ? run->dead + dead_words : NULL;
+	run->filter_mask = filter_bits ? (uint32_t)(filter_bits - 1) : 0;
+    }
+    return run;
+}
+
+/* Returns the number of words in the removal bitmap and filter of |run|. */
+static inline size_t
+run_words(const lsm_run* run)
+{
+    return ((run->size + 31) >> 5) +
+	(run->filter ? ((size_t)run->filter_mask + 1) >> 5 : 0);
+}
+
+/* Allocates a run of |count| > 0 live entries, with an empty filter. */
+static lsm_run*
+run_new(const lsmtree* tree, size_t count)
+{
+    lsm_run* run = run_alloc(tree, count);
+    if (run) {
+	memset(run->dead, 0, run_words(run) * sizeof(uint32_t));
+	run->count = run->live = count;
+	run->hi = count - 1;
+    }
+    return run;
+}
+
+static void
+run_fill_filter(const lsmtree* tree, lsm_run* run)
+{
+    if (run->filter) {
+	for (size_t i = 0; i < run->count; i++)
+	    filter_add(run, filter_hash(tree, run->entries[i].key));
+    }
+}
+
+static inline ptrdiff_t
+run_next_live(const lsm_run* run, ptrdiff_t i)
+{
+    while (i < (ptrdiff_t)run->count && IS_DEAD(run, i))
+	i++;
+    return i;
+}
+
+static inline ptrdiff_t
+run_prev_live(const lsm_run* run, ptrdiff_t i)
+{
+    while (i >= 0 && IS_DEAD(run, i))
+	i--;
+    return i;
+}
+
+/* Returns the index of the live entry of |run| with |key|, or the count of
+ * the run if there is none. */
+static size_t
+run_find(const lsmtree* tree, const lsm_run* run, const void* key,
+	 uint32_t hash)
+{
+    if (run->filter && !filter_test(run, hash))
+	return run->count;
+    int cmp = tree->cmp_func(key, run->entries[run->lo].key);
+    if (cmp <= 0)
+	return cmp ? run->count : run->lo;
+    cmp = tree->cmp_func(key, run->entries[run->hi].key);
+    if (cmp >= 0)
+	return cmp ? run->count : run->hi;
+
+    /* Binary search (lo, hi) using only live entries: a probe that lands on
+     * a removed entry uses the next live one instead. */
+    size_t lo = run->lo + 1, hi = run->hi;
+    while (lo < hi) {
+	const size_t mid = lo + ((hi - lo) >> 1);
+	const size_t live = run_next_live(run, mid);
+	if (live >= hi) {
+	    hi = mid;
+	    continue;
+	}
+	cmp = tree->cmp_func(key, run->entries[live].key);
+	if (cmp == 0)
+	    return live;
+	if (cmp < 0)
+	    hi = mid;
+	else
+	    lo = live + 1;
+    }
+    return run->count;
+}
+
+/* Finds the run and index of the run entry with |key|, newest run first. */
+static lsm_run*
+runs_find(const lsmtree* tree, const void* key, size_t* index)
+{
+    if (!tree->nruns)
+	return NULL;
+    const uint32_t hash = tree->hash_func ? filter_hash(tree, key) : 0;
+    for (unsigned r = tree->nruns; r-- > 0;) {
+	lsm_run* run = tree->runs[r];
+	if (!run->live)
+	    continue;
+	const size_t i = run_find(tree, run, key, hash);
+	if (i < run->count) {
+	    *index = i;
+	    return run;
+	}
+    }
+    return NULL;
+}
+
+/* Merges the live entries of |runs| into a new run, with a k-way merge. */
+static lsm_run*
+runs_merge(const lsmtree* tree, lsm_run* const* runs, unsigned nmerge)
+{
+    ASSERT(nmerge > 0 && nmerge <= MAX_RUNS);
+
+    ptrdiff_t pos[MAX_RUNS];
+    size_t total = 0;
+    for (unsigned k = 0; k < nmerge; k++) {
+	total += runs[k]->live;
+	pos[k] = run_next_live(runs[k], 0);
+    }
+    lsm_run* run = run_new(tree, total);
+    if (!run)
+	return NULL;
+    for (size_t n = 0; n < total; n++) {
+	unsigned best = nmerge;
+	for (unsigned k = 0; k < nmerge; k++) {
+	    if (pos[k] < (ptrdiff_t)runs[k]->count &&
+		(best == nmerge ||
+		 tree->cmp_func(runs[k]->entries[pos[k]].key,
+				runs[best]->entries[pos[best]].key) < 0))
+		best = k;
+	}
+	ASSERT(best < nmerge);
+	run->entries[n] = runs[best]->entries[pos[best]];
+	pos[best] = run_next_live(runs[best], pos[best] + 1);
+    }
+    run_fill_filter(tree, run);
+    return run;
+}
+
+/* Replaces runs [first, nruns) with their merge. */
+static bool
+runs_collapse(lsmtree* tree, unsigned first)
+{
+    ASSERT(first < tree->nruns);
+
+    lsm_run* run = runs_merge(tree, tree->runs + first, tree->nruns - first);
+    if (!run)
+	return false;
+    for (unsigned r = first; r < tree->nruns; r++)
+	FREE(tree->runs[r]);
+    tree->runs[first] = run;
+    tree->nruns = first + 1;
+    return true;
+}
+
+/* Returns whether |run| is being merged, or merged into. */
+static bool
+run_merging(const lsmtree* tree, const lsm_run* run)
+{
+    if (run == tree->merge_out)
+	return true;
+    for (unsigned k = 0; k < tree->merge_nin; k++)
+	if (run == tree->merge_in[k])
+	    return true;
+    return false;
+}
+
+/* Starts merging the |nmerge| runs from |first| into an empty run, which is
+ * placed before them. If there is no room for it, the runs stay as they are. */
+static void
+merge_start(lsmtree* tree, unsigned first, unsigned nmerge)
+{
+    ASSERT(tree->merge_out == NULL);
+    ASSERT(first + nmerge <= tree->nruns);
+
+    if (tree->nruns == MAX_RUNS)
+	return;
+    size_t total = 0;
+    for (unsigned k = 0; k < nmerge; k++)
+	total += tree->runs[first + k]->live;
+    lsm_run* out = run_alloc(tree, total);
+    if (!out)
+	return;
+    memcpy(tree->merge_in, tree->runs + first, nmerge * sizeof(tree->runs[0]));
+    memmove(tree->runs + first + 1, tree->runs + first,
+	    (tree->nruns - first) * sizeof(tree->runs[0]));
+    tree->runs[first] = out;
+    tree->nruns++;
+    tree->merge_out = out;
+    tree->merge_nin = nmerge;
+    tree->merge_cleared = 0;
+}
+
+/* Starts a merge of the newest runs, for as long as the run before them is no
+ * more than twice their combined size, or else of a run that is more than half
+ * removed; unless a merge is pending already. */
+static void
+runs_compact(lsmtree* tree)
+{
+    if (tree->merge_out || tree->nruns == 0)
+	return;
+    unsigned first = tree->nruns - 1;
+    size_t live = tree->runs[first]->live;
+    while (first > 0 && tree->runs[first - 1]->live <= 2 * live)
+	live += tree->runs[--first]->live;
+    if (first + 1 < tree->nruns) {
+	merge_start(tree, first, tree->nruns - first);
+	return;
+    }
+    for (unsigned r = 0; r < tree->nruns; r++) {
+	if (tree->runs[r]->live * 2 < tree->runs[r]->count) {
+	    merge_start(tree, r, 1);
+	    return;
+	}
+    }
+}
+
+/* Drops the runs the pending merge has emptied, which are all those it merged
+ * and perhaps its output, and starts the next merge, if one is due. */
+static void
+merge_finish(lsmtree* tree)
+{
+    unsigned n = 0;
+    for (unsigned r = 0; r < tree->nruns; r++) {
+	lsm_run* run = tree->runs[r];
+	if (run->live)
+	    tree->runs[n++] = run;
+	else
+	    FREE(run);
+    }
+    tree->nruns = n;
+    tree->merge_out = NULL;
+    tree->merge_nin = 0;
+    tree->mod_count++;
+    runs_compact(tree);
+}
+
+/* Moves about |budget| entries of the pending merge into its output, after
+ * clearing the output's bitmap and filter, which counts MERGE_CLEAR_WORDS
+ * words to an entry. Returns true once no merge is pending. */
+static bool
+merge_step(lsmtree* tree, size_t budget)
+{
+    lsm_run* out = tree->merge_out;
+    if (!out)
+	return true;
+    const size_t words = run_words(out);
+    if (tree->merge_cleared < words) {
+	size_t n = words - tree->merge_cleared;
+	if (n / MERGE_CLEAR_WORDS > budget)
+	    n = budget * MERGE_CLEAR_WORDS;
+	memset(out->dead + tree->merge_cleared, 0, n * sizeof(uint32_t));
+	tree->merge_cleared += n;
+	if (tree->merge_cleared < words)
+	    return false;
+	budget -= n / MERGE_CLEAR_WORDS;
+    }
+    if (budget == 0)
+	return false;
+
+    lsm_run* const* in = tree->merge_in;
+    const unsigned nin = tree->merge_nin;
+    tree->mod_count++;
+    for (; budget > 0; budget--) {
+	unsigned best = nin;
+	for (unsigned k = 0; k < nin; k++) {
+	    if (in[k]->live &&
+		(best == nin ||
+		 tree->cmp_func(in[k]->entries[in[k]->lo].key,
+				in[best]->entries[in[best]->lo].key) < 0))
+		best = k;
+	}
+	if (best == nin) {
+	    merge_finish(tree);
+	    return tree->merge_out == NULL;
+	}
+	lsm_run* run = in[best];
+	const size_t i = run->lo;
+	const size_t j = out->count++;
+	out->entries[j] = run->entries[i];
+	if (out->filter)
+	    filter_add(out, filter_hash(tree, out->entries[j].key));
+	if (out->live++ == 0)
+	    out->lo = j;
+	out->hi = j;
+	SET_DEAD(run, i);
+	run->lo = run_next_live(run, (ptrdiff_t)i + 1);
+	if (--run->live == 0)
+	    run->hi = (size_t)-1;
+    }
+    return false;
+}
+
+/* Returns how many entries of the pending merge an operation moves: enough
+ * that the merge finishes before the runs frozen meanwhile number MERGE_RUNS,
+ * or within a freeze once they do. */
+static size_t
+merge_pace(const lsmtree* tree)
+{
+    if (!tree->merge_out)
+	return 0;
+    size_t left = (run_words(tree->merge_out) - tree->merge_cleared) /
+	MERGE_CLEAR_WORDS;
+    for (unsigned k = 0; k < tree->merge_nin; k++)
+	left += tree->merge_in[k]->live;
+    const size_t freezes = tree->nruns + 1 < MERGE_RUNS ?
+	MERGE_RUNS - 1 - tree->nruns : 1;
+    return MERGE_STEP + left / (freezes * tree->mem_limit);
+}
+
+bool
+lsmtree_merge_step(lsmtree* tree, size_t budget)
+{
+    ASSERT(tree != NULL);
+
+    return merge_step(tree, budget);
+}
+
+bool
+lsmtree_flush(lsmtree* tree)
+{
+    ASSERT(tree != NULL);
+
+    const size_t count = skiplist_count(tree->mem);
+    if (count == 0)
+	return true;
+    /* Merges only fall this far behind if they could not be started. */
+    while (tree->nruns == MAX_RUNS && tree->merge_out)
+	merge_step(tree, SIZE_MAX);
+    if (tree->nruns == MAX_RUNS && !runs_collapse(tree, MAX_RUNS - 2))
+	return false;
+
+    lsm_run* run = run_new(tree, count);
+    if (!run)
+	return false;
+    skiplist_itor* itor = tree->mem_itor;
+    lsm_entry* entry = run->entries;
+    for (bool valid = skiplist_itor_first(itor); valid;
+	 valid = skiplist_itor_next(itor), entry++) {
+	entry->key = (void*)skiplist_itor_key(itor);
+	entry->datum = *skiplist_itor_data(itor);
+    }
+    ASSERT(entry == run->entries + count);
+    run_fill_filter(tree, run);
+    /* The memtable has no delete function, so this only frees its nodes. */
+    skiplist_clear(tree->mem);
+
+    tree->runs[tree->nruns++] = run;
+    runs_compact(tree);
+    tree->mod_count++;
+    return true;
+}
+
+lsmtree*
+lsmtree_clone(lsmtree* tree, dict_key_datum_clone_func clone_func)
+{
+    ASSERT(tree != NULL);
+
+    lsmtree* clone = lsmtree_new(tree->cmp_func, tree->hash_func,
+				 tree->del_func, tree->mem_limit);
+    if (!clone)
+	return NULL;
+    skiplist* mem = skiplist_clone(tree->mem, clone_func);
+    if (!mem) {
+	lsmtree_free(clone);
+	return NULL;
+    }
+    skiplist_itor_free(clone->mem_itor);
+    skiplist_free(clone->mem);
+    clone->mem = mem;
+    if (!(clone->mem_itor = skiplist_itor_new(mem))) {
+	skiplist_free(mem);
+	FREE(clone);
+	return NULL;
+    }
+    clone->count = skiplist_count(mem);
+    /* A pending merge is cloned along with the runs. */
+    for (unsigned r = 0; r < tree->nruns; r++) {
+	const lsm_run* run = tree->runs[r];
+	lsm_run* copy = run_alloc(tree, run->size);
+	if (!copy) {
+	    lsmtree_free(clone);
+	    return NULL;
+	}
+	const size_t words = run == tree->merge_out ? tree->merge_cleared
+						    : run_words(run);
+	memcpy(copy->entries, run->entries, run->count * sizeof(lsm_entry));
+	memcpy(copy->dead, run->dead, words * sizeof(uint32_t));
+	copy->count = run->count;
+	copy->live = run->live;
+	copy->lo = run->lo;
+	copy->hi = run->hi;
+	if (clone_func) {
+	    for (size_t i = run->lo; i < run->count; i++)
+		if (!IS_DEAD(copy, i))
+		    clone_func(&copy->entries[i].key, &copy->entries[i].datum);
+	}
+	clone->runs[clone->nruns++] = copy;
+	clone->count += copy->live;
+	if (run == tree->merge_out)
+	    clone->merge_out = copy;
+	for (unsigned k = 0; k < tree->merge_nin; k++)
+	    if (run == tree->merge_in[k])
+		clone->merge_in[k] = copy;
+    }
+    clone->merge_nin = tree->merge_nin;
+    clone->merge_cleared = tree->merge_cleared;
+    return clone;
+}
+
+void**
+lsmtree_insert(lsmtree* tree, void* key, bool* inserted)
+{
+    ASSERT(tree != NULL);
+
+    /* The memtable is frozen here rather than right after the insertion that
+     * fills it, since the caller stores the datum after we return. */
+    if (skiplist_count(tree->mem) >= tree->mem_limit && !lsmtree_flush(tree)) {
+	TRACE_OP(insert, "lsm", tree, key, 0, -1);
+	return NULL;
+    }
+    merge_step(tree, merge_pace(tree));
+
+    size_t index;
+    lsm_run* run = runs_find(tree, key, &index);
+    if (run) {
+	if (inserted)
+	    *inserted = false;
+	TRACE_OP(insert, "lsm", tree, key, 0, 0);
+	return &run->entries[index].datum;
+    }
+    bool mem_inserted = false;
+    void** datum = skiplist_insert(tree->mem, key, &mem_inserted);
+    if (datum && mem_inserted) {
+	tree->count++;
+	tree->mod_count++;
+    }
+    if (inserted)
+	*inserted = mem_inserted;
+    TRACE_OP(insert, "lsm", tree, key, 0, datum ? mem_inserted : -1);
+    return datum;
+}
+
+void*
+lsmtree_search(lsmtree* tree, const void* key)
+{
+    ASSERT(tree != NULL);
+
+    void* datum = skiplist_search(tree->mem, key);
+    if (datum) {
+	TRACE_OP(search, "lsm", tree, key, 0, 1);
+	return datum;
+    }
+    size_t index;
+    lsm_run* run = runs_find(tree, key, &index);
+    TRACE_OP(search, "lsm", tree, key, 0, run != NULL);
+    return run ? run->entries[index].datum : NULL;
+}
+
+static void
+run_unlink(lsmtree* tree, unsigned r)
+{
+    FREE(tree->runs[r]);
+    memmove(tree->runs + r, tree->runs + r + 1,
+	    (--tree->nruns - r) * sizeof(tree->runs[0]));
+}
+
+bool
+lsmtree_remove(lsmtree* tree, const void* key)
+{
+    ASSERT(tree != NULL);
+
+    merge_step(tree, merge_pace(tree));
+    skiplist_itor* itor = tree->mem_itor;
+    if (skiplist_itor_search(itor, key)) {
+	void* mem_key = (void*)skiplist_itor_key(itor);
+	void* mem_datum = *skiplist_itor_data(itor);
+	skiplist_itor_invalidate(itor);
+	skiplist_remove(tree->mem, mem_key);
+	if (tree->del_func)
+	    tree->del_func(mem_key, mem_datum);
+	tree->count--;
+	tree->mod_count++;
+	TRACE_OP(remove, "lsm", tree, key, 0, 1);
+	return true;
+    }
+
+    size_t index;
+    lsm_run* run = runs_find(tree, key, &index);
+    if (!run) {
+	TRACE_OP(remove, "lsm", tree, key, 0, 0);
+	return false;
+    }
+    unsigned r = tree->nruns;
+    while (tree->runs[--r] != run)
+	/* void */;
+    lsm_entry entry = run->entries[index];
+    SET_DEAD(run, index);
+    tree->count--;
+    tree->mod_count++;
+    /* The runs of a pending merge stay put, even if emptied, until it ends. */
+    if (--run->live == 0 && !run_merging(tree, run)) {
+	run_unlink(tree, r);
+    } else {
+	if (index == run->lo)
+	    run->lo = run_next_live(run, index);
+	if (index == run->hi)
+	    run->hi = run_prev_live(run, index);
+	if (run->live * 2 < run->count && !tree->merge_out)
+	    merge_start(tree, r, 1);
+    }
+    if (tree->del_func)
+	tree->del_func(entry.key, entry.datum);
+    TRACE_OP(remove, "lsm", tree, key, 0, 1);
+    return true;
+}
+
+size_t
+lsmtree_clear(lsmtree* tree)
+{
+    ASSERT(tree != NULL);
+
+    const size_t count = tree->count;
+    if (tree->del_func) {
+	skiplist_itor* itor = tree->mem_itor;
+	for (bool valid = skiplist_itor_first(itor); valid;
+	     valid = skiplist_itor_next(itor))
+	    tree->del_func((void*)skiplist_itor_key(itor),
+			   *skiplist_itor_data(itor));
+    }
+    skiplist_itor_invalidate(tree->mem_itor);
+    skiplist_clear(tree->mem);
+    for (unsigned r = 0; r < tree->nruns; r++) {
+	lsm_run* run = tree->runs[r];
+	if (tree->del_func) {
+	    for (size_t i = run->lo; i < run->count; i++)
+		if (!IS_DEAD(run, i))
+		    tree->del_func(run->entries[i].key, run->entries[i].datum);
+	}
+	FREE(run);
+    }
+    tree->nruns = 0;
+    tree->merge_out = NULL;
+    tree->merge_nin = 0;
+    tree->count = 0;
+    tree->mod_count++;
+    return count;
+}
+
+size_t
+lsmtree_traverse(lsmtree* tree, dict_visit_func visit)
+{
+    ASSERT(tree != NULL);
+    ASSERT(visit != NULL);
+
+    lsmtree_itor* itor = lsmtree_itor_new(tree);
+    if (!itor)
+	return 0;
+    size_t count = 0;
+    for (bool valid = lsmtree_itor_first(itor); valid;
+	 valid = lsmtree_itor_next(itor)) {
+	++count;
+	if (!visit(lsmtree_itor_key(itor), *lsmtree_itor_data(itor)))
+	    break;
+    }
+    lsmtree_itor_free(itor);
+    return count;
+}
+
+size_t
+lsmtree_count(const lsmtree* tree)
+{
+    ASSERT(tree != NULL);
+
+    return tree->count;
+}
+
+static size_t
+lsmtree_mod_count(const lsmtree* tree)
+{
+    ASSERT(tree != NULL);
+
+    return tree->mod_count;
+}
+
+size_t
+lsmtree_run_count(const lsmtree* tree)
+{
+    ASSERT(tree != NULL);
+
+    return tree->nruns;
+}
+
+bool
+lsmtree_verify(const lsmtree* tree)
+{
+    ASSERT(tree != NULL);
+
+    VERIFY(skiplist_verify(tree->mem));
+    VERIFY(tree->nruns <= MAX_RUNS);
+    size_t count = skiplist_count(tree->mem);
+    unsigned merging = 0;
+    for (unsigned r = 0; r < tree->nruns; r++) {
+	const lsm_run* run = tree->runs[r];
+	if (run_merging(tree, run))
+	    merging++;
+	else
+	    VERIFY(run->live > 0);
+	VERIFY(run->live <= run->count);
+	VERIFY(run->count <= run->size);
+	VERIFY((size_t)run_next_live(run, 0) == run->lo);
+	VERIFY((size_t)run_prev_live(run, (ptrdiff_t)run->count - 1) == run->hi);
+	size_t live = 0;
+	const void* prev = NULL;
+	for (size_t i = run->lo; i < run->count; i++) {
+	    if (IS_DEAD(run, i))
+		continue;
+	    const void* key = run->entries[i].key;
+	    if (live++)
+		VERIFY(tree->cmp_func(prev, key) < 0);
+	    if (run->filter)
+		VERIFY(filter_test(run, filter_hash(tree, key)));
+	    prev = key;
+	}
+	VERIFY(live == run->live);
+	count += live;
+    }
+    VERIFY(tree->count == count);
+    if (tree->merge_out) {
+	VERIFY(merging == tree->merge_nin + 1);
+	VERIFY(tree->merge_out->count == 0 ||
+	       tree->merge_cleared == run_words(tree->merge_out));
+    }
+
+    /* Keys must be unique across the memtable and the runs. */
+    lsmtree_itor* itor = lsmtree_itor_new((lsmtree*)tree);
+    if (itor) {
+	size_t n = 0;
+	const void* prev = NULL;
+	for (bool valid = lsmtree_itor_first(itor); valid;
+	     valid = lsmtree_itor_next(itor)) {
+	    const void* key = lsmtree_itor_key(itor);
+	    if (n++)
+		VERIFY(tree->cmp_func(prev, key) < 0);
+	    prev = key;
+	}
+	lsmtree_itor_free(itor);
+	VERIFY(n == count);
+    }
+    return true;
+}
+
+lsmtree_itor*
+lsmtree_itor_new(lsmtree* tree)
+{
+    ASSERT(tree != NULL);
+
+    lsmtree_itor* itor = MALLOC(sizeof(*itor));
+    if (itor) {
+	if (!(itor->mem = skiplist_itor_new(tree->mem))) {
+	    FREE(itor);
+	    return NULL;
+	}
+	itor->tree = tree;
+	itor->cur = SRC_NONE;
+	itor->forward = true;
+    }
+    return itor;
+}
+
+dict_itor*
+lsmtree_dict_itor_new(lsmtree* tree)
+{
+    ASSERT(tree != NULL);
+
+    dict_itor* itor = MALLOC(sizeof(*itor));
+    if (itor) {
+	if (!(itor->_itor = lsmtree_itor_new(tree))) {
+	    FREE(itor);
+	    return NULL;
+	}
+	itor->_vtable = &lsmtree_itor_vtable;
+    }
+    return itor;
+}
+
+void
+lsmtree_itor_free(lsmtree_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    skiplist_itor_free(itor->mem);
+    FREE(itor);
+}
+
+bool
+lsmtree_itor_valid(const lsmtree_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    return itor->cur != SRC_NONE;
+}
+
+void
+lsmtree_itor_invalidate(lsmtree_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    itor->cur = SRC_NONE;
+}
+
+/* Moves the cursor of source |src| one live entry forward or backward. */
+static void
+itor_step(lsmtree_itor* itor, int src, bool forward)
+{
+    if (src == SRC_MEM) {
+	if (forward)
+	    skiplist_itor_next(itor->mem);
+	else
+	    skiplist_itor_prev(itor->mem);
+    } else {
+	const lsm_run* run = itor->tree->runs[src];
+	itor->pos[src] = forward ? run_next_live(run, itor->pos[src] + 1)
+				 : run_prev_live(run, itor->pos[src] - 1);
+    }
+}
+
+/* Makes the least (going forward) or greatest (going backward) of the entries
+ * under the source cursors current. Going forward, each cursor rests on the
+ * first entry of its source not less than the current key; going backward,
+ * on the last entry not greater. */
+static bool
+itor_pick(lsmtree_itor* itor)
+{
+    const lsmtree* tree = itor->tree;
+    const int sign = itor->forward ? 1 : -1;
+    const void* best_key = NULL;
+    itor->cur = SRC_NONE;
+    if (skiplist_itor_valid(itor->mem)) {
+	itor->cur = SRC_MEM;
+	best_key = skiplist_itor_key(itor->mem);
+    }
+    for (unsigned r = 0; r < tree->nruns; r++) {
+	const ptrdiff_t i = itor->pos[r];
+	if (i < 0 || i >= (ptrdiff_t)tree->runs[r]->count)
+	    continue;
+	const void* key = tree->runs[r]->entries[i].key;
+	if (itor->cur == SRC_NONE || tree->cmp_func(key, best_key) * sign < 0) {
+	    itor->cur = (int)r;
+	    best_key = key;
+	}
+    }
+    return itor->cur != SRC_NONE;
+}
+
+/* Turns the iterator around, so that it can move in direction |forward|. Keys
+ * are unique, so every other cursor is one step away from where it must be. */
+static void
+itor_turn(lsmtree_itor* itor, bool forward)
+{
+    if (itor->forward == forward)
+	return;
+    if (itor->cur != SRC_MEM)
+	itor_step(itor, SRC_MEM, forward);
+    for (unsigned r = 0; r < itor->tree->nruns; r++)
+	if ((int)r != itor->cur)
+	    itor_step(itor, (int)r, forward);
+    itor->forward = forward;
+}
+
+bool
+lsmtree_itor_first(lsmtree_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    skiplist_itor_first(itor->mem);
+    for (unsigned r = 0; r < itor->tree->nruns; r++)
+	itor->pos[r] = run_next_live(itor->tree->runs[r], 0);
+    itor->forward = true;
+    return itor_pick(itor);
+}
+
+bool
+lsmtree_itor_last(lsmtree_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    skiplist_itor_last(itor->mem);
+    for (unsigned r = 0; r < itor->tree->nruns; r++) {
+	const lsm_run* run = itor->tree->runs[r];
+	itor->pos[r] = run_prev_live(run, (ptrdiff_t)run->count - 1);
+    }
+    itor->forward = false;
+    return itor_pick(itor);
+}
+
+bool
+lsmtree_itor_next(lsmtree_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    if (itor->cur == SRC_NONE)
+	return lsmtree_itor_first(itor);
+    itor_turn(itor, true);
+    itor_step(itor, itor->cur, true);
+    return itor_pick(itor);
+}
+
+bool
+lsmtree_itor_prev(lsmtree_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    if (itor->cur == SRC_NONE)
+	return lsmtree_itor_last(itor);
+    itor_turn(itor, false);
+    itor_step(itor, itor->cur, false);
+    return itor_pick(itor);
+}
+
+bool
+lsmtree_itor_nextn(lsmtree_itor* itor, size_t count)
+{
+    ASSERT(itor != NULL);
+
+    while (count--)
+	if (!lsmtree_itor_next(itor))
+	    return false;
+    return itor->cur != SRC_NONE;
+}
+
+bool
+lsmtree_itor_prevn(lsmtree_itor* itor, size_t count)
+{
+    ASSERT(itor != NULL);
+
+    while (count--)
+	if (!lsmtree_itor_prev(itor))
+	    return false;
+    return itor->cur != SRC_NONE;
+}
+
+/* Returns the index of the first live entry of |run| at or after |from| whose
+ * key is not less than |key|, or the count of the run if there is none. As in
+ * run_find(), only live entries are compared with. */
+static size_t
+run_lower_bound(const lsmtree* tree, const lsm_run* run, size_t from,
+		const void* key)
+{
+    size_t lo = from, hi = run->hi + 1;
+    while (lo < hi) {
+	const size_t mid = lo + ((hi - lo) >> 1);
+	const size_t live = run_next_live(run, mid);
+	if (live >= hi)
+	    hi = mid;
+	else if (tree->cmp_func(run->entries[live].key, key) < 0)
+	    lo = live + 1;
+	else
+	    hi = mid;
+    }
+    return run_next_live(run, lo);
+}
+
+bool
+lsmtree_itor_seek(lsmtree_itor* itor, const void* key)
+{
+    ASSERT(itor != NULL);
+
+    if (itor->cur == SRC_NONE)
+	return false;
+    const lsmtree* tree = itor->tree;
+    if (tree->cmp_func(lsmtree_itor_key(itor), key) >= 0)
+	return true;
+    /* Every source moves to its first entry not less than |key|, which puts
+     * the cursors where going forward leaves them. */
+    itor_turn(itor, true);
+    if (skiplist_itor_valid(itor->mem))
+	skiplist_itor_seek(itor->mem, key);
+    for (unsigned r = 0; r < tree->nruns; r++) {
+	const lsm_run* run = tree->runs[r];
+	if (itor->pos[r] < (ptrdiff_t)run->count)
+	    itor->pos[r] = (ptrdiff_t)run_lower_bound(tree, run,
+						      (size_t)itor->pos[r],
+						      key);
+    }
+    return itor_pick(itor);
+}
+
+const void*
+lsmtree_itor_key(const lsmtree_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    if (itor->cur == SRC_NONE)
+	return NULL;
+    if (itor->cur == SRC_MEM)
+	return skiplist_itor_key(itor->mem);
+    return itor->tree->runs[itor->cur]->entries[itor->pos[itor->cur]].key;
+}
+
+void**
+lsmtree_itor_data(lsmtree_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    if (itor->cur == SRC_NONE)
+	return NULL;
+    if (itor->cur == SRC_MEM)
+	return skiplist_itor_data(itor->mem);
+    return &itor->tree->runs[itor->cur]->entries[itor->pos[itor->cur]].datum;
+}
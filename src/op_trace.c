@@ -0,0 +1,568 @@
+/*
+ * libdict -- operation trace implementation.
+ *
+ * Copyright (c) 2001-2011, Farooq Mela
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *    This product includes software developed by Farooq Mela.
+ * 4. Neither the name of the Farooq Mela nor the
+ *    names of contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY FAROOQ MELA ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL FAROOQ MELA BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * The trace file starts with an 8-byte magic number and a byte that is 1 if
+ * keys are serialized and 0 if they are IDs, followed by records. Each record
+ * is a byte holding the operation in its low two bits and the result plus one
+ * in the next two; then, except for a clear, the key, as its length and
+ * bytes or as its ID; then the nanoseconds since the previous record started.
+ * Lengths, IDs and times are unsigned LEB128 varints.
+ */
+
+#define _POSIX_C_SOURCE 200809L	    /* For clock_gettime(). */
+
+#include "op_trace.h"
+
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "dict_private.h"
+
+#define TRACE_MAGIC	    "libdictT"
+#define TRACE_MAGIC_SIZE    8
+#define TRACE_BUFFER_SIZE   65536
+#define VARINT_MAX	    10	    /* Bytes in the longest 64-bit varint. */
+
+struct op_trace {
+    dict*		    dct;
+    int			    fd;
+    op_trace_encode_func    key_encode;
+    uint64_t		    start;	/* Clock reading at creation. */
+    uint64_t		    last;	/* Start of the last record. */
+    size_t		    records;
+    bool		    failed;	/* A write failed; records dropped. */
+    unsigned char*	    buf;
+    size_t		    len;
+    size_t		    cap;
+    size_t		    open;	/* Bytes of an unfinished record. */
+    size_t		    mod_count;	/* Keys added or removed through it. */
+};
+
+struct op_trace_reader {
+    int			    fd;
+    bool		    keys;
+    uint64_t		    nsec;
+    unsigned char*	    buf;
+    size_t		    pos;
+    size_t		    end;
+    size_t		    cap;
+};
+
+static size_t op_trace_mod_count(const op_trace* trace);
+
+static dict_vtable op_trace_vtable = {
+    (dict_inew_func)	    op_trace_itor_new,
+    (dict_dfree_func)	    op_trace_free,
+    (dict_insert_func)	    op_trace_insert,
+    (dict_search_func)	    op_trace_search,
+    (dict_remove_func)	    op_trace_remove,
+    (dict_clear_func)	    op_trace_clear,
+    (dict_traverse_func)    op_trace_traverse,
+    (dict_count_func)	    op_trace_count,
+    (dict_verify_func)	    op_trace_verify,
+    (dict_clone_func)	    op_trace_clone,
+    (dict_remove_many_func) NULL,/* op_trace_remove_many not implemented yet */
+    (dict_remove_if_func)   NULL,/* op_trace_remove_if not implemented yet */
+    (dict_mod_count_func)   op_trace_mod_count,
+    (dict_export_func)	    NULL,/* op_trace_export not implemented yet */
+    (dict_export_all_func)  NULL,/* op_trace_export_all not implemented yet */
+};
+
+static uint64_t
+clock_nsec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+static inline size_t
+put_varint(unsigned char* p, uint64_t v)
+{
+    size_t n = 0;
+    while (v >= 0x80) {
+	p[n++] = (unsigned char)(v | 0x80);
+	v >>= 7;
+    }
+    p[n++] = (unsigned char)v;
+    return n;
+}
+
+/* Decodes the varint of at most |size| bytes at |p| into |v|, returning its
+ * length, or 0 if it is cut short or too long. */
+static inline size_t
+get_varint(const unsigned char* p, size_t size, uint64_t* v)
+{
+    uint64_t value = 0;
+    for (size_t n = 0; n < size && n < VARINT_MAX; n++) {
+	value |= (uint64_t)(p[n] & 0x7F) << (7 * n);
+	if (!(p[n] & 0x80)) {
+	    *v = value;
+	    return n + 1;
+	}
+    }
+    return 0;
+}
+
+static bool
+write_full(int fd, const unsigned char* p, size_t size)
+{
+    while (size) {
+	ssize_t n = write(fd, p, size);
+	if (n < 0 && errno == EINTR)
+	    continue;
+	if (n <= 0)
+	    return false;
+	p += n;
+	size -= (size_t)n;
+    }
+    return true;
+}
+
+/* Makes room in the buffer for |size| bytes past the finished records, which
+ * are written out first if need be. */
+static bool
+buffer_reserve(op_trace* trace, size_t size)
+{
+    if (trace->cap - trace->len >= size)
+	return true;
+    if (trace->len) {
+	if (!write_full(trace->fd, trace->buf, trace->len))
+	    return false;
+	trace->len = 0;
+    }
+    if (trace->cap >= size)
+	return true;
+    unsigned char* buf = MALLOC(size);
+    if (!buf)
+	return false;
+    FREE(trace->buf);
+    trace->buf = buf;
+    trace->cap = size;
+    return true;
+}
+
+/* Starts a record of |op| on |key| at the end of the buffer, returning false
+ * if records are being dropped. The key is written before the operation,
+ * since a removal may free it. */
+static bool
+record_start(op_trace* trace, dict_op op, const void* key)
+{
+    ASSERT(trace->open == 0);
+
+    if (trace->failed)
+	return false;
+    size_t need = 1 + 2 * VARINT_MAX;
+    for (;;) {
+	if (!buffer_reserve(trace, need)) {
+	    trace->failed = true;
+	    return false;
+	}
+	unsigned char* rec = trace->buf + trace->len;
+	rec[0] = (unsigned char)op;
+	size_t n = 1;
+	if (op == DICT_OP_CLEAR) {
+	    /* No key. */
+	} else if (!trace->key_encode) {
+	    n += put_varint(rec + n, (uint64_t)(uintptr_t)key);
+	} else {
+	    /* Serialize past the longest length, then move the bytes up. */
+	    const size_t room = trace->cap - trace->len - 1 - 2 * VARINT_MAX;
+	    const size_t klen = trace->key_encode(key, rec + 1 + VARINT_MAX,
+						  room);
+	    if (klen > room) {
+		need = 1 + 2 * VARINT_MAX + klen;
+		continue;
+	    }
+	    n += put_varint(rec + n, klen);
+	    memmove(rec + n, rec + 1 + VARINT_MAX, klen);
+	    n += klen;
+	}
+	trace->open = n;
+	return true;
+    }
+}
+
+/* Adds |result| and the time since the last record to the record that was
+ * started for an operation that began at |nsec|. */
+static void
+record_finish(op_trace* trace, int result, uint64_t nsec)
+{
+    ASSERT(trace->open > 0);
+    ASSERT(result >= -1 && result <= 1);
+
+    unsigned char* rec = trace->buf + trace->len;
+    rec[0] |= (unsigned char)((result + 1) << 2);
+    const size_t n = put_varint(rec + trace->open, nsec - trace->last);
+    trace->last = nsec;
+    trace->len += trace->open + n;
+    trace->open = 0;
+    trace->records++;
+}
+
+/* Returns the time since the trace was created, for a record that has been
+ * started, or 0 if none was. */
+static inline uint64_t
+record_clock(const op_trace* trace)
+{
+    return trace->open ? clock_nsec() - trace->start : 0;
+}
+
+op_trace*
+op_trace_new(dict* dct, const char* path, op_trace_encode_func key_encode)
+{
+    ASSERT(dct != NULL);
+    ASSERT(path != NULL);
+
+    op_trace* trace = MALLOC(sizeof(*trace));
+    if (!trace)
+	return NULL;
+    trace->dct = dct;
+    trace->key_encode = key_encode;
+    trace->last = 0;
+    trace->records = 0;
+    trace->failed = false;
+    trace->len = 0;
+    trace->cap = TRACE_BUFFER_SIZE;
+    trace->open = 0;
+    trace->mod_count = 0;
+    trace->buf = MALLOC(trace->cap);
+    trace->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (!trace->buf || trace->fd < 0) {
+	if (trace->fd >= 0)
+	    close(trace->fd);
+	FREE(trace->buf);
+	FREE(trace);
+	return NULL;
+    }
+    memcpy(trace->buf, TRACE_MAGIC, TRACE_MAGIC_SIZE);
+    trace->buf[TRACE_MAGIC_SIZE] = key_encode != NULL;
+    trace->len = TRACE_MAGIC_SIZE + 1;
+    trace->start = clock_nsec();
+    return trace;
+}
+
+dict*
+op_trace_dict_new(dict* dct, const char* path, op_trace_encode_func key_encode)
+{
+    dict* tdct = MALLOC(sizeof(*tdct));
+    if (tdct) {
+	if (!(tdct->_object = op_trace_new(dct, path, key_encode))) {
+	    FREE(tdct);
+	    return NULL;
+	}
+	tdct->_vtable = &op_trace_vtable;
+    }
+    return tdct;
+}
+
+size_t
+op_trace_free(op_trace* trace)
+{
+    ASSERT(trace != NULL);
+
+    op_trace_flush(trace);
+    close(trace->fd);
+    const size_t count = dict_free(trace->dct);
+    FREE(trace->buf);
+    FREE(trace);
+    return count;
+}
+
+op_trace*
+op_trace_clone(op_trace* trace, dict_key_datum_clone_func clone_func)
+{
+    ASSERT(trace != NULL);
+
+    /* A clone would need a trace file of its own. */
+    (void)clone_func;
+    return NULL;
+}
+
+void**
+op_trace_insert(op_trace* trace, void* key, bool* inserted)
+{
+    ASSERT(trace != NULL);
+
+    record_start(trace, DICT_OP_INSERT, key);
+    const uint64_t nsec = record_clock(trace);
+    bool added = false;
+    void** datum = dict_insert(trace->dct, key, &added);
+    if (trace->open)
+	record_finish(trace, datum ? added : -1, nsec);
+    if (added)
+	trace->mod_count++;
+    if (inserted)
+	*inserted = added;
+    return datum;
+}
+
+void*
+op_trace_search(op_trace* trace, const void* key)
+{
+    ASSERT(trace != NULL);
+
+    record_start(trace, DICT_OP_SEARCH, key);
+    const uint64_t nsec = record_clock(trace);
+    void* datum = dict_search(trace->dct, key);
+    if (trace->open)
+	record_finish(trace, datum != NULL, nsec);
+    return datum;
+}
+
+bool
+op_trace_remove(op_trace* trace, const void* key)
+{
+    ASSERT(trace != NULL);
+
+    record_start(trace, DICT_OP_REMOVE, key);
+    const uint64_t nsec = record_clock(trace);
+    const bool removed = dict_remove(trace->dct, key);
+    if (trace->open)
+	record_finish(trace, removed, nsec);
+    if (removed)
+	trace->mod_count++;
+    return removed;
+}
+
+size_t
+op_trace_clear(op_trace* trace)
+{
+    ASSERT(trace != NULL);
+
+    record_start(trace, DICT_OP_CLEAR, NULL);
+    const uint64_t nsec = record_clock(trace);
+    const size_t count = dict_clear(trace->dct);
+    if (trace->open)
+	record_finish(trace, 1, nsec);
+    trace->mod_count++;
+    return count;
+}
+
+size_t
+op_trace_traverse(op_trace* trace, dict_visit_func visit)
+{
+    ASSERT(trace != NULL);
+
+    return dict_traverse(trace->dct, visit);
+}
+
+size_t
+op_trace_count(const op_trace* trace)
+{
+    ASSERT(trace != NULL);
+
+    return dict_count(trace->dct);
+}
+
+/* Changes made through the trace are counted here as well, in case the traced
+ * dictionary does not count its own. */
+static size_t
+op_trace_mod_count(const op_trace* trace)
+{
+    ASSERT(trace != NULL);
+
+    return trace->mod_count + dict_mod_count(trace->dct);
+}
+
+bool
+op_trace_verify(const op_trace* trace)
+{
+    ASSERT(trace != NULL);
+
+    VERIFY(trace->len <= trace->cap);
+    VERIFY(trace->open == 0);
+    return dict_verify(trace->dct);
+}
+
+dict_itor*
+op_trace_itor_new(op_trace* trace)
+{
+    ASSERT(trace != NULL);
+
+    return dict_itor_new(trace->dct);
+}
+
+bool
+op_trace_flush(op_trace* trace)
+{
+    ASSERT(trace != NULL);
+
+    if (trace->failed)
+	return false;
+    if (trace->len) {
+	if (!write_full(trace->fd, trace->buf, trace->len)) {
+	    trace->failed = true;
+	    return false;
+	}
+	trace->len = 0;
+    }
+    return true;
+}
+
+size_t
+op_trace_records(const op_trace* trace)
+{
+    ASSERT(trace != NULL);
+
+    return trace->records;
+}
+
+/* Tries to have |size| bytes buffered past the read position, returning how
+ * many there are, which is fewer only at the end of the file. */
+static size_t
+reader_fill(op_trace_reader* reader, size_t size)
+{
+    if (reader->end - reader->pos >= size)
+	return reader->end - reader->pos;
+    memmove(reader->buf, reader->buf + reader->pos, reader->end - reader->pos);
+    reader->end -= reader->pos;
+    reader->pos = 0;
+    if (reader->cap < size) {
+	unsigned char* buf = MALLOC(size);
+	if (!buf)
+	    return reader->end;
+	memcpy(buf, reader->buf, reader->end);
+	FREE(reader->buf);
+	reader->buf = buf;
+	reader->cap = size;
+    }
+    while (reader->end < size) {
+	ssize_t n = read(reader->fd, reader->buf + reader->end,
+			 reader->cap - reader->end);
+	if (n < 0 && errno == EINTR)
+	    continue;
+	if (n <= 0)
+	    break;
+	reader->end += (size_t)n;
+    }
+    return reader->end;
+}
+
+op_trace_reader*
+op_trace_reader_open(const char* path)
+{
+    ASSERT(path != NULL);
+
+    op_trace_reader* reader = MALLOC(sizeof(*reader));
+    if (!reader)
+	return NULL;
+    reader->nsec = 0;
+    reader->pos = reader->end = 0;
+    reader->cap = TRACE_BUFFER_SIZE;
+    reader->buf = MALLOC(reader->cap);
+    reader->fd = open(path, O_RDONLY);
+    if (!reader->buf || reader->fd < 0 ||
+	reader_fill(reader, TRACE_MAGIC_SIZE + 1) < TRACE_MAGIC_SIZE + 1 ||
+	memcmp(reader->buf, TRACE_MAGIC, TRACE_MAGIC_SIZE) != 0 ||
+	reader->buf[TRACE_MAGIC_SIZE] > 1) {
+	if (reader->fd >= 0)
+	    close(reader->fd);
+	FREE(reader->buf);
+	FREE(reader);
+	return NULL;
+    }
+    reader->keys = reader->buf[TRACE_MAGIC_SIZE];
+    reader->pos = TRACE_MAGIC_SIZE + 1;
+    return reader;
+}
+
+void
+op_trace_reader_close(op_trace_reader* reader)
+{
+    ASSERT(reader != NULL);
+
+    close(reader->fd);
+    FREE(reader->buf);
+    FREE(reader);
+}
+
+bool
+op_trace_reader_keys(const op_trace_reader* reader)
+{
+    ASSERT(reader != NULL);
+
+    return reader->keys;
+}
+
+bool
+op_trace_reader_next(op_trace_reader* reader, op_trace_record* record)
+{
+    ASSERT(reader != NULL);
+    ASSERT(record != NULL);
+
+    size_t avail = reader_fill(reader, 1 + 2 * VARINT_MAX);
+    if (avail == 0)
+	return false;
+    const unsigned char* p = reader->buf + reader->pos;
+    const unsigned op = p[0] & 3, result = (p[0] >> 2) & 3;
+    if (p[0] >> 4 || result > 2)
+	return false;
+    size_t n = 1;
+    record->op = (dict_op)op;
+    record->result = (int)result - 1;
+    record->key = NULL;
+    record->key_size = 0;
+    record->key_id = 0;
+    if (op != DICT_OP_CLEAR) {
+	uint64_t v;
+	size_t len = get_varint(p + n, avail - n, &v);
+	if (!len)
+	    return false;
+	n += len;
+	if (!reader->keys) {
+	    record->key_id = v;
+	} else {
+	    if (v > SIZE_MAX - n - VARINT_MAX)
+		return false;
+	    /* Buffer the key along with the time that follows it. */
+	    avail = reader_fill(reader, n + (size_t)v + VARINT_MAX);
+	    if (avail < n + v)
+		return false;
+	    p = reader->buf + reader->pos;
+	    record->key = p + n;
+	    record->key_size = (size_t)v;
+	    n += (size_t)v;
+	}
+    }
+    uint64_t delta;
+    const size_t len = get_varint(p + n, avail - n, &delta);
+    if (!len)
+	return false;
+    reader->pos += n + len;
+    reader->nsec += delta;
+    record->nsec = reader->nsec;
+    return true;
+}
@@ -0,0 +1,764 @@
+/*
+ * libdict -- learned index implementation.
+ *
+ * Copyright (c) 2001-2011, Farooq Mela
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *    This product includes software developed by Farooq Mela.
+ * 4. Neither the name of the Farooq Mela nor the
+ *    names of contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY FAROOQ MELA ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL FAROOQ MELA BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * The keys and data are kept in two arrays. Level 0 of the model divides the
+ * keys into segments, each of which predicts the position of a key from its
+ * distance to the segment's first key along a line; segments are fitted
+ * greedily, each extended for as long as some slope keeps every one of its
+ * keys within |epsilon| of its position (a shrinking cone of slopes). Level 1
+ * divides the first keys of the level 0 segments in the same way, and so on,
+ * up to a level of one segment.
+ *
+ * Predictions are clamped to the positions the segment covers, and each
+ * level records the greatest error of any prediction it makes for its own
+ * keys, measured after fitting so that rounding cannot make it wrong. Since
+ * predictions never decrease as keys increase, the predecessor of any key,
+ * present or not, then lies within that error of its prediction (give or
+ * take one), and a lookup narrows its search on each level to such a window.
+ */
+
+#include "pgm_index.h"
+
+#include <string.h>	    /* For memcpy() */
+#include "dict_private.h"
+
+#define PGM_MAX_HEIGHT	    64	    /* Each segment covers at least 2 keys. */
+
+typedef struct {
+    uintptr_t		    key;	/* The first key it covers. */
+    size_t		    start;	/* The position of that key. */
+    double		    slope;
+} pgm_segment;
+
+typedef struct {
+    pgm_segment*	    segs;	/* Followed by a sentinel segment. */
+    size_t		    count;
+    size_t		    error;
+} pgm_level;
+
+struct pgm_index {
+    uintptr_t*		    keys;
+    void**		    data;
+    size_t		    count;
+    size_t		    epsilon;
+    dict_delete_func	    del_func;
+    unsigned		    height;
+    pgm_level		    levels[PGM_MAX_HEIGHT];
+};
+
+#define POS_NONE	    ((size_t)-1)
+
+struct pgm_itor {
+    pgm_index*		    index;
+    size_t		    pos;
+};
+
+static dict_vtable pgm_index_vtable = {
+    (dict_inew_func)	    pgm_dict_itor_new,
+    (dict_dfree_func)	    pgm_index_free,
+    (dict_insert_func)	    pgm_index_insert,
+    (dict_search_func)	    pgm_index_search,
+    (dict_remove_func)	    pgm_index_remove,
+    (dict_clear_func)	    pgm_index_clear,
+    (dict_traverse_func)    pgm_index_traverse,
+    (dict_count_func)	    pgm_index_count,
+    (dict_verify_func)	    pgm_index_verify,
+    (dict_clone_func)	    pgm_index_clone,
+    (dict_remove_many_func) NULL,/* Nothing can be removed. */
+    (dict_remove_if_func)   NULL,/* Nothing can be removed. */
+    (dict_mod_count_func)   pgm_index_count,/* Only a clear changes it. */
+    (dict_export_func)	    pgm_index_export,
+    (dict_export_all_func)  NULL,/* pgm_index_export_all not implemented yet */
+};
+
+static itor_vtable pgm_itor_vtable = {
+    (dict_ifree_func)	    pgm_itor_free,
+    (dict_valid_func)	    pgm_itor_valid,
+    (dict_invalidate_func)  pgm_itor_invalidate,
+    (dict_next_func)	    pgm_itor_next,
+    (dict_prev_func)	    pgm_itor_prev,
+    (dict_nextn_func)	    pgm_itor_nextn,
+    (dict_prevn_func)	    pgm_itor_prevn,
+    (dict_first_func)	    pgm_itor_first,
+    (dict_last_func)	    pgm_itor_last,
+    (dict_key_func)	    pgm_itor_key,
+    (dict_data_func)	    pgm_itor_data,
+    (dict_iremove_func)	    NULL,/* Nothing can be removed. */
+    (dict_icompare_func)    NULL,/* pgm_itor_compare not implemented */
+    (dict_iseek_func)	    pgm_itor_seek
+};
+
+/* Predicts the position of |key|, which is not less than the segment's first
+ * key, among those the segment covers; the next segment starts where it
+ * ends. Never decreases as |key| increases. */
+static GCC_INLINE size_t
+predict(const pgm_segment* seg, uintptr_t key)
+{
+    const size_t last = seg[1].start - 1 - seg->start;
+    const double offset = seg->slope * (double)(key - seg->key);
+    return seg->start + (offset < (double)last ? (size_t)offset : last);
+}
+
+/* The keys a level is fitted to: those of the index, or the first keys of
+ * the segments on the level below, which begin each segment. */
+#define KEY_AT(keys, stride, i) \
+    (*(const uintptr_t*)((const char*)(keys) + (i) * (stride)))
+
+/* Fits segments with slopes keeping each of the |count| keys at |keys| within
+ * |epsilon| of its position, storing them into |segs| unless it is NULL, and
+ * returns their number. A sentinel follows the segments stored. */
+static size_t
+fit(const void* keys, size_t stride, size_t count, size_t epsilon,
+    pgm_segment* segs)
+{
+    size_t nsegs = 0;
+    for (size_t start = 0; start < count;) {
+	const uintptr_t first = KEY_AT(keys, stride, start);
+	double lo = 0, hi = -1;	    /* No bound above yet. */
+	size_t end = start + 1;
+	for (; end < count; end++) {
+	    const double dx = (double)(KEY_AT(keys, stride, end) - first);
+	    const double dy = (double)(end - start);
+	    const double new_lo = (dy - (double)epsilon) / dx;
+	    const double new_hi = (dy + (double)epsilon) / dx;
+	    if (hi >= 0 && (new_lo > hi || new_hi < lo))
+		break;
+	    if (new_lo > lo)
+		lo = new_lo;
+	    if (hi < 0 || new_hi < hi)
+		hi = new_hi;
+	}
+	if (segs) {
+	    segs[nsegs].key = first;
+	    segs[nsegs].start = start;
+	    segs[nsegs].slope = hi < 0 ? 0 : (lo + hi) / 2;
+	}
+	nsegs++;
+	start = end;
+    }
+    if (segs) {
+	segs[nsegs].key = UINTPTR_MAX;
+	segs[nsegs].start = count;
+	segs[nsegs].slope = 0;
+    }
+    return nsegs;
+}
+
+/* Returns the greatest distance between the position of any of the keys at
+ * |keys| and its prediction by the segment covering it. */
+static size_t
+measure(const void* keys, size_t stride, const pgm_segment* segs,
+	size_t nsegs)
+{
+    size_t error = 0;
+    for (size_t s = 0; s < nsegs; s++) {
+	for (size_t i = segs[s].start; i < segs[s + 1].start; i++) {
+	    const size_t p = predict(&segs[s], KEY_AT(keys, stride, i));
+	    const size_t e = p > i ? p - i : i - p;
+	    if (error < e)
+		error = e;
+	}
+    }
+    return error;
+}
+
+static void
+levels_free(pgm_index* index)
+{
+    for (unsigned l = 0; l < index->height; l++)
+	FREE(index->levels[l].segs);
+    index->height = 0;
+}
+
+/* Builds the levels of the model over the keys of |index|. */
+static bool
+levels_build(pgm_index* index)
+{
+    const void* keys = index->keys;
+    size_t stride = sizeof(*index->keys);
+    size_t count = index->count;
+    while (count > 0) {
+	ASSERT(index->height < PGM_MAX_HEIGHT);
+	pgm_level* level = &index->levels[index->height];
+	level->count = fit(keys, stride, count, index->epsilon, NULL);
+	level->segs = MALLOC((level->count + 1) * sizeof(pgm_segment));
+	if (!level->segs) {
+	    levels_free(index);
+	    return false;
+	}
+	index->height++;
+	fit(keys, stride, count, index->epsilon, level->segs);
+	level->error = measure(keys, stride, level->segs, level->count);
+	if (level->count == 1)
+	    break;
+	keys = level->segs;
+	stride = sizeof(pgm_segment);
+	count = level->count;
+    }
+    return true;
+}
+
+static pgm_index*
+index_alloc(size_t count, size_t epsilon, dict_delete_func del_func)
+{
+    pgm_index* index = MALLOC(sizeof(*index));
+    if (!index)
+	return NULL;
+    index->keys = count ? MALLOC(count * sizeof(*index->keys)) : NULL;
+    index->data = count ? MALLOC(count * sizeof(*index->data)) : NULL;
+    if (count && (!index->keys || !index->data)) {
+	FREE(index->keys);
+	FREE(index->data);
+	FREE(index);
+	return NULL;
+    }
+    index->count = count;
+    index->epsilon = epsilon;
+    index->del_func = del_func;
+    index->height = 0;
+    return index;
+}
+
+static void
+index_release(pgm_index* index)
+{
+    levels_free(index);
+    FREE(index->keys);
+    FREE(index->data);
+    FREE(index);
+}
+
+/* Builds the model once the keys and data are in place, failing if the keys
+ * do not increase. */
+static pgm_index*
+index_finish(pgm_index* index)
+{
+    for (size_t i = 1; i < index->count; i++) {
+	if (index->keys[i - 1] >= index->keys[i]) {
+	    index_release(index);
+	    return NULL;
+	}
+    }
+    if (!levels_build(index)) {
+	index_release(index);
+	return NULL;
+    }
+    return index;
+}
+
+pgm_index*
+pgm_index_new(void* const* keys, void* const* data, size_t count,
+	      size_t epsilon, dict_delete_func del_func)
+{
+    ASSERT(keys != NULL || count == 0);
+
+    pgm_index* index = index_alloc(count, epsilon, del_func);
+    if (!index)
+	return NULL;
+    for (size_t i = 0; i < count; i++) {
+	index->keys[i] = (uintptr_t)keys[i];
+	index->data[i] = data ? data[i] : NULL;
+    }
+    return index_finish(index);
+}
+
+pgm_index*
+pgm_index_from_dict(dict* dct, size_t epsilon, dict_delete_func del_func)
+{
+    ASSERT(dct != NULL);
+
+    pgm_index* index = index_alloc(dict_count(dct), epsilon, del_func);
+    if (!index)
+	return NULL;
+    dict_itor* itor = dict_itor_new(dct);
+    if (!itor) {
+	index_release(index);
+	return NULL;
+    }
+    size_t i = 0;
+    for (dict_itor_first(itor); dict_itor_valid(itor) && i < index->count;
+	 dict_itor_next(itor), i++) {
+	index->keys[i] = (uintptr_t)dict_itor_key(itor);
+	index->data[i] = *dict_itor_data(itor);
+    }
+    dict_itor_free(itor);
+    ASSERT(i == index->count);
+    return index_finish(index);
+}
+
+static dict*
+dict_wrap(pgm_index* index)
+{
+    if (!index)
+	return NULL;
+    dict* dct = MALLOC(sizeof(*dct));
+    if (!dct) {
+	index_release(index);
+	return NULL;
+    }
+    dct->_object = index;
+    dct->_vtable = &pgm_index_vtable;
+    return dct;
+}
+
+dict*
+pgm_dict_new(void* const* keys, void* const* data, size_t count,
+	     size_t epsilon, dict_delete_func del_func)
+{
+    return dict_wrap(pgm_index_new(keys, data, count, epsilon, del_func));
+}
+
+dict*
+pgm_dict_from_dict(dict* dct, size_t epsilon, dict_delete_func del_func)
+{
+    return dict_wrap(pgm_index_from_dict(dct, epsilon, del_func));
+}
+
+size_t
+pgm_index_free(pgm_index* index)
+{
+    ASSERT(index != NULL);
+
+    const size_t count = pgm_index_clear(index);
+    index_release(index);
+    return count;
+}
+
+pgm_index*
+pgm_index_clone(pgm_index* index, dict_key_datum_clone_func clone_func)
+{
+    ASSERT(index != NULL);
+
+    pgm_index* clone = index_alloc(index->count, index->epsilon,
+				   index->del_func);
+    if (!clone)
+	return NULL;
+    if (index->count) {
+	memcpy(clone->keys, index->keys, index->count * sizeof(*index->keys));
+	memcpy(clone->data, index->data, index->count * sizeof(*index->data));
+    }
+    for (unsigned l = 0; l < index->height; l++) {
+	const pgm_level* level = &index->levels[l];
+	const size_t size = (level->count + 1) * sizeof(pgm_segment);
+	if (!(clone->levels[l].segs = MALLOC(size))) {
+	    index_release(clone);
+	    return NULL;
+	}
+	memcpy(clone->levels[l].segs, level->segs, size);
+	clone->levels[l].count = level->count;
+	clone->levels[l].error = level->error;
+	clone->height++;
+    }
+    if (clone_func) {
+	for (size_t i = 0; i < clone->count; i++) {
+	    void* key = (void*)clone->keys[i];
+	    clone_func(&key, &clone->data[i]);
+	    ASSERT((uintptr_t)key == clone->keys[i]);
+	}
+    }
+    return clone;
+}
+
+/* Returns the position within [lo, hi] of the last of |keys| not greater
+ * than |key|, or lo - 1 if there is none. */
+static GCC_INLINE size_t
+key_floor(const uintptr_t* keys, size_t lo, size_t hi, uintptr_t key)
+{
+    while (lo <= hi) {
+	const size_t mid = lo + (hi - lo) / 2;
+	if (keys[mid] <= key)
+	    lo = mid + 1;
+	else if (mid == 0)
+	    break;
+	else
+	    hi = mid - 1;
+    }
+    return lo - 1;
+}
+
+/* Likewise for the first keys of |segs|, of which there is always one. */
+static GCC_INLINE size_t
+segment_floor(const pgm_segment* segs, size_t lo, size_t hi, uintptr_t key)
+{
+    while (lo < hi) {
+	const size_t mid = hi - (hi - lo) / 2;
+	if (segs[mid].key <= key)
+	    lo = mid;
+	else
+	    hi = mid - 1;
+    }
+    return lo;
+}
+
+/* Clamps the window of positions about |seg|'s prediction for |key| to those
+ * the segment covers. */
+static GCC_INLINE void
+window(const pgm_segment* seg, size_t error, uintptr_t key,
+       size_t* lo, size_t* hi)
+{
+    const size_t p = predict(seg, key);
+    *lo = p - seg->start > error + 1 ? p - error - 1 : seg->start;
+    *hi = seg[1].start - 1 - p > error ? p + error : seg[1].start - 1;
+}
+
+/* Returns the position of the last key not greater than |key|, or POS_NONE if
+ * every key is greater. */
+static size_t
+index_floor(const pgm_index* index, uintptr_t key)
+{
+    if (index->count == 0 || key < index->keys[0])
+	return POS_NONE;
+    size_t s = 0;
+    for (unsigned l = index->height - 1; l > 0; l--) {
+	const pgm_level* level = &index->levels[l];
+	size_t lo, hi;
+	window(&level->segs[s], level->error, key, &lo, &hi);
+	s = segment_floor(index->levels[l - 1].segs, lo, hi, key);
+    }
+    const pgm_level* level = &index->levels[0];
+    size_t lo, hi;
+    window(&level->segs[s], level->error, key, &lo, &hi);
+    return key_floor(index->keys, lo, hi, key);
+}
+
+void**
+pgm_index_insert(pgm_index* index, void* key, bool* inserted)
+{
+    ASSERT(index != NULL);
+
+    const size_t pos = index_floor(index, (uintptr_t)key);
+    if (pos == POS_NONE || index->keys[pos] != (uintptr_t)key)
+	return NULL;
+    if (inserted)
+	*inserted = false;
+    return &index->data[pos];
+}
+
+void*
+pgm_index_search(pgm_index* index, const void* key)
+{
+    ASSERT(index != NULL);
+
+    const size_t pos = index_floor(index, (uintptr_t)key);
+    if (pos == POS_NONE || index->keys[pos] != (uintptr_t)key) {
+	TRACE_OP(search, "pgm", index, key, 0, 0);
+	return NULL;
+    }
+    TRACE_OP(search, "pgm", index, key, 0, 1);
+    return index->data[pos];
+}
+
+bool
+pgm_index_remove(pgm_index* index, const void* key)
+{
+    ASSERT(index != NULL);
+
+    (void)key;
+    return false;
+}
+
+size_t
+pgm_index_clear(pgm_index* index)
+{
+    ASSERT(index != NULL);
+
+    const size_t count = index->count;
+    if (index->del_func)
+	for (size_t i = 0; i < count; i++)
+	    index->del_func((void*)index->keys[i], index->data[i]);
+    levels_free(index);
+    index->count = 0;
+    return count;
+}
+
+size_t
+pgm_index_traverse(pgm_index* index, dict_visit_func visit)
+{
+    ASSERT(index != NULL);
+    ASSERT(visit != NULL);
+
+    size_t count = 0;
+    while (count < index->count) {
+	const size_t i = count++;
+	if (!visit((const void*)index->keys[i], index->data[i]))
+	    break;
+    }
+    return count;
+}
+
+size_t
+pgm_index_export(pgm_index* index, void** keys, void** data, size_t max,
+		 dict_export_pos* pos)
+{
+    ASSERT(index != NULL);
+    ASSERT(pos != NULL);
+
+    const size_t start = pos->index;
+    const size_t n = MIN(max, index->count - start);
+    if (keys)
+	for (size_t i = 0; i < n; i++)
+	    keys[i] = (void*)index->keys[start + i];
+    if (data)
+	memcpy(data, index->data + start, n * sizeof(*data));
+    pos->index += n;
+    return n;
+}
+
+size_t
+pgm_index_count(const pgm_index* index)
+{
+    ASSERT(index != NULL);
+
+    return index->count;
+}
+
+size_t
+pgm_index_height(const pgm_index* index)
+{
+    ASSERT(index != NULL);
+
+    return index->height;
+}
+
+size_t
+pgm_index_segments(const pgm_index* index)
+{
+    ASSERT(index != NULL);
+
+    return index->height ? index->levels[0].count : 0;
+}
+
+bool
+pgm_index_verify(const pgm_index* index)
+{
+    ASSERT(index != NULL);
+
+    for (size_t i = 1; i < index->count; i++)
+	VERIFY(index->keys[i - 1] < index->keys[i]);
+    VERIFY((index->height == 0) == (index->count == 0));
+    const void* keys = index->keys;
+    size_t stride = sizeof(*index->keys);
+    size_t count = index->count;
+    for (unsigned l = 0; l < index->height; l++) {
+	const pgm_level* level = &index->levels[l];
+	VERIFY(level->count > 0);
+	VERIFY(level->count <= count);
+	VERIFY((l + 1 == index->height) == (level->count == 1));
+	VERIFY(level->segs[0].start == 0);
+	VERIFY(level->segs[level->count].start == count);
+	for (size_t s = 0; s < level->count; s++) {
+	    VERIFY(level->segs[s].start < level->segs[s + 1].start);
+	    VERIFY(level->segs[s].key ==
+		   KEY_AT(keys, stride, level->segs[s].start));
+	    VERIFY(level->segs[s].slope >= 0);
+	}
+	VERIFY(measure(keys, stride, level->segs, level->count) <=
+	       level->error);
+	keys = level->segs;
+	stride = sizeof(pgm_segment);
+	count = level->count;
+    }
+    /* Every key is found where it is. */
+    for (size_t i = 0; i < index->count; i++)
+	VERIFY(index_floor(index, index->keys[i]) == i);
+    return true;
+}
+
+pgm_itor*
+pgm_itor_new(pgm_index* index)
+{
+    ASSERT(index != NULL);
+
+    pgm_itor* itor = MALLOC(sizeof(*itor));
+    if (itor) {
+	itor->index = index;
+	itor->pos = POS_NONE;
+    }
+    return itor;
+}
+
+dict_itor*
+pgm_dict_itor_new(pgm_index* index)
+{
+    ASSERT(index != NULL);
+
+    dict_itor* itor = MALLOC(sizeof(*itor));
+    if (itor) {
+	if (!(itor->_itor = pgm_itor_new(index))) {
+	    FREE(itor);
+	    return NULL;
+	}
+	itor->_vtable = &pgm_itor_vtable;
+    }
+    return itor;
+}
+
+void
+pgm_itor_free(pgm_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    FREE(itor);
+}
+
+bool
+pgm_itor_valid(const pgm_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    return itor->pos != POS_NONE;
+}
+
+void
+pgm_itor_invalidate(pgm_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    itor->pos = POS_NONE;
+}
+
+bool
+pgm_itor_next(pgm_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    return pgm_itor_nextn(itor, 1);
+}
+
+bool
+pgm_itor_prev(pgm_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    return pgm_itor_prevn(itor, 1);
+}
+
+bool
+pgm_itor_nextn(pgm_itor* itor, size_t count)
+{
+    ASSERT(itor != NULL);
+
+    if (itor->pos != POS_NONE) {
+	if (count < itor->index->count - itor->pos)
+	    itor->pos += count;
+	else
+	    itor->pos = POS_NONE;
+    }
+    return itor->pos != POS_NONE;
+}
+
+bool
+pgm_itor_prevn(pgm_itor* itor, size_t count)
+{
+    ASSERT(itor != NULL);
+
+    if (itor->pos != POS_NONE) {
+	if (count <= itor->pos)
+	    itor->pos -= count;
+	else
+	    itor->pos = POS_NONE;
+    }
+    return itor->pos != POS_NONE;
+}
+
+bool
+pgm_itor_first(pgm_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    itor->pos = itor->index->count ? 0 : POS_NONE;
+    return itor->pos != POS_NONE;
+}
+
+bool
+pgm_itor_last(pgm_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    itor->pos = itor->index->count ? itor->index->count - 1 : POS_NONE;
+    return itor->pos != POS_NONE;
+}
+
+bool
+pgm_itor_search(pgm_itor* itor, const void* key)
+{
+    ASSERT(itor != NULL);
+
+    const pgm_index* index = itor->index;
+    const size_t pos = index_floor(index, (uintptr_t)key);
+    if (pos == POS_NONE || index->keys[pos] != (uintptr_t)key)
+	itor->pos = POS_NONE;
+    else
+	itor->pos = pos;
+    return itor->pos != POS_NONE;
+}
+
+bool
+pgm_itor_seek(pgm_itor* itor, const void* key)
+{
+    ASSERT(itor != NULL);
+
+    if (itor->pos == POS_NONE)
+	return false;
+    const uintptr_t* keys = itor->index->keys;
+    const size_t count = itor->index->count;
+    if (keys[itor->pos] >= (uintptr_t)key)
+	return true;
+    /* Gallop forward to bracket the key, then search the last gallop. */
+    size_t lo = itor->pos, step = 1;
+    while (step < count - lo && keys[lo + step] < (uintptr_t)key) {
+	lo += step;
+	step *= 2;
+    }
+    const size_t hi = step < count - lo ? lo + step : count - 1;
+    const size_t pos = key_floor(keys, lo, hi, (uintptr_t)key - 1) + 1;
+    itor->pos = pos < count ? pos : POS_NONE;
+    return itor->pos != POS_NONE;
+}
+
+const void*
+pgm_itor_key(const pgm_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    return itor->pos != POS_NONE ? (const void*)itor->index->keys[itor->pos]
+				 : NULL;
+}
+
+void**
+pgm_itor_data(pgm_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    return itor->pos != POS_NONE ? &itor->index->data[itor->pos] : NULL;
+}
@@ -40,6 +40,7 @@ typedef struct pr_node pr_node;
 struct pr_node {
     TREE_NODE_FIELDS(pr_node);
     unsigned		    weight;
+    void*		    datum;	/* Not allocated in a set. */
 };
 
 #define WEIGHT(n)	((n) ? (n)->weight : 1)
@@ -52,17 +53,26 @@ struct pr_itor {
     TREE_ITERATOR_FIELDS(pr_tree, pr_node);
 };
 
+/* A set's nodes end before the datum. */
+STATIC_ASSERT(set_node_size,
+	      offsetof(pr_node, datum) + sizeof(void*) == sizeof(pr_node));
+
 static dict_vtable pr_tree_vtable = {
     (dict_inew_func)	    pr_dict_itor_new,
     (dict_dfree_func)	    tree_free,
     (dict_insert_func)	    pr_tree_insert,
-    (dict_search_func)	    tree_search,
+    (dict_search_func)	    pr_tree_search,
     (dict_remove_func)	    pr_tree_remove,
     (dict_clear_func)	    tree_clear,
     (dict_traverse_func)    tree_traverse,
     (dict_count_func)	    tree_count,
     (dict_verify_func)	    pr_tree_verify,
     (dict_clone_func)	    pr_tree_clone,
+    (dict_remove_many_func) pr_tree_remove_many,
+    (dict_remove_if_func)   pr_tree_remove_if,
+    (dict_mod_count_func)   tree_mod_count,
+    (dict_export_func)	    pr_tree_export,
+    (dict_export_all_func)  pr_tree_export_all,
 };
 
 static itor_vtable pr_tree_itor_vtable = {
@@ -78,7 +88,8 @@ static itor_vtable pr_tree_itor_vtable = {
     (dict_key_func)	    tree_iterator_key,
     (dict_data_func)	    tree_iterator_data,
     (dict_iremove_func)	    NULL,/* pr_itor_remove not implemented yet */
-    (dict_icompare_func)    NULL /* pr_itor_compare not implemented yet */
+    (dict_icompare_func)    NULL,/* pr_itor_compare not implemented yet */
+    (dict_iseek_func)	    tree_iterator_seek
 };
 
 static unsigned	fixup(pr_tree* tree, pr_node* node);
@@ -87,7 +98,7 @@ static void	rot_right(pr_tree* tree, pr_node* node);
 static size_t	node_height(const pr_node* node);
 static size_t	node_mheight(const pr_node* node);
 static size_t	node_pathlen(const pr_node* node, size_t level);
-static pr_node*	node_new(void* key);
+static pr_node*	node_new(pr_tree* tree, void* key);
 
 pr_tree*
 pr_tree_new(dict_compare_func cmp_func, dict_delete_func del_func)
@@ -97,8 +108,12 @@ pr_tree_new(dict_compare_func cmp_func, dict_delete_func del_func)
 	tree->root = NULL;
 	tree->count = 0;
 	tree->cmp_func = cmp_func ? cmp_func : dict_ptr_cmp;
+	tree->keys_only = false;
+	tree->set_datum = NULL;
+	tree->datum_offset = offsetof(pr_node, datum);
 	tree->del_func = del_func;
 	tree->rotation_count = 0;
+	tree->mod_count = 0;
     }
     return tree;
 }
@@ -117,6 +132,29 @@ pr_dict_new(dict_compare_func cmp_func, dict_delete_func del_func)
     return dct;
 }
 
+pr_tree*
+pr_tree_new_set(dict_compare_func cmp_func, dict_delete_func del_func)
+{
+    pr_tree* tree = pr_tree_new(cmp_func, del_func);
+    if (tree)
+	tree->keys_only = true;
+    return tree;
+}
+
+dict*
+pr_dict_new_set(dict_compare_func cmp_func, dict_delete_func del_func)
+{
+    dict* dct = MALLOC(sizeof(*dct));
+    if (dct) {
+	if (!(dct->_object = pr_tree_new_set(cmp_func, del_func))) {
+	    FREE(dct);
+	    return NULL;
+	}
+	dct->_vtable = &pr_tree_vtable;
+    }
+    return dct;
+}
+
 size_t
 pr_tree_free(pr_tree* tree)
 {
@@ -132,7 +170,8 @@ pr_tree_clone(pr_tree* tree, dict_key_datum_clone_func clone_func)
 {
     ASSERT(tree != NULL);
 
-    return tree_clone(tree, sizeof(pr_tree), sizeof(pr_node), clone_func);
+    return tree_clone(tree, sizeof(pr_tree),
+		      SET_NODE_SIZE(tree, sizeof(pr_node)), clone_func);
 }
 
 void*
@@ -140,6 +179,8 @@ pr_tree_search(pr_tree* tree, const void* key)
 {
     ASSERT(tree != NULL);
 
+    size_t depth = TRACE_DEPTH(search, tree_search_depth(tree, key));
+
     pr_node* node = tree->root;
     while (node) {
 	int cmp = tree->cmp_func(key, node->key);
@@ -147,10 +188,13 @@ pr_tree_search(pr_tree* tree, const void* key)
 	    node = node->llink;
 	else if (cmp)
 	    node = node->rlink;
-	else
-	    return node->datum;
+	else {
+	    TRACE_OP(search, "pr", tree, key, depth, 1);
+	    return NODE_DATUM(tree, node);
+	}
     }
 
+    TRACE_OP(search, "pr", tree, key, depth, 0);
     return NULL;
 }
 
@@ -292,6 +336,8 @@ pr_tree_insert(pr_tree* tree, void* key, bool* inserted)
 {
     ASSERT(tree != NULL);
 
+    size_t depth = TRACE_DEPTH(insert, tree_search_depth(tree, key));
+
     int cmp = 0;
     pr_node* node = tree->root;
     pr_node* parent = NULL;
@@ -304,13 +350,16 @@ pr_tree_insert(pr_tree* tree, void* key, bool* inserted)
 	else {
 	    if (inserted)
 		*inserted = false;
-	    return &node->datum;
+	    TRACE_OP(insert, "pr", tree, key, depth, 0);
+	    return NODE_DATUM_SLOT(tree, node);
 	}
     }
 
-    pr_node *add = node_new(key);
-    if (!add)
+    pr_node *add = node_new(tree, key);
+    if (!add) {
+	TRACE_OP(insert, "pr", tree, key, depth, -1);
 	return NULL;
+    }
     if (inserted)
 	*inserted = true;
     if (!(add->parent = parent)) {
@@ -332,7 +381,9 @@ pr_tree_insert(pr_tree* tree, void* key, bool* inserted)
 	tree->rotation_count += rotations;
     }
     ++tree->count;
-    return &add->datum;
+    tree->mod_count++;
+    TRACE_OP(insert, "pr", tree, key, depth, 1);
+    return NODE_DATUM_SLOT(tree, add);
 }
 
 bool
@@ -341,6 +392,8 @@ pr_tree_remove(pr_tree* tree, const void* key)
     ASSERT(tree != NULL);
     ASSERT(key != NULL);
 
+    size_t depth = TRACE_DEPTH(remove, tree_search_depth(tree, key));
+
     pr_node* node = tree->root;
     while (node) {
 	int cmp = tree->cmp_func(key, node->key);
@@ -362,7 +415,8 @@ pr_tree_remove(pr_tree* tree, const void* key)
 		}
 		void* tmp;
 		SWAP(node->key, out->key, tmp);
-		SWAP(node->datum, out->datum, tmp);
+		if (!tree->keys_only)
+		    SWAP(node->datum, out->datum, tmp);
 		node = out;
 	    }
 	    ASSERT(!node->llink || !node->rlink);
@@ -381,9 +435,10 @@ pr_tree_remove(pr_tree* tree, const void* key)
 		tree->root = child;
 	    }
 	    if (tree->del_func)
-		tree->del_func(node->key, node->datum);
+		tree->del_func(node->key, NODE_DEL_DATUM(tree, node));
 	    FREE(node);
 	    --tree->count;
+	    tree->mod_count++;
 	    /* Now move up the tree, decrementing weights. */
 	    unsigned rotations = 0;
 	    while (parent) {
@@ -393,12 +448,63 @@ pr_tree_remove(pr_tree* tree, const void* key)
 		parent = up;
 	    }
 	    tree->rotation_count += rotations;
+	    TRACE_OP(remove, "pr", tree, key, depth, 1);
 	    return true;
 	}
     }
+    TRACE_OP(remove, "pr", tree, key, depth, 0);
     return false;
 }
 
+/* Set the balance information of a node of a rebuilt tree. */
+static void
+node_rebuild(void* Tree, void* Node, size_t depth, size_t lheight,
+	     size_t rheight)
+{
+    pr_node* node = Node;
+    (void)Tree;
+    (void)depth;
+    (void)lheight;
+    (void)rheight;
+
+    node->weight = WEIGHT(node->llink) + WEIGHT(node->rlink);
+}
+
+size_t
+pr_tree_remove_many(pr_tree* tree, const void** keys, size_t count)
+{
+    ASSERT(tree != NULL);
+
+    return tree_remove_many(tree, NULL, NULL, keys, count,
+			    (dict_remove_func)pr_tree_remove, node_rebuild);
+}
+
+size_t
+pr_tree_remove_if(pr_tree* tree, dict_predicate_func pred, void* ctx)
+{
+    ASSERT(tree != NULL);
+
+    return tree_remove_if(tree, NULL, NULL, pred, ctx,
+			  (dict_remove_func)pr_tree_remove, node_rebuild);
+}
+
+size_t
+pr_tree_export(pr_tree* tree, void** keys, void** data, size_t max,
+	       dict_export_pos* pos)
+{
+    ASSERT(tree != NULL);
+
+    return tree_export(tree, NULL, keys, data, max, pos);
+}
+
+size_t
+pr_tree_export_all(pr_tree* tree, void** keys, void** data, unsigned threads)
+{
+    ASSERT(tree != NULL);
+
+    return tree_export_all(tree, NULL, keys, data, threads);
+}
+
 size_t
 pr_tree_clear(pr_tree* tree)
 {
@@ -413,7 +519,7 @@ pr_tree_clear(pr_tree* tree)
 	}
 
 	if (tree->del_func)
-	    tree->del_func(node->key, node->datum);
+	    tree->del_func(node->key, NODE_DEL_DATUM(tree, node));
 
 	pr_node* parent = node->parent;
 	FREE(node);
@@ -429,6 +535,7 @@ pr_tree_clear(pr_tree* tree)
 
     tree->root = NULL;
     tree->count = 0;
+    tree->mod_count++;
     return count;
 }
 
@@ -499,12 +606,13 @@ pr_tree_pathlen(const pr_tree* tree)
 }
 
 static pr_node*
-node_new(void* key)
+node_new(pr_tree* tree, void* key)
 {
-    pr_node* node = MALLOC(sizeof(*node));
+    pr_node* node = MALLOC(SET_NODE_SIZE(tree, sizeof(*node)));
     if (node) {
 	node->key = key;
-	node->datum = NULL;
+	if (!tree->keys_only)
+	    node->datum = NULL;
 	node->parent = NULL;
 	node->llink = NULL;
 	node->rlink = NULL;
@@ -800,5 +908,5 @@ pr_itor_data(pr_itor* itor)
 {
     ASSERT(itor != NULL);
 
-    return itor->node ? &itor->node->datum : NULL;
+    return itor->node ? NODE_DATUM_SLOT(itor->tree, itor->node) : NULL;
 }
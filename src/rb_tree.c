@@ -35,38 +35,22 @@
 
 #include <string.h>
 #include "dict_private.h"
-#include "tree_common.h"
-
-typedef struct rb_node rb_node;
-struct rb_node {
-    void*	    key;
-    void*	    datum;
-    rb_node*	    parent;
-    rb_node*	    llink;
-    union {
-	intptr_t    color;
-	rb_node*    rlink;
-    };
-};
-
-#define RB_RED		    0
-#define RB_BLACK	    1
-
-#define RLINK(node)	    ((rb_node*)((node)->color & ~RB_BLACK))
-#define COLOR(node)	    ((node)->color & RB_BLACK)
-
-#define SET_RED(node)	    (node)->color &= (~(intptr_t)RB_BLACK)
-#define SET_BLACK(node)	    (node)->color |= ((intptr_t)RB_BLACK)
-#define SET_RLINK(node,r)   (node)->color = COLOR(node) | (intptr_t)(r)
-
-struct rb_tree {
-    TREE_FIELDS(rb_node);
-};
+#include "rb_tree_private.h"
+#include "dict_inline.h"
 
 struct rb_itor {
     TREE_ITERATOR_FIELDS(rb_tree, rb_node);
 };
 
+/* The layouts that dict_inline.h relies on, beyond the common ones. */
+STATIC_ASSERT(inline_rb_rlink,
+	      offsetof(rb_node, rlink) == offsetof(dict_inline_node, rlink));
+STATIC_ASSERT(inline_rb_color, RB_BLACK == 1);
+STATIC_ASSERT(inline_rb_cmp_func, offsetof(rb_tree, cmp_func) ==
+	      offsetof(dict_inline_tree, cmp_func));
+STATIC_ASSERT(inline_rb_itor_node,
+	      offsetof(rb_itor, node) == offsetof(dict_inline_itor, node));
+
 static dict_vtable rb_tree_vtable = {
     (dict_inew_func)	    rb_dict_itor_new,
     (dict_dfree_func)	    rb_tree_free,
@@ -78,6 +62,11 @@ static dict_vtable rb_tree_vtable = {
     (dict_count_func)	    tree_count,
     (dict_verify_func)	    rb_tree_verify,
     (dict_clone_func)	    rb_tree_clone,
+    (dict_remove_many_func) rb_tree_remove_many,
+    (dict_remove_if_func)   rb_tree_remove_if,
+    (dict_mod_count_func)   tree_mod_count,
+    (dict_export_func)	    rb_tree_export,
+    (dict_export_all_func)  rb_tree_export_all,
 };
 
 static itor_vtable rb_tree_itor_vtable = {
@@ -93,11 +82,15 @@ static itor_vtable rb_tree_itor_vtable = {
     (dict_key_func)	    rb_itor_key,
     (dict_data_func)	    rb_itor_data,
     (dict_iremove_func)	    NULL,/* rb_itor_remove not implemented yet */
-    (dict_icompare_func)    NULL /* rb_itor_compare not implemented yet */
+    (dict_icompare_func)    NULL,/* rb_itor_compare not implemented yet */
+    (dict_iseek_func)	    rb_itor_seek
 };
 
-static rb_node _null = { NULL, NULL, NULL, NULL, { RB_BLACK } };
-#define RB_NULL	&_null
+/* A set's nodes end before the datum. */
+STATIC_ASSERT(set_node_size,
+	      offsetof(rb_node, datum) + sizeof(void*) == sizeof(rb_node));
+
+rb_node rb_null = { NULL, NULL, NULL, { RB_BLACK }, NULL };
 
 static void	rot_left(rb_tree* tree, rb_node* node);
 static void	rot_right(rb_tree* tree, rb_node* node);
@@ -106,11 +99,19 @@ static unsigned	delete_fixup(rb_tree* tree, rb_node* node);
 static size_t	node_height(const rb_node* node);
 static size_t	node_mheight(const rb_node* node);
 static size_t	node_pathlen(const rb_node* node, size_t level);
-static rb_node*	node_new(void* key);
+static size_t	node_depth(const rb_tree* tree, const void* key);
+static rb_node*	node_new(rb_tree* tree, void* key);
 static rb_node*	node_next(rb_node* node);
 static rb_node*	node_prev(rb_node* node);
 static rb_node*	node_max(rb_node* node);
 static rb_node*	node_min(rb_node* node);
+static void	relaxed_mark(rb_tree* tree, rb_node* node);
+static void	relaxed_drain(rb_tree* tree);
+static void	pending_free(rb_pending* pending);
+static void	pending_clear(rb_pending* pending);
+static void	pending_erase(rb_pending* pending, const rb_node* node);
+static bool	pending_contains(const rb_pending* pending,
+				 const rb_node* node);
 
 rb_tree*
 rb_tree_new(dict_compare_func cmp_func, dict_delete_func del_func)
@@ -120,8 +121,19 @@ rb_tree_new(dict_compare_func cmp_func, dict_delete_func del_func)
 	tree->root = RB_NULL;
 	tree->count = 0;
 	tree->cmp_func = cmp_func ? cmp_func : dict_ptr_cmp;
+	tree->keys_only = false;
+	tree->set_datum = NULL;
+	tree->datum_offset = offsetof(rb_node, datum);
 	tree->del_func = del_func;
 	tree->rotation_count = 0;
+	tree->mod_count = 0;
+	tree->agg_func = NULL;
+	tree->agg_update = NULL;
+	tree->agg_offset = 0;
+	tree->agg_size = 0;
+	tree->agg_stale = NULL;
+	tree->layout = NULL;
+	tree->pending = NULL;
     }
     return tree;
 }
@@ -140,29 +152,55 @@ rb_dict_new(dict_compare_func cmp_func, dict_delete_func del_func)
     return dct;
 }
 
+rb_tree*
+rb_tree_new_set(dict_compare_func cmp_func, dict_delete_func del_func)
+{
+    rb_tree* tree = rb_tree_new(cmp_func, del_func);
+    if (tree)
+	tree->keys_only = true;
+    return tree;
+}
+
+dict*
+rb_dict_new_set(dict_compare_func cmp_func, dict_delete_func del_func)
+{
+    dict* dct = MALLOC(sizeof(*dct));
+    if (dct) {
+	if (!(dct->_object = rb_tree_new_set(cmp_func, del_func))) {
+	    FREE(dct);
+	    return NULL;
+	}
+	dct->_vtable = &rb_tree_vtable;
+    }
+    return dct;
+}
+
 size_t
 rb_tree_free(rb_tree* tree)
 {
     ASSERT(tree != NULL);
 
     size_t count = rb_tree_clear(tree);
+    tree_layout_free(tree->layout);
+    pending_free(tree->pending);
     FREE(tree);
     return count;
 }
 
 static rb_node*
-node_clone(rb_node* node, rb_node* parent, dict_key_datum_clone_func clone_func)
+node_clone(rb_node* node, rb_node* parent, size_t node_size,
+	   dict_key_datum_clone_func clone_func)
 {
     if (node == RB_NULL)
 	return RB_NULL;
-    rb_node* clone = MALLOC(sizeof(*clone));
+    rb_node* clone = MALLOC(node_size);
     if (!clone)
 	return RB_NULL;
+    memcpy(clone, node, node_size);
     clone->parent = parent;
     clone->key = node->key;
-    clone->datum = node->datum;
-    clone->llink = node_clone(node->llink, clone, clone_func);
-    clone->rlink = node_clone(RLINK(node), clone, clone_func);
+    clone->llink = node_clone(node->llink, clone, node_size, clone_func);
+    clone->rlink = node_clone(RLINK(node), clone, node_size, clone_func);
     if (COLOR(node) == RB_BLACK)
 	SET_BLACK(clone);
     else
@@ -175,10 +213,18 @@ rb_tree_clone(rb_tree* tree, dict_key_datum_clone_func clone_func)
 {
     ASSERT(tree != NULL);
 
+    tree_aggregate_flush(tree, RB_NULL);
+    relaxed_drain(tree);
     rb_tree* clone = rb_tree_new(tree->cmp_func, tree->del_func);
     if (clone) {
 	memcpy(clone, tree, sizeof(rb_tree));
-	clone->root = node_clone(tree->root, RB_NULL, clone_func);
+	clone->layout = NULL;
+	clone->pending = NULL;
+	clone->root = node_clone(tree->root, RB_NULL,
+				 tree_node_alloc_size(tree, sizeof(rb_node)),
+				 clone_func);
+	if (clone_func)
+	    tree_aggregate_rebuild(clone, RB_NULL);
     }
     return clone;
 }
@@ -188,6 +234,8 @@ rb_tree_search(rb_tree* tree, const void* key)
 {
     ASSERT(tree != NULL);
 
+    size_t depth = TRACE_DEPTH(search, node_depth(tree, key));
+
     rb_node* node = tree->root;
     while (node != RB_NULL) {
 	int cmp = tree->cmp_func(key, node->key);
@@ -195,9 +243,12 @@ rb_tree_search(rb_tree* tree, const void* key)
 	    node = node->llink;
 	else if (cmp)
 	    node = RLINK(node);
-	else
-	    return node->datum;
+	else {
+	    TRACE_OP(search, "rb", tree, key, depth, 1);
+	    return NODE_DATUM(tree, node);
+	}
     }
+    TRACE_OP(search, "rb", tree, key, depth, 0);
     return NULL;
 }
 
@@ -206,6 +257,9 @@ rb_tree_insert(rb_tree* tree, void* key, bool* inserted)
 {
     ASSERT(tree != NULL);
 
+    size_t depth = TRACE_DEPTH(insert, node_depth(tree, key));
+
+    tree_aggregate_flush(tree, RB_NULL);
     int cmp = 0;	/* Quell GCC warning about uninitialized usage. */
     rb_node* node = tree->root;
     rb_node* parent = RB_NULL;
@@ -218,15 +272,31 @@ rb_tree_insert(rb_tree* tree, void* key, bool* inserted)
 	else {
 	    if (inserted)
 		*inserted = false;
-	    return &node->datum;
+	    if (TREE_AUGMENTED(tree))
+		tree->agg_stale = node;
+	    TRACE_OP(insert, "rb", tree, key, depth, 0);
+	    return NODE_DATUM_SLOT(tree, node);
 	}
     }
 
-    if (!(node = node_new(key))) {
+    if (!(node = rb_tree_insert_node(tree, parent, cmp, key))) {
+	TRACE_OP(insert, "rb", tree, key, depth, -1);
 	return NULL;
     }
     if (inserted)
 	*inserted = true;
+    TRACE_OP(insert, "rb", tree, key, depth, 1);
+    return NODE_DATUM_SLOT(tree, node);
+}
+
+rb_node*
+rb_tree_insert_node(rb_tree* tree, rb_node* parent, int cmp, void* key)
+{
+    ASSERT(tree != NULL);
+
+    rb_node* node = node_new(tree, key);
+    if (!node)
+	return NULL;
     if ((node->parent = parent) == RB_NULL) {
 	tree->root = node;
 	ASSERT(tree->count == 0);
@@ -237,10 +307,16 @@ rb_tree_insert(rb_tree* tree, void* key, bool* inserted)
 	else
 	    SET_RLINK(parent, node);
 
-	tree->rotation_count += insert_fixup(tree, node);
+	if (tree->pending)
+	    relaxed_mark(tree, node);
+	else
+	    tree->rotation_count += insert_fixup(tree, node);
     }
     ++tree->count;
-    return &node->datum;
+    tree->mod_count++;
+    if (TREE_AUGMENTED(tree))
+	tree->agg_stale = node;
+    return node;
 }
 
 static unsigned
@@ -305,6 +381,9 @@ rb_tree_remove(rb_tree* tree, const void* key)
 {
     ASSERT(tree != NULL);
 
+    size_t depth = TRACE_DEPTH(remove, node_depth(tree, key));
+
+    tree_aggregate_flush(tree, RB_NULL);
     rb_node* node = tree->root;
     while (node != RB_NULL) {
 	int cmp = tree->cmp_func(key, node->key);
@@ -315,21 +394,49 @@ rb_tree_remove(rb_tree* tree, const void* key)
 	else
 	    break;
     }
-    if (node == RB_NULL)
+    if (node == RB_NULL) {
+	TRACE_OP(remove, "rb", tree, key, depth, 0);
 	return false;
+    }
 
-    rb_node* out;
-    if (node->llink == RB_NULL || RLINK(node) == RB_NULL) {
-	out = node;
-    } else {
-	void* tmp;
+    rb_tree_remove_node(tree, node);
+    TRACE_OP(remove, "rb", tree, key, depth, 1);
+    return true;
+}
+
+void
+rb_tree_remove_node(rb_tree* tree, rb_node* node)
+{
+    ASSERT(tree != NULL);
+    ASSERT(node != RB_NULL);
+
+    rb_node* out = node;
+    if (node->llink != RB_NULL && RLINK(node) != RB_NULL)
 	for (out = RLINK(node); out->llink != RB_NULL; out = out->llink)
 	    /* void */;
+    rb_node* temp = out->llink != RB_NULL ? out->llink : RLINK(out);
+    if (tree->pending) {
+	if (COLOR(out) == RB_BLACK && COLOR(temp) == RB_BLACK) {
+	    /* The fixup for a black height deficit assumes there are no red-red
+	     * violations, so finish the deferred fixups first. They only
+	     * recolor and rotate, so |node| is still in the tree. */
+	    relaxed_drain(tree);
+	    out = node;
+	    if (node->llink != RB_NULL && RLINK(node) != RB_NULL)
+		for (out = RLINK(node); out->llink != RB_NULL; out = out->llink)
+		    /* void */;
+	    temp = out->llink != RB_NULL ? out->llink : RLINK(out);
+	}
+	/* If |out| is red, a red |temp| was already pending and stays so. */
+	pending_erase(tree->pending, out);
+    }
+    if (out != node) {
+	void* tmp;
 	SWAP(node->key, out->key, tmp);
-	SWAP(node->datum, out->datum, tmp);
+	if (!tree->keys_only)
+	    SWAP(node->datum, out->datum, tmp);
     }
 
-    rb_node* temp = out->llink != RB_NULL ? out->llink : RLINK(out);
     rb_node* parent = out->parent;
     temp->parent = parent;
     if (parent != RB_NULL) {
@@ -340,16 +447,16 @@ rb_tree_remove(rb_tree* tree, const void* key)
     } else {
 	tree->root = temp;
     }
+    tree_node_aggregate_path(tree, RB_NULL, parent);
 
     if (COLOR(out) == RB_BLACK)
 	tree->rotation_count += delete_fixup(tree, temp);
     if (tree->del_func)
-	tree->del_func(out->key, out->datum);
-    FREE(out);
+	tree->del_func(out->key, NODE_DEL_DATUM(tree, out));
+    tree_layout_free_node(tree->layout, out);
 
     tree->count--;
-
-    return true;
+    tree->mod_count++;
 }
 
 static unsigned
@@ -429,6 +536,69 @@ delete_fixup(rb_tree* tree, rb_node* node)
     return rotations;
 }
 
+void
+rb_tree_rebuild_node(void* Tree, void* Node, size_t depth, size_t lheight,
+		     size_t rheight)
+{
+    rb_tree* tree = Tree;
+    rb_node* node = Node;
+    (void)lheight;
+    (void)rheight;
+
+    /* The rebuilt tree's leaves are on its last two levels: only the nodes on
+     * the last one are red. */
+    size_t last = 0;
+    for (size_t count = tree->count; count > 1; count >>= 1)
+	last++;
+    if (depth == last && depth > 0)
+	SET_RED(node);
+    else
+	SET_BLACK(node);
+    if (TREE_AUGMENTED(tree))
+	tree_node_aggregate(tree, RB_NULL, node);
+}
+
+size_t
+rb_tree_remove_many(rb_tree* tree, const void** keys, size_t count)
+{
+    ASSERT(tree != NULL);
+
+    tree_aggregate_flush(tree, RB_NULL);
+    relaxed_drain(tree);
+    return tree_remove_many(tree, RB_NULL, tree->layout, keys, count,
+			    (dict_remove_func)rb_tree_remove,
+			    rb_tree_rebuild_node);
+}
+
+size_t
+rb_tree_remove_if(rb_tree* tree, dict_predicate_func pred, void* ctx)
+{
+    ASSERT(tree != NULL);
+
+    tree_aggregate_flush(tree, RB_NULL);
+    relaxed_drain(tree);
+    return tree_remove_if(tree, RB_NULL, tree->layout, pred, ctx,
+			  (dict_remove_func)rb_tree_remove,
+			  rb_tree_rebuild_node);
+}
+
+size_t
+rb_tree_export(rb_tree* tree, void** keys, void** data, size_t max,
+	       dict_export_pos* pos)
+{
+    ASSERT(tree != NULL);
+
+    return tree_export(tree, RB_NULL, keys, data, max, pos);
+}
+
+size_t
+rb_tree_export_all(rb_tree* tree, void** keys, void** data, unsigned threads)
+{
+    ASSERT(tree != NULL);
+
+    return tree_export_all(tree, RB_NULL, keys, data, threads);
+}
+
 size_t
 rb_tree_clear(rb_tree* tree)
 {
@@ -447,11 +617,12 @@ rb_tree_clear(rb_tree* tree)
 	}
 
 	if (tree->del_func)
-	    tree->del_func(node->key, node->datum);
+	    tree->del_func(node->key, NODE_DEL_DATUM(tree, node));
 
 	rb_node* parent = node->parent;
-	FREE(node);
+	tree_layout_free_node(tree->layout, node);
 	tree->count--;
+	tree->mod_count++;
 	if (parent != RB_NULL) {
 	    if (parent->llink == node)
 		parent->llink = RB_NULL;
@@ -462,6 +633,9 @@ rb_tree_clear(rb_tree* tree)
     }
 
     tree->root = RB_NULL;
+    tree->agg_stale = NULL;
+    if (tree->pending)
+	pending_clear(tree->pending);
     ASSERT(tree->count == 0);
     return count;
 }
@@ -539,7 +713,7 @@ rb_tree_traverse(rb_tree* tree, dict_visit_func visit)
     rb_node* node = node_min(tree->root);
     for (; node != RB_NULL; node = node_next(node)) {
 	++count;
-	if (!visit(node->key, node->datum))
+	if (!visit(node->key, NODE_DATUM(tree, node)))
 	    break;
     }
     return count;
@@ -574,6 +748,25 @@ node_pathlen(const rb_node* node, size_t level)
     return n;
 }
 
+/* Return the number of nodes |key| is compared with to find it, or to find
+ * that it is not in the tree. */
+static size_t
+node_depth(const rb_tree* tree, const void* key)
+{
+    size_t depth = 0;
+    for (const rb_node* node = tree->root; node != RB_NULL; ) {
+	++depth;
+	int cmp = tree->cmp_func(key, node->key);
+	if (cmp < 0)
+	    node = node->llink;
+	else if (cmp)
+	    node = RLINK(node);
+	else
+	    break;
+    }
+    return depth;
+}
+
 static void
 rot_left(rb_tree* tree, rb_node* node)
 {
@@ -596,6 +789,9 @@ rot_left(rb_tree* tree, rb_node* node)
     }
     rlink->llink = node;
     node->parent = rlink;
+    tree_node_aggregate(tree, RB_NULL, node);
+    tree_node_aggregate(tree, RB_NULL, rlink);
+    TRACE_ROTATE(tree, node, 0);
 }
 
 static void
@@ -620,20 +816,27 @@ rot_right(rb_tree* tree, rb_node* node)
     }
     SET_RLINK(llink, node);
     node->parent = llink;
+    tree_node_aggregate(tree, RB_NULL, node);
+    tree_node_aggregate(tree, RB_NULL, llink);
+    TRACE_ROTATE(tree, node, 1);
 }
 
 static rb_node*
-node_new(void* key)
+node_new(rb_tree* tree, void* key)
 {
-    rb_node* node = MALLOC(sizeof(*node));
+    rb_node* node = MALLOC(tree_node_alloc_size(tree, sizeof(*node)));
     if (node) {
+	if (tree->agg_size)
+	    memset(AGG(tree, node), 0, tree->agg_size);
 	ASSERT((((intptr_t)node) & 1) == 0);
 	node->key = key;
-	node->datum = NULL;
+	if (!tree->keys_only)
+	    node->datum = NULL;
 	node->parent = RB_NULL;
 	node->llink = RB_NULL;
 	node->rlink = RB_NULL;
 	SET_RED(node);
+	tree_node_aggregate(tree, RB_NULL, node);
     }
     return node;
 }
@@ -698,6 +901,306 @@ node_min(rb_node* node)
     return node;
 }
 
+bool
+rb_tree_set_aggregate(rb_tree* tree, dict_aggregate_func agg_func,
+		      size_t agg_size)
+{
+    ASSERT(tree != NULL);
+
+    return tree_set_aggregate(tree, sizeof(rb_node), agg_func, agg_size);
+}
+
+bool
+rb_tree_update_aggregate(rb_tree* tree, const void* key)
+{
+    ASSERT(tree != NULL);
+
+    return tree_aggregate_update(tree, RB_NULL, key);
+}
+
+bool
+rb_tree_range_aggregate(rb_tree* tree, const void* lo, const void* hi,
+			void* result)
+{
+    ASSERT(tree != NULL);
+
+    return tree_range_aggregate(tree, RB_NULL, lo, hi, result);
+}
+
+bool
+rb_tree_relayout(rb_tree* tree, dict_layout order)
+{
+    ASSERT(tree != NULL);
+
+    tree_aggregate_flush(tree, RB_NULL);
+    relaxed_drain(tree);
+    return tree_relayout(tree, &tree->layout,
+			 tree_node_alloc_size(tree, sizeof(rb_node)), RB_NULL,
+			 order);
+}
+
+bool
+rb_tree_relayout_step(rb_tree* tree, size_t budget)
+{
+    ASSERT(tree != NULL);
+
+    tree_aggregate_flush(tree, RB_NULL);
+    relaxed_drain(tree);
+    return tree_relayout_step(tree, &tree->layout,
+			      tree_node_alloc_size(tree, sizeof(rb_node)),
+			      RB_NULL, budget);
+}
+
+/* In relaxed mode an insertion only links its red node into place. Every red
+ * node whose parent may also be red is kept in a stack of pending nodes, with
+ * an open-addressed table from each node to its index in the stack so that
+ * nodes can be dropped in constant time when they are freed. */
+struct rb_pending {
+    rb_node**		    nodes;
+    size_t		    count;
+    size_t		    size;	/* Capacity of |nodes|. */
+    size_t*		    slots;	/* Indices into |nodes|, or EMPTY_SLOT. */
+    size_t		    mask;	/* Number of slots, less one. */
+};
+
+#define EMPTY_SLOT	    SIZE_MAX
+#define PENDING_MIN_SIZE    8
+
+static size_t
+pending_hash(const rb_node* node)
+{
+    return (size_t)(((uint64_t)((uintptr_t)node >> 4) *
+		     UINT64_C(0x9E3779B97F4A7C15)) >> 32);
+}
+
+/* Returns the slot holding |node|, or the empty slot where it would go. */
+static size_t
+pending_slot(const rb_pending* pending, const rb_node* node)
+{
+    size_t slot = pending_hash(node) & pending->mask;
+    while (pending->slots[slot] != EMPTY_SLOT &&
+	   pending->nodes[pending->slots[slot]] != node)
+	slot = (slot + 1) & pending->mask;
+    return slot;
+}
+
+static bool
+pending_contains(const rb_pending* pending, const rb_node* node)
+{
+    return pending->slots[pending_slot(pending, node)] != EMPTY_SLOT;
+}
+
+/* Allocates room for |size| nodes, which must be a power of two, and twice as
+ * many slots, and fills the slots for the nodes already pending. */
+static bool
+pending_resize(rb_pending* pending, size_t size)
+{
+    rb_node** nodes = MALLOC(size * sizeof(*nodes));
+    size_t* slots = MALLOC(2 * size * sizeof(*slots));
+    if (!nodes || !slots) {
+	FREE(nodes);
+	FREE(slots);
+	return false;
+    }
+    if (pending->count)
+	memcpy(nodes, pending->nodes, pending->count * sizeof(*nodes));
+    FREE(pending->nodes);
+    FREE(pending->slots);
+    pending->nodes = nodes;
+    pending->size = size;
+    pending->slots = slots;
+    pending->mask = 2 * size - 1;
+    for (size_t i = 0; i <= pending->mask; i++)
+	slots[i] = EMPTY_SLOT;
+    for (size_t i = 0; i < pending->count; i++)
+	slots[pending_slot(pending, nodes[i])] = i;
+    return true;
+}
+
+static rb_pending*
+pending_new(void)
+{
+    rb_pending* pending = MALLOC(sizeof(*pending));
+    if (pending) {
+	pending->nodes = NULL;
+	pending->count = 0;
+	pending->slots = NULL;
+	if (!pending_resize(pending, PENDING_MIN_SIZE)) {
+	    FREE(pending);
+	    return NULL;
+	}
+    }
+    return pending;
+}
+
+static void
+pending_free(rb_pending* pending)
+{
+    if (pending) {
+	FREE(pending->nodes);
+	FREE(pending->slots);
+	FREE(pending);
+    }
+}
+
+static void
+pending_clear(rb_pending* pending)
+{
+    pending->count = 0;
+    for (size_t i = 0; i <= pending->mask; i++)
+	pending->slots[i] = EMPTY_SLOT;
+}
+
+static bool
+pending_push(rb_pending* pending, rb_node* node)
+{
+    size_t slot = pending_slot(pending, node);
+    if (pending->slots[slot] != EMPTY_SLOT)
+	return true;
+    if (pending->count == pending->size) {
+	if (!pending_resize(pending, 2 * pending->size))
+	    return false;
+	slot = pending_slot(pending, node);
+    }
+    pending->slots[slot] = pending->count;
+    pending->nodes[pending->count++] = node;
+    return true;
+}
+
+static void
+pending_erase(rb_pending* pending, const rb_node* node)
+{
+    size_t slot = pending_slot(pending, node);
+    const size_t index = pending->slots[slot];
+    if (index == EMPTY_SLOT)
+	return;
+    rb_node* last = pending->nodes[--pending->count];
+    if (last != node) {
+	pending->slots[pending_slot(pending, last)] = index;
+	pending->nodes[index] = last;
+    }
+    /* Shift back the entries after the freed slot that may not stay there,
+     * because it would end their probe sequence early. */
+    for (size_t next = (slot + 1) & pending->mask;
+	 pending->slots[next] != EMPTY_SLOT;
+	 next = (next + 1) & pending->mask) {
+	const size_t home =
+	    pending_hash(pending->nodes[pending->slots[next]]) & pending->mask;
+	if (((next - home) & pending->mask) >= ((next - slot) & pending->mask)) {
+	    pending->slots[slot] = pending->slots[next];
+	    slot = next;
+	}
+    }
+    pending->slots[slot] = EMPTY_SLOT;
+}
+
+/* Make one repair toward removing the red-red violation between |node| and
+ * its parent, as insert_fixup() would, at the top of the run of red nodes
+ * above |node| so that the grandparent is black. Returns the number of
+ * rotations. */
+static unsigned
+relaxed_fixup(rb_tree* tree, rb_node* node)
+{
+    ASSERT(COLOR(node) == RB_RED);
+    ASSERT(COLOR(node->parent) == RB_RED);
+
+    /* The root is black, so a red node's parent is not RB_NULL. */
+    while (COLOR(node->parent->parent) == RB_RED)
+	node = node->parent;
+    rb_node* parent = node->parent;
+    rb_node* grandparent = parent->parent;
+    const bool left = parent == grandparent->llink;
+    rb_node* uncle = left ? RLINK(grandparent) : grandparent->llink;
+    if (COLOR(uncle) == RB_RED) {
+	SET_BLACK(parent);
+	SET_BLACK(uncle);
+	if (grandparent != tree->root) {
+	    SET_RED(grandparent);
+	    relaxed_mark(tree, grandparent);
+	}
+	return 0;
+    }
+
+    /* Rotations only move the red children of red nodes to other red nodes,
+     * so every violation they leave was already pending. */
+    unsigned rotations = 1;
+    if (left) {
+	if (node == RLINK(parent)) {
+	    rot_left(tree, parent);
+	    parent = node;
+	    ++rotations;
+	}
+	rot_right(tree, grandparent);
+    } else {
+	if (node == parent->llink) {
+	    rot_right(tree, parent);
+	    parent = node;
+	    ++rotations;
+	}
+	rot_left(tree, grandparent);
+    }
+    SET_BLACK(parent);
+    SET_RED(grandparent);
+    return rotations;
+}
+
+/* Mark |node| pending if it is red with a red parent, or repair the violation
+ * at once if there is no memory to record it. */
+static void
+relaxed_mark(rb_tree* tree, rb_node* node)
+{
+    if (COLOR(node) == RB_RED && COLOR(node->parent) == RB_RED &&
+	!pending_push(tree->pending, node)) {
+	do {
+	    tree->rotation_count += relaxed_fixup(tree, node);
+	} while (COLOR(node) == RB_RED && COLOR(node->parent) == RB_RED);
+    }
+}
+
+static void
+relaxed_drain(rb_tree* tree)
+{
+    if (tree->pending)
+	rb_tree_rebalance_step(tree, SIZE_MAX);
+}
+
+bool
+rb_tree_set_relaxed(rb_tree* tree, bool relaxed)
+{
+    ASSERT(tree != NULL);
+
+    if (relaxed) {
+	if (!tree->pending && !(tree->pending = pending_new()))
+	    return false;
+    } else if (tree->pending) {
+	relaxed_drain(tree);
+	pending_free(tree->pending);
+	tree->pending = NULL;
+    }
+    return true;
+}
+
+bool
+rb_tree_rebalance_step(rb_tree* tree, size_t budget)
+{
+    ASSERT(tree != NULL);
+
+    rb_pending* pending = tree->pending;
+    if (!pending)
+	return true;
+    tree_aggregate_flush(tree, RB_NULL);
+    for (; pending->count; --budget) {
+	if (!budget)
+	    return false;
+	rb_node* node = pending->nodes[pending->count - 1];
+	if (COLOR(node) == RB_RED && COLOR(node->parent) == RB_RED)
+	    tree->rotation_count += relaxed_fixup(tree, node);
+	else
+	    pending_erase(pending, node);
+    }
+    return true;
+}
+
 static bool
 node_verify(const rb_tree* tree, const rb_node* parent, const rb_node* node)
 {
@@ -712,9 +1215,14 @@ node_verify(const rb_tree* tree, const rb_node* parent, const rb_node* node)
     if (node != RB_NULL) {
 	VERIFY(node->parent == parent);
 	if (COLOR(node) == RB_RED) {
-	    /* Verify that every child of a red node is black. */
-	    VERIFY(COLOR(node->llink) == RB_BLACK);
-	    VERIFY(COLOR(node->rlink) == RB_BLACK);
+	    /* Verify that every child of a red node is black, or in relaxed
+	     * mode is awaiting its fixup. */
+	    VERIFY(COLOR(node->llink) == RB_BLACK ||
+		   (tree->pending && pending_contains(tree->pending,
+						      node->llink)));
+	    VERIFY(COLOR(node->rlink) == RB_BLACK ||
+		   (tree->pending && pending_contains(tree->pending,
+						      RLINK(node))));
 	}
 	if (!node_verify(tree, node, node->llink) ||
 	    !node_verify(tree, node, RLINK(node)))
@@ -726,6 +1234,20 @@ node_verify(const rb_tree* tree, const rb_node* parent, const rb_node* node)
     return true;
 }
 
+/* Returns the number of black nodes on each path from |node| to a leaf, or
+ * SIZE_MAX if the paths differ. */
+static size_t
+node_black_height(const rb_node* node)
+{
+    if (node == RB_NULL)
+	return 0;
+    size_t l = node_black_height(node->llink);
+    size_t r = node_black_height(RLINK(node));
+    if (l != r || l == SIZE_MAX)
+	return SIZE_MAX;
+    return l + (COLOR(node) == RB_BLACK);
+}
+
 bool
 rb_tree_verify(const rb_tree* tree)
 {
@@ -736,7 +1258,9 @@ rb_tree_verify(const rb_tree* tree)
     } else {
 	VERIFY(tree->count == 0);
     }
-    return node_verify(tree, RB_NULL, tree->root);
+    VERIFY(node_black_height(tree->root) != SIZE_MAX);
+    return node_verify(tree, RB_NULL, tree->root) &&
+	   tree_aggregate_verify(tree, RB_NULL);
 }
 
 rb_itor*
@@ -883,6 +1407,31 @@ rb_itor_search(rb_itor* itor, const void* key)
     return false;
 }
 
+bool
+rb_itor_seek(rb_itor* itor, const void* key)
+{
+    ASSERT(itor != NULL);
+
+    rb_node* node = itor->node;
+    if (node == RB_NULL)
+	return false;
+    const dict_compare_func cmp = itor->tree->cmp_func;
+    if (cmp(node->key, key) >= 0)
+	return true;
+    /* Climb only while the parent is also before |key|. The key sought is then
+     * in |node|'s right subtree, or else it is the parent. */
+    rb_node* found;
+    while ((found = node->parent) != RB_NULL && cmp(found->key, key) < 0)
+	node = found;
+    for (node = RLINK(node); node != RB_NULL;) {
+	if (cmp(node->key, key) >= 0)
+	    found = node, node = node->llink;
+	else
+	    node = RLINK(node);
+    }
+    return (itor->node = found) != RB_NULL;
+}
+
 const void*
 rb_itor_key(const rb_itor* itor)
 {
@@ -896,5 +1445,6 @@ rb_itor_data(rb_itor* itor)
 {
     ASSERT(itor != NULL);
 
-    return (itor->node != RB_NULL) ? &itor->node->datum : NULL;
+    return (itor->node != RB_NULL) ?
+	NODE_DATUM_SLOT(itor->tree, itor->node) : NULL;
 }
@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2001-2011 Farooq Mela.
+ * All rights reserved.
+ *
+ * Private definitions for red-black trees, shared with the containers that
+ * are built on them.
+ */
+
+#ifndef _RB_TREE_PRIVATE_H_
+#define _RB_TREE_PRIVATE_H_
+
+#include "rb_tree.h"
+#include "tree_common.h"
+
+typedef struct rb_node rb_node;
+struct rb_node {
+    void*	    key;
+    rb_node*	    parent;
+    rb_node*	    llink;
+    union {
+	intptr_t    color;
+	rb_node*    rlink;
+    };
+    void*	    datum;	/* Not allocated in a set. */
+};
+
+#define RB_RED		    0
+#define RB_BLACK	    1
+
+#define RLINK(node)	    ((rb_node*)((node)->color & ~RB_BLACK))
+#define COLOR(node)	    ((node)->color & RB_BLACK)
+
+#define SET_RED(node)	    (node)->color &= (~(intptr_t)RB_BLACK)
+#define SET_BLACK(node)	    (node)->color |= ((intptr_t)RB_BLACK)
+#define SET_RLINK(node,r)   (node)->color = COLOR(node) | (intptr_t)(r)
+
+/* The sentinel standing in for every missing child, and the root's parent. */
+extern rb_node		    rb_null;
+#define RB_NULL		    (&rb_null)
+
+/* The red nodes whose red-red violations are awaiting deferred fixup. */
+typedef struct rb_pending   rb_pending;
+
+struct rb_tree {
+    TREE_FIELDS(rb_node);
+    TREE_AGGREGATE_FIELDS(rb_node);
+    tree_layout*	    layout;
+    rb_pending*		    pending;	/* Non-NULL in relaxed mode. */
+};
+
+#define AGG(tree,node)	    ((void*)((char*)(node) + (tree)->agg_offset))
+
+/* Insert a new node for |key| as the left (|cmp| < 0) or right child of
+ * |parent|, which must not have one, and rebalance. Returns the new node, or
+ * NULL if it could not be allocated. */
+rb_node*	rb_tree_insert_node(rb_tree* tree, rb_node* parent, int cmp,
+				    void* key);
+/* Remove |node| from the tree, delete its key and datum, and rebalance. */
+void		rb_tree_remove_node(rb_tree* tree, rb_node* node);
+/* Set the colour and augmentation of a node of a tree rebuilt by a bulk
+ * removal; see tree_rebuild_func. */
+void		rb_tree_rebuild_node(void* tree, void* node, size_t depth,
+				     size_t lheight, size_t rheight);
+
+#endif /* !_RB_TREE_PRIVATE_H_ */
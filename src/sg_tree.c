@@ -0,0 +1,1027 @@
+/*
+ * libdict -- scapegoat tree implementation.
+ * cf. [Galperin and Rivest 1993], [Stout and Warren 1986]
+ *
+ * Copyright (c) 2001-2011, Farooq Mela
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *    This product includes software developed by Farooq Mela.
+ * 4. Neither the name of the Farooq Mela nor the
+ *    names of contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY FAROOQ MELA ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL FAROOQ MELA BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * A scapegoat tree keeps no balance information in its nodes, and its nodes
+ * have no parent pointers either, so each node is just a key, a datum and two
+ * links. Balance is restored lazily: when an insertion creates a node deeper
+ * than log_{3/2}(n), an ancestor whose subtree is out of weight balance (the
+ * scapegoat) is found on the way back up, and its subtree is rebuilt into a
+ * perfectly balanced one in linear time and constant space with the
+ * Day-Stout-Warren algorithm. When deletions shrink the tree below 2/3 of its
+ * size since the last full rebuild, the whole tree is rebuilt.
+ *
+ * Operations take O(log n) amortized time, and lookups O(log n) worst case.
+ * Since there are no parent pointers, iterators keep a stack of ancestors.
+ */
+
+#include "sg_tree.h"
+
+#include "dict_private.h"
+#include "tree_common.h"
+
+/* The depth of the tree is at most log_{3/2}(n), where n < 2^64. */
+#define SG_MAX_HEIGHT	112
+
+typedef struct sg_node sg_node;
+
+struct sg_node {
+    void*		    key;
+    sg_node*		    llink;
+    sg_node*		    rlink;
+    void*		    datum;	/* Not allocated in a set. */
+};
+
+/* A set's nodes end before the datum. */
+STATIC_ASSERT(set_node_size,
+	      offsetof(sg_node, datum) + sizeof(void*) == sizeof(sg_node));
+
+struct sg_tree {
+    TREE_FIELDS(sg_node);
+    size_t		    max_count;
+};
+
+struct sg_itor {
+    sg_tree*		    tree;
+    sg_node*		    node;
+    unsigned		    depth;
+    sg_node*		    path[SG_MAX_HEIGHT];
+};
+
+static dict_vtable sg_tree_vtable = {
+    (dict_inew_func)	    sg_dict_itor_new,
+    (dict_dfree_func)	    sg_tree_free,
+    (dict_insert_func)	    sg_tree_insert,
+    (dict_search_func)	    sg_tree_search,
+    (dict_remove_func)	    sg_tree_remove,
+    (dict_clear_func)	    sg_tree_clear,
+    (dict_traverse_func)    sg_tree_traverse,
+    (dict_count_func)	    sg_tree_count,
+    (dict_verify_func)	    sg_tree_verify,
+    (dict_clone_func)	    sg_tree_clone,
+    (dict_remove_many_func) sg_tree_remove_many,
+    (dict_remove_if_func)   sg_tree_remove_if,
+    (dict_mod_count_func)   tree_mod_count,
+    (dict_export_func)	    sg_tree_export,
+    (dict_export_all_func)  NULL,/* sg_tree_export_all not implemented yet */
+};
+
+static itor_vtable sg_tree_itor_vtable = {
+    (dict_ifree_func)	    sg_itor_free,
+    (dict_valid_func)	    sg_itor_valid,
+    (dict_invalidate_func)  sg_itor_invalidate,
+    (dict_next_func)	    sg_itor_next,
+    (dict_prev_func)	    sg_itor_prev,
+    (dict_nextn_func)	    sg_itor_nextn,
+    (dict_prevn_func)	    sg_itor_prevn,
+    (dict_first_func)	    sg_itor_first,
+    (dict_last_func)	    sg_itor_last,
+    (dict_key_func)	    sg_itor_key,
+    (dict_data_func)	    sg_itor_data,
+    (dict_iremove_func)	    NULL,/* sg_itor_remove not implemented yet */
+    (dict_icompare_func)    NULL,/* sg_itor_compare not implemented yet */
+    (dict_iseek_func)	    sg_itor_seek
+};
+
+static unsigned	height_bound(size_t count);
+static size_t	vine_from_tree(sg_node* pseudo_root);
+static size_t	vine_to_tree(sg_node* pseudo_root, size_t size);
+static size_t	rebuild(sg_node** link, size_t size);
+static size_t	node_count(const sg_node* node);
+static size_t	node_height(const sg_node* node);
+static size_t	node_mheight(const sg_node* node);
+static size_t	node_pathlen(const sg_node* node, size_t level);
+static sg_node*	node_new(sg_tree* tree, void* key);
+static sg_node*	node_clone(const sg_tree* tree, sg_node* node,
+			   dict_key_datum_clone_func clone_func);
+static void	node_free_clone(const sg_tree* tree, sg_node* node,
+				bool cloned);
+
+sg_tree*
+sg_tree_new(dict_compare_func cmp_func, dict_delete_func del_func)
+{
+    sg_tree* tree = MALLOC(sizeof(*tree));
+    if (tree) {
+	tree->root = NULL;
+	tree->count = 0;
+	tree->cmp_func = cmp_func ? cmp_func : dict_ptr_cmp;
+	tree->keys_only = false;
+	tree->set_datum = NULL;
+	tree->datum_offset = offsetof(sg_node, datum);
+	tree->del_func = del_func;
+	tree->rotation_count = 0;
+	tree->mod_count = 0;
+	tree->max_count = 0;
+    }
+    return tree;
+}
+
+dict*
+sg_dict_new(dict_compare_func cmp_func, dict_delete_func del_func)
+{
+    dict* dct = MALLOC(sizeof(*dct));
+    if (dct) {
+	if (!(dct->_object = sg_tree_new(cmp_func, del_func))) {
+	    FREE(dct);
+	    return NULL;
+	}
+	dct->_vtable = &sg_tree_vtable;
+    }
+    return dct;
+}
+
+sg_tree*
+sg_tree_new_set(dict_compare_func cmp_func, dict_delete_func del_func)
+{
+    sg_tree* tree = sg_tree_new(cmp_func, del_func);
+    if (tree)
+	tree->keys_only = true;
+    return tree;
+}
+
+dict*
+sg_dict_new_set(dict_compare_func cmp_func, dict_delete_func del_func)
+{
+    dict* dct = MALLOC(sizeof(*dct));
+    if (dct) {
+	if (!(dct->_object = sg_tree_new_set(cmp_func, del_func))) {
+	    FREE(dct);
+	    return NULL;
+	}
+	dct->_vtable = &sg_tree_vtable;
+    }
+    return dct;
+}
+
+size_t
+sg_tree_free(sg_tree* tree)
+{
+    ASSERT(tree != NULL);
+
+    size_t count = sg_tree_clear(tree);
+    FREE(tree);
+    return count;
+}
+
+sg_tree*
+sg_tree_clone(sg_tree* tree, dict_key_datum_clone_func clone_func)
+{
+    ASSERT(tree != NULL);
+
+    sg_tree* clone = sg_tree_new(tree->cmp_func, tree->del_func);
+    if (clone) {
+	clone->keys_only = tree->keys_only;
+	if (tree->root &&
+	    !(clone->root = node_clone(tree, tree->root, clone_func))) {
+	    FREE(clone);
+	    return NULL;
+	}
+	clone->count = tree->count;
+	clone->max_count = tree->max_count;
+    }
+    return clone;
+}
+
+size_t
+sg_tree_clear(sg_tree* tree)
+{
+    ASSERT(tree != NULL);
+
+    /* Rotate left children up so that the tree can be freed without a stack. */
+    const size_t count = tree->count;
+    sg_node* node = tree->root;
+    while (node) {
+	sg_node* llink = node->llink;
+	if (llink) {
+	    node->llink = llink->rlink;
+	    llink->rlink = node;
+	    node = llink;
+	} else {
+	    sg_node* rlink = node->rlink;
+	    if (tree->del_func)
+		tree->del_func(node->key, NODE_DEL_DATUM(tree, node));
+	    FREE(node);
+	    node = rlink;
+	}
+    }
+    tree->root = NULL;
+    tree->count = 0;
+    tree->max_count = 0;
+    tree->mod_count++;
+    return count;
+}
+
+/* Return the number of nodes |key| is compared with to find it, or to find
+ * that it is not in the tree. Scapegoat nodes have no parent link, so the
+ * common tree_search_depth() does not apply. */
+static size_t
+node_depth(const sg_tree* tree, const void* key)
+{
+    size_t depth = 0;
+    for (const sg_node* node = tree->root; node; ) {
+	++depth;
+	int cmp = tree->cmp_func(key, node->key);
+	if (cmp < 0)
+	    node = node->llink;
+	else if (cmp)
+	    node = node->rlink;
+	else
+	    break;
+    }
+    return depth;
+}
+
+void*
+sg_tree_search(sg_tree* tree, const void* key)
+{
+    ASSERT(tree != NULL);
+
+    size_t depth = TRACE_DEPTH(search, node_depth(tree, key));
+
+    sg_node* node = tree->root;
+    while (node) {
+	int cmp = tree->cmp_func(key, node->key);
+	if (cmp < 0)
+	    node = node->llink;
+	else if (cmp)
+	    node = node->rlink;
+	else {
+	    TRACE_OP(search, "sg", tree, key, depth, 1);
+	    return NODE_DATUM(tree, node);
+	}
+    }
+    TRACE_OP(search, "sg", tree, key, depth, 0);
+    return NULL;
+}
+
+void**
+sg_tree_insert(sg_tree* tree, void* key, bool* inserted)
+{
+    ASSERT(tree != NULL);
+
+    size_t search_depth = TRACE_DEPTH(insert, node_depth(tree, key));
+
+    sg_node* path[SG_MAX_HEIGHT];
+    unsigned depth = 0;
+    int cmp = 0;
+    sg_node* node = tree->root;
+    while (node) {
+	cmp = tree->cmp_func(key, node->key);
+	if (cmp < 0) {
+	    path[depth++] = node;
+	    node = node->llink;
+	} else if (cmp) {
+	    path[depth++] = node;
+	    node = node->rlink;
+	} else {
+	    if (inserted)
+		*inserted = false;
+	    TRACE_OP(insert, "sg", tree, key, search_depth, 0);
+	    return NODE_DATUM_SLOT(tree, node);
+	}
+    }
+
+    sg_node* add = node = node_new(tree, key);
+    if (!node) {
+	TRACE_OP(insert, "sg", tree, key, search_depth, -1);
+	return NULL;
+    }
+    if (inserted)
+	*inserted = true;
+    if (!depth)
+	tree->root = node;
+    else if (cmp < 0)
+	path[depth - 1]->llink = node;
+    else
+	path[depth - 1]->rlink = node;
+    if (tree->max_count < ++tree->count)
+	tree->max_count = tree->count;
+    tree->mod_count++;
+
+    if (depth > height_bound(tree->count)) {
+	/* Too deep: find the lowest ancestor whose larger child holds more than
+	 * 2/3 of its nodes, and rebuild that subtree. */
+	size_t size = 1;
+	while (depth--) {
+	    sg_node* parent = path[depth];
+	    sg_node* sibling = (parent->llink == node) ? parent->rlink
+						       : parent->llink;
+	    const size_t parent_size = size + 1 + node_count(sibling);
+	    if (size * 3 > parent_size * 2) {
+		sg_node** link = !depth ? &tree->root :
+		    (path[depth - 1]->llink == parent) ? &path[depth - 1]->llink
+						       : &path[depth - 1]->rlink;
+		tree->rotation_count += rebuild(link, parent_size);
+		TRACE_REBUILD(tree, parent_size);
+		break;
+	    }
+	    node = parent;
+	    size = parent_size;
+	}
+    }
+    TRACE_OP(insert, "sg", tree, key, search_depth, 1);
+    return NODE_DATUM_SLOT(tree, add);
+}
+
+bool
+sg_tree_remove(sg_tree* tree, const void* key)
+{
+    ASSERT(tree != NULL);
+
+    size_t depth = TRACE_DEPTH(remove, node_depth(tree, key));
+
+    sg_node** link = &tree->root;
+    sg_node* node = tree->root;
+    while (node) {
+	int cmp = tree->cmp_func(key, node->key);
+	if (cmp < 0) {
+	    link = &node->llink;
+	    node = node->llink;
+	} else if (cmp) {
+	    link = &node->rlink;
+	    node = node->rlink;
+	} else
+	    break;
+    }
+    if (!node) {
+	TRACE_OP(remove, "sg", tree, key, depth, 0);
+	return false;
+    }
+
+    if (node->llink && node->rlink) {
+	/* Swap with the successor and remove that instead. */
+	sg_node* out = node->rlink;
+	link = &node->rlink;
+	while (out->llink) {
+	    link = &out->llink;
+	    out = out->llink;
+	}
+	void* tmp;
+	SWAP(node->key, out->key, tmp);
+	if (!tree->keys_only)
+	    SWAP(node->datum, out->datum, tmp);
+	node = out;
+    }
+    *link = node->llink ? node->llink : node->rlink;
+    if (tree->del_func)
+	tree->del_func(node->key, NODE_DEL_DATUM(tree, node));
+    FREE(node);
+    tree->mod_count++;
+
+    if (--tree->count * 3 < tree->max_count * 2) {
+	tree->rotation_count += rebuild(&tree->root, tree->count);
+	tree->max_count = tree->count;
+	TRACE_REBUILD(tree, tree->count);
+    }
+    TRACE_OP(remove, "sg", tree, key, depth, 1);
+    return true;
+}
+
+size_t
+sg_tree_remove_many(sg_tree* tree, const void** keys, size_t count)
+{
+    ASSERT(tree != NULL);
+
+    return tree_remove_many_with(tree, keys, count,
+				 (dict_remove_func)sg_tree_remove,
+				 (dict_remove_if_func)sg_tree_remove_if);
+}
+
+size_t
+sg_tree_remove_if(sg_tree* tree, dict_predicate_func pred, void* ctx)
+{
+    ASSERT(tree != NULL);
+    ASSERT(pred != NULL);
+
+    if (!tree->root)
+	return 0;
+    /* Flatten the tree into a vine, unlink the nodes to remove from it in
+     * order, and rebuild what is left: a full rebuild, in linear time. */
+    sg_node pseudo_root;
+    pseudo_root.rlink = tree->root;
+    tree->rotation_count += vine_from_tree(&pseudo_root);
+    size_t removed = 0;
+    sg_node* prev = &pseudo_root;
+    for (sg_node* node = prev->rlink; node; node = prev->rlink) {
+	if (pred(node->key, NODE_DATUM(tree, node), ctx)) {
+	    prev->rlink = node->rlink;
+	    if (tree->del_func)
+		tree->del_func(node->key, NODE_DEL_DATUM(tree, node));
+	    FREE(node);
+	    removed++;
+	} else {
+	    prev = node;
+	}
+    }
+    tree->count -= removed;
+    tree->max_count = tree->count;
+    tree->mod_count++;
+    tree->rotation_count += vine_to_tree(&pseudo_root, tree->count);
+    tree->root = pseudo_root.rlink;
+    TRACE_REBUILD(tree, tree->count);
+    return removed;
+}
+
+/* Return floor(log_{3/2}(count)), the maximum depth of any node. */
+static unsigned
+height_bound(size_t count)
+{
+    unsigned height = 0;
+    for (double n = 1.5; n <= count; n *= 1.5)
+	++height;
+    return height;
+}
+
+/* Rotate right until the tree hanging off |pseudo_root->rlink| is a
+ * right-leaning vine. Returns the number of rotations. */
+static size_t
+vine_from_tree(sg_node* pseudo_root)
+{
+    size_t rotations = 0;
+    sg_node* tail = pseudo_root;
+    sg_node* rest = tail->rlink;
+    while (rest) {
+	if (rest->llink) {
+	    sg_node* llink = rest->llink;
+	    rest->llink = llink->rlink;
+	    llink->rlink = rest;
+	    tail->rlink = rest = llink;
+	    ++rotations;
+	} else {
+	    tail = rest;
+	    rest = rest->rlink;
+	}
+    }
+    return rotations;
+}
+
+/* Rotate left every other node of the |size|-node vine hanging off
+ * |pseudo_root->rlink|, first to make the bottom level, then repeatedly
+ * halving it into a tree. Returns the number of rotations. */
+static size_t
+vine_to_tree(sg_node* pseudo_root, size_t size)
+{
+    size_t rotations = 0;
+    size_t leaves = size + 1;
+    while (leaves & (leaves - 1))
+	leaves &= leaves - 1;
+    leaves = size + 1 - leaves;
+    for (size_t n = leaves, remaining = size - leaves;; n = remaining /= 2) {
+	sg_node* scanner = pseudo_root;
+	for (size_t i = 0; i < n; i++) {
+	    sg_node* child = scanner->rlink;
+	    scanner = scanner->rlink = child->rlink;
+	    child->rlink = scanner->llink;
+	    scanner->llink = child;
+	}
+	rotations += n;
+	if (remaining <= 1)
+	    break;
+    }
+    return rotations;
+}
+
+/* Rebuild the subtree of |size| nodes hanging from |*link| into a balanced
+ * tree in which every level but the last is full, returning the number of
+ * rotations performed. */
+static size_t
+rebuild(sg_node** link, size_t size)
+{
+    sg_node pseudo_root;
+    pseudo_root.rlink = *link;
+    size_t rotations = vine_from_tree(&pseudo_root);
+    rotations += vine_to_tree(&pseudo_root, size);
+    *link = pseudo_root.rlink;
+    return rotations;
+}
+
+const void*
+sg_tree_min(const sg_tree* tree)
+{
+    ASSERT(tree != NULL);
+
+    const sg_node* node = tree->root;
+    if (!node)
+	return NULL;
+    while (node->llink)
+	node = node->llink;
+    return node->key;
+}
+
+const void*
+sg_tree_max(const sg_tree* tree)
+{
+    ASSERT(tree != NULL);
+
+    const sg_node* node = tree->root;
+    if (!node)
+	return NULL;
+    while (node->rlink)
+	node = node->rlink;
+    return node->key;
+}
+
+size_t
+sg_tree_traverse(sg_tree* tree, dict_visit_func visit)
+{
+    ASSERT(tree != NULL);
+    ASSERT(visit != NULL);
+
+    sg_node* path[SG_MAX_HEIGHT];
+    unsigned depth = 0;
+    size_t count = 0;
+    sg_node* node = tree->root;
+    for (;;) {
+	while (node) {
+	    path[depth++] = node;
+	    node = node->llink;
+	}
+	if (!depth)
+	    break;
+	node = path[--depth];
+	++count;
+	if (!visit(node->key, NODE_DATUM(tree, node)))
+	    break;
+	node = node->rlink;
+    }
+    return count;
+}
+
+/* Without parent links, an export resumes by searching for the node it stopped
+ * at, stacking the nodes after it on the way as the traversal does. */
+size_t
+sg_tree_export(sg_tree* tree, void** keys, void** data, size_t max,
+	       dict_export_pos* pos)
+{
+    ASSERT(tree != NULL);
+    ASSERT(pos != NULL);
+
+    sg_node* path[SG_MAX_HEIGHT];
+    unsigned depth = 0;
+    sg_node* node = tree->root;
+    if (pos->node) {
+	const sg_node* next = pos->node;
+	while (node != next) {
+	    if (tree->cmp_func(next->key, node->key) < 0) {
+		path[depth++] = node;
+		node = node->llink;
+	    } else {
+		node = node->rlink;
+	    }
+	}
+	path[depth++] = node;
+	node = NULL;
+    } else if (pos->index) {
+	return 0;
+    }
+    size_t n = 0;
+    for (;;) {
+	while (node) {
+	    path[depth++] = node;
+	    node = node->llink;
+	}
+	if (!depth || n == max)
+	    break;
+	node = path[--depth];
+	if (keys)
+	    keys[n] = node->key;
+	if (data)
+	    data[n] = NODE_DATUM(tree, node);
+	n++;
+	node = node->rlink;
+    }
+    pos->index += n;
+    pos->node = depth ? path[depth - 1] : NULL;
+    return n;
+}
+
+size_t
+sg_tree_count(const sg_tree* tree)
+{
+    ASSERT(tree != NULL);
+
+    return tree->count;
+}
+
+size_t
+sg_tree_height(const sg_tree* tree)
+{
+    ASSERT(tree != NULL);
+
+    return tree->root ? node_height(tree->root) : 0;
+}
+
+size_t
+sg_tree_mheight(const sg_tree* tree)
+{
+    ASSERT(tree != NULL);
+
+    return tree->root ? node_mheight(tree->root) : 0;
+}
+
+size_t
+sg_tree_pathlen(const sg_tree* tree)
+{
+    ASSERT(tree != NULL);
+
+    return tree->root ? node_pathlen(tree->root, 1) : 0;
+}
+
+static sg_node*
+node_new(sg_tree* tree, void* key)
+{
+    sg_node* node = MALLOC(SET_NODE_SIZE(tree, sizeof(*node)));
+    if (node) {
+	node->key = key;
+	if (!tree->keys_only)
+	    node->datum = NULL;
+	node->llink = NULL;
+	node->rlink = NULL;
+    }
+    return node;
+}
+
+static sg_node*
+node_clone(const sg_tree* tree, sg_node* node,
+	   dict_key_datum_clone_func clone_func)
+{
+    ASSERT(node != NULL);
+
+    sg_node* clone = MALLOC(SET_NODE_SIZE(tree, sizeof(*clone)));
+    if (clone) {
+	clone->key = node->key;
+	void* datum = DICT_SET_MEMBER;
+	if (!tree->keys_only)
+	    clone->datum = node->datum;
+	if (clone_func)
+	    clone_func(&clone->key, tree->keys_only ? &datum : &clone->datum);
+	clone->llink = clone->rlink = NULL;
+	if ((node->llink &&
+	     !(clone->llink = node_clone(tree, node->llink, clone_func))) ||
+	    (node->rlink &&
+	     !(clone->rlink = node_clone(tree, node->rlink, clone_func)))) {
+	    node_free_clone(tree, clone, clone_func != NULL);
+	    return NULL;
+	}
+    }
+    return clone;
+}
+
+/* Frees a partial clone. Keys and data that |clone_func| copied belong to the
+ * clone and are passed to the delete function. */
+static void
+node_free_clone(const sg_tree* tree, sg_node* node, bool cloned)
+{
+    if (!node)
+	return;
+    node_free_clone(tree, node->llink, cloned);
+    node_free_clone(tree, node->rlink, cloned);
+    if (cloned && tree->del_func)
+	tree->del_func(node->key, NODE_DEL_DATUM(tree, node));
+    FREE(node);
+}
+
+static size_t
+node_count(const sg_node* node)
+{
+    size_t count = 0;
+    for (; node; node = node->rlink)
+	count += 1 + node_count(node->llink);
+    return count;
+}
+
+static size_t
+node_height(const sg_node* node)
+{
+    ASSERT(node != NULL);
+
+    size_t l = node->llink ? node_height(node->llink) + 1 : 0;
+    size_t r = node->rlink ? node_height(node->rlink) + 1 : 0;
+    return MAX(l, r);
+}
+
+static size_t
+node_mheight(const sg_node* node)
+{
+    ASSERT(node != NULL);
+
+    size_t l = node->llink ? node_mheight(node->llink) + 1 : 0;
+    size_t r = node->rlink ? node_mheight(node->rlink) + 1 : 0;
+    return MIN(l, r);
+}
+
+static size_t
+node_pathlen(const sg_node* node, size_t level)
+{
+    ASSERT(node != NULL);
+
+    size_t n = 0;
+    if (node->llink)
+	n += level + node_pathlen(node->llink, level + 1);
+    if (node->rlink)
+	n += level + node_pathlen(node->rlink, level + 1);
+    return n;
+}
+
+static bool
+node_verify(const sg_tree* tree, const sg_node* node,
+	    const void* lo, const void* hi)
+{
+    if (node) {
+	if (lo) {
+	    VERIFY(tree->cmp_func(lo, node->key) < 0);
+	}
+	if (hi) {
+	    VERIFY(tree->cmp_func(node->key, hi) < 0);
+	}
+	if (!node_verify(tree, node->llink, lo, node->key) ||
+	    !node_verify(tree, node->rlink, node->key, hi))
+	    return false;
+    }
+    return true;
+}
+
+bool
+sg_tree_verify(const sg_tree* tree)
+{
+    ASSERT(tree != NULL);
+
+    if (tree->root) {
+	VERIFY(tree->count > 0);
+	VERIFY(node_height(tree->root) <= height_bound(tree->max_count));
+    } else {
+	VERIFY(tree->count == 0);
+    }
+    VERIFY(node_count(tree->root) == tree->count);
+    VERIFY(tree->count <= tree->max_count);
+    VERIFY(tree->count * 3 >= tree->max_count * 2);
+    return node_verify(tree, tree->root, NULL, NULL);
+}
+
+sg_itor*
+sg_itor_new(sg_tree* tree)
+{
+    ASSERT(tree != NULL);
+
+    sg_itor* itor = MALLOC(sizeof(*itor));
+    if (itor) {
+	itor->tree = tree;
+	itor->node = NULL;
+	itor->depth = 0;
+    }
+    return itor;
+}
+
+dict_itor*
+sg_dict_itor_new(sg_tree* tree)
+{
+    ASSERT(tree != NULL);
+
+    dict_itor* itor = MALLOC(sizeof(*itor));
+    if (itor) {
+	if (!(itor->_itor = sg_itor_new(tree))) {
+	    FREE(itor);
+	    return NULL;
+	}
+	itor->_vtable = &sg_tree_itor_vtable;
+    }
+    return itor;
+}
+
+void
+sg_itor_free(sg_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    FREE(itor);
+}
+
+bool
+sg_itor_valid(const sg_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    return itor->node != NULL;
+}
+
+void
+sg_itor_invalidate(sg_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    itor->node = NULL;
+    itor->depth = 0;
+}
+
+/* Descend from |node| along llinks (or rlinks), recording the path. */
+static void
+itor_descend(sg_itor* itor, sg_node* node, bool left)
+{
+    if (node) {
+	for (;;) {
+	    sg_node* next = left ? node->llink : node->rlink;
+	    if (!next)
+		break;
+	    itor->path[itor->depth++] = node;
+	    node = next;
+	}
+    }
+    itor->node = node;
+}
+
+bool
+sg_itor_next(sg_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    sg_node* node = itor->node;
+    if (!node)
+	return sg_itor_first(itor);
+    if (node->rlink) {
+	itor->path[itor->depth++] = node;
+	itor_descend(itor, node->rlink, true);
+	return true;
+    }
+    while (itor->depth) {
+	sg_node* parent = itor->path[--itor->depth];
+	if (parent->llink == node) {
+	    itor->node = parent;
+	    return true;
+	}
+	node = parent;
+    }
+    itor->node = NULL;
+    return false;
+}
+
+bool
+sg_itor_prev(sg_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    sg_node* node = itor->node;
+    if (!node)
+	return sg_itor_last(itor);
+    if (node->llink) {
+	itor->path[itor->depth++] = node;
+	itor_descend(itor, node->llink, false);
+	return true;
+    }
+    while (itor->depth) {
+	sg_node* parent = itor->path[--itor->depth];
+	if (parent->rlink == node) {
+	    itor->node = parent;
+	    return true;
+	}
+	node = parent;
+    }
+    itor->node = NULL;
+    return false;
+}
+
+bool
+sg_itor_nextn(sg_itor* itor, size_t count)
+{
+    ASSERT(itor != NULL);
+
+    while (count--)
+	if (!sg_itor_next(itor))
+	    return false;
+    return itor->node != NULL;
+}
+
+bool
+sg_itor_prevn(sg_itor* itor, size_t count)
+{
+    ASSERT(itor != NULL);
+
+    while (count--)
+	if (!sg_itor_prev(itor))
+	    return false;
+    return itor->node != NULL;
+}
+
+bool
+sg_itor_first(sg_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    itor->depth = 0;
+    itor_descend(itor, itor->tree->root, true);
+    return itor->node != NULL;
+}
+
+bool
+sg_itor_last(sg_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    itor->depth = 0;
+    itor_descend(itor, itor->tree->root, false);
+    return itor->node != NULL;
+}
+
+bool
+sg_itor_search(sg_itor* itor, const void* key)
+{
+    ASSERT(itor != NULL);
+
+    itor->depth = 0;
+    sg_node* node = itor->tree->root;
+    while (node) {
+	int cmp = itor->tree->cmp_func(key, node->key);
+	if (!cmp) {
+	    itor->node = node;
+	    return true;
+	}
+	itor->path[itor->depth++] = node;
+	node = (cmp < 0) ? node->llink : node->rlink;
+    }
+    itor->node = NULL;
+    itor->depth = 0;
+    return false;
+}
+
+bool
+sg_itor_seek(sg_itor* itor, const void* key)
+{
+    ASSERT(itor != NULL);
+
+    sg_node* node = itor->node;
+    if (!node)
+	return false;
+    const dict_compare_func cmp = itor->tree->cmp_func;
+    if (cmp(node->key, key) >= 0)
+	return true;
+    /* Climb only while the parent is also before |key|. The key sought is then
+     * in |node|'s right subtree, or else it is the parent. */
+    while (itor->depth && cmp(itor->path[itor->depth - 1]->key, key) < 0)
+	node = itor->path[--itor->depth];
+    unsigned depth = itor->depth;
+    sg_node* found = depth ? itor->path[depth - 1] : NULL;
+    unsigned found_depth = depth ? depth - 1 : 0;
+    itor->path[depth++] = node;
+    for (node = node->rlink; node;) {
+	sg_node* next;
+	if (cmp(node->key, key) >= 0) {
+	    found = node;
+	    found_depth = depth;
+	    next = node->llink;
+	} else {
+	    next = node->rlink;
+	}
+	if (!next)
+	    break;
+	itor->path[depth++] = node;
+	node = next;
+    }
+    itor->node = found;
+    itor->depth = found ? found_depth : 0;
+    return found != NULL;
+}
+
+const void*
+sg_itor_key(const sg_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    return itor->node ? itor->node->key : NULL;
+}
+
+void**
+sg_itor_data(sg_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    return itor->node ? NODE_DATUM_SLOT(itor->tree, itor->node) : NULL;
+}
@@ -0,0 +1,1146 @@
+/*
+ * libdict -- dictionaries in POSIX shared memory implementation.
+ *
+ * Copyright (c) 2001-2011, Farooq Mela
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *    This product includes software developed by Farooq Mela.
+ * 4. Neither the name of the Farooq Mela nor the
+ *    names of contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY FAROOQ MELA ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL FAROOQ MELA BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * The shared memory object starts with a header, which holds the lock, the
+ * allocator state and the red-black tree sentinel; a hashtable's bucket heads
+ * follow it, and then the nodes, all of one size. A link is the offset of the
+ * node it points to from the start of the object. Hashtable chains end with
+ * offset 0, the header's, and red-black tree links with the offset of the
+ * sentinel, which, as in rb_tree, is black and whose parent link is written
+ * while removing. Freed nodes are kept on a free list linked through llink.
+ */
+
+#define _POSIX_C_SOURCE 200809L	    /* For shm_open() and pthread_rwlock_t. */
+
+#include "shm_map.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stddef.h> /* For offsetof() */
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "dict_private.h"
+
+#define SHM_MAGIC	    0x70616d6d68736c64ULL	/* "dlshmmap" */
+#define SHM_VERSION	    1
+
+#define SHM_RED		    0
+#define SHM_BLACK	    1
+
+typedef uint64_t	    shm_off;
+
+typedef struct {
+    shm_off		    llink;	/* Or the next node in a chain. */
+    shm_off		    rlink;
+    shm_off		    parent;
+    unsigned		    hash;
+    unsigned		    color;
+    void*		    datum;
+    /* The key follows. */
+} shm_node;
+
+typedef struct {
+    uint64_t		    magic;
+    uint32_t		    version;
+    uint32_t		    layout;
+    uint32_t		    ptr_size;
+    uint32_t		    lock_size;
+    uint64_t		    size;
+    uint64_t		    key_size;
+    uint64_t		    node_size;
+    uint64_t		    buckets;
+    uint64_t		    count;
+    shm_off		    root;
+    shm_off		    nodes;	/* The first node. */
+    shm_off		    top;	/* The space not yet allocated. */
+    shm_off		    free_list;
+    uint64_t		    free_count;
+    pthread_rwlock_t	    lock;
+    shm_node		    nil;
+} shm_header;
+
+struct shm_map {
+    unsigned char*	    base;
+    shm_header*		    hdr;
+    dict_compare_func	    cmp_func;
+    dict_hash_func	    hash_func;
+};
+
+struct shm_map_itor {
+    shm_map*		    map;
+    shm_off		    node;	/* 0 if the iterator is invalid. */
+};
+
+#define NODE(map, off)	    ((shm_node*)((map)->base + (off)))
+#define KEY(node)	    ((void*)((node) + 1))
+#define TABLE(map)	    ((shm_off*)((map)->hdr + 1))
+#define NIL		    ((shm_off)offsetof(shm_header, nil))
+#define COLOR(map, off)	    (NODE(map, off)->color)
+
+static dict_vtable shm_map_vtable = {
+    (dict_inew_func)	    shm_map_dict_itor_new,
+    (dict_dfree_func)	    shm_map_free,
+    (dict_insert_func)	    shm_map_insert,
+    (dict_search_func)	    shm_map_search,
+    (dict_remove_func)	    shm_map_remove,
+    (dict_clear_func)	    shm_map_clear,
+    (dict_traverse_func)    shm_map_traverse,
+    (dict_count_func)	    shm_map_count,
+    (dict_verify_func)	    shm_map_verify,
+    (dict_clone_func)	    shm_map_clone,
+    (dict_remove_many_func) NULL,
+    (dict_remove_if_func)   NULL,
+    (dict_mod_count_func)   NULL,/* Iterators hold the lock. */
+    (dict_export_func)	    NULL,
+    (dict_export_all_func)  NULL,
+};
+
+static itor_vtable shm_map_itor_vtable = {
+    (dict_ifree_func)	    shm_map_itor_free,
+    (dict_valid_func)	    shm_map_itor_valid,
+    (dict_invalidate_func)  shm_map_itor_invalidate,
+    (dict_next_func)	    shm_map_itor_next,
+    (dict_prev_func)	    shm_map_itor_prev,
+    (dict_nextn_func)	    shm_map_itor_nextn,
+    (dict_prevn_func)	    shm_map_itor_prevn,
+    (dict_first_func)	    shm_map_itor_first,
+    (dict_last_func)	    shm_map_itor_last,
+    (dict_key_func)	    shm_map_itor_key,
+    (dict_data_func)	    shm_map_itor_data,
+    (dict_iremove_func)	    NULL,/* The iterator holds a read lock. */
+    (dict_icompare_func)    NULL,/* shm_map_itor_compare not implemented yet */
+    (dict_iseek_func)	    shm_map_itor_seek
+};
+
+static void
+read_lock(const shm_map* map)
+{
+    const int err = pthread_rwlock_rdlock(&map->hdr->lock);
+    ASSERT(err == 0);
+    (void)err;
+}
+
+static void
+write_lock(const shm_map* map)
+{
+    const int err = pthread_rwlock_wrlock(&map->hdr->lock);
+    ASSERT(err == 0);
+    (void)err;
+}
+
+static void
+unlock(const shm_map* map)
+{
+    const int err = pthread_rwlock_unlock(&map->hdr->lock);
+    ASSERT(err == 0);
+    (void)err;
+}
+
+static shm_off
+node_alloc(shm_map* map)
+{
+    shm_header* hdr = map->hdr;
+    shm_off off = hdr->free_list;
+    if (off) {
+	hdr->free_list = NODE(map, off)->llink;
+	hdr->free_count--;
+    } else if (hdr->size - hdr->top >= hdr->node_size) {
+	off = hdr->top;
+	hdr->top += hdr->node_size;
+    }
+    return off;
+}
+
+static void
+node_free(shm_map* map, shm_off off)
+{
+    NODE(map, off)->llink = map->hdr->free_list;
+    map->hdr->free_list = off;
+    map->hdr->free_count++;
+}
+
+static shm_map*
+map_attach(void* base, dict_compare_func cmp_func, dict_hash_func hash_func)
+{
+    shm_map* map = MALLOC(sizeof(*map));
+    if (map) {
+	map->base = base;
+	map->hdr = base;
+	map->cmp_func = cmp_func;
+	map->hash_func = hash_func;
+    }
+    return map;
+}
+
+static dict*
+dict_wrap(shm_map* map)
+{
+    if (!map)
+	return NULL;
+    dict* dct = MALLOC(sizeof(*dct));
+    if (!dct) {
+	shm_map_free(map);
+	return NULL;
+    }
+    dct->_object = map;
+    dct->_vtable = &shm_map_vtable;
+    return dct;
+}
+
+shm_map*
+shm_map_create(const char* name, shm_map_layout layout, size_t size,
+	       size_t key_size, unsigned buckets, dict_compare_func cmp_func,
+	       dict_hash_func hash_func)
+{
+    ASSERT(name != NULL);
+    ASSERT(key_size > 0);
+    ASSERT(cmp_func != NULL);
+    ASSERT(layout == SHM_MAP_RB_TREE || (hash_func != NULL && buckets > 0));
+
+    if (layout != SHM_MAP_HASHTABLE)
+	buckets = 0;
+    const size_t node_size = sizeof(shm_node) + (key_size + 7) / 8 * 8;
+    const size_t nodes = sizeof(shm_header) + buckets * sizeof(shm_off);
+    if (size < nodes + node_size) {
+	errno = EINVAL;
+	return NULL;
+    }
+    const int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0)
+	return NULL;
+    void* base = MAP_FAILED;
+    if (ftruncate(fd, (off_t)size) == 0)
+	base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    shm_map* map = NULL;
+    if (base == MAP_FAILED || !(map = map_attach(base, cmp_func, hash_func))) {
+	const int err = errno;
+	if (base != MAP_FAILED)
+	    munmap(base, size);
+	shm_unlink(name);
+	errno = err;
+	return NULL;
+    }
+
+    /* The object starts out zeroed, so the bucket heads are empty. */
+    shm_header* hdr = map->hdr;
+    hdr->version = SHM_VERSION;
+    hdr->layout = layout;
+    hdr->ptr_size = sizeof(void*);
+    hdr->lock_size = sizeof(pthread_rwlock_t);
+    hdr->size = size;
+    hdr->key_size = key_size;
+    hdr->node_size = node_size;
+    hdr->buckets = buckets;
+    hdr->count = 0;
+    hdr->root = NIL;
+    hdr->nodes = hdr->top = nodes;
+    hdr->free_list = 0;
+    hdr->free_count = 0;
+    hdr->nil.llink = hdr->nil.rlink = hdr->nil.parent = NIL;
+    hdr->nil.color = SHM_BLACK;
+    pthread_rwlockattr_t attr;
+    int err = pthread_rwlockattr_init(&attr);
+    if (err == 0) {
+	err = pthread_rwlockattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+	if (err == 0)
+	    err = pthread_rwlock_init(&hdr->lock, &attr);
+	pthread_rwlockattr_destroy(&attr);
+    }
+    if (err != 0) {
+	shm_map_free(map);
+	shm_unlink(name);
+	errno = err;
+	return NULL;
+    }
+    hdr->magic = SHM_MAGIC;
+    return map;
+}
+
+dict*
+shm_dict_create(const char* name, shm_map_layout layout, size_t size,
+		size_t key_size, unsigned buckets, dict_compare_func cmp_func,
+		dict_hash_func hash_func)
+{
+    return dict_wrap(shm_map_create(name, layout, size, key_size, buckets,
+				    cmp_func, hash_func));
+}
+
+shm_map*
+shm_map_open(const char* name, dict_compare_func cmp_func,
+	     dict_hash_func hash_func)
+{
+    ASSERT(name != NULL);
+    ASSERT(cmp_func != NULL);
+
+    const int fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0)
+	return NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+	close(fd);
+	return NULL;
+    }
+    const size_t size = (size_t)st.st_size;
+    if (size < sizeof(shm_header)) {
+	close(fd);
+	errno = EINVAL;
+	return NULL;
+    }
+    void* base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+	return NULL;
+    const shm_header* hdr = base;
+    const bool hashed = hdr->layout == SHM_MAP_HASHTABLE;
+    if (hdr->magic != SHM_MAGIC || hdr->version != SHM_VERSION ||
+	hdr->ptr_size != sizeof(void*) ||
+	hdr->lock_size != sizeof(pthread_rwlock_t) || hdr->size != size ||
+	(!hashed && hdr->layout != SHM_MAP_RB_TREE) ||
+	(hashed && (!hash_func || hdr->buckets == 0)) ||
+	hdr->node_size != sizeof(shm_node) + (hdr->key_size + 7) / 8 * 8) {
+	munmap(base, size);
+	errno = EINVAL;
+	return NULL;
+    }
+    shm_map* map = map_attach(base, cmp_func, hash_func);
+    if (!map)
+	munmap(base, size);
+    return map;
+}
+
+dict*
+shm_dict_open(const char* name, dict_compare_func cmp_func,
+	      dict_hash_func hash_func)
+{
+    return dict_wrap(shm_map_open(name, cmp_func, hash_func));
+}
+
+bool
+shm_map_unlink(const char* name)
+{
+    ASSERT(name != NULL);
+
+    return shm_unlink(name) == 0;
+}
+
+size_t
+shm_map_free(shm_map* map)
+{
+    ASSERT(map != NULL);
+
+    const size_t count = map->hdr->count;
+    munmap(map->base, map->hdr->size);
+    FREE(map);
+    return count;
+}
+
+shm_map*
+shm_map_clone(shm_map* map, dict_key_datum_clone_func clone_func)
+{
+    ASSERT(map != NULL);
+
+    /* A clone would need a shared memory object of its own. */
+    (void)clone_func;
+    return NULL;
+}
+
+/* Returns the node holding |key|, whose hash value is |hash| in a hashtable,
+ * or 0 (NIL in a red-black tree). The lock must be held. */
+static shm_off
+node_find(const shm_map* map, const void* key, unsigned hash)
+{
+    if (map->hdr->layout == SHM_MAP_HASHTABLE) {
+	shm_off off = TABLE(map)[hash % map->hdr->buckets];
+	for (; off; off = NODE(map, off)->llink) {
+	    const shm_node* node = NODE(map, off);
+	    if (node->hash == hash && map->cmp_func(key, KEY(node)) == 0)
+		break;
+	}
+	return off;
+    }
+    shm_off off = map->hdr->root;
+    while (off != NIL) {
+	const int cmp = map->cmp_func(key, KEY(NODE(map, off)));
+	if (cmp < 0)
+	    off = NODE(map, off)->llink;
+	else if (cmp)
+	    off = NODE(map, off)->rlink;
+	else
+	    break;
+    }
+    return off;
+}
+
+static unsigned
+key_hash(const shm_map* map, const void* key)
+{
+    return map->hdr->layout == SHM_MAP_HASHTABLE ? map->hash_func(key) : 0;
+}
+
+static bool
+found(shm_off off)
+{
+    return off != 0 && off != NIL;
+}
+
+static void
+rot_left(shm_map* map, shm_off off)
+{
+    shm_node* node = NODE(map, off);
+    const shm_off r = node->rlink;
+    shm_node* rnode = NODE(map, r);
+    node->rlink = rnode->llink;
+    if (rnode->llink != NIL)
+	NODE(map, rnode->llink)->parent = off;
+    const shm_off parent = node->parent;
+    rnode->parent = parent;
+    if (parent == NIL)
+	map->hdr->root = r;
+    else if (NODE(map, parent)->llink == off)
+	NODE(map, parent)->llink = r;
+    else
+	NODE(map, parent)->rlink = r;
+    rnode->llink = off;
+    node->parent = r;
+    TRACE_ROTATE(map, node, 0);
+}
+
+static void
+rot_right(shm_map* map, shm_off off)
+{
+    shm_node* node = NODE(map, off);
+    const shm_off l = node->llink;
+    shm_node* lnode = NODE(map, l);
+    node->llink = lnode->rlink;
+    if (lnode->rlink != NIL)
+	NODE(map, lnode->rlink)->parent = off;
+    const shm_off parent = node->parent;
+    lnode->parent = parent;
+    if (parent == NIL)
+	map->hdr->root = l;
+    else if (NODE(map, parent)->llink == off)
+	NODE(map, parent)->llink = l;
+    else
+	NODE(map, parent)->rlink = l;
+    lnode->rlink = off;
+    node->parent = l;
+    TRACE_ROTATE(map, node, 1);
+}
+
+static void
+insert_fixup(shm_map* map, shm_off off)
+{
+    while (off != map->hdr->root &&
+	   COLOR(map, NODE(map, off)->parent) == SHM_RED) {
+	shm_off parent = NODE(map, off)->parent;
+	shm_off grand = NODE(map, parent)->parent;
+	if (parent == NODE(map, grand)->llink) {
+	    const shm_off uncle = NODE(map, grand)->rlink;
+	    if (COLOR(map, uncle) == SHM_RED) {
+		COLOR(map, uncle) = SHM_BLACK;
+		COLOR(map, parent) = SHM_BLACK;
+		COLOR(map, grand) = SHM_RED;
+		off = grand;
+	    } else {
+		if (off == NODE(map, parent)->rlink) {
+		    off = parent;
+		    rot_left(map, off);
+		    parent = NODE(map, off)->parent;
+		}
+		COLOR(map, parent) = SHM_BLACK;
+		COLOR(map, grand) = SHM_RED;
+		rot_right(map, grand);
+	    }
+	} else {
+	    const shm_off uncle = NODE(map, grand)->llink;
+	    if (COLOR(map, uncle) == SHM_RED) {
+		COLOR(map, uncle) = SHM_BLACK;
+		COLOR(map, parent) = SHM_BLACK;
+		COLOR(map, grand) = SHM_RED;
+		off = grand;
+	    } else {
+		if (off == NODE(map, parent)->llink) {
+		    off = parent;
+		    rot_right(map, off);
+		    parent = NODE(map, off)->parent;
+		}
+		COLOR(map, parent) = SHM_BLACK;
+		COLOR(map, grand) = SHM_RED;
+		rot_left(map, grand);
+	    }
+	}
+    }
+    COLOR(map, map->hdr->root) = SHM_BLACK;
+}
+
+static void
+delete_fixup(shm_map* map, shm_off off)
+{
+    while (off != map->hdr->root && COLOR(map, off) == SHM_BLACK) {
+	const shm_off parent = NODE(map, off)->parent;
+	if (NODE(map, parent)->llink == off) {
+	    shm_off sib = NODE(map, parent)->rlink;
+	    if (COLOR(map, sib) == SHM_RED) {
+		COLOR(map, sib) = SHM_BLACK;
+		COLOR(map, parent) = SHM_RED;
+		rot_left(map, parent);
+		sib = NODE(map, parent)->rlink;
+	    }
+	    if (COLOR(map, NODE(map, sib)->llink) == SHM_BLACK &&
+		COLOR(map, NODE(map, sib)->rlink) == SHM_BLACK) {
+		COLOR(map, sib) = SHM_RED;
+		off = parent;
+	    } else {
+		if (COLOR(map, NODE(map, sib)->rlink) == SHM_BLACK) {
+		    COLOR(map, NODE(map, sib)->llink) = SHM_BLACK;
+		    COLOR(map, sib) = SHM_RED;
+		    rot_right(map, sib);
+		    sib = NODE(map, parent)->rlink;
+		}
+		COLOR(map, sib) = COLOR(map, parent);
+		COLOR(map, NODE(map, sib)->rlink) = SHM_BLACK;
+		COLOR(map, parent) = SHM_BLACK;
+		rot_left(map, parent);
+		off = map->hdr->root;
+	    }
+	} else {
+	    shm_off sib = NODE(map, parent)->llink;
+	    if (COLOR(map, sib) == SHM_RED) {
+		COLOR(map, sib) = SHM_BLACK;
+		COLOR(map, parent) = SHM_RED;
+		rot_right(map, parent);
+		sib = NODE(map, parent)->llink;
+	    }
+	    if (COLOR(map, NODE(map, sib)->rlink) == SHM_BLACK &&
+		COLOR(map, NODE(map, sib)->llink) == SHM_BLACK) {
+		COLOR(map, sib) = SHM_RED;
+		off = parent;
+	    } else {
+		if (COLOR(map, NODE(map, sib)->llink) == SHM_BLACK) {
+		    COLOR(map, NODE(map, sib)->rlink) = SHM_BLACK;
+		    COLOR(map, sib) = SHM_RED;
+		    rot_left(map, sib);
+		    sib = NODE(map, parent)->llink;
+		}
+		COLOR(map, sib) = COLOR(map, parent);
+		COLOR(map, NODE(map, sib)->llink) = SHM_BLACK;
+		COLOR(map, parent) = SHM_BLACK;
+		rot_right(map, parent);
+		off = map->hdr->root;
+	    }
+	}
+    }
+    COLOR(map, off) = SHM_BLACK;
+}
+
+/* Returns the node holding |key|, inserting it if it is absent, or 0 if the
+ * object is full. The write lock must be held. */
+static shm_off
+node_insert(shm_map* map, const void* key, bool* inserted)
+{
+    shm_header* hdr = map->hdr;
+    const unsigned hash = key_hash(map, key);
+    shm_off parent = NIL, off;
+    int cmp = 0;
+    if (hdr->layout == SHM_MAP_HASHTABLE) {
+	if ((off = node_find(map, key, hash)) != 0) {
+	    *inserted = false;
+	    return off;
+	}
+    } else {
+	for (off = hdr->root; off != NIL;) {
+	    cmp = map->cmp_func(key, KEY(NODE(map, off)));
+	    if (cmp == 0) {
+		*inserted = false;
+		return off;
+	    }
+	    parent = off;
+	    off = cmp < 0 ? NODE(map, off)->llink : NODE(map, off)->rlink;
+	}
+    }
+
+    if (!(off = node_alloc(map)))
+	return 0;
+    *inserted = true;
+    shm_node* node = NODE(map, off);
+    memcpy(KEY(node), key, hdr->key_size);
+    node->hash = hash;
+    node->datum = NULL;
+    hdr->count++;
+    if (hdr->layout == SHM_MAP_HASHTABLE) {
+	shm_off* head = &TABLE(map)[hash % hdr->buckets];
+	node->llink = *head;
+	*head = off;
+	return off;
+    }
+    node->llink = node->rlink = NIL;
+    node->parent = parent;
+    node->color = SHM_RED;
+    if (parent == NIL)
+	hdr->root = off;
+    else if (cmp < 0)
+	NODE(map, parent)->llink = off;
+    else
+	NODE(map, parent)->rlink = off;
+    insert_fixup(map, off);
+    return off;
+}
+
+void**
+shm_map_insert(shm_map* map, void* key, bool* inserted)
+{
+    ASSERT(map != NULL);
+
+    bool added;
+    write_lock(map);
+    const shm_off off = node_insert(map, key, &added);
+    unlock(map);
+    TRACE_OP(insert, "shm", map, key, 0, off ? added : -1);
+    if (!off)
+	return NULL;
+    if (inserted)
+	*inserted = added;
+    return &NODE(map, off)->datum;
+}
+
+bool
+shm_map_put(shm_map* map, const void* key, void* datum)
+{
+    ASSERT(map != NULL);
+
+    bool added;
+    write_lock(map);
+    const shm_off off = node_insert(map, key, &added);
+    if (off)
+	NODE(map, off)->datum = datum;
+    unlock(map);
+    return off != 0;
+}
+
+void*
+shm_map_search(shm_map* map, const void* key)
+{
+    ASSERT(map != NULL);
+
+    const unsigned hash = key_hash(map, key);
+    read_lock(map);
+    const shm_off off = node_find(map, key, hash);
+    void* datum = found(off) ? NODE(map, off)->datum : NULL;
+    unlock(map);
+    TRACE_OP(search, "shm", map, key, 0, found(off));
+    return datum;
+}
+
+static void
+tree_remove(shm_map* map, shm_off off)
+{
+    shm_header* hdr = map->hdr;
+    shm_node* node = NODE(map, off);
+    shm_off out = off;
+    if (node->llink != NIL && node->rlink != NIL)
+	for (out = node->rlink; NODE(map, out)->llink != NIL;
+	     out = NODE(map, out)->llink)
+	    /* void */;
+    shm_node* onode = NODE(map, out);
+    const shm_off temp = onode->llink != NIL ? onode->llink : onode->rlink;
+    if (out != off) {
+	memcpy(KEY(node), KEY(onode), hdr->key_size);
+	node->datum = onode->datum;
+    }
+
+    const shm_off parent = onode->parent;
+    NODE(map, temp)->parent = parent;
+    if (parent == NIL)
+	hdr->root = temp;
+    else if (NODE(map, parent)->llink == out)
+	NODE(map, parent)->llink = temp;
+    else
+	NODE(map, parent)->rlink = temp;
+    if (onode->color == SHM_BLACK)
+	delete_fixup(map, temp);
+    node_free(map, out);
+}
+
+bool
+shm_map_remove(shm_map* map, const void* key)
+{
+    ASSERT(map != NULL);
+
+    const unsigned hash = key_hash(map, key);
+    write_lock(map);
+    shm_header* hdr = map->hdr;
+    bool removed = false;
+    if (hdr->layout == SHM_MAP_HASHTABLE) {
+	shm_off* link = &TABLE(map)[hash % hdr->buckets];
+	for (; *link; link = &NODE(map, *link)->llink) {
+	    shm_node* node = NODE(map, *link);
+	    if (node->hash == hash && map->cmp_func(key, KEY(node)) == 0) {
+		const shm_off off = *link;
+		*link = node->llink;
+		node_free(map, off);
+		removed = true;
+		break;
+	    }
+	}
+    } else {
+	const shm_off off = node_find(map, key, hash);
+	if ((removed = off != NIL))
+	    tree_remove(map, off);
+    }
+    if (removed)
+	hdr->count--;
+    unlock(map);
+    TRACE_OP(remove, "shm", map, key, 0, removed);
+    return removed;
+}
+
+size_t
+shm_map_clear(shm_map* map)
+{
+    ASSERT(map != NULL);
+
+    write_lock(map);
+    shm_header* hdr = map->hdr;
+    const size_t count = hdr->count;
+    memset(TABLE(map), 0, hdr->buckets * sizeof(shm_off));
+    hdr->root = NIL;
+    hdr->count = 0;
+    hdr->top = hdr->nodes;
+    hdr->free_list = 0;
+    hdr->free_count = 0;
+    unlock(map);
+    return count;
+}
+
+/* Returns the first node in iteration order, or 0. */
+static shm_off
+node_first(const shm_map* map)
+{
+    const shm_header* hdr = map->hdr;
+    if (hdr->layout == SHM_MAP_HASHTABLE) {
+	for (size_t b = 0; b < hdr->buckets; b++)
+	    if (TABLE(map)[b])
+		return TABLE(map)[b];
+	return 0;
+    }
+    shm_off off = hdr->root;
+    if (off == NIL)
+	return 0;
+    while (NODE(map, off)->llink != NIL)
+	off = NODE(map, off)->llink;
+    return off;
+}
+
+static shm_off
+node_last(const shm_map* map)
+{
+    const shm_header* hdr = map->hdr;
+    if (hdr->layout == SHM_MAP_HASHTABLE) {
+	for (size_t b = hdr->buckets; b-- > 0;) {
+	    shm_off off = TABLE(map)[b];
+	    if (off) {
+		while (NODE(map, off)->llink)
+		    off = NODE(map, off)->llink;
+		return off;
+	    }
+	}
+	return 0;
+    }
+    shm_off off = hdr->root;
+    if (off == NIL)
+	return 0;
+    while (NODE(map, off)->rlink != NIL)
+	off = NODE(map, off)->rlink;
+    return off;
+}
+
+/* Returns the node after |off| in iteration order, or 0. */
+static shm_off
+node_next(const shm_map* map, shm_off off)
+{
+    const shm_node* node = NODE(map, off);
+    if (map->hdr->layout == SHM_MAP_HASHTABLE) {
+	if (node->llink)
+	    return node->llink;
+	for (size_t b = node->hash % map->hdr->buckets + 1;
+	     b < map->hdr->buckets; b++)
+	    if (TABLE(map)[b])
+		return TABLE(map)[b];
+	return 0;
+    }
+    if (node->rlink != NIL) {
+	for (off = node->rlink; NODE(map, off)->llink != NIL;
+	     off = NODE(map, off)->llink)
+	    /* void */;
+	return off;
+    }
+    shm_off parent = node->parent;
+    while (parent != NIL && NODE(map, parent)->rlink == off) {
+	off = parent;
+	parent = NODE(map, parent)->parent;
+    }
+    return parent == NIL ? 0 : parent;
+}
+
+static shm_off
+node_prev(const shm_map* map, shm_off off)
+{
+    const shm_node* node = NODE(map, off);
+    if (map->hdr->layout == SHM_MAP_HASHTABLE) {
+	/* Chains are singly linked; find the node before this one. */
+	size_t b = node->hash % map->hdr->buckets;
+	shm_off prev = TABLE(map)[b];
+	if (prev != off) {
+	    while (NODE(map, prev)->llink != off)
+		prev = NODE(map, prev)->llink;
+	    return prev;
+	}
+	while (b-- > 0) {
+	    if ((prev = TABLE(map)[b]) != 0) {
+		while (NODE(map, prev)->llink)
+		    prev = NODE(map, prev)->llink;
+		return prev;
+	    }
+	}
+	return 0;
+    }
+    if (node->llink != NIL) {
+	for (off = node->llink; NODE(map, off)->rlink != NIL;
+	     off = NODE(map, off)->rlink)
+	    /* void */;
+	return off;
+    }
+    shm_off parent = node->parent;
+    while (parent != NIL && NODE(map, parent)->llink == off) {
+	off = parent;
+	parent = NODE(map, parent)->parent;
+    }
+    return parent == NIL ? 0 : parent;
+}
+
+size_t
+shm_map_traverse(shm_map* map, dict_visit_func visit)
+{
+    ASSERT(map != NULL);
+    ASSERT(visit != NULL);
+
+    size_t count = 0;
+    read_lock(map);
+    for (shm_off off = node_first(map); off; off = node_next(map, off)) {
+	++count;
+	if (!visit(KEY(NODE(map, off)), NODE(map, off)->datum))
+	    break;
+    }
+    unlock(map);
+    return count;
+}
+
+size_t
+shm_map_count(const shm_map* map)
+{
+    ASSERT(map != NULL);
+
+    return map->hdr->count;
+}
+
+size_t
+shm_map_room(const shm_map* map)
+{
+    ASSERT(map != NULL);
+
+    const shm_header* hdr = map->hdr;
+    return hdr->free_count + (hdr->size - hdr->top) / hdr->node_size;
+}
+
+static bool
+node_valid(const shm_map* map, shm_off off)
+{
+    const shm_header* hdr = map->hdr;
+    return off >= hdr->nodes && off < hdr->top &&
+	   (off - hdr->nodes) % hdr->node_size == 0;
+}
+
+/* Verifies the subtree at |off|, and returns its black height in |*height|
+ * and the number of its nodes in |*count|. */
+static bool
+tree_verify(const shm_map* map, shm_off parent, shm_off off, size_t* height,
+	    size_t* count)
+{
+    if (off == NIL) {
+	*height = 0;
+	return true;
+    }
+    VERIFY(node_valid(map, off));
+    const shm_node* node = NODE(map, off);
+    VERIFY(node->parent == parent);
+    if (node->color == SHM_RED) {
+	VERIFY(COLOR(map, node->llink) == SHM_BLACK);
+	VERIFY(COLOR(map, node->rlink) == SHM_BLACK);
+    } else {
+	VERIFY(node->color == SHM_BLACK);
+    }
+    if (node->llink != NIL)
+	VERIFY(map->cmp_func(KEY(NODE(map, node->llink)), KEY(node)) < 0);
+    if (node->rlink != NIL)
+	VERIFY(map->cmp_func(KEY(NODE(map, node->rlink)), KEY(node)) > 0);
+    size_t lheight, rheight;
+    if (!tree_verify(map, off, node->llink, &lheight, count) ||
+	!tree_verify(map, off, node->rlink, &rheight, count))
+	return false;
+    VERIFY(lheight == rheight);
+    *height = lheight + (node->color == SHM_BLACK);
+    ++*count;
+    return true;
+}
+
+static bool
+map_verify(const shm_map* map)
+{
+    const shm_header* hdr = map->hdr;
+    VERIFY(hdr->top <= hdr->size);
+    VERIFY(hdr->nil.color == SHM_BLACK);
+    size_t count = 0;
+    if (hdr->layout == SHM_MAP_HASHTABLE) {
+	for (size_t b = 0; b < hdr->buckets; b++) {
+	    for (shm_off off = TABLE(map)[b]; off; off = NODE(map, off)->llink) {
+		VERIFY(node_valid(map, off));
+		const shm_node* node = NODE(map, off);
+		VERIFY(node->hash % hdr->buckets == b);
+		VERIFY(map->hash_func(KEY(node)) == node->hash);
+		VERIFY(++count <= hdr->count);
+	    }
+	}
+    } else {
+	if (hdr->root != NIL)
+	    VERIFY(COLOR(map, hdr->root) == SHM_BLACK);
+	size_t height;
+	if (!tree_verify(map, NIL, hdr->root, &height, &count))
+	    return false;
+    }
+    VERIFY(count == hdr->count);
+    size_t nfree = 0;
+    for (shm_off off = hdr->free_list; off; off = NODE(map, off)->llink) {
+	VERIFY(node_valid(map, off));
+	VERIFY(++nfree <= hdr->free_count);
+    }
+    VERIFY(nfree == hdr->free_count);
+    VERIFY(hdr->count + nfree == (hdr->top - hdr->nodes) / hdr->node_size);
+    return true;
+}
+
+bool
+shm_map_verify(const shm_map* map)
+{
+    ASSERT(map != NULL);
+
+    read_lock(map);
+    const bool ok = map_verify(map);
+    unlock(map);
+    return ok;
+}
+
+shm_map_itor*
+shm_map_itor_new(shm_map* map)
+{
+    ASSERT(map != NULL);
+
+    shm_map_itor* itor = MALLOC(sizeof(*itor));
+    if (itor) {
+	itor->map = map;
+	itor->node = 0;
+	read_lock(map);
+    }
+    return itor;
+}
+
+dict_itor*
+shm_map_dict_itor_new(shm_map* map)
+{
+    ASSERT(map != NULL);
+
+    dict_itor* itor = MALLOC(sizeof(*itor));
+    if (itor) {
+	if (!(itor->_itor = shm_map_itor_new(map))) {
+	    FREE(itor);
+	    return NULL;
+	}
+	itor->_vtable = &shm_map_itor_vtable;
+    }
+    return itor;
+}
+
+void
+shm_map_itor_free(shm_map_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    unlock(itor->map);
+    FREE(itor);
+}
+
+bool
+shm_map_itor_valid(const shm_map_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    return itor->node != 0;
+}
+
+void
+shm_map_itor_invalidate(shm_map_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    itor->node = 0;
+}
+
+bool
+shm_map_itor_next(shm_map_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    if (itor->node)
+	itor->node = node_next(itor->map, itor->node);
+    return itor->node != 0;
+}
+
+bool
+shm_map_itor_prev(shm_map_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    if (itor->node)
+	itor->node = node_prev(itor->map, itor->node);
+    return itor->node != 0;
+}
+
+bool
+shm_map_itor_nextn(shm_map_itor* itor, size_t count)
+{
+    ASSERT(itor != NULL);
+
+    while (count--)
+	if (!shm_map_itor_next(itor))
+	    return false;
+    return itor->node != 0;
+}
+
+bool
+shm_map_itor_prevn(shm_map_itor* itor, size_t count)
+{
+    ASSERT(itor != NULL);
+
+    while (count--)
+	if (!shm_map_itor_prev(itor))
+	    return false;
+    return itor->node != 0;
+}
+
+bool
+shm_map_itor_first(shm_map_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    itor->node = node_first(itor->map);
+    return itor->node != 0;
+}
+
+bool
+shm_map_itor_last(shm_map_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    itor->node = node_last(itor->map);
+    return itor->node != 0;
+}
+
+bool
+shm_map_itor_search(shm_map_itor* itor, const void* key)
+{
+    ASSERT(itor != NULL);
+
+    const shm_map* map = itor->map;
+    const shm_off off = node_find(map, key, key_hash(map, key));
+    itor->node = found(off) ? off : 0;
+    return itor->node != 0;
+}
+
+bool
+shm_map_itor_seek(shm_map_itor* itor, const void* key)
+{
+    ASSERT(itor != NULL);
+
+    const shm_map* map = itor->map;
+    if (!itor->node || map->cmp_func(KEY(NODE(map, itor->node)), key) >= 0)
+	return itor->node != 0;
+    if (map->hdr->layout == SHM_MAP_HASHTABLE) {
+	do {
+	    if (!(itor->node = node_next(map, itor->node)))
+		return false;
+	} while (map->cmp_func(KEY(NODE(map, itor->node)), key) < 0);
+	return true;
+    }
+    /* The keys before the iterator are less than |key| too, so the first key
+     * not less than it can be found from the root. */
+    shm_off best = 0;
+    for (shm_off off = map->hdr->root; off != NIL;) {
+	if (map->cmp_func(KEY(NODE(map, off)), key) < 0) {
+	    off = NODE(map, off)->rlink;
+	} else {
+	    best = off;
+	    off = NODE(map, off)->llink;
+	}
+    }
+    itor->node = best;
+    return itor->node != 0;
+}
+
+const void*
+shm_map_itor_key(const shm_map_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    return itor->node ? KEY(NODE(itor->map, itor->node)) : NULL;
+}
+
+void**
+shm_map_itor_data(shm_map_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    return itor->node ? &NODE(itor->map, itor->node)->datum : NULL;
+}
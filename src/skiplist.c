@@ -40,7 +40,6 @@ typedef struct skip_node skip_node;
 
 struct skip_node {
     void*		    key;
-    void*		    datum;
     skip_node*		    prev;
     unsigned		    link_count;
     skip_node*		    link[0];
@@ -48,14 +47,73 @@ struct skip_node {
 
 #define MAX_LINK	    32
 
+/* A superseded state of a node of a versioned list. */
+typedef struct skip_version skip_version;
+struct skip_version {
+    void*		    key;
+    void*		    datum;
+    uint64_t		    seq;	/* When this state was committed. */
+    bool		    removed;	/* Whether the key was absent. */
+    skip_version*	    next;	/* The next older state. */
+};
+
+/* The versioning information of a node of a versioned list, which follows its
+ * datum. The node's key and datum are its current state. */
+typedef struct {
+    uint64_t		    seq;	/* When the current state was committed. */
+    bool		    removed;	/* Whether the key is currently absent. */
+    bool		    queued;	/* Whether the node is on the GC list. */
+    skip_version*	    older;	/* Superseded states, newest first. */
+    skip_node*		    gc_next;	/* Next node with older states. */
+} skip_versions;
+
+/* A node's links are followed by its datum, which a set does not allocate, and
+ * then by its versioning information if the list is versioned. */
+#define NODE_SIZE(links)    (sizeof(skip_node) + sizeof(skip_node*) * (links))
+#define DATUM_SIZE(list)    ((list)->keys_only ? 0 : sizeof(void*))
+#define DATUM(node) \
+    (*(void**)((char*)(node) + NODE_SIZE((node)->link_count)))
+#define VERSIONS(list,node) \
+    ((skip_versions*)((char*)(node) + NODE_SIZE((node)->link_count) + \
+		      DATUM_SIZE(list)))
+#define REMOVED(list,node)  ((list)->versioned && VERSIONS(list,node)->removed)
+
+/* The datum of |node|, and the datum to pass to the delete function. */
+#define LIST_DATUM(list,node) \
+    ((list)->keys_only ? DICT_SET_MEMBER : DATUM(node))
+#define LIST_DEL_DATUM(list,node) \
+    ((list)->keys_only ? NULL : DATUM(node))
+/* The pointer to return for the datum of |node|. */
+#define LIST_DATUM_SLOT(list,node) \
+    ((list)->keys_only ? \
+     ((list)->set_datum = DICT_SET_MEMBER, &(list)->set_datum) : &DATUM(node))
+
+/* The sequence number under which iterators see the current state. */
+#define CURRENT_SEQ	    UINT64_MAX
+
 struct skiplist {
     skip_node*		    head;
     unsigned		    max_link;
     unsigned		    top_link;
     dict_compare_func	    cmp_func;
     dict_delete_func	    del_func;
+    bool		    keys_only;
+    void*		    set_datum;
     size_t		    count;
+    size_t		    mod_count;	/* Nodes added, revived or removed. */
     unsigned		    randgen;
+    bool		    versioned;
+    uint64_t		    seq;	/* Last commit sequence number. */
+    skiplist_snapshot*	    oldest;	/* Open snapshots, oldest first. */
+    skiplist_snapshot*	    newest;
+    skip_node*		    gc_list;	/* Nodes with older states. */
+};
+
+struct skiplist_snapshot {
+    skiplist*		    list;
+    uint64_t		    seq;
+    skiplist_snapshot*	    prev;
+    skiplist_snapshot*	    next;
 };
 
 #define RGEN_A		    1664525U
@@ -64,8 +122,11 @@ struct skiplist {
 struct skiplist_itor {
     skiplist*		    list;
     skip_node*		    node;
+    uint64_t		    seq;	/* The snapshot's, or CURRENT_SEQ. */
 };
 
+static size_t	    skiplist_mod_count(const skiplist* list);
+
 static dict_vtable skiplist_vtable = {
     (dict_inew_func)	    skiplist_dict_itor_new,
     (dict_dfree_func)	    skiplist_free,
@@ -77,6 +138,11 @@ static dict_vtable skiplist_vtable = {
     (dict_count_func)	    skiplist_count,
     (dict_verify_func)	    skiplist_verify,
     (dict_clone_func)	    skiplist_clone,
+    (dict_remove_many_func) NULL,/* skiplist_remove_many not implemented yet */
+    (dict_remove_if_func)   NULL,/* skiplist_remove_if not implemented yet */
+    (dict_mod_count_func)   skiplist_mod_count,
+    (dict_export_func)	    skiplist_export,
+    (dict_export_all_func)  NULL,/* skiplist_export_all not implemented yet */
 };
 
 static itor_vtable skiplist_itor_vtable = {
@@ -92,11 +158,20 @@ static itor_vtable skiplist_itor_vtable = {
     (dict_key_func)	    skiplist_itor_key,
     (dict_data_func)	    skiplist_itor_data,
     (dict_iremove_func)	    NULL,/* skiplist_itor_remove not implemented yet */
-    (dict_icompare_func)    NULL/* skiplist_itor_compare not implemented yet */
+    (dict_icompare_func)    NULL,/* skiplist_itor_compare not implemented yet */
+    (dict_iseek_func)	    skiplist_itor_seek
 };
 
-static skip_node*   node_new(void* key, unsigned link_count);
+static skip_node*   node_new(void* key, unsigned link_count, size_t size);
 static void**	    node_insert(skiplist* list, void* key, skip_node** update);
+static void	    node_unlink(skiplist* list, skip_node* x,
+				skip_node** update);
+static bool	    node_state(skiplist* list, skip_node* node,
+			       uint64_t seq, void** key, void*** datum);
+static bool	    node_save(skiplist* list, skip_node* node);
+static void	    versions_free(skiplist* list, skip_version* version,
+				  bool removal);
+static void	    versions_collect(skiplist* list);
 static unsigned	    rand_link_count(skiplist* list);
 
 skiplist*
@@ -110,7 +185,7 @@ skiplist_new(dict_compare_func cmp_func, dict_delete_func del_func,
 
     skiplist* list = MALLOC(sizeof(*list));
     if (list) {
-	if (!(list->head = node_new(NULL, max_link))) {
+	if (!(list->head = node_new(NULL, max_link, NODE_SIZE(max_link)))) {
 	    FREE(list);
 	    return NULL;
 	}
@@ -119,8 +194,15 @@ skiplist_new(dict_compare_func cmp_func, dict_delete_func del_func,
 	list->top_link = 0;
 	list->cmp_func = cmp_func ? cmp_func : dict_ptr_cmp;
 	list->del_func = del_func;
+	list->keys_only = false;
+	list->set_datum = NULL;
 	list->count = 0;
+	list->mod_count = 0;
 	list->randgen = rand();
+	list->versioned = false;
+	list->seq = 0;
+	list->oldest = list->newest = NULL;
+	list->gc_list = NULL;
     }
     return list;
 }
@@ -139,10 +221,36 @@ skiplist_dict_new(dict_compare_func cmp_func, dict_delete_func del_func,
     return dct;
 }
 
+skiplist*
+skiplist_new_set(dict_compare_func cmp_func, dict_delete_func del_func,
+		 unsigned max_link)
+{
+    skiplist* list = skiplist_new(cmp_func, del_func, max_link);
+    if (list)
+	list->keys_only = true;
+    return list;
+}
+
+dict*
+skiplist_dict_new_set(dict_compare_func cmp_func, dict_delete_func del_func,
+		      unsigned max_link)
+{
+    dict* dct = MALLOC(sizeof(*dct));
+    if (dct) {
+	if (!(dct->_object = skiplist_new_set(cmp_func, del_func, max_link))) {
+	    FREE(dct);
+	    return NULL;
+	}
+	dct->_vtable = &skiplist_vtable;
+    }
+    return dct;
+}
+
 size_t
 skiplist_free(skiplist* list)
 {
     ASSERT(list != NULL);
+    ASSERT(list->oldest == NULL);
 
     size_t count = skiplist_clear(list);
     FREE(list->head);
@@ -158,21 +266,24 @@ skiplist_clone(skiplist* list, dict_key_datum_clone_func clone_func)
     skiplist* clone = skiplist_new(list->cmp_func, list->del_func,
 				   list->max_link);
     if (clone) {
+	clone->versioned = list->versioned;
+	clone->keys_only = list->keys_only;
 	skip_node* node = list->head->link[0];
-	while (node) {
+	for (; node; node = node->link[0]) {
+	    if (REMOVED(list, node))
+		continue;
 	    bool inserted = false;
 	    void** datum = skiplist_insert(clone, node->key, &inserted);
 	    if (!datum || !inserted) {
 		skiplist_free(clone);
 		return NULL;
 	    }
-	    *datum = node->datum;
-	    node = node->link[0];
+	    *datum = LIST_DATUM(list, node);
 	}
 	if (clone_func) {
 	    node = clone->head->link[0];
 	    while (node) {
-		clone_func(&node->key, &node->datum);
+		clone_func(&node->key, LIST_DATUM_SLOT(clone, node));
 		node = node->link[0];
 	    }
 	}
@@ -185,10 +296,21 @@ node_insert(skiplist* list, void* key, skip_node** update)
 {
     const unsigned nlinks = rand_link_count(list);
     ASSERT(nlinks < list->max_link);
-    skip_node* x = node_new(key, nlinks);
+    skip_node* x = node_new(key, nlinks, NODE_SIZE(nlinks) + DATUM_SIZE(list) +
+			    (list->versioned ? sizeof(skip_versions) : 0));
     if (!x) {
 	return NULL;
     }
+    if (!list->keys_only)
+	DATUM(x) = NULL;
+    if (list->versioned) {
+	skip_versions* versions = VERSIONS(list, x);
+	versions->seq = ++list->seq;
+	versions->removed = false;
+	versions->queued = false;
+	versions->older = NULL;
+	versions->gc_next = NULL;
+    }
 
     if (list->top_link < nlinks) {
 	for (unsigned k = list->top_link+1; k <= nlinks; k++) {
@@ -207,7 +329,29 @@ node_insert(skiplist* list, void* key, skip_node** update)
 	update[k]->link[k] = x;
     }
     ++list->count;
-    return &x->datum;
+    list->mod_count++;
+    return LIST_DATUM_SLOT(list, x);
+}
+
+/* Return the number of keys that |key| is compared with to find it, or to find
+ * that it is not in the list. */
+static size_t
+search_depth(const skiplist* list, const void* key)
+{
+    size_t depth = 0;
+    const skip_node* x = list->head;
+    for (unsigned k = list->top_link+1; k-->0;) {
+	while (x->link[k]) {
+	    ++depth;
+	    int cmp = list->cmp_func(key, x->link[k]->key);
+	    if (cmp < 0)
+		break;
+	    x = x->link[k];
+	    if (cmp == 0)
+		return depth;
+	}
+    }
+    return depth;
 }
 
 void**
@@ -215,6 +359,8 @@ skiplist_insert(skiplist* list, void* key, bool* inserted)
 {
     ASSERT(list != NULL);
 
+    size_t depth = TRACE_DEPTH(insert, search_depth(list, key));
+
     skip_node* x = list->head;
     skip_node* update[MAX_LINK] = { 0 };
     for (unsigned k = list->top_link+1; k-->0; ) {
@@ -225,14 +371,33 @@ skiplist_insert(skiplist* list, void* key, bool* inserted)
     }
     x = x->link[0];
     if (x && list->cmp_func(key, x->key) == 0) {
+	bool revived = false;
+	if (list->versioned) {
+	    if (!node_save(list, x)) {
+		TRACE_OP(insert, "skiplist", list, key, depth, -1);
+		return NULL;
+	    }
+	    skip_versions* versions = VERSIONS(list, x);
+	    versions->seq = ++list->seq;
+	    if ((revived = versions->removed)) {
+		/* The old key belongs to the state that was removed. */
+		versions->removed = false;
+		x->key = key;
+		if (!list->keys_only)
+		    DATUM(x) = NULL;
+		list->count++;
+		list->mod_count++;
+	    }
+	}
 	if (inserted)
-	    *inserted = false;
-	return &x->datum;
+	    *inserted = revived;
+	TRACE_OP(insert, "skiplist", list, key, depth, revived);
+	return LIST_DATUM_SLOT(list, x);
     }
     void **datum = node_insert(list, key, update);
-    if (datum) {
+    if (datum && inserted)
 	*inserted = true;
-    }
+    TRACE_OP(insert, "skiplist", list, key, depth, datum ? 1 : -1);
     return datum;
 }
 
@@ -241,6 +406,8 @@ skiplist_search(skiplist* list, const void* key)
 {
     ASSERT(list != NULL);
 
+    size_t depth = TRACE_DEPTH(search, search_depth(list, key));
+
     skip_node* x = list->head;
     for (unsigned k = list->top_link+1; k-->0;) {
 	while (x->link[k]) {
@@ -248,10 +415,14 @@ skiplist_search(skiplist* list, const void* key)
 	    if (cmp < 0)
 		break;
 	    x = x->link[k];
-	    if (cmp == 0)
-		return x->datum;
+	    if (cmp == 0) {
+		TRACE_OP(search, "skiplist", list, key, depth,
+			 !REMOVED(list, x));
+		return REMOVED(list, x) ? NULL : LIST_DATUM(list, x);
+	    }
 	}
     }
+    TRACE_OP(search, "skiplist", list, key, depth, 0);
     return NULL;
 }
 
@@ -260,6 +431,8 @@ skiplist_remove(skiplist* list, const void* key)
 {
     ASSERT(list != NULL);
 
+    size_t depth = TRACE_DEPTH(remove, search_depth(list, key));
+
     skip_node* x = list->head;
     skip_node* update[MAX_LINK] = { 0 };
     for (unsigned k = list->top_link+1; k-->0;) {
@@ -269,8 +442,41 @@ skiplist_remove(skiplist* list, const void* key)
 	update[k] = x;
     }
     x = x->link[0];
-    if (!x || list->cmp_func(key, x->key) != 0)
+    if (!x || list->cmp_func(key, x->key) != 0 || REMOVED(list, x)) {
+	TRACE_OP(remove, "skiplist", list, key, depth, 0);
 	return false;
+    }
+    if (list->versioned) {
+	/* Leave the node for the snapshots that may still see it. */
+	if (!node_save(list, x)) {
+	    TRACE_OP(remove, "skiplist", list, key, depth, 0);
+	    return false;
+	}
+	skip_versions* versions = VERSIONS(list, x);
+	versions->seq = ++list->seq;
+	if (versions->older) {
+	    versions->removed = true;
+	    list->count--;
+	    list->mod_count++;
+	    TRACE_OP(remove, "skiplist", list, key, depth, 1);
+	    return true;
+	}
+    }
+    ASSERT(!list->versioned || !VERSIONS(list, x)->queued);
+    node_unlink(list, x, update);
+    if (list->del_func)
+	list->del_func(x->key, LIST_DEL_DATUM(list, x));
+    FREE(x);
+    list->count--;
+    list->mod_count++;
+    TRACE_OP(remove, "skiplist", list, key, depth, 1);
+    return true;
+}
+
+/* Unlink |x| from the list, given its predecessor at each level. */
+static void
+node_unlink(skiplist* list, skip_node* x, skip_node** update)
+{
     for (unsigned k = 0; k <= list->top_link; k++) {
 	ASSERT(update[k] != NULL);
 	ASSERT(update[k]->link_count > k);
@@ -282,13 +488,8 @@ skiplist_remove(skiplist* list, const void* key)
 	x->prev->link[0] = x->link[0];
     if (x->link[0])
 	x->link[0]->prev = x->prev;
-    if (list->del_func)
-	list->del_func(x->key, x->datum);
-    FREE(x);
     while (list->top_link > 0 && !list->head->link[list->top_link-1])
 	list->top_link--;
-    list->count--;
-    return true;
 }
 
 size_t
@@ -299,14 +500,20 @@ skiplist_clear(skiplist* list)
     skip_node* node = list->head->link[0];
     while (node) {
 	skip_node* next = node->link[0];
-	if (list->del_func)
-	    list->del_func(node->key, node->datum);
+	if (list->del_func && !REMOVED(list, node))
+	    list->del_func(node->key, LIST_DEL_DATUM(list, node));
+	if (list->versioned) {
+	    skip_versions* versions = VERSIONS(list, node);
+	    versions_free(list, versions->older, versions->removed);
+	}
 	FREE(node);
 	node = next;
     }
+    list->gc_list = NULL;
 
     const size_t count = list->count;
     list->count = 0;
+    list->mod_count++;
     list->head->link[list->top_link] = NULL;
     while (list->top_link)
 	list->head->link[--list->top_link] = NULL;
@@ -322,13 +529,43 @@ skiplist_traverse(skiplist* list, dict_visit_func visit)
 
     size_t count = 0;
     for (skip_node* node = list->head->link[0]; node; node = node->link[0]) {
+	if (REMOVED(list, node))
+	    continue;
 	++count;
-	if (!visit(node->key, node->datum))
+	if (!visit(node->key, LIST_DATUM(list, node)))
 	    break;
     }
     return count;
 }
 
+size_t
+skiplist_export(skiplist* list, void** keys, void** data, size_t max,
+		dict_export_pos* pos)
+{
+    ASSERT(list != NULL);
+    ASSERT(pos != NULL);
+
+    skip_node* node = pos->node;
+    if (!node) {
+	if (pos->index)
+	    return 0;
+	node = list->head->link[0];
+    }
+    size_t n = 0;
+    for (; node && n < max; node = node->link[0]) {
+	if (REMOVED(list, node))
+	    continue;
+	if (keys)
+	    keys[n] = node->key;
+	if (data)
+	    data[n] = LIST_DATUM(list, node);
+	n++;
+    }
+    pos->index += n;
+    pos->node = node;
+    return n;
+}
+
 size_t
 skiplist_count(const skiplist* list)
 {
@@ -337,6 +574,14 @@ skiplist_count(const skiplist* list)
     return list->count;
 }
 
+static size_t
+skiplist_mod_count(const skiplist* list)
+{
+    ASSERT(list != NULL);
+
+    return list->mod_count;
+}
+
 bool
 skiplist_verify(const skiplist* list)
 {
@@ -353,6 +598,7 @@ skiplist_verify(const skiplist* list)
 	VERIFY(list->head->link[i] == NULL);
     }
     unsigned observed_top_link = 0;
+    size_t count = 0, queued = 0;
 
     skip_node* prev = list->head;
     skip_node* node = list->head->link[0];
@@ -360,6 +606,20 @@ skiplist_verify(const skiplist* list)
     while (node) {
 	if (observed_top_link < node->link_count)
 	    observed_top_link = node->link_count;
+	if (!REMOVED(list, node))
+	    count++;
+	if (list->versioned) {
+	    const skip_versions* versions = VERSIONS(list, node);
+	    VERIFY(versions->seq <= list->seq);
+	    VERIFY(versions->older || !versions->removed);
+	    VERIFY(versions->queued == (versions->older != NULL));
+	    queued += versions->queued;
+	    uint64_t seq = versions->seq;
+	    for (const skip_version* v = versions->older; v; v = v->next) {
+		VERIFY(v->seq < seq);
+		seq = v->seq;
+	    }
+	}
 
 	VERIFY(node->prev == prev);
 	VERIFY(node->link_count >= 1);
@@ -374,11 +634,23 @@ skiplist_verify(const skiplist* list)
 	node = node->link[0];
     }
     VERIFY(list->top_link == observed_top_link);
+    VERIFY(list->count == count);
+    for (node = list->gc_list; node; node = VERSIONS(list, node)->gc_next)
+	queued--;
+    VERIFY(queued == 0);
+    if (!list->oldest) {
+	VERIFY(list->gc_list == NULL);
+    }
     return true;
 }
 
 #define VALID(itor) ((itor)->node && (itor)->node != (itor)->list->head)
 
+/* Whether the node under |itor| has a state in its view. */
+#define VISIBLE(itor) \
+    (!(itor)->list->versioned || \
+     node_state((itor)->list, (itor)->node, (itor)->seq, NULL, NULL))
+
 skiplist_itor*
 skiplist_itor_new(skiplist* list)
 {
@@ -388,6 +660,7 @@ skiplist_itor_new(skiplist* list)
     if (itor) {
 	itor->list = list;
 	itor->node = NULL;
+	itor->seq = CURRENT_SEQ;
     }
     return itor;
 }
@@ -440,7 +713,9 @@ skiplist_itor_next(skiplist_itor* itor)
     if (!itor->node)
 	return skiplist_itor_first(itor);
 
-    itor->node = itor->node->link[0];
+    do {
+	itor->node = itor->node->link[0];
+    } while (VALID(itor) && !VISIBLE(itor));
     return VALID(itor);
 }
 
@@ -452,7 +727,9 @@ skiplist_itor_prev(skiplist_itor* itor)
     if (!itor->node)
 	return skiplist_itor_last(itor);
 
-    itor->node = itor->node->prev;
+    do {
+	itor->node = itor->node->prev;
+    } while (VALID(itor) && !VISIBLE(itor));
     return VALID(itor);
 }
 
@@ -484,6 +761,8 @@ skiplist_itor_first(skiplist_itor* itor)
     ASSERT(itor != NULL);
 
     itor->node = itor->list->head->link[0];
+    while (VALID(itor) && !VISIBLE(itor))
+	itor->node = itor->node->link[0];
     return VALID(itor);
 }
 
@@ -497,13 +776,14 @@ skiplist_itor_last(skiplist_itor* itor)
 	while (x->link[k])
 	    x = x->link[k];
     }
-    if (x == itor->list->head) {
+    itor->node = x;
+    while (VALID(itor) && !VISIBLE(itor))
+	itor->node = itor->node->prev;
+    if (!VALID(itor)) {
 	itor->node = NULL;
 	return false;
-    } else {
-	itor->node = x;
-	return true;
     }
+    return true;
 }
 
 bool
@@ -521,7 +801,10 @@ skiplist_itor_search(skiplist_itor* itor, const void* key)
 	    x = x->link[k];
 	    if (cmp == 0) {
 		itor->node = x;
-		return true;
+		if (VISIBLE(itor))
+		    return true;
+		itor->node = NULL;
+		return false;
 	    }
 	}
     }
@@ -529,12 +812,45 @@ skiplist_itor_search(skiplist_itor* itor, const void* key)
     return false;
 }
 
+bool
+skiplist_itor_seek(skiplist_itor* itor, const void* key)
+{
+    ASSERT(itor != NULL);
+
+    if (!VALID(itor))
+	return false;
+    const skiplist* list = itor->list;
+    skip_node* x = itor->node;
+    if (list->cmp_func(x->key, key) >= 0)
+	return true;
+    /* Follow each node's highest link while it stays before |key|, which
+     * climbs to nodes of ever more links, then descend as in a search. */
+    for (;;) {
+	skip_node* next = x->link[x->link_count - 1];
+	if (!next || list->cmp_func(next->key, key) >= 0)
+	    break;
+	x = next;
+    }
+    for (unsigned k = x->link_count; k-->0;) {
+	while (x->link[k] && list->cmp_func(x->link[k]->key, key) < 0)
+	    x = x->link[k];
+    }
+    itor->node = x->link[0];
+    while (VALID(itor) && !VISIBLE(itor))
+	itor->node = itor->node->link[0];
+    return VALID(itor);
+}
+
 const void*
 skiplist_itor_key(const skiplist_itor* itor)
 {
     ASSERT(itor != NULL);
 
-    return itor->node ? itor->node->key : NULL;
+    void* key;
+    if (!itor->node || !node_state(itor->list, itor->node, itor->seq, &key,
+				   NULL))
+	return NULL;
+    return key;
 }
 
 void**
@@ -542,19 +858,264 @@ skiplist_itor_data(skiplist_itor* itor)
 {
     ASSERT(itor != NULL);
 
-    return itor->node ? &itor->node->datum : NULL;
+    void** datum;
+    if (!itor->node || !node_state(itor->list, itor->node, itor->seq, NULL,
+				   &datum))
+	return NULL;
+    return datum;
+}
+
+bool
+skiplist_set_versioned(skiplist* list, bool versioned)
+{
+    ASSERT(list != NULL);
+
+    if (list->head->link[0] || list->oldest)
+	return false;
+    list->versioned = versioned;
+    return true;
+}
+
+uint64_t
+skiplist_sequence(const skiplist* list)
+{
+    ASSERT(list != NULL);
+
+    return list->seq;
+}
+
+skiplist_snapshot*
+skiplist_snapshot_open(skiplist* list)
+{
+    ASSERT(list != NULL);
+
+    if (!list->versioned)
+	return NULL;
+    skiplist_snapshot* snapshot = MALLOC(sizeof(*snapshot));
+    if (snapshot) {
+	snapshot->list = list;
+	snapshot->seq = list->seq;
+	snapshot->next = NULL;
+	if ((snapshot->prev = list->newest) != NULL)
+	    list->newest->next = snapshot;
+	else
+	    list->oldest = snapshot;
+	list->newest = snapshot;
+    }
+    return snapshot;
+}
+
+void
+skiplist_snapshot_close(skiplist_snapshot* snapshot)
+{
+    ASSERT(snapshot != NULL);
+
+    skiplist* list = snapshot->list;
+    if (snapshot->next)
+	snapshot->next->prev = snapshot->prev;
+    else
+	list->newest = snapshot->prev;
+    if (snapshot->prev) {
+	snapshot->prev->next = snapshot->next;
+	FREE(snapshot);
+    } else {
+	list->oldest = snapshot->next;
+	FREE(snapshot);
+	versions_collect(list);
+    }
+}
+
+uint64_t
+skiplist_snapshot_sequence(const skiplist_snapshot* snapshot)
+{
+    ASSERT(snapshot != NULL);
+
+    return snapshot->seq;
+}
+
+void*
+skiplist_snapshot_search(const skiplist_snapshot* snapshot, const void* key)
+{
+    ASSERT(snapshot != NULL);
+
+    skiplist* list = snapshot->list;
+    skip_node* x = list->head;
+    for (unsigned k = list->top_link+1; k-->0;) {
+	while (x->link[k]) {
+	    int cmp = list->cmp_func(key, x->link[k]->key);
+	    if (cmp < 0)
+		break;
+	    x = x->link[k];
+	    if (cmp == 0) {
+		void** datum;
+		return node_state(list, x, snapshot->seq, NULL, &datum) ?
+		    *datum : NULL;
+	    }
+	}
+    }
+    return NULL;
+}
+
+skiplist_itor*
+skiplist_snapshot_itor_new(skiplist_snapshot* snapshot)
+{
+    ASSERT(snapshot != NULL);
+
+    skiplist_itor* itor = skiplist_itor_new(snapshot->list);
+    if (itor)
+	itor->seq = snapshot->seq;
+    return itor;
+}
+
+dict_itor*
+skiplist_snapshot_dict_itor_new(skiplist_snapshot* snapshot)
+{
+    ASSERT(snapshot != NULL);
+
+    dict_itor* itor = MALLOC(sizeof(*itor));
+    if (itor) {
+	if (!(itor->_itor = skiplist_snapshot_itor_new(snapshot))) {
+	    FREE(itor);
+	    return NULL;
+	}
+	itor->_vtable = &skiplist_itor_vtable;
+    }
+    return itor;
+}
+
+/* Find the state of |node| as of |seq|, storing its key and the address of its
+ * datum where given. Returns false if the key was absent then. */
+static bool
+node_state(skiplist* list, skip_node* node, uint64_t seq, void** key,
+	   void*** datum)
+{
+    void** k = &node->key;
+    void** d = NULL;	/* The current datum, unless an older one is found. */
+    if (list->versioned) {
+	skip_versions* versions = VERSIONS(list, node);
+	bool removed = versions->removed;
+	if (versions->seq > seq) {
+	    skip_version* v = versions->older;
+	    while (v && v->seq > seq)
+		v = v->next;
+	    if (!v)
+		return false;
+	    k = &v->key;
+	    d = &v->datum;
+	    removed = v->removed;
+	}
+	if (removed)
+	    return false;
+    }
+    if (key)
+	*key = *k;
+    if (datum)
+	*datum = d ? d : LIST_DATUM_SLOT(list, node);
+    return true;
+}
+
+/* Keep the current state of |node| as an older one before a commit replaces
+ * it, if an open snapshot may see it or older states depend on it. Returns
+ * false if out of memory. */
+static bool
+node_save(skiplist* list, skip_node* node)
+{
+    skip_versions* versions = VERSIONS(list, node);
+    if (!versions->older &&
+	!(list->newest && list->newest->seq >= versions->seq))
+	return true;
+    skip_version* v = MALLOC(sizeof(*v));
+    if (!v)
+	return false;
+    v->key = node->key;
+    v->datum = LIST_DATUM(list, node);
+    v->seq = versions->seq;
+    v->removed = versions->removed;
+    v->next = versions->older;
+    versions->older = v;
+    if (!versions->queued) {
+	versions->queued = true;
+	versions->gc_next = list->gc_list;
+	list->gc_list = node;
+    }
+    return true;
+}
+
+/* Free the states from |version| on, newest first. A key and datum are deleted
+ * with the state that was followed by their removal; if |removal|, that is
+ * true of |version|. */
+static void
+versions_free(skiplist* list, skip_version* version, bool removal)
+{
+    while (version) {
+	skip_version* next = version->next;
+	if (removal && !version->removed && list->del_func)
+	    list->del_func(version->key,
+			   list->keys_only ? NULL : version->datum);
+	removal = version->removed;
+	FREE(version);
+	version = next;
+    }
+}
+
+/* Free the older states that no open snapshot can see, which are those
+ * superseded no later than the oldest snapshot, and unlink the nodes of
+ * removed keys that are left with none. */
+static void
+versions_collect(skiplist* list)
+{
+    const uint64_t horizon = list->oldest ? list->oldest->seq : CURRENT_SEQ;
+    skip_node** link = &list->gc_list;
+    while (*link) {
+	skip_node* node = *link;
+	skip_versions* versions = VERSIONS(list, node);
+	skip_version** cut = &versions->older;
+	uint64_t superseded = versions->seq;
+	bool removal = versions->removed;
+	while (*cut && superseded > horizon) {
+	    superseded = (*cut)->seq;
+	    removal = (*cut)->removed;
+	    cut = &(*cut)->next;
+	}
+	skip_version* dropped = *cut;
+	*cut = NULL;
+	if (versions->older) {
+	    versions_free(list, dropped, removal);
+	    link = &versions->gc_next;
+	    continue;
+	}
+
+	*link = versions->gc_next;
+	versions->queued = false;
+	if (versions->removed) {
+	    /* Unlink the node before its key is deleted with its last state. */
+	    skip_node* update[MAX_LINK] = { 0 };
+	    skip_node* x = list->head;
+	    for (unsigned k = list->top_link+1; k-->0;) {
+		while (x->link[k] && x->link[k] != node &&
+		       list->cmp_func(node->key, x->link[k]->key) > 0)
+		    x = x->link[k];
+		update[k] = x;
+	    }
+	    ASSERT(x->link[0] == node);
+	    node_unlink(list, node, update);
+	    versions_free(list, dropped, removal);
+	    FREE(node);
+	    list->mod_count++;
+	} else {
+	    versions_free(list, dropped, removal);
+	}
+    }
 }
 
 skip_node*
-node_new(void* key, unsigned link_count)
+node_new(void* key, unsigned link_count, size_t size)
 {
     ASSERT(link_count >= 1);
 
-    skip_node* node = MALLOC(sizeof(*node) +
-			     sizeof(node->link[0]) * link_count);
+    skip_node* node = MALLOC(size);
     if (node) {
 	node->key = key;
-	node->datum = NULL;
 	node->prev = NULL;
 	node->link_count = link_count;
 	memset(node->link, 0, sizeof(node->link[0]) * link_count);
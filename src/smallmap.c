@@ -0,0 +1,608 @@
+/*
+ * libdict -- small map implementation.
+ *
+ * Copyright (c) 2001-2011, Farooq Mela
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *    This product includes software developed by Farooq Mela.
+ * 4. Neither the name of the Farooq Mela nor the
+ *    names of contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY FAROOQ MELA ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL FAROOQ MELA BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Entries are kept sorted in the array that follows the map, and found by a
+ * linear scan that stops at the first key not less than the one sought, which
+ * for a handful of entries beats a binary search and does not need the keys
+ * to be anything but comparable. Once the map has converted, every operation
+ * is passed on to the backend.
+ *
+ * The backend is created without a delete function, so that a conversion that
+ * runs out of memory partway can free it without deleting the keys and data
+ * it shares with the array; the map deletes them itself, finding the stored
+ * key of an entry to be removed through an iterator of the backend.
+ */
+
+#include "smallmap.h"
+
+#include <string.h>	    /* For memmove() */
+#include "dict_private.h"
+
+typedef struct {
+    void*		    key;
+    void*		    datum;
+} smallmap_entry;
+
+struct smallmap {
+    dict_compare_func	    cmp_func;
+    dict_delete_func	    del_func;
+    smallmap_backend_func   backend_new;
+    dict*		    backend;	/* Holds the entries, once converted. */
+    dict_itor*		    finder;	/* Finds stored keys for deletion. */
+    size_t		    mod_base;	/* Added to the backend's count. */
+    size_t		    capacity;
+    size_t		    count;
+    smallmap_entry	    entries[];
+};
+
+#define POS_NONE	    ((size_t)-1)
+
+struct smallmap_itor {
+    smallmap*		    map;
+    dict_itor*		    backend;
+    size_t		    pos;
+};
+
+static size_t smallmap_mod_count(const smallmap* map);
+
+static dict_vtable smallmap_vtable = {
+    (dict_inew_func)	    smallmap_dict_itor_new,
+    (dict_dfree_func)	    smallmap_free,
+    (dict_insert_func)	    smallmap_insert,
+    (dict_search_func)	    smallmap_search,
+    (dict_remove_func)	    smallmap_remove,
+    (dict_clear_func)	    smallmap_clear,
+    (dict_traverse_func)    smallmap_traverse,
+    (dict_count_func)	    smallmap_count,
+    (dict_verify_func)	    smallmap_verify,
+    (dict_clone_func)	    smallmap_clone,
+    (dict_remove_many_func) NULL,/* smallmap_remove_many not implemented yet */
+    (dict_remove_if_func)   NULL,/* smallmap_remove_if not implemented yet */
+    (dict_mod_count_func)   smallmap_mod_count,
+    (dict_export_func)	    NULL,/* smallmap_export not implemented yet */
+    (dict_export_all_func)  NULL,/* smallmap_export_all not implemented yet */
+};
+
+static itor_vtable smallmap_itor_vtable = {
+    (dict_ifree_func)	    smallmap_itor_free,
+    (dict_valid_func)	    smallmap_itor_valid,
+    (dict_invalidate_func)  smallmap_itor_invalidate,
+    (dict_next_func)	    smallmap_itor_next,
+    (dict_prev_func)	    smallmap_itor_prev,
+    (dict_nextn_func)	    smallmap_itor_nextn,
+    (dict_prevn_func)	    smallmap_itor_prevn,
+    (dict_first_func)	    smallmap_itor_first,
+    (dict_last_func)	    smallmap_itor_last,
+    (dict_key_func)	    smallmap_itor_key,
+    (dict_data_func)	    smallmap_itor_data,
+    (dict_iremove_func)	    NULL,/* smallmap_itor_remove not implemented */
+    (dict_icompare_func)    NULL,/* smallmap_itor_compare not implemented */
+    (dict_iseek_func)	    smallmap_itor_seek
+};
+
+smallmap*
+smallmap_new(dict_compare_func cmp_func, dict_delete_func del_func,
+	     smallmap_backend_func backend_new, size_t capacity)
+{
+    ASSERT(backend_new != NULL);
+
+    smallmap* map = MALLOC(sizeof(*map) + capacity * sizeof(smallmap_entry));
+    if (map) {
+	map->cmp_func = cmp_func ? cmp_func : dict_ptr_cmp;
+	map->del_func = del_func;
+	map->backend_new = backend_new;
+	map->backend = NULL;
+	map->finder = NULL;
+	map->mod_base = 0;
+	map->capacity = capacity;
+	map->count = 0;
+    }
+    return map;
+}
+
+dict*
+smallmap_dict_new(dict_compare_func cmp_func, dict_delete_func del_func,
+		  smallmap_backend_func backend_new, size_t capacity)
+{
+    dict* dct = MALLOC(sizeof(*dct));
+    if (dct) {
+	if (!(dct->_object = smallmap_new(cmp_func, del_func, backend_new,
+					  capacity))) {
+	    FREE(dct);
+	    return NULL;
+	}
+	dct->_vtable = &smallmap_vtable;
+    }
+    return dct;
+}
+
+size_t
+smallmap_free(smallmap* map)
+{
+    ASSERT(map != NULL);
+
+    size_t count = smallmap_clear(map);
+    FREE(map);
+    return count;
+}
+
+smallmap*
+smallmap_clone(smallmap* map, dict_key_datum_clone_func clone_func)
+{
+    ASSERT(map != NULL);
+
+    smallmap* clone = smallmap_new(map->cmp_func, map->del_func,
+				   map->backend_new, map->capacity);
+    if (!clone)
+	return NULL;
+    if (map->backend) {
+	if (!(clone->backend = dict_clone(map->backend, clone_func))) {
+	    FREE(clone);
+	    return NULL;
+	}
+    } else {
+	memcpy(clone->entries, map->entries, map->count * sizeof(smallmap_entry));
+	clone->count = map->count;
+	if (clone_func)
+	    for (size_t i = 0; i < clone->count; i++)
+		clone_func(&clone->entries[i].key, &clone->entries[i].datum);
+    }
+    return clone;
+}
+
+/* Returns the position of the first entry whose key is not less than |key|,
+ * setting |found| if it is equal. */
+static size_t
+entry_find(const smallmap* map, const void* key, bool* found)
+{
+    size_t i = 0;
+    for (; i < map->count; i++) {
+	const int cmp = map->cmp_func(key, map->entries[i].key);
+	if (cmp <= 0) {
+	    *found = (cmp == 0);
+	    return i;
+	}
+    }
+    *found = false;
+    return i;
+}
+
+/* Moves every entry into a new backend; on failure, nothing changes. */
+static bool
+convert(smallmap* map)
+{
+    dict* backend = map->backend_new(map->cmp_func, NULL);
+    if (!backend)
+	return false;
+    for (size_t i = 0; i < map->count; i++) {
+	void** datum_location = dict_insert(backend, map->entries[i].key, NULL);
+	if (!datum_location) {
+	    dict_free(backend);
+	    return false;
+	}
+	*datum_location = map->entries[i].datum;
+    }
+    /* The base makes up for the count the new backend starts with. */
+    const size_t mod_count = smallmap_mod_count(map);
+    map->backend = backend;
+    map->count = 0;
+    map->mod_base = mod_count + 1 - dict_mod_count(backend);
+    return true;
+}
+
+static void**
+backend_insert(smallmap* map, void* key, bool* inserted)
+{
+    bool added = false;
+    void** datum = dict_insert(map->backend, key, &added);
+    if (added)
+	map->mod_base++;
+    if (inserted)
+	*inserted = added;
+    return datum;
+}
+
+void**
+smallmap_insert(smallmap* map, void* key, bool* inserted)
+{
+    ASSERT(map != NULL);
+
+    if (map->backend)
+	return backend_insert(map, key, inserted);
+
+    bool found;
+    const size_t i = entry_find(map, key, &found);
+    if (found) {
+	if (inserted)
+	    *inserted = false;
+	TRACE_OP(insert, "smallmap", map, key, 0, 0);
+	return &map->entries[i].datum;
+    }
+    if (map->count == map->capacity) {
+	if (!convert(map)) {
+	    TRACE_OP(insert, "smallmap", map, key, 0, -1);
+	    return NULL;
+	}
+	return backend_insert(map, key, inserted);
+    }
+    memmove(&map->entries[i + 1], &map->entries[i],
+	    (map->count - i) * sizeof(smallmap_entry));
+    map->entries[i].key = key;
+    map->entries[i].datum = NULL;
+    map->count++;
+    map->mod_base++;
+    if (inserted)
+	*inserted = true;
+    TRACE_OP(insert, "smallmap", map, key, 0, 1);
+    return &map->entries[i].datum;
+}
+
+void*
+smallmap_search(smallmap* map, const void* key)
+{
+    ASSERT(map != NULL);
+
+    if (map->backend)
+	return dict_search(map->backend, key);
+    bool found;
+    const size_t i = entry_find(map, key, &found);
+    TRACE_OP(search, "smallmap", map, key, 0, found);
+    return found ? map->entries[i].datum : NULL;
+}
+
+/* Moves the finder to the backend's entry with |key|, if there is one. A
+ * backend without a seek may be unordered, so every entry is compared. */
+static bool
+finder_search(smallmap* map, const void* key)
+{
+    if (!map->finder && !(map->finder = dict_itor_new(map->backend)))
+	return false;
+    dict_itor* itor = map->finder;
+    if (!dict_itor_first(itor))
+	return false;
+    if (itor->_vtable->seek)
+	return dict_itor_seek(itor, key) &&
+	       map->cmp_func(dict_itor_key(itor), key) == 0;
+    for (; dict_itor_valid(itor); dict_itor_next(itor))
+	if (map->cmp_func(dict_itor_key(itor), key) == 0)
+	    return true;
+    return false;
+}
+
+bool
+smallmap_remove(smallmap* map, const void* key)
+{
+    ASSERT(map != NULL);
+
+    if (map->backend) {
+	if (!map->del_func) {
+	    if (!dict_remove(map->backend, key))
+		return false;
+	    map->mod_base++;
+	    return true;
+	}
+	if (!finder_search(map, key))
+	    return false;
+	void* stored_key = (void*)dict_itor_key(map->finder);
+	void* datum = *dict_itor_data(map->finder);
+	dict_itor_invalidate(map->finder);
+	if (!dict_remove(map->backend, stored_key))
+	    return false;
+	map->mod_base++;
+	map->del_func(stored_key, datum);
+	return true;
+    }
+    bool found;
+    const size_t i = entry_find(map, key, &found);
+    TRACE_OP(remove, "smallmap", map, key, 0, found);
+    if (!found)
+	return false;
+    if (map->del_func)
+	map->del_func(map->entries[i].key, map->entries[i].datum);
+    map->count--;
+    memmove(&map->entries[i], &map->entries[i + 1],
+	    (map->count - i) * sizeof(smallmap_entry));
+    map->mod_base++;
+    return true;
+}
+
+size_t
+smallmap_clear(smallmap* map)
+{
+    ASSERT(map != NULL);
+
+    if (map->backend) {
+	if (map->finder) {
+	    dict_itor_free(map->finder);
+	    map->finder = NULL;
+	}
+	if (map->del_func) {
+	    dict_itor* itor = dict_itor_new(map->backend);
+	    if (itor) {
+		for (dict_itor_first(itor); dict_itor_valid(itor);
+		     dict_itor_next(itor))
+		    map->del_func((void*)dict_itor_key(itor),
+				  *dict_itor_data(itor));
+		dict_itor_free(itor);
+	    }
+	}
+	map->mod_base = smallmap_mod_count(map) + 1;
+	const size_t count = dict_free(map->backend);
+	map->backend = NULL;
+	return count;
+    }
+    const size_t count = map->count;
+    if (map->del_func)
+	for (size_t i = 0; i < count; i++)
+	    map->del_func(map->entries[i].key, map->entries[i].datum);
+    map->count = 0;
+    map->mod_base++;
+    return count;
+}
+
+size_t
+smallmap_traverse(smallmap* map, dict_visit_func visit)
+{
+    ASSERT(map != NULL);
+    ASSERT(visit != NULL);
+
+    if (map->backend)
+	return dict_traverse(map->backend, visit);
+    size_t count = 0;
+    while (count < map->count) {
+	const smallmap_entry* entry = &map->entries[count++];
+	if (!visit(entry->key, entry->datum))
+	    break;
+    }
+    return count;
+}
+
+size_t
+smallmap_count(const smallmap* map)
+{
+    ASSERT(map != NULL);
+
+    return map->backend ? dict_count(map->backend) : map->count;
+}
+
+static size_t
+smallmap_mod_count(const smallmap* map)
+{
+    ASSERT(map != NULL);
+
+    return map->mod_base + (map->backend ? dict_mod_count(map->backend) : 0);
+}
+
+dict*
+smallmap_backend(smallmap* map)
+{
+    ASSERT(map != NULL);
+
+    return map->backend;
+}
+
+bool
+smallmap_verify(const smallmap* map)
+{
+    ASSERT(map != NULL);
+
+    if (map->backend) {
+	VERIFY(map->count == 0);
+	return dict_verify(map->backend);
+    }
+    VERIFY(map->count <= map->capacity);
+    for (size_t i = 1; i < map->count; i++)
+	VERIFY(map->cmp_func(map->entries[i - 1].key, map->entries[i].key) < 0);
+    return true;
+}
+
+smallmap_itor*
+smallmap_itor_new(smallmap* map)
+{
+    ASSERT(map != NULL);
+
+    smallmap_itor* itor = MALLOC(sizeof(*itor));
+    if (itor) {
+	itor->map = map;
+	itor->backend = NULL;
+	itor->pos = POS_NONE;
+	if (map->backend && !(itor->backend = dict_itor_new(map->backend))) {
+	    FREE(itor);
+	    return NULL;
+	}
+    }
+    return itor;
+}
+
+dict_itor*
+smallmap_dict_itor_new(smallmap* map)
+{
+    ASSERT(map != NULL);
+
+    dict_itor* itor = MALLOC(sizeof(*itor));
+    if (itor) {
+	if (!(itor->_itor = smallmap_itor_new(map))) {
+	    FREE(itor);
+	    return NULL;
+	}
+	itor->_vtable = &smallmap_itor_vtable;
+    }
+    return itor;
+}
+
+void
+smallmap_itor_free(smallmap_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    if (itor->backend)
+	dict_itor_free(itor->backend);
+    FREE(itor);
+}
+
+bool
+smallmap_itor_valid(const smallmap_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    if (itor->backend)
+	return dict_itor_valid(itor->backend);
+    return itor->pos != POS_NONE;
+}
+
+void
+smallmap_itor_invalidate(smallmap_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    if (itor->backend)
+	dict_itor_invalidate(itor->backend);
+    itor->pos = POS_NONE;
+}
+
+bool
+smallmap_itor_next(smallmap_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    return smallmap_itor_nextn(itor, 1);
+}
+
+bool
+smallmap_itor_prev(smallmap_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    return smallmap_itor_prevn(itor, 1);
+}
+
+bool
+smallmap_itor_nextn(smallmap_itor* itor, size_t count)
+{
+    ASSERT(itor != NULL);
+
+    if (itor->backend)
+	return dict_itor_nextn(itor->backend, count);
+    if (itor->pos != POS_NONE) {
+	if (count < itor->map->count - itor->pos)
+	    itor->pos += count;
+	else
+	    itor->pos = POS_NONE;
+    }
+    return itor->pos != POS_NONE;
+}
+
+bool
+smallmap_itor_prevn(smallmap_itor* itor, size_t count)
+{
+    ASSERT(itor != NULL);
+
+    if (itor->backend)
+	return dict_itor_prevn(itor->backend, count);
+    if (itor->pos != POS_NONE) {
+	if (count <= itor->pos)
+	    itor->pos -= count;
+	else
+	    itor->pos = POS_NONE;
+    }
+    return itor->pos != POS_NONE;
+}
+
+bool
+smallmap_itor_first(smallmap_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    if (itor->backend)
+	return dict_itor_first(itor->backend);
+    itor->pos = itor->map->count ? 0 : POS_NONE;
+    return itor->pos != POS_NONE;
+}
+
+bool
+smallmap_itor_last(smallmap_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    if (itor->backend)
+	return dict_itor_last(itor->backend);
+    itor->pos = itor->map->count ? itor->map->count - 1 : POS_NONE;
+    return itor->pos != POS_NONE;
+}
+
+const void*
+smallmap_itor_key(const smallmap_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    if (itor->backend)
+	return dict_itor_key(itor->backend);
+    return itor->pos != POS_NONE ? itor->map->entries[itor->pos].key : NULL;
+}
+
+void**
+smallmap_itor_data(smallmap_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    if (itor->backend)
+	return dict_itor_data(itor->backend);
+    return itor->pos != POS_NONE ? &itor->map->entries[itor->pos].datum : NULL;
+}
+
+bool
+smallmap_itor_seek(smallmap_itor* itor, const void* key)
+{
+    ASSERT(itor != NULL);
+
+    const smallmap* map = itor->map;
+    if (itor->backend) {
+	dict_itor* backend = itor->backend;
+	if (backend->_vtable->seek)
+	    return dict_itor_seek(backend, key);
+	/* The backend may be unordered, so the only key known to come at or
+	 * after |key| is |key| itself. */
+	for (; dict_itor_valid(backend); dict_itor_next(backend))
+	    if (map->cmp_func(dict_itor_key(backend), key) == 0)
+		return true;
+	return false;
+    }
+    if (itor->pos == POS_NONE)
+	return false;
+    while (map->cmp_func(map->entries[itor->pos].key, key) < 0)
+	if (++itor->pos == map->count) {
+	    itor->pos = POS_NONE;
+	    return false;
+	}
+    return true;
+}
@@ -56,6 +56,7 @@
 typedef struct sp_node sp_node;
 struct sp_node {
     TREE_NODE_FIELDS(sp_node);
+    void*		    datum;	/* Not allocated in a set. */
 };
 
 struct sp_tree {
@@ -66,6 +67,10 @@ struct sp_itor {
     TREE_ITERATOR_FIELDS(sp_tree, sp_node);
 };
 
+/* A set's nodes end before the datum. */
+STATIC_ASSERT(set_node_size,
+	      offsetof(sp_node, datum) + sizeof(void*) == sizeof(sp_node));
+
 static dict_vtable sp_tree_vtable = {
     (dict_inew_func)	    sp_dict_itor_new,
     (dict_dfree_func)	    tree_free,
@@ -77,6 +82,11 @@ static dict_vtable sp_tree_vtable = {
     (dict_count_func)	    tree_count,
     (dict_verify_func)	    sp_tree_verify,
     (dict_clone_func)	    sp_tree_clone,
+    (dict_remove_many_func) sp_tree_remove_many,
+    (dict_remove_if_func)   sp_tree_remove_if,
+    (dict_mod_count_func)   tree_mod_count,
+    (dict_export_func)	    sp_tree_export,
+    (dict_export_all_func)  sp_tree_export_all,
 };
 
 static itor_vtable sp_tree_itor_vtable = {
@@ -92,10 +102,11 @@ static itor_vtable sp_tree_itor_vtable = {
     (dict_key_func)	    tree_iterator_key,
     (dict_data_func)	    tree_iterator_data,
     (dict_iremove_func)	    NULL,/* sp_itor_remove not implemented yet */
-    (dict_icompare_func)    NULL /* sp_itor_compare not implemented yet */
+    (dict_icompare_func)    NULL,/* sp_itor_compare not implemented yet */
+    (dict_iseek_func)	    tree_iterator_seek
 };
 
-static sp_node*	node_new(void* key);
+static sp_node*	node_new(sp_tree* tree, void* key);
 static size_t	node_height(const sp_node* node);
 static size_t	node_mheight(const sp_node* node);
 static size_t	node_pathlen(const sp_node* node, size_t level);
@@ -109,8 +120,12 @@ sp_tree_new(dict_compare_func cmp_func, dict_delete_func del_func)
 	tree->root = NULL;
 	tree->count = 0;
 	tree->cmp_func = cmp_func ? cmp_func : dict_ptr_cmp;
+	tree->keys_only = false;
+	tree->set_datum = NULL;
+	tree->datum_offset = offsetof(sp_node, datum);
 	tree->del_func = del_func;
 	tree->rotation_count = 0;
+	tree->mod_count = 0;
     }
     return tree;
 }
@@ -129,6 +144,29 @@ sp_dict_new(dict_compare_func cmp_func, dict_delete_func del_func)
     return dct;
 }
 
+sp_tree*
+sp_tree_new_set(dict_compare_func cmp_func, dict_delete_func del_func)
+{
+    sp_tree* tree = sp_tree_new(cmp_func, del_func);
+    if (tree)
+	tree->keys_only = true;
+    return tree;
+}
+
+dict*
+sp_dict_new_set(dict_compare_func cmp_func, dict_delete_func del_func)
+{
+    dict* dct = MALLOC(sizeof(*dct));
+    if (dct) {
+	if (!(dct->_object = sp_tree_new_set(cmp_func, del_func))) {
+	    FREE(dct);
+	    return NULL;
+	}
+	dct->_vtable = &sp_tree_vtable;
+    }
+    return dct;
+}
+
 size_t
 sp_tree_free(sp_tree* tree)
 {
@@ -144,7 +182,55 @@ sp_tree_clone(sp_tree* tree, dict_key_datum_clone_func clone_func)
 {
     ASSERT(tree != NULL);
 
-    return tree_clone(tree, sizeof(sp_tree), sizeof(sp_node), clone_func);
+    return tree_clone(tree, sizeof(sp_tree),
+		      SET_NODE_SIZE(tree, sizeof(sp_node)), clone_func);
+}
+
+/* Set the balance information of a node of a rebuilt tree. */
+static void
+node_rebuild(void* Tree, void* Node, size_t depth, size_t lheight,
+	     size_t rheight)
+{
+    (void)Tree;
+    (void)Node;
+    (void)depth;
+    (void)lheight;
+    (void)rheight;
+}
+
+size_t
+sp_tree_remove_many(sp_tree* tree, const void** keys, size_t count)
+{
+    ASSERT(tree != NULL);
+
+    return tree_remove_many(tree, NULL, NULL, keys, count,
+			    (dict_remove_func)sp_tree_remove, node_rebuild);
+}
+
+size_t
+sp_tree_remove_if(sp_tree* tree, dict_predicate_func pred, void* ctx)
+{
+    ASSERT(tree != NULL);
+
+    return tree_remove_if(tree, NULL, NULL, pred, ctx,
+			  (dict_remove_func)sp_tree_remove, node_rebuild);
+}
+
+size_t
+sp_tree_export(sp_tree* tree, void** keys, void** data, size_t max,
+	       dict_export_pos* pos)
+{
+    ASSERT(tree != NULL);
+
+    return tree_export(tree, NULL, keys, data, max, pos);
+}
+
+size_t
+sp_tree_export_all(sp_tree* tree, void** keys, void** data, unsigned threads)
+{
+    ASSERT(tree != NULL);
+
+    return tree_export_all(tree, NULL, keys, data, threads);
 }
 
 size_t
@@ -165,8 +251,9 @@ sp_tree_clear(sp_tree* tree)
 	}
 
 	if (tree->del_func)
-	    tree->del_func(node->key, node->datum);
+	    tree->del_func(node->key, NODE_DEL_DATUM(tree, node));
 	--tree->count;
+	tree->mod_count++;
 
 	sp_node* parent = node->parent;
 	if (parent) {
@@ -202,10 +289,12 @@ splay(sp_tree* t, sp_node* n)
 		    p->llink->parent = p;
 		n->rlink = p;
 		++rotations;
+		TRACE_ROTATE(t, p, 1);
 	    } else {
 		if ((p->rlink = n->llink) != NULL)
 		    p->rlink->parent = p;
 		n->llink = p;
+		TRACE_ROTATE(t, p, 0);
 	    }
 	    p->parent = n;
 	    t->root = n;
@@ -224,12 +313,14 @@ splay(sp_tree* t, sp_node* n)
 		pp->parent = p;
 		if ((pp->llink = pr) != NULL)
 		    pr->parent = pp;
+		TRACE_ROTATE(t, pp, 1);
 
 		sp_node* nr = n->rlink;
 		n->rlink = p;
 		p->parent = n;
 		if ((p->llink = nr) != NULL)
 		    nr->parent = p;
+		TRACE_ROTATE(t, p, 1);
 	    } else {
 		/* Rotate node right, then parent left. */
 		sp_node* nr = n->rlink;
@@ -237,12 +328,14 @@ splay(sp_tree* t, sp_node* n)
 		p->parent = n;
 		if ((p->llink = nr) != NULL)
 		    nr->parent = p;
+		TRACE_ROTATE(t, p, 1);
 
 		sp_node* nl = n->llink;
 		n->llink = pp;
 		pp->parent = n;
 		if ((pp->rlink = nl) != NULL)
 		    nl->parent = pp;
+		TRACE_ROTATE(t, pp, 0);
 	    }
 	} else {
 	    if (pp->rlink == p) {
@@ -252,12 +345,14 @@ splay(sp_tree* t, sp_node* n)
 		pp->parent = p;
 		if ((pp->rlink = pl) != NULL)
 		    pl->parent = pp;
+		TRACE_ROTATE(t, pp, 0);
 
 		sp_node* nl = n->llink;
 		n->llink = p;
 		p->parent = n;
 		if ((p->rlink = nl) != NULL)
 		    nl->parent = p;
+		TRACE_ROTATE(t, p, 0);
 	    } else {
 		/* Rotate node left, then parent right. */
 		sp_node* nl = n->llink;
@@ -265,12 +360,14 @@ splay(sp_tree* t, sp_node* n)
 		p->parent = n;
 		if ((p->rlink = nl) != NULL)
 		    nl->parent = p;
+		TRACE_ROTATE(t, p, 0);
 
 		sp_node* nr = n->rlink;
 		n->rlink = pp;
 		pp->parent = n;
 		if ((pp->llink = nr) != NULL)
 		    nr->parent = pp;
+		TRACE_ROTATE(t, pp, 1);
 	    }
 	}
 	n->parent = ppp;
@@ -292,6 +389,8 @@ sp_tree_insert(sp_tree* tree, void* key, bool* inserted)
 {
     ASSERT(tree != NULL);
 
+    size_t depth = TRACE_DEPTH(insert, tree_search_depth(tree, key));
+
     int cmp = 0;
     sp_node* node = tree->root;
     sp_node* parent = NULL;
@@ -304,12 +403,15 @@ sp_tree_insert(sp_tree* tree, void* key, bool* inserted)
 	else {
 	    if (inserted)
 		*inserted = false;
-	    return &node->datum;
+	    TRACE_OP(insert, "sp", tree, key, depth, 0);
+	    return NODE_DATUM_SLOT(tree, node);
 	}
     }
 
-    if (!(node = node_new(key)))
+    if (!(node = node_new(tree, key))) {
+	TRACE_OP(insert, "sp", tree, key, depth, -1);
 	return NULL;
+    }
     if (inserted)
 	*inserted = true;
     if (!(node->parent = parent)) {
@@ -324,9 +426,11 @@ sp_tree_insert(sp_tree* tree, void* key, bool* inserted)
 	    parent->rlink = node;
 	splay(tree, node);
 	++tree->count;
+	tree->mod_count++;
     }
     ASSERT(tree->root == node);
-    return &node->datum;
+    TRACE_OP(insert, "sp", tree, key, depth, 1);
+    return NODE_DATUM_SLOT(tree, node);
 }
 
 void*
@@ -334,6 +438,8 @@ sp_tree_search(sp_tree* tree, const void* key)
 {
     ASSERT(tree != NULL);
 
+    size_t depth = TRACE_DEPTH(search, tree_search_depth(tree, key));
+
     sp_node* node = tree->root;
     sp_node* parent = NULL;
     while (node) {
@@ -345,7 +451,8 @@ sp_tree_search(sp_tree* tree, const void* key)
 	else {
 	    splay(tree, node);
 	    ASSERT(tree->root == node);
-	    return node->datum;
+	    TRACE_OP(search, "sp", tree, key, depth, 1);
+	    return NODE_DATUM(tree, node);
 	}
     }
     if (parent) {
@@ -353,6 +460,7 @@ sp_tree_search(sp_tree* tree, const void* key)
 	splay(tree, parent);
 	ASSERT(tree->root == parent);
     }
+    TRACE_OP(search, "sp", tree, key, depth, 0);
     return NULL;
 }
 
@@ -361,6 +469,8 @@ sp_tree_remove(sp_tree* tree, const void* key)
 {
     ASSERT(tree != NULL);
 
+    size_t depth = TRACE_DEPTH(remove, tree_search_depth(tree, key));
+
     sp_node* node = tree->root;
     while (node) {
 	int cmp = tree->cmp_func(key, node->key);
@@ -371,8 +481,10 @@ sp_tree_remove(sp_tree* tree, const void* key)
 	else
 	    break;
     }
-    if (!node)
+    if (!node) {
+	TRACE_OP(remove, "sp", tree, key, depth, 0);
 	return false;
+    }
 
     sp_node* out;
     if (!node->llink || !node->rlink) {
@@ -384,7 +496,8 @@ sp_tree_remove(sp_tree* tree, const void* key)
 	for (out = node->rlink; out->llink; out = out->llink)
 	    /* void */;
 	SWAP(node->key, out->key, tmp);
-	SWAP(node->datum, out->datum, tmp);
+	if (!tree->keys_only)
+	    SWAP(node->datum, out->datum, tmp);
     }
 
     sp_node* temp = out->llink ? out->llink : out->rlink;
@@ -400,7 +513,7 @@ sp_tree_remove(sp_tree* tree, const void* key)
 	tree->root = temp;
     }
     if (tree->del_func)
-	tree->del_func(out->key, out->datum);
+	tree->del_func(out->key, NODE_DEL_DATUM(tree, out));
 
     /* Splay an adjacent node to the root, if possible. */
     temp =
@@ -414,6 +527,8 @@ sp_tree_remove(sp_tree* tree, const void* key)
 
     FREE(out);
     --tree->count;
+    tree->mod_count++;
+    TRACE_OP(remove, "sp", tree, key, depth, 1);
     return true;
 }
 
@@ -428,7 +543,7 @@ sp_tree_traverse(sp_tree* tree, dict_visit_func visit)
 	sp_node* node = tree_node_min(tree->root);
 	do {
 	    ++count;
-	    if (!visit(node->key, node->datum))
+	    if (!visit(node->key, NODE_DATUM(tree, node)))
 		break;
 	    node = tree_node_next(node);
 	} while (node);
@@ -497,12 +612,13 @@ sp_tree_max(const sp_tree* tree)
 }
 
 static sp_node*
-node_new(void* key)
+node_new(sp_tree* tree, void* key)
 {
-    sp_node* node = MALLOC(sizeof(*node));
+    sp_node* node = MALLOC(SET_NODE_SIZE(tree, sizeof(*node)));
     if (node) {
 	node->key = key;
-	node->datum = NULL;
+	if (!tree->keys_only)
+	    node->datum = NULL;
 	node->parent = NULL;
 	node->llink = NULL;
 	node->rlink = NULL;
@@ -59,6 +59,7 @@ typedef struct tr_node tr_node;
 struct tr_node {
     TREE_NODE_FIELDS(tr_node);
     uint32_t		    prio;
+    void*		    datum;	/* Not allocated in a set. */
 };
 
 struct tr_tree {
@@ -71,17 +72,26 @@ struct tr_itor {
     TREE_ITERATOR_FIELDS(tr_tree, tr_node);
 };
 
+/* A set's nodes end before the datum. */
+STATIC_ASSERT(set_node_size,
+	      offsetof(tr_node, datum) + sizeof(void*) == sizeof(tr_node));
+
 static dict_vtable tr_tree_vtable = {
     (dict_inew_func)	    tr_dict_itor_new,
     (dict_dfree_func)	    tree_free,
     (dict_insert_func)	    tr_tree_insert,
-    (dict_search_func)	    tree_search,
+    (dict_search_func)	    tr_tree_search,
     (dict_remove_func)	    tr_tree_remove,
     (dict_clear_func)	    tree_clear,
     (dict_traverse_func)    tree_traverse,
     (dict_count_func)	    tree_count,
     (dict_verify_func)	    tr_tree_verify,
     (dict_clone_func)	    tr_tree_clone,
+    (dict_remove_many_func) tr_tree_remove_many,
+    (dict_remove_if_func)   tr_tree_remove_if,
+    (dict_mod_count_func)   tree_mod_count,
+    (dict_export_func)	    tr_tree_export,
+    (dict_export_all_func)  tr_tree_export_all,
 };
 
 static itor_vtable tr_tree_itor_vtable = {
@@ -97,13 +107,14 @@ static itor_vtable tr_tree_itor_vtable = {
     (dict_key_func)	    tree_iterator_key,
     (dict_data_func)	    tree_iterator_data,
     (dict_iremove_func)	    NULL,/* tr_itor_remove not implemented yet */
-    (dict_icompare_func)    NULL /* tr_itor_compare not implemented yet */
+    (dict_icompare_func)    NULL,/* tr_itor_compare not implemented yet */
+    (dict_iseek_func)	    tree_iterator_seek
 };
 
 static size_t	node_height(const tr_node* node);
 static size_t	node_mheight(const tr_node* node);
 static size_t	node_pathlen(const tr_node* node, size_t level);
-static tr_node*	node_new(void* key);
+static tr_node*	node_new(tr_tree* tree, void* key);
 
 tr_tree*
 tr_tree_new(dict_compare_func cmp_func, dict_prio_func prio_func,
@@ -114,8 +125,12 @@ tr_tree_new(dict_compare_func cmp_func, dict_prio_func prio_func,
 	tree->root = NULL;
 	tree->count = 0;
 	tree->cmp_func = cmp_func ? cmp_func : dict_ptr_cmp;
+	tree->keys_only = false;
+	tree->set_datum = NULL;
+	tree->datum_offset = offsetof(tr_node, datum);
 	tree->del_func = del_func;
 	tree->rotation_count = 0;
+	tree->mod_count = 0;
 	tree->prio_func = prio_func;
 	tree->randgen = rand();
     }
@@ -137,6 +152,31 @@ tr_dict_new(dict_compare_func cmp_func, dict_prio_func prio_func,
     return dct;
 }
 
+tr_tree*
+tr_tree_new_set(dict_compare_func cmp_func, dict_prio_func prio_func,
+		dict_delete_func del_func)
+{
+    tr_tree* tree = tr_tree_new(cmp_func, prio_func, del_func);
+    if (tree)
+	tree->keys_only = true;
+    return tree;
+}
+
+dict*
+tr_dict_new_set(dict_compare_func cmp_func, dict_prio_func prio_func,
+		dict_delete_func del_func)
+{
+    dict* dct = MALLOC(sizeof(*dct));
+    if (dct) {
+	if (!(dct->_object = tr_tree_new_set(cmp_func, prio_func, del_func))) {
+	    FREE(dct);
+	    return NULL;
+	}
+	dct->_vtable = &tr_tree_vtable;
+    }
+    return dct;
+}
+
 size_t
 tr_tree_free(tr_tree* tree)
 {
@@ -152,7 +192,45 @@ tr_tree_clone(tr_tree* tree, dict_key_datum_clone_func clone_func)
 {
     ASSERT(tree != NULL);
 
-    return tree_clone(tree, sizeof(tr_tree), sizeof(tr_node), clone_func);
+    return tree_clone(tree, sizeof(tr_tree),
+		      SET_NODE_SIZE(tree, sizeof(tr_node)), clone_func);
+}
+
+/* A treap's shape is fixed by its priorities, so it is never rebuilt; bulk
+ * removals remove one key at a time. */
+size_t
+tr_tree_remove_many(tr_tree* tree, const void** keys, size_t count)
+{
+    ASSERT(tree != NULL);
+
+    return tree_remove_many(tree, NULL, NULL, keys, count,
+			    (dict_remove_func)tr_tree_remove, NULL);
+}
+
+size_t
+tr_tree_remove_if(tr_tree* tree, dict_predicate_func pred, void* ctx)
+{
+    ASSERT(tree != NULL);
+
+    return tree_remove_if(tree, NULL, NULL, pred, ctx,
+			  (dict_remove_func)tr_tree_remove, NULL);
+}
+
+size_t
+tr_tree_export(tr_tree* tree, void** keys, void** data, size_t max,
+	       dict_export_pos* pos)
+{
+    ASSERT(tree != NULL);
+
+    return tree_export(tree, NULL, keys, data, max, pos);
+}
+
+size_t
+tr_tree_export_all(tr_tree* tree, void** keys, void** data, unsigned threads)
+{
+    ASSERT(tree != NULL);
+
+    return tree_export_all(tree, NULL, keys, data, threads);
 }
 
 size_t
@@ -168,6 +246,8 @@ tr_tree_insert(tr_tree* tree, void* key, bool* inserted)
 {
     ASSERT(tree != NULL);
 
+    size_t depth = TRACE_DEPTH(insert, tree_search_depth(tree, key));
+
     int cmp = 0;
     tr_node* node = tree->root;
     tr_node* parent = NULL;
@@ -180,12 +260,15 @@ tr_tree_insert(tr_tree* tree, void* key, bool* inserted)
 	else {
 	    if (inserted)
 		*inserted = false;
-	    return &node->datum;
+	    TRACE_OP(insert, "tr", tree, key, depth, 0);
+	    return NODE_DATUM_SLOT(tree, node);
 	}
     }
 
-    if (!(node = node_new(key)))
+    if (!(node = node_new(tree, key))) {
+	TRACE_OP(insert, "tr", tree, key, depth, -1);
 	return NULL;
+    }
     if (inserted)
 	*inserted = true;
     node->prio = tree->prio_func ? tree->prio_func(key) :
@@ -213,7 +296,9 @@ tr_tree_insert(tr_tree* tree, void* key, bool* inserted)
 	tree->rotation_count += rotations;
     }
     ++tree->count;
-    return &node->datum;
+    tree->mod_count++;
+    TRACE_OP(insert, "tr", tree, key, depth, 1);
+    return NODE_DATUM_SLOT(tree, node);
 }
 
 bool
@@ -221,6 +306,8 @@ tr_tree_remove(tr_tree* tree, const void* key)
 {
     ASSERT(tree != NULL);
 
+    size_t depth = TRACE_DEPTH(remove, tree_search_depth(tree, key));
+
     tr_node* node = tree->root;
     while (node) {
 	int cmp = tree->cmp_func(key, node->key);
@@ -231,8 +318,10 @@ tr_tree_remove(tr_tree* tree, const void* key)
 	else
 	    break;
     }
-    if (!node)
+    if (!node) {
+	TRACE_OP(remove, "tr", tree, key, depth, 0);
 	return false;
+    }
 
     unsigned rotations = 0;
     while (node->llink && node->rlink) {
@@ -257,10 +346,12 @@ tr_tree_remove(tr_tree* tree, const void* key)
     }
 
     if (tree->del_func)
-	tree->del_func(node->key, node->datum);
+	tree->del_func(node->key, NODE_DEL_DATUM(tree, node));
     FREE(node);
 
     --tree->count;
+    tree->mod_count++;
+    TRACE_OP(remove, "tr", tree, key, depth, 1);
     return true;
 }
 
@@ -269,7 +360,10 @@ tr_tree_search(tr_tree* tree, const void* key)
 {
     ASSERT(tree != NULL);
 
-    return tree_search(tree, key);
+    size_t depth = TRACE_DEPTH(search, tree_search_depth(tree, key));
+    void* datum = tree_search(tree, key);
+    TRACE_OP(search, "tr", tree, key, depth, datum != NULL);
+    return datum;
 }
 
 size_t
@@ -330,12 +424,13 @@ tr_tree_max(const tr_tree* tree)
 }
 
 static tr_node*
-node_new(void* key)
+node_new(tr_tree* tree, void* key)
 {
-    tr_node* node = MALLOC(sizeof(*node));
+    tr_node* node = MALLOC(SET_NODE_SIZE(tree, sizeof(*node)));
     if (node) {
 	node->key = key;
-	node->datum = NULL;
+	if (!tree->keys_only)
+	    node->datum = NULL;
 	node->parent = NULL;
 	node->llink = NULL;
 	node->rlink = NULL;
@@ -572,5 +667,5 @@ tr_itor_data(tr_itor* itor)
 {
     ASSERT(itor != NULL);
 
-    return itor->node ? &itor->node->datum : NULL;
+    return itor->node ? NODE_DATUM_SLOT(itor->tree, itor->node) : NULL;
 }
@@ -5,10 +5,14 @@
  * Common definitions for binary search trees.
  */
 
+#define _POSIX_C_SOURCE 200809L	    /* For pthreads. */
+
 #include "tree_common.h"
 
+#include <pthread.h>
 #include <string.h>
 #include "dict_private.h"
+#include "dict_inline.h"
 
 typedef struct tree_node {
     TREE_NODE_FIELDS(struct tree_node);
@@ -22,6 +26,41 @@ typedef struct {
     TREE_ITERATOR_FIELDS(tree, tree_node);
 } tree_iterator;
 
+/* NODE_DATUM() and the rest from dict_private.h, for nodes whose datum follows
+ * whatever fields their tree adds to the links. */
+#define DATUM(t, node) \
+    ((t)->keys_only ? DICT_SET_MEMBER : TREE_DATUM(t, node))
+#define DEL_DATUM(t, node) \
+    ((t)->keys_only ? NULL : TREE_DATUM(t, node))
+#define DATUM_SLOT(t, node) \
+    ((t)->keys_only ? \
+     ((t)->set_datum = DICT_SET_MEMBER, &(t)->set_datum) : \
+     &TREE_DATUM(t, node))
+
+/* The layouts that dict_inline.h relies on. */
+#define SAME_OFFSET(a, b, field) (offsetof(a, field) == offsetof(b, field))
+STATIC_ASSERT(inline_node_key, SAME_OFFSET(tree_node, dict_inline_node, key));
+STATIC_ASSERT(inline_node_parent,
+	      SAME_OFFSET(tree_node, dict_inline_node, parent));
+STATIC_ASSERT(inline_node_llink,
+	      SAME_OFFSET(tree_node, dict_inline_node, llink));
+STATIC_ASSERT(inline_node_rlink,
+	      SAME_OFFSET(tree_node, dict_inline_node, rlink));
+STATIC_ASSERT(inline_tree_root, SAME_OFFSET(tree, dict_inline_tree, root));
+STATIC_ASSERT(inline_tree_cmp_func,
+	      SAME_OFFSET(tree, dict_inline_tree, cmp_func));
+STATIC_ASSERT(inline_tree_keys_only,
+	      SAME_OFFSET(tree, dict_inline_tree, keys_only));
+STATIC_ASSERT(inline_tree_set_datum,
+	      SAME_OFFSET(tree, dict_inline_tree, set_datum));
+STATIC_ASSERT(inline_tree_datum_offset,
+	      SAME_OFFSET(tree, dict_inline_tree, datum_offset));
+STATIC_ASSERT(inline_itor_tree,
+	      SAME_OFFSET(tree_iterator, dict_inline_itor, tree));
+STATIC_ASSERT(inline_itor_node,
+	      SAME_OFFSET(tree_iterator, dict_inline_itor, node));
+#undef SAME_OFFSET
+
 void
 tree_node_rot_left(void* Tree, void* Node)
 {
@@ -46,6 +85,7 @@ tree_node_rot_left(void* Tree, void* Node)
     } else {
 	t->root = nr;
     }
+    TRACE_ROTATE(t, n, 0);
 }
 
 void
@@ -72,6 +112,7 @@ tree_node_rot_right(void* Tree, void* Node)
     } else {
 	t->root = nl;
     }
+    TRACE_ROTATE(t, n, 1);
 }
 
 void*
@@ -126,22 +167,48 @@ tree_node_max(void* Node)
     return node;
 }
 
+static tree_node*
+tree_search_node(tree* tree, const void* key)
+{
+    tree_node* node = tree->root;
+    while (node) {
+	int cmp = tree->cmp_func(key, node->key);
+	if (cmp < 0)
+	    node = node->llink;
+	else if (cmp)
+	    node = node->rlink;
+	else
+	    return node;
+    }
+    return NULL;
+}
+
 void*
 tree_search(void* Tree, const void* key)
 {
     tree* tree = Tree;
     ASSERT(tree != NULL);
-    tree_node* node = tree->root;
-    while (node) {
+    tree_node* node = tree_search_node(tree, key);
+    return node ? DATUM(tree, node) : NULL;
+}
+
+size_t
+tree_search_depth(const void* Tree, const void* key)
+{
+    const tree* tree = Tree;
+    ASSERT(tree != NULL);
+    size_t depth = 0;
+    for (const tree_node* node = tree->root; node; ) {
+	++depth;
 	int cmp = tree->cmp_func(key, node->key);
 	if (cmp < 0)
 	    node = node->llink;
 	else if (cmp)
 	    node = node->rlink;
 	else
-	    return node->datum;
+	    break;
     }
-    return NULL;
+    return depth;
 }
 
 const void*
@@ -179,10 +246,10 @@ tree_traverse(void* Tree, dict_visit_func visit)
 
     size_t count = 0;
     if (tree->root) {
-	tree_node* node = tree_node_min(tree);
+	tree_node* node = tree_node_min(tree->root);
 	do {
 	    ++count;
-	    if (!visit(node->key, node->datum))
+	    if (!visit(node->key, DATUM(tree, node)))
 		break;
 	    node = tree_node_next(node);
 	} while (node);
@@ -198,7 +265,7 @@ tree_node_free(tree* tree, tree_node* node)
     tree_node* llink = node->llink;
     tree_node* rlink = node->rlink;
     if (tree->del_func)
-	tree->del_func(node->key, node->datum);
+	tree->del_func(node->key, DEL_DATUM(tree, node));
     FREE(node);
     if (llink)
 	tree_node_free(tree, llink);
@@ -214,6 +281,14 @@ tree_count(const void* Tree)
     return tree->count;
 }
 
+size_t
+tree_mod_count(const void* Tree)
+{
+    const tree* tree = Tree;
+    ASSERT(tree != NULL);
+    return tree->mod_count;
+}
+
 size_t
 tree_clear(void* Tree)
 {
@@ -225,6 +300,7 @@ tree_clear(void* Tree)
 	tree_node_free(tree, tree->root);
 	tree->root = NULL;
 	tree->count = 0;
+	tree->mod_count++;
     }
     return count;
 }
@@ -241,8 +317,8 @@ tree_free(void* Tree)
 }
 
 static tree_node_base*
-node_clone(tree_node_base* node, tree_node_base* parent, size_t node_size,
-	   dict_key_datum_clone_func clone_func)
+node_clone(const tree_base* tree, tree_node_base* node, tree_node_base* parent,
+	   size_t node_size, dict_key_datum_clone_func clone_func)
 {
     if (!node)
 	return NULL;
@@ -250,11 +326,14 @@ node_clone(tree_node_base* node, tree_node_base* parent, size_t node_size,
     if (!clone)
 	return NULL;
     memcpy(clone, node, node_size);
-    if (clone_func)
-	clone_func(&clone->key, &clone->datum);
+    if (clone_func) {
+	void* datum = DICT_SET_MEMBER;
+	clone_func(&clone->key,
+		   tree->keys_only ? &datum : &TREE_DATUM(tree, clone));
+    }
     clone->parent = parent;
-    clone->llink = node_clone(node->llink, clone, node_size, clone_func);
-    clone->rlink = node_clone(node->rlink, clone, node_size, clone_func);
+    clone->llink = node_clone(tree, node->llink, clone, node_size, clone_func);
+    clone->rlink = node_clone(tree, node->rlink, clone, node_size, clone_func);
     return clone;
 }
 
@@ -263,13 +342,13 @@ tree_clone(void* tree, size_t tree_size, size_t node_size,
 	   dict_key_datum_clone_func clone_func)
 {
     ASSERT(tree_size >= sizeof(tree_base));
-    ASSERT(node_size >= sizeof(tree_node_base));
+    ASSERT(node_size >= sizeof(tree_node));
 
     tree_base* clone = MALLOC(tree_size);
     if (clone) {
 	memcpy(clone, tree, tree_size);
-	clone->root = node_clone(((tree_base*)tree)->root, NULL, node_size,
-				 clone_func);
+	clone->root = node_clone(tree, ((tree_base*)tree)->root, NULL,
+				 node_size, clone_func);
     }
     return clone;
 }
@@ -324,6 +403,938 @@ tree_max_leaf_depth(const void* Tree)
     return tree->root ? node_max_leaf_depth(tree->root, 1) : 0;
 }
 
+typedef struct {
+    TREE_FIELDS(tree_node);
+    TREE_AGGREGATE_FIELDS(tree_node);
+} aggregate_tree;
+
+/* Some trees keep a flag in the low bit of each rlink. */
+#define RLINK_BITS	((uintptr_t)1)
+#define RLINK(node)	((tree_node*)((uintptr_t)(node)->rlink & ~RLINK_BITS))
+
+#define AGG(tree, node)	((void*)((char*)(node) + (tree)->agg_offset))
+#define CHILD_AGG(tree, node, null) ((node) != (null) ? AGG(tree, node) : NULL)
+
+bool
+tree_set_aggregate(void* Tree, size_t node_size,
+		   dict_aggregate_func agg_func, size_t agg_size)
+{
+    aggregate_tree* tree = Tree;
+    ASSERT(tree != NULL);
+    ASSERT(agg_func == NULL || agg_size > 0);
+
+    if (tree->count)
+	return false;
+    tree->agg_func = agg_func;
+    tree->agg_update = NULL;
+    tree->agg_offset = TREE_AGGREGATE_OFFSET(SET_NODE_SIZE(tree, node_size));
+    tree->agg_size = agg_func ? agg_size : 0;
+    tree->agg_stale = NULL;
+    return true;
+}
+
+size_t
+tree_node_alloc_size(const void* Tree, size_t node_size)
+{
+    const aggregate_tree* tree = Tree;
+    ASSERT(tree != NULL);
+
+    return tree->agg_size ? tree->agg_offset + tree->agg_size :
+			    SET_NODE_SIZE(tree, node_size);
+}
+
+void
+tree_node_aggregate(void* Tree, const void* null, void* Node)
+{
+    aggregate_tree* tree = Tree;
+    tree_node* node = Node;
+    ASSERT(tree != NULL);
+    ASSERT(node != NULL);
+
+    if (tree->agg_update)
+	tree->agg_update(tree, node);
+    else if (tree->agg_func)
+	tree->agg_func(AGG(tree, node), node->key, DATUM(tree, node),
+		       CHILD_AGG(tree, node->llink, null),
+		       CHILD_AGG(tree, RLINK(node), null));
+}
+
+void
+tree_node_aggregate_path(void* Tree, const void* null, void* Node)
+{
+    aggregate_tree* tree = Tree;
+    ASSERT(tree != NULL);
+
+    if (TREE_AUGMENTED(tree))
+	for (tree_node* node = Node; node != null; node = node->parent)
+	    tree_node_aggregate(tree, null, node);
+}
+
+void
+tree_aggregate_flush(void* Tree, const void* null)
+{
+    aggregate_tree* tree = Tree;
+    ASSERT(tree != NULL);
+
+    if (tree->agg_stale) {
+	tree_node_aggregate_path(tree, null, tree->agg_stale);
+	tree->agg_stale = NULL;
+    }
+}
+
+bool
+tree_aggregate_update(void* Tree, const void* null, const void* key)
+{
+    aggregate_tree* tree = Tree;
+    ASSERT(tree != NULL);
+
+    tree_aggregate_flush(tree, null);
+    tree_node* node = tree->root;
+    while (node != null) {
+	int cmp = tree->cmp_func(key, node->key);
+	if (cmp < 0)
+	    node = node->llink;
+	else if (cmp)
+	    node = RLINK(node);
+	else {
+	    tree_node_aggregate_path(tree, null, node);
+	    return true;
+	}
+    }
+    return false;
+}
+
+static void
+node_aggregate_all(aggregate_tree* tree, const tree_node* null,
+		   tree_node* node)
+{
+    if (node != null) {
+	node_aggregate_all(tree, null, node->llink);
+	node_aggregate_all(tree, null, RLINK(node));
+	tree_node_aggregate(tree, null, node);
+    }
+}
+
+void
+tree_aggregate_rebuild(void* Tree, const void* null)
+{
+    aggregate_tree* tree = Tree;
+    ASSERT(tree != NULL);
+
+    if (TREE_AUGMENTED(tree))
+	node_aggregate_all(tree, null, tree->root);
+    tree->agg_stale = NULL;
+}
+
+/* Aggregate the nodes of the subtree |node| with keys not less than |lo| into
+ * |result|, returning |result|, or NULL if there are none. */
+static const void*
+node_aggregate_from(aggregate_tree* tree, const tree_node* null,
+		    tree_node* node, const void* lo, void* result)
+{
+    while (node != null && tree->cmp_func(node->key, lo) < 0)
+	node = RLINK(node);
+    if (node == null)
+	return NULL;
+    TREE_AGGREGATE_BUFFER(left, tree->agg_size);
+    tree->agg_func(result, node->key, DATUM(tree, node),
+		   node_aggregate_from(tree, null, node->llink, lo, left),
+		   CHILD_AGG(tree, RLINK(node), null));
+    return result;
+}
+
+/* Aggregate the nodes of the subtree |node| with keys not greater than |hi|
+ * into |result|, returning |result|, or NULL if there are none. */
+static const void*
+node_aggregate_to(aggregate_tree* tree, const tree_node* null,
+		  tree_node* node, const void* hi, void* result)
+{
+    while (node != null && tree->cmp_func(node->key, hi) > 0)
+	node = node->llink;
+    if (node == null)
+	return NULL;
+    TREE_AGGREGATE_BUFFER(right, tree->agg_size);
+    tree->agg_func(result, node->key, DATUM(tree, node),
+		   CHILD_AGG(tree, node->llink, null),
+		   node_aggregate_to(tree, null, RLINK(node), hi, right));
+    return result;
+}
+
+bool
+tree_range_aggregate(void* Tree, const void* null, const void* lo,
+		     const void* hi, void* result)
+{
+    aggregate_tree* tree = Tree;
+    ASSERT(tree != NULL);
+    ASSERT(tree->agg_func != NULL);
+    ASSERT(result != NULL);
+
+    tree_aggregate_flush(tree, null);
+    /* Find the highest node in the range; the rest of the range is split
+     * between a suffix of its left subtree and a prefix of its right. */
+    tree_node* node = tree->root;
+    while (node != null) {
+	if (tree->cmp_func(node->key, lo) < 0)
+	    node = RLINK(node);
+	else if (tree->cmp_func(node->key, hi) > 0)
+	    node = node->llink;
+	else
+	    break;
+    }
+    if (node == null)
+	return false;
+    TREE_AGGREGATE_BUFFER(left, tree->agg_size);
+    TREE_AGGREGATE_BUFFER(right, tree->agg_size);
+    tree->agg_func(result, node->key, DATUM(tree, node),
+		   node_aggregate_from(tree, null, node->llink, lo, left),
+		   node_aggregate_to(tree, null, RLINK(node), hi, right));
+    return true;
+}
+
+static bool
+node_aggregate_verify(const aggregate_tree* tree, const tree_node* null,
+		      tree_node* node)
+{
+    if (node == null)
+	return true;
+    if (!node_aggregate_verify(tree, null, node->llink) ||
+	!node_aggregate_verify(tree, null, RLINK(node)))
+	return false;
+    /* The recomputed aggregate starts out as a copy of the stored one, so
+     * that padding the aggregate function leaves alone compares equal. */
+    TREE_AGGREGATE_BUFFER(agg, tree->agg_size);
+    memcpy(agg, AGG(tree, node), tree->agg_size);
+    tree->agg_func(agg, node->key, DATUM(tree, node),
+		   CHILD_AGG(tree, node->llink, null),
+		   CHILD_AGG(tree, RLINK(node), null));
+    VERIFY(memcmp(agg, AGG(tree, node), tree->agg_size) == 0);
+    return true;
+}
+
+bool
+tree_aggregate_verify(const void* Tree, const void* null)
+{
+    const aggregate_tree* tree = Tree;
+    ASSERT(tree != NULL);
+
+    if (!tree->agg_func)
+	return true;
+    /* Aggregates are allowed to be stale until the next operation. */
+    tree_aggregate_flush((void*)tree, null);
+    return node_aggregate_verify(tree, null, tree->root);
+}
+
+/* Nodes are relaid out into arenas, each a single allocation holding the nodes
+ * that were copied into it; an arena is freed once all of its nodes have been
+ * released. A relayout in progress uses its arena as the queue of a
+ * breadth-first traversal: the children of each moved node are moved in turn
+ * to the end of the arena. Nodes that the tree gains under nodes that have
+ * already been visited are left where they are. */
+typedef struct tree_arena tree_arena;
+
+struct tree_arena {
+    tree_arena*		next;
+    char*		base;
+    char*		end;
+    size_t		live;	    /* Nodes not yet released. */
+};
+
+struct tree_layout {
+    tree_arena*		arenas;
+    tree_arena*		step;	    /* Arena of the relayout in progress. */
+    size_t		head;	    /* Next moved node whose children to move. */
+    size_t		tail;	    /* Nodes moved so far. */
+};
+
+static void
+set_rlink(tree_node* node, tree_node* rlink)
+{
+    node->rlink = (tree_node*)((uintptr_t)rlink |
+			       ((uintptr_t)node->rlink & RLINK_BITS));
+}
+
+static tree_layout*
+layout_get(tree_layout** layout)
+{
+    if (!*layout && (*layout = MALLOC(sizeof(**layout))) != NULL) {
+	(*layout)->arenas = NULL;
+	(*layout)->step = NULL;
+	(*layout)->head = (*layout)->tail = 0;
+    }
+    return *layout;
+}
+
+static tree_arena*
+arena_new(tree_layout* layout, size_t count, size_t node_size)
+{
+    const size_t header = TREE_AGGREGATE_OFFSET(sizeof(tree_arena));
+    if (count > (SIZE_MAX - header) / node_size)
+	return NULL;
+    tree_arena* arena = MALLOC(header + count * node_size);
+    if (arena) {
+	arena->base = (char*)arena + header;
+	arena->end = arena->base + count * node_size;
+	arena->live = 0;
+	arena->next = layout->arenas;
+	layout->arenas = arena;
+    }
+    return arena;
+}
+
+static bool
+arena_holds(const tree_arena* arena, const void* node)
+{
+    return (uintptr_t)node >= (uintptr_t)arena->base &&
+	   (uintptr_t)node < (uintptr_t)arena->end;
+}
+
+void
+tree_layout_free_node(tree_layout* layout, void* node)
+{
+    if (layout) {
+	for (tree_arena** prev = &layout->arenas; *prev; prev = &(*prev)->next) {
+	    tree_arena* arena = *prev;
+	    if (arena_holds(arena, node)) {
+		/* A released node is marked as its own parent, so that a
+		 * relayout in progress does not visit it. */
+		((tree_node*)node)->parent = node;
+		if (--arena->live == 0) {
+		    if (arena == layout->step)
+			layout->step = NULL;
+		    *prev = arena->next;
+		    FREE(arena);
+		}
+		return;
+	    }
+	}
+    }
+    FREE(node);
+}
+
+void
+tree_layout_free(tree_layout* layout)
+{
+    if (layout) {
+	ASSERT(layout->arenas == NULL);
+	FREE(layout);
+    }
+}
+
+static void
+node_bfs(tree_node* root, const tree_node* null, tree_node** nodes)
+{
+    size_t n = 0;
+    nodes[n++] = root;
+    for (size_t i = 0; i < n; i++) {
+	if (nodes[i]->llink != null)
+	    nodes[n++] = nodes[i]->llink;
+	if (RLINK(nodes[i]) != null)
+	    nodes[n++] = RLINK(nodes[i]);
+    }
+}
+
+static size_t
+node_height(const tree_node* node, const tree_node* null)
+{
+    if (node == null)
+	return 0;
+    const size_t l = node_height(node->llink, null);
+    const size_t r = node_height(RLINK(node), null);
+    return MAX(l, r) + 1;
+}
+
+static void node_veb(tree_node* node, const tree_node* null, size_t height,
+		     tree_node** nodes, size_t* n);
+
+/* Lay out the subtrees rooted |depth| levels below |node|, left to right. */
+static void
+node_veb_below(tree_node* node, const tree_node* null, size_t depth,
+	       size_t height, tree_node** nodes, size_t* n)
+{
+    if (node == null)
+	return;
+    if (depth == 0) {
+	node_veb(node, null, height, nodes, n);
+    } else {
+	node_veb_below(node->llink, null, depth - 1, height, nodes, n);
+	node_veb_below(RLINK(node), null, depth - 1, height, nodes, n);
+    }
+}
+
+/* Lay out the top |height| levels of the subtree rooted at |node|: the top
+ * half of them, then each subtree below that, recursively. */
+static void
+node_veb(tree_node* node, const tree_node* null, size_t height,
+	 tree_node** nodes, size_t* n)
+{
+    if (node == null)
+	return;
+    if (height == 1) {
+	nodes[(*n)++] = node;
+	return;
+    }
+    const size_t top = height / 2;
+    node_veb(node, null, top, nodes, n);
+    node_veb_below(node, null, top, height - top, nodes, n);
+}
+
+bool
+tree_relayout(void* Tree, tree_layout** Layout, size_t node_size,
+	      const void* Null, dict_layout order)
+{
+    tree* t = Tree;
+    const tree_node* null = Null;
+    ASSERT(t != NULL);
+    ASSERT(Layout != NULL);
+
+    if (t->root == null)
+	return true;
+    tree_layout* layout = layout_get(Layout);
+    if (!layout)
+	return false;
+    tree_node** nodes = MALLOC(t->count * sizeof(*nodes));
+    if (!nodes)
+	return false;
+    tree_arena* arena = arena_new(layout, t->count, node_size);
+    if (!arena) {
+	FREE(nodes);
+	return false;
+    }
+    layout->step = NULL;
+
+    if (order == DICT_LAYOUT_VEB) {
+	size_t n = 0;
+	node_veb(t->root, null, node_height(t->root, null), nodes, &n);
+	ASSERT(n == t->count);
+    } else {
+	node_bfs(t->root, null, nodes);
+    }
+
+    /* Copy each node, then leave the address of its copy in its parent field
+     * so that the copies' links can be redirected. */
+    for (size_t i = 0; i < t->count; i++) {
+	memcpy(arena->base + i * node_size, nodes[i], node_size);
+	nodes[i]->parent = (tree_node*)(arena->base + i * node_size);
+    }
+    for (size_t i = 0; i < t->count; i++) {
+	tree_node* node = (tree_node*)(arena->base + i * node_size);
+	if (node->parent != null)
+	    node->parent = node->parent->parent;
+	if (node->llink != null)
+	    node->llink = node->llink->parent;
+	if (RLINK(node) != null)
+	    set_rlink(node, RLINK(node)->parent);
+    }
+    t->root = t->root->parent;
+    t->mod_count++;
+    for (size_t i = 0; i < t->count; i++)
+	tree_layout_free_node(layout, nodes[i]);
+    arena->live = t->count;
+    FREE(nodes);
+    return true;
+}
+
+/* Move |node| to |slot| in |arena|, and release it. */
+static void
+node_move(tree* t, tree_layout* layout, tree_arena* arena, char* slot,
+	  tree_node* node, size_t node_size, const tree_node* null)
+{
+    tree_node* moved = memcpy(slot, node, node_size);
+    tree_node* parent = node->parent;
+    if (parent == null)
+	t->root = moved;
+    else if (parent->llink == node)
+	parent->llink = moved;
+    else
+	set_rlink(parent, moved);
+    if (moved->llink != null)
+	moved->llink->parent = moved;
+    if (RLINK(moved) != null)
+	RLINK(moved)->parent = moved;
+    t->mod_count++;
+    arena->live++;
+    tree_layout_free_node(layout, node);
+}
+
+bool
+tree_relayout_step(void* Tree, tree_layout** Layout, size_t node_size,
+		   const void* Null, size_t budget)
+{
+    tree* t = Tree;
+    const tree_node* null = Null;
+    ASSERT(t != NULL);
+    ASSERT(Layout != NULL);
+
+    tree_layout* layout = layout_get(Layout);
+    if (!layout)
+	return true;
+    size_t moved = 0;
+    if (!layout->step) {
+	if (t->root == null ||
+	    !(layout->step = arena_new(layout, t->count, node_size)))
+	    return true;
+	node_move(t, layout, layout->step, layout->step->base, t->root,
+		  node_size, null);
+	layout->head = 0;
+	layout->tail = 1;
+	moved++;
+    }
+
+    tree_arena* arena = layout->step;
+    const size_t capacity = (size_t)(arena->end - arena->base) / node_size;
+    while (moved < budget && layout->head < layout->tail) {
+	tree_node* node = (tree_node*)(arena->base + layout->head++ * node_size);
+	if (node->parent == node)
+	    continue;
+	tree_node* child[2] = { node->llink, RLINK(node) };
+	for (unsigned i = 0; i < 2; i++) {
+	    if (child[i] != null && !arena_holds(arena, child[i]) &&
+		layout->tail < capacity) {
+		node_move(t, layout, arena,
+			  arena->base + layout->tail++ * node_size,
+			  child[i], node_size, null);
+		moved++;
+	    }
+	}
+    }
+    if (layout->head < layout->tail)
+	return false;
+    layout->step = NULL;
+    return true;
+}
+
+/* A bulk removal rebuilds the tree once at least 1/REBUILD_FRACTION of its
+ * nodes are to be removed; fewer are removed one at a time. */
+#define REBUILD_FRACTION	8
+
+static tree_node*
+node_first(tree_node* node, const tree_node* null)
+{
+    if (node != null)
+	while (node->llink != null)
+	    node = node->llink;
+    return node;
+}
+
+/* Like tree_node_next(), for trees whose missing child may be a sentinel. */
+static tree_node*
+node_next(tree_node* node, const tree_node* null)
+{
+    tree_node* next = RLINK(node);
+    if (next != null)
+	return node_first(next, null);
+    next = node->parent;
+    while (next != null && RLINK(next) == node) {
+	node = next;
+	next = next->parent;
+    }
+    return next;
+}
+
+/* Build a balanced subtree from the first |count| nodes of |*list|, which are
+ * in order and linked through their llink, calling |rebuild| on each node
+ * after its children. Returns the subtree's root and its height. */
+static tree_node*
+node_build(tree* t, tree_node** list, size_t count, size_t depth,
+	   size_t* height, const tree_node* null, tree_rebuild_func rebuild)
+{
+    if (count == 0) {
+	*height = 0;
+	return (tree_node*)null;
+    }
+    size_t lheight, rheight;
+    tree_node* llink = node_build(t, list, (count - 1) / 2, depth + 1,
+				  &lheight, null, rebuild);
+    tree_node* node = *list;
+    *list = node->llink;
+    tree_node* rlink = node_build(t, list, count - 1 - (count - 1) / 2,
+				  depth + 1, &rheight, null, rebuild);
+    node->llink = llink;
+    node->rlink = rlink;
+    if (llink != null)
+	llink->parent = node;
+    if (rlink != null)
+	rlink->parent = node;
+    rebuild(t, node, depth, lheight, rheight);
+    *height = MAX(lheight, rheight) + 1;
+    return node;
+}
+
+/* Unlink the nodes holding the |nkeys| keys in |keys|, which are in tree
+ * order, and rebuild the tree from the rest. */
+static void
+tree_rebuild_without(tree* t, const void** keys, size_t nkeys,
+		     tree_layout* layout, const tree_node* null,
+		     tree_rebuild_func rebuild)
+{
+    tree_node* kept = NULL;
+    tree_node** kept_tail = &kept;
+    tree_node* removed = NULL;
+    tree_node** removed_tail = &removed;
+    size_t i = 0;
+    /* A node's llink is not read again once the walk has moved past it. */
+    for (tree_node* node = node_first(t->root, null); node != null;) {
+	tree_node* next = node_next(node, null);
+	if (i < nkeys && node->key == keys[i]) {
+	    *removed_tail = node;
+	    removed_tail = &node->llink;
+	    i++;
+	} else {
+	    *kept_tail = node;
+	    kept_tail = &node->llink;
+	}
+	node = next;
+    }
+    ASSERT(i == nkeys);
+    *removed_tail = NULL;
+
+    t->count -= nkeys;
+    t->mod_count++;
+    size_t height;
+    t->root = node_build(t, &kept, t->count, 0, &height, null, rebuild);
+    if (t->root != null)
+	t->root->parent = (tree_node*)null;
+    TRACE_REBUILD(t, t->count);
+
+    while (removed) {
+	tree_node* next = removed->llink;
+	if (t->del_func)
+	    t->del_func(removed->key, DEL_DATUM(t, removed));
+	tree_layout_free_node(layout, removed);
+	removed = next;
+    }
+}
+
+size_t
+tree_remove_if(void* Tree, const void* Null, tree_layout* layout,
+	       dict_predicate_func pred, void* ctx, dict_remove_func remove,
+	       tree_rebuild_func rebuild)
+{
+    tree* t = Tree;
+    const tree_node* null = Null;
+    ASSERT(t != NULL);
+    ASSERT(pred != NULL);
+    ASSERT(remove != NULL);
+
+    const void* local[DICT_LOCAL_KEYS];
+    const void** keys = local;
+    size_t size = DICT_LOCAL_KEYS;
+    size_t removed = 0;
+    bool done = false;
+    while (!done) {
+	/* Collect the keys to remove in one walk, cutting it short if the
+	 * buffer cannot grow; the walk is then resumed from the start. */
+	size_t nkeys = 0;
+	done = true;
+	for (tree_node* node = node_first(t->root, null); node != null;
+	     node = node_next(node, null)) {
+	    if (nkeys == size && !dict_keys_grow(&keys, &size, local)) {
+		done = false;
+		break;
+	    }
+	    if (pred(node->key, DATUM(t, node), ctx))
+		keys[nkeys++] = node->key;
+	}
+
+	if (rebuild && done &&
+	    nkeys * REBUILD_FRACTION >= t->count && nkeys > 0) {
+	    tree_rebuild_without(t, keys, nkeys, layout, null, rebuild);
+	    removed += nkeys;
+	} else {
+	    for (size_t i = 0; i < nkeys; i++)
+		removed += remove(t, keys[i]);
+	}
+    }
+    if (keys != local)
+	FREE(keys);
+    return removed;
+}
+
+/* Sort |keys| in place with heapsort, which needs no memory of its own. */
+static void
+keys_sift(const void** keys, size_t root, size_t count,
+	  dict_compare_func cmp_func)
+{
+    for (;;) {
+	size_t child = 2 * root + 1;
+	if (child >= count)
+	    return;
+	if (child + 1 < count && cmp_func(keys[child], keys[child + 1]) < 0)
+	    child++;
+	if (cmp_func(keys[root], keys[child]) >= 0)
+	    return;
+	const void* tmp;
+	SWAP(keys[root], keys[child], tmp);
+	root = child;
+    }
+}
+
+static void
+keys_sort(const void** keys, size_t count, dict_compare_func cmp_func)
+{
+    for (size_t i = count / 2; i-- > 0;)
+	keys_sift(keys, i, count, cmp_func);
+    for (size_t i = count; i-- > 1;) {
+	const void* tmp;
+	SWAP(keys[0], keys[i], tmp);
+	keys_sift(keys, 0, i, cmp_func);
+    }
+}
+
+typedef struct {
+    const void**	keys;
+    size_t		count;
+    size_t		next;
+    dict_compare_func	cmp_func;
+} keys_merge;
+
+/* Called on the keys of the tree in order, returns whether the sorted keys
+ * being merged with them include |key|. */
+static bool
+keys_merge_pred(const void* key, void* datum, void* ctx)
+{
+    keys_merge* merge = ctx;
+    (void)datum;
+    while (merge->next < merge->count) {
+	int cmp = merge->cmp_func(merge->keys[merge->next], key);
+	if (cmp > 0)
+	    return false;
+	merge->next++;
+	if (cmp == 0)
+	    return true;
+    }
+    return false;
+}
+
+size_t
+tree_remove_many(void* Tree, const void* Null, tree_layout* layout,
+		 const void** keys, size_t count, dict_remove_func remove,
+		 tree_rebuild_func rebuild)
+{
+    tree* t = Tree;
+    ASSERT(t != NULL);
+    ASSERT(keys != NULL || count == 0);
+
+    keys_sort(keys, count, t->cmp_func);
+    if (rebuild && count * REBUILD_FRACTION >= t->count) {
+	keys_merge merge = { keys, count, 0, t->cmp_func };
+	return tree_remove_if(t, Null, layout, keys_merge_pred, &merge,
+			      remove, rebuild);
+    }
+    size_t removed = 0;
+    for (size_t i = 0; i < count; i++)
+	removed += remove(t, keys[i]);
+    return removed;
+}
+
+size_t
+tree_remove_many_with(void* Tree, const void** keys, size_t count,
+		      dict_remove_func remove, dict_remove_if_func remove_if)
+{
+    tree* t = Tree;
+    ASSERT(t != NULL);
+    ASSERT(keys != NULL || count == 0);
+
+    keys_sort(keys, count, t->cmp_func);
+    if (count * REBUILD_FRACTION >= t->count) {
+	keys_merge merge = { keys, count, 0, t->cmp_func };
+	return remove_if(t, keys_merge_pred, &merge);
+    }
+    size_t removed = 0;
+    for (size_t i = 0; i < count; i++)
+	removed += remove(t, keys[i]);
+    return removed;
+}
+
+size_t
+tree_export(void* Tree, const void* Null, void** keys, void** data,
+	    size_t max, dict_export_pos* pos)
+{
+    tree* t = Tree;
+    const tree_node* null = Null;
+    ASSERT(t != NULL);
+    ASSERT(pos != NULL);
+
+    tree_node* node = pos->node;
+    if (!node) {
+	if (pos->index)
+	    return 0;
+	node = node_first(t->root, null);
+    }
+    size_t n = 0;
+    for (; n < max && node != null; n++, node = node_next(node, null)) {
+	if (keys)
+	    keys[n] = node->key;
+	if (data)
+	    data[n] = DATUM(t, node);
+    }
+    pos->index += n;
+    pos->node = node != null ? node : NULL;
+    return n;
+}
+
+/* A parallel export splits the tree into the nodes of its top levels and the
+ * subtrees below them. The workers count the nodes of the subtrees, which
+ * places each subtree and each top node in the output, and then copy the
+ * subtrees into place. Each worker takes every |threads|th subtree. */
+#define EXPORT_THREADS_MAX	64
+#define EXPORT_MIN_PER_THREAD	8192
+
+typedef struct {
+    const tree*		tree;
+    const tree_node*	null;
+    tree_node**		items;	    /* Top nodes and subtrees, in order. */
+    bool*		subtree;    /* Whether each item is a subtree. */
+    size_t*		sizes;	    /* The number of nodes in each item. */
+    size_t*		offsets;    /* Where each item goes in the output. */
+    size_t		nitems;
+    void**		keys;
+    void**		data;
+    unsigned		threads;
+    bool		copy;	    /* Copying, rather than counting. */
+} export_job;
+
+typedef struct {
+    export_job*		job;
+    unsigned		index;
+} export_worker;
+
+/* Append the top |depth| levels under |node|, and the subtrees below them, to
+ * the items of |job| in order. */
+static void
+export_split(tree_node* node, unsigned depth, export_job* job)
+{
+    if (depth == 0 || node == job->null) {
+	job->items[job->nitems] = node;
+	job->subtree[job->nitems++] = true;
+	return;
+    }
+    export_split(node->llink, depth - 1, job);
+    job->items[job->nitems] = node;
+    job->subtree[job->nitems++] = false;
+    export_split(RLINK(node), depth - 1, job);
+}
+
+static void*
+export_work(void* arg)
+{
+    const export_worker* worker = arg;
+    export_job* job = worker->job;
+    const tree_node* null = job->null;
+    for (size_t i = worker->index; i < job->nitems; i += job->threads) {
+	tree_node* node = job->items[i];
+	if (!job->subtree[i] || node == null)
+	    continue;
+	if (!job->copy) {
+	    /* Parent links lead out of the subtree after its last node. */
+	    tree_node* last = node;
+	    while (RLINK(last) != null)
+		last = RLINK(last);
+	    size_t count = 1;
+	    for (node = node_first(node, null); node != last;
+		 node = node_next(node, null))
+		count++;
+	    job->sizes[i] = count;
+	} else {
+	    void** keys = job->keys ? job->keys + job->offsets[i] : NULL;
+	    void** data = job->data ? job->data + job->offsets[i] : NULL;
+	    node = node_first(node, null);
+	    for (size_t n = 0;;) {
+		if (keys)
+		    keys[n] = node->key;
+		if (data)
+		    data[n] = DATUM(job->tree, node);
+		if (++n == job->sizes[i])
+		    break;
+		node = node_next(node, null);
+	    }
+	}
+    }
+    return NULL;
+}
+
+/* Run |job| on up to |job->threads| threads, the first being this one; the
+ * work of any thread that cannot be started is done here. */
+static void
+export_run(export_job* job)
+{
+    export_worker workers[EXPORT_THREADS_MAX];
+    pthread_t ids[EXPORT_THREADS_MAX];
+    bool started[EXPORT_THREADS_MAX];
+    for (unsigned i = 0; i < job->threads; i++) {
+	workers[i].job = job;
+	workers[i].index = i;
+	started[i] = i > 0 &&
+	    pthread_create(&ids[i], NULL, export_work, &workers[i]) == 0;
+    }
+    for (unsigned i = 0; i < job->threads; i++)
+	if (!started[i])
+	    export_work(&workers[i]);
+    for (unsigned i = 1; i < job->threads; i++)
+	if (started[i])
+	    pthread_join(ids[i], NULL);
+}
+
+size_t
+tree_export_all(void* Tree, const void* Null, void** keys, void** data,
+		unsigned threads)
+{
+    tree* t = Tree;
+    ASSERT(t != NULL);
+
+    if (threads > EXPORT_THREADS_MAX)
+	threads = EXPORT_THREADS_MAX;
+    if (threads > t->count / EXPORT_MIN_PER_THREAD)
+	threads = (unsigned)(t->count / EXPORT_MIN_PER_THREAD);
+    /* About eight subtrees per thread evens out their sizes. */
+    unsigned depth = 0;
+    while ((1U << depth) < threads * 8)
+	depth++;
+    const size_t max_items = ((size_t)2 << depth) - 1;
+    export_job job = { t, Null, NULL, NULL, NULL, NULL, 0, keys, data,
+		       threads, false };
+    if (threads > 1) {
+	job.items = MALLOC(max_items * sizeof(*job.items));
+	job.subtree = MALLOC(max_items * sizeof(*job.subtree));
+	job.sizes = MALLOC(max_items * sizeof(*job.sizes));
+	job.offsets = MALLOC(max_items * sizeof(*job.offsets));
+    }
+    if (threads <= 1 ||
+	!job.items || !job.subtree || !job.sizes || !job.offsets) {
+	FREE(job.items);
+	FREE(job.subtree);
+	FREE(job.sizes);
+	FREE(job.offsets);
+	dict_export_pos pos = DICT_EXPORT_START;
+	return tree_export(t, Null, keys, data, t->count, &pos);
+    }
+
+    export_split(t->root, depth, &job);
+    for (size_t i = 0; i < job.nitems; i++)
+	job.sizes[i] = job.subtree[i] ? 0 : 1;
+    export_run(&job);
+    size_t offset = 0;
+    for (size_t i = 0; i < job.nitems; i++) {
+	job.offsets[i] = offset;
+	if (!job.subtree[i]) {
+	    if (keys)
+		keys[offset] = job.items[i]->key;
+	    if (data)
+		data[offset] = DATUM(t, job.items[i]);
+	}
+	offset += job.sizes[i];
+    }
+    ASSERT(offset == t->count);
+    job.copy = true;
+    export_run(&job);
+
+    FREE(job.items);
+    FREE(job.subtree);
+    FREE(job.sizes);
+    FREE(job.offsets);
+    return offset;
+}
+
 bool
 tree_iterator_valid(const void* Iterator)
 {
@@ -428,7 +1439,34 @@ tree_iterator_search(void* Iterator, const void* key)
     tree_iterator* iterator = Iterator;
     ASSERT(iterator != NULL);
     ASSERT(iterator->tree != NULL);
-    return (iterator->node = tree_search(iterator->tree, key)) != NULL;
+    return (iterator->node = tree_search_node(iterator->tree, key)) != NULL;
+}
+
+bool
+tree_iterator_seek(void* Iterator, const void* key)
+{
+    tree_iterator* iterator = Iterator;
+    ASSERT(iterator != NULL);
+    ASSERT(iterator->tree != NULL);
+
+    tree_node* node = iterator->node;
+    if (!node)
+	return false;
+    const dict_compare_func cmp = iterator->tree->cmp_func;
+    if (cmp(node->key, key) >= 0)
+	return true;
+    /* Climb only while the parent is also before |key|. The key sought is then
+     * in |node|'s right subtree, or else it is the parent. */
+    tree_node* found;
+    while ((found = node->parent) && cmp(found->key, key) < 0)
+	node = found;
+    for (node = node->rlink; node;) {
+	if (cmp(node->key, key) >= 0)
+	    found = node, node = node->llink;
+	else
+	    node = node->rlink;
+    }
+    return (iterator->node = found) != NULL;
 }
 
 const void*
@@ -446,5 +1484,6 @@ tree_iterator_data(void* Iterator)
     tree_iterator* iterator = Iterator;
     ASSERT(iterator != NULL);
     ASSERT(iterator->tree != NULL);
-    return iterator->node ? &iterator->node->datum : NULL;
+    return iterator->node ?
+	DATUM_SLOT(iterator->tree, iterator->node) : NULL;
 }
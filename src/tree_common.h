@@ -10,28 +10,86 @@
 
 #include "dict.h"
 
+/* Every node starts with these links. The fields a tree adds follow them, and
+ * its datum comes last, so that a set, whose nodes store only keys, can
+ * allocate nodes that end before it; see TREE_FIELDS. */
 #define TREE_NODE_FIELDS(node_type) \
     void*		key; \
-    void*		datum; \
     node_type*		parent; \
     node_type*		llink; \
     node_type*		rlink;
 
 typedef struct tree_node_base {
     TREE_NODE_FIELDS(struct tree_node_base);
+    void*		datum;
 } tree_node_base;
 
+/* |mod_count| changes whenever a node is added, freed or moved, so that a
+ * cursor can tell whether the node it was left on is still there. A set
+ * (|keys_only|) allocates its nodes without their datum; see dict_private.h.
+ * |datum_offset| locates the datum in each node, after the tree's own
+ * fields. */
 #define TREE_FIELDS(node_type) \
     node_type*		root; \
     size_t		count; \
     dict_compare_func	cmp_func; \
+    bool		keys_only; \
+    void*		set_datum; \
+    size_t		datum_offset; \
     dict_delete_func	del_func; \
-    size_t		rotation_count;
+    size_t		rotation_count; \
+    size_t		mod_count;
 
 typedef struct tree_base {
     TREE_FIELDS(struct tree_node_base);
 } tree_base;
 
+/* The datum of |node| of |tree|, which must not be a set. */
+#define TREE_DATUM(tree, node) \
+    (*(void**)((char*)(node) + (tree)->datum_offset))
+
+/* Recompute the augmentation stored after |node| from its children's. */
+typedef void (*tree_update_func)(void *tree, void *node);
+
+/* Trees that maintain subtree aggregates store each one after its node, at
+ * |agg_offset|. |agg_stale| is a node whose datum may have been changed since
+ * it was returned by insert, so the aggregates on its path to the root must be
+ * recomputed before they are next used. A tree built on another, such as the
+ * interval tree, may keep its own augmentation in that space by setting
+ * |agg_update| instead of |agg_func|. */
+#define TREE_AGGREGATE_FIELDS(node_type) \
+    dict_aggregate_func	agg_func; \
+    tree_update_func	agg_update; \
+    size_t		agg_offset; \
+    size_t		agg_size; \
+    node_type*		agg_stale;
+
+/* Whether |tree| keeps anything in the space after its nodes. */
+#define TREE_AUGMENTED(tree) \
+    ((tree)->agg_func != NULL || (tree)->agg_update != NULL)
+
+typedef struct tree_aggregate_base {
+    TREE_FIELDS(struct tree_node_base);
+    TREE_AGGREGATE_FIELDS(struct tree_node_base);
+} tree_aggregate_base;
+
+/* Aggregates are aligned for pointers, doubles and 64-bit integers. */
+typedef union {
+    void*		p;
+    double		d;
+    long long		ll;
+} tree_aggregate_align;
+
+#define TREE_AGGREGATE_OFFSET(node_size) \
+    (((node_size) + sizeof(tree_aggregate_align) - 1) & \
+     ~(sizeof(tree_aggregate_align) - 1))
+
+/* Declare |name| as a buffer of |size| bytes, suitably aligned for an
+ * aggregate. */
+#define TREE_AGGREGATE_BUFFER(name, size) \
+    tree_aggregate_align name[((size) + sizeof(tree_aggregate_align) - 1) / \
+			      sizeof(tree_aggregate_align)]
+
 #define TREE_ITERATOR_FIELDS(tree_type, node_type) \
     tree_type*		tree; \
     node_type*		node;
@@ -56,6 +114,9 @@ void*	    tree_node_min(void *node);
 void*	    tree_node_max(void *node);
 /* Return the data associated with the key, or NULL if not found. */
 void*	    tree_search(void *tree, const void *key);
+/* Return the number of nodes |key| is compared with to find it, or to find
+ * that it is not in the tree. */
+size_t	    tree_search_depth(const void *tree, const void *key);
 /* Return the minimal key in the tree, or NULL if the tree is empty. */
 const void* tree_min(const void *tree);
 /* Return the maximal key in the tree, or NULL if the tree is empty. */
@@ -66,13 +127,16 @@ const void* tree_max(const void *tree);
 size_t	    tree_traverse(void *tree, dict_visit_func visit);
 /* Return a count of the elements in |tree|. */
 size_t	    tree_count(const void *tree);
+/* Return the number of times nodes of |tree| have been added, freed or
+ * moved. */
+size_t	    tree_mod_count(const void *tree);
 /* Remove all elements from |tree|. */
 size_t	    tree_clear(void *tree);
 /* Remove all elements from |tree| and free its memory. */
 size_t	    tree_free(void *tree);
 /* Return a clone of the tree |tree| where |tree_size| is the tree object size
- * in bytes, |node_size| is the node object size in bytes, and |clone_func| is
- * an optional key-datum cloning function. */
+ * in bytes, |node_size| is the number of bytes allocated for each node, and
+ * |clone_func| is an optional key-datum cloning function. */
 void*	    tree_clone(void *tree, size_t tree_size, size_t node_size,
 		       dict_key_datum_clone_func clone_func);
 /* Returns the depth of the leaf with minimal depth, or 0 for an empty tree. */
@@ -80,6 +144,92 @@ size_t	    tree_min_leaf_depth(const void *tree);
 /* Returns the depth of the leaf with maximal depth, or 0 for an empty tree. */
 size_t	    tree_max_leaf_depth(const void *tree);
 
+/* Set the aggregate function of the empty tree |tree|, whose nodes are
+ * |node_size| bytes without the aggregate. Returns false if |tree| is not
+ * empty. */
+bool	    tree_set_aggregate(void *tree, size_t node_size,
+			       dict_aggregate_func agg_func, size_t agg_size);
+/* Return the number of bytes to allocate for a node of |tree|. */
+size_t	    tree_node_alloc_size(const void *tree, size_t node_size);
+/* Recompute the aggregate of |node| from those of its children. Here and
+ * below, |null| is the tree's missing child: NULL, or a sentinel. The low bit
+ * of each rlink is ignored, for trees that keep a flag there. */
+void	    tree_node_aggregate(void *tree, const void *null, void *node);
+/* Recompute the aggregates of |node| and each of its ancestors. */
+void	    tree_node_aggregate_path(void *tree, const void *null, void *node);
+/* Recompute the aggregates left stale by the last insert, if any. */
+void	    tree_aggregate_flush(void *tree, const void *null);
+/* Recompute the aggregates on the path to the node with |key|, after its datum
+ * has been changed. Returns false if |key| is not in the tree. */
+bool	    tree_aggregate_update(void *tree, const void *null,
+				  const void *key);
+/* Recompute every aggregate, e.g. after cloning keys and data. */
+void	    tree_aggregate_rebuild(void *tree, const void *null);
+/* Aggregate the nodes with keys in [lo, hi] into |result|, calling the
+ * aggregate function O(lg N) times. Returns false if there are none. */
+bool	    tree_range_aggregate(void *tree, const void *null, const void *lo,
+				 const void *hi, void *result);
+/* Return true if every stored aggregate matches a recomputed one. */
+bool	    tree_aggregate_verify(const void *tree, const void *null);
+
+/* Trees that can be relaid out own the arenas their nodes were copied into
+ * through a |tree_layout|, which is NULL until the first relayout. |null| is
+ * the tree's missing child: NULL, or a sentinel. The low bit of each rlink is
+ * preserved, for trees that keep a flag there. */
+typedef struct tree_layout tree_layout;
+
+/* Copy the |node_size|-byte nodes of |tree| into one arena in |order|, fixing
+ * up their links and releasing the old nodes. Returns false, leaving the tree
+ * as it was, if the arena could not be allocated. */
+bool	    tree_relayout(void *tree, tree_layout **layout, size_t node_size,
+			  const void *null, dict_layout order);
+/* Move about |budget| nodes of |tree| into an arena in breadth-first order,
+ * starting a relayout if none is in progress. The tree is valid between
+ * steps, and may be modified; nodes inserted meanwhile may be left out. Returns
+ * true once the relayout is complete, or if the arena could not be allocated. */
+bool	    tree_relayout_step(void *tree, tree_layout **layout,
+			       size_t node_size, const void *null,
+			       size_t budget);
+/* Free |node|, or release it from the arena that holds it. */
+void	    tree_layout_free_node(tree_layout *layout, void *node);
+/* Free |layout|, whose arenas must have been emptied by clearing the tree. */
+void	    tree_layout_free(tree_layout *layout);
+
+/* Called by a bulk removal on each node of the rebuilt tree, after its
+ * children, to set the node's balance information from its |depth| and the
+ * heights of its subtrees. */
+typedef void (*tree_rebuild_func)(void *tree, void *node, size_t depth,
+				  size_t lheight, size_t rheight);
+
+/* Remove the nodes for which |pred| returns true, calling it once on each
+ * node in order, unless memory runs short. If enough are removed and the tree
+ * has a |rebuild| function, the tree is rebuilt balanced from the remaining
+ * nodes in linear time; otherwise each is removed with |remove|. Returns the
+ * number of nodes removed. */
+size_t	    tree_remove_if(void *tree, const void *null, tree_layout *layout,
+			   dict_predicate_func pred, void *ctx,
+			   dict_remove_func remove, tree_rebuild_func rebuild);
+/* Sort the |count| |keys| and remove them from the tree, by merging them with
+ * the tree in one walk if they are many. Returns the number removed. */
+size_t	    tree_remove_many(void *tree, const void *null, tree_layout *layout,
+			     const void **keys, size_t count,
+			     dict_remove_func remove, tree_rebuild_func rebuild);
+/* Like tree_remove_many(), for trees that remove nodes in bulk through their
+ * own |remove_if|, which is passed the sorted keys to merge with if they are
+ * many. */
+size_t	    tree_remove_many_with(void *tree, const void **keys, size_t count,
+				  dict_remove_func remove,
+				  dict_remove_if_func remove_if);
+
+/* Copy up to |max| keys and datums in order, resuming from |pos|, as
+ * dict_export() does. */
+size_t	    tree_export(void *tree, const void *null, void **keys, void **data,
+			size_t max, dict_export_pos *pos);
+/* Copy every key and datum in order, splitting the work among up to
+ * |threads| threads if the tree is large enough. */
+size_t	    tree_export_all(void *tree, const void *null, void **keys,
+			    void **data, unsigned threads);
+
 bool	    tree_iterator_valid(const void *iterator);
 void	    tree_iterator_invalidate(void *iterator);
 void	    tree_iterator_free(void *iterator);
@@ -90,6 +240,7 @@ bool	    tree_iterator_prev_n(void *iterator, size_t count);
 bool	    tree_iterator_first(void *iterator);
 bool	    tree_iterator_last(void *iterator);
 bool	    tree_iterator_search(void *iterator, const void *key);
+bool	    tree_iterator_seek(void *iterator, const void *key);
 const void* tree_iterator_key(const void *iterator);
 void**	    tree_iterator_data(void *iterator);
 
@@ -0,0 +1,639 @@
+/*
+ * libdict -- write-ahead log implementation.
+ *
+ * Copyright (c) 2001-2011, Farooq Mela
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *    This product includes software developed by Farooq Mela.
+ * 4. Neither the name of the Farooq Mela nor the
+ *    names of contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY FAROOQ MELA ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL FAROOQ MELA BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * The log file starts with an 8-byte magic number, followed by records. Each
+ * record has a 13-byte header -- a CRC-32 of the rest of the record, a type
+ * byte, and the little-endian lengths of the serialized key and datum -- then
+ * the key and datum themselves.
+ */
+
+#define _POSIX_C_SOURCE 200809L	    /* For fdatasync(). */
+
+#include "wal.h"
+
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "dict_private.h"
+
+#define WAL_MAGIC	    "libdictL"
+#define WAL_MAGIC_SIZE	    8
+#define WAL_HEADER_SIZE	    13
+#define WAL_BUFFER_SIZE	    65536
+
+#define REC_INSERT	    'I'
+#define REC_REMOVE	    'R'
+#define REC_CLEAR	    'C'
+
+struct wal_log {
+    dict*		    dct;
+    int			    fd;
+    char*		    path;
+    wal_codec		    codec;
+    dict_delete_func	    del_func;
+    size_t		    group;
+    size_t		    unsynced;	/* Records since the last sync. */
+    size_t		    size;	/* Bytes in the file. */
+    unsigned char*	    buf;
+    size_t		    len;
+    size_t		    cap;
+    size_t		    open;	/* Bytes of an unfinished record. */
+    void**		    pending_datum;	/* Of an unfinished insertion. */
+    size_t		    mod_count;	/* Keys added or removed through it. */
+};
+
+static size_t wal_log_mod_count(const wal_log* log);
+
+static dict_vtable wal_log_vtable = {
+    (dict_inew_func)	    wal_log_itor_new,
+    (dict_dfree_func)	    wal_log_free,
+    (dict_insert_func)	    wal_log_insert,
+    (dict_search_func)	    wal_log_search,
+    (dict_remove_func)	    wal_log_remove,
+    (dict_clear_func)	    wal_log_clear,
+    (dict_traverse_func)    wal_log_traverse,
+    (dict_count_func)	    wal_log_count,
+    (dict_verify_func)	    wal_log_verify,
+    (dict_clone_func)	    wal_log_clone,
+    (dict_remove_many_func) NULL,/* wal_log_remove_many not implemented yet */
+    (dict_remove_if_func)   NULL,/* wal_log_remove_if not implemented yet */
+    (dict_mod_count_func)   wal_log_mod_count,
+    (dict_export_func)	    NULL,/* wal_log_export not implemented yet */
+    (dict_export_all_func)  NULL,/* wal_log_export_all not implemented yet */
+};
+
+static uint32_t crc_table[256];
+
+static uint32_t
+crc32_update(uint32_t crc, const unsigned char* p, size_t size)
+{
+    if (!crc_table[1]) {
+	for (uint32_t i = 0; i < 256; i++) {
+	    uint32_t c = i;
+	    for (unsigned k = 0; k < 8; k++)
+		c = (c >> 1) ^ (c & 1 ? 0xEDB88320U : 0);
+	    crc_table[i] = c;
+	}
+    }
+    crc = ~crc;
+    while (size--)
+	crc = crc_table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+static inline void
+put_u32(unsigned char* p, uint32_t v)
+{
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+    p[2] = (unsigned char)(v >> 16);
+    p[3] = (unsigned char)(v >> 24);
+}
+
+static inline uint32_t
+get_u32(const unsigned char* p)
+{
+    return p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 |
+	(uint32_t)p[3] << 24;
+}
+
+static bool
+write_full(int fd, const unsigned char* p, size_t size)
+{
+    while (size) {
+	ssize_t n = write(fd, p, size);
+	if (n < 0 && errno == EINTR)
+	    continue;
+	if (n <= 0)
+	    return false;
+	p += n;
+	size -= (size_t)n;
+    }
+    return true;
+}
+
+static size_t
+read_full(int fd, unsigned char* p, size_t size)
+{
+    size_t total = 0;
+    while (total < size) {
+	ssize_t n = read(fd, p + total, size - total);
+	if (n < 0 && errno == EINTR)
+	    continue;
+	if (n <= 0)
+	    break;
+	total += (size_t)n;
+    }
+    return total;
+}
+
+/* Writes out the buffer to the log file, except for an unfinished record,
+ * which moves to the front. */
+static bool
+buffer_flush(wal_log* log)
+{
+    if (log->len) {
+	if (!write_full(log->fd, log->buf, log->len))
+	    return false;
+	log->size += log->len;
+	memmove(log->buf, log->buf + log->len, log->open);
+	log->len = 0;
+    }
+    return true;
+}
+
+/* Makes room in the buffer for |size| bytes past the finished records. */
+static bool
+buffer_reserve(wal_log* log, size_t size)
+{
+    if (log->cap - log->len >= size)
+	return true;
+    if (!buffer_flush(log))
+	return false;
+    if (log->cap >= size)
+	return true;
+    unsigned char* buf = MALLOC(size);
+    if (!buf)
+	return false;
+    memcpy(buf, log->buf, log->open);
+    FREE(log->buf);
+    log->buf = buf;
+    log->cap = size;
+    return true;
+}
+
+/* Starts a record with its key at the end of the buffer. */
+static bool
+record_start(wal_log* log, int type, const void* key)
+{
+    ASSERT(log->open == 0);
+
+    size_t need = WAL_HEADER_SIZE;
+    for (;;) {
+	if (!buffer_reserve(log, need))
+	    return false;
+	unsigned char* rec = log->buf + log->len;
+	const size_t room = log->cap - log->len - WAL_HEADER_SIZE;
+	const size_t klen = type == REC_CLEAR ? 0 :
+	    log->codec.key_encode(key, rec + WAL_HEADER_SIZE, room);
+	if (klen > room) {
+	    need = WAL_HEADER_SIZE + klen;
+	    continue;
+	}
+	rec[4] = (unsigned char)type;
+	put_u32(rec + 5, (uint32_t)klen);
+	log->open = WAL_HEADER_SIZE + klen;
+	return true;
+    }
+}
+
+/* Adds the datum, if the record has one, and the checksum to the record that
+ * was started, and appends it to the log. */
+static bool
+record_finish(wal_log* log, const void* datum, bool has_datum)
+{
+    ASSERT(log->open >= WAL_HEADER_SIZE);
+
+    size_t dlen = 0;
+    if (has_datum) {
+	size_t room = log->cap - log->len - log->open;
+	dlen = log->codec.datum_encode(datum, log->buf + log->len + log->open,
+				       room);
+	if (dlen > room) {
+	    if (!buffer_reserve(log, log->open + dlen)) {
+		log->open = 0;
+		return false;
+	    }
+	    room = log->cap - log->len - log->open;
+	    dlen = log->codec.datum_encode(datum,
+					   log->buf + log->len + log->open,
+					   room);
+	    ASSERT(dlen <= room);
+	}
+    }
+    unsigned char* rec = log->buf + log->len;
+    put_u32(rec + 9, (uint32_t)dlen);
+    put_u32(rec, crc32_update(0, rec + 4, log->open - 4 + dlen));
+    log->len += log->open + dlen;
+    log->open = 0;
+    log->unsynced++;
+    return true;
+}
+
+/* Finishes the record of the last insertion, with the datum that has been
+ * stored since. */
+static bool
+pending_flush(wal_log* log)
+{
+    if (!log->pending_datum)
+	return true;
+    void** datum = log->pending_datum;
+    log->pending_datum = NULL;
+    return record_finish(log, *datum, true);
+}
+
+/* Commits if a group of records has built up. */
+static bool
+group_commit(wal_log* log)
+{
+    if (log->group && log->unsynced >= log->group)
+	return wal_log_commit(log);
+    return true;
+}
+
+static void
+replay_record(wal_log* log, int type, const unsigned char* p, size_t klen,
+	      size_t dlen)
+{
+    if (type == REC_CLEAR) {
+	dict_clear(log->dct);
+	return;
+    }
+    void* key = log->codec.key_decode(p, klen);
+    if (type == REC_REMOVE) {
+	dict_remove(log->dct, key);
+	if (log->del_func)
+	    log->del_func(key, NULL);
+	return;
+    }
+    void* datum = log->codec.datum_decode(p + klen, dlen);
+    bool inserted = false;
+    void** location = dict_insert(log->dct, key, &inserted);
+    if (!location)
+	return;
+    if (!inserted && log->del_func)
+	log->del_func(key, *location);
+    *location = datum;
+}
+
+/* Replays the records after the magic number, and cuts off the log after the
+ * last intact one. */
+static bool
+replay(wal_log* log)
+{
+    struct stat st;
+    if (fstat(log->fd, &st) != 0)
+	return false;
+    const size_t end = (size_t)st.st_size;
+    size_t offset = WAL_MAGIC_SIZE;
+    for (;;) {
+	unsigned char hdr[WAL_HEADER_SIZE];
+	if (read_full(log->fd, hdr, sizeof(hdr)) < sizeof(hdr))
+	    break;
+	const size_t klen = get_u32(hdr + 5), dlen = get_u32(hdr + 9);
+	const int type = hdr[4];
+	/* The lengths are not covered by a checked CRC yet: a record longer
+	 * than the rest of the file is torn, and is not allocated for. */
+	const size_t left = end - offset - WAL_HEADER_SIZE;
+	if ((type != REC_INSERT && type != REC_REMOVE && type != REC_CLEAR) ||
+	    klen > left || dlen > left - klen)
+	    break;
+	if (log->cap < klen + dlen) {
+	    unsigned char* buf = MALLOC(klen + dlen);
+	    if (!buf)
+		return false;
+	    FREE(log->buf);
+	    log->buf = buf;
+	    log->cap = klen + dlen;
+	}
+	if (read_full(log->fd, log->buf, klen + dlen) < klen + dlen)
+	    break;
+	uint32_t crc = crc32_update(0, hdr + 4, WAL_HEADER_SIZE - 4);
+	crc = crc32_update(crc, log->buf, klen + dlen);
+	if (crc != get_u32(hdr))
+	    break;
+	replay_record(log, type, log->buf, klen, dlen);
+	offset += WAL_HEADER_SIZE + klen + dlen;
+    }
+    log->size = offset;
+    return ftruncate(log->fd, (off_t)offset) == 0 &&
+	lseek(log->fd, (off_t)offset, SEEK_SET) == (off_t)offset;
+}
+
+wal_log*
+wal_log_new(dict* dct, const char* path, const wal_codec* codec,
+	    dict_delete_func del_func, size_t group)
+{
+    ASSERT(dct != NULL);
+    ASSERT(path != NULL);
+    ASSERT(codec != NULL);
+
+    wal_log* log = MALLOC(sizeof(*log));
+    if (!log)
+	return NULL;
+    log->dct = dct;
+    log->codec = *codec;
+    log->del_func = del_func;
+    log->group = group;
+    log->unsynced = 0;
+    log->len = 0;
+    log->cap = WAL_BUFFER_SIZE;
+    log->open = 0;
+    log->pending_datum = NULL;
+    log->mod_count = 0;
+    log->buf = MALLOC(log->cap);
+    log->path = MALLOC(strlen(path) + 1);
+    log->fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (!log->buf || !log->path || log->fd < 0)
+	goto fail;
+    strcpy(log->path, path);
+
+    unsigned char magic[WAL_MAGIC_SIZE];
+    const size_t n = read_full(log->fd, magic, sizeof(magic));
+    if (n == 0) {
+	if (!write_full(log->fd, (const unsigned char*)WAL_MAGIC,
+			WAL_MAGIC_SIZE) || fdatasync(log->fd) != 0)
+	    goto fail;
+	log->size = WAL_MAGIC_SIZE;
+    } else if (n < sizeof(magic) ||
+	       memcmp(magic, WAL_MAGIC, WAL_MAGIC_SIZE) != 0 || !replay(log)) {
+	goto fail;
+    }
+    return log;
+
+fail:
+    if (log->fd >= 0)
+	close(log->fd);
+    FREE(log->path);
+    FREE(log->buf);
+    FREE(log);
+    return NULL;
+}
+
+dict*
+wal_dict_new(dict* dct, const char* path, const wal_codec* codec,
+	     dict_delete_func del_func, size_t group)
+{
+    dict* wdct = MALLOC(sizeof(*wdct));
+    if (wdct) {
+	if (!(wdct->_object = wal_log_new(dct, path, codec, del_func,
+					  group))) {
+	    FREE(wdct);
+	    return NULL;
+	}
+	wdct->_vtable = &wal_log_vtable;
+    }
+    return wdct;
+}
+
+size_t
+wal_log_free(wal_log* log)
+{
+    ASSERT(log != NULL);
+
+    wal_log_commit(log);
+    close(log->fd);
+    const size_t count = dict_free(log->dct);
+    FREE(log->path);
+    FREE(log->buf);
+    FREE(log);
+    return count;
+}
+
+wal_log*
+wal_log_clone(wal_log* log, dict_key_datum_clone_func clone_func)
+{
+    ASSERT(log != NULL);
+
+    /* A clone would need a log file of its own. */
+    (void)clone_func;
+    return NULL;
+}
+
+void**
+wal_log_insert(wal_log* log, void* key, bool* inserted)
+{
+    ASSERT(log != NULL);
+
+    if (!pending_flush(log) || !group_commit(log) ||
+	!record_start(log, REC_INSERT, key))
+	return NULL;
+    bool added = false;
+    void** datum = dict_insert(log->dct, key, &added);
+    if (inserted)
+	*inserted = added;
+    if (datum) {
+	log->pending_datum = datum;
+	if (added)
+	    log->mod_count++;
+    } else {
+	log->open = 0;
+    }
+    return datum;
+}
+
+void*
+wal_log_search(wal_log* log, const void* key)
+{
+    ASSERT(log != NULL);
+
+    return dict_search(log->dct, key);
+}
+
+bool
+wal_log_remove(wal_log* log, const void* key)
+{
+    ASSERT(log != NULL);
+
+    /* The key may not outlive the removal, so the record is started first. */
+    if (!pending_flush(log) || !record_start(log, REC_REMOVE, key))
+	return false;
+    if (!dict_remove(log->dct, key)) {
+	log->open = 0;
+	return false;
+    }
+    log->mod_count++;
+    /* The key is gone either way; false reports it may not be durable. */
+    return record_finish(log, NULL, false) && group_commit(log);
+}
+
+size_t
+wal_log_clear(wal_log* log)
+{
+    ASSERT(log != NULL);
+
+    if (!pending_flush(log) || !record_start(log, REC_CLEAR, NULL) ||
+	!record_finish(log, NULL, false))
+	return 0;
+    const size_t count = dict_clear(log->dct);
+    log->mod_count++;
+    group_commit(log);
+    return count;
+}
+
+size_t
+wal_log_traverse(wal_log* log, dict_visit_func visit)
+{
+    ASSERT(log != NULL);
+
+    return dict_traverse(log->dct, visit);
+}
+
+size_t
+wal_log_count(const wal_log* log)
+{
+    ASSERT(log != NULL);
+
+    return dict_count(log->dct);
+}
+
+/* Adds the count of the wrapped dictionary, which may not keep one. */
+static size_t
+wal_log_mod_count(const wal_log* log)
+{
+    ASSERT(log != NULL);
+
+    return log->mod_count + dict_mod_count(log->dct);
+}
+
+bool
+wal_log_verify(const wal_log* log)
+{
+    ASSERT(log != NULL);
+
+    VERIFY(log->len <= log->cap);
+    VERIFY(log->size >= WAL_MAGIC_SIZE);
+    return dict_verify(log->dct);
+}
+
+dict_itor*
+wal_log_itor_new(wal_log* log)
+{
+    ASSERT(log != NULL);
+
+    return dict_itor_new(log->dct);
+}
+
+bool
+wal_log_commit(wal_log* log)
+{
+    ASSERT(log != NULL);
+
+    if (!pending_flush(log) || !buffer_flush(log))
+	return false;
+    if (log->unsynced) {
+	if (fdatasync(log->fd) != 0)
+	    return false;
+	log->unsynced = 0;
+    }
+    return true;
+}
+
+/* Syncs the directory holding |path|, so that a rename into it is durable. */
+static bool
+sync_parent(const char* path)
+{
+    const char* slash = strrchr(path, '/');
+    char* dir = MALLOC(slash ? (size_t)(slash - path) + 2 : 2);
+    if (!dir)
+	return false;
+    if (slash) {
+	memcpy(dir, path, (size_t)(slash - path) + 1);
+	dir[slash - path + 1] = '\0';
+    } else {
+	strcpy(dir, ".");
+    }
+    const int fd = open(dir, O_RDONLY);
+    FREE(dir);
+    if (fd < 0)
+	return false;
+    const bool ok = fsync(fd) == 0;
+    close(fd);
+    return ok;
+}
+
+bool
+wal_log_checkpoint(wal_log* log)
+{
+    ASSERT(log != NULL);
+
+    /* Records not yet written go to the old log first, in case this fails. */
+    if (!pending_flush(log) || !buffer_flush(log))
+	return false;
+
+    const size_t path_len = strlen(log->path);
+    char* tmp = MALLOC(path_len + 5);
+    if (!tmp)
+	return false;
+    memcpy(tmp, log->path, path_len);
+    strcpy(tmp + path_len, ".tmp");
+    const int fd = open(tmp, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+	FREE(tmp);
+	return false;
+    }
+
+    /* Stream the contents into the buffer, writing it out as it fills. */
+    const int old_fd = log->fd;
+    const size_t old_size = log->size;
+    log->fd = fd;
+    log->size = 0;
+    memcpy(log->buf, WAL_MAGIC, WAL_MAGIC_SIZE);
+    log->len = WAL_MAGIC_SIZE;
+    bool ok = true;
+    dict_itor* itor = dict_itor_new(log->dct);
+    if (!itor) {
+	ok = false;
+    } else {
+	for (bool valid = dict_itor_first(itor); ok && valid;
+	     valid = dict_itor_next(itor))
+	    ok = record_start(log, REC_INSERT, dict_itor_key(itor)) &&
+		record_finish(log, *dict_itor_data(itor), true);
+	dict_itor_free(itor);
+    }
+    ok = ok && buffer_flush(log) && fdatasync(fd) == 0 &&
+	rename(tmp, log->path) == 0;
+    if (!ok) {
+	log->fd = old_fd;
+	log->size = old_size;
+	log->len = 0;
+	close(fd);
+	unlink(tmp);
+	FREE(tmp);
+	return false;
+    }
+    FREE(tmp);
+    close(old_fd);
+    log->unsynced = 0;
+    return sync_parent(log->path);
+}
+
+size_t
+wal_log_size(const wal_log* log)
+{
+    ASSERT(log != NULL);
+
+    return log->size + log->len;
+}
@@ -0,0 +1,763 @@
+/*
+ * libdict -- weak AVL (rank-balanced) tree implementation.
+ * cf. [Haeupler, Sen, and Tarjan 2015]
+ *
+ * Copyright (c) 2001-2011, Farooq Mela
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *    This product includes software developed by Farooq Mela.
+ * 4. Neither the name of the Farooq Mela nor the
+ *    names of contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY FAROOQ MELA ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL FAROOQ MELA BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * A weak AVL tree assigns every node an integer rank; missing children have
+ * rank -1. The rank difference of a child is the rank of its parent minus its
+ * own rank. Every rank difference is 1 or 2, and every leaf has rank 0 (that
+ * is, no leaf is a 2,2-node).
+ *
+ * If no deletions are made, the tree is an AVL tree (the rank of a node is its
+ * height), so its height is at most 1.44lg(n). With deletions, the height is
+ * still at most 2lg(n), and never more than that of the AVL tree that would
+ * result from the insertions alone. Rebalancing after an insertion or a
+ * deletion does at most two rotations; the remaining work is promotions and
+ * demotions, which take O(1) amortized time.
+ */
+
+#include "wavl_tree.h"
+
+#include "dict_private.h"
+#include "tree_common.h"
+
+typedef struct wavl_node wavl_node;
+
+struct wavl_node {
+    TREE_NODE_FIELDS(wavl_node);
+    uint8_t		    rank;
+    void*		    datum;	/* Not allocated in a set. */
+};
+
+/* The rank of a node, where a missing node has rank -1. */
+#define RANK(n)		((n) ? (int)(n)->rank : -1)
+
+struct wavl_tree {
+    TREE_FIELDS(wavl_node);
+};
+
+struct wavl_itor {
+    TREE_ITERATOR_FIELDS(wavl_tree, wavl_node);
+};
+
+/* A set's nodes end before the datum. */
+STATIC_ASSERT(set_node_size,
+	      offsetof(wavl_node, datum) + sizeof(void*) == sizeof(wavl_node));
+
+static dict_vtable wavl_tree_vtable = {
+    (dict_inew_func)	    wavl_dict_itor_new,
+    (dict_dfree_func)	    tree_free,
+    (dict_insert_func)	    wavl_tree_insert,
+    (dict_search_func)	    wavl_tree_search,
+    (dict_remove_func)	    wavl_tree_remove,
+    (dict_clear_func)	    tree_clear,
+    (dict_traverse_func)    tree_traverse,
+    (dict_count_func)	    tree_count,
+    (dict_verify_func)	    wavl_tree_verify,
+    (dict_clone_func)	    wavl_tree_clone,
+    (dict_remove_many_func) wavl_tree_remove_many,
+    (dict_remove_if_func)   wavl_tree_remove_if,
+    (dict_mod_count_func)   tree_mod_count,
+    (dict_export_func)	    wavl_tree_export,
+    (dict_export_all_func)  wavl_tree_export_all,
+};
+
+static itor_vtable wavl_tree_itor_vtable = {
+    (dict_ifree_func)	    tree_iterator_free,
+    (dict_valid_func)	    tree_iterator_valid,
+    (dict_invalidate_func)  tree_iterator_invalidate,
+    (dict_next_func)	    tree_iterator_next,
+    (dict_prev_func)	    tree_iterator_prev,
+    (dict_nextn_func)	    tree_iterator_next_n,
+    (dict_prevn_func)	    tree_iterator_prev_n,
+    (dict_first_func)	    tree_iterator_first,
+    (dict_last_func)	    tree_iterator_last,
+    (dict_key_func)	    tree_iterator_key,
+    (dict_data_func)	    tree_iterator_data,
+    (dict_iremove_func)	    NULL,/* wavl_itor_remove not implemented yet */
+    (dict_icompare_func)    NULL,/* wavl_itor_compare not implemented yet */
+    (dict_iseek_func)	    tree_iterator_seek
+};
+
+static unsigned	insert_fixup(wavl_tree* tree, wavl_node* node);
+static unsigned	delete_fixup(wavl_tree* tree, wavl_node* parent,
+			     wavl_node* node);
+static size_t	node_height(const wavl_node* node);
+static size_t	node_mheight(const wavl_node* node);
+static size_t	node_pathlen(const wavl_node* node, size_t level);
+static wavl_node* node_new(wavl_tree* tree, void* key);
+
+wavl_tree*
+wavl_tree_new(dict_compare_func cmp_func, dict_delete_func del_func)
+{
+    wavl_tree* tree = MALLOC(sizeof(*tree));
+    if (tree) {
+	tree->root = NULL;
+	tree->count = 0;
+	tree->cmp_func = cmp_func ? cmp_func : dict_ptr_cmp;
+	tree->keys_only = false;
+	tree->set_datum = NULL;
+	tree->datum_offset = offsetof(wavl_node, datum);
+	tree->del_func = del_func;
+	tree->rotation_count = 0;
+	tree->mod_count = 0;
+    }
+    return tree;
+}
+
+dict*
+wavl_dict_new(dict_compare_func cmp_func, dict_delete_func del_func)
+{
+    dict* dct = MALLOC(sizeof(*dct));
+    if (dct) {
+	if (!(dct->_object = wavl_tree_new(cmp_func, del_func))) {
+	    FREE(dct);
+	    return NULL;
+	}
+	dct->_vtable = &wavl_tree_vtable;
+    }
+    return dct;
+}
+
+wavl_tree*
+wavl_tree_new_set(dict_compare_func cmp_func, dict_delete_func del_func)
+{
+    wavl_tree* tree = wavl_tree_new(cmp_func, del_func);
+    if (tree)
+	tree->keys_only = true;
+    return tree;
+}
+
+dict*
+wavl_dict_new_set(dict_compare_func cmp_func, dict_delete_func del_func)
+{
+    dict* dct = MALLOC(sizeof(*dct));
+    if (dct) {
+	if (!(dct->_object = wavl_tree_new_set(cmp_func, del_func))) {
+	    FREE(dct);
+	    return NULL;
+	}
+	dct->_vtable = &wavl_tree_vtable;
+    }
+    return dct;
+}
+
+size_t
+wavl_tree_free(wavl_tree* tree)
+{
+    ASSERT(tree != NULL);
+
+    return tree_free(tree);
+}
+
+wavl_tree*
+wavl_tree_clone(wavl_tree* tree, dict_key_datum_clone_func clone_func)
+{
+    ASSERT(tree != NULL);
+
+    return tree_clone(tree, sizeof(wavl_tree),
+		      SET_NODE_SIZE(tree, sizeof(wavl_node)), clone_func);
+}
+
+/* Set the balance information of a node of a rebuilt tree. */
+static void
+node_rebuild(void* Tree, void* Node, size_t depth, size_t lheight,
+	     size_t rheight)
+{
+    wavl_node* node = Node;
+    (void)Tree;
+    (void)depth;
+
+    node->rank = (uint8_t)MAX(lheight, rheight);
+}
+
+size_t
+wavl_tree_remove_many(wavl_tree* tree, const void** keys, size_t count)
+{
+    ASSERT(tree != NULL);
+
+    return tree_remove_many(tree, NULL, NULL, keys, count,
+			    (dict_remove_func)wavl_tree_remove, node_rebuild);
+}
+
+size_t
+wavl_tree_remove_if(wavl_tree* tree, dict_predicate_func pred, void* ctx)
+{
+    ASSERT(tree != NULL);
+
+    return tree_remove_if(tree, NULL, NULL, pred, ctx,
+			  (dict_remove_func)wavl_tree_remove, node_rebuild);
+}
+
+size_t
+wavl_tree_export(wavl_tree* tree, void** keys, void** data, size_t max,
+		 dict_export_pos* pos)
+{
+    ASSERT(tree != NULL);
+
+    return tree_export(tree, NULL, keys, data, max, pos);
+}
+
+size_t
+wavl_tree_export_all(wavl_tree* tree, void** keys, void** data,
+		     unsigned threads)
+{
+    ASSERT(tree != NULL);
+
+    return tree_export_all(tree, NULL, keys, data, threads);
+}
+
+size_t
+wavl_tree_clear(wavl_tree* tree)
+{
+    ASSERT(tree != NULL);
+
+    return tree_clear(tree);
+}
+
+void*
+wavl_tree_search(wavl_tree* tree, const void* key)
+{
+    ASSERT(tree != NULL);
+
+    size_t depth = TRACE_DEPTH(search, tree_search_depth(tree, key));
+    void* datum = tree_search(tree, key);
+    TRACE_OP(search, "wavl", tree, key, depth, datum != NULL);
+    return datum;
+}
+
+void**
+wavl_tree_insert(wavl_tree* tree, void* key, bool* inserted)
+{
+    ASSERT(tree != NULL);
+
+    size_t depth = TRACE_DEPTH(insert, tree_search_depth(tree, key));
+
+    int cmp = 0;
+    wavl_node* node = tree->root;
+    wavl_node* parent = NULL;
+    while (node) {
+	cmp = tree->cmp_func(key, node->key);
+	if (cmp < 0)
+	    parent = node, node = node->llink;
+	else if (cmp)
+	    parent = node, node = node->rlink;
+	else {
+	    if (inserted)
+		*inserted = false;
+	    TRACE_OP(insert, "wavl", tree, key, depth, 0);
+	    return NODE_DATUM_SLOT(tree, node);
+	}
+    }
+
+    wavl_node* add = node = node_new(tree, key);
+    if (!node) {
+	TRACE_OP(insert, "wavl", tree, key, depth, -1);
+	return NULL;
+    }
+    if (inserted)
+	*inserted = true;
+    if (!(node->parent = parent)) {
+	ASSERT(tree->count == 0);
+	tree->root = node;
+    } else {
+	if (cmp < 0)
+	    parent->llink = node;
+	else
+	    parent->rlink = node;
+	tree->rotation_count += insert_fixup(tree, node);
+    }
+    ++tree->count;
+    tree->mod_count++;
+    TRACE_OP(insert, "wavl", tree, key, depth, 1);
+    return NODE_DATUM_SLOT(tree, add);
+}
+
+/* Restore the rank rule after |node| has been attached as a new leaf. The only
+ * possible violation is a 0-child: promote while its parent is a 0,1-node,
+ * then finish with a single or double rotation if the parent is a 0,2-node. */
+static unsigned
+insert_fixup(wavl_tree* tree, wavl_node* node)
+{
+    wavl_node* parent = node->parent;
+    while (parent && parent->rank == node->rank) {
+	const bool left = (parent->llink == node);
+	wavl_node* sibling = left ? parent->rlink : parent->llink;
+	if (parent->rank - RANK(sibling) == 1) {
+	    /* 0,1-node: promote and move the violation up. */
+	    ++parent->rank;
+	    node = parent;
+	    parent = node->parent;
+	    continue;
+	}
+
+	/* 0,2-node: rotate. */
+	ASSERT(parent->rank - RANK(sibling) == 2);
+	wavl_node* inner = left ? node->rlink : node->llink;
+	if (RANK(inner) == node->rank - 1) {
+	    /* The inner child is a 1-child: rotate it up twice. */
+	    if (left) {
+		tree_node_rot_left(tree, node);
+		tree_node_rot_right(tree, parent);
+	    } else {
+		tree_node_rot_right(tree, node);
+		tree_node_rot_left(tree, parent);
+	    }
+	    ++inner->rank;
+	    --node->rank;
+	    --parent->rank;
+	    return 2;
+	}
+	if (left)
+	    tree_node_rot_right(tree, parent);
+	else
+	    tree_node_rot_left(tree, parent);
+	--parent->rank;
+	return 1;
+    }
+    return 0;
+}
+
+bool
+wavl_tree_remove(wavl_tree* tree, const void* key)
+{
+    ASSERT(tree != NULL);
+
+    size_t depth = TRACE_DEPTH(remove, tree_search_depth(tree, key));
+
+    wavl_node* node = tree->root;
+    while (node) {
+	int cmp = tree->cmp_func(key, node->key);
+	if (cmp < 0)
+	    node = node->llink;
+	else if (cmp)
+	    node = node->rlink;
+	else
+	    break;
+    }
+    if (!node) {
+	TRACE_OP(remove, "wavl", tree, key, depth, 0);
+	return false;
+    }
+
+    if (node->llink && node->rlink) {
+	wavl_node* out = tree_node_min(node->rlink);
+	void* tmp;
+	SWAP(node->key, out->key, tmp);
+	if (!tree->keys_only)
+	    SWAP(node->datum, out->datum, tmp);
+	node = out;
+    }
+
+    wavl_node* child = node->llink ? node->llink : node->rlink;
+    wavl_node* parent = node->parent;
+    if (child)
+	child->parent = parent;
+    if (parent) {
+	if (parent->llink == node)
+	    parent->llink = child;
+	else
+	    parent->rlink = child;
+    } else {
+	tree->root = child;
+    }
+    if (tree->del_func)
+	tree->del_func(node->key, NODE_DEL_DATUM(tree, node));
+    FREE(node);
+    if (parent)
+	tree->rotation_count += delete_fixup(tree, parent, child);
+    tree->count--;
+    tree->mod_count++;
+    TRACE_OP(remove, "wavl", tree, key, depth, 1);
+    return true;
+}
+
+/* Restore the rank rule after |node| (possibly NULL) has replaced a removed
+ * child of |parent|. Either |parent| is now a 2,2-leaf, or |node| may be a
+ * 3-child. Demote while the sibling is a 2-child or a 2,2-node, then finish
+ * with a single or double rotation. */
+static unsigned
+delete_fixup(wavl_tree* tree, wavl_node* parent, wavl_node* node)
+{
+    ASSERT(parent != NULL);
+
+    if (!parent->llink && !parent->rlink && parent->rank == 1) {
+	/* A 2,2-leaf: demote it, which may make it a 3-child. */
+	parent->rank = 0;
+	node = parent;
+	parent = node->parent;
+    }
+
+    while (parent && parent->rank - RANK(node) == 3) {
+	const bool left = (parent->llink == node);
+	wavl_node* sibling = left ? parent->rlink : parent->llink;
+	ASSERT(sibling != NULL);
+	if (parent->rank - sibling->rank == 2) {
+	    /* Sibling is a 2-child: demote and move the violation up. */
+	    --parent->rank;
+	} else if (sibling->rank - RANK(sibling->llink) == 2 &&
+		   sibling->rank - RANK(sibling->rlink) == 2) {
+	    /* Sibling is a 2,2-node: demote both. */
+	    --sibling->rank;
+	    --parent->rank;
+	} else {
+	    /* Rotate. */
+	    wavl_node* outer = left ? sibling->rlink : sibling->llink;
+	    wavl_node* inner = left ? sibling->llink : sibling->rlink;
+	    if (sibling->rank - RANK(outer) == 1) {
+		if (left)
+		    tree_node_rot_left(tree, parent);
+		else
+		    tree_node_rot_right(tree, parent);
+		++sibling->rank;
+		--parent->rank;
+		if (!parent->llink && !parent->rlink)
+		    --parent->rank;
+		return 1;
+	    }
+	    ASSERT(inner != NULL);
+	    if (left) {
+		tree_node_rot_right(tree, sibling);
+		tree_node_rot_left(tree, parent);
+	    } else {
+		tree_node_rot_left(tree, sibling);
+		tree_node_rot_right(tree, parent);
+	    }
+	    inner->rank += 2;
+	    --sibling->rank;
+	    parent->rank -= 2;
+	    return 2;
+	}
+	node = parent;
+	parent = node->parent;
+    }
+    return 0;
+}
+
+const void*
+wavl_tree_min(const wavl_tree* tree)
+{
+    ASSERT(tree != NULL);
+
+    return tree_min(tree);
+}
+
+const void*
+wavl_tree_max(const wavl_tree* tree)
+{
+    ASSERT(tree != NULL);
+
+    return tree_max(tree);
+}
+
+size_t
+wavl_tree_traverse(wavl_tree* tree, dict_visit_func visit)
+{
+    ASSERT(tree != NULL);
+
+    return tree_traverse(tree, visit);
+}
+
+size_t
+wavl_tree_count(const wavl_tree* tree)
+{
+    ASSERT(tree != NULL);
+
+    return tree_count(tree);
+}
+
+size_t
+wavl_tree_height(const wavl_tree* tree)
+{
+    ASSERT(tree != NULL);
+
+    return tree->root ? node_height(tree->root) : 0;
+}
+
+size_t
+wavl_tree_mheight(const wavl_tree* tree)
+{
+    ASSERT(tree != NULL);
+
+    return tree->root ? node_mheight(tree->root) : 0;
+}
+
+size_t
+wavl_tree_pathlen(const wavl_tree* tree)
+{
+    ASSERT(tree != NULL);
+
+    return tree->root ? node_pathlen(tree->root, 1) : 0;
+}
+
+static wavl_node*
+node_new(wavl_tree* tree, void* key)
+{
+    wavl_node* node = MALLOC(SET_NODE_SIZE(tree, sizeof(*node)));
+    if (node) {
+	node->key = key;
+	if (!tree->keys_only)
+	    node->datum = NULL;
+	node->parent = NULL;
+	node->llink = NULL;
+	node->rlink = NULL;
+	node->rank = 0;
+    }
+    return node;
+}
+
+static size_t
+node_height(const wavl_node* node)
+{
+    ASSERT(node != NULL);
+
+    size_t l = node->llink ? node_height(node->llink) + 1 : 0;
+    size_t r = node->rlink ? node_height(node->rlink) + 1 : 0;
+    return MAX(l, r);
+}
+
+static size_t
+node_mheight(const wavl_node* node)
+{
+    ASSERT(node != NULL);
+
+    size_t l = node->llink ? node_mheight(node->llink) + 1 : 0;
+    size_t r = node->rlink ? node_mheight(node->rlink) + 1 : 0;
+    return MIN(l, r);
+}
+
+static size_t
+node_pathlen(const wavl_node* node, size_t level)
+{
+    ASSERT(node != NULL);
+
+    size_t n = 0;
+    if (node->llink)
+	n += level + node_pathlen(node->llink, level + 1);
+    if (node->rlink)
+	n += level + node_pathlen(node->rlink, level + 1);
+    return n;
+}
+
+static bool
+node_verify(const wavl_tree* tree, const wavl_node* parent,
+	    const wavl_node* node)
+{
+    ASSERT(tree != NULL);
+
+    if (!parent) {
+	VERIFY(tree->root == node);
+    } else {
+	VERIFY(parent->llink == node || parent->rlink == node);
+	/* Every rank difference is 1 or 2. */
+	VERIFY(parent->rank - RANK(node) >= 1);
+	VERIFY(parent->rank - RANK(node) <= 2);
+    }
+    if (node) {
+	VERIFY(node->parent == parent);
+	if (!node->llink && !node->rlink) {
+	    /* Every leaf has rank 0. */
+	    VERIFY(node->rank == 0);
+	}
+	if (!node_verify(tree, node, node->llink) ||
+	    !node_verify(tree, node, node->rlink))
+	    return false;
+    }
+    return true;
+}
+
+bool
+wavl_tree_verify(const wavl_tree* tree)
+{
+    ASSERT(tree != NULL);
+
+    if (tree->root) {
+	VERIFY(tree->count > 0);
+    } else {
+	VERIFY(tree->count == 0);
+    }
+    return node_verify(tree, NULL, tree->root);
+}
+
+wavl_itor*
+wavl_itor_new(wavl_tree* tree)
+{
+    ASSERT(tree != NULL);
+
+    wavl_itor* itor = MALLOC(sizeof(*itor));
+    if (itor) {
+	itor->tree = tree;
+	itor->node = NULL;
+    }
+    return itor;
+}
+
+dict_itor*
+wavl_dict_itor_new(wavl_tree* tree)
+{
+    ASSERT(tree != NULL);
+
+    dict_itor* itor = MALLOC(sizeof(*itor));
+    if (itor) {
+	if (!(itor->_itor = wavl_itor_new(tree))) {
+	    FREE(itor);
+	    return NULL;
+	}
+	itor->_vtable = &wavl_tree_itor_vtable;
+    }
+    return itor;
+}
+
+void
+wavl_itor_free(wavl_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    FREE(itor);
+}
+
+bool
+wavl_itor_valid(const wavl_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    return itor->node != NULL;
+}
+
+void
+wavl_itor_invalidate(wavl_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    itor->node = NULL;
+}
+
+bool
+wavl_itor_next(wavl_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    if (!itor->node)
+	wavl_itor_first(itor);
+    else
+	itor->node = tree_node_next(itor->node);
+    return itor->node != NULL;
+}
+
+bool
+wavl_itor_prev(wavl_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    if (!itor->node)
+	wavl_itor_last(itor);
+    else
+	itor->node = tree_node_prev(itor->node);
+    return itor->node != NULL;
+}
+
+bool
+wavl_itor_nextn(wavl_itor* itor, size_t count)
+{
+    ASSERT(itor != NULL);
+
+    while (count--)
+	if (!wavl_itor_next(itor))
+	    return false;
+    return itor->node != NULL;
+}
+
+bool
+wavl_itor_prevn(wavl_itor* itor, size_t count)
+{
+    ASSERT(itor != NULL);
+
+    while (count--)
+	if (!wavl_itor_prev(itor))
+	    return false;
+    return itor->node != NULL;
+}
+
+bool
+wavl_itor_first(wavl_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    itor->node = itor->tree->root ? tree_node_min(itor->tree->root) : NULL;
+    return itor->node != NULL;
+}
+
+bool
+wavl_itor_last(wavl_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    itor->node = itor->tree->root ? tree_node_max(itor->tree->root) : NULL;
+    return itor->node != NULL;
+}
+
+bool
+wavl_itor_search(wavl_itor* itor, const void* key)
+{
+    ASSERT(itor != NULL);
+
+    wavl_node* node = itor->tree->root;
+    while (node) {
+	int cmp = itor->tree->cmp_func(key, node->key);
+	if (cmp < 0)
+	    node = node->llink;
+	else if (cmp)
+	    node = node->rlink;
+	else {
+	    itor->node = node;
+	    return true;
+	}
+    }
+    itor->node = NULL;
+    return false;
+}
+
+const void*
+wavl_itor_key(const wavl_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    return itor->node ? itor->node->key : NULL;
+}
+
+void**
+wavl_itor_data(wavl_itor* itor)
+{
+    ASSERT(itor != NULL);
+
+    return itor->node ? NODE_DATUM_SLOT(itor->tree, itor->node) : NULL;
+}
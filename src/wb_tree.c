@@ -34,6 +34,7 @@
 #include "wb_tree.h"
 
 #include <limits.h>
+#include <string.h>
 #include "dict_private.h"
 #include "tree_common.h"
 
@@ -66,29 +67,40 @@ typedef struct wb_node wb_node;
 struct wb_node {
     TREE_NODE_FIELDS(wb_node);
     uint32_t		    weight;
+    void*		    datum;	/* Not allocated in a set. */
 };
 
 #define WEIGHT(n)	((n) ? (n)->weight : 1U)
 
 struct wb_tree {
     TREE_FIELDS(wb_node);
+    TREE_AGGREGATE_FIELDS(wb_node);
 };
 
 struct wb_itor {
     TREE_ITERATOR_FIELDS(wb_tree, wb_node);
 };
 
+/* A set's nodes end before the datum. */
+STATIC_ASSERT(set_node_size,
+	      offsetof(wb_node, datum) + sizeof(void*) == sizeof(wb_node));
+
 static dict_vtable wb_tree_vtable = {
     (dict_inew_func)	    wb_dict_itor_new,
-    (dict_dfree_func)	    tree_free,
+    (dict_dfree_func)	    wb_tree_free,
     (dict_insert_func)	    wb_tree_insert,
-    (dict_search_func)	    tree_search,
+    (dict_search_func)	    wb_tree_search,
     (dict_remove_func)	    wb_tree_remove,
-    (dict_clear_func)	    tree_clear,
+    (dict_clear_func)	    wb_tree_clear,
     (dict_traverse_func)    tree_traverse,
     (dict_count_func)	    tree_count,
     (dict_verify_func)	    wb_tree_verify,
     (dict_clone_func)	    wb_tree_clone,
+    (dict_remove_many_func) wb_tree_remove_many,
+    (dict_remove_if_func)   wb_tree_remove_if,
+    (dict_mod_count_func)   tree_mod_count,
+    (dict_export_func)	    wb_tree_export,
+    (dict_export_all_func)  wb_tree_export_all,
 };
 
 static itor_vtable wb_tree_itor_vtable = {
@@ -104,13 +116,14 @@ static itor_vtable wb_tree_itor_vtable = {
     (dict_key_func)	    tree_iterator_key,
     (dict_data_func)	    tree_iterator_data,
     (dict_iremove_func)	    NULL,/* wb_itor_remove not implemented yet */
-    (dict_icompare_func)    NULL /* wb_itor_compare not implemented yet */
+    (dict_icompare_func)    NULL,/* wb_itor_compare not implemented yet */
+    (dict_iseek_func)	    tree_iterator_seek
 };
 
 static size_t	node_height(const wb_node* node);
 static size_t	node_mheight(const wb_node* node);
 static size_t	node_pathlen(const wb_node* node, size_t level);
-static wb_node*	node_new(void* key);
+static wb_node*	node_new(wb_tree* tree, void* key);
 
 wb_tree*
 wb_tree_new(dict_compare_func cmp_func, dict_delete_func del_func)
@@ -120,8 +133,17 @@ wb_tree_new(dict_compare_func cmp_func, dict_delete_func del_func)
 	tree->root = NULL;
 	tree->count = 0;
 	tree->cmp_func = cmp_func ? cmp_func : dict_ptr_cmp;
+	tree->keys_only = false;
+	tree->set_datum = NULL;
+	tree->datum_offset = offsetof(wb_node, datum);
 	tree->del_func = del_func;
 	tree->rotation_count = 0;
+	tree->mod_count = 0;
+	tree->agg_func = NULL;
+	tree->agg_update = NULL;
+	tree->agg_offset = 0;
+	tree->agg_size = 0;
+	tree->agg_stale = NULL;
     }
     return tree;
 }
@@ -140,12 +162,35 @@ wb_dict_new(dict_compare_func cmp_func, dict_delete_func del_func)
     return dct;
 }
 
+wb_tree*
+wb_tree_new_set(dict_compare_func cmp_func, dict_delete_func del_func)
+{
+    wb_tree* tree = wb_tree_new(cmp_func, del_func);
+    if (tree)
+	tree->keys_only = true;
+    return tree;
+}
+
+dict*
+wb_dict_new_set(dict_compare_func cmp_func, dict_delete_func del_func)
+{
+    dict* dct = MALLOC(sizeof(*dct));
+    if (dct) {
+	if (!(dct->_object = wb_tree_new_set(cmp_func, del_func))) {
+	    FREE(dct);
+	    return NULL;
+	}
+	dct->_vtable = &wb_tree_vtable;
+    }
+    return dct;
+}
+
 size_t
 wb_tree_free(wb_tree* tree)
 {
     ASSERT(tree != NULL);
 
-    size_t count = tree_clear(tree);
+    size_t count = wb_tree_clear(tree);
     FREE(tree);
     return count;
 }
@@ -155,7 +200,13 @@ wb_tree_clone(wb_tree* tree, dict_key_datum_clone_func clone_func)
 {
     ASSERT(tree != NULL);
 
-    return tree_clone(tree, sizeof(wb_tree), sizeof(wb_node), clone_func);
+    tree_aggregate_flush(tree, NULL);
+    wb_tree* clone = tree_clone(tree, sizeof(wb_tree),
+				tree_node_alloc_size(tree, sizeof(wb_node)),
+				clone_func);
+    if (clone && clone_func)
+	tree_aggregate_rebuild(clone, NULL);
+    return clone;
 }
 
 void*
@@ -163,7 +214,10 @@ wb_tree_search(wb_tree* tree, const void* key)
 {
     ASSERT(tree != NULL);
 
-    return tree_search(tree, key);
+    size_t depth = TRACE_DEPTH(search, tree_search_depth(tree, key));
+    void* datum = tree_search(tree, key);
+    TRACE_OP(search, "wb", tree, key, depth, datum != NULL);
+    return datum;
 }
 
 static inline unsigned
@@ -177,6 +231,8 @@ fixup(wb_tree* tree, wb_node* n) {
 	if (WEIGHT(nrl) * 1000U < nr->weight * 586U) {	/* LL */
 	    /* Rotate |n| left. */
 	    tree_node_rot_left(tree, n);
+	    tree_node_aggregate(tree, NULL, n);
+	    tree_node_aggregate(tree, NULL, nr);
 	    nr->weight = (n->weight = WEIGHT(n->llink) + WEIGHT(n->rlink)) +
 			 WEIGHT(nr->rlink);
 	    rotations += 1;
@@ -207,6 +263,9 @@ fixup(wb_tree* tree, wb_node* n) {
 
 	    nrl->weight = (n->weight = WEIGHT(n->llink) + WEIGHT(a)) +
 			  (nr->weight = WEIGHT(b) + WEIGHT(nr->rlink));
+	    tree_node_aggregate(tree, NULL, n);
+	    tree_node_aggregate(tree, NULL, nr);
+	    tree_node_aggregate(tree, NULL, nrl);
 	    rotations += 2;
 	}
     } else if (weight * 1000U > n->weight * 707U) {
@@ -215,6 +274,8 @@ fixup(wb_tree* tree, wb_node* n) {
 	weight = WEIGHT(nl->llink);
 	if (weight * 1000U > nl->weight * 414U) {	/* RR */
 	    tree_node_rot_right(tree, n);
+	    tree_node_aggregate(tree, NULL, n);
+	    tree_node_aggregate(tree, NULL, nl);
 
 	    n->weight = WEIGHT(n->llink) + WEIGHT(n->rlink);
 	    nl->weight = weight + n->weight;
@@ -247,6 +308,9 @@ fixup(wb_tree* tree, wb_node* n) {
 
 	    nlr->weight = (n->weight = WEIGHT(b) + WEIGHT(n->rlink)) +
 			  (nl->weight = WEIGHT(nl->llink) + WEIGHT(a));
+	    tree_node_aggregate(tree, NULL, n);
+	    tree_node_aggregate(tree, NULL, nl);
+	    tree_node_aggregate(tree, NULL, nlr);
 	    rotations += 2;
 	}
     }
@@ -260,6 +324,9 @@ wb_tree_insert(wb_tree* tree, void* key, bool* inserted)
 
     ASSERT(tree != NULL);
 
+    size_t depth = TRACE_DEPTH(insert, tree_search_depth(tree, key));
+
+    tree_aggregate_flush(tree, NULL);
     wb_node* node = tree->root;
     wb_node* parent = NULL;
     while (node) {
@@ -271,13 +338,18 @@ wb_tree_insert(wb_tree* tree, void* key, bool* inserted)
 	else {
 	    if (inserted)
 		*inserted = false;
-	    return &node->datum;
+	    if (tree->agg_func)
+		tree->agg_stale = node;
+	    TRACE_OP(insert, "wb", tree, key, depth, 0);
+	    return NODE_DATUM_SLOT(tree, node);
 	}
     }
 
-    wb_node *add = node = node_new(key);
-    if (!add)
+    wb_node *add = node = node_new(tree, key);
+    if (!add) {
+	TRACE_OP(insert, "wb", tree, key, depth, -1);
 	return NULL;
+    }
     if (inserted)
 	*inserted = true;
     if (!(node->parent = parent)) {
@@ -299,7 +371,11 @@ wb_tree_insert(wb_tree* tree, void* key, bool* inserted)
 	tree->rotation_count += rotations;
     }
     ++tree->count;
-    return &add->datum;
+    tree->mod_count++;
+    if (tree->agg_func)
+	tree->agg_stale = add;
+    TRACE_OP(insert, "wb", tree, key, depth, 1);
+    return NODE_DATUM_SLOT(tree, add);
 }
 
 bool
@@ -308,6 +384,9 @@ wb_tree_remove(wb_tree* tree, const void* key)
     ASSERT(tree != NULL);
     ASSERT(key != NULL);
 
+    size_t depth = TRACE_DEPTH(remove, tree_search_depth(tree, key));
+
+    tree_aggregate_flush(tree, NULL);
     wb_node* node = tree->root;
     while (node) {
 	int cmp = tree->cmp_func(key, node->key);
@@ -329,7 +408,8 @@ wb_tree_remove(wb_tree* tree, const void* key)
 		}
 		void* tmp;
 		SWAP(node->key, out->key, tmp);
-		SWAP(node->datum, out->datum, tmp);
+		if (!tree->keys_only)
+		    SWAP(node->datum, out->datum, tmp);
 		node = out;
 	    }
 	    ASSERT(!node->llink || !node->rlink);
@@ -348,9 +428,11 @@ wb_tree_remove(wb_tree* tree, const void* key)
 		tree->root = child;
 	    }
 	    if (tree->del_func)
-		tree->del_func(node->key, node->datum);
+		tree->del_func(node->key, NODE_DEL_DATUM(tree, node));
 	    FREE(node);
 	    --tree->count;
+	    tree->mod_count++;
+	    tree_node_aggregate_path(tree, NULL, parent);
 	    /* Now move up the tree, decrementing weights. */
 	    unsigned rotations = 0;
 	    while (parent) {
@@ -360,17 +442,73 @@ wb_tree_remove(wb_tree* tree, const void* key)
 		parent = up;
 	    }
 	    tree->rotation_count += rotations;
+	    TRACE_OP(remove, "wb", tree, key, depth, 1);
 	    return true;
 	}
     }
+    TRACE_OP(remove, "wb", tree, key, depth, 0);
     return false;
 }
 
+/* Set the balance information of a node of a rebuilt tree. */
+static void
+node_rebuild(void* Tree, void* Node, size_t depth, size_t lheight,
+	     size_t rheight)
+{
+    wb_tree* tree = Tree;
+    wb_node* node = Node;
+    (void)depth;
+    (void)lheight;
+    (void)rheight;
+
+    node->weight = WEIGHT(node->llink) + WEIGHT(node->rlink);
+    if (tree->agg_func)
+	tree_node_aggregate(tree, NULL, node);
+}
+
+size_t
+wb_tree_remove_many(wb_tree* tree, const void** keys, size_t count)
+{
+    ASSERT(tree != NULL);
+
+    tree_aggregate_flush(tree, NULL);
+    return tree_remove_many(tree, NULL, NULL, keys, count,
+			    (dict_remove_func)wb_tree_remove, node_rebuild);
+}
+
+size_t
+wb_tree_remove_if(wb_tree* tree, dict_predicate_func pred, void* ctx)
+{
+    ASSERT(tree != NULL);
+
+    tree_aggregate_flush(tree, NULL);
+    return tree_remove_if(tree, NULL, NULL, pred, ctx,
+			  (dict_remove_func)wb_tree_remove, node_rebuild);
+}
+
+size_t
+wb_tree_export(wb_tree* tree, void** keys, void** data, size_t max,
+	       dict_export_pos* pos)
+{
+    ASSERT(tree != NULL);
+
+    return tree_export(tree, NULL, keys, data, max, pos);
+}
+
+size_t
+wb_tree_export_all(wb_tree* tree, void** keys, void** data, unsigned threads)
+{
+    ASSERT(tree != NULL);
+
+    return tree_export_all(tree, NULL, keys, data, threads);
+}
+
 size_t
 wb_tree_clear(wb_tree* tree)
 {
     ASSERT(tree != NULL);
 
+    tree->agg_stale = NULL;
     return tree_clear(tree);
 }
 
@@ -413,7 +551,7 @@ wb_tree_traverse(wb_tree* tree, dict_visit_func visit)
     wb_node* node = tree_node_min(tree->root);
     while (node) {
 	++count;
-	if (!visit(node->key, node->datum))
+	if (!visit(node->key, NODE_DATUM(tree, node)))
 	    break;
 	node = tree_node_next(node);
     }
@@ -453,16 +591,20 @@ wb_tree_pathlen(const wb_tree* tree)
 }
 
 static wb_node*
-node_new(void* key)
+node_new(wb_tree* tree, void* key)
 {
-    wb_node* node = MALLOC(sizeof(*node));
+    wb_node* node = MALLOC(tree_node_alloc_size(tree, sizeof(*node)));
     if (node) {
+	if (tree->agg_func)
+	    memset((char*)node + tree->agg_offset, 0, tree->agg_size);
 	node->key = key;
-	node->datum = NULL;
+	if (!tree->keys_only)
+	    node->datum = NULL;
 	node->parent = NULL;
 	node->llink = NULL;
 	node->rlink = NULL;
 	node->weight = 2;
+	tree_node_aggregate(tree, NULL, node);
     }
     return node;
 }
@@ -562,7 +704,34 @@ wb_tree_verify(const wb_tree* tree)
     } else {
 	VERIFY(tree->count == 0);
     }
-    return node_verify(tree, NULL, tree->root);
+    return node_verify(tree, NULL, tree->root) &&
+	   tree_aggregate_verify(tree, NULL);
+}
+
+bool
+wb_tree_set_aggregate(wb_tree* tree, dict_aggregate_func agg_func,
+		      size_t agg_size)
+{
+    ASSERT(tree != NULL);
+
+    return tree_set_aggregate(tree, sizeof(wb_node), agg_func, agg_size);
+}
+
+bool
+wb_tree_update_aggregate(wb_tree* tree, const void* key)
+{
+    ASSERT(tree != NULL);
+
+    return tree_aggregate_update(tree, NULL, key);
+}
+
+bool
+wb_tree_range_aggregate(wb_tree* tree, const void* lo, const void* hi,
+			void* result)
+{
+    ASSERT(tree != NULL);
+
+    return tree_range_aggregate(tree, NULL, lo, hi, result);
 }
 
 void
@@ -698,5 +867,5 @@ wb_itor_data(wb_itor* itor)
 {
     ASSERT(itor != NULL);
 
-    return itor->node ? &itor->node->datum : NULL;
+    return itor->node ? NODE_DATUM_SLOT(itor->tree, itor->node) : NULL;
 }
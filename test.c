@@ -56,14 +56,18 @@ main(int argc, char **argv)
     if (argc != 3) {
 	fprintf(stderr, "usage: %s [type] [input]\n", appname);
 	fprintf(stderr, "type: specifies the dictionary type:\n");
+	fprintf(stderr, "   g: scapegoat tree\n");
 	fprintf(stderr, "   h: height-balanced tree\n");
 	fprintf(stderr, "   p: path-reduction tree\n");
 	fprintf(stderr, "   r: red-black tree\n");
 	fprintf(stderr, "   t: treap\n");
 	fprintf(stderr, "   s: splay tree\n");
+	fprintf(stderr, "   v: weak AVL tree\n");
 	fprintf(stderr, "   w: weight-balanced tree\n");
 	fprintf(stderr, "   S: skiplist\n");
 	fprintf(stderr, "   H: hashtable\n");
+	fprintf(stderr, "   L: log-structured merge tree\n");
+	fprintf(stderr, "   A: adaptive map\n");
 	fprintf(stderr, "input: text file consisting of newline-separated keys"
 		"\n");
 	exit(EXIT_FAILURE);
@@ -80,6 +84,10 @@ main(int argc, char **argv)
     const char type = argv[1][0];
     const char *container_name = NULL;
     switch (type) {
+	case 'g':
+	    container_name = "sg";
+	    dct = sg_dict_new(cmp_func, key_str_free);
+	    break;
 	case 'h':
 	    container_name = "hb";
 	    dct = hb_dict_new(cmp_func, key_str_free);
@@ -104,6 +112,10 @@ main(int argc, char **argv)
 	    container_name = "sk";
 	    dct = skiplist_dict_new(cmp_func, key_str_free, 12);
 	    break;
+	case 'v':
+	    container_name = "wavl";
+	    dct = wavl_dict_new(cmp_func, key_str_free);
+	    break;
 	case 'w':
 	    container_name = "wb";
 	    dct = wb_dict_new(cmp_func, key_str_free);
@@ -112,8 +124,16 @@ main(int argc, char **argv)
 	    container_name = "ht";
 	    dct = hashtable_dict_new(cmp_func, hash_func, key_str_free, HSIZE);
 	    break;
+	case 'L':
+	    container_name = "lsm";
+	    dct = lsmtree_dict_new(cmp_func, hash_func, key_str_free, HSIZE);
+	    break;
+	case 'A':
+	    container_name = "ad";
+	    dct = adaptive_dict_new(cmp_func, hash_func, key_str_free);
+	    break;
 	default:
-	    quit("type must be one of h, p, r, t, s, w or H");
+	    quit("type must be one of g, h, p, r, t, s, S, v, w, H, L or A");
     }
 
     if (!dct)
@@ -161,13 +181,15 @@ main(int argc, char **argv)
     timer_end(&start, &end, &total);
     printf("    %s container: %.02fkB\n", container_name, malloced_save * 1e-3);
     printf("       %s memory: %.02fkB\n", container_name, malloced * 1e-3);
+    printf("      %s per key: %.02fB\n", container_name,
+	   (double)(malloced - malloced_save) / nwords);
     printf("       %s insert: %.03f s (%9zu cmp, %9zu hash)\n",
 	   container_name,
 	   (end.ru_utime.tv_sec * 1000000 + end.ru_utime.tv_usec) * 1e-6,
 	   comp_count, hash_count);
     total_comp += comp_count; comp_count = 0;
     total_hash += hash_count; hash_count = 0;
-    if (type != 'H' && type != 'S') {
+    if (type != 'H' && type != 'S' && type != 'L' && type != 'A') {
 	tree_base *tree = dict_private(dct);
 	printf("insert rotations: %zu\n", tree->rotation_count);
 	total_rotations += tree->rotation_count;
@@ -231,7 +253,7 @@ main(int argc, char **argv)
 	   comp_count, hash_count);
     total_comp += comp_count; comp_count = 0;
     total_hash += hash_count; hash_count = 0;
-    if (type != 'H' && type != 'S') {
+    if (type != 'H' && type != 'S' && type != 'L' && type != 'A') {
 	tree_base *tree = dict_private(dct);
 	printf("search rotations: %zu\n", tree->rotation_count);
 	total_rotations += tree->rotation_count;
@@ -267,7 +289,7 @@ main(int argc, char **argv)
 	   comp_count, hash_count);
     total_comp += comp_count; comp_count = 0;
     total_hash += hash_count; hash_count = 0;
-    if (type != 'H' && type != 'S') {
+    if (type != 'H' && type != 'S' && type != 'L' && type != 'A') {
 	tree_base *tree = dict_private(dct);
 	printf("remove rotations: %zu\n", tree->rotation_count);
 	total_rotations += tree->rotation_count;
@@ -286,7 +308,7 @@ main(int argc, char **argv)
 	   (total.tv_sec * 1000000 + total.tv_usec) * 1e-6,
 	   total_comp, total_hash);
 
-    if (type != 'H' && type != 'S') {
+    if (type != 'H' && type != 'S' && type != 'L' && type != 'A') {
 	printf(" total rotations: %zu\n", total_rotations);
     }
 
@@ -1,6 +1,8 @@
 /* unit_tests.c
  * Copyright (C) 2012 Farooq Mela. All rights reserved. */
 
+#define _POSIX_C_SOURCE 200809L	/* For fork(). */
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -8,41 +10,109 @@
 #include <limits.h>
 #include <float.h>
 #include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <pthread.h>
 
 #include <CUnit/CUnit.h>
 #include <CUnit/Basic.h>
 
 #include "dict.h"
+#include "dict_inline.h"
 
 #define TEST_FUNC(func) { #func, func }
 
+/* Whether the library has static probes, as dict_private.h decides. */
+#if !defined(DICT_NO_USDT) && defined(__has_include)
+# if __has_include(<sys/sdt.h>)
+#  define TEST_USDT 1
+extern volatile unsigned short libdict_search_semaphore;
+# endif
+#endif
+
 struct key_info {
     char *key, *value, *alt;
 };
 
 void test_basic(dict *dct, const struct key_info *keys, const unsigned nkeys);
+void test_basic_adaptive();
 void test_basic_hashtable_1bucket();
 void test_basic_hashtable_nbuckets();
 void test_basic_height_balanced_tree();
+void test_basic_lsmtree();
 void test_basic_path_reduction_tree();
 void test_basic_red_black_tree();
+void test_basic_scapegoat_tree();
 void test_basic_skiplist();
+void test_basic_smallmap();
 void test_basic_splay_tree();
 void test_basic_treap();
+void test_basic_weak_avl_tree();
 void test_basic_weight_balanced_tree();
 void test_version_string();
+void test_range_aggregate();
+void test_interval_tree();
+void test_db_tree();
+void test_wal_log();
+void test_dict_arena();
+void test_tree_relayout();
+void test_adaptive_workload();
+void test_inline_api();
+void test_bulk_remove();
+void test_rb_relaxed();
+void test_skiplist_snapshot();
+void test_dict_join();
+void test_pgm_index();
+void test_kary_index();
+void test_hashtable_frozen();
+void test_shm_map();
+void test_sampler();
+void test_search_probe();
+void test_op_trace();
+void test_dict_cursor();
+void test_dict_export();
+void test_dict_set();
+void test_lsmtree_merge();
 
 CU_TestInfo basic_tests[] = {
+    TEST_FUNC(test_basic_adaptive),
     TEST_FUNC(test_basic_hashtable_1bucket),
     TEST_FUNC(test_basic_hashtable_nbuckets),
     TEST_FUNC(test_basic_height_balanced_tree),
+    TEST_FUNC(test_basic_lsmtree),
     TEST_FUNC(test_basic_path_reduction_tree),
     TEST_FUNC(test_basic_red_black_tree),
+    TEST_FUNC(test_basic_scapegoat_tree),
     TEST_FUNC(test_basic_skiplist),
+    TEST_FUNC(test_basic_smallmap),
     TEST_FUNC(test_basic_splay_tree),
     TEST_FUNC(test_basic_treap),
+    TEST_FUNC(test_basic_weak_avl_tree),
     TEST_FUNC(test_basic_weight_balanced_tree),
     TEST_FUNC(test_version_string),
+    TEST_FUNC(test_range_aggregate),
+    TEST_FUNC(test_interval_tree),
+    TEST_FUNC(test_db_tree),
+    TEST_FUNC(test_wal_log),
+    TEST_FUNC(test_dict_arena),
+    TEST_FUNC(test_tree_relayout),
+    TEST_FUNC(test_adaptive_workload),
+    TEST_FUNC(test_inline_api),
+    TEST_FUNC(test_bulk_remove),
+    TEST_FUNC(test_rb_relaxed),
+    TEST_FUNC(test_skiplist_snapshot),
+    TEST_FUNC(test_dict_join),
+    TEST_FUNC(test_pgm_index),
+    TEST_FUNC(test_kary_index),
+    TEST_FUNC(test_hashtable_frozen),
+    TEST_FUNC(test_shm_map),
+    TEST_FUNC(test_sampler),
+    TEST_FUNC(test_search_probe),
+    TEST_FUNC(test_op_trace),
+    TEST_FUNC(test_dict_cursor),
+    TEST_FUNC(test_dict_export),
+    TEST_FUNC(test_dict_set),
+    TEST_FUNC(test_lsmtree_merge),
     CU_TEST_INFO_NULL
 };
 
@@ -343,6 +413,24 @@ strhash(const void *p)
     return hash;
 }
 
+static unsigned
+int_hash(const void *key)
+{
+    return (unsigned)*(const int *)key * 2654435761U;
+}
+
+static unsigned
+ptr_hash(const void *key)
+{
+    return (unsigned)(uintptr_t)key * 2654435761U;
+}
+
+void test_basic_adaptive()
+{
+    test_basic(adaptive_dict_new(dict_str_cmp, strhash, NULL), keys1, NKEYS1);
+    test_basic(adaptive_dict_new(dict_str_cmp, strhash, NULL), keys2, NKEYS2);
+}
+
 void test_basic_hashtable_1bucket()
 {
     test_basic(hashtable_dict_new(dict_str_cmp, strhash, NULL, 1),
@@ -365,6 +453,16 @@ void test_basic_height_balanced_tree()
     test_basic(hb_dict_new(dict_str_cmp, NULL), keys2, NKEYS2);
 }
 
+void test_basic_lsmtree()
+{
+    test_basic(lsmtree_dict_new(dict_str_cmp, dict_str_hash, NULL, 4),
+	       keys1, NKEYS1);
+    test_basic(lsmtree_dict_new(dict_str_cmp, dict_str_hash, NULL, 4),
+	       keys2, NKEYS2);
+    test_basic(lsmtree_dict_new(dict_str_cmp, NULL, NULL, 1), keys1, NKEYS1);
+    test_basic(lsmtree_dict_new(dict_str_cmp, NULL, NULL, 1), keys2, NKEYS2);
+}
+
 void test_basic_path_reduction_tree()
 {
     test_basic(pr_dict_new(dict_str_cmp, NULL), keys1, NKEYS1);
@@ -377,12 +475,152 @@ void test_basic_red_black_tree()
     test_basic(rb_dict_new(dict_str_cmp, NULL), keys2, NKEYS2);
 }
 
+static size_t sg_mallocs_left, sg_live;
+
+static void *
+sg_failing_malloc(size_t size)
+{
+    if (!sg_mallocs_left)
+	return NULL;
+    sg_mallocs_left--;
+    sg_live++;
+    return malloc(size);
+}
+
+static void
+sg_counting_free(void *p)
+{
+    sg_live--;
+    free(p);
+}
+
+void test_basic_scapegoat_tree()
+{
+    test_basic(sg_dict_new(dict_str_cmp, NULL), keys1, NKEYS1);
+    test_basic(sg_dict_new(dict_str_cmp, NULL), keys2, NKEYS2);
+
+    /* A clone that runs out of memory partway frees the nodes it made. */
+    static int ints[100];
+    dict *dct = sg_dict_new(dict_int_cmp, NULL);
+    for (int i = 0; i < 100; i++) {
+	ints[i] = i;
+	*dict_insert(dct, &ints[i], NULL) = &ints[i];
+    }
+    for (size_t left = 0; left < 101; left += 10) {
+	sg_mallocs_left = left;
+	sg_live = 0;
+	dict_malloc_func = sg_failing_malloc;
+	dict_free_func = sg_counting_free;
+	CU_ASSERT_PTR_NULL(dict_clone(dct, NULL));
+	dict_malloc_func = malloc;
+	dict_free_func = free;
+	CU_ASSERT_EQUAL(sg_live, 0);
+    }
+    dict_free(dct);
+}
+
 void test_basic_skiplist()
 {
     test_basic(skiplist_dict_new(dict_str_cmp, NULL, 13), keys1, NKEYS1);
     test_basic(skiplist_dict_new(dict_str_cmp, NULL, 13), keys2, NKEYS2);
 }
 
+static size_t smallmap_mallocs_left, smallmap_deleted;
+
+static void *
+smallmap_failing_malloc(size_t size)
+{
+    if (!smallmap_mallocs_left)
+	return NULL;
+    smallmap_mallocs_left--;
+    return malloc(size);
+}
+
+static void
+smallmap_count_delete(void *key, void *datum)
+{
+    (void)key;
+    (void)datum;
+    smallmap_deleted++;
+}
+
+static dict *
+smallmap_hashtable_new(dict_compare_func cmp_func, dict_delete_func del_func)
+{
+    return hashtable_dict_new(cmp_func, int_hash, del_func, 7);
+}
+
+void test_basic_smallmap()
+{
+    /* Large enough to hold keys1 without converting. */
+    dict *dct = smallmap_dict_new(dict_str_cmp, NULL, rb_dict_new, NKEYS1);
+    CU_ASSERT_PTR_NOT_NULL(dct);
+    for (unsigned i = 0; i < NKEYS1; ++i)
+	*dict_insert(dct, keys1[i].key, NULL) = keys1[i].value;
+    CU_ASSERT_PTR_NULL(smallmap_backend(dict_private(dct)));
+    CU_ASSERT_TRUE(dict_verify(dct));
+    dict_free(dct);
+
+    test_basic(smallmap_dict_new(dict_str_cmp, NULL, rb_dict_new, NKEYS1),
+	       keys1, NKEYS1);
+    test_basic(smallmap_dict_new(dict_str_cmp, NULL, rb_dict_new, 8),
+	       keys1, NKEYS1);
+    test_basic(smallmap_dict_new(dict_str_cmp, NULL, sp_dict_new, 8),
+	       keys2, NKEYS2);
+    test_basic(smallmap_dict_new(dict_str_cmp, NULL, rb_dict_new, 0),
+	       keys2, NKEYS2);
+
+    /* A conversion that runs out of memory partway frees what it built and
+     * leaves the entries in the array. */
+    static int ints[9] = { 0, 1, 2, 3, 4, 5, 6, 7, 8 };
+    dct = smallmap_dict_new(dict_int_cmp, smallmap_count_delete, rb_dict_new,
+			    8);
+    CU_ASSERT_PTR_NOT_NULL(dct);
+    for (int i = 0; i < 8; i++)
+	*dict_insert(dct, &ints[i], NULL) = &ints[i];
+    smallmap_mallocs_left = 5;	/* The backend, and three of its nodes. */
+    dict_malloc_func = smallmap_failing_malloc;
+    CU_ASSERT_PTR_NULL(dict_insert(dct, &ints[8], NULL));
+    dict_malloc_func = malloc;
+    CU_ASSERT_PTR_NULL(smallmap_backend(dict_private(dct)));
+    CU_ASSERT_EQUAL(dict_count(dct), 8);
+    CU_ASSERT_TRUE(dict_verify(dct));
+    smallmap_deleted = 0;
+    *dict_insert(dct, &ints[8], NULL) = &ints[8];
+    CU_ASSERT_PTR_NOT_NULL(smallmap_backend(dict_private(dct)));
+    CU_ASSERT_EQUAL(smallmap_deleted, 0);
+    CU_ASSERT_TRUE(dict_remove(dct, &ints[3]));
+    CU_ASSERT_EQUAL(smallmap_deleted, 1);
+    CU_ASSERT_FALSE(dict_remove(dct, &ints[3]));
+    CU_ASSERT_PTR_EQUAL(dict_search(dct, &ints[4]), &ints[4]);
+    CU_ASSERT_EQUAL(dict_free(dct), 8);
+    CU_ASSERT_EQUAL(smallmap_deleted, 9);
+
+    /* An unordered backend still finds every stored key to delete it, and
+     * seeks only to a key it holds. */
+    static int more[41];
+    dct = smallmap_dict_new(dict_int_cmp, smallmap_count_delete,
+			    smallmap_hashtable_new, 4);
+    CU_ASSERT_PTR_NOT_NULL(dct);
+    for (int i = 0; i <= 40; i++)
+	more[i] = i;
+    for (int i = 0; i < 40; i++)
+	*dict_insert(dct, &more[i], NULL) = &more[i];
+    CU_ASSERT_PTR_NOT_NULL(smallmap_backend(dict_private(dct)));
+    dict_itor *itor = dict_itor_new(dct);
+    CU_ASSERT_TRUE(dict_itor_first(itor));
+    CU_ASSERT_TRUE(dict_itor_seek(itor, &more[17]));
+    CU_ASSERT_PTR_EQUAL(dict_itor_key(itor), &more[17]);
+    CU_ASSERT_FALSE(dict_itor_seek(itor, &more[40]));
+    dict_itor_free(itor);
+    smallmap_deleted = 0;
+    for (int i = 0; i < 40; i++)
+	CU_ASSERT_TRUE(dict_remove(dct, &more[i * 17 % 40]));
+    CU_ASSERT_EQUAL(smallmap_deleted, 40);
+    CU_ASSERT_EQUAL(dict_count(dct), 0);
+    CU_ASSERT_EQUAL(dict_free(dct), 0);
+}
+
 void test_basic_splay_tree()
 {
     test_basic(sp_dict_new(dict_str_cmp, NULL), keys1, NKEYS1);
@@ -395,6 +633,12 @@ void test_basic_treap()
     test_basic(tr_dict_new(dict_str_cmp, NULL, NULL), keys2, NKEYS2);
 }
 
+void test_basic_weak_avl_tree()
+{
+    test_basic(wavl_dict_new(dict_str_cmp, NULL), keys1, NKEYS1);
+    test_basic(wavl_dict_new(dict_str_cmp, NULL), keys2, NKEYS2);
+}
+
 void test_basic_weight_balanced_tree()
 {
     test_basic(wb_dict_new(dict_str_cmp, NULL), keys1, NKEYS1);
@@ -408,3 +652,2328 @@ void test_version_string()
 	     DICT_VERSION_MAJOR, DICT_VERSION_MINOR, DICT_VERSION_PATCH);
     CU_ASSERT_STRING_EQUAL(kDictVersionString, version_string);
 }
+
+static void
+sum_aggregate(void *agg, const void *key, const void *datum,
+	      const void *left, const void *right)
+{
+    (void)key;
+    long sum = datum ? *(const int *)datum : 0;
+    if (left)
+	sum += *(const long *)left;
+    if (right)
+	sum += *(const long *)right;
+    *(long *)agg = sum;
+}
+
+typedef bool (*set_aggregate_func)(void *, dict_aggregate_func, size_t);
+typedef bool (*update_aggregate_func)(void *, const void *);
+typedef bool (*range_aggregate_func)(void *, const void *, const void *,
+				     void *);
+
+#define AGG_KEYS 1000
+
+static void
+test_range_aggregate_tree(dict *dct, set_aggregate_func set_aggregate,
+			  update_aggregate_func update_aggregate,
+			  range_aggregate_func range_aggregate)
+{
+    static int keys[AGG_KEYS], values[AGG_KEYS];
+    bool present[AGG_KEYS] = { false };
+
+    CU_ASSERT_TRUE(set_aggregate(dict_private(dct), sum_aggregate,
+				 sizeof(long)));
+    for (int i = 0; i < AGG_KEYS; i++) {
+	keys[i] = i;
+	values[i] = i * 3;
+    }
+    for (int i = 0; i < AGG_KEYS * 2; i++) {
+	int k = rand() % AGG_KEYS;
+	if (rand() % 3) {
+	    bool inserted = false;
+	    void **datum_location = dict_insert(dct, &keys[k], &inserted);
+	    CU_ASSERT_PTR_NOT_NULL(datum_location);
+	    *datum_location = &values[k];
+	    present[k] = true;
+	} else {
+	    CU_ASSERT_EQUAL(dict_remove(dct, &keys[k]), present[k]);
+	    present[k] = false;
+	}
+    }
+    CU_ASSERT_TRUE(dict_verify(dct));
+    CU_ASSERT_FALSE(set_aggregate(dict_private(dct), sum_aggregate,
+				  sizeof(long)));
+
+    /* Change a datum behind the tree's back. */
+    int k = 0;
+    while (!present[k])
+	k++;
+    values[k] += 1000;
+    CU_ASSERT_TRUE(update_aggregate(dict_private(dct), &keys[k]));
+    CU_ASSERT_TRUE(dict_verify(dct));
+
+    for (int i = 0; i < 200; i++) {
+	int lo = rand() % AGG_KEYS, hi = rand() % AGG_KEYS;
+	long expected = 0;
+	bool nonempty = false;
+	for (int j = lo; j <= hi; j++) {
+	    if (present[j]) {
+		expected += values[j];
+		nonempty = true;
+	    }
+	}
+	long sum = 0;
+	CU_ASSERT_EQUAL(range_aggregate(dict_private(dct), &keys[lo], &keys[hi],
+					&sum), nonempty);
+	if (nonempty)
+	    CU_ASSERT_EQUAL(sum, expected);
+    }
+    dict_free(dct);
+}
+
+void test_range_aggregate()
+{
+    test_range_aggregate_tree(hb_dict_new(dict_int_cmp, NULL),
+			      (set_aggregate_func)hb_tree_set_aggregate,
+			      (update_aggregate_func)hb_tree_update_aggregate,
+			      (range_aggregate_func)hb_tree_range_aggregate);
+    test_range_aggregate_tree(rb_dict_new(dict_int_cmp, NULL),
+			      (set_aggregate_func)rb_tree_set_aggregate,
+			      (update_aggregate_func)rb_tree_update_aggregate,
+			      (range_aggregate_func)rb_tree_range_aggregate);
+    test_range_aggregate_tree(wb_dict_new(dict_int_cmp, NULL),
+			      (set_aggregate_func)wb_tree_set_aggregate,
+			      (update_aggregate_func)wb_tree_update_aggregate,
+			      (range_aggregate_func)wb_tree_range_aggregate);
+}
+
+#define IV_KEYS 500
+
+static int iv_points[IV_KEYS * 2 + 50];
+static bool iv_overlapping[IV_KEYS];
+static iv_interval iv_keys[IV_KEYS];
+static size_t iv_visited;
+
+static bool
+iv_visit(const void *key, void *datum)
+{
+    const iv_interval *interval = key;
+    CU_ASSERT_PTR_EQUAL(datum, interval);
+    CU_ASSERT_TRUE(iv_overlapping[interval - iv_keys]);
+    ++iv_visited;
+    return true;
+}
+
+static bool
+iv_long(const void *key, void *datum, void *ctx)
+{
+    const iv_interval *interval = key;
+    (void)datum;
+    (void)ctx;
+    return *(int *)interval->hi - *(int *)interval->lo > 25;
+}
+
+static void
+iv_check_overlaps(iv_tree *tree, const bool *present)
+{
+    for (int i = 0; i < 200; i++) {
+	int lo = rand() % (IV_KEYS * 2);
+	int hi = lo + (rand() % 3 ? rand() % 20 : 0);
+	size_t expected = 0;
+	for (int j = 0; j < IV_KEYS; j++) {
+	    iv_overlapping[j] = present[j] &&
+		*(int *)iv_keys[j].lo <= hi && *(int *)iv_keys[j].hi >= lo;
+	    expected += iv_overlapping[j];
+	}
+	iv_visited = 0;
+	CU_ASSERT_EQUAL(iv_tree_overlaps(tree, &iv_points[lo], &iv_points[hi],
+					 iv_visit), expected);
+	CU_ASSERT_EQUAL(iv_visited, expected);
+	if (lo == hi)
+	    CU_ASSERT_EQUAL(iv_tree_stab(tree, &iv_points[lo], iv_visit),
+			    expected);
+    }
+}
+
+void test_interval_tree()
+{
+    for (int i = 0; i < IV_KEYS * 2 + 50; i++)
+	iv_points[i] = i;
+    /* Distinct lower endpoints make every interval distinct. */
+    for (int i = 0; i < IV_KEYS; i++) {
+	iv_keys[i].lo = &iv_points[i * 2];
+	iv_keys[i].hi = &iv_points[i * 2 + rand() % 50];
+    }
+
+    dict *dct = iv_dict_new(dict_int_cmp, NULL);
+    bool present[IV_KEYS] = { false };
+    for (int i = 0; i < IV_KEYS * 3; i++) {
+	int k = rand() % IV_KEYS;
+	if (rand() % 4) {
+	    bool inserted = false;
+	    void **datum_location = dict_insert(dct, &iv_keys[k], &inserted);
+	    CU_ASSERT_PTR_NOT_NULL(datum_location);
+	    CU_ASSERT_EQUAL(inserted, !present[k]);
+	    *datum_location = &iv_keys[k];
+	    present[k] = true;
+	} else {
+	    CU_ASSERT_EQUAL(dict_remove(dct, &iv_keys[k]), present[k]);
+	    present[k] = false;
+	}
+	if (i % 100 == 0)
+	    CU_ASSERT_TRUE(dict_verify(dct));
+    }
+    CU_ASSERT_TRUE(dict_verify(dct));
+
+    iv_check_overlaps(dict_private(dct), present);
+
+    /* Remove the long intervals in one pass. */
+    size_t expected = 0;
+    for (int j = 0; j < IV_KEYS; j++) {
+	if (present[j] && iv_long(&iv_keys[j], NULL, NULL)) {
+	    present[j] = false;
+	    expected++;
+	}
+    }
+    CU_ASSERT_EQUAL(dict_remove_if(dct, iv_long, NULL), expected);
+    CU_ASSERT_TRUE(dict_verify(dct));
+    iv_check_overlaps(dict_private(dct), present);
+    dict_free(dct);
+}
+
+#define DB_KEYS	    20000
+#define DB_PATH	    "unit_tests.db"
+
+void test_db_tree()
+{
+    remove(DB_PATH);
+    /* A small pool makes most operations go to the file. */
+    dict *dct = db_dict_new(DB_PATH, sizeof(int), dict_int_cmp, NULL, 8);
+    CU_ASSERT_PTR_NOT_NULL(dct);
+    if (!dct)
+	return;
+    for (int i = 0; i < DB_KEYS; i++) {
+	int key = (i * 7919) % DB_KEYS;
+	bool inserted = false;
+	void **datum_location = dict_insert(dct, &key, &inserted);
+	CU_ASSERT_PTR_NOT_NULL(datum_location);
+	CU_ASSERT_TRUE(inserted);
+	*datum_location = (void *)(intptr_t)(key + 1);
+    }
+    CU_ASSERT_TRUE(dict_verify(dct));
+    for (int key = 1; key < DB_KEYS; key += 2)
+	CU_ASSERT_TRUE(dict_remove(dct, &key));
+    CU_ASSERT_TRUE(dict_verify(dct));
+    CU_ASSERT_EQUAL(dict_free(dct), DB_KEYS / 2);
+
+    /* The contents survive reopening the file. */
+    db_tree *tree = db_tree_new(DB_PATH, sizeof(int), dict_int_cmp, NULL, 8);
+    CU_ASSERT_PTR_NOT_NULL(tree);
+    if (!tree)
+	return;
+    CU_ASSERT_EQUAL(db_tree_count(tree), DB_KEYS / 2);
+    CU_ASSERT_TRUE(db_tree_verify(tree));
+    size_t reads = 0, reads_after = 0;
+    for (int key = 0; key < DB_KEYS; key++) {
+	db_tree_io_counts(tree, &reads, NULL);
+	CU_ASSERT_EQUAL(db_tree_search(tree, &key),
+			key % 2 ? NULL : (void *)(intptr_t)(key + 1));
+	db_tree_io_counts(tree, &reads_after, NULL);
+	CU_ASSERT_TRUE(reads_after - reads <= db_tree_height(tree));
+    }
+    db_itor *itor = db_itor_new(tree);
+    int expected = DB_KEYS - 2;
+    for (bool valid = db_itor_last(itor); valid; valid = db_itor_prev(itor)) {
+	CU_ASSERT_EQUAL(*(const int *)db_itor_key(itor), expected);
+	expected -= 2;
+    }
+    CU_ASSERT_EQUAL(expected, -2);
+    /* Seeking lands on the first key not less than the one sought, across
+     * leaves, and never moves back. */
+    CU_ASSERT_TRUE(db_itor_first(itor));
+    for (int key = 1; key < DB_KEYS - 2; key += 998) {
+	CU_ASSERT_TRUE(db_itor_seek(itor, &key));
+	CU_ASSERT_EQUAL(*(const int *)db_itor_key(itor), key + 1);
+    }
+    CU_ASSERT_TRUE(db_itor_seek(itor, &(int){ 0 }));
+    CU_ASSERT_FALSE(db_itor_seek(itor, &(int){ DB_KEYS }));
+    CU_ASSERT_FALSE(db_itor_valid(itor));
+    db_itor_free(itor);
+
+    CU_ASSERT_EQUAL(db_tree_clear(tree), DB_KEYS / 2);
+    CU_ASSERT_TRUE(db_tree_verify(tree));
+    db_tree_free(tree);
+    /* A file made with another key size is rejected. */
+    CU_ASSERT_PTR_NULL(db_tree_new(DB_PATH, 8, dict_int_cmp, NULL, 8));
+    remove(DB_PATH);
+}
+
+#define WAL_KEYS    2000
+#define WAL_PATH    "unit_tests.wal"
+
+static size_t wal_int_encode(const void *obj, void *buf, size_t size)
+{
+    if (size >= sizeof(int))
+	memcpy(buf, obj, sizeof(int));
+    return sizeof(int);
+}
+
+static void *wal_int_decode(const void *buf, size_t size)
+{
+    CU_ASSERT_EQUAL(size, sizeof(int));
+    int *obj = malloc(sizeof(int));
+    memcpy(obj, buf, sizeof(int));
+    return obj;
+}
+
+static void wal_int_free(void *key, void *datum)
+{
+    free(key);
+    free(datum);
+}
+
+static const wal_codec wal_int_codec = {
+    wal_int_encode, wal_int_decode, wal_int_encode, wal_int_decode
+};
+
+static dict *wal_open(size_t group)
+{
+    return wal_dict_new(rb_dict_new(dict_int_cmp, wal_int_free), WAL_PATH,
+			&wal_int_codec, wal_int_free, group);
+}
+
+static void wal_check(dict *dct, const bool *present)
+{
+    CU_ASSERT_TRUE(dict_verify(dct));
+    size_t count = 0;
+    for (int i = 0; i < WAL_KEYS; i++) {
+	int *datum = dict_search(dct, &i);
+	CU_ASSERT_EQUAL(datum != NULL, present[i]);
+	if (datum)
+	    CU_ASSERT_EQUAL(*datum, -i);
+	count += present[i];
+    }
+    CU_ASSERT_EQUAL(dict_count(dct), count);
+}
+
+/* Fails the allocations no intact record needs. */
+static void *wal_small_malloc(size_t size)
+{
+    return size <= 65536 ? malloc(size) : NULL;
+}
+
+void test_wal_log()
+{
+    bool present[WAL_KEYS] = { false };
+    remove(WAL_PATH);
+    dict *dct = wal_open(64);
+    CU_ASSERT_PTR_NOT_NULL(dct);
+    if (!dct)
+	return;
+    for (int i = 0; i < WAL_KEYS * 2; i++) {
+	int k = rand() % WAL_KEYS;
+	if (rand() % 3) {
+	    int *key = malloc(sizeof(int)), *datum = malloc(sizeof(int));
+	    *key = k;
+	    *datum = -k;
+	    bool inserted = false;
+	    void **datum_location = dict_insert(dct, key, &inserted);
+	    CU_ASSERT_PTR_NOT_NULL(datum_location);
+	    if (!inserted) {
+		free(key);
+		free(*datum_location);
+	    }
+	    *datum_location = datum;
+	    present[k] = true;
+	} else {
+	    CU_ASSERT_EQUAL(dict_remove(dct, &k), present[k]);
+	    present[k] = false;
+	}
+    }
+    dict_free(dct);
+
+    /* Reopening replays the log. */
+    dct = wal_open(0);
+    CU_ASSERT_PTR_NOT_NULL(dct);
+    if (!dct)
+	return;
+    wal_check(dct, present);
+    const size_t size = wal_log_size(dict_private(dct));
+    CU_ASSERT_TRUE(wal_log_checkpoint(dict_private(dct)));
+    CU_ASSERT_TRUE(wal_log_size(dict_private(dct)) < size);
+    dict_free(dct);
+
+    /* A torn record at the end of the log is dropped. */
+    FILE *fp = fopen(WAL_PATH, "ab");
+    CU_ASSERT_PTR_NOT_NULL(fp);
+    if (fp) {
+	fwrite("I\1\2\3", 1, 4, fp);
+	fclose(fp);
+    }
+    dct = wal_open(0);
+    CU_ASSERT_PTR_NOT_NULL(dct);
+    if (!dct)
+	return;
+    wal_check(dct, present);
+    dict_free(dct);
+
+    /* So is a torn header whose lengths run past the end of the file, without
+     * allocating for them. */
+    long wal_size = 0;
+    fp = fopen(WAL_PATH, "ab");
+    CU_ASSERT_PTR_NOT_NULL(fp);
+    if (fp) {
+	wal_size = ftell(fp);
+	static const unsigned char header[13] = {
+	    0, 0, 0, 0, 'I', 0xf0, 0xff, 0xff, 0xff, 0xf0, 0xff, 0xff, 0xff
+	};
+	fwrite(header, 1, sizeof(header), fp);
+	fclose(fp);
+    }
+    dict_malloc_func = wal_small_malloc;
+    dct = wal_open(0);
+    dict_malloc_func = malloc;
+    CU_ASSERT_PTR_NOT_NULL(dct);
+    if (!dct)
+	return;
+    CU_ASSERT_EQUAL(wal_log_size(dict_private(dct)), (size_t)wal_size);
+    wal_check(dct, present);
+    dict_free(dct);
+    remove(WAL_PATH);
+}
+
+void test_dict_arena()
+{
+    dict_arena_stats before, after;
+    dict_arena_get_stats(&before);
+
+    dict_malloc_func = dict_arena_malloc;
+    dict_free_func = dict_arena_free;
+    test_basic(rb_dict_new(dict_str_cmp, NULL), keys1, NKEYS1);
+    test_basic(hashtable_dict_new(dict_str_cmp, strhash, NULL, 97),
+	       keys2, NKEYS2);
+
+    /* Freed blocks are reused before the region is advanced. */
+    void* p = dict_arena_malloc(40);
+    CU_ASSERT_PTR_NOT_NULL(p);
+    dict_arena_free(p);
+    CU_ASSERT_PTR_EQUAL(dict_arena_malloc(33), p);
+    dict_arena_free(p);
+
+    /* Large blocks are passed on to malloc() and back to free(). */
+    p = dict_arena_malloc(4096);
+    CU_ASSERT_PTR_NOT_NULL(p);
+    dict_arena_free(p);
+    dict_malloc_func = malloc;
+    dict_free_func = free;
+
+    dict_arena_get_stats(&after);
+    CU_ASSERT_EQUAL(after.blocks, before.blocks);
+    CU_ASSERT(after.regions > 0);
+    CU_ASSERT(after.huge_regions <= after.regions);
+    CU_ASSERT(after.fallbacks > before.fallbacks);
+}
+
+typedef bool (*relayout_func)(void *, dict_layout);
+typedef bool (*relayout_step_func)(void *, size_t);
+
+#define RELAYOUT_KEYS 2000
+
+static void
+relayout_check(dict *dct, const bool *present, const int *values)
+{
+    CU_ASSERT_TRUE(dict_verify(dct));
+    size_t count = 0;
+    for (int i = 0; i < RELAYOUT_KEYS; i++) {
+	if (present[i]) {
+	    count++;
+	    CU_ASSERT_PTR_EQUAL(dict_search(dct, &i), &values[i]);
+	} else {
+	    CU_ASSERT_PTR_NULL(dict_search(dct, &i));
+	}
+    }
+    CU_ASSERT_EQUAL(dict_count(dct), count);
+}
+
+static void
+test_relayout_tree(dict *dct, set_aggregate_func set_aggregate,
+		   relayout_func relayout, relayout_step_func relayout_step)
+{
+    static int keys[RELAYOUT_KEYS], values[RELAYOUT_KEYS];
+    bool present[RELAYOUT_KEYS] = { false };
+
+    CU_ASSERT_TRUE(set_aggregate(dict_private(dct), sum_aggregate,
+				 sizeof(long)));
+    CU_ASSERT_TRUE(relayout(dict_private(dct), DICT_LAYOUT_VEB));
+    CU_ASSERT_TRUE(relayout_step(dict_private(dct), 10));
+    for (int i = 0; i < RELAYOUT_KEYS; i++) {
+	keys[i] = i;
+	values[i] = i;
+    }
+    for (int pass = 0; pass < 4; pass++) {
+	for (int i = 0; i < RELAYOUT_KEYS; i++) {
+	    int k = rand() % RELAYOUT_KEYS;
+	    if (rand() % 3) {
+		*dict_insert(dct, &keys[k], NULL) = &values[k];
+		present[k] = true;
+	    } else {
+		CU_ASSERT_EQUAL(dict_remove(dct, &keys[k]), present[k]);
+		present[k] = false;
+	    }
+	}
+	CU_ASSERT_TRUE(relayout(dict_private(dct),
+				pass % 2 ? DICT_LAYOUT_VEB : DICT_LAYOUT_BFS));
+	relayout_check(dct, present, values);
+    }
+
+    /* Steps interleaved with insertions and removals. */
+    size_t steps = 0;
+    bool done = false;
+    while (!done) {
+	done = relayout_step(dict_private(dct), 50);
+	steps++;
+	for (int i = 0; i < 5; i++) {
+	    int k = rand() % RELAYOUT_KEYS;
+	    if (rand() % 2) {
+		*dict_insert(dct, &keys[k], NULL) = &values[k];
+		present[k] = true;
+	    } else {
+		CU_ASSERT_EQUAL(dict_remove(dct, &keys[k]), present[k]);
+		present[k] = false;
+	    }
+	}
+	CU_ASSERT_TRUE(dict_verify(dct));
+	CU_ASSERT(steps < RELAYOUT_KEYS);
+	if (steps == RELAYOUT_KEYS)
+	    break;
+    }
+    relayout_check(dct, present, values);
+
+    /* Uninterrupted steps complete a relayout. */
+    while (!relayout_step(dict_private(dct), 100))
+	/* void */;
+    relayout_check(dct, present, values);
+    dict_free(dct);
+}
+
+void test_tree_relayout()
+{
+    test_relayout_tree(hb_dict_new(dict_int_cmp, NULL),
+		       (set_aggregate_func)hb_tree_set_aggregate,
+		       (relayout_func)hb_tree_relayout,
+		       (relayout_step_func)hb_tree_relayout_step);
+    test_relayout_tree(rb_dict_new(dict_int_cmp, NULL),
+		       (set_aggregate_func)rb_tree_set_aggregate,
+		       (relayout_func)rb_tree_relayout,
+		       (relayout_step_func)rb_tree_relayout_step);
+}
+
+#define ADAPTIVE_KEYS 4096
+
+static size_t adaptive_deleted;
+
+static void
+adaptive_int_delete(void *key, void *datum)
+{
+    (void)key;
+    (void)datum;
+    adaptive_deleted++;
+}
+
+static void
+adaptive_check_order(dict *dct)
+{
+    dict_itor *itor = dict_itor_new(dct);
+    CU_ASSERT_PTR_NOT_NULL(itor);
+    if (!itor)
+	return;
+    int last = -1;
+    size_t n = 0;
+    for (dict_itor_first(itor); dict_itor_valid(itor); dict_itor_next(itor)) {
+	CU_ASSERT(*(const int *)dict_itor_key(itor) > last);
+	last = *(const int *)dict_itor_key(itor);
+	n++;
+    }
+    CU_ASSERT_EQUAL(n, dict_count(dct));
+    dict_itor_free(itor);
+}
+
+void test_adaptive_workload()
+{
+    static int keys[ADAPTIVE_KEYS];
+    dict *dct = adaptive_dict_new(dict_int_cmp, int_hash, adaptive_int_delete);
+    CU_ASSERT_PTR_NOT_NULL(dct);
+    if (!dct)
+	return;
+    adaptive *map = dict_private(dct);
+    adaptive_deleted = 0;
+
+    for (int i = 0; i < ADAPTIVE_KEYS; i++) {
+	keys[i] = i;
+	*dict_insert(dct, &keys[i], NULL) = &keys[i];
+    }
+    CU_ASSERT_EQUAL(adaptive_backend(map), ADAPTIVE_RB_TREE);
+
+    /* Uniform searches and no ordered operations: hashing pays off. */
+    for (int i = 0; i < ADAPTIVE_KEYS * 16; i++) {
+	int k = rand() % ADAPTIVE_KEYS;
+	CU_ASSERT_PTR_EQUAL(dict_search(dct, &k), &keys[k]);
+    }
+    CU_ASSERT_EQUAL(adaptive_backend(map), ADAPTIVE_HASHTABLE);
+    CU_ASSERT_TRUE(dict_verify(dct));
+
+    /* Iterating turns it back into a tree. */
+    adaptive_check_order(dct);
+    CU_ASSERT_EQUAL(adaptive_backend(map), ADAPTIVE_RB_TREE);
+
+    /* Mostly one key, with ordered operations: splaying pays off. */
+    for (int i = 0; i < ADAPTIVE_KEYS * 16; i++) {
+	int k = rand() % 8 ? 7 : rand() % ADAPTIVE_KEYS;
+	CU_ASSERT_PTR_EQUAL(dict_search(dct, &k), &keys[k]);
+	if (i % 1000 == 0)
+	    adaptive_check_order(dct);
+    }
+    CU_ASSERT_EQUAL(adaptive_backend(map), ADAPTIVE_SP_TREE);
+    CU_ASSERT_TRUE(dict_verify(dct));
+
+    /* Removals delete each entry exactly once across migrations. */
+    for (int i = 0; i < ADAPTIVE_KEYS; i += 2)
+	CU_ASSERT_TRUE(dict_remove(dct, &keys[i]));
+    CU_ASSERT_EQUAL(adaptive_deleted, ADAPTIVE_KEYS / 2);
+    adaptive_check_order(dct);
+    size_t migrations = adaptive_migrations(map);
+    CU_ASSERT(migrations >= 3);
+    CU_ASSERT_EQUAL(dict_free(dct), ADAPTIVE_KEYS / 2);
+    CU_ASSERT_EQUAL(adaptive_deleted, ADAPTIVE_KEYS);
+}
+
+#define INLINE_KEYS 1000
+
+/* Inserts even keys through the typed front end, then checks search and a
+ * full iteration, which is in key order for the trees. */
+#define TEST_INLINE(container, itor_type, itor_new, itor_first, itor_free, \
+		    container_free, ordered) \
+    do { \
+	static int keys[INLINE_KEYS]; \
+	CU_ASSERT_PTR_NOT_NULL(container); \
+	if (!container) \
+	    break; \
+	for (int i = 0; i < INLINE_KEYS; i++) { \
+	    keys[i] = (i * 7919) % INLINE_KEYS * 2; \
+	    bool inserted = false; \
+	    void **datum = dict_insert_typed(container, &keys[i], &inserted); \
+	    CU_ASSERT_TRUE(inserted); \
+	    *datum = &keys[i]; \
+	} \
+	for (int k = -1; k <= INLINE_KEYS * 2; k++) { \
+	    int *found = dict_search_typed(container, &k); \
+	    if (k >= 0 && k < INLINE_KEYS * 2 && k % 2 == 0) { \
+		CU_ASSERT_PTR_NOT_NULL(found); \
+		if (found) \
+		    CU_ASSERT_EQUAL(*found, k); \
+	    } else { \
+		CU_ASSERT_PTR_NULL(found); \
+	    } \
+	} \
+	itor_type *itor = itor_new(container); \
+	size_t n = 0; \
+	int last = -1; \
+	/* An invalid iterator's next starts from the first entry, if at \
+	 * all, so position it explicitly. */ \
+	for (itor_first(itor); dict_itor_key_typed(itor); \
+	     dict_itor_next_typed(itor)) { \
+	    const int *key = dict_itor_key_typed(itor); \
+	    CU_ASSERT_PTR_EQUAL(*dict_itor_data_typed(itor), key); \
+	    if (ordered) \
+		CU_ASSERT(*key > last); \
+	    last = *key; \
+	    n++; \
+	} \
+	CU_ASSERT_EQUAL(n, INLINE_KEYS); \
+	CU_ASSERT_PTR_NULL(dict_itor_data_typed(itor)); \
+	itor_free(itor); \
+	CU_ASSERT_EQUAL(container_free(container), INLINE_KEYS); \
+    } while (0)
+
+void test_inline_api()
+{
+    hashtable *ht = hashtable_new(dict_int_cmp, int_hash, NULL, 97);
+    TEST_INLINE(ht, hashtable_itor, hashtable_itor_new, hashtable_itor_first,
+		hashtable_itor_free, hashtable_free, false);
+    hb_tree *hb = hb_tree_new(dict_int_cmp, NULL);
+    TEST_INLINE(hb, hb_itor, hb_itor_new, hb_itor_first, hb_itor_free,
+		hb_tree_free, true);
+    pr_tree *pr = pr_tree_new(dict_int_cmp, NULL);
+    TEST_INLINE(pr, pr_itor, pr_itor_new, pr_itor_first, pr_itor_free,
+		pr_tree_free, true);
+    rb_tree *rb = rb_tree_new(dict_int_cmp, NULL);
+    TEST_INLINE(rb, rb_itor, rb_itor_new, rb_itor_first, rb_itor_free,
+		rb_tree_free, true);
+    sg_tree *sg = sg_tree_new(dict_int_cmp, NULL);
+    TEST_INLINE(sg, sg_itor, sg_itor_new, sg_itor_first, sg_itor_free,
+		sg_tree_free, true);
+    skiplist *sl = skiplist_new(dict_int_cmp, NULL, 13);
+    TEST_INLINE(sl, skiplist_itor, skiplist_itor_new, skiplist_itor_first,
+		skiplist_itor_free, skiplist_free, true);
+    sp_tree *sp = sp_tree_new(dict_int_cmp, NULL);
+    TEST_INLINE(sp, sp_itor, sp_itor_new, sp_itor_first, sp_itor_free,
+		sp_tree_free, true);
+    tr_tree *tr = tr_tree_new(dict_int_cmp, NULL, NULL);
+    TEST_INLINE(tr, tr_itor, tr_itor_new, tr_itor_first, tr_itor_free,
+		tr_tree_free, true);
+    wavl_tree *wavl = wavl_tree_new(dict_int_cmp, NULL);
+    TEST_INLINE(wavl, wavl_itor, wavl_itor_new, wavl_itor_first,
+		wavl_itor_free, wavl_tree_free, true);
+    wb_tree *wb = wb_tree_new(dict_int_cmp, NULL);
+    TEST_INLINE(wb, wb_itor, wb_itor_new, wb_itor_first, wb_itor_free,
+		wb_tree_free, true);
+
+    /* The inline next restarts an invalid red-black iterator, as the
+     * out-of-line one does. */
+    rb = rb_tree_new(dict_int_cmp, NULL);
+    static int one = 1;
+    *rb_tree_insert(rb, &one, NULL) = &one;
+    rb_itor *itor = rb_itor_new(rb);
+    CU_ASSERT_PTR_NULL(rb_itor_key_inline(itor));
+    CU_ASSERT_TRUE(rb_itor_next_inline(itor));
+    CU_ASSERT_PTR_EQUAL(rb_itor_key_inline(itor), &one);
+    CU_ASSERT_FALSE(rb_itor_next_inline(itor));
+    CU_ASSERT_FALSE(rb_itor_valid(itor));
+    rb_itor_free(itor);
+    rb_tree_free(rb);
+}
+
+#define BULK_KEYS 2000
+
+static size_t bulk_deleted;
+
+static void
+bulk_delete(void *key, void *datum)
+{
+    (void)key;
+    (void)datum;
+    bulk_deleted++;
+}
+
+static bool
+bulk_divisible(const void *key, void *datum, void *ctx)
+{
+    (void)datum;
+    return *(const int *)key % *(const int *)ctx == 0;
+}
+
+static void
+bulk_check(dict *dct, int *keys, const bool *present)
+{
+    CU_ASSERT_TRUE(dict_verify(dct));
+    size_t n = 0;
+    for (int i = 0; i < BULK_KEYS; i++) {
+	CU_ASSERT_EQUAL(dict_search(dct, &keys[i]) != NULL, present[i]);
+	n += present[i];
+    }
+    CU_ASSERT_EQUAL(dict_count(dct), n);
+    CU_ASSERT_EQUAL(bulk_deleted, BULK_KEYS - n);
+
+    dict_itor *itor = dict_itor_new(dct);
+    size_t m = 0;
+    for (dict_itor_first(itor); dict_itor_valid(itor); dict_itor_next(itor))
+	m++;
+    CU_ASSERT_EQUAL(m, n);
+    dict_itor_free(itor);
+}
+
+static size_t
+bulk_remove_if(dict *dct, int *keys, bool *present, int divisor)
+{
+    size_t expected = 0;
+    for (int i = 0; i < BULK_KEYS; i++) {
+	if (present[i] && i % divisor == 0) {
+	    present[i] = false;
+	    expected++;
+	}
+    }
+    CU_ASSERT_EQUAL(dict_remove_if(dct, bulk_divisible, &divisor), expected);
+    bulk_check(dct, keys, present);
+    return expected;
+}
+
+static void
+bulk_remove_many(dict *dct, int *keys, bool *present, int residue,
+		 size_t count)
+{
+    static const void *remove[BULK_KEYS + 2];
+    static int missing = -1;
+    size_t n = 0, expected = 0;
+    for (int i = residue; i < BULK_KEYS && n < count; i += 3) {
+	remove[n++] = &keys[i];
+	expected += present[i];
+	present[i] = false;
+    }
+    remove[n++] = &missing;
+    remove[n++] = remove[0];
+    for (size_t i = n - 1; i > 0; i--) {
+	size_t j = (size_t)rand() % (i + 1);
+	const void *t = remove[i]; remove[i] = remove[j]; remove[j] = t;
+    }
+    CU_ASSERT_EQUAL(dict_remove_many(dct, remove, n), expected);
+    bulk_check(dct, keys, present);
+}
+
+static void
+test_bulk_remove_dict(dict *dct, set_aggregate_func set_aggregate,
+		      relayout_func relayout)
+{
+    static int keys[BULK_KEYS];
+    bool present[BULK_KEYS];
+
+    CU_ASSERT_PTR_NOT_NULL(dct);
+    if (!dct)
+	return;
+    if (set_aggregate)
+	CU_ASSERT_TRUE(set_aggregate(dict_private(dct), sum_aggregate,
+				     sizeof(long)));
+    bulk_deleted = 0;
+    for (int i = 0; i < BULK_KEYS; i++) {
+	keys[i] = i;
+	*dict_insert(dct, &keys[i], NULL) = &keys[i];
+	present[i] = true;
+    }
+    if (relayout)
+	CU_ASSERT_TRUE(relayout(dict_private(dct), DICT_LAYOUT_BFS));
+
+    /* A third of the keys, then a few more. */
+    CU_ASSERT_EQUAL(bulk_remove_if(dct, keys, present, 3), BULK_KEYS / 3 + 1);
+    bulk_remove_if(dct, keys, present, 97);
+    /* Many keys, then a few. */
+    bulk_remove_many(dct, keys, present, 1, BULK_KEYS);
+    bulk_remove_many(dct, keys, present, 2, 5);
+    /* No keys. */
+    CU_ASSERT_EQUAL(dict_remove_many(dct, NULL, 0), 0);
+    bulk_remove_if(dct, keys, present, BULK_KEYS * 2);
+
+    size_t count = dict_count(dct);
+    CU_ASSERT_EQUAL(dict_free(dct), count);
+    CU_ASSERT_EQUAL(bulk_deleted, BULK_KEYS);
+}
+
+void test_bulk_remove()
+{
+    test_bulk_remove_dict(adaptive_dict_new(dict_int_cmp, int_hash,
+					    bulk_delete), NULL, NULL);
+    test_bulk_remove_dict(hashtable_dict_new(dict_int_cmp, int_hash,
+					     bulk_delete, 257), NULL, NULL);
+    test_bulk_remove_dict(hb_dict_new(dict_int_cmp, bulk_delete),
+			  (set_aggregate_func)hb_tree_set_aggregate,
+			  (relayout_func)hb_tree_relayout);
+    test_bulk_remove_dict(pr_dict_new(dict_int_cmp, bulk_delete), NULL, NULL);
+    test_bulk_remove_dict(rb_dict_new(dict_int_cmp, bulk_delete),
+			  (set_aggregate_func)rb_tree_set_aggregate,
+			  (relayout_func)rb_tree_relayout);
+    test_bulk_remove_dict(rb_dict_new(dict_int_cmp, bulk_delete), NULL, NULL);
+    test_bulk_remove_dict(sg_dict_new(dict_int_cmp, bulk_delete), NULL, NULL);
+    test_bulk_remove_dict(skiplist_dict_new(dict_int_cmp, bulk_delete, 13),
+			  NULL, NULL);
+    test_bulk_remove_dict(smallmap_dict_new(dict_int_cmp, bulk_delete,
+					    rb_dict_new, 8), NULL, NULL);
+    test_bulk_remove_dict(sp_dict_new(dict_int_cmp, bulk_delete), NULL, NULL);
+    test_bulk_remove_dict(tr_dict_new(dict_int_cmp, NULL, bulk_delete),
+			  NULL, NULL);
+    test_bulk_remove_dict(wavl_dict_new(dict_int_cmp, bulk_delete), NULL, NULL);
+    test_bulk_remove_dict(wb_dict_new(dict_int_cmp, bulk_delete),
+			  (set_aggregate_func)wb_tree_set_aggregate, NULL);
+}
+
+void test_rb_relaxed()
+{
+    static int keys[RELAYOUT_KEYS], values[RELAYOUT_KEYS];
+    bool present[RELAYOUT_KEYS] = { false };
+    dict *dct = rb_dict_new(dict_int_cmp, NULL);
+    rb_tree *tree = dict_private(dct);
+
+    CU_ASSERT_TRUE(rb_tree_set_aggregate(tree, sum_aggregate, sizeof(long)));
+    CU_ASSERT_TRUE(rb_tree_set_relaxed(tree, true));
+    for (int i = 0; i < RELAYOUT_KEYS; i++) {
+	keys[i] = i;
+	values[i] = i;
+    }
+
+    /* Ascending insertions without rebalancing leave a chain of red nodes. */
+    for (int i = 0; i < RELAYOUT_KEYS / 2; i++) {
+	*dict_insert(dct, &keys[i], NULL) = &values[i];
+	present[i] = true;
+    }
+    CU_ASSERT_TRUE(dict_verify(dct));
+    CU_ASSERT(rb_tree_height(tree) > RELAYOUT_KEYS / 4);
+    relayout_check(dct, present, values);
+    size_t steps = 0;
+    while (!rb_tree_rebalance_step(tree, 10))
+	steps++;
+    CU_ASSERT(steps > 0);
+    CU_ASSERT(rb_tree_height(tree) <= 20);
+    CU_ASSERT_TRUE(dict_verify(dct));
+
+    /* Bursts of insertions and removals with steps in between. */
+    for (int pass = 0; pass < 20; pass++) {
+	for (int i = 0; i < RELAYOUT_KEYS / 4; i++) {
+	    int k = rand() % RELAYOUT_KEYS;
+	    if (rand() % 3) {
+		*dict_insert(dct, &keys[k], NULL) = &values[k];
+		present[k] = true;
+	    } else {
+		CU_ASSERT_EQUAL(dict_remove(dct, &keys[k]), present[k]);
+		present[k] = false;
+	    }
+	}
+	CU_ASSERT_TRUE(dict_verify(dct));
+	rb_tree_rebalance_step(tree, 50);
+	CU_ASSERT_TRUE(dict_verify(dct));
+	relayout_check(dct, present, values);
+    }
+
+    /* Leaving relaxed mode finishes the rebalancing. */
+    CU_ASSERT_TRUE(rb_tree_set_relaxed(tree, false));
+    CU_ASSERT_TRUE(rb_tree_rebalance_step(tree, 0));
+    CU_ASSERT_TRUE(dict_verify(dct));
+    relayout_check(dct, present, values);
+    dict_free(dct);
+}
+
+#define SNAPSHOT_KEYS 1000
+
+static int snapshot_deleted[SNAPSHOT_KEYS];
+
+static void
+snapshot_delete(void *key, void *datum)
+{
+    (void)datum;
+    snapshot_deleted[*(int *)key]++;
+}
+
+/* Checks that |itor| visits the keys for which |values| is non-NULL, in order,
+ * with those values. */
+static void
+snapshot_check(skiplist *list, skiplist_snapshot *snapshot,
+	       int *const *values)
+{
+    skiplist_itor *itor = snapshot ? skiplist_snapshot_itor_new(snapshot)
+				   : skiplist_itor_new(list);
+    CU_ASSERT_PTR_NOT_NULL(itor);
+    if (!itor)
+	return;
+    int last = -1;
+    for (skiplist_itor_first(itor); skiplist_itor_valid(itor);
+	 skiplist_itor_next(itor)) {
+	int key = *(const int *)skiplist_itor_key(itor);
+	for (int k = last + 1; k < key; k++)
+	    CU_ASSERT_PTR_NULL(values[k]);
+	CU_ASSERT_PTR_EQUAL(*skiplist_itor_data(itor), values[key]);
+	last = key;
+    }
+    for (int k = last + 1; k < SNAPSHOT_KEYS; k++)
+	CU_ASSERT_PTR_NULL(values[k]);
+    skiplist_itor_free(itor);
+
+    for (int k = 0; k < SNAPSHOT_KEYS; k++) {
+	CU_ASSERT_PTR_EQUAL(snapshot ? skiplist_snapshot_search(snapshot, &k)
+				     : skiplist_search(list, &k), values[k]);
+    }
+}
+
+void test_skiplist_snapshot()
+{
+    static int keys[SNAPSHOT_KEYS], values[2][SNAPSHOT_KEYS];
+    int *current[SNAPSHOT_KEYS] = { NULL }, *seen[2][SNAPSHOT_KEYS];
+    int removals[SNAPSHOT_KEYS] = { 0 };
+    skiplist *list = skiplist_new(dict_int_cmp, snapshot_delete, 13);
+    CU_ASSERT_PTR_NOT_NULL(list);
+    if (!list)
+	return;
+
+    CU_ASSERT_PTR_NULL(skiplist_snapshot_open(list));
+    CU_ASSERT_TRUE(skiplist_set_versioned(list, true));
+    memset(snapshot_deleted, 0, sizeof(snapshot_deleted));
+    for (int i = 0; i < SNAPSHOT_KEYS; i++) {
+	keys[i] = i;
+	values[0][i] = values[1][i] = i;
+	if (i % 2) {
+	    *skiplist_insert(list, &keys[i], NULL) = &values[0][i];
+	    current[i] = &values[0][i];
+	}
+    }
+    CU_ASSERT_FALSE(skiplist_set_versioned(list, false));
+
+    skiplist_snapshot *snapshot[2] = { NULL, NULL };
+    for (int pass = 0; pass < 6; pass++) {
+	/* Alternately reopen each snapshot, then make random changes. */
+	int s = pass % 2;
+	if (snapshot[s])
+	    skiplist_snapshot_close(snapshot[s]);
+	snapshot[s] = skiplist_snapshot_open(list);
+	CU_ASSERT_EQUAL(skiplist_snapshot_sequence(snapshot[s]),
+			skiplist_sequence(list));
+	memcpy(seen[s], current, sizeof(current));
+	for (int i = 0; i < SNAPSHOT_KEYS; i++) {
+	    int k = rand() % SNAPSHOT_KEYS;
+	    if (rand() % 2) {
+		bool inserted;
+		int *value = &values[rand() % 2][k];
+		*skiplist_insert(list, &keys[k], &inserted) = value;
+		CU_ASSERT_EQUAL(inserted, current[k] == NULL);
+		current[k] = value;
+	    } else {
+		CU_ASSERT_EQUAL(skiplist_remove(list, &keys[k]),
+				current[k] != NULL);
+		removals[k] += current[k] != NULL;
+		current[k] = NULL;
+	    }
+	}
+	CU_ASSERT_TRUE(skiplist_verify(list));
+	snapshot_check(list, NULL, current);
+	snapshot_check(list, snapshot[s], seen[s]);
+	if (snapshot[!s])
+	    snapshot_check(list, snapshot[!s], seen[!s]);
+    }
+
+    /* Removed keys are deleted once no snapshot can see them. */
+    size_t present = 0, deferred = 0;
+    for (int k = 0; k < SNAPSHOT_KEYS; k++) {
+	present += current[k] != NULL;
+	CU_ASSERT(snapshot_deleted[k] <= removals[k]);
+	deferred += removals[k] - snapshot_deleted[k];
+    }
+    CU_ASSERT(deferred > 0);
+    skiplist_snapshot_close(snapshot[0]);
+    skiplist_snapshot_close(snapshot[1]);
+    CU_ASSERT_TRUE(skiplist_verify(list));
+    snapshot_check(list, NULL, current);
+    for (int k = 0; k < SNAPSHOT_KEYS; k++)
+	CU_ASSERT_EQUAL(snapshot_deleted[k], removals[k]);
+    CU_ASSERT_EQUAL(skiplist_count(list), present);
+    CU_ASSERT_EQUAL(skiplist_free(list), present);
+    for (int k = 0; k < SNAPSHOT_KEYS; k++)
+	CU_ASSERT_EQUAL(snapshot_deleted[k], removals[k] + (current[k] != NULL));
+}
+
+#define JOIN_KEYS 3000
+
+void test_dict_join()
+{
+    static int keys[JOIN_KEYS];
+    dict *dicts[5] = {
+	rb_dict_new(dict_int_cmp, NULL),
+	skiplist_dict_new(dict_int_cmp, NULL, 13),
+	sg_dict_new(dict_int_cmp, NULL),
+	wavl_dict_new(dict_int_cmp, NULL),
+	smallmap_dict_new(dict_int_cmp, NULL, rb_dict_new, 64),
+    };
+    const int divisors[4] = { 2, 3, 5, 1 };
+    for (int i = 0; i < JOIN_KEYS; i++)
+	keys[i] = i;
+    for (int d = 0; d < 4; d++) {
+	CU_ASSERT_PTR_NOT_NULL(dicts[d]);
+	for (int i = 0; i < JOIN_KEYS; i += divisors[d])
+	    *dict_insert(dicts[d], &keys[i], NULL) = &keys[i];
+    }
+    /* The small map cannot seek, and has only a few of the keys. */
+    CU_ASSERT_PTR_NOT_NULL(dicts[4]);
+    for (int i = 0; i < 10; i++)
+	*dict_insert(dicts[4], &keys[i * 60 + 30 * (i % 2)], NULL) = NULL;
+
+    for (size_t count = 1; count <= 5; count++) {
+	dict_join *join = dict_join_new(dicts, count, dict_int_cmp);
+	CU_ASSERT_PTR_NOT_NULL(join);
+	if (!join)
+	    break;
+	int expected = 0;
+	while (dict_join_next(join)) {
+	    const int key = *(const int *)dict_join_key(join);
+	    /* Keys divisible by 2, 3, then 5, and then those of the small map. */
+	    while (expected < JOIN_KEYS &&
+		   ((count > 0 && expected % 2) ||
+		    (count > 1 && expected % 3) ||
+		    (count > 2 && expected % 5) ||
+		    (count > 4 && !(expected < 600 && expected % 60 ==
+				    30 * (expected / 60 % 2)))))
+		expected++;
+	    CU_ASSERT_EQUAL(key, expected);
+	    for (size_t d = 0; d < count && d < 4; d++)
+		CU_ASSERT_PTR_EQUAL(*dict_join_data(join, d), &keys[key]);
+	    expected++;
+	}
+	CU_ASSERT_PTR_NULL(dict_join_key(join));
+	CU_ASSERT_FALSE(dict_join_next(join));
+	dict_join_free(join);
+    }
+
+    /* Seeking lands on the least key not less than the target, whether that is
+     * the current key, a near neighbour, or far ahead. */
+    dict *(*seekable[])(dict_compare_func, dict_delete_func) = {
+	hb_dict_new, pr_dict_new, rb_dict_new, sg_dict_new, sp_dict_new,
+	wavl_dict_new, wb_dict_new,
+    };
+    for (size_t t = 0; t < sizeof(seekable) / sizeof(seekable[0]); t++) {
+	dict *dct = seekable[t](dict_int_cmp, NULL);
+	for (int i = 7; i < JOIN_KEYS; i += 7)
+	    dict_insert(dct, &keys[i], NULL);
+	dict_itor *itor = dict_itor_new(dct);
+	CU_ASSERT_TRUE(dict_itor_first(itor));
+	int target = 0;
+	for (unsigned step = 0; target < JOIN_KEYS; step++) {
+	    const int lower = target < 7 ? 7 : (target + 6) / 7 * 7;
+	    if (lower >= JOIN_KEYS) {
+		CU_ASSERT_FALSE(dict_itor_seek(itor, &target));
+		CU_ASSERT_FALSE(dict_itor_valid(itor));
+		break;
+	    }
+	    CU_ASSERT_TRUE(dict_itor_seek(itor, &target));
+	    CU_ASSERT_EQUAL(*(const int *)dict_itor_key(itor), lower);
+	    target += (step * 2654435761u) % (step % 4 ? 9 : 400);
+	}
+	dict_itor_free(itor);
+	dict_free(dct);
+    }
+
+    /* An empty input makes the join empty. */
+    dict *empty = hb_dict_new(dict_int_cmp, NULL);
+    dict *pair[2] = { dicts[0], empty };
+    dict_join *join = dict_join_new(pair, 2, dict_int_cmp);
+    CU_ASSERT_FALSE(dict_join_next(join));
+    dict_join_free(join);
+    dict_free(empty);
+    for (int d = 0; d < 5; d++)
+	dict_free(dicts[d]);
+}
+
+#define PGM_KEYS 20000
+
+void test_pgm_index()
+{
+    static void *keys[PGM_KEYS], *data[PGM_KEYS];
+    /* Gaps that change in size now and then, so that the keys do not lie on
+     * a line. */
+    uintptr_t key = 1000, state = 1;
+    for (int i = 0; i < PGM_KEYS; i++) {
+	state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+	key += 1 + (state >> 33) % ((i / 1000 % 4) * 300 + 2);
+	keys[i] = (void *)key;
+	data[i] = &keys[i];
+    }
+    const size_t epsilons[] = { 0, 1, 8, 64, 1000000 };
+    for (size_t e = 0; e < sizeof(epsilons) / sizeof(epsilons[0]); e++) {
+	dict *dct = pgm_dict_new(keys, data, PGM_KEYS, epsilons[e], NULL);
+	CU_ASSERT_PTR_NOT_NULL(dct);
+	if (!dct)
+	    continue;
+	pgm_index *index = dict_private(dct);
+	CU_ASSERT_TRUE(dict_verify(dct));
+	CU_ASSERT_EQUAL(dict_count(dct), PGM_KEYS);
+	CU_ASSERT_TRUE(pgm_index_height(index) > 0);
+	CU_ASSERT_TRUE(pgm_index_segments(index) <= PGM_KEYS / 2);
+	for (int i = 0; i < PGM_KEYS; i++) {
+	    CU_ASSERT_PTR_EQUAL(dict_search(dct, keys[i]), &keys[i]);
+	    /* The keys in between are absent. */
+	    const uintptr_t k = (uintptr_t)keys[i];
+	    if (i + 1 < PGM_KEYS && k + 1 < (uintptr_t)keys[i + 1])
+		CU_ASSERT_PTR_NULL(dict_search(dct, (void *)(k + 1)));
+	}
+	CU_ASSERT_PTR_NULL(dict_search(dct, (void *)(uintptr_t)999));
+	CU_ASSERT_PTR_NULL(dict_search(dct, (void *)(key + 1)));
+	CU_ASSERT_PTR_NULL(dict_search(dct, (void *)UINTPTR_MAX));
+
+	/* Only data can change. */
+	bool inserted = true;
+	void **datum = dict_insert(dct, keys[7], &inserted);
+	CU_ASSERT_FALSE(inserted);
+	CU_ASSERT_PTR_EQUAL(*datum, &keys[7]);
+	*datum = &keys[8];
+	CU_ASSERT_PTR_EQUAL(dict_search(dct, keys[7]), &keys[8]);
+	*datum = &keys[7];
+	CU_ASSERT_PTR_NULL(dict_insert(dct, (void *)(key + 1), NULL));
+	CU_ASSERT_FALSE(dict_remove(dct, keys[7]));
+
+	dict_itor *itor = dict_itor_new(dct);
+	int i = 0;
+	for (dict_itor_first(itor); dict_itor_valid(itor);
+	     dict_itor_next(itor), i++)
+	    CU_ASSERT_PTR_EQUAL(dict_itor_key(itor), keys[i]);
+	CU_ASSERT_EQUAL(i, PGM_KEYS);
+	CU_ASSERT_TRUE(dict_itor_first(itor));
+	for (i = 0; i < PGM_KEYS; i += 1 + i / 16) {
+	    const void *target = (void *)(i ? (uintptr_t)keys[i - 1] + 1 : 0);
+	    CU_ASSERT_TRUE(dict_itor_seek(itor, target));
+	    CU_ASSERT_PTR_EQUAL(dict_itor_key(itor), keys[i]);
+	}
+	CU_ASSERT_FALSE(dict_itor_seek(itor, (void *)(key + 1)));
+	dict_itor_free(itor);
+
+	pgm_itor *pitor = pgm_itor_new(index);
+	CU_ASSERT_TRUE(pgm_itor_search(pitor, keys[PGM_KEYS / 2]));
+	CU_ASSERT_TRUE(pgm_itor_prev(pitor));
+	CU_ASSERT_PTR_EQUAL(pgm_itor_key(pitor), keys[PGM_KEYS / 2 - 1]);
+	CU_ASSERT_FALSE(pgm_itor_search(pitor, (void *)(uintptr_t)999));
+	pgm_itor_free(pitor);
+
+	dict *clone = dict_clone(dct, NULL);
+	CU_ASSERT_TRUE(dict_verify(clone));
+	CU_ASSERT_PTR_EQUAL(dict_search(clone, keys[PGM_KEYS - 1]),
+			    &keys[PGM_KEYS - 1]);
+	CU_ASSERT_EQUAL(dict_clear(clone), PGM_KEYS);
+	CU_ASSERT_TRUE(dict_verify(clone));
+	CU_ASSERT_PTR_NULL(dict_search(clone, keys[0]));
+	dict_free(clone);
+	CU_ASSERT_EQUAL(dict_free(dct), PGM_KEYS);
+    }
+
+    /* Built from another dictionary. */
+    dict *tree = wb_dict_new(dict_ptr_cmp, NULL);
+    for (int i = PGM_KEYS; i-- > 0;)
+	*dict_insert(tree, keys[i], NULL) = data[i];
+    dict *dct = pgm_dict_from_dict(tree, 16, NULL);
+    CU_ASSERT_PTR_NOT_NULL(dct);
+    CU_ASSERT_TRUE(dict_verify(dct));
+    for (int i = 0; i < PGM_KEYS; i++)
+	CU_ASSERT_PTR_EQUAL(dict_search(dct, keys[i]), &keys[i]);
+    dict_free(dct);
+    dict_free(tree);
+
+    /* Keys out of order are refused; no keys at all are fine. */
+    void *swapped[3] = { (void *)1, (void *)3, (void *)2 };
+    CU_ASSERT_PTR_NULL(pgm_dict_new(swapped, NULL, 3, 4, NULL));
+    dct = pgm_dict_new(NULL, NULL, 0, 4, NULL);
+    CU_ASSERT_PTR_NOT_NULL(dct);
+    CU_ASSERT_TRUE(dict_verify(dct));
+    CU_ASSERT_PTR_NULL(dict_search(dct, keys[0]));
+    dict_free(dct);
+}
+
+#define KARY_KEYS 30000
+
+void test_kary_index()
+{
+    static void *keys[KARY_KEYS];
+    /* Keys of 32 bits, then keys needing 64 where pointers have them. */
+    const uintptr_t bases[2] = {
+	0, sizeof(uintptr_t) > 4 ? (uintptr_t)1 << (4 * sizeof(uintptr_t)) : 0
+    };
+    for (int b = 0; b < 2; b++) {
+	uintptr_t key = bases[b], state = 1;
+	for (int i = 0; i < KARY_KEYS; i++) {
+	    state = state * 1103515245 + 12345;
+	    key += 1 + (state >> 16) % 5;
+	    keys[i] = (void *)key;
+	}
+	/* The greatest key value is a key like any other. */
+	keys[KARY_KEYS - 1] = (void *)UINTPTR_MAX;
+	for (size_t count = 0; count <= KARY_KEYS; count += count < 300 ? 1 :
+		 KARY_KEYS / 4) {
+	    dict *dct = kary_dict_new(keys, keys, count, NULL);
+	    CU_ASSERT_PTR_NOT_NULL(dct);
+	    if (!dct)
+		continue;
+	    kary_index *index = dict_private(dct);
+	    CU_ASSERT_TRUE(dict_verify(dct));
+	    CU_ASSERT_EQUAL(dict_count(dct), count);
+	    for (int simd = 0; simd < 2; simd++) {
+		kary_index_use_simd(index, simd);
+		size_t expected = 0;
+		/* Probe every key and the values on either side of it. */
+		for (size_t i = 0; i < count; i++) {
+		    const uintptr_t k = (uintptr_t)keys[i];
+		    CU_ASSERT_EQUAL(kary_index_lower_bound(index, (void *)k), i);
+		    const bool adjacent = i > 0 && (uintptr_t)keys[i - 1] == k - 1;
+		    CU_ASSERT_EQUAL(kary_index_lower_bound(index,
+							   (void *)(k - 1)),
+				    adjacent ? i - 1 : i);
+		    if (k != UINTPTR_MAX)
+			CU_ASSERT_EQUAL(kary_index_lower_bound(index,
+							       (void *)(k + 1)),
+					i + 1);
+		    CU_ASSERT_PTR_EQUAL(dict_search(dct, keys[i]), keys[i]);
+		    expected++;
+		}
+		CU_ASSERT_EQUAL(expected, count);
+	    }
+	    if (count > 1) {
+		CU_ASSERT_PTR_NULL(dict_search(dct,
+					       (void *)((uintptr_t)keys[0] - 1)));
+		CU_ASSERT_PTR_NULL(dict_insert(dct,
+					       (void *)((uintptr_t)keys[0] - 1),
+					       NULL));
+		CU_ASSERT_PTR_NOT_NULL(dict_insert(dct, keys[1], NULL));
+		CU_ASSERT_FALSE(dict_remove(dct, keys[1]));
+	    }
+
+	    dict_itor *itor = dict_itor_new(dct);
+	    size_t i = 0;
+	    for (dict_itor_first(itor); dict_itor_valid(itor);
+		 dict_itor_next(itor), i++)
+		CU_ASSERT_PTR_EQUAL(dict_itor_key(itor), keys[i]);
+	    CU_ASSERT_EQUAL(i, count);
+	    if (count > 0) {
+		CU_ASSERT_TRUE(dict_itor_first(itor));
+		for (i = 1; i < count; i += 1 + i / 8) {
+		    CU_ASSERT_TRUE(dict_itor_seek(itor, keys[i]));
+		    CU_ASSERT_PTR_EQUAL(dict_itor_key(itor), keys[i]);
+		}
+	    }
+	    dict_itor_free(itor);
+
+	    dict *clone = dict_clone(dct, NULL);
+	    CU_ASSERT_TRUE(dict_verify(clone));
+	    CU_ASSERT_EQUAL(dict_free(clone), count);
+	    CU_ASSERT_EQUAL(dict_clear(dct), count);
+	    CU_ASSERT_TRUE(dict_verify(dct));
+	    CU_ASSERT_PTR_NULL(dict_search(dct, keys[0]));
+	    dict_free(dct);
+	}
+    }
+
+    /* Built from another dictionary. */
+    dict *tree = rb_dict_new(dict_ptr_cmp, NULL);
+    for (int i = 0; i < 1000; i++)
+	*dict_insert(tree, keys[i * 7 % 1000], NULL) = &keys[i * 7 % 1000];
+    dict *dct = kary_dict_from_dict(tree, NULL);
+    CU_ASSERT_TRUE(dict_verify(dct));
+    kary_itor *itor = kary_itor_new(dict_private(dct));
+    CU_ASSERT_TRUE(kary_itor_lower_bound(itor, (void *)0));
+    CU_ASSERT_PTR_EQUAL(kary_itor_key(itor), keys[0]);
+    CU_ASSERT_TRUE(kary_itor_search(itor, keys[500]));
+    CU_ASSERT_PTR_EQUAL(*kary_itor_data(itor), &keys[500]);
+    CU_ASSERT_FALSE(kary_itor_lower_bound(itor,
+					  (void *)((uintptr_t)keys[999] + 1)));
+    kary_itor_free(itor);
+    dict_free(dct);
+    dict_free(tree);
+
+    void *swapped[3] = { (void *)1, (void *)3, (void *)2 };
+    CU_ASSERT_PTR_NULL(kary_dict_new(swapped, NULL, 3, NULL));
+}
+
+#define FROZEN_KEYS 20000
+#define FROZEN_PATH "unit_tests.frozen"
+
+/* A poor hash function, so that many keys share hash values. */
+static unsigned
+frozen_weak_hash(const void *key)
+{
+    return dict_str_hash(key) % (FROZEN_KEYS / 4);
+}
+
+static size_t frozen_deleted;
+
+static void
+frozen_count_delete(void *key, void *datum)
+{
+    (void)key;
+    (void)datum;
+    frozen_deleted++;
+}
+
+void test_hashtable_frozen()
+{
+    static char keys[FROZEN_KEYS][8];
+    for (int i = 0; i < FROZEN_KEYS; i++)
+	sprintf(keys[i], "k%06d", i);
+    const dict_hash_func hashes[2] = { dict_str_hash, frozen_weak_hash };
+    for (int h = 0; h < 2; h++) {
+	for (size_t count = 0; count <= FROZEN_KEYS; count += count < 64 ? 1 :
+		 FROZEN_KEYS / 4) {
+	    hashtable *table = hashtable_new(dict_str_cmp, hashes[h],
+					     frozen_count_delete, 997);
+	    for (size_t i = 0; i < count; i++)
+		*hashtable_insert(table, keys[i], NULL) = (void *)i;
+	    dict *dct = hashtable_freeze_dict(table);
+	    CU_ASSERT_PTR_NOT_NULL(dct);
+	    if (!dct) {
+		hashtable_free(table);
+		continue;
+	    }
+	    CU_ASSERT_EQUAL(hashtable_count(table), 0);
+	    CU_ASSERT_EQUAL(hashtable_free(table), 0);
+	    CU_ASSERT_TRUE(dict_verify(dct));
+	    CU_ASSERT_EQUAL(dict_count(dct), count);
+	    for (size_t i = 0; i < count; i++)
+		CU_ASSERT_EQUAL((size_t)dict_search(dct, keys[i]), i);
+	    CU_ASSERT_PTR_NULL(dict_search(dct, "absent"));
+	    if (count < FROZEN_KEYS)
+		CU_ASSERT_PTR_NULL(dict_search(dct, keys[count]));
+
+	    /* Only data can change. */
+	    if (count > 0) {
+		bool inserted = true;
+		void **datum = dict_insert(dct, keys[0], &inserted);
+		CU_ASSERT_FALSE(inserted);
+		CU_ASSERT_PTR_NOT_NULL(datum);
+		CU_ASSERT_FALSE(dict_remove(dct, keys[0]));
+	    }
+	    CU_ASSERT_PTR_NULL(dict_insert(dct, "absent", NULL));
+
+	    /* Iteration visits every key once. */
+	    char *seen = calloc(count + 1, 1);
+	    dict_itor *itor = dict_itor_new(dct);
+	    size_t n = 0;
+	    for (dict_itor_first(itor); dict_itor_valid(itor);
+		 dict_itor_next(itor), n++) {
+		const size_t i = (size_t)*dict_itor_data(itor);
+		CU_ASSERT_STRING_EQUAL(dict_itor_key(itor), keys[i]);
+		CU_ASSERT_FALSE(seen[i]);
+		seen[i] = 1;
+	    }
+	    CU_ASSERT_EQUAL(n, count);
+	    free(seen);
+	    dict_itor_free(itor);
+
+	    /* Saved and mapped back in. */
+	    CU_ASSERT_TRUE(hashtable_frozen_save(dict_private(dct), FROZEN_PATH,
+						 8));
+	    dict *loaded = hashtable_frozen_dict_load(FROZEN_PATH, dict_str_cmp,
+						      hashes[h]);
+	    remove(FROZEN_PATH);
+	    CU_ASSERT_PTR_NOT_NULL(loaded);
+	    if (loaded) {
+		CU_ASSERT_TRUE(dict_verify(loaded));
+		CU_ASSERT_EQUAL(dict_count(loaded), count);
+		for (size_t i = 0; i < count; i++)
+		    CU_ASSERT_EQUAL((size_t)dict_search(loaded, keys[i]), i);
+		CU_ASSERT_PTR_NULL(dict_search(loaded, "absent"));
+		dict_free(loaded);
+	    }
+
+	    dict *clone = dict_clone(dct, NULL);
+	    CU_ASSERT_TRUE(dict_verify(clone));
+	    for (size_t i = 0; i < count; i += 1 + i / 8)
+		CU_ASSERT_EQUAL((size_t)dict_search(clone, keys[i]), i);
+	    frozen_deleted = 0;
+	    CU_ASSERT_EQUAL(dict_clear(clone), count);
+	    CU_ASSERT_EQUAL(frozen_deleted, count);
+	    CU_ASSERT_TRUE(dict_verify(clone));
+	    if (count > 0)
+		CU_ASSERT_PTR_NULL(dict_search(clone, keys[0]));
+	    dict_free(clone);
+	    CU_ASSERT_EQUAL(dict_free(dct), count);
+	}
+    }
+
+    /* A file that is not a frozen table is refused. */
+    FILE *fp = fopen(FROZEN_PATH, "w");
+    CU_ASSERT_PTR_NOT_NULL(fp);
+    if (fp) {
+	for (int i = 0; i < 32; i++)
+	    fputs("not a frozen table\n", fp);
+	fclose(fp);
+	CU_ASSERT_PTR_NULL(hashtable_frozen_load(FROZEN_PATH, dict_str_cmp,
+						 dict_str_hash));
+	remove(FROZEN_PATH);
+    }
+}
+
+#define SHM_NAME "/libdict-unit-tests"
+#define SHM_KEYS 4000
+
+/* Keys that were removed and inserted again have NULL datums. */
+#define SHM_DATUM(k)	((void *)((k) < SHM_KEYS && (k) % 3 == 0 ? 0 : (k) * 2))
+
+static unsigned
+shm_ulong_hash(const void *key)
+{
+    return (unsigned)(*(const unsigned long *)key * 2654435761U);
+}
+
+/* Checks the keys of a shared map in a child process, which then adds some
+ * of its own; returns whether the child succeeded. */
+static bool
+shm_child_run(void)
+{
+    const pid_t pid = fork();
+    if (pid == 0) {
+	dict *dct = shm_dict_open(SHM_NAME, dict_ulong_cmp, shm_ulong_hash);
+	bool ok = dct != NULL;
+	for (unsigned long k = 0; ok && k < SHM_KEYS; k++)
+	    ok = dict_search(dct, &k) == SHM_DATUM(k);
+	for (unsigned long k = SHM_KEYS; ok && k < SHM_KEYS + 100; k++)
+	    ok = shm_map_put(dict_private(dct), &k, (void *)(k * 2));
+	ok = ok && dict_verify(dct);
+	if (dct)
+	    dict_free(dct);
+	_exit(ok ? 0 : 1);
+    }
+    int status;
+    return pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status) &&
+	   WEXITSTATUS(status) == 0;
+}
+
+void test_shm_map()
+{
+    const shm_map_layout layouts[2] = { SHM_MAP_HASHTABLE, SHM_MAP_RB_TREE };
+    for (int l = 0; l < 2; l++) {
+	shm_map_unlink(SHM_NAME);
+	dict *dct = shm_dict_create(SHM_NAME, layouts[l], 1 << 20,
+				    sizeof(unsigned long), 997, dict_ulong_cmp,
+				    shm_ulong_hash);
+	CU_ASSERT_PTR_NOT_NULL(dct);
+	if (!dct)
+	    continue;
+	shm_map *map = dict_private(dct);
+	/* The name is taken. */
+	CU_ASSERT_PTR_NULL(shm_map_create(SHM_NAME, layouts[l], 1 << 20,
+					  sizeof(unsigned long), 997,
+					  dict_ulong_cmp, shm_ulong_hash));
+
+	for (unsigned long k = 0; k < SHM_KEYS; k++) {
+	    const unsigned long key = k * 7919 % SHM_KEYS;
+	    CU_ASSERT_TRUE(shm_map_put(map, &key, (void *)(key * 2)));
+	}
+	CU_ASSERT_EQUAL(dict_count(dct), SHM_KEYS);
+	CU_ASSERT_TRUE(dict_verify(dct));
+	for (unsigned long k = 0; k < SHM_KEYS; k += 3)
+	    CU_ASSERT_TRUE(dict_remove(dct, &k));
+	for (unsigned long k = 0; k < SHM_KEYS; k += 3) {
+	    bool inserted = false;
+	    void **datum = dict_insert(dct, &k, &inserted);
+	    CU_ASSERT_TRUE(inserted);
+	    CU_ASSERT_PTR_NOT_NULL(datum);
+	    CU_ASSERT_PTR_NULL(datum ? *datum : NULL);
+	}
+	CU_ASSERT_FALSE(dict_remove(dct, &(unsigned long){ SHM_KEYS }));
+	CU_ASSERT_TRUE(dict_verify(dct));
+
+	/* Another process sees the same keys, and can add its own. */
+	CU_ASSERT_TRUE(shm_child_run());
+	CU_ASSERT_EQUAL(dict_count(dct), SHM_KEYS + 100);
+	CU_ASSERT_TRUE(dict_verify(dct));
+	for (unsigned long k = 0; k < SHM_KEYS + 100; k++)
+	    CU_ASSERT_EQUAL(dict_search(dct, &k), SHM_DATUM(k));
+
+	dict_itor *itor = dict_itor_new(dct);
+	size_t n = 0;
+	unsigned long last = 0;
+	for (dict_itor_first(itor); dict_itor_valid(itor);
+	     dict_itor_next(itor), n++) {
+	    const unsigned long key = *(const unsigned long *)dict_itor_key(itor);
+	    if (layouts[l] == SHM_MAP_RB_TREE)
+		CU_ASSERT_TRUE(n == 0 || key > last);
+	    last = key;
+	}
+	CU_ASSERT_EQUAL(n, SHM_KEYS + 100);
+	for (dict_itor_last(itor), n = 0; dict_itor_valid(itor);
+	     dict_itor_prev(itor))
+	    n++;
+	CU_ASSERT_EQUAL(n, SHM_KEYS + 100);
+	dict_itor_free(itor);
+
+	/* A cursor does not keep the map locked between moves. */
+	if (layouts[l] == SHM_MAP_RB_TREE) {
+	    dict_cursor *cursor = dict_cursor_new(dct, dict_ulong_cmp);
+	    unsigned long key = 10;
+	    CU_ASSERT_TRUE(dict_cursor_seek(cursor, &key));
+	    CU_ASSERT_EQUAL(*(const unsigned long *)dict_cursor_key(cursor),
+			    key);
+	    CU_ASSERT_TRUE(dict_remove(dct, &(unsigned long){ key + 1 }));
+	    CU_ASSERT_TRUE(dict_cursor_next(cursor));
+	    CU_ASSERT_EQUAL(*(const unsigned long *)dict_cursor_key(cursor),
+			    key + 2);
+	    CU_ASSERT_PTR_EQUAL(*dict_cursor_data(cursor), SHM_DATUM(key + 2));
+	    key++;
+	    CU_ASSERT_TRUE(shm_map_put(map, &key, SHM_DATUM(key)));
+	    dict_cursor_free(cursor);
+	}
+
+	/* Inserting fails once the object is full, until it is cleared. */
+	const size_t room = shm_map_room(map);
+	for (unsigned long k = SHM_KEYS + 100; shm_map_room(map) > 0; k++)
+	    CU_ASSERT_TRUE(shm_map_put(map, &k, NULL));
+	CU_ASSERT_FALSE(shm_map_put(map, &(unsigned long){ 0 - 1UL }, NULL));
+	CU_ASSERT_EQUAL(dict_count(dct), SHM_KEYS + 100 + room);
+	CU_ASSERT_TRUE(dict_verify(dct));
+	CU_ASSERT_EQUAL(dict_clear(dct), SHM_KEYS + 100 + room);
+	CU_ASSERT_EQUAL(shm_map_room(map), room + SHM_KEYS + 100);
+	CU_ASSERT_TRUE(dict_verify(dct));
+	CU_ASSERT_PTR_NULL(dict_clone(dct, NULL));
+	CU_ASSERT_EQUAL(dict_free(dct), 0);
+	CU_ASSERT_TRUE(shm_map_unlink(SHM_NAME));
+    }
+    CU_ASSERT_PTR_NULL(shm_map_open(SHM_NAME, dict_ulong_cmp, shm_ulong_hash));
+}
+
+typedef struct {
+    size_t	    calls[3];
+    const dict*	    dct;
+    const void*	    key;
+} sample_counts;
+
+static void
+sample_count(dict_op op, const dict *dct, const void *key, uint64_t nsec,
+	     void *ctx)
+{
+    sample_counts *counts = ctx;
+    (void)nsec;
+    CU_ASSERT_TRUE(op <= DICT_OP_REMOVE);
+    CU_ASSERT_PTR_EQUAL(dct, counts->dct);
+    counts->calls[op]++;
+    counts->key = key;
+}
+
+#define SAMPLE_THREADS 4
+#define SAMPLE_SEARCHES 1000
+
+static pthread_mutex_t sample_mutex = PTHREAD_MUTEX_INITIALIZER;
+static size_t sample_thread_calls;
+
+static void
+sample_count_locked(dict_op op, const dict *dct, const void *key,
+		    uint64_t nsec, void *ctx)
+{
+    (void)op, (void)dct, (void)key, (void)nsec, (void)ctx;
+    pthread_mutex_lock(&sample_mutex);
+    sample_thread_calls++;
+    pthread_mutex_unlock(&sample_mutex);
+}
+
+static void *
+sample_searches(void *arg)
+{
+    for (uintptr_t k = 1; k <= SAMPLE_SEARCHES; k++)
+	dict_search((dict *)arg, (void *)k);
+    return NULL;
+}
+
+void test_sampler()
+{
+    dict *dct = hb_dict_new(dict_ptr_cmp, NULL);
+    sample_counts counts = { { 0, 0, 0 }, dct, NULL };
+
+    /* Every operation is timed with an interval of 1. */
+    dict_set_sampler(1, sample_count, &counts);
+    for (uintptr_t k = 1; k <= 100; k++)
+	CU_ASSERT_PTR_NOT_NULL(dict_insert(dct, (void *)k, NULL));
+    CU_ASSERT_EQUAL(counts.calls[DICT_OP_INSERT], 100);
+    CU_ASSERT_PTR_EQUAL(counts.key, (void *)100);
+    CU_ASSERT_PTR_NULL(dict_search(dct, (void *)1));
+    CU_ASSERT_TRUE(dict_remove(dct, (void *)1));
+    CU_ASSERT_EQUAL(counts.calls[DICT_OP_SEARCH], 1);
+    CU_ASSERT_EQUAL(counts.calls[DICT_OP_REMOVE], 1);
+
+    /* One in ten, whatever the operation. */
+    dict_set_sampler(10, sample_count, &counts);
+    for (uintptr_t k = 1; k <= 100; k++)
+	dict_search(dct, (void *)k);
+    for (uintptr_t k = 2; k <= 51; k++)
+	CU_ASSERT_TRUE(dict_remove(dct, (void *)k));
+    CU_ASSERT_EQUAL(counts.calls[DICT_OP_SEARCH], 1 + 10);
+    CU_ASSERT_EQUAL(counts.calls[DICT_OP_REMOVE], 1 + 5);
+    CU_ASSERT_EQUAL(dict_count(dct), 49);
+
+    /* Operations within the library, such as the removals made by
+     * dict_remove_many() for containers without their own, are not
+     * sampled. */
+    dict_set_sampler(1, sample_count, &counts);
+    dict *list = skiplist_dict_new(dict_ptr_cmp, NULL, 8);
+    counts.dct = list;
+    for (uintptr_t k = 1; k <= 10; k++)
+	dict_insert(list, (void *)k, NULL);
+    const void *keys[] = { (void *)2, (void *)4 };
+    CU_ASSERT_EQUAL(dict_remove_many(list, keys, 2), 2);
+    CU_ASSERT_EQUAL(counts.calls[DICT_OP_INSERT], 110);
+    CU_ASSERT_EQUAL(counts.calls[DICT_OP_REMOVE], 6);
+    dict_free(list);
+
+    /* Each thread counts its own calls, so none are lost to the others. */
+    dict_set_sampler(10, sample_count_locked, NULL);
+    pthread_t threads[SAMPLE_THREADS];
+    for (int i = 0; i < SAMPLE_THREADS; i++)
+	CU_ASSERT_EQUAL(pthread_create(&threads[i], NULL, sample_searches, dct),
+			0);
+    for (int i = 0; i < SAMPLE_THREADS; i++)
+	pthread_join(threads[i], NULL);
+    CU_ASSERT_EQUAL(sample_thread_calls,
+		    SAMPLE_THREADS * SAMPLE_SEARCHES / 10);
+
+    /* Turning sampling off stops the calls. */
+    dict_set_sampler(0, sample_count, &counts);
+    CU_ASSERT_EQUAL(dict_sample_every, 0);
+    dict_insert(dct, (void *)1000, NULL);
+    CU_ASSERT_EQUAL(counts.calls[DICT_OP_INSERT], 110);
+    dict_free(dct);
+}
+
+#define PROBE_KEYS 1000
+
+static size_t probe_compares;
+
+static int
+probe_int_cmp(const void *a, const void *b)
+{
+    probe_compares++;
+    return dict_int_cmp(a, b);
+}
+
+static dict *
+probe_tr_new(dict_compare_func cmp_func, dict_delete_func del_func)
+{
+    return tr_dict_new(cmp_func, NULL, del_func);
+}
+
+/* A search through dict_search() reaches each tree's own search, which fires
+ * the search probe; with the probe's semaphore raised, it also walks the path
+ * to the key to report its depth, which doubles the comparisons made. */
+void test_search_probe()
+{
+    static int keys[PROBE_KEYS];
+    dict *(*dict_new[])(dict_compare_func, dict_delete_func) = {
+	hb_dict_new, pr_dict_new, probe_tr_new, wavl_dict_new, wb_dict_new,
+    };
+    dict_search_func searches[] = {
+	(dict_search_func)hb_tree_search, (dict_search_func)pr_tree_search,
+	(dict_search_func)tr_tree_search, (dict_search_func)wavl_tree_search,
+	(dict_search_func)wb_tree_search,
+    };
+    for (int i = 0; i < PROBE_KEYS; i++)
+	keys[i] = i;
+    for (size_t t = 0; t < sizeof(dict_new) / sizeof(dict_new[0]); t++) {
+	dict *dct = dict_new[t](probe_int_cmp, NULL);
+	CU_ASSERT_PTR_EQUAL(dct->_vtable->search, searches[t]);
+	for (int i = 0; i < PROBE_KEYS; i++)
+	    *dict_insert(dct, &keys[i], NULL) = &keys[i];
+	probe_compares = 0;
+	CU_ASSERT_PTR_EQUAL(dict_search(dct, &keys[PROBE_KEYS / 3]),
+			    &keys[PROBE_KEYS / 3]);
+	const size_t compares = probe_compares;
+	CU_ASSERT_TRUE(compares > 0);
+#if defined(TEST_USDT)
+	libdict_search_semaphore++;
+	probe_compares = 0;
+	CU_ASSERT_PTR_EQUAL(dict_search(dct, &keys[PROBE_KEYS / 3]),
+			    &keys[PROBE_KEYS / 3]);
+	libdict_search_semaphore--;
+	CU_ASSERT_EQUAL(probe_compares, 2 * compares);
+#endif
+	dict_free(dct);
+    }
+}
+
+#define TRACE_PATH  "unit_tests.trace"
+#define TRACE_KEYS  1000
+
+static size_t
+trace_str_encode(const void *key, void *buf, size_t size)
+{
+    const size_t len = strlen(key);
+    if (size >= len)
+	memcpy(buf, key, len);
+    return len;
+}
+
+void test_op_trace()
+{
+    /* Serialized keys, one of them larger than the trace's buffer. */
+    char *big = malloc(100001);
+    memset(big, 'x', 100000);
+    big[100000] = '\0';
+    struct {
+	dict_op	    op;
+	const char* key;
+	int	    result;
+    } ops[] = {
+	{ DICT_OP_INSERT, "apple", 1 }, { DICT_OP_INSERT, "pear", 1 },
+	{ DICT_OP_INSERT, "apple", 0 }, { DICT_OP_SEARCH, "fig", 0 },
+	{ DICT_OP_SEARCH, "pear", 1 }, { DICT_OP_INSERT, big, 1 },
+	{ DICT_OP_REMOVE, "fig", 0 }, { DICT_OP_REMOVE, "apple", 1 },
+	{ DICT_OP_CLEAR, NULL, 1 }, { DICT_OP_SEARCH, big, 0 },
+    };
+    const size_t nops = sizeof(ops) / sizeof(ops[0]);
+    dict *dct = op_trace_dict_new(hb_dict_new(dict_str_cmp, NULL), TRACE_PATH,
+				  trace_str_encode);
+    CU_ASSERT_PTR_NOT_NULL(dct);
+    if (!dct)
+	return;
+    for (size_t i = 0; i < nops; i++) {
+	void *key = (void *)ops[i].key;
+	bool inserted = false;
+	switch (ops[i].op) {
+	case DICT_OP_INSERT:
+	    *dict_insert(dct, key, &inserted) = key;
+	    CU_ASSERT_EQUAL(inserted, ops[i].result);
+	    break;
+	case DICT_OP_SEARCH:
+	    CU_ASSERT_EQUAL(dict_search(dct, key) != NULL, ops[i].result);
+	    break;
+	case DICT_OP_REMOVE:
+	    CU_ASSERT_EQUAL(dict_remove(dct, key), ops[i].result);
+	    break;
+	case DICT_OP_CLEAR:
+	    CU_ASSERT_EQUAL(dict_clear(dct), 2);
+	    break;
+	}
+    }
+    CU_ASSERT_TRUE(dict_verify(dct));
+    CU_ASSERT_EQUAL(op_trace_records(dict_private(dct)), nops);
+    CU_ASSERT_PTR_NULL(dict_clone(dct, NULL));
+    CU_ASSERT_EQUAL(dict_free(dct), 0);
+
+    op_trace_reader *reader = op_trace_reader_open(TRACE_PATH);
+    CU_ASSERT_PTR_NOT_NULL(reader);
+    if (!reader)
+	return;
+    CU_ASSERT_TRUE(op_trace_reader_keys(reader));
+    op_trace_record record;
+    uint64_t nsec = 0;
+    size_t n = 0;
+    while (op_trace_reader_next(reader, &record)) {
+	CU_ASSERT_TRUE(n < nops);
+	if (n >= nops)
+	    break;
+	CU_ASSERT_EQUAL(record.op, ops[n].op);
+	CU_ASSERT_EQUAL(record.result, ops[n].result);
+	CU_ASSERT_TRUE(record.nsec >= nsec);
+	nsec = record.nsec;
+	const size_t len = ops[n].key ? strlen(ops[n].key) : 0;
+	CU_ASSERT_EQUAL(record.key_size, len);
+	CU_ASSERT_TRUE(len == 0 || memcmp(record.key, ops[n].key, len) == 0);
+	n++;
+    }
+    CU_ASSERT_EQUAL(n, nops);
+    op_trace_reader_close(reader);
+    free(big);
+
+    /* Key IDs; a record cut short ends the trace before it. */
+    dct = op_trace_dict_new(hashtable_dict_new(dict_ptr_cmp, ptr_hash,
+					       NULL, 97), TRACE_PATH, NULL);
+    for (uintptr_t k = 1; k <= TRACE_KEYS; k++)
+	*dict_insert(dct, (void *)k, NULL) = (void *)k;
+    for (uintptr_t k = 2; k <= TRACE_KEYS; k += 2)
+	CU_ASSERT_TRUE(dict_remove(dct, (void *)k));
+    for (uintptr_t k = 1; k <= TRACE_KEYS; k++)
+	CU_ASSERT_EQUAL(dict_search(dct, (void *)k) != NULL, k % 2);
+    CU_ASSERT_EQUAL(dict_free(dct), TRACE_KEYS / 2);
+    reader = op_trace_reader_open(TRACE_PATH);
+    CU_ASSERT_PTR_NOT_NULL(reader);
+    if (!reader)
+	return;
+    CU_ASSERT_FALSE(op_trace_reader_keys(reader));
+    size_t counts[3] = { 0, 0, 0 };
+    for (n = 0; op_trace_reader_next(reader, &record); n++) {
+	CU_ASSERT_TRUE(record.op <= DICT_OP_REMOVE);
+	CU_ASSERT_PTR_NULL(record.key);
+	if (record.op == DICT_OP_SEARCH)
+	    CU_ASSERT_EQUAL(record.result, (int)(record.key_id % 2));
+	else
+	    CU_ASSERT_EQUAL(record.result, 1);
+	counts[record.op % 3]++;
+    }
+    CU_ASSERT_EQUAL(counts[DICT_OP_INSERT], TRACE_KEYS);
+    CU_ASSERT_EQUAL(counts[DICT_OP_REMOVE], TRACE_KEYS / 2);
+    CU_ASSERT_EQUAL(counts[DICT_OP_SEARCH], TRACE_KEYS);
+    op_trace_reader_close(reader);
+
+    FILE *file = fopen(TRACE_PATH, "rb");
+    CU_ASSERT_PTR_NOT_NULL(file);
+    fseek(file, 0, SEEK_END);
+    const long size = ftell(file);
+    fclose(file);
+    CU_ASSERT_EQUAL(truncate(TRACE_PATH, size - 1), 0);
+    reader = op_trace_reader_open(TRACE_PATH);
+    for (n = 0; op_trace_reader_next(reader, &record); n++)
+	/* void */;
+    CU_ASSERT_EQUAL(n, TRACE_KEYS * 5 / 2 - 1);
+    op_trace_reader_close(reader);
+    remove(TRACE_PATH);
+    CU_ASSERT_PTR_NULL(op_trace_reader_open(TRACE_PATH));
+}
+
+#define CURSOR_KEYS 4000
+
+static dict *
+cursor_smallmap_new(dict_compare_func cmp_func, dict_delete_func del_func)
+{
+    return smallmap_dict_new(cmp_func, del_func, rb_dict_new, 64);
+}
+
+static dict *
+cursor_skiplist_new(dict_compare_func cmp_func, dict_delete_func del_func)
+{
+    return skiplist_dict_new(cmp_func, del_func, 13);
+}
+
+static dict *
+cursor_lsmtree_new(dict_compare_func cmp_func, dict_delete_func del_func)
+{
+    return lsmtree_dict_new(cmp_func, NULL, del_func, 64);
+}
+
+static dict *
+cursor_adaptive_new(dict_compare_func cmp_func, dict_delete_func del_func)
+{
+    return adaptive_dict_new(cmp_func, int_hash, del_func);
+}
+
+/* Return the least key after |key| that is present, or CURSOR_KEYS. */
+static int
+cursor_expected(const bool *present, int key)
+{
+    while (++key < CURSOR_KEYS && !present[key])
+	/* void */;
+    return key;
+}
+
+void test_dict_cursor()
+{
+    static int keys[CURSOR_KEYS];
+    static bool present[CURSOR_KEYS];
+    dict *(*dict_new[])(dict_compare_func, dict_delete_func) = {
+	hb_dict_new, pr_dict_new, rb_dict_new, sg_dict_new, sp_dict_new,
+	wavl_dict_new, wb_dict_new, cursor_skiplist_new, cursor_smallmap_new,
+	cursor_lsmtree_new, cursor_adaptive_new,
+    };
+    for (int i = 0; i < CURSOR_KEYS; i++)
+	keys[i] = i;
+
+    for (size_t t = 0; t < sizeof(dict_new) / sizeof(dict_new[0]); t++) {
+	dict *dct = dict_new[t](dict_int_cmp, NULL);
+	CU_ASSERT_PTR_NOT_NULL(dct);
+	for (int i = 0; i < CURSOR_KEYS; i++)
+	    if ((present[i] = i % 2 == 0 && i < CURSOR_KEYS - 10))
+		*dict_insert(dct, &keys[i], NULL) = &keys[i];
+
+	dict_cursor *cursor = dict_cursor_new(dct, dict_int_cmp);
+	CU_ASSERT_PTR_NOT_NULL(cursor);
+	CU_ASSERT_PTR_NULL(dict_cursor_key(cursor));
+	int expected = cursor_expected(present, -1);
+	while (dict_cursor_next(cursor)) {
+	    const int key = *(const int *)dict_cursor_key(cursor);
+	    CU_ASSERT_EQUAL(key, expected);
+	    CU_ASSERT_PTR_EQUAL(*dict_cursor_data(cursor), &keys[key]);
+	    /* Insert keys behind and just ahead of the cursor, and remove the
+	     * key it is on and the one after it. */
+	    if (key % 4 == 0 && key + 1 < CURSOR_KEYS && !present[key + 1]) {
+		*dict_insert(dct, &keys[key + 1], NULL) = &keys[key + 1];
+		present[key + 1] = true;
+	    }
+	    if (key % 10 == 0 && key > 0 && !present[key - 1]) {
+		*dict_insert(dct, &keys[key - 1], NULL) = &keys[key - 1];
+		present[key - 1] = true;
+	    }
+	    if (key % 6 == 0) {
+		CU_ASSERT_TRUE(dict_remove(dct, &keys[key]));
+		present[key] = false;
+		CU_ASSERT_PTR_NULL(dict_cursor_data(cursor));
+		CU_ASSERT_EQUAL(*(const int *)dict_cursor_key(cursor), key);
+	    }
+	    const int next = cursor_expected(present, key);
+	    if (key % 14 == 0 && next < CURSOR_KEYS) {
+		CU_ASSERT_TRUE(dict_remove(dct, &keys[next]));
+		present[next] = false;
+	    }
+	    if (present[key])
+		CU_ASSERT_PTR_EQUAL(*dict_cursor_data(cursor), &keys[key]);
+	    expected = cursor_expected(present, key);
+	}
+	CU_ASSERT_EQUAL(expected, CURSOR_KEYS);
+	CU_ASSERT_PTR_NULL(dict_cursor_key(cursor));
+	CU_ASSERT_FALSE(dict_cursor_next(cursor));
+
+	/* Keys added after the end are found. */
+	*dict_insert(dct, &keys[CURSOR_KEYS - 1], NULL) = &keys[CURSOR_KEYS - 1];
+	CU_ASSERT_TRUE(dict_cursor_next(cursor));
+	CU_ASSERT_EQUAL(*(const int *)dict_cursor_key(cursor), CURSOR_KEYS - 1);
+	CU_ASSERT_FALSE(dict_cursor_next(cursor));
+
+	/* A failed seek keeps its key, and finds keys not less than it. */
+	CU_ASSERT_TRUE(dict_cursor_seek(cursor, &keys[101]));
+	CU_ASSERT_EQUAL(*(const int *)dict_cursor_key(cursor),
+			cursor_expected(present, 100));
+	CU_ASSERT_TRUE(dict_remove(dct, &keys[CURSOR_KEYS - 1]));
+	CU_ASSERT_FALSE(dict_cursor_seek(cursor, &keys[CURSOR_KEYS - 3]));
+	*dict_insert(dct, &keys[CURSOR_KEYS - 3], NULL) = &keys[CURSOR_KEYS - 3];
+	CU_ASSERT_TRUE(dict_cursor_next(cursor));
+	CU_ASSERT_EQUAL(*(const int *)dict_cursor_key(cursor), CURSOR_KEYS - 3);
+
+	/* Clearing the dictionary is a modification like any other. */
+	dict_clear(dct);
+	CU_ASSERT_FALSE(dict_cursor_next(cursor));
+	CU_ASSERT_PTR_NULL(dict_cursor_data(cursor));
+	dict_cursor_free(cursor);
+	CU_ASSERT_TRUE(dict_verify(dct));
+	dict_free(dct);
+    }
+}
+
+#define EXPORT_KEYS 50000
+#define EXPORT_CHUNK 37
+
+static int
+export_ptr_cmp(const void *a, const void *b)
+{
+    return dict_ptr_cmp(*(void *const *)a, *(void *const *)b);
+}
+
+/* Check that OUT_KEYS holds the COUNT keys of KEYS, in order if ORDERED, with
+ * each key's datum, which is the key itself, in OUT_DATA. */
+static void
+export_compare(void **keys, void **out_keys, void **out_data, size_t count,
+	       bool ordered)
+{
+    size_t mismatches = 0;
+    for (size_t i = 0; i < count; i++)
+	mismatches += out_data[i] != out_keys[i];
+    if (!ordered)
+	qsort(out_keys, count, sizeof(*out_keys), export_ptr_cmp);
+    for (size_t i = 0; i < count; i++)
+	mismatches += out_keys[i] != keys[i];
+    CU_ASSERT_EQUAL(mismatches, 0);
+}
+
+static void
+export_check(dict *dct, void **keys, size_t count, bool ordered)
+{
+    CU_ASSERT_PTR_NOT_NULL(dct);
+    if (!dct)
+	return;
+    CU_ASSERT_EQUAL(dict_count(dct), count);
+    void **out_keys = malloc((count + EXPORT_CHUNK) * sizeof(*out_keys));
+    void **out_data = malloc((count + EXPORT_CHUNK) * sizeof(*out_data));
+
+    /* In chunks, each resuming where the last stopped. */
+    dict_export_pos pos = DICT_EXPORT_START;
+    size_t n = 0, chunk;
+    while ((chunk = dict_export(dct, out_keys + n, out_data + n, EXPORT_CHUNK,
+				&pos)) == EXPORT_CHUNK)
+	n += chunk;
+    n += chunk;
+    CU_ASSERT_EQUAL(n, count);
+    CU_ASSERT_EQUAL(dict_export(dct, out_keys, NULL, EXPORT_CHUNK, &pos), 0);
+    dict_export_end(&pos);
+    export_compare(keys, out_keys, out_data, count, ordered);
+
+    /* All at once, on several threads if the container can. */
+    memset(out_keys, 0, count * sizeof(*out_keys));
+    memset(out_data, 0, count * sizeof(*out_data));
+    CU_ASSERT_EQUAL(dict_export_all(dct, out_keys, out_data, 4), count);
+    export_compare(keys, out_keys, out_data, count, ordered);
+
+    /* Only the keys, of a walk abandoned partway. */
+    dict_export_pos partial = DICT_EXPORT_START;
+    CU_ASSERT_EQUAL(dict_export(dct, out_keys, NULL, 10, &partial),
+		    count < 10 ? count : 10);
+    dict_export_end(&partial);
+
+    free(out_keys);
+    free(out_data);
+    dict_free(dct);
+}
+
+void test_dict_export()
+{
+    void **keys = malloc(EXPORT_KEYS * sizeof(*keys));
+    void **shuffled = malloc(EXPORT_KEYS * sizeof(*shuffled));
+    for (size_t i = 0; i < EXPORT_KEYS; i++) {
+	keys[i] = (void *)(uintptr_t)(3 * i + 1);
+	size_t j = (size_t)rand() % (i + 1);
+	shuffled[i] = shuffled[j];
+	shuffled[j] = keys[i];
+    }
+
+    dict *(*dict_new[])(dict_compare_func, dict_delete_func) = {
+	hb_dict_new, pr_dict_new, rb_dict_new, sg_dict_new, sp_dict_new,
+	wavl_dict_new, wb_dict_new, cursor_skiplist_new, cursor_smallmap_new,
+    };
+    const size_t counts[] = { 0, 1, EXPORT_CHUNK, 1000, EXPORT_KEYS };
+    for (size_t t = 0; t < sizeof(dict_new) / sizeof(dict_new[0]); t++) {
+	for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+	    dict *dct = dict_new[t](dict_ptr_cmp, NULL);
+	    for (size_t i = 0; i < EXPORT_KEYS; i++)
+		if ((uintptr_t)shuffled[i] <= 3 * counts[c])
+		    *dict_insert(dct, shuffled[i], NULL) = shuffled[i];
+	    export_check(dct, keys, counts[c], true);
+	}
+    }
+
+    hashtable *table = hashtable_new(dict_ptr_cmp, ptr_hash, NULL, 997);
+    for (size_t i = 0; i < EXPORT_KEYS; i++)
+	*hashtable_insert(table, shuffled[i], NULL) = shuffled[i];
+    export_check(hashtable_freeze_dict(table), keys, EXPORT_KEYS, false);
+    hashtable_free(table);
+    export_check(hashtable_dict_new(dict_ptr_cmp, ptr_hash, NULL, 997),
+		 keys, 0, false);
+    dict *dct = hashtable_dict_new(dict_ptr_cmp, ptr_hash, NULL, 997);
+    for (size_t i = 0; i < EXPORT_KEYS; i++)
+	*dict_insert(dct, shuffled[i], NULL) = shuffled[i];
+    export_check(dct, keys, EXPORT_KEYS, false);
+
+    export_check(kary_dict_new(keys, keys, EXPORT_KEYS, NULL), keys,
+		 EXPORT_KEYS, true);
+    export_check(pgm_dict_new(keys, keys, EXPORT_KEYS, 16, NULL), keys,
+		 EXPORT_KEYS, true);
+    free(shuffled);
+    free(keys);
+}
+
+#define SET_KEYS 2000
+
+static size_t set_deleted, set_visited;
+
+static void
+set_key_delete(void *key, void *datum)
+{
+    (void)key;
+    CU_ASSERT_PTR_NULL(datum);
+    set_deleted++;
+}
+
+static bool
+set_datum_visit(const void *key, void *datum)
+{
+    (void)key;
+    set_visited += datum == DICT_SET_MEMBER;
+    return true;
+}
+
+/* Counts the members of a subtree. */
+static void
+set_count_aggregate(void *agg, const void *key, const void *datum,
+		    const void *left, const void *right)
+{
+    (void)key;
+    long count = datum == DICT_SET_MEMBER;
+    if (left)
+	count += *(const long *)left;
+    if (right)
+	count += *(const long *)right;
+    *(long *)agg = count;
+}
+
+static bool
+set_odd_pred(const void *key, void *datum, void *ctx)
+{
+    (void)ctx;
+    CU_ASSERT_PTR_EQUAL(datum, DICT_SET_MEMBER);
+    return *(const int *)key % 2;
+}
+
+static dict *
+set_skiplist_new(dict_compare_func cmp_func, dict_delete_func del_func)
+{
+    return skiplist_dict_new_set(cmp_func, del_func, 13);
+}
+
+static dict *
+set_hashtable_new(dict_compare_func cmp_func, dict_delete_func del_func)
+{
+    return hashtable_dict_new_set(cmp_func, int_hash, del_func, 97);
+}
+
+static dict *
+set_tr_new(dict_compare_func cmp_func, dict_delete_func del_func)
+{
+    return tr_dict_new_set(cmp_func, NULL, del_func);
+}
+
+static void
+test_set_dict(dict *dct, const int *keys)
+{
+    CU_ASSERT_PTR_NOT_NULL(dct);
+    if (!dct)
+	return;
+    set_deleted = 0;
+    for (int i = 0; i < SET_KEYS; i++) {
+	bool inserted = false;
+	void **datum = dict_insert(dct, (void *)&keys[i], &inserted);
+	CU_ASSERT_PTR_NOT_NULL(datum);
+	CU_ASSERT_TRUE(inserted);
+	if (!datum)
+	    continue;
+	CU_ASSERT_PTR_EQUAL(*datum, DICT_SET_MEMBER);
+	*datum = (void *)&keys[i];	/* Discarded. */
+    }
+    bool inserted = true;
+    CU_ASSERT_PTR_NOT_NULL(dict_insert(dct, (void *)&keys[0], &inserted));
+    CU_ASSERT_FALSE(inserted);
+    CU_ASSERT_TRUE(dict_verify(dct));
+    CU_ASSERT_EQUAL(dict_count(dct), SET_KEYS);
+
+    size_t members = 0;
+    for (int i = 0; i < SET_KEYS; i++)
+	members += dict_search(dct, &keys[i]) == DICT_SET_MEMBER;
+    CU_ASSERT_EQUAL(members, SET_KEYS);
+    const int absent = -1;
+    CU_ASSERT_PTR_NULL(dict_search(dct, &absent));
+
+    set_visited = 0;
+    CU_ASSERT_EQUAL(dict_traverse(dct, set_datum_visit), SET_KEYS);
+    CU_ASSERT_EQUAL(set_visited, SET_KEYS);
+    members = 0;
+    dict_itor *itor = dict_itor_new(dct);
+    for (dict_itor_first(itor); dict_itor_valid(itor); dict_itor_next(itor))
+	members += *dict_itor_data(itor) == DICT_SET_MEMBER;
+    dict_itor_free(itor);
+    CU_ASSERT_EQUAL(members, SET_KEYS);
+
+    void **out_keys = malloc(SET_KEYS * sizeof(*out_keys));
+    void **out_data = malloc(SET_KEYS * sizeof(*out_data));
+    CU_ASSERT_EQUAL(dict_export_all(dct, out_keys, out_data, 1), SET_KEYS);
+    members = 0;
+    for (int i = 0; i < SET_KEYS; i++)
+	members += out_data[i] == DICT_SET_MEMBER;
+    CU_ASSERT_EQUAL(members, SET_KEYS);
+    free(out_keys);
+    free(out_data);
+
+    dict *clone = dict_clone(dct, NULL);
+    CU_ASSERT_PTR_NOT_NULL(clone);
+    if (clone) {
+	CU_ASSERT_TRUE(dict_verify(clone));
+	CU_ASSERT_EQUAL(dict_count(clone), SET_KEYS);
+	CU_ASSERT_PTR_EQUAL(dict_search(clone, &keys[1]), DICT_SET_MEMBER);
+	CU_ASSERT_EQUAL(dict_free(clone), SET_KEYS);
+	CU_ASSERT_EQUAL(set_deleted, SET_KEYS);
+	set_deleted = 0;
+    }
+
+    CU_ASSERT_EQUAL(dict_remove_if(dct, set_odd_pred, NULL), SET_KEYS / 2);
+    CU_ASSERT_EQUAL(set_deleted, SET_KEYS / 2);
+    const int two = 2;
+    CU_ASSERT_TRUE(dict_remove(dct, &two));
+    CU_ASSERT_PTR_NULL(dict_search(dct, &two));
+    CU_ASSERT_TRUE(dict_verify(dct));
+    CU_ASSERT_EQUAL(dict_free(dct), SET_KEYS / 2 - 1);
+    CU_ASSERT_EQUAL(set_deleted, SET_KEYS);
+}
+
+void test_dict_set()
+{
+    static int keys[SET_KEYS];
+    for (int i = 0; i < SET_KEYS; i++) {
+	int j = rand() % (i + 1);
+	keys[i] = keys[j];
+	keys[j] = i + 1;
+    }
+
+    dict *(*dict_new[])(dict_compare_func, dict_delete_func) = {
+	hb_dict_new_set, pr_dict_new_set, rb_dict_new_set, sg_dict_new_set,
+	sp_dict_new_set, set_tr_new, wavl_dict_new_set, wb_dict_new_set,
+	set_skiplist_new, set_hashtable_new,
+    };
+    for (size_t t = 0; t < sizeof(dict_new) / sizeof(dict_new[0]); t++)
+	test_set_dict(dict_new[t](dict_int_cmp, set_key_delete), keys);
+
+    /* Aggregates and relayouts see the sentinel as every datum. */
+    rb_tree *tree = rb_tree_new_set(dict_int_cmp, NULL);
+    CU_ASSERT_TRUE(rb_tree_set_aggregate(tree, set_count_aggregate,
+				       sizeof(long)));
+    for (int i = 0; i < SET_KEYS; i++)
+	rb_tree_insert(tree, &keys[i], NULL);
+    CU_ASSERT_TRUE(rb_tree_relayout(tree, DICT_LAYOUT_VEB));
+    CU_ASSERT_TRUE(rb_tree_verify(tree));
+    CU_ASSERT_PTR_EQUAL(rb_tree_search_inline(tree, &keys[0]),
+			DICT_SET_MEMBER);
+    const int lo = 11, hi = 110;
+    long count = 0;
+    CU_ASSERT_TRUE(rb_tree_range_aggregate(tree, &lo, &hi, &count));
+    CU_ASSERT_EQUAL(count, 100);
+    CU_ASSERT_EQUAL(rb_tree_free(tree), SET_KEYS);
+
+    /* As they do in a tree whose nodes keep a balance field before it. */
+    hb_tree *hb = hb_tree_new_set(dict_int_cmp, NULL);
+    CU_ASSERT_TRUE(hb_tree_set_aggregate(hb, set_count_aggregate,
+				       sizeof(long)));
+    for (int i = 0; i < SET_KEYS; i++)
+	hb_tree_insert(hb, &keys[i], NULL);
+    CU_ASSERT_TRUE(hb_tree_relayout(hb, DICT_LAYOUT_BFS));
+    CU_ASSERT_TRUE(hb_tree_verify(hb));
+    CU_ASSERT_PTR_EQUAL(hb_tree_search_inline(hb, &keys[0]),
+			DICT_SET_MEMBER);
+    count = 0;
+    CU_ASSERT_TRUE(hb_tree_range_aggregate(hb, &lo, &hi, &count));
+    CU_ASSERT_EQUAL(count, 100);
+    CU_ASSERT_EQUAL(hb_tree_free(hb), SET_KEYS);
+
+    /* A frozen set answers searches like the table it was frozen from. */
+    hashtable *table = hashtable_new_set(dict_int_cmp, int_hash, NULL, 97);
+    for (int i = 0; i < SET_KEYS; i++)
+	hashtable_insert(table, &keys[i], NULL);
+    CU_ASSERT_PTR_EQUAL(hashtable_search_inline(table, &keys[0]),
+			DICT_SET_MEMBER);
+    hashtable_frozen *frozen = hashtable_freeze(table);
+    CU_ASSERT_PTR_NOT_NULL(frozen);
+    if (frozen) {
+	CU_ASSERT_TRUE(hashtable_frozen_verify(frozen));
+	CU_ASSERT_PTR_EQUAL(hashtable_frozen_search(frozen, &keys[0]),
+			    DICT_SET_MEMBER);
+	CU_ASSERT_EQUAL(hashtable_frozen_free(frozen), SET_KEYS);
+    }
+    hashtable_free(table);
+
+    /* A snapshot of a versioned set still sees keys removed after it. */
+    skiplist *list = skiplist_new_set(dict_int_cmp, NULL, 13);
+    CU_ASSERT_TRUE(skiplist_set_versioned(list, true));
+    for (int i = 0; i < SET_KEYS; i++)
+	skiplist_insert(list, &keys[i], NULL);
+    skiplist_snapshot *snapshot = skiplist_snapshot_open(list);
+    CU_ASSERT_TRUE(skiplist_remove(list, &keys[0]));
+    CU_ASSERT_PTR_NULL(skiplist_search(list, &keys[0]));
+    CU_ASSERT_PTR_EQUAL(skiplist_snapshot_search(snapshot, &keys[0]),
+			DICT_SET_MEMBER);
+    CU_ASSERT_TRUE(skiplist_verify(list));
+    skiplist_snapshot_close(snapshot);
+    skiplist_free(list);
+}
+
+#define LSM_KEYS 20000
+
+void test_lsmtree_merge()
+{
+    static int keys[LSM_KEYS];
+    for (int i = 0; i < LSM_KEYS; i++)
+	keys[i] = (int)((i * 7919U) % LSM_KEYS);
+
+    /* Merges are left pending by the insertions that start them, and the tree
+     * can be searched, changed and cloned while they are. */
+    lsmtree *tree = lsmtree_new(dict_int_cmp, int_hash, NULL, 16);
+    size_t pending = 0, max_runs = 0;
+    for (int i = 0; i < LSM_KEYS; i++) {
+	bool inserted = false;
+	void **datum = lsmtree_insert(tree, &keys[i], &inserted);
+	CU_ASSERT_TRUE(inserted);
+	*datum = &keys[i];
+	if (lsmtree_run_count(tree) > max_runs)
+	    max_runs = lsmtree_run_count(tree);
+	if (lsmtree_merge_step(tree, 0) || pending++ % 512)
+	    continue;
+	const int *key = &keys[i / 2];
+	CU_ASSERT_TRUE(lsmtree_remove(tree, key));
+	CU_ASSERT_PTR_NULL(lsmtree_search(tree, key));
+	datum = lsmtree_insert(tree, (void *)key, &inserted);
+	CU_ASSERT_TRUE(inserted);
+	*datum = (void *)key;
+	CU_ASSERT_TRUE(lsmtree_verify(tree));
+	lsmtree *clone = lsmtree_clone(tree, NULL);
+	CU_ASSERT_TRUE(lsmtree_verify(clone));
+	while (!lsmtree_merge_step(clone, 64))
+	    /* void */;
+	CU_ASSERT_TRUE(lsmtree_verify(clone));
+	CU_ASSERT_EQUAL(lsmtree_count(clone), (size_t)i + 1);
+	lsmtree_free(clone);
+    }
+    CU_ASSERT_TRUE(pending > 0);
+    CU_ASSERT_TRUE(max_runs <= 20);
+    for (int i = 0; i < LSM_KEYS; i++)
+	CU_ASSERT_PTR_EQUAL(lsmtree_search(tree, &keys[i]), &keys[i]);
+    while (!lsmtree_merge_step(tree, 64))
+	/* void */;
+    CU_ASSERT_TRUE(lsmtree_verify(tree));
+    CU_ASSERT_TRUE(lsmtree_run_count(tree) <= 16);
+
+    /* Removals rewrite the runs they empty by half through merges as well. */
+    for (int i = 0; i < LSM_KEYS; i += 2) {
+	CU_ASSERT_TRUE(lsmtree_remove(tree, &keys[i]));
+	if (i % 1024 == 0)
+	    CU_ASSERT_TRUE(lsmtree_verify(tree));
+    }
+    while (!lsmtree_merge_step(tree, 64))
+	/* void */;
+    CU_ASSERT_TRUE(lsmtree_verify(tree));
+    CU_ASSERT_EQUAL(lsmtree_count(tree), LSM_KEYS / 2);
+    for (int i = 0; i < LSM_KEYS; i++)
+	CU_ASSERT_PTR_EQUAL(lsmtree_search(tree, &keys[i]),
+			    i % 2 ? &keys[i] : NULL);
+    lsmtree_free(tree);
+}